@@ -45,6 +45,7 @@
 #include "qapi/qapi-types-common.h"
 #include "qapi/qapi-visit-common.h"
 #include "sysemu/reset.h"
+#include "monitor/stats.h"
 
 #include "hw/boards.h"
 
@@ -102,6 +103,12 @@ struct KVMState
     OnOffAuto kernel_irqchip_split;
     bool sync_mmu;
     bool manual_dirty_log_protect;
+    /* Dirty ring entries per vCPU, 0 when dirty rings are not in use.  */
+    uint32_t kvm_dirty_ring_size;
+    uint32_t kvm_dirty_ring_bytes;
+    QemuThread kvm_dirty_ring_reaper;
+    /* Userspace halt polling limit for halts that exit to QEMU */
+    uint32_t halt_poll_max_ns;
     /* The man page (and posix) say ioctl numbers are signed int, but
      * they're not.  Linux, glibc and *BSD all treat ioctl numbers as
      * unsigned, and treating them as signed here can break things */
@@ -160,8 +167,14 @@ static const KVMCapabilityInfo kvm_required_capabilites[] = {
 static NotifierList kvm_irqchip_change_notifiers =
     NOTIFIER_LIST_INITIALIZER(kvm_irqchip_change_notifiers);
 
-#define kvm_slots_lock(kml)      qemu_mutex_lock(&(kml)->slots_lock)
-#define kvm_slots_unlock(kml)    qemu_mutex_unlock(&(kml)->slots_lock)
+/*
+ * Protects the slots of all the KVMMemoryListeners and everything inside
+ * them. A single lock since a dirty ring holds pages of any address space.
+ */
+static QemuMutex kml_slots_lock;
+
+#define kvm_slots_lock()    qemu_mutex_lock(&kml_slots_lock)
+#define kvm_slots_unlock()  qemu_mutex_unlock(&kml_slots_lock)
 
 int kvm_get_max_memslots(void)
 {
@@ -190,60 +203,92 @@ int kvm_memcrypt_encrypt_data(uint8_t *ptr, uint64_t len)
     return 1;
 }
 
-/* Called with KVMMemoryListener.slots_lock held */
-static KVMSlot *kvm_get_free_slot(KVMMemoryListener *kml)
-{
-    KVMState *s = kvm_state;
-    int i;
-
-    for (i = 0; i < s->nr_slots; i++) {
-        if (kml->slots[i].memory_size == 0) {
-            return &kml->slots[i];
-        }
-    }
-
-    return NULL;
-}
-
 bool kvm_has_free_slot(MachineState *ms)
 {
     KVMState *s = KVM_STATE(ms->accelerator);
     bool result;
     KVMMemoryListener *kml = &s->memory_listener;
 
-    kvm_slots_lock(kml);
-    result = !!kvm_get_free_slot(kml);
-    kvm_slots_unlock(kml);
+    kvm_slots_lock();
+    result = kml->nr_free_slots > 0;
+    kvm_slots_unlock();
 
     return result;
 }
 
-/* Called with KVMMemoryListener.slots_lock held */
-static KVMSlot *kvm_alloc_slot(KVMMemoryListener *kml)
+/*
+ * Return the index in kml->used_slots of the first slot that ends after
+ * @addr, or kml->nr_used_slots if there is none.
+ */
+static int kvm_slot_search(KVMMemoryListener *kml, hwaddr addr)
 {
-    KVMSlot *slot = kvm_get_free_slot(kml);
+    int lo = 0, hi = kml->nr_used_slots;
 
-    if (slot) {
-        return slot;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        KVMSlot *mem = kml->used_slots[mid];
+
+        if (mem->start_addr + mem->memory_size <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
 
-    fprintf(stderr, "%s: no free slot available\n", __func__);
-    abort();
+    return lo;
+}
+
+/* Called with kml_slots_lock held */
+static KVMSlot *kvm_alloc_slot(KVMMemoryListener *kml, hwaddr start_addr,
+                               hwaddr size)
+{
+    KVMSlot *mem;
+    int i;
+
+    if (!kml->nr_free_slots) {
+        fprintf(stderr, "%s: no free slot available\n", __func__);
+        abort();
+    }
+
+    mem = &kml->slots[kml->free_slots[--kml->nr_free_slots]];
+    mem->start_addr = start_addr;
+    mem->memory_size = size;
+
+    i = kvm_slot_search(kml, start_addr);
+    memmove(&kml->used_slots[i + 1], &kml->used_slots[i],
+            (kml->nr_used_slots - i) * sizeof(kml->used_slots[0]));
+    kml->used_slots[i] = mem;
+    kml->nr_used_slots++;
+
+    return mem;
+}
+
+/* Called with kml_slots_lock held, before the slot is cleared */
+static void kvm_free_slot(KVMMemoryListener *kml, KVMSlot *mem)
+{
+    int i = kvm_slot_search(kml, mem->start_addr);
+
+    assert(i < kml->nr_used_slots && kml->used_slots[i] == mem);
+    kml->nr_used_slots--;
+    memmove(&kml->used_slots[i], &kml->used_slots[i + 1],
+            (kml->nr_used_slots - i) * sizeof(kml->used_slots[0]));
+    kml->free_slots[kml->nr_free_slots++] = mem->slot;
 }
 
 static KVMSlot *kvm_lookup_matching_slot(KVMMemoryListener *kml,
                                          hwaddr start_addr,
                                          hwaddr size)
 {
-    KVMState *s = kvm_state;
-    int i;
+    int i = kvm_slot_search(kml, start_addr);
+    KVMSlot *mem;
 
-    for (i = 0; i < s->nr_slots; i++) {
-        KVMSlot *mem = &kml->slots[i];
+    if (i == kml->nr_used_slots) {
+        return NULL;
+    }
 
-        if (start_addr == mem->start_addr && size == mem->memory_size) {
-            return mem;
-        }
+    mem = kml->used_slots[i];
+    if (start_addr == mem->start_addr && size == mem->memory_size) {
+        return mem;
     }
 
     return NULL;
@@ -279,7 +324,7 @@ int kvm_physical_memory_addr_from_host(KVMState *s, void *ram,
     KVMMemoryListener *kml = &s->memory_listener;
     int i, ret = 0;
 
-    kvm_slots_lock(kml);
+    kvm_slots_lock();
     for (i = 0; i < s->nr_slots; i++) {
         KVMSlot *mem = &kml->slots[i];
 
@@ -289,7 +334,7 @@ int kvm_physical_memory_addr_from_host(KVMState *s, void *ram,
             break;
         }
     }
-    kvm_slots_unlock(kml);
+    kvm_slots_unlock();
 
     return ret;
 }
@@ -355,6 +400,14 @@ int kvm_destroy_vcpu(CPUState *cpu)
         goto err;
     }
 
+    if (cpu->kvm_dirty_gfns) {
+        ret = munmap(cpu->kvm_dirty_gfns, s->kvm_dirty_ring_bytes);
+        if (ret < 0) {
+            goto err;
+        }
+        cpu->kvm_dirty_gfns = NULL;
+    }
+
     vcpu = g_malloc0(sizeof(*vcpu));
     vcpu->vcpu_id = kvm_arch_vcpu_id(cpu);
     vcpu->kvm_fd = cpu->kvm_fd;
@@ -398,6 +451,7 @@ int kvm_init_vcpu(CPUState *cpu)
     cpu->kvm_fd = ret;
     cpu->kvm_state = s;
     cpu->vcpu_dirty = true;
+    cpu->halt_poll_max_ns = s->halt_poll_max_ns;
 
     mmap_size = kvm_ioctl(s, KVM_GET_VCPU_MMAP_SIZE, 0);
     if (mmap_size < 0) {
@@ -419,6 +473,20 @@ int kvm_init_vcpu(CPUState *cpu)
             (void *)cpu->kvm_run + s->coalesced_mmio * PAGE_SIZE;
     }
 
+    if (s->kvm_dirty_ring_size) {
+        /* Use MAP_SHARED to share pages with the kernel */
+        cpu->kvm_dirty_gfns = mmap(NULL, s->kvm_dirty_ring_bytes,
+                                   PROT_READ | PROT_WRITE, MAP_SHARED,
+                                   cpu->kvm_fd,
+                                   PAGE_SIZE * KVM_DIRTY_LOG_PAGE_OFFSET);
+        if (cpu->kvm_dirty_gfns == MAP_FAILED) {
+            ret = -errno;
+            DPRINTF("mmap'ing vcpu dirty gfns failed: %d\n", ret);
+            goto err;
+        }
+        cpu->kvm_fetch_index = 0;
+    }
+
     ret = kvm_arch_init_vcpu(cpu);
 err:
     return ret;
@@ -442,7 +510,7 @@ static int kvm_mem_flags(MemoryRegion *mr)
     return flags;
 }
 
-/* Called with KVMMemoryListener.slots_lock held */
+/* Called with kml_slots_lock held */
 static int kvm_slot_update_flags(KVMMemoryListener *kml, KVMSlot *mem,
                                  MemoryRegion *mr)
 {
@@ -468,7 +536,7 @@ static int kvm_section_update_flags(KVMMemoryListener *kml,
         return 0;
     }
 
-    kvm_slots_lock(kml);
+    kvm_slots_lock();
 
     while (size && !ret) {
         slot_size = MIN(kvm_max_slot_size, size);
@@ -484,7 +552,7 @@ static int kvm_section_update_flags(KVMMemoryListener *kml,
     }
 
 out:
-    kvm_slots_unlock(kml);
+    kvm_slots_unlock();
     return ret;
 }
 
@@ -557,13 +625,183 @@ static void kvm_memslot_init_dirty_bitmap(KVMSlot *mem)
     mem->dirty_bmap = g_malloc0(bitmap_size);
 }
 
+/*
+ * Dirty ring support.
+ *
+ * With KVM_CAP_DIRTY_LOG_RING every vCPU has a ring of dirtied GFNs that
+ * is shared with the kernel, instead of KVM keeping a bitmap per slot.
+ * Harvesting the rings costs in proportion to the number of pages dirtied
+ * since the last harvest rather than to the size of the guest. Harvested
+ * pages are collected into the dirty_bmap of their slot and handed over
+ * to the ram dirty bitmap on log sync.
+ */
+
+/* Called with kml_slots_lock held */
+static void kvm_dirty_ring_mark_page(KVMState *s, uint32_t as_id,
+                                     uint32_t slot_id, uint64_t offset)
+{
+    KVMMemoryListener *kml;
+    KVMSlot *mem;
+
+    if (as_id >= s->nr_as || slot_id >= s->nr_slots) {
+        return;
+    }
+
+    kml = s->as[as_id].ml;
+    if (!kml) {
+        return;
+    }
+
+    mem = &kml->slots[slot_id];
+    if (!mem->memory_size ||
+        offset >= (mem->memory_size / qemu_real_host_page_size)) {
+        return;
+    }
+
+    if (!mem->dirty_bmap) {
+        kvm_memslot_init_dirty_bitmap(mem);
+    }
+    set_bit(offset, mem->dirty_bmap);
+}
+
+static bool dirty_gfn_is_dirtied(struct kvm_dirty_gfn *gfn)
+{
+    /*
+     * Read the flags before the value. Pairs with the barrier in KVM's
+     * kvm_dirty_ring_push().
+     */
+    return atomic_load_acquire(&gfn->flags) == KVM_DIRTY_GFN_F_DIRTY;
+}
+
+static void dirty_gfn_set_collected(struct kvm_dirty_gfn *gfn)
+{
+    /*
+     * Use a store-release so that the CPU that executes
+     * KVM_RESET_DIRTY_RINGS sees the full content of the ring.
+     */
+    atomic_store_release(&gfn->flags, KVM_DIRTY_GFN_F_RESET);
+}
+
+/* Called with kml_slots_lock held */
+static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
+{
+    struct kvm_dirty_gfn *dirty_gfns = cpu->kvm_dirty_gfns, *cur;
+    uint32_t ring_size = s->kvm_dirty_ring_size;
+    uint32_t count = 0, fetch = cpu->kvm_fetch_index;
+
+    while (true) {
+        cur = &dirty_gfns[fetch % ring_size];
+        if (!dirty_gfn_is_dirtied(cur)) {
+            break;
+        }
+        kvm_dirty_ring_mark_page(s, cur->slot >> 16, cur->slot & 0xffff,
+                                 cur->offset);
+        dirty_gfn_set_collected(cur);
+        fetch++;
+        count++;
+    }
+    cpu->kvm_fetch_index = fetch;
+
+    return count;
+}
+
+/* Called with kml_slots_lock and the BQL held */
+static uint64_t kvm_dirty_ring_reap_locked(KVMState *s)
+{
+    uint64_t total = 0;
+    CPUState *cpu;
+    int ret;
+
+    CPU_FOREACH(cpu) {
+        if (cpu->kvm_dirty_gfns) {
+            total += kvm_dirty_ring_reap_one(s, cpu);
+        }
+    }
+
+    if (total) {
+        /* Let KVM write protect the harvested pages again.  */
+        ret = kvm_vm_ioctl(s, KVM_RESET_DIRTY_RINGS);
+        assert(ret == total);
+    }
+
+    trace_kvm_dirty_ring_reap(total);
+    return total;
+}
+
+/* Called with the BQL held */
+static uint64_t kvm_dirty_ring_reap(KVMState *s)
+{
+    uint64_t total;
+
+    kvm_slots_lock();
+    total = kvm_dirty_ring_reap_locked(s);
+    kvm_slots_unlock();
+
+    return total;
+}
+
+static void do_kvm_cpu_synchronize_kick(CPUState *cpu, run_on_cpu_data arg)
+{
+    /* No need to do anything */
+}
+
+/*
+ * Flush all the dirty pages into the slot bitmaps. Guest writes are only
+ * guaranteed to be in the rings once the vCPUs have left the guest, e.g.
+ * PML buffers are flushed on vmexit, so kick them all out first.
+ *
+ * Called with the BQL held.
+ */
+static void kvm_dirty_ring_flush(KVMState *s)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        run_on_cpu(cpu, do_kvm_cpu_synchronize_kick, RUN_ON_CPU_NULL);
+    }
+    kvm_dirty_ring_reap(s);
+}
+
+/* Hand the pages collected in a slot over to the ram dirty bitmap.  */
+static void kvm_slot_sync_dirty_pages(KVMSlot *mem)
+{
+    ram_addr_t start = qemu_ram_addr_from_host(mem->ram);
+    ram_addr_t pages = mem->memory_size / qemu_real_host_page_size;
+
+    assert(start != RAM_ADDR_INVALID);
+    cpu_physical_memory_set_dirty_lebitmap(mem->dirty_bmap, start, pages);
+    bitmap_clear(mem->dirty_bmap, 0, pages);
+}
+
+/*
+ * The reaper keeps the rings from filling up, which would otherwise
+ * force the vCPUs out to userspace to harvest them.
+ */
+static void *kvm_dirty_ring_reaper_thread(void *opaque)
+{
+    KVMState *s = opaque;
+
+    rcu_register_thread();
+
+    while (true) {
+        g_usleep(G_USEC_PER_SEC);
+
+        qemu_mutex_lock_iothread();
+        kvm_dirty_ring_reap(s);
+        qemu_mutex_unlock_iothread();
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
 /**
  * kvm_physical_sync_dirty_bitmap - Sync dirty bitmap from kernel space
  *
  * This function will first try to fetch dirty bitmap from the kernel,
  * and then updates qemu's dirty bitmap.
  *
- * NOTE: caller must be with kml->slots_lock held.
+ * NOTE: caller must be with kml_slots_lock held.
  *
  * @kml: the KVM memory listener object
  * @section: the memory section to sync the dirty bitmap with
@@ -755,15 +993,13 @@ static int kvm_physical_log_clear(KVMMemoryListener *kml,
         return ret;
     }
 
-    kvm_slots_lock(kml);
+    kvm_slots_lock();
 
-    for (i = 0; i < s->nr_slots; i++) {
-        mem = &kml->slots[i];
-        /* Discard slots that are empty or do not overlap the section */
-        if (!mem->memory_size ||
-            mem->start_addr > start + size - 1 ||
-            start > mem->start_addr + mem->memory_size - 1) {
-            continue;
+    /* Only visit the slots that overlap the section */
+    for (i = kvm_slot_search(kml, start); i < kml->nr_used_slots; i++) {
+        mem = kml->used_slots[i];
+        if (mem->start_addr > start + size - 1) {
+            break;
         }
 
         if (start >= mem->start_addr) {
@@ -781,7 +1017,7 @@ static int kvm_physical_log_clear(KVMMemoryListener *kml,
         }
     }
 
-    kvm_slots_unlock(kml);
+    kvm_slots_unlock();
 
     return ret;
 }
@@ -1086,7 +1322,7 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
     ram = memory_region_get_ram_ptr(mr) + section->offset_within_region +
           (start_addr - section->offset_within_address_space);
 
-    kvm_slots_lock(kml);
+    kvm_slots_lock();
 
     if (!add) {
         do {
@@ -1096,10 +1332,22 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
                 goto out;
             }
             if (mem->flags & KVM_MEM_LOG_DIRTY_PAGES) {
-                kvm_physical_sync_dirty_bitmap(kml, section);
+                if (kvm_state->kvm_dirty_ring_size) {
+                    /*
+                     * Without kicking the vCPUs, so pages still in a
+                     * PML buffer may be missed, but we can't drop the lock.
+                     */
+                    kvm_dirty_ring_reap_locked(kvm_state);
+                    if (mem->dirty_bmap) {
+                        kvm_slot_sync_dirty_pages(mem);
+                    }
+                } else {
+                    kvm_physical_sync_dirty_bitmap(kml, section);
+                }
             }
 
             /* unregister the slot */
+            kvm_free_slot(kml, mem);
             g_free(mem->dirty_bmap);
             mem->dirty_bmap = NULL;
             mem->memory_size = 0;
@@ -1119,9 +1367,7 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
     /* register the new slot */
     do {
         slot_size = MIN(kvm_max_slot_size, size);
-        mem = kvm_alloc_slot(kml);
-        mem->memory_size = slot_size;
-        mem->start_addr = start_addr;
+        mem = kvm_alloc_slot(kml, start_addr, slot_size);
         mem->ram = ram;
         mem->flags = kvm_mem_flags(mr);
 
@@ -1144,7 +1390,7 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
     } while (size);
 
 out:
-    kvm_slots_unlock(kml);
+    kvm_slots_unlock();
 }
 
 static void kvm_region_add(MemoryListener *listener,
@@ -1171,14 +1417,34 @@ static void kvm_log_sync(MemoryListener *listener,
     KVMMemoryListener *kml = container_of(listener, KVMMemoryListener, listener);
     int r;
 
-    kvm_slots_lock(kml);
+    kvm_slots_lock();
     r = kvm_physical_sync_dirty_bitmap(kml, section);
-    kvm_slots_unlock(kml);
+    kvm_slots_unlock();
     if (r < 0) {
         abort();
     }
 }
 
+static void kvm_log_sync_global(MemoryListener *listener)
+{
+    KVMMemoryListener *kml = container_of(listener, KVMMemoryListener, listener);
+    KVMState *s = kvm_state;
+    KVMSlot *mem;
+    int i;
+
+    /* Flush all kernel dirty addresses into the slot bitmaps.  */
+    kvm_dirty_ring_flush(s);
+
+    kvm_slots_lock();
+    for (i = 0; i < kml->nr_used_slots; i++) {
+        mem = kml->used_slots[i];
+        if (mem->flags & KVM_MEM_LOG_DIRTY_PAGES && mem->dirty_bmap) {
+            kvm_slot_sync_dirty_pages(mem);
+        }
+    }
+    kvm_slots_unlock();
+}
+
 static void kvm_log_clear(MemoryListener *listener,
                           MemoryRegionSection *section)
 {
@@ -1273,20 +1539,29 @@ void kvm_memory_listener_register(KVMState *s, KVMMemoryListener *kml,
 {
     int i;
 
-    qemu_mutex_init(&kml->slots_lock);
     kml->slots = g_malloc0(s->nr_slots * sizeof(KVMSlot));
+    kml->used_slots = g_new(KVMSlot *, s->nr_slots);
+    kml->nr_used_slots = 0;
+    kml->free_slots = g_new(int, s->nr_slots);
+    kml->nr_free_slots = s->nr_slots;
     kml->as_id = as_id;
 
     for (i = 0; i < s->nr_slots; i++) {
         kml->slots[i].slot = i;
+        /* Hand out the lowest slot numbers first */
+        kml->free_slots[i] = s->nr_slots - 1 - i;
     }
 
     kml->listener.region_add = kvm_region_add;
     kml->listener.region_del = kvm_region_del;
     kml->listener.log_start = kvm_log_start;
     kml->listener.log_stop = kvm_log_stop;
-    kml->listener.log_sync = kvm_log_sync;
-    kml->listener.log_clear = kvm_log_clear;
+    if (s->kvm_dirty_ring_size) {
+        kml->listener.log_sync_global = kvm_log_sync_global;
+    } else {
+        kml->listener.log_sync = kvm_log_sync;
+        kml->listener.log_clear = kvm_log_clear;
+    }
     kml->listener.priority = 10;
 
     memory_listener_register(&kml->listener, as);
@@ -1896,6 +2171,38 @@ bool kvm_vcpu_id_is_valid(int vcpu_id)
     return vcpu_id >= 0 && vcpu_id < kvm_max_vcpu_id(s);
 }
 
+static const StatsDescriptor kvm_vcpu_stats[] = {
+    { "exits", STATS_TYPE_CUMULATIVE },
+    { "io-exits", STATS_TYPE_CUMULATIVE },
+    { "mmio-exits", STATS_TYPE_CUMULATIVE },
+    { "signal-exits", STATS_TYPE_CUMULATIVE },
+    { "halt-poll-ns", STATS_TYPE_INSTANT, true, STATS_UNIT_NANOSECONDS },
+    { "halt-poll-hits", STATS_TYPE_CUMULATIVE },
+    { "halt-poll-misses", STATS_TYPE_CUMULATIVE },
+};
+
+static void kvm_vcpu_stats_retrieve(StatsCollector *c)
+{
+    CPUState *cpu;
+
+    /* The counters are only written by the vCPU threads */
+    CPU_FOREACH(cpu) {
+        g_autofree char *path = object_get_canonical_path(OBJECT(cpu));
+        uint64_t values[] = {
+            cpu->kvm_exits,
+            cpu->kvm_io_exits,
+            cpu->kvm_mmio_exits,
+            cpu->kvm_intr_exits,
+            cpu->halt_poll_ns,
+            cpu->halt_poll_hits,
+            cpu->halt_poll_misses,
+        };
+
+        QEMU_BUILD_BUG_ON(ARRAY_SIZE(values) != ARRAY_SIZE(kvm_vcpu_stats));
+        stats_collect(c, path, values);
+    }
+}
+
 static int kvm_init(MachineState *ms)
 {
     MachineClass *mc = MACHINE_GET_CLASS(ms);
@@ -1917,6 +2224,8 @@ static int kvm_init(MachineState *ms)
     int type = 0;
     const char *kvm_type;
 
+    qemu_mutex_init(&kml_slots_lock);
+
     s = KVM_STATE(ms->accelerator);
 
     /*
@@ -2041,7 +2350,47 @@ static int kvm_init(MachineState *ms)
     s->coalesced_pio = s->coalesced_mmio &&
                        kvm_check_extension(s, KVM_CAP_COALESCED_PIO);
 
-    s->manual_dirty_log_protect =
+    /*
+     * Enable the dirty ring if requested and supported, otherwise fall
+     * back to the dirty bitmap. The ACQ_REL flavour is the only one
+     * available on weakly ordered hosts such as arm64.
+     */
+    if (s->kvm_dirty_ring_size) {
+        uint64_t ring_bytes;
+        int cap = KVM_CAP_DIRTY_LOG_RING_ACQ_REL;
+
+        ring_bytes = s->kvm_dirty_ring_size * sizeof(struct kvm_dirty_gfn);
+
+        /* Returns the maximum size of the ring in bytes.  */
+        ret = kvm_vm_check_extension(s, cap);
+        if (ret <= 0) {
+            cap = KVM_CAP_DIRTY_LOG_RING;
+            ret = kvm_vm_check_extension(s, cap);
+        }
+        if (ret > 0) {
+            if (ring_bytes > ret) {
+                error_report("KVM dirty ring size %" PRIu32 " too big "
+                             "(maximum is %ld)", s->kvm_dirty_ring_size,
+                             (long)ret / sizeof(struct kvm_dirty_gfn));
+                ret = -EINVAL;
+                goto err;
+            }
+
+            ret = kvm_vm_enable_cap(s, cap, 0, ring_bytes);
+            if (ret) {
+                error_report("Enabling of KVM dirty ring failed: %s",
+                             strerror(-ret));
+                goto err;
+            }
+            s->kvm_dirty_ring_bytes = ring_bytes;
+        } else {
+            warn_report("KVM dirty ring not available, using bitmap method");
+            s->kvm_dirty_ring_size = 0;
+        }
+    }
+
+    /* The dirty ring doesn't use KVM_CLEAR_DIRTY_LOG.  */
+    s->manual_dirty_log_protect = !s->kvm_dirty_ring_size &&
         kvm_check_extension(s, KVM_CAP_MANUAL_DIRTY_LOG_PROTECT2);
     if (s->manual_dirty_log_protect) {
         ret = kvm_vm_enable_cap(s, KVM_CAP_MANUAL_DIRTY_LOG_PROTECT2, 0, 1);
@@ -2139,6 +2488,12 @@ static int kvm_init(MachineState *ms)
     memory_listener_register(&kvm_coalesced_pio_listener,
                              &address_space_io);
 
+    if (s->kvm_dirty_ring_size) {
+        qemu_thread_create(&s->kvm_dirty_ring_reaper, "kvm-reaper",
+                           kvm_dirty_ring_reaper_thread, s,
+                           QEMU_THREAD_DETACHED);
+    }
+
     s->many_ioeventfds = kvm_check_many_ioeventfds();
 
     s->sync_mmu = !!kvm_vm_check_extension(kvm_state, KVM_CAP_SYNC_MMU);
@@ -2146,6 +2501,9 @@ static int kvm_init(MachineState *ms)
         qemu_balloon_inhibit(true);
     }
 
+    stats_register(STATS_PROVIDER_KVM, STATS_TARGET_VCPU, kvm_vcpu_stats,
+                   ARRAY_SIZE(kvm_vcpu_stats), kvm_vcpu_stats_retrieve);
+
     return 0;
 
 err:
@@ -2380,6 +2738,7 @@ int kvm_cpu_exec(CPUState *cpu)
         smp_rmb();
 
         run_ret = kvm_vcpu_ioctl(cpu, KVM_RUN, 0);
+        cpu->kvm_exits++;
 
         attrs = kvm_arch_post_run(cpu, run);
 
@@ -2396,6 +2755,7 @@ int kvm_cpu_exec(CPUState *cpu)
         if (run_ret < 0) {
             if (run_ret == -EINTR || run_ret == -EAGAIN) {
                 DPRINTF("io window exit\n");
+                cpu->kvm_intr_exits++;
                 kvm_eat_signals(cpu);
                 ret = EXCP_INTERRUPT;
                 break;
@@ -2418,6 +2778,7 @@ int kvm_cpu_exec(CPUState *cpu)
         switch (run->exit_reason) {
         case KVM_EXIT_IO:
             DPRINTF("handle_io\n");
+            cpu->kvm_io_exits++;
             /* Called outside BQL */
             kvm_handle_io(run->io.port, attrs,
                           (uint8_t *)run + run->io.data_offset,
@@ -2428,6 +2789,7 @@ int kvm_cpu_exec(CPUState *cpu)
             break;
         case KVM_EXIT_MMIO:
             DPRINTF("handle_mmio\n");
+            cpu->kvm_mmio_exits++;
             /* Called outside BQL */
             address_space_rw(&address_space_memory,
                              run->mmio.phys_addr, attrs,
@@ -2453,6 +2815,14 @@ int kvm_cpu_exec(CPUState *cpu)
         case KVM_EXIT_INTERNAL_ERROR:
             ret = kvm_handle_internal_error(cpu, run);
             break;
+        case KVM_EXIT_DIRTY_RING_FULL:
+            /* The reaper didn't keep up, harvest the rings ourselves.  */
+            trace_kvm_dirty_ring_full(cpu->cpu_index);
+            qemu_mutex_lock_iothread();
+            kvm_dirty_ring_reap(kvm_state);
+            qemu_mutex_unlock_iothread();
+            ret = 0;
+            break;
         case KVM_EXIT_SYSTEM_EVENT:
             switch (run->system_event.type) {
             case KVM_SYSTEM_EVENT_SHUTDOWN:
@@ -3039,6 +3409,64 @@ static void kvm_set_kvm_shadow_mem(Object *obj, Visitor *v,
     s->kvm_shadow_mem = value;
 }
 
+static void kvm_get_dirty_ring_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    KVMState *s = KVM_STATE(obj);
+    uint32_t value = s->kvm_dirty_ring_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void kvm_set_dirty_ring_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    KVMState *s = KVM_STATE(obj);
+    Error *error = NULL;
+    uint32_t value;
+
+    visit_type_uint32(v, name, &value, &error);
+    if (error) {
+        error_propagate(errp, error);
+        return;
+    }
+    if (value & (value - 1)) {
+        error_setg(errp, "dirty-ring-size must be a power of 2");
+        return;
+    }
+
+    s->kvm_dirty_ring_size = value;
+}
+
+static void kvm_get_halt_poll_max_ns(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    KVMState *s = KVM_STATE(obj);
+    uint32_t value = s->halt_poll_max_ns;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void kvm_set_halt_poll_max_ns(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    KVMState *s = KVM_STATE(obj);
+    Error *error = NULL;
+    uint32_t value;
+
+    visit_type_uint32(v, name, &value, &error);
+    if (error) {
+        error_propagate(errp, error);
+        return;
+    }
+
+    s->halt_poll_max_ns = value;
+}
+
 static void kvm_set_kernel_irqchip(Object *obj, Visitor *v,
                                    const char *name, void *opaque,
                                    Error **errp)
@@ -3120,6 +3548,18 @@ static void kvm_accel_class_init(ObjectClass *oc, void *data)
         NULL, NULL);
     object_class_property_set_description(oc, "kvm-shadow-mem",
         "KVM shadow MMU size");
+
+    object_class_property_add(oc, "dirty-ring-size", "uint32",
+        kvm_get_dirty_ring_size, kvm_set_dirty_ring_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "dirty-ring-size",
+        "Size of KVM dirty page ring buffer (default: 0, i.e. use bitmap)");
+
+    object_class_property_add(oc, "halt-poll-max-ns", "uint32",
+        kvm_get_halt_poll_max_ns, kvm_set_halt_poll_max_ns,
+        NULL, NULL);
+    object_class_property_set_description(oc, "halt-poll-max-ns",
+        "Maximum userspace halt polling time (default: 0, i.e. disabled)");
 }
 
 static const TypeInfo kvm_accel_type = {
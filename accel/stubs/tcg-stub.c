@@ -14,6 +14,8 @@
 #include "cpu.h"
 #include "tcg/tcg.h"
 #include "exec/exec-all.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
 
 void tb_flush(CPUState *cpu)
 {
@@ -22,3 +24,9 @@ void tb_flush(CPUState *cpu)
 void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
 {
 }
+
+TbHashInfo *qmp_x_query_tb_hash(Error **errp)
+{
+    error_setg(errp, "TCG is not enabled");
+    return NULL;
+}
@@ -31,6 +31,7 @@
 #include "exec/tb-hash.h"
 #include "exec/tb-lookup.h"
 #include "exec/log.h"
+#include "hw/boot-profile.h"
 #include "qemu/main-loop.h"
 #if defined(TARGET_I386) && !defined(CONFIG_USER_ONLY)
 #include "hw/i386/apic.h"
@@ -154,7 +155,8 @@ static inline tcg_target_ulong cpu_tb_exec(CPUState *cpu, TranslationBlock *itb)
                            itb->cs_base, itb->pc, itb->flags,
                            lookup_symbol(itb->pc));
 
-    if (qemu_etrace_mask(ETRACE_F_EXEC)) {
+    if ((itb->cflags & CF_ETRACE) && qemu_etrace_mask(ETRACE_F_EXEC)
+        && etrace_filter_exec(&qemu_etracer, cpu->cpu_index)) {
         etrace_dump_exec_start(&qemu_etracer, cpu->cpu_index,
                                itb->pc);
     }
@@ -688,6 +690,10 @@ int cpu_exec(CPUState *cpu)
         return EXCP_HALTED;
     }
 
+    if (unlikely(boot_profile_enabled)) {
+        boot_profile_first_exec(cpu->cpu_index);
+    }
+
     rcu_read_lock();
 
     cc->cpu_exec_enter(cpu);
@@ -721,7 +727,7 @@ int cpu_exec(CPUState *cpu)
         }
 
         if (qemu_etrace_mask(ETRACE_F_EXEC)
-            && qemu_etracer.exec_start_valid) {
+            && etrace_exec_start_valid(&qemu_etracer)) {
             target_ulong cs_base, pc;
             uint32_t flags;
 
@@ -756,23 +762,28 @@ int cpu_exec(CPUState *cpu)
             tb = tb_find(cpu, last_tb, tb_exit, cflags);
             cpu_loop_exec_tb(cpu, tb, &last_tb, &tb_exit);
 
+            /*
+             * Exec records are only ever started with tracing enabled,
+             * so keep the disabled case down to the mask check.
+             */
             if (qemu_etrace_mask(ETRACE_F_EXEC)) {
-                target_ulong cs_base, pc;
-                uint32_t flags;
-
-                if (tb_exit) {
-                    /* TB early exit, ask for CPU state.  */
-                    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
-                } else {
-                    /* TB didn't exit, assume we ran all of it.  */
-                    pc = tb->pc + tb->size;
+                if (etrace_exec_start_valid(&qemu_etracer)) {
+                    target_ulong cs_base, pc;
+                    uint32_t flags;
+
+                    if (tb_exit) {
+                        /* TB early exit, ask for CPU state.  */
+                        cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+                    } else {
+                        /* TB didn't exit, assume we ran all of it.  */
+                        pc = tb->pc + tb->size;
+                    }
+                    etrace_dump_exec_end(&qemu_etracer,
+                                         cpu->cpu_index, pc);
                 }
-                etrace_dump_exec_end(&qemu_etracer,
-                                     cpu->cpu_index, pc);
+                etrace_exec_cancel(&qemu_etracer);
             }
 
-            qemu_etracer.exec_start_valid = false;
-
             /* Try to align the host and virtual clocks
                if the guest is in advance */
             align_clocks(&sc, cpu);
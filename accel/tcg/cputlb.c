@@ -25,6 +25,7 @@
 #include "exec/address-spaces.h"
 #include "exec/cpu_ldst.h"
 #include "exec/cputlb.h"
+#include "exec/tb-hash.h"
 #include "exec/memory-internal.h"
 #include "exec/ram_addr.h"
 #include "tcg/tcg.h"
@@ -38,6 +39,8 @@
 #include "trace/mem.h"
 #ifdef CONFIG_PLUGIN
 #include "qemu/plugin-memory.h"
+#include "sysemu/replay.h"
+#include "sysemu/tcg.h"
 #endif
 
 /* DEBUG defines, enable DEBUG_TLB_LOG to log to the CPU_LOG_MMU target */
@@ -218,6 +221,8 @@ static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
     desc->vindex = 0;
+    desc->bindex = 0;
+    memset(desc->btable, 0, sizeof(desc->btable));
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
 }
@@ -437,11 +442,51 @@ static inline void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
     }
 }
 
+static inline bool tlb_hit_block(target_ulong tlb_addr, target_ulong addr,
+                                 target_ulong mask)
+{
+    return tlb_addr != -1 && (tlb_addr & mask) == addr;
+}
+
+static inline bool tlb_hit_block_anyprot(CPUTLBEntry *tlb_entry,
+                                         target_ulong addr,
+                                         target_ulong mask)
+{
+    return tlb_hit_block(tlb_entry->addr_read, addr, mask) ||
+           tlb_hit_block(tlb_addr_write(tlb_entry), addr, mask) ||
+           tlb_hit_block(tlb_entry->addr_code, addr, mask);
+}
+
+/* Called with tlb_c.lock held */
+static void tlb_flush_block_locked(CPUArchState *env, int midx,
+                                   target_ulong addr, target_ulong mask)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    size_t i, n = tlb_n_entries(f);
+
+    for (i = 0; i < n; i++) {
+        if (tlb_hit_block_anyprot(&f->table[i], addr, mask)) {
+            memset(&f->table[i], -1, sizeof(f->table[i]));
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+    for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        if (tlb_hit_block_anyprot(&d->vtable[i], addr, mask)) {
+            memset(&d->vtable[i], -1, sizeof(d->vtable[i]));
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+}
+
 static void tlb_flush_page_locked(CPUArchState *env, int midx,
                                   target_ulong page)
 {
-    target_ulong lp_addr = env_tlb(env)->d[midx].large_page_addr;
-    target_ulong lp_mask = env_tlb(env)->d[midx].large_page_mask;
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    target_ulong lp_addr = d->large_page_addr;
+    target_ulong lp_mask = d->large_page_mask;
+    bool in_block = false;
+    int i;
 
     /* Check if we need to flush due to large pages.  */
     if ((page & lp_mask) == lp_addr) {
@@ -449,7 +494,24 @@ static void tlb_flush_page_locked(CPUArchState *env, int midx,
                   TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
                   midx, lp_addr, lp_mask);
         tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-    } else {
+        return;
+    }
+
+    /* Pages of a tracked block only need the block itself dropped.  */
+    for (i = 0; i < CPU_BTLB_SIZE; i++) {
+        CPUTLBBlock *b = &d->btable[i];
+
+        if (b->prot && (page & b->mask) == b->vaddr) {
+            tlb_debug("flushing block midx %d ("
+                      TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+                      midx, b->vaddr, b->mask);
+            tlb_flush_block_locked(env, midx, b->vaddr, b->mask);
+            b->prot = 0;
+            in_block = true;
+        }
+    }
+
+    if (!in_block) {
         if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
             tlb_n_used_entries_dec(env, midx);
         }
@@ -651,6 +713,225 @@ void tlb_flush_page_all_cpus_synced(CPUState *src, target_ulong addr)
     tlb_flush_page_by_mmuidx_all_cpus_synced(src, addr, ALL_MMUIDX_BITS);
 }
 
+typedef struct {
+    target_ulong addr;
+    target_ulong len;
+    uint16_t idxmap;
+} TLBFlushRangeData;
+
+static inline bool tlb_hit_range(target_ulong tlb_addr, target_ulong addr,
+                                 target_ulong last)
+{
+    target_ulong page = tlb_addr & TARGET_PAGE_MASK;
+
+    return tlb_addr != -1 && page >= addr && page <= last;
+}
+
+static inline bool tlb_hit_range_anyprot(CPUTLBEntry *tlb_entry,
+                                         target_ulong addr,
+                                         target_ulong last)
+{
+    return tlb_hit_range(tlb_entry->addr_read, addr, last) ||
+           tlb_hit_range(tlb_addr_write(tlb_entry), addr, last) ||
+           tlb_hit_range(tlb_entry->addr_code, addr, last);
+}
+
+/*
+ * Called with tlb_c.lock held. ADDR is page aligned, LAST is the last
+ * byte of the range.
+ */
+static void tlb_flush_range_locked(CPUArchState *env, int midx,
+                                   target_ulong addr, target_ulong last)
+{
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    target_ulong lp_addr = d->large_page_addr;
+    target_ulong lp_mask = d->large_page_mask;
+    target_ulong npages = ((last - addr) >> TARGET_PAGE_BITS) + 1;
+    size_t i, n = tlb_n_entries(f);
+
+    /* Short ranges are cheaper to flush page by page.  */
+    if (npages <= n / 4) {
+        for (i = 0; i < npages; i++) {
+            tlb_flush_page_locked(env, midx, addr + (i << TARGET_PAGE_BITS));
+        }
+        return;
+    }
+
+    if (lp_addr != (target_ulong)-1 &&
+        lp_addr <= last && addr <= (lp_addr | ~lp_mask)) {
+        tlb_debug("forcing full flush midx %d ("
+                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+                  midx, lp_addr, lp_mask);
+        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+        return;
+    }
+
+    /* A block that overlaps the range is invalidated as a whole.  */
+    for (i = 0; i < CPU_BTLB_SIZE; i++) {
+        CPUTLBBlock *b = &d->btable[i];
+
+        if (b->prot && b->vaddr <= last && addr <= (b->vaddr | ~b->mask)) {
+            tlb_flush_block_locked(env, midx, b->vaddr, b->mask);
+            b->prot = 0;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        if (tlb_hit_range_anyprot(&f->table[i], addr, last)) {
+            memset(&f->table[i], -1, sizeof(f->table[i]));
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+    for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        if (tlb_hit_range_anyprot(&d->vtable[i], addr, last)) {
+            memset(&d->vtable[i], -1, sizeof(d->vtable[i]));
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+}
+
+static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
+                                              TLBFlushRangeData d)
+{
+    CPUArchState *env = cpu->env_ptr;
+    target_ulong addr = d.addr & TARGET_PAGE_MASK;
+    target_ulong last = d.addr + d.len - 1;
+    target_ulong npages;
+    int mmu_idx;
+
+    assert_cpu_is_self(cpu);
+
+    if (last < d.addr) {
+        /* The range wraps, clamp it to the top of the address space.  */
+        last = -1;
+    }
+    npages = ((last - addr) >> TARGET_PAGE_BITS) + 1;
+
+    tlb_debug("range:" TARGET_FMT_lx "/" TARGET_FMT_lx " mmu_map:0x%x\n",
+              d.addr, d.len, d.idxmap);
+
+    qemu_spin_lock(&env_tlb(env)->c.lock);
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        if ((d.idxmap >> mmu_idx) & 1) {
+            tlb_flush_range_locked(env, mmu_idx, addr, last);
+        }
+    }
+    qemu_spin_unlock(&env_tlb(env)->c.lock);
+
+    if (npages > TB_JMP_CACHE_SIZE >> TB_JMP_PAGE_BITS) {
+        cpu_tb_jmp_cache_clear(cpu);
+    } else {
+        target_ulong i;
+
+        for (i = 0; i < npages; i++) {
+            tb_flush_jmp_cache(cpu, addr + (i << TARGET_PAGE_BITS));
+        }
+    }
+}
+
+static void tlb_flush_range_by_mmuidx_async_1(CPUState *cpu,
+                                              run_on_cpu_data data)
+{
+    TLBFlushRangeData *d = data.host_ptr;
+
+    tlb_flush_range_by_mmuidx_async_0(cpu, *d);
+    g_free(d);
+}
+
+static inline bool tlb_range_is_one_page(target_ulong addr, target_ulong len)
+{
+    return (addr & ~TARGET_PAGE_MASK) + len <= TARGET_PAGE_SIZE;
+}
+
+static void tlb_flush_range_queue(CPUState *cpu, target_ulong addr,
+                                  target_ulong len, uint16_t idxmap,
+                                  bool safe)
+{
+    TLBFlushRangeData *d = g_new(TLBFlushRangeData, 1);
+
+    /* Freed by the worker.  */
+    d->addr = addr;
+    d->len = len;
+    d->idxmap = idxmap;
+    if (safe) {
+        async_safe_run_on_cpu(cpu, tlb_flush_range_by_mmuidx_async_1,
+                              RUN_ON_CPU_HOST_PTR(d));
+    } else {
+        async_run_on_cpu(cpu, tlb_flush_range_by_mmuidx_async_1,
+                         RUN_ON_CPU_HOST_PTR(d));
+    }
+}
+
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap)
+{
+    TLBFlushRangeData d = { addr, len, idxmap };
+
+    if (len == 0) {
+        return;
+    }
+    if (tlb_range_is_one_page(addr, len)) {
+        tlb_flush_page_by_mmuidx(cpu, addr & TARGET_PAGE_MASK, idxmap);
+        return;
+    }
+
+    if (qemu_cpu_is_self(cpu)) {
+        tlb_flush_range_by_mmuidx_async_0(cpu, d);
+    } else {
+        tlb_flush_range_queue(cpu, addr, len, idxmap, false);
+    }
+}
+
+void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
+                                        target_ulong len, uint16_t idxmap)
+{
+    TLBFlushRangeData d = { addr, len, idxmap };
+    CPUState *dst_cpu;
+
+    if (len == 0) {
+        return;
+    }
+    if (tlb_range_is_one_page(addr, len)) {
+        tlb_flush_page_by_mmuidx_all_cpus(src_cpu, addr & TARGET_PAGE_MASK,
+                                          idxmap);
+        return;
+    }
+
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_range_queue(dst_cpu, addr, len, idxmap, false);
+        }
+    }
+
+    tlb_flush_range_by_mmuidx_async_0(src_cpu, d);
+}
+
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap)
+{
+    CPUState *dst_cpu;
+
+    if (len == 0) {
+        return;
+    }
+    if (tlb_range_is_one_page(addr, len)) {
+        tlb_flush_page_by_mmuidx_all_cpus_synced(src_cpu,
+                                                 addr & TARGET_PAGE_MASK,
+                                                 idxmap);
+        return;
+    }
+
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_range_queue(dst_cpu, addr, len, idxmap, false);
+        }
+    }
+    tlb_flush_range_queue(src_cpu, addr, len, idxmap, true);
+}
+
 /* update the TLBs so that writes to code in the virtual page 'addr'
    can be detected */
 void tlb_protect_code(ram_addr_t ram_addr)
@@ -799,16 +1080,52 @@ static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
     env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
 }
 
+/* Remember a block mapping so that its other pages can be filled
+   without a page table walk, see tlb_fill_from_block.  */
+static void tlb_add_block(CPUArchState *env, int mmu_idx,
+                          target_ulong vaddr, hwaddr paddr,
+                          MemTxAttrs attrs, int prot, target_ulong size)
+{
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    target_ulong mask = ~(size - 1);
+    target_ulong offset = (vaddr & TARGET_PAGE_MASK) & ~mask;
+    CPUTLBBlock *b = NULL;
+    int i;
+
+    for (i = 0; i < CPU_BTLB_SIZE; i++) {
+        if (desc->btable[i].prot &&
+            desc->btable[i].vaddr == (vaddr & mask) &&
+            desc->btable[i].mask == mask) {
+            b = &desc->btable[i];
+            break;
+        }
+    }
+    if (!b) {
+        b = &desc->btable[desc->bindex++ % CPU_BTLB_SIZE];
+        if (b->prot) {
+            /* Pages of the evicted block may still be in the tlb.  */
+            tlb_add_large_page(env, mmu_idx, b->vaddr, ~b->mask + 1);
+        }
+    }
+
+    b->vaddr = vaddr & mask;
+    b->mask = mask;
+    b->paddr = (paddr & TARGET_PAGE_MASK) - offset;
+    b->attrs = attrs;
+    b->prot = prot;
+}
+
 /* Add a new TLB entry. At most one entry for a given virtual address
  * is permitted. Only a single TARGET_PAGE_SIZE region is mapped, the
- * supplied size is only used by tlb_flush_page.
+ * supplied size is only used by tlb_flush_page. If BLOCK is set, the
+ * page belongs to a block tracked in the block table.
  *
  * Called from TCG-generated code, which is under an RCU read-side
  * critical section.
  */
-void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
-                             hwaddr paddr, MemTxAttrs attrs, int prot,
-                             int mmu_idx, target_ulong size)
+static void tlb_set_page_full(CPUState *cpu, target_ulong vaddr,
+                              hwaddr paddr, MemTxAttrs attrs, int prot,
+                              int mmu_idx, target_ulong size, bool block)
 {
     CPUArchState *env = cpu->env_ptr;
     CPUTLB *tlb = env_tlb(env);
@@ -819,7 +1136,7 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     target_ulong write_address;
     uintptr_t addend;
     CPUTLBEntry *te, tn;
-    hwaddr iotlb, xlat, sz, paddr_page;
+    hwaddr iotlb, xlat, sz, paddr_page, subpage;
     target_ulong vaddr_page;
     int asidx = cpu_asidx_from_attrs(cpu, attrs);
     int wp_flags;
@@ -834,7 +1151,9 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     if (size <= TARGET_PAGE_SIZE) {
         sz = TARGET_PAGE_SIZE;
     } else {
-        tlb_add_large_page(env, mmu_idx, vaddr, size);
+        if (!block) {
+            tlb_add_large_page(env, mmu_idx, vaddr, size);
+        }
         sz = size;
     }
     vaddr_page = vaddr & TARGET_PAGE_MASK;
@@ -849,9 +1168,17 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
               vaddr, paddr, prot, mmu_idx, attr->attrs.secure, attrs.secure);
 
     address = vaddr_page;
+    subpage = 0;
     if (size < TARGET_PAGE_SIZE) {
         /* Repeat the MMU check and TLB fill on every access.  */
         address |= TLB_INVALID_MASK;
+        /*
+         * A translation finer than the target page, such as a 4K guest
+         * page with -machine target-page-size=64K, may move @vaddr to a
+         * different offset within the page.  Only the access at @vaddr
+         * uses this entry, so offset the page to map @vaddr to @paddr.
+         */
+        subpage = (paddr & ~TARGET_PAGE_MASK) - (vaddr & ~TARGET_PAGE_MASK);
     }
     if (attrs.byte_swap) {
         address |= TLB_BSWAP;
@@ -862,7 +1189,8 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
 
     if (is_ram || is_romd) {
         /* RAM and ROMD both have associated host memory. */
-        addend = (uintptr_t)memory_region_get_ram_ptr(section->mr) + xlat;
+        addend = (uintptr_t)memory_region_get_ram_ptr(section->mr) + xlat +
+                 subpage;
     } else {
         /* I/O does not; force the host address to NULL. */
         addend = 0;
@@ -882,6 +1210,8 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
                 write_address |= TLB_NOTDIRTY;
             }
         }
+        iotlb += subpage;
+        subpage = 0;
     } else {
         /* I/O or ROMD */
         iotlb = memory_region_section_get_iotlb(cpu, section) + xlat;
@@ -945,7 +1275,16 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
      * vaddr we add back in io_readx()/io_writex()/get_page_addr_code().
      */
     desc->iotlb[index].addr = iotlb - vaddr_page;
+    desc->iotlb[index].subpage = subpage;
     desc->iotlb[index].attrs = attrs;
+    desc->iotlb[index].wp_read = 0;
+    desc->iotlb[index].wp_write = 0;
+    if (unlikely(wp_flags)) {
+        desc->iotlb[index].wp_read =
+            cpu_watchpoint_page_mask(cpu, vaddr_page, BP_MEM_READ);
+        desc->iotlb[index].wp_write =
+            cpu_watchpoint_page_mask(cpu, vaddr_page, BP_MEM_WRITE);
+    }
 
     /* Now calculate the new entry */
     tn.addend = addend - vaddr_page;
@@ -980,6 +1319,63 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     qemu_spin_unlock(&tlb->c.lock);
 }
 
+void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
+                             hwaddr paddr, MemTxAttrs attrs, int prot,
+                             int mmu_idx, target_ulong size)
+{
+    tlb_set_page_full(cpu, vaddr, paddr, attrs, prot, mmu_idx, size, false);
+}
+
+void tlb_set_block_with_attrs(CPUState *cpu, target_ulong vaddr,
+                              hwaddr paddr, MemTxAttrs attrs, int prot,
+                              int mmu_idx, target_ulong size)
+{
+    bool block = size > TARGET_PAGE_SIZE;
+
+    if (block) {
+        tlb_add_block(cpu->env_ptr, mmu_idx, vaddr, paddr, attrs, prot, size);
+    }
+    tlb_set_page_full(cpu, vaddr, paddr, attrs, prot, mmu_idx, size, block);
+}
+
+/*
+ * Fill the page containing ADDR from a tracked block mapping, if there
+ * is one that permits ACCESS_TYPE. On failure the target has to walk
+ * its page tables, and raise any fault.
+ */
+static bool tlb_fill_from_block(CPUState *cpu, target_ulong addr,
+                                MMUAccessType access_type, int mmu_idx)
+{
+    CPUTLBDesc *desc = &env_tlb(cpu->env_ptr)->d[mmu_idx];
+    int need;
+    int i;
+
+    switch (access_type) {
+    case MMU_DATA_LOAD:
+        need = PAGE_READ;
+        break;
+    case MMU_DATA_STORE:
+        need = PAGE_WRITE;
+        break;
+    default:
+        need = PAGE_EXEC;
+        break;
+    }
+
+    for (i = 0; i < CPU_BTLB_SIZE; i++) {
+        CPUTLBBlock b = desc->btable[i];
+
+        if ((b.prot & need) && (addr & b.mask) == b.vaddr) {
+            target_ulong offset = addr & ~b.mask & TARGET_PAGE_MASK;
+
+            tlb_set_page_full(cpu, b.vaddr + offset, b.paddr + offset,
+                              b.attrs, b.prot, mmu_idx, ~b.mask + 1, true);
+            return true;
+        }
+    }
+    return false;
+}
+
 /* Add a new TLB entry, but without specifying the memory
  * transaction attributes to be used.
  */
@@ -1014,6 +1410,10 @@ static void tlb_fill(CPUState *cpu, target_ulong addr, int size,
     CPUClass *cc = CPU_GET_CLASS(cpu);
     bool ok;
 
+    if (tlb_fill_from_block(cpu, addr, access_type, mmu_idx)) {
+        return;
+    }
+
     /*
      * This is not a probe, so only valid return is success; failure
      * should result in exception + longjmp to the cpu loop.
@@ -1022,6 +1422,66 @@ static void tlb_fill(CPUState *cpu, target_ulong addr, int size,
     assert(ok);
 }
 
+/*
+ * A loop that keeps reading the same value from the same register at the
+ * same instruction waits for a device whose state changes with time or
+ * with an interrupt.  After MMIO_POLL_THRESHOLD such reads, put the vCPU
+ * to sleep until the next virtual clock deadline.
+ */
+#define MMIO_POLL_THRESHOLD     64
+#define MMIO_POLL_MAX_SLEEP_NS  (1 * SCALE_MS)
+
+bool tcg_mmio_poll_sleep;
+
+static void mmio_poll_wake(void *opaque)
+{
+    CPUState *cpu = opaque;
+
+    cpu->halted = 0;
+    qemu_cpu_kick(cpu);
+}
+
+static void mmio_poll_check(CPUState *cpu, MemoryRegion *mr, hwaddr addr,
+                            uint64_t val, uintptr_t retaddr)
+{
+    int64_t now, deadline;
+
+    if (cpu->mmio_poll.mr != mr || cpu->mmio_poll.addr != addr ||
+        cpu->mmio_poll.val != val || cpu->mmio_poll.ra != retaddr) {
+        cpu->mmio_poll.mr = mr;
+        cpu->mmio_poll.addr = addr;
+        cpu->mmio_poll.val = val;
+        cpu->mmio_poll.ra = retaddr;
+        cpu->mmio_poll.count = 0;
+        return;
+    }
+    if (++cpu->mmio_poll.count < MMIO_POLL_THRESHOLD ||
+        replay_mode != REPLAY_MODE_NONE) {
+        return;
+    }
+    cpu->mmio_poll.count = 0;
+
+    if (!cpu->mmio_poll_timer) {
+        cpu->mmio_poll_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                            mmio_poll_wake, cpu);
+    }
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                          QEMU_TIMER_ATTR_ALL);
+    if (deadline < 0 || deadline > MMIO_POLL_MAX_SLEEP_NS) {
+        deadline = MMIO_POLL_MAX_SLEEP_NS;
+    }
+    timer_mod(cpu->mmio_poll_timer, now + deadline);
+
+    /*
+     * The current TB completes, cpu_exec() then finds the vCPU halted.
+     * Architecturally this is a stall, and a pending interrupt still
+     * wakes the vCPU through cpu_has_work().
+     */
+    cpu->halted = 1;
+    cpu_exit(cpu);
+}
+
 static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
                          int mmu_idx, target_ulong addr, uintptr_t retaddr,
                          MMUAccessType access_type, MemOp op)
@@ -1036,7 +1496,8 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
 
     section = iotlb_to_section(cpu, iotlbentry->addr, iotlbentry->attrs);
     mr = section->mr;
-    mr_offset = (iotlbentry->addr & TARGET_PAGE_MASK) + addr;
+    mr_offset = (iotlbentry->addr & TARGET_PAGE_MASK) + addr +
+                iotlbentry->subpage;
     cpu->mem_io_pc = retaddr;
     if (!cpu->can_do_io) {
         cpu_io_recompile(cpu, retaddr);
@@ -1069,6 +1530,10 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
         qemu_mutex_unlock_iothread();
     }
 
+    if (unlikely(tcg_mmio_poll_sleep) && r == MEMTX_OK) {
+        mmio_poll_check(cpu, mr, mr_offset, val, retaddr);
+    }
+
     return val;
 }
 
@@ -1085,11 +1550,14 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
 
     section = iotlb_to_section(cpu, iotlbentry->addr, iotlbentry->attrs);
     mr = section->mr;
-    mr_offset = (iotlbentry->addr & TARGET_PAGE_MASK) + addr;
+    mr_offset = (iotlbentry->addr & TARGET_PAGE_MASK) + addr +
+                iotlbentry->subpage;
     if (!cpu->can_do_io) {
         cpu_io_recompile(cpu, retaddr);
     }
     cpu->mem_io_pc = retaddr;
+    /* A loop that writes to a device is not waiting on it */
+    cpu->mmio_poll.count = 0;
 
     if (mr->global_locking && !qemu_mutex_iothread_locked()) {
         qemu_mutex_lock_iothread();
@@ -1227,6 +1695,20 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env, target_ulong addr)
     return get_page_addr_code_hostp(env, addr, NULL);
 }
 
+/*
+ * Return true if [addr, addr + size) touches a granule of the page that
+ * @mask marks as watched.  The access must not cross the page.
+ */
+static inline bool tlb_watch_granules(uint64_t mask, target_ulong addr,
+                                      target_ulong size)
+{
+    unsigned int first = (addr & ~TARGET_PAGE_MASK) >> TLB_WP_GRANULE_BITS;
+    unsigned int last = ((addr & ~TARGET_PAGE_MASK) + size - 1)
+                        >> TLB_WP_GRANULE_BITS;
+
+    return mask & MAKE_64BIT_MASK(first, last - first + 1);
+}
+
 static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
                            CPUIOTLBEntry *iotlbentry, uintptr_t retaddr)
 {
@@ -1286,7 +1768,8 @@ static int probe_access_internal(CPUArchState *env, target_ulong addr,
             CPUState *cs = env_cpu(env);
             CPUClass *cc = CPU_GET_CLASS(cs);
 
-            if (!cc->tlb_fill(cs, addr, fault_size, access_type,
+            if (!tlb_fill_from_block(cs, addr, access_type, mmu_idx) &&
+                !cc->tlb_fill(cs, addr, fault_size, access_type,
                               mmu_idx, nonfault, retaddr)) {
                 /* Non-faulting page table read failed.  */
                 *phost = NULL;
@@ -1354,10 +1837,14 @@ void *probe_access(CPUArchState *env, target_ulong addr, int size,
 
         /* Handle watchpoints.  */
         if (flags & TLB_WATCHPOINT) {
-            int wp_access = (access_type == MMU_DATA_STORE
-                             ? BP_MEM_WRITE : BP_MEM_READ);
-            cpu_check_watchpoint(env_cpu(env), addr, size,
-                                 iotlbentry->attrs, wp_access, retaddr);
+            bool wr = access_type == MMU_DATA_STORE;
+
+            if (tlb_watch_granules(wr ? iotlbentry->wp_write
+                                      : iotlbentry->wp_read, addr, size)) {
+                cpu_check_watchpoint(env_cpu(env), addr, size,
+                                     iotlbentry->attrs,
+                                     wr ? BP_MEM_WRITE : BP_MEM_READ, retaddr);
+            }
         }
 
         /* Handle clean RAM pages.  */
@@ -1408,7 +1895,8 @@ bool tlb_plugin_lookup(CPUState *cpu, target_ulong addr, int mmu_idx,
             iotlbentry = &env_tlb(env)->d[mmu_idx].iotlb[index];
             data->is_io = true;
             data->v.io.section = iotlb_to_section(cpu, iotlbentry->addr, iotlbentry->attrs);
-            data->v.io.offset = (iotlbentry->addr & TARGET_PAGE_MASK) + addr;
+            data->v.io.offset = (iotlbentry->addr & TARGET_PAGE_MASK) + addr +
+                                 iotlbentry->subpage;
         } else {
             data->is_io = false;
             data->v.ram.hostaddr = addr + tlbe->addend;
@@ -1579,7 +2067,8 @@ load_helper(CPUArchState *env, target_ulong addr, TCGMemOpIdx oi,
         iotlbentry = &env_tlb(env)->d[mmu_idx].iotlb[index];
 
         /* Handle watchpoints.  */
-        if (unlikely(tlb_addr & TLB_WATCHPOINT)) {
+        if (unlikely(tlb_addr & TLB_WATCHPOINT) &&
+            tlb_watch_granules(iotlbentry->wp_read, addr, size)) {
             /* On watchpoint hit, this will longjmp out.  */
             cpu_check_watchpoint(env_cpu(env), addr, size,
                                  iotlbentry->attrs, BP_MEM_READ, retaddr);
@@ -2030,7 +2519,8 @@ store_helper(CPUArchState *env, target_ulong addr, uint64_t val,
         iotlbentry = &env_tlb(env)->d[mmu_idx].iotlb[index];
 
         /* Handle watchpoints.  */
-        if (unlikely(tlb_addr & TLB_WATCHPOINT)) {
+        if (unlikely(tlb_addr & TLB_WATCHPOINT) &&
+            tlb_watch_granules(iotlbentry->wp_write, addr, size)) {
             /* On watchpoint hit, this will longjmp out.  */
             cpu_check_watchpoint(env_cpu(env), addr, size,
                                  iotlbentry->attrs, BP_MEM_WRITE, retaddr);
@@ -2106,14 +2596,20 @@ store_helper(CPUArchState *env, target_ulong addr, uint64_t val,
          * must happen before any store.
          */
         if (unlikely(tlb_addr & TLB_WATCHPOINT)) {
-            cpu_check_watchpoint(env_cpu(env), addr, size - size2,
-                                 env_tlb(env)->d[mmu_idx].iotlb[index].attrs,
-                                 BP_MEM_WRITE, retaddr);
+            CPUIOTLBEntry *io = &env_tlb(env)->d[mmu_idx].iotlb[index];
+
+            if (tlb_watch_granules(io->wp_write, addr, size - size2)) {
+                cpu_check_watchpoint(env_cpu(env), addr, size - size2,
+                                     io->attrs, BP_MEM_WRITE, retaddr);
+            }
         }
         if (unlikely(tlb_addr2 & TLB_WATCHPOINT)) {
-            cpu_check_watchpoint(env_cpu(env), page2, size2,
-                                 env_tlb(env)->d[mmu_idx].iotlb[index2].attrs,
-                                 BP_MEM_WRITE, retaddr);
+            CPUIOTLBEntry *io = &env_tlb(env)->d[mmu_idx].iotlb[index2];
+
+            if (tlb_watch_granules(io->wp_write, page2, size2)) {
+                cpu_check_watchpoint(env_cpu(env), page2, size2,
+                                     io->attrs, BP_MEM_WRITE, retaddr);
+            }
         }
 
         /*
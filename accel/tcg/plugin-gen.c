@@ -279,6 +279,13 @@ static TCGOp *copy_op(TCGOp **begin_op, TCGOp *op, TCGOpcode opc)
     return op;
 }
 
+/* Step over an op of the empty callback without copying it */
+static void skip_op(TCGOp **begin_op, TCGOpcode opc)
+{
+    *begin_op = QTAILQ_NEXT(*begin_op, link);
+    tcg_debug_assert(*begin_op && (*begin_op)->opc == opc);
+}
+
 static TCGOp *copy_extu_i32_i64(TCGOp **begin_op, TCGOp *op)
 {
     if (TCG_TARGET_REG_BITS == 32) {
@@ -457,10 +464,66 @@ static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+/*
+ * A store only needs the pointer and the constant out of the empty
+ * callback: skip the load and the add, and store the constant directly.
+ */
+static TCGOp *append_inline_store(const struct qemu_plugin_dyn_cb *cb,
+                                  TCGOp *begin_op, TCGOp *op)
+{
+    TCGOp *imm_lo, *imm_hi = NULL;
+
+    /* const_ptr */
+    op = copy_const_ptr(&begin_op, op, cb->userp);
+
+    /* ld_i64 */
+    if (TCG_TARGET_REG_BITS == 32) {
+        skip_op(&begin_op, INDEX_op_ld_i32);
+        skip_op(&begin_op, INDEX_op_ld_i32);
+    } else {
+        skip_op(&begin_op, INDEX_op_ld_i64);
+    }
+
+    /* const_i64 */
+    if (TCG_TARGET_REG_BITS == 32) {
+        imm_lo = op = copy_op(&begin_op, op, INDEX_op_movi_i32);
+        op->args[1] = cb->inline_insn.imm;
+        imm_hi = op = copy_op(&begin_op, op, INDEX_op_movi_i32);
+        op->args[1] = cb->inline_insn.imm >> 32;
+    } else {
+        imm_lo = op = copy_op(&begin_op, op, INDEX_op_movi_i64);
+        op->args[1] = cb->inline_insn.imm;
+    }
+
+    /* add_i64 */
+    if (TCG_TARGET_REG_BITS == 32) {
+        skip_op(&begin_op, INDEX_op_add2_i32);
+    } else {
+        skip_op(&begin_op, INDEX_op_add_i64);
+    }
+
+    /* st_i64, storing the constant rather than the sum */
+    if (TCG_TARGET_REG_BITS == 32) {
+        op = copy_op(&begin_op, op, INDEX_op_st_i32);
+        op->args[0] = imm_lo->args[0];
+        op = copy_op(&begin_op, op, INDEX_op_st_i32);
+        op->args[0] = imm_hi->args[0];
+    } else {
+        op = copy_op(&begin_op, op, INDEX_op_st_i64);
+        op->args[0] = imm_lo->args[0];
+    }
+
+    return op;
+}
+
 static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
+    if (cb->inline_insn.op == QEMU_PLUGIN_INLINE_STORE_U64) {
+        return append_inline_store(cb, begin_op, op);
+    }
+
     /* const_ptr */
     op = copy_const_ptr(&begin_op, op, cb->userp);
 
@@ -35,6 +35,9 @@
 #include "qemu/error-report.h"
 #include "hw/boards.h"
 #include "qapi/qapi-builtin-visit.h"
+#include "exec/cputlb.h"
+#include "exec/tb-context.h"
+#include "monitor/stats.h"
 
 typedef struct TCGState {
     AccelState parent_obj;
@@ -122,6 +125,32 @@ static void tcg_accel_instance_init(Object *obj)
     s->mttcg_enabled = default_mttcg_enabled();
 }
 
+static const StatsDescriptor tcg_vm_stats[] = {
+    { "tbs", STATS_TYPE_INSTANT },
+    { "code-size", STATS_TYPE_INSTANT, true, STATS_UNIT_BYTES },
+    { "tb-flushes", STATS_TYPE_CUMULATIVE },
+    { "tb-invalidations", STATS_TYPE_CUMULATIVE },
+    { "tlb-flushes-full", STATS_TYPE_CUMULATIVE },
+    { "tlb-flushes-partial", STATS_TYPE_CUMULATIVE },
+    { "tlb-flushes-elided", STATS_TYPE_CUMULATIVE },
+};
+
+static void tcg_vm_stats_retrieve(StatsCollector *c)
+{
+    size_t full, part, elide;
+    uint64_t values[ARRAY_SIZE(tcg_vm_stats)];
+
+    tlb_flush_counts(&full, &part, &elide);
+    values[0] = tcg_nb_tbs();
+    values[1] = tcg_code_size();
+    values[2] = atomic_read(&tb_ctx.tb_flush_count);
+    values[3] = tcg_tb_phys_invalidate_count();
+    values[4] = full;
+    values[5] = part;
+    values[6] = elide;
+    stats_collect(c, NULL, values);
+}
+
 static int tcg_init(MachineState *ms)
 {
     TCGState *s = TCG_STATE(current_accel());
@@ -129,6 +158,8 @@ static int tcg_init(MachineState *ms)
     tcg_exec_init(s->tb_size * 1024 * 1024);
     cpu_interrupt_handler = tcg_handle_interrupt;
     mttcg_enabled = s->mttcg_enabled;
+    stats_register(STATS_PROVIDER_TCG, STATS_TARGET_VM, tcg_vm_stats,
+                   ARRAY_SIZE(tcg_vm_stats), tcg_vm_stats_retrieve);
     return 0;
 }
 
@@ -194,6 +225,16 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static bool tcg_get_mmio_poll_sleep(Object *obj, Error **errp)
+{
+    return tcg_mmio_poll_sleep;
+}
+
+static void tcg_set_mmio_poll_sleep(Object *obj, bool value, Error **errp)
+{
+    tcg_mmio_poll_sleep = value;
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -211,6 +252,12 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add_bool(oc, "mmio-poll-sleep",
+                                   tcg_get_mmio_poll_sleep,
+                                   tcg_set_mmio_poll_sleep);
+    object_class_property_set_description(oc, "mmio-poll-sleep",
+        "Put vCPUs that poll an unchanging MMIO register to sleep");
+
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -52,6 +52,8 @@
 #include "translate-all.h"
 #include "qemu/bitmap.h"
 #include "qemu/error-report.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
 #include "qemu/main-loop.h"
@@ -222,6 +224,25 @@ __thread TCGContext *tcg_ctx;
 TBContext tb_ctx;
 bool parallel_cpus;
 
+/*
+ * With icount, an I/O access that is not the last insn of its TB makes
+ * cpu_io_recompile() restart from that insn. Remember where this
+ * happened so that later translations of the same block end right
+ * before the access, and the block starting with it may do I/O. Only
+ * used with icount, where all vCPUs run on a single thread.
+ */
+#define TB_IO_HINTS_BITS 8
+#define TB_IO_HINTS_SIZE (1 << TB_IO_HINTS_BITS)
+typedef struct TBIOHint {
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    /* Insns to translate before the I/O insn, 0 for the I/O insn itself. */
+    uint16_t insns;
+    bool valid;
+} TBIOHint;
+static TBIOHint tb_io_hints[TB_IO_HINTS_SIZE];
+
 static void page_table_config_init(void)
 {
     uint32_t v_l1_bits;
@@ -336,6 +357,10 @@ static int encode_search(TranslationBlock *tb, uint8_t *block)
  * When reset_icount is true, current TB will be interrupted and
  * icount should be recalculated.
  */
+/*
+ * Returns the index of the insn containing searched_pc within the TB,
+ * or -1 if it was not found.
+ */
 static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
                                      uintptr_t searched_pc, bool reset_icount)
 {
@@ -382,7 +407,7 @@ static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
                 prof->restore_time + profile_getclock() - ti);
     atomic_set(&prof->restore_count, prof->restore_count + 1);
 #endif
-    return 0;
+    return i;
 }
 
 bool cpu_restore_state(CPUState *cpu, uintptr_t host_pc, bool will_exit)
@@ -1228,7 +1253,11 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
         cpu_tb_jmp_cache_clear(cpu);
     }
 
-    qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
+    /*
+     * Keep the table as big as the working set that filled the code buffer,
+     * so that it does not have to grow again after every flush.
+     */
+    qht_reset_size(&tb_ctx.htable, MAX(CODE_GEN_HTABLE_SIZE, tcg_nb_tbs()));
     page_flush_tb();
 
     tcg_region_reset_all();
@@ -1257,6 +1286,53 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+static gboolean tb_evict_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+
+    /* Invalidated TBs are already unreachable */
+    if (!(tb_cflags(tb) & CF_INVALID)) {
+        tb_phys_invalidate(tb, -1);
+    }
+    return false;
+}
+
+static void do_tb_reclaim(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    int evicted = 0;
+
+    mmap_lock();
+    /* Nothing to do if a flush got in first */
+    if (tb_ctx.tb_flush_count == tb_flush_count.host_int) {
+        evicted = tcg_region_evict(tb_evict_iter);
+        if (evicted > 0) {
+            atomic_add(&tb_ctx.tb_evict_count, evicted);
+        }
+    }
+    mmap_unlock();
+
+    if (evicted < 0) {
+        do_tb_flush(cpu, tb_flush_count);
+    }
+}
+
+/*
+ * Make room in a full code buffer.  The least recently allocated regions
+ * are evicted along with their TBs, so that the rest of the working set
+ * survives.  If there are not enough regions for that, flush everything.
+ */
+static void tb_reclaim(CPUState *cpu)
+{
+    unsigned tb_flush_count = atomic_mb_read(&tb_ctx.tb_flush_count);
+
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_reclaim(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_reclaim,
+                              RUN_ON_CPU_HOST_INT(tb_flush_count));
+    }
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1413,7 +1489,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 {
     CPUState *cpu;
     PageDesc *p;
-    uint32_t h;
+    uint32_t h, cluster;
     tb_page_addr_t phys_pc;
 
     assert_memory_lock();
@@ -1444,9 +1520,17 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
         }
     }
 
-    /* remove the TB from the hash list */
+    /*
+     * remove the TB from the hash list. Only CPUs of the cluster the TB
+     * was generated for can have it cached, leave the others alone.
+     */
     h = tb_jmp_cache_hash_func(tb->pc);
+    cluster = tb_cflags(tb) & CF_CLUSTER_MASK;
     CPU_FOREACH(cpu) {
+        if (((cpu->cluster_index << CF_CLUSTER_SHIFT) & CF_CLUSTER_MASK)
+            != cluster) {
+            continue;
+        }
         if (atomic_read(&cpu->tb_jmp_cache[h]) == tb) {
             atomic_set(&cpu->tb_jmp_cache[h], NULL);
         }
@@ -1650,6 +1734,42 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     return tb;
 }
 
+static TBIOHint *tb_io_hint(target_ulong pc, target_ulong cs_base,
+                            uint32_t flags)
+{
+    uint32_t h = tb_hash_func(0, pc, flags, 0, 0) ^ cs_base;
+
+    return &tb_io_hints[h & (TB_IO_HINTS_SIZE - 1)];
+}
+
+static TBIOHint *tb_io_hint_find(target_ulong pc, target_ulong cs_base,
+                                 uint32_t flags)
+{
+    TBIOHint *hint = tb_io_hint(pc, cs_base, flags);
+
+    if (hint->valid && hint->pc == pc && hint->cs_base == cs_base &&
+        hint->flags == flags) {
+        return hint;
+    }
+    return NULL;
+}
+
+static void tb_io_hint_add(TranslationBlock *tb, int insns)
+{
+    TBIOHint *hint = tb_io_hint_find(tb->pc, tb->cs_base, tb->flags);
+
+    if (hint) {
+        hint->insns = MIN(hint->insns, insns);
+        return;
+    }
+    hint = tb_io_hint(tb->pc, tb->cs_base, tb->flags);
+    hint->pc = tb->pc;
+    hint->cs_base = tb->cs_base;
+    hint->flags = tb->flags;
+    hint->insns = insns;
+    hint->valid = true;
+}
+
 /* Called with mmap_lock held for user mode emulation.  */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
@@ -1661,6 +1781,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
+    uint32_t gen_cflags;
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti;
@@ -1690,11 +1811,28 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         max_insns = 1;
     }
 
+    /*
+     * The hint only changes what gets translated, not the lookup key,
+     * so gen_cflags is what the translator sees and cflags what the TB
+     * is stored with.
+     */
+    gen_cflags = cflags;
+    if ((cflags & CF_USE_ICOUNT) && !(cflags & (CF_LAST_IO | CF_COUNT_MASK))) {
+        TBIOHint *hint = tb_io_hint_find(pc, cs_base, flags);
+
+        if (hint && hint->insns) {
+            max_insns = MIN(max_insns, hint->insns);
+        } else if (hint) {
+            max_insns = 1;
+            gen_cflags |= CF_LAST_IO | 1;
+        }
+    }
+
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* eviction or flush must be done */
+        tb_reclaim(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1706,10 +1844,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->pc = pc;
     tb->cs_base = cs_base;
     tb->flags = flags;
-    tb->cflags = cflags;
+    tb->cflags = gen_cflags;
     tb->orig_tb = NULL;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
-    tcg_ctx->tb_cflags = cflags;
+    tcg_ctx->tb_cflags = gen_cflags;
  tb_overflow:
 
 #ifdef CONFIG_PROFILER
@@ -1723,6 +1861,13 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tcg_ctx->cpu = env_cpu(env);
     gen_intermediate_code(cpu, tb, max_insns);
     tcg_ctx->cpu = NULL;
+    tb->cflags = cflags;
+
+    /* TBs outside of the etrace filters never get traced.  */
+    if (qemu_etrace_mask(ETRACE_F_EXEC)
+        && etrace_filter_tb(&qemu_etracer, tb->pc, tb->pc + tb->size)) {
+        tb->cflags |= CF_ETRACE;
+    }
 
     trace_translate_block(tb, tb->pc, tb->tc.ptr);
 
@@ -2183,6 +2328,45 @@ void tb_check_watchpoint(CPUState *cpu, uintptr_t retaddr)
 }
 
 #ifndef CONFIG_USER_ONLY
+struct tb_virt_addr_match {
+    target_ulong addr;
+    uint32_t cflags;
+    GPtrArray *tbs;
+};
+
+static void do_tb_virt_addr_match(void *p, uint32_t hash, void *userp)
+{
+    TranslationBlock *tb = p;
+    struct tb_virt_addr_match *m = userp;
+
+    if ((tb->cflags & CF_CLUSTER_MASK) == m->cflags &&
+        m->addr >= tb->pc && m->addr < tb->pc + MAX(tb->size, 1)) {
+        g_ptr_array_add(m->tbs, tb);
+    }
+}
+
+/*
+ * Invalidate the TBs of @cpu's cluster that cover virtual address @addr,
+ * whether or not @addr currently has a translation.  This is what the
+ * breakpoint code needs and it leaves the rest of the TB cache alone.
+ */
+void tb_invalidate_virt_addr(CPUState *cpu, target_ulong addr)
+{
+    struct tb_virt_addr_match m = {
+        .addr = addr,
+        .cflags = (cpu->cluster_index << CF_CLUSTER_SHIFT) & CF_CLUSTER_MASK,
+        .tbs = g_ptr_array_new(),
+    };
+    int i;
+
+    /* The TBs cannot be removed from the hash table while we walk it.  */
+    qht_iter(&tb_ctx.htable, do_tb_virt_addr_match, &m);
+    for (i = 0; i < m.tbs->len; i++) {
+        tb_phys_invalidate(g_ptr_array_index(m.tbs, i), -1);
+    }
+    g_ptr_array_free(m.tbs, true);
+}
+
 /* in deterministic execution mode, instructions doing device I/Os
  * must be at the end of the TB.
  *
@@ -2195,13 +2379,14 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
 #endif
     TranslationBlock *tb;
     uint32_t n;
+    int insn;
 
     tb = tcg_tb_lookup(retaddr);
     if (!tb) {
         cpu_abort(cpu, "cpu_io_recompile: could not find TB for pc=%p",
                   (void *)retaddr);
     }
-    cpu_restore_state_from_tb(cpu, tb, retaddr, true);
+    insn = cpu_restore_state_from_tb(cpu, tb, retaddr, true);
 
     /* On MIPS and SH, delay slot instructions can only be restarted if
        they were already the first instruction in the TB.  If this is not
@@ -2236,6 +2421,14 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
             tb_phys_invalidate(tb->orig_tb, -1);
         }
         tcg_tb_remove(tb);
+    } else if (n == 1 && insn >= 0 &&
+               !(tb_cflags(tb) & (CF_LAST_IO | CF_COUNT_MASK))) {
+        /*
+         * Split the block at the I/O insn from now on, so that this
+         * path is not taken again on every execution.
+         */
+        tb_io_hint_add(tb, insn);
+        tb_phys_invalidate(tb, -1);
     }
 
     /* TODO: If env->pc != tb->pc (i.e. the faulting instruction was not
@@ -2373,6 +2566,8 @@ void dump_exec_info(void)
     qemu_printf("\nStatistics:\n");
     qemu_printf("TB flush count      %u\n",
                 atomic_read(&tb_ctx.tb_flush_count));
+    qemu_printf("TB region evictions %u\n",
+                atomic_read(&tb_ctx.tb_evict_count));
     qemu_printf("TB invalidate count %zu\n",
                 tcg_tb_phys_invalidate_count());
 
@@ -2388,6 +2583,24 @@ void dump_opcount_info(void)
     tcg_dump_op_count();
 }
 
+TbHashInfo *qmp_x_query_tb_hash(Error **errp)
+{
+    TbHashInfo *info = g_new0(TbHashInfo, 1);
+    struct qht_stats hst;
+
+    qht_statistics_init(&tb_ctx.htable, &hst);
+    info->head_buckets = hst.head_buckets;
+    info->used_head_buckets = hst.used_head_buckets;
+    info->entries = hst.entries;
+    if (hst.used_head_buckets) {
+        info->occupancy_avg = qdist_avg(&hst.occupancy);
+        info->chain_avg = qdist_avg(&hst.chain);
+        info->chain_max = qdist_xmax(&hst.chain);
+    }
+    qht_statistics_destroy(&hst);
+    return info;
+}
+
 #else /* CONFIG_USER_ONLY */
 
 void cpu_interrupt(CPUState *cpu, int mask)
@@ -2625,6 +2838,22 @@ int page_unprotect(target_ulong address, uintptr_t pc)
     PageDesc *p;
     target_ulong host_start, host_end, addr;
 
+#ifndef TARGET_HAS_PRECISE_SMC
+    /*
+     * Several threads often fault on the same page; all but the first
+     * find it already writable.  Let them retry the access without
+     * waiting for mmap_lock, which may be held for a long translation
+     * or mmap.  If the host page is not writable yet they fault again.
+     * With precise SMC the current TB must be checked once the other
+     * thread is done invalidating, so take the lock then.
+     */
+    p = page_find(address >> TARGET_PAGE_BITS);
+    if (p && (atomic_read(&p->flags) & (PAGE_WRITE_ORG | PAGE_WRITE)) ==
+             (PAGE_WRITE_ORG | PAGE_WRITE)) {
+        return 1;
+    }
+#endif
+
     /* Technically this isn't safe inside a signal handler.  However we
        know this only ever happens in a synchronous SEGV handler, so in
        practice it seems to be ok.  */
@@ -457,6 +457,11 @@ void mixeng_volume (struct st_sample *buf, int len, struct mixeng_volume *vol)
         return;
     }
 
+    /* Unity gain leaves the samples as they are.  */
+    if (vol->l == nominal_volume.l && vol->r == nominal_volume.r) {
+        return;
+    }
+
     while (len--) {
 #ifdef FLOAT_MIXENG
         buf->l = buf->l * vol->l;
@@ -30,6 +30,7 @@ struct HostMemoryBackendFile {
     uint64_t align;
     bool discard_data;
     bool is_pmem;
+    bool clone;
 };
 
 static void
@@ -50,13 +51,18 @@ file_backend_memory_alloc(HostMemoryBackend *backend, Error **errp)
         error_setg(errp, "mem-path property not set");
         return;
     }
+    if (fb->clone && backend->share) {
+        error_setg(errp, "'clone' and 'share' are mutually exclusive");
+        return;
+    }
 
     name = host_memory_backend_get_name(backend);
     memory_region_init_ram_from_file(&backend->mr, OBJECT(backend),
                                      name,
                                      backend->size, fb->align,
                                      (backend->share ? RAM_SHARED : 0) |
-                                     (fb->is_pmem ? RAM_PMEM : 0),
+                                     (fb->is_pmem ? RAM_PMEM : 0) |
+                                     (fb->clone ? RAM_CLONE : 0),
                                      fb->mem_path, errp);
     g_free(name);
 #endif
@@ -162,12 +168,32 @@ static void file_memory_backend_set_pmem(Object *o, bool value, Error **errp)
     fb->is_pmem = value;
 }
 
+static bool file_memory_backend_get_clone(Object *o, Error **errp)
+{
+    return MEMORY_BACKEND_FILE(o)->clone;
+}
+
+static void file_memory_backend_set_clone(Object *o, bool value, Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(o);
+    HostMemoryBackendFile *fb = MEMORY_BACKEND_FILE(o);
+
+    if (host_memory_backend_mr_inited(backend)) {
+        error_setg(errp, "cannot change property 'clone' of %s",
+                   object_get_typename(o));
+        return;
+    }
+    fb->clone = value;
+}
+
 static void file_backend_unparent(Object *obj)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
     HostMemoryBackendFile *fb = MEMORY_BACKEND_FILE(obj);
 
-    if (host_memory_backend_mr_inited(backend) && fb->discard_data) {
+    /* The template of a clone is not ours to destroy */
+    if (host_memory_backend_mr_inited(backend) && fb->discard_data &&
+        !fb->clone) {
         void *ptr = memory_region_get_ram_ptr(&backend->mr);
         uint64_t sz = memory_region_size(&backend->mr);
 
@@ -193,6 +219,8 @@ file_backend_class_init(ObjectClass *oc, void *data)
         NULL, NULL);
     object_class_property_add_bool(oc, "pmem",
         file_memory_backend_get_pmem, file_memory_backend_set_pmem);
+    object_class_property_add_bool(oc, "clone",
+        file_memory_backend_get_clone, file_memory_backend_set_clone);
 }
 
 static void file_backend_instance_finalize(Object *o)
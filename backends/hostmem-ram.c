@@ -13,12 +13,25 @@
 #include "qemu/osdep.h"
 #include "sysemu/hostmem.h"
 #include "qapi/error.h"
+#include "qapi/visitor.h"
 #include "qemu/module.h"
 #include "qom/object_interfaces.h"
 
+#define MEMORY_BACKEND_RAM(obj) \
+    OBJECT_CHECK(HostMemoryBackendRam, (obj), TYPE_MEMORY_BACKEND_RAM)
+
+typedef struct HostMemoryBackendRam HostMemoryBackendRam;
+
+struct HostMemoryBackendRam {
+    HostMemoryBackend parent_obj;
+
+    uint64_t hugetlbsize;
+};
+
 static void
 ram_backend_memory_alloc(HostMemoryBackend *backend, Error **errp)
 {
+    HostMemoryBackendRam *r = MEMORY_BACKEND_RAM(backend);
     char *name;
 
     if (!backend->size) {
@@ -27,22 +40,76 @@ ram_backend_memory_alloc(HostMemoryBackend *backend, Error **errp)
     }
 
     name = host_memory_backend_get_name(backend);
-    memory_region_init_ram_shared_nomigrate(&backend->mr, OBJECT(backend), name,
-                           backend->size, backend->share, errp);
+    if (r->hugetlbsize) {
+        memory_region_init_ram_hugetlb(&backend->mr, OBJECT(backend), name,
+                                       backend->size, r->hugetlbsize,
+                                       backend->share, errp);
+    } else {
+        memory_region_init_ram_shared_nomigrate(&backend->mr, OBJECT(backend),
+                                                name, backend->size,
+                                                backend->share, errp);
+    }
     g_free(name);
 }
 
+static void
+ram_backend_set_hugetlbsize(Object *obj, Visitor *v, const char *name,
+                            void *opaque, Error **errp)
+{
+    HostMemoryBackendRam *r = MEMORY_BACKEND_RAM(obj);
+    Error *local_err = NULL;
+    uint64_t value;
+
+    if (host_memory_backend_mr_inited(MEMORY_BACKEND(obj))) {
+        error_setg(&local_err, "cannot change property value");
+        goto out;
+    }
+
+    visit_type_size(v, name, &value, &local_err);
+    if (local_err) {
+        goto out;
+    }
+    if (value && !is_power_of_2(value)) {
+        error_setg(&local_err, "Property '%s.%s' doesn't take value '%"
+                   PRIu64 "'", object_get_typename(obj), name, value);
+        goto out;
+    }
+    r->hugetlbsize = value;
+out:
+    error_propagate(errp, local_err);
+}
+
+static void
+ram_backend_get_hugetlbsize(Object *obj, Visitor *v, const char *name,
+                            void *opaque, Error **errp)
+{
+    HostMemoryBackendRam *r = MEMORY_BACKEND_RAM(obj);
+    uint64_t value = r->hugetlbsize;
+
+    visit_type_size(v, name, &value, errp);
+}
+
 static void
 ram_backend_class_init(ObjectClass *oc, void *data)
 {
     HostMemoryBackendClass *bc = MEMORY_BACKEND_CLASS(oc);
 
     bc->alloc = ram_backend_memory_alloc;
+
+#ifdef CONFIG_LINUX
+    object_class_property_add(oc, "hugetlbsize", "int",
+                              ram_backend_get_hugetlbsize,
+                              ram_backend_set_hugetlbsize,
+                              NULL, NULL);
+    object_class_property_set_description(oc, "hugetlbsize",
+        "Back with anonymous huge pages of this size (ex: 2M, 1G)");
+#endif
 }
 
 static const TypeInfo ram_backend_info = {
     .name = TYPE_MEMORY_BACKEND_RAM,
     .parent = TYPE_MEMORY_BACKEND,
+    .instance_size = sizeof(HostMemoryBackendRam),
     .class_init = ram_backend_class_init,
 };
 
@@ -24,6 +24,7 @@
 
 #define BLOCK_COPY_MAX_COPY_RANGE (16 * MiB)
 #define BLOCK_COPY_MAX_BUFFER (1 * MiB)
+#define BLOCK_COPY_MAX_ADAPTIVE_BUFFER (16 * MiB)
 #define BLOCK_COPY_MAX_MEM (128 * MiB)
 #define BLOCK_COPY_MAX_WORKERS 64
 
@@ -64,6 +65,12 @@ typedef struct BlockCopyState {
     int64_t cluster_size;
     bool use_copy_range;
     int64_t copy_size;
+    /*
+     * Buffered copying adapts copy_size: it doubles whenever a full-sized
+     * chunk was copied, as long as the dirty extents are that long, and
+     * halves when a task has to wait for bounce buffer memory.
+     */
+    bool adaptive_copy_size;
     uint64_t len;
     QLIST_HEAD(, BlockCopyTask) tasks;
 
@@ -259,6 +266,7 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
          */
         s->use_copy_range = true;
         s->copy_size = MAX(s->cluster_size, BLOCK_COPY_MAX_BUFFER);
+        s->adaptive_copy_size = true;
     }
 
     QLIST_INIT(&s->tasks);
@@ -409,6 +417,44 @@ out:
     return ret;
 }
 
+static int64_t block_copy_max_buffer(BlockCopyState *s)
+{
+    return MAX(s->cluster_size, BLOCK_COPY_MAX_ADAPTIVE_BUFFER);
+}
+
+/* A buffered chunk of @bytes was copied, see if larger ones would do */
+static void block_copy_grow_copy_size(BlockCopyState *s, int64_t bytes)
+{
+    int64_t new_size;
+
+    if (!s->adaptive_copy_size || s->use_copy_range || bytes < s->copy_size) {
+        return;
+    }
+
+    new_size = MIN(s->copy_size * 2, block_copy_max_buffer(s));
+    if (new_size != s->copy_size) {
+        trace_block_copy_adapt_copy_size(s, s->copy_size, new_size);
+        s->copy_size = new_size;
+    }
+}
+
+/* Tasks are waiting for bounce buffer memory, use smaller chunks */
+static void block_copy_shrink_copy_size(BlockCopyState *s)
+{
+    int64_t new_size;
+
+    if (!s->adaptive_copy_size || s->use_copy_range) {
+        return;
+    }
+
+    new_size = MAX(QEMU_ALIGN_DOWN(s->copy_size / 2, s->cluster_size),
+                   MAX(s->cluster_size, BLOCK_COPY_MAX_BUFFER));
+    if (new_size != s->copy_size) {
+        trace_block_copy_adapt_copy_size(s, s->copy_size, new_size);
+        s->copy_size = new_size;
+    }
+}
+
 static coroutine_fn int block_copy_task_entry(AioTask *task)
 {
     BlockCopyTask *t = container_of(task, BlockCopyTask, task);
@@ -423,6 +469,9 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
     } else {
         progress_work_done(t->s->progress, t->bytes);
         t->s->progress_bytes_callback(t->bytes, t->s->progress_opaque);
+        if (!t->zeroes) {
+            block_copy_grow_copy_size(t->s, t->bytes);
+        }
     }
     co_put_to_shres(t->s->mem, t->bytes);
     block_copy_task_end(t, ret);
@@ -598,7 +647,10 @@ static int coroutine_fn block_copy_dirty_clusters(BlockCopyState *s,
 
         trace_block_copy_process(s, task->offset);
 
-        co_get_from_shres(s->mem, task->bytes);
+        if (!co_try_get_from_shres(s->mem, task->bytes)) {
+            block_copy_shrink_copy_size(s);
+            co_get_from_shres(s->mem, task->bytes);
+        }
 
         offset = task_end(task);
         bytes = end - offset;
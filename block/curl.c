@@ -60,7 +60,7 @@ static CURLMcode __curl_multi_socket_action(CURLM *multi_handle,
 #define PROTOCOLS (CURLPROTO_HTTP | CURLPROTO_HTTPS | \
                    CURLPROTO_FTP | CURLPROTO_FTPS)
 
-#define CURL_NUM_STATES 8
+#define CURL_NUM_STATES 16
 #define CURL_NUM_ACB    8
 #define CURL_TIMEOUT_MAX 10000
 
@@ -853,15 +853,72 @@ out_noclean:
     return -EINVAL;
 }
 
-static void curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
+/* Called with s->mutex held.  */
+static bool curl_range_pending(BDRVCURLState *s, uint64_t start)
+{
+    int i;
+
+    for (i = 0; i < CURL_NUM_STATES; i++) {
+        CURLState *state = &s->states[i];
+        size_t len = state->in_use ? state->buf_len : state->buf_off;
+
+        if (state->orig_buf && start >= state->buf_start &&
+            start < state->buf_start + len) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Start fetching [start, start + len) into @state.  @acb, if not NULL, is
+ * completed when the transfer finishes.
+ *
+ * Called with s->mutex held.
+ */
+static int curl_start_range(BDRVCURLState *s, CURLState *state,
+                            uint64_t start, size_t len, CURLAIOCB *acb)
 {
-    CURLState *state;
     int running;
 
-    BDRVCURLState *s = bs->opaque;
+    if (curl_init_state(s, state) < 0) {
+        curl_clean_state(state);
+        return -EIO;
+    }
+
+    state->buf_off = 0;
+    g_free(state->orig_buf);
+    state->buf_start = start;
+    state->buf_len = len;
+    state->orig_buf = g_try_malloc(state->buf_len);
+    if (state->buf_len && state->orig_buf == NULL) {
+        curl_clean_state(state);
+        return -ENOMEM;
+    }
+    state->acb[0] = acb;
 
+    snprintf(state->range, 127, "%" PRIu64 "-%" PRIu64,
+             start, start + len - 1);
+    curl_easy_setopt(state->curl, CURLOPT_RANGE, state->range);
+
+    if (curl_multi_add_handle(s->multi, state->curl) != CURLM_OK) {
+        state->acb[0] = NULL;
+        curl_clean_state(state);
+        return -EIO;
+    }
+
+    /* Tell curl it needs to kick things off */
+    curl_multi_socket_action(s->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    return 0;
+}
+
+static void curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
+{
+    CURLState *state;
+    BDRVCURLState *s = bs->opaque;
     uint64_t start = acb->offset;
-    uint64_t end;
+    uint64_t buf_start, buf_end;
+    int ret;
 
     qemu_mutex_lock(&s->mutex);
 
@@ -880,43 +937,43 @@ static void curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
         qemu_co_queue_wait(&s->free_state_waitq, &s->mutex);
     }
 
-    if (curl_init_state(s, state) < 0) {
-        curl_clean_state(state);
-        acb->ret = -EIO;
-        goto out;
+    /*
+     * Fetch whole readahead-sized chunks, so that neighbouring requests
+     * find each other's buffers instead of issuing overlapping ranges.
+     */
+    buf_start = start;
+    buf_end = MIN(start + acb->bytes, s->len) + s->readahead_size;
+    if (s->readahead_size) {
+        buf_start = QEMU_ALIGN_DOWN(start, s->readahead_size);
+        buf_end = QEMU_ALIGN_UP(buf_end, s->readahead_size);
     }
+    buf_end = MIN(buf_end, s->len);
 
-    acb->start = 0;
-    acb->end = MIN(acb->bytes, s->len - start);
+    acb->start = start - buf_start;
+    acb->end = acb->start + MIN(acb->bytes, s->len - start);
 
-    state->buf_off = 0;
-    g_free(state->orig_buf);
-    state->buf_start = start;
-    state->buf_len = MIN(acb->end + s->readahead_size, s->len - start);
-    end = start + state->buf_len - 1;
-    state->orig_buf = g_try_malloc(state->buf_len);
-    if (state->buf_len && state->orig_buf == NULL) {
-        curl_clean_state(state);
-        acb->ret = -ENOMEM;
+    trace_curl_setup_preadv(acb->bytes, start, buf_start, buf_end - buf_start);
+    ret = curl_start_range(s, state, buf_start, buf_end - buf_start, acb);
+    if (ret < 0) {
+        acb->ret = ret;
         goto out;
     }
-    state->acb[0] = acb;
 
-    snprintf(state->range, 127, "%" PRIu64 "-%" PRIu64, start, end);
-    trace_curl_setup_preadv(acb->bytes, start, state->range);
-    curl_easy_setopt(state->curl, CURLOPT_RANGE, state->range);
-
-    if (curl_multi_add_handle(s->multi, state->curl) != CURLM_OK) {
-        state->acb[0] = NULL;
-        acb->ret = -EIO;
+    /*
+     * Reads are mostly sequential while booting or streaming an image,
+     * so get the next chunk in flight too if a connection is idle.
+     */
+    if (s->readahead_size && buf_end < s->len &&
+        !curl_range_pending(s, buf_end)) {
+        state = curl_find_state(s);
+        if (state) {
+            size_t len = MIN(buf_end - buf_start, s->len - buf_end);
 
-        curl_clean_state(state);
-        goto out;
+            trace_curl_prefetch(buf_end, len);
+            curl_start_range(s, state, buf_end, len, NULL);
+        }
     }
 
-    /* Tell curl it needs to kick things off */
-    curl_multi_socket_action(s->multi, CURL_SOCKET_TIMEOUT, 0, &running);
-
 out:
     qemu_mutex_unlock(&s->mutex);
 }
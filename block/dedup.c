@@ -0,0 +1,1096 @@
+/*
+ * Deduplicating image format
+ *
+ * Copyright (c) 2020 Xilinx Inc
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * A dedup image splits the virtual disk into fixed-size chunks.  The
+ * image file only holds a header and an index with one entry per chunk;
+ * the data lives in a separate chunk store, where every distinct chunk is
+ * stored once, keyed by its SHA-256 hash.  Many images, for example the
+ * nightly backups of a set of similar VMs, can share one store.
+ *
+ * The store is append-only.  It starts with a header block, followed by
+ * records of a fixed size: a record header with the hash of the chunk,
+ * and the chunk itself.  Chunks are never freed, so overwriting data in
+ * an image leaves the old chunk behind; images are meant to be written
+ * once, as backup targets.  On open, the headers of all records are read
+ * to rebuild the hash table of the store.  Records that are not valid,
+ * for example torn by a crash in the middle of an append, are skipped.
+ *
+ * An index entry is the offset of the record in the store, or zero for a
+ * chunk that reads as zeroes.  The index is only updated after the chunk
+ * has been written.  A flush flushes both the store and the image, so, as
+ * with other formats, only what was written before the last flush is
+ * guaranteed to survive a crash.
+ *
+ * Nodes that share a store must use the same store node, which then also
+ * shares the hash table.  Writing to the store through any other node,
+ * including from another process, corrupts it.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-visit-block-core.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qobject-input-visitor.h"
+#include "block/block_int.h"
+#include "block/qdict.h"
+#include "crypto/hash.h"
+#include "qemu/bswap.h"
+#include "qemu/coroutine.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/uuid.h"
+#include "sysemu/block-backend.h"
+#include "trace.h"
+
+#define DEDUP_MAGIC             0x49444451 /* "QDDI" */
+#define DEDUP_STORE_MAGIC       0x53444451 /* "QDDS" */
+#define DEDUP_RECORD_MAGIC      0x43444451 /* "QDDC" */
+#define DEDUP_VERSION           1
+
+#define DEDUP_HASH_ALG          QCRYPTO_HASH_ALG_SHA256
+#define DEDUP_HASH_SIZE         32
+
+/* The image header and the store header each take the first block */
+#define DEDUP_HEADER_SIZE       4096
+/* The record header keeps the chunks sector aligned */
+#define DEDUP_RECORD_HDR_SIZE   512
+
+#define DEDUP_MIN_CHUNK_SIZE    4096
+#define DEDUP_MAX_CHUNK_SIZE    (4 * MiB)
+#define DEDUP_DEFAULT_CHUNK_SIZE (64 * KiB)
+
+/* All fields are little-endian.  The store filename follows the header. */
+typedef struct DedupHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunk_size;
+    uint32_t store_name_len;
+    uint64_t disk_size;
+    uint64_t index_offset;
+    QemuUUID store_id;
+} QEMU_PACKED DedupHeader;
+
+typedef struct DedupStoreHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunk_size;
+    uint32_t reserved;
+    QemuUUID id;
+} QEMU_PACKED DedupStoreHeader;
+
+typedef struct DedupRecordHeader {
+    uint32_t magic;
+    uint32_t len;
+    uint8_t hash[DEDUP_HASH_SIZE];
+} QEMU_PACKED DedupRecordHeader;
+
+typedef struct DedupChunk {
+    uint8_t hash[DEDUP_HASH_SIZE];
+    uint64_t offset;
+    /* Still being written; wait on DedupStore.pending_queue */
+    bool pending;
+} DedupChunk;
+
+typedef struct DedupStore {
+    BlockDriverState *bs;
+    unsigned int refcnt;
+    uint32_t chunk_size;
+    QemuUUID id;
+
+    /* Hash of the chunk -> DedupChunk */
+    GHashTable *chunks;
+    /* Where the next record is appended */
+    uint64_t end;
+    CoQueue pending_queue;
+} DedupStore;
+
+typedef struct BDRVDedupState {
+    BdrvChild *store_child;
+    DedupStore *store;
+    char *store_name;
+
+    uint32_t chunk_size;
+    int chunk_bits;
+    uint64_t disk_size;
+    uint64_t nb_chunks;
+    uint64_t index_offset;
+    /* Host-endian copy of the index */
+    uint64_t *index;
+} BDRVDedupState;
+
+/* Stores in use by some node, indexed by the BlockDriverState of the store */
+static GHashTable *dedup_stores;
+
+static int dedup_probe(const uint8_t *buf, int buf_size, const char *filename)
+{
+    if (buf_size >= sizeof(DedupHeader) &&
+        ldl_le_p(buf) == DEDUP_MAGIC &&
+        ldl_le_p(buf + 4) == DEDUP_VERSION) {
+        return 100;
+    }
+    return 0;
+}
+
+static guint dedup_hash_hash(gconstpointer key)
+{
+    /* The hash is a cryptographic one, any four bytes of it will do */
+    return ldl_he_p(key);
+}
+
+static gboolean dedup_hash_equal(gconstpointer a, gconstpointer b)
+{
+    return !memcmp(a, b, DEDUP_HASH_SIZE);
+}
+
+static uint64_t dedup_record_size(DedupStore *st)
+{
+    return DEDUP_RECORD_HDR_SIZE + st->chunk_size;
+}
+
+static bool dedup_record_valid(DedupStore *st, uint64_t offset)
+{
+    return offset >= DEDUP_HEADER_SIZE && offset < st->end &&
+           (offset - DEDUP_HEADER_SIZE) % dedup_record_size(st) == 0;
+}
+
+static int dedup_store_read_records(DedupStore *st, BdrvChild *child,
+                                    Error **errp)
+{
+    uint64_t record_size = dedup_record_size(st);
+    DedupRecordHeader *rh;
+    uint64_t offset, skipped = 0;
+    int64_t len;
+    int ret = 0;
+
+    len = bdrv_getlength(child->bs);
+    if (len < 0) {
+        error_setg_errno(errp, -len, "Could not get the store length");
+        return len;
+    }
+
+    rh = qemu_blockalign(child->bs, DEDUP_RECORD_HDR_SIZE);
+    for (offset = DEDUP_HEADER_SIZE; offset + record_size <= len;
+         offset += record_size) {
+        DedupChunk *c;
+
+        ret = bdrv_pread(child, offset, rh, DEDUP_RECORD_HDR_SIZE);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read the chunk store");
+            goto out;
+        }
+        if (le32_to_cpu(rh->magic) != DEDUP_RECORD_MAGIC ||
+            le32_to_cpu(rh->len) != st->chunk_size ||
+            g_hash_table_contains(st->chunks, rh->hash)) {
+            skipped++;
+            continue;
+        }
+
+        c = g_new0(DedupChunk, 1);
+        memcpy(c->hash, rh->hash, DEDUP_HASH_SIZE);
+        c->offset = offset;
+        g_hash_table_insert(st->chunks, c->hash, c);
+    }
+    ret = 0;
+
+    /* A torn record at the end is overwritten by the next append */
+    st->end = offset;
+    if (skipped) {
+        warn_report("dedup: skipped %" PRIu64 " invalid records in chunk "
+                    "store '%s'", skipped, child->bs->filename);
+    }
+
+out:
+    qemu_vfree(rh);
+    return ret;
+}
+
+static DedupStore *dedup_store_get(BdrvChild *child, uint32_t chunk_size,
+                                   const QemuUUID *id, Error **errp)
+{
+    DedupStore *st;
+    DedupStoreHeader sh;
+    int ret;
+
+    if (!dedup_stores) {
+        dedup_stores = g_hash_table_new(NULL, NULL);
+    }
+
+    st = g_hash_table_lookup(dedup_stores, child->bs);
+    if (st) {
+        if (st->chunk_size != chunk_size || !qemu_uuid_is_equal(&st->id, id)) {
+            error_setg(errp, "'%s' is not the chunk store of this image",
+                       child->bs->filename);
+            return NULL;
+        }
+        st->refcnt++;
+        return st;
+    }
+
+    ret = bdrv_pread(child, 0, &sh, sizeof(sh));
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read the chunk store header");
+        return NULL;
+    }
+    if (le32_to_cpu(sh.magic) != DEDUP_STORE_MAGIC ||
+        le32_to_cpu(sh.version) != DEDUP_VERSION) {
+        error_setg(errp, "'%s' is not a dedup chunk store",
+                   child->bs->filename);
+        return NULL;
+    }
+    if (le32_to_cpu(sh.chunk_size) != chunk_size ||
+        !qemu_uuid_is_equal(&sh.id, id)) {
+        error_setg(errp, "'%s' is not the chunk store of this image",
+                   child->bs->filename);
+        return NULL;
+    }
+
+    st = g_new0(DedupStore, 1);
+    st->bs = child->bs;
+    st->refcnt = 1;
+    st->chunk_size = chunk_size;
+    st->id = *id;
+    st->chunks = g_hash_table_new_full(dedup_hash_hash, dedup_hash_equal,
+                                       NULL, g_free);
+    qemu_co_queue_init(&st->pending_queue);
+
+    ret = dedup_store_read_records(st, child, errp);
+    if (ret < 0) {
+        g_hash_table_destroy(st->chunks);
+        g_free(st);
+        return NULL;
+    }
+
+    trace_dedup_store_open(st->bs, g_hash_table_size(st->chunks), st->end);
+    g_hash_table_insert(dedup_stores, st->bs, st);
+    return st;
+}
+
+static void dedup_store_put(DedupStore *st)
+{
+    if (--st->refcnt) {
+        return;
+    }
+
+    g_hash_table_remove(dedup_stores, st->bs);
+    g_hash_table_destroy(st->chunks);
+    g_free(st);
+}
+
+static void dedup_child_perm(BlockDriverState *bs, BdrvChild *c,
+                             BdrvChildRole role,
+                             BlockReopenQueue *reopen_queue,
+                             uint64_t perm, uint64_t shared,
+                             uint64_t *nperm, uint64_t *nshared)
+{
+    bdrv_default_perms(bs, c, role, reopen_queue, perm, shared,
+                       nperm, nshared);
+
+    /* Let the other images that use the store append to it, too */
+    if (!(role & BDRV_CHILD_PRIMARY)) {
+        *nshared |= BLK_PERM_WRITE | BLK_PERM_RESIZE;
+    }
+}
+
+static QemuOptsList runtime_opts = {
+    .name = "dedup",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        { /* end of list */ }
+    },
+};
+
+static int dedup_read_header(BlockDriverState *bs, QemuUUID *store_id,
+                             Error **errp)
+{
+    BDRVDedupState *s = bs->opaque;
+    DedupHeader h;
+    uint32_t name_len;
+    int64_t len;
+    int ret;
+
+    ret = bdrv_pread(bs->file, 0, &h, sizeof(h));
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read the image header");
+        return ret;
+    }
+
+    if (le32_to_cpu(h.magic) != DEDUP_MAGIC) {
+        error_setg(errp, "Image not in dedup format");
+        return -EINVAL;
+    }
+    if (le32_to_cpu(h.version) != DEDUP_VERSION) {
+        error_setg(errp, "Unsupported dedup version %" PRIu32,
+                   le32_to_cpu(h.version));
+        return -ENOTSUP;
+    }
+
+    s->chunk_size = le32_to_cpu(h.chunk_size);
+    if (s->chunk_size < DEDUP_MIN_CHUNK_SIZE ||
+        s->chunk_size > DEDUP_MAX_CHUNK_SIZE ||
+        !is_power_of_2(s->chunk_size)) {
+        error_setg(errp, "Invalid chunk size %" PRIu32, s->chunk_size);
+        return -EINVAL;
+    }
+    s->chunk_bits = ctz32(s->chunk_size);
+
+    s->disk_size = le64_to_cpu(h.disk_size);
+    if (!QEMU_IS_ALIGNED(s->disk_size, s->chunk_size) ||
+        s->disk_size > INT64_MAX - s->chunk_size) {
+        error_setg(errp, "Invalid disk size %" PRIu64, s->disk_size);
+        return -EINVAL;
+    }
+    s->nb_chunks = s->disk_size >> s->chunk_bits;
+
+    s->index_offset = le64_to_cpu(h.index_offset);
+    len = bdrv_getlength(bs->file->bs);
+    if (len < 0) {
+        error_setg_errno(errp, -len, "Could not get the image length");
+        return len;
+    }
+    if (s->index_offset < DEDUP_HEADER_SIZE ||
+        s->nb_chunks > (len - s->index_offset) / sizeof(uint64_t)) {
+        error_setg(errp, "The index does not fit into the image");
+        return -EINVAL;
+    }
+
+    name_len = le32_to_cpu(h.store_name_len);
+    if (name_len == 0 || name_len > DEDUP_HEADER_SIZE - sizeof(h)) {
+        error_setg(errp, "Invalid chunk store name length %" PRIu32,
+                   name_len);
+        return -EINVAL;
+    }
+    s->store_name = g_malloc0(name_len + 1);
+    ret = bdrv_pread(bs->file, sizeof(h), s->store_name, name_len);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read the chunk store name");
+        return ret;
+    }
+
+    *store_id = h.store_id;
+    return 0;
+}
+
+static int dedup_open(BlockDriverState *bs, QDict *options, int flags,
+                      Error **errp)
+{
+    BDRVDedupState *s = bs->opaque;
+    QemuOpts *opts;
+    Error *local_err = NULL;
+    QemuUUID store_id;
+    char *store_path = NULL;
+    uint64_t i;
+    int ret;
+
+    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    qemu_opts_absorb_qdict(opts, options, &local_err);
+    if (local_err) {
+        ret = -EINVAL;
+        error_propagate(errp, local_err);
+        goto fail;
+    }
+
+    if (!qcrypto_hash_supports(DEDUP_HASH_ALG)) {
+        ret = -ENOTSUP;
+        error_setg(errp, "dedup needs SHA-256 support in the crypto library");
+        goto fail;
+    }
+
+    /* The index lives in bs->file, the data in the store */
+    bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
+                               BDRV_CHILD_METADATA | BDRV_CHILD_PRIMARY,
+                               false, &local_err);
+    if (local_err) {
+        ret = -EINVAL;
+        error_propagate(errp, local_err);
+        goto fail;
+    }
+
+    ret = dedup_read_header(bs, &store_id, errp);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    s->store_child = bdrv_open_child(NULL, options, "store", bs,
+                                     &child_of_bds,
+                                     BDRV_CHILD_DATA | BDRV_CHILD_METADATA,
+                                     true, &local_err);
+    if (local_err) {
+        ret = -EINVAL;
+        error_propagate(errp, local_err);
+        goto fail;
+    }
+    if (!s->store_child) {
+        /* Like backing files, a relative name is relative to the image */
+        store_path = path_combine(bs->filename, s->store_name);
+        s->store_child = bdrv_open_child(store_path, options, "store", bs,
+                                         &child_of_bds,
+                                         BDRV_CHILD_DATA |
+                                         BDRV_CHILD_METADATA,
+                                         false, &local_err);
+        if (local_err) {
+            ret = -EINVAL;
+            error_propagate(errp, local_err);
+            goto fail;
+        }
+    }
+
+    s->store = dedup_store_get(s->store_child, s->chunk_size, &store_id,
+                               errp);
+    if (!s->store) {
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    s->index = g_try_new(uint64_t, s->nb_chunks);
+    if (s->nb_chunks && !s->index) {
+        ret = -ENOMEM;
+        error_setg(errp, "Could not allocate the index");
+        goto fail;
+    }
+    ret = bdrv_pread(bs->file, s->index_offset, s->index,
+                     s->nb_chunks * sizeof(uint64_t));
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read the index");
+        goto fail;
+    }
+    for (i = 0; i < s->nb_chunks; i++) {
+        le64_to_cpus(&s->index[i]);
+    }
+
+    bs->supported_zero_flags = BDRV_REQ_MAY_UNMAP;
+    ret = 0;
+
+fail:
+    if (ret < 0) {
+        if (s->store) {
+            dedup_store_put(s->store);
+            s->store = NULL;
+        }
+        g_free(s->index);
+        s->index = NULL;
+        g_free(s->store_name);
+        s->store_name = NULL;
+        bdrv_unref_child(bs, s->store_child);
+        s->store_child = NULL;
+        bdrv_unref_child(bs, bs->file);
+        bs->file = NULL;
+    }
+    g_free(store_path);
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static void dedup_close(BlockDriverState *bs)
+{
+    BDRVDedupState *s = bs->opaque;
+
+    dedup_store_put(s->store);
+    s->store = NULL;
+    g_free(s->index);
+    s->index = NULL;
+    g_free(s->store_name);
+    s->store_name = NULL;
+
+    bdrv_unref_child(bs, s->store_child);
+    s->store_child = NULL;
+}
+
+static void dedup_refresh_limits(BlockDriverState *bs, Error **errp)
+{
+    BDRVDedupState *s = bs->opaque;
+
+    bs->bl.request_alignment = s->chunk_size;
+    bs->bl.pwrite_zeroes_alignment = s->chunk_size;
+    bs->bl.pdiscard_alignment = s->chunk_size;
+}
+
+static int64_t dedup_getlength(BlockDriverState *bs)
+{
+    BDRVDedupState *s = bs->opaque;
+
+    return s->disk_size;
+}
+
+static int dedup_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
+{
+    BDRVDedupState *s = bs->opaque;
+
+    /* Makes the backup job write whole chunks */
+    bdi->cluster_size = s->chunk_size;
+    bdi->unallocated_blocks_are_zero = true;
+    return 0;
+}
+
+static int coroutine_fn dedup_co_preadv_part(BlockDriverState *bs,
+                                             uint64_t offset, uint64_t bytes,
+                                             QEMUIOVector *qiov,
+                                             size_t qiov_offset, int flags)
+{
+    BDRVDedupState *s = bs->opaque;
+    uint64_t chunk = offset >> s->chunk_bits;
+    uint64_t done;
+    int ret;
+
+    assert(QEMU_IS_ALIGNED(offset | bytes, s->chunk_size));
+
+    for (done = 0; done < bytes; done += s->chunk_size, chunk++) {
+        uint64_t record = s->index[chunk];
+
+        if (!record) {
+            qemu_iovec_memset(qiov, qiov_offset + done, 0, s->chunk_size);
+            continue;
+        }
+        if (!dedup_record_valid(s->store, record)) {
+            error_report_once("dedup: chunk %" PRIu64 " of '%s' refers to "
+                              "an invalid record", chunk, bs->filename);
+            return -EIO;
+        }
+
+        ret = bdrv_co_preadv_part(s->store_child,
+                                  record + DEDUP_RECORD_HDR_SIZE,
+                                  s->chunk_size, qiov, qiov_offset + done, 0);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Return the record that holds the data of the chunk at @qiov_offset in
+ * @qiov, appending a new one to the store if no chunk with the same hash
+ * is there yet.
+ */
+static int coroutine_fn dedup_store_chunk(BlockDriverState *bs,
+                                          QEMUIOVector *qiov,
+                                          size_t qiov_offset,
+                                          uint64_t *record)
+{
+    BDRVDedupState *s = bs->opaque;
+    DedupStore *st = s->store;
+    QEMUIOVector chunk_qiov, rec_qiov;
+    DedupRecordHeader *rh;
+    uint8_t hash[DEDUP_HASH_SIZE];
+    uint8_t *result = hash;
+    size_t result_len = sizeof(hash);
+    DedupChunk *c;
+    Error *local_err = NULL;
+    int ret;
+
+    qemu_iovec_init_slice(&chunk_qiov, qiov, qiov_offset, s->chunk_size);
+    ret = qcrypto_hash_bytesv(DEDUP_HASH_ALG, chunk_qiov.iov, chunk_qiov.niov,
+                              &result, &result_len, &local_err);
+    qemu_iovec_destroy(&chunk_qiov);
+    if (ret < 0) {
+        error_report_err(local_err);
+        return -EIO;
+    }
+
+    /* The lookup and the insertion cannot be interrupted by other requests */
+    while ((c = g_hash_table_lookup(st->chunks, hash)) && c->pending) {
+        qemu_co_queue_wait(&st->pending_queue, NULL);
+    }
+    if (c) {
+        trace_dedup_store_chunk(bs, c->offset, true);
+        *record = c->offset;
+        return 0;
+    }
+
+    c = g_new0(DedupChunk, 1);
+    memcpy(c->hash, hash, DEDUP_HASH_SIZE);
+    c->offset = st->end;
+    c->pending = true;
+    g_hash_table_insert(st->chunks, c->hash, c);
+    st->end += dedup_record_size(st);
+
+    rh = qemu_blockalign0(st->bs, DEDUP_RECORD_HDR_SIZE);
+    rh->magic = cpu_to_le32(DEDUP_RECORD_MAGIC);
+    rh->len = cpu_to_le32(s->chunk_size);
+    memcpy(rh->hash, hash, DEDUP_HASH_SIZE);
+
+    qemu_iovec_init(&rec_qiov, qiov->niov + 1);
+    qemu_iovec_add(&rec_qiov, rh, DEDUP_RECORD_HDR_SIZE);
+    qemu_iovec_concat(&rec_qiov, qiov, qiov_offset, s->chunk_size);
+
+    trace_dedup_store_chunk(bs, c->offset, false);
+    ret = bdrv_co_pwritev(s->store_child, c->offset, rec_qiov.size,
+                          &rec_qiov, 0);
+    qemu_iovec_destroy(&rec_qiov);
+    qemu_vfree(rh);
+
+    if (ret < 0) {
+        /* The hole is skipped when the store is opened again */
+        g_hash_table_remove(st->chunks, hash);
+    } else {
+        c->pending = false;
+        *record = c->offset;
+    }
+    qemu_co_queue_restart_all(&st->pending_queue);
+    return ret;
+}
+
+/* Set the index entries of @nb chunks from @chunk on to @records */
+static int coroutine_fn dedup_update_index(BlockDriverState *bs,
+                                           uint64_t chunk, uint64_t nb,
+                                           const uint64_t *records)
+{
+    BDRVDedupState *s = bs->opaque;
+    uint64_t *buf;
+    uint64_t i;
+    int ret;
+
+    buf = g_new(uint64_t, nb);
+    for (i = 0; i < nb; i++) {
+        buf[i] = cpu_to_le64(records[i]);
+    }
+    ret = bdrv_co_pwrite(bs->file, s->index_offset + chunk * sizeof(uint64_t),
+                         nb * sizeof(uint64_t), buf, 0);
+    g_free(buf);
+    if (ret < 0) {
+        return ret;
+    }
+
+    memcpy(&s->index[chunk], records, nb * sizeof(uint64_t));
+    return 0;
+}
+
+static int coroutine_fn dedup_co_pwritev_part(BlockDriverState *bs,
+                                              uint64_t offset, uint64_t bytes,
+                                              QEMUIOVector *qiov,
+                                              size_t qiov_offset, int flags)
+{
+    BDRVDedupState *s = bs->opaque;
+    uint64_t chunk = offset >> s->chunk_bits;
+    uint64_t nb = bytes >> s->chunk_bits;
+    uint64_t *records;
+    uint64_t i;
+    int ret = 0;
+
+    assert(QEMU_IS_ALIGNED(offset | bytes, s->chunk_size));
+
+    records = g_new(uint64_t, nb);
+    for (i = 0; i < nb; i++) {
+        size_t chunk_offset = qiov_offset + (i << s->chunk_bits);
+
+        if (qemu_iovec_is_zero(qiov, chunk_offset, s->chunk_size)) {
+            records[i] = 0;
+            continue;
+        }
+        ret = dedup_store_chunk(bs, qiov, chunk_offset, &records[i]);
+        if (ret < 0) {
+            goto out;
+        }
+    }
+
+    ret = dedup_update_index(bs, chunk, nb, records);
+
+out:
+    g_free(records);
+    return ret;
+}
+
+static int coroutine_fn dedup_co_pwrite_zeroes(BlockDriverState *bs,
+                                               int64_t offset, int bytes,
+                                               BdrvRequestFlags flags)
+{
+    BDRVDedupState *s = bs->opaque;
+    uint64_t nb = bytes >> s->chunk_bits;
+    uint64_t *records;
+    int ret;
+
+    assert(QEMU_IS_ALIGNED(offset | bytes, s->chunk_size));
+
+    /* Zero chunks take no space, so there is nothing to unmap */
+    records = g_new0(uint64_t, nb);
+    ret = dedup_update_index(bs, offset >> s->chunk_bits, nb, records);
+    g_free(records);
+    return ret;
+}
+
+static int coroutine_fn dedup_co_pdiscard(BlockDriverState *bs,
+                                          int64_t offset, int bytes)
+{
+    return dedup_co_pwrite_zeroes(bs, offset, bytes, BDRV_REQ_MAY_UNMAP);
+}
+
+static int coroutine_fn dedup_co_block_status(BlockDriverState *bs,
+                                              bool want_zero,
+                                              int64_t offset, int64_t bytes,
+                                              int64_t *pnum, int64_t *map,
+                                              BlockDriverState **file)
+{
+    BDRVDedupState *s = bs->opaque;
+    uint64_t chunk = offset >> s->chunk_bits;
+    uint64_t record = s->index[chunk];
+    uint64_t n = 1;
+
+    assert(QEMU_IS_ALIGNED(offset, s->chunk_size));
+
+    if (record) {
+        /* Records are not contiguous in the store, report one at a time */
+        *pnum = MIN(bytes, s->chunk_size);
+        *map = record + DEDUP_RECORD_HDR_SIZE;
+        *file = s->store_child->bs;
+        return BDRV_BLOCK_DATA | BDRV_BLOCK_OFFSET_VALID;
+    }
+
+    while (n < (bytes >> s->chunk_bits) && !s->index[chunk + n]) {
+        n++;
+    }
+    *pnum = MIN(bytes, n << s->chunk_bits);
+    return BDRV_BLOCK_ZERO;
+}
+
+static int dedup_co_create_store(BlockDriverState *store_bs,
+                                 uint32_t *chunk_size, QemuUUID *id,
+                                 Error **errp)
+{
+    BlockBackend *blk;
+    DedupStoreHeader sh;
+    int64_t len;
+    int ret;
+
+    blk = blk_new_with_bs(store_bs, BLK_PERM_WRITE | BLK_PERM_RESIZE,
+                          BLK_PERM_ALL, errp);
+    if (!blk) {
+        return -EPERM;
+    }
+
+    len = blk_getlength(blk);
+    if (len < 0) {
+        ret = len;
+        error_setg_errno(errp, -ret, "Could not get the store length");
+        goto out;
+    }
+
+    if (len > 0) {
+        /* Add the new image to the existing store */
+        ret = blk_pread(blk, 0, &sh, sizeof(sh));
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read the store header");
+            goto out;
+        }
+        if (le32_to_cpu(sh.magic) != DEDUP_STORE_MAGIC ||
+            le32_to_cpu(sh.version) != DEDUP_VERSION) {
+            ret = -EINVAL;
+            error_setg(errp, "'%s' is not a dedup chunk store",
+                       store_bs->filename);
+            goto out;
+        }
+        if (*chunk_size && le32_to_cpu(sh.chunk_size) != *chunk_size) {
+            ret = -EINVAL;
+            error_setg(errp, "The chunk store uses a chunk size of %" PRIu32,
+                       le32_to_cpu(sh.chunk_size));
+            goto out;
+        }
+        *chunk_size = le32_to_cpu(sh.chunk_size);
+        *id = sh.id;
+        ret = 0;
+        goto out;
+    }
+
+    if (!*chunk_size) {
+        *chunk_size = DEDUP_DEFAULT_CHUNK_SIZE;
+    }
+    qemu_uuid_generate(id);
+
+    memset(&sh, 0, sizeof(sh));
+    sh.magic = cpu_to_le32(DEDUP_STORE_MAGIC);
+    sh.version = cpu_to_le32(DEDUP_VERSION);
+    sh.chunk_size = cpu_to_le32(*chunk_size);
+    sh.id = *id;
+
+    blk_set_allow_write_beyond_eof(blk, true);
+    ret = blk_pwrite(blk, 0, &sh, sizeof(sh), 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not write the store header");
+        goto out;
+    }
+    ret = blk_truncate(blk, DEDUP_HEADER_SIZE, false, PREALLOC_MODE_OFF, 0,
+                       errp);
+
+out:
+    blk_unref(blk);
+    return ret;
+}
+
+static int coroutine_fn dedup_co_do_create(BlockdevCreateOptions *options,
+                                           const char *store_name,
+                                           Error **errp)
+{
+    BlockdevCreateOptionsDedup *opts;
+    BlockDriverState *bs = NULL, *store_bs = NULL;
+    BlockBackend *blk = NULL;
+    DedupHeader *h = NULL;
+    uint32_t chunk_size = 0;
+    uint64_t index_size;
+    QemuUUID store_id;
+    int ret;
+
+    assert(options->driver == BLOCKDEV_DRIVER_DEDUP);
+    opts = &options->u.dedup;
+
+    if (opts->has_cluster_size) {
+        if (opts->cluster_size < DEDUP_MIN_CHUNK_SIZE ||
+            opts->cluster_size > DEDUP_MAX_CHUNK_SIZE ||
+            !is_power_of_2(opts->cluster_size)) {
+            error_setg(errp, "Cluster size must be a power of two between "
+                       "%d and %d", DEDUP_MIN_CHUNK_SIZE,
+                       DEDUP_MAX_CHUNK_SIZE);
+            return -EINVAL;
+        }
+        chunk_size = opts->cluster_size;
+    }
+
+    store_bs = bdrv_open_blockdev_ref(opts->store, errp);
+    if (!store_bs) {
+        return -EIO;
+    }
+    if (!store_name) {
+        store_name = store_bs->filename;
+    }
+    if (!*store_name || sizeof(*h) + strlen(store_name) > DEDUP_HEADER_SIZE) {
+        ret = -EINVAL;
+        error_setg(errp, "The chunk store name must be between 1 and %zu "
+                   "characters long", DEDUP_HEADER_SIZE - sizeof(*h));
+        goto out;
+    }
+
+    ret = dedup_co_create_store(store_bs, &chunk_size, &store_id, errp);
+    if (ret < 0) {
+        goto out;
+    }
+
+    if (!QEMU_IS_ALIGNED(opts->size, chunk_size)) {
+        ret = -EINVAL;
+        error_setg(errp, "Image size must be a multiple of the cluster size "
+                   "(%" PRIu32 " bytes)", chunk_size);
+        goto out;
+    }
+    index_size = (opts->size / chunk_size) * sizeof(uint64_t);
+
+    bs = bdrv_open_blockdev_ref(opts->file, errp);
+    if (!bs) {
+        ret = -EIO;
+        goto out;
+    }
+
+    blk = blk_new_with_bs(bs, BLK_PERM_WRITE | BLK_PERM_RESIZE, BLK_PERM_ALL,
+                          errp);
+    if (!blk) {
+        ret = -EPERM;
+        goto out;
+    }
+    blk_set_allow_write_beyond_eof(blk, true);
+
+    /* An index full of zeroes describes an empty disk */
+    ret = blk_truncate(blk, DEDUP_HEADER_SIZE + index_size, false,
+                       PREALLOC_MODE_OFF, BDRV_REQ_ZERO_WRITE, errp);
+    if (ret < 0) {
+        goto out;
+    }
+
+    h = g_malloc0(DEDUP_HEADER_SIZE);
+    h->magic = cpu_to_le32(DEDUP_MAGIC);
+    h->version = cpu_to_le32(DEDUP_VERSION);
+    h->chunk_size = cpu_to_le32(chunk_size);
+    h->store_name_len = cpu_to_le32(strlen(store_name));
+    h->disk_size = cpu_to_le64(opts->size);
+    h->index_offset = cpu_to_le64(DEDUP_HEADER_SIZE);
+    h->store_id = store_id;
+    memcpy(h + 1, store_name, strlen(store_name));
+
+    ret = blk_pwrite(blk, 0, h, DEDUP_HEADER_SIZE, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not write the image header");
+        goto out;
+    }
+    ret = 0;
+
+out:
+    g_free(h);
+    blk_unref(blk);
+    bdrv_unref(bs);
+    bdrv_unref(store_bs);
+    return ret;
+}
+
+static int coroutine_fn dedup_co_create(BlockdevCreateOptions *options,
+                                        Error **errp)
+{
+    return dedup_co_do_create(options, NULL, errp);
+}
+
+static QemuOptsList dedup_create_opts;
+
+static int coroutine_fn dedup_co_create_opts(BlockDriver *drv,
+                                             const char *filename,
+                                             QemuOpts *opts,
+                                             Error **errp)
+{
+    BlockdevCreateOptions *create_options = NULL;
+    BlockDriverState *bs = NULL, *store_bs = NULL;
+    QDict *qdict = NULL;
+    char *store_name = NULL, *store_path = NULL;
+    Visitor *v;
+    Error *local_err = NULL;
+    int ret;
+
+    store_name = qemu_opt_get_del(opts, "store");
+    if (!store_name) {
+        error_setg(errp, "Parameter 'store' is required");
+        ret = -EINVAL;
+        goto done;
+    }
+
+    qdict = qemu_opts_to_qdict_filtered(opts, NULL, &dedup_create_opts, true);
+
+    /* Change legacy command line options into QMP ones */
+    static const QDictRenames opt_renames[] = {
+        { BLOCK_OPT_CLUSTER_SIZE,       "cluster-size" },
+        { NULL, NULL },
+    };
+
+    if (!qdict_rename_keys(qdict, opt_renames, errp)) {
+        ret = -EINVAL;
+        goto done;
+    }
+
+    /* Create and open the file (protocol layer) */
+    ret = bdrv_create_file(filename, opts, errp);
+    if (ret < 0) {
+        goto done;
+    }
+
+    bs = bdrv_open(filename, NULL, NULL,
+                   BDRV_O_RDWR | BDRV_O_RESIZE | BDRV_O_PROTOCOL, errp);
+    if (!bs) {
+        ret = -EIO;
+        goto done;
+    }
+
+    /* Use the store if it exists already, or create an empty one */
+    store_path = path_combine(filename, store_name);
+    store_bs = bdrv_open(store_path, NULL, NULL,
+                         BDRV_O_RDWR | BDRV_O_RESIZE | BDRV_O_PROTOCOL,
+                         &local_err);
+    if (!store_bs) {
+        error_free(local_err);
+        local_err = NULL;
+
+        qemu_opt_set_number(opts, BLOCK_OPT_SIZE, 0, &error_abort);
+        ret = bdrv_create_file(store_path, opts, errp);
+        if (ret < 0) {
+            goto done;
+        }
+        store_bs = bdrv_open(store_path, NULL, NULL,
+                             BDRV_O_RDWR | BDRV_O_RESIZE | BDRV_O_PROTOCOL,
+                             errp);
+        if (!store_bs) {
+            ret = -EIO;
+            goto done;
+        }
+    }
+
+    qdict_put_str(qdict, "driver", "dedup");
+    qdict_put_str(qdict, "file", bs->node_name);
+    qdict_put_str(qdict, "store", store_bs->node_name);
+
+    /* Get the QAPI object */
+    v = qobject_input_visitor_new_flat_confused(qdict, errp);
+    if (!v) {
+        ret = -EINVAL;
+        goto done;
+    }
+    visit_type_BlockdevCreateOptions(v, NULL, &create_options, &local_err);
+    visit_free(v);
+
+    if (local_err) {
+        error_propagate(errp, local_err);
+        ret = -EINVAL;
+        goto done;
+    }
+
+    /* Record the name as given, it is resolved relative to the image */
+    ret = dedup_co_do_create(create_options, store_name, errp);
+done:
+    qobject_unref(qdict);
+    qapi_free_BlockdevCreateOptions(create_options);
+    bdrv_unref(store_bs);
+    bdrv_unref(bs);
+    g_free(store_path);
+    g_free(store_name);
+    return ret;
+}
+
+static QemuOptsList dedup_create_opts = {
+    .name = "dedup-create-opts",
+    .head = QTAILQ_HEAD_INITIALIZER(dedup_create_opts.head),
+    .desc = {
+        {
+            .name = BLOCK_OPT_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Virtual disk size"
+        },
+        {
+            .name = "store",
+            .type = QEMU_OPT_STRING,
+            .help = "File name of the chunk store, which is created if it "
+                    "does not exist"
+        },
+        {
+            .name = BLOCK_OPT_CLUSTER_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Chunk size of a new store (default 64k)"
+        },
+        { /* end of list */ }
+    }
+};
+
+static const char *const dedup_strong_runtime_opts[] = {
+    "store",
+
+    NULL
+};
+
+static BlockDriver bdrv_dedup = {
+    .format_name                = "dedup",
+    .instance_size              = sizeof(BDRVDedupState),
+
+    .bdrv_probe                 = dedup_probe,
+    .bdrv_open                  = dedup_open,
+    .bdrv_close                 = dedup_close,
+    .bdrv_child_perm            = dedup_child_perm,
+    .bdrv_refresh_limits        = dedup_refresh_limits,
+    .bdrv_co_create             = dedup_co_create,
+    .bdrv_co_create_opts        = dedup_co_create_opts,
+
+    .bdrv_getlength             = dedup_getlength,
+    .bdrv_get_info              = dedup_get_info,
+
+    .bdrv_co_preadv_part        = dedup_co_preadv_part,
+    .bdrv_co_pwritev_part       = dedup_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes      = dedup_co_pwrite_zeroes,
+    .bdrv_co_pdiscard           = dedup_co_pdiscard,
+    .bdrv_co_block_status       = dedup_co_block_status,
+
+    .is_format                  = true,
+    .create_opts                = &dedup_create_opts,
+    .strong_runtime_opts        = dedup_strong_runtime_opts,
+};
+
+static void bdrv_dedup_init(void)
+{
+    bdrv_register(&bdrv_dedup);
+}
+
+block_init(bdrv_dedup_init);
@@ -0,0 +1,647 @@
+/*
+ * Sharing QEMU block devices via vhost-user protocol
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * Based on the vhost-user-blk sample application in
+ * contrib/vhost-user-blk and on hw/block/virtio-blk.c.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/host-utils.h"
+#include "qemu/iov.h"
+#include "qemu/queue.h"
+#include "qapi/error.h"
+#include "block/block.h"
+#include "sysemu/block-backend.h"
+#include "sysemu/iothread.h"
+#include "io/channel-socket.h"
+#include "io/net-listener.h"
+#include "standard-headers/linux/virtio_blk.h"
+#include "contrib/libvhost-user/libvhost-user.h"
+#include "vhost-user-blk-server.h"
+
+enum {
+    VHOST_USER_BLK_MAX_QUEUES = 64,
+    /* The vhost-user-blk master uses 128 entry virtqueues by default */
+    VHOST_USER_BLK_SEG_MAX = 128 - 2,
+    VHOST_USER_BLK_MAX_DISCARD_SECTORS = 32768,
+    VHOST_USER_BLK_MAX_WRITE_ZEROES_SECTORS = 32768,
+};
+
+struct virtio_blk_inhdr {
+    unsigned char status;
+};
+
+typedef struct VuBlkExport VuBlkExport;
+
+/* A file descriptor libvhost-user asked us to watch */
+typedef struct VuBlkWatch {
+    VuBlkExport *exp;
+    int fd;
+    vu_watch_cb cb;
+    void *cb_data;
+    QTAILQ_ENTRY(VuBlkWatch) next;
+} VuBlkWatch;
+
+struct VuBlkExport {
+    VuDev vu_dev;
+    char *name;
+    BlockBackend *blk;
+    AioContext *ctx;
+    QIONetListener *listener;
+    bool writable;
+    uint16_t num_queues;
+    uint32_t blk_size;
+
+    /* The connected vhost-user master, NULL if there is none */
+    QIOChannelSocket *sioc;
+    /* Number of requests whose coroutine has not completed yet */
+    unsigned int in_flight;
+    /* Tear down the connection once in_flight drops to zero */
+    bool disconnecting;
+    QTAILQ_HEAD(, VuBlkWatch) watches;
+
+    QLIST_ENTRY(VuBlkExport) next;
+};
+
+typedef struct VuBlkReq {
+    /* Must be first, this is allocated by vu_queue_pop() */
+    VuVirtqElement elem;
+    VuBlkExport *exp;
+    VuVirtq *vq;
+} VuBlkReq;
+
+static QLIST_HEAD(, VuBlkExport) vu_blk_exports =
+    QLIST_HEAD_INITIALIZER(vu_blk_exports);
+
+static VuBlkExport *vu_blk_export_find(const char *name)
+{
+    VuBlkExport *exp;
+
+    QLIST_FOREACH(exp, &vu_blk_exports, next) {
+        if (strcmp(name, exp->name) == 0) {
+            return exp;
+        }
+    }
+
+    return NULL;
+}
+
+static void vu_blk_disconnect_finish(VuBlkExport *exp)
+{
+    assert(QTAILQ_EMPTY(&exp->watches));
+
+    /* The socket is owned by exp->sioc, do not let libvhost-user close it */
+    exp->vu_dev.sock = -1;
+    vu_deinit(&exp->vu_dev);
+
+    object_unref(OBJECT(exp->sioc));
+    exp->sioc = NULL;
+    exp->disconnecting = false;
+}
+
+/*
+ * Stop processing the socket and the virtqueues.  Guest memory stays mapped
+ * until the last in-flight request has completed.
+ */
+static void vu_blk_disconnect(VuBlkExport *exp)
+{
+    VuBlkWatch *watch, *next;
+
+    if (!exp->sioc || exp->disconnecting) {
+        return;
+    }
+    exp->disconnecting = true;
+
+    aio_set_fd_handler(exp->ctx, exp->sioc->fd, false,
+                       NULL, NULL, NULL, NULL);
+    QTAILQ_FOREACH_SAFE(watch, &exp->watches, next, next) {
+        aio_set_fd_handler(exp->ctx, watch->fd, true, NULL, NULL, NULL, NULL);
+        QTAILQ_REMOVE(&exp->watches, watch, next);
+        g_free(watch);
+    }
+
+    if (exp->in_flight == 0) {
+        vu_blk_disconnect_finish(exp);
+    }
+}
+
+static void vu_blk_disconnect_bh(void *opaque)
+{
+    VuBlkExport *exp = opaque;
+
+    aio_context_acquire(exp->ctx);
+    vu_blk_disconnect(exp);
+    aio_context_release(exp->ctx);
+}
+
+static void vu_blk_panic(VuDev *vu_dev, const char *buf)
+{
+    VuBlkExport *exp = container_of(vu_dev, VuBlkExport, vu_dev);
+
+    error_report("vhost-user-blk export '%s': %s", exp->name, buf);
+
+    /* We may be deep inside libvhost-user, disconnect once it has returned */
+    aio_bh_schedule_oneshot(exp->ctx, vu_blk_disconnect_bh, exp);
+}
+
+static bool vu_blk_range_ok(VuBlkExport *exp, int64_t offset, uint64_t bytes)
+{
+    int64_t len;
+
+    if ((offset | bytes) & (exp->blk_size - 1)) {
+        return false;
+    }
+
+    len = blk_getlength(exp->blk);
+    return len >= 0 && offset <= len && bytes <= len - offset;
+}
+
+static int coroutine_fn vu_blk_co_discard_write_zeroes(VuBlkExport *exp,
+                                                       struct iovec *iov,
+                                                       unsigned int iov_cnt,
+                                                       uint32_t type)
+{
+    struct virtio_blk_discard_write_zeroes desc;
+    bool is_write_zeroes = type == VIRTIO_BLK_T_WRITE_ZEROES;
+    uint32_t max_sectors;
+    uint32_t num_sectors;
+    uint32_t flags;
+    int64_t offset;
+    int ret;
+
+    /* We only advertise a single segment per request */
+    if (iov_to_buf(iov, iov_cnt, 0, &desc, sizeof(desc)) != sizeof(desc)) {
+        return VIRTIO_BLK_S_IOERR;
+    }
+
+    offset = le64_to_cpu(desc.sector) << BDRV_SECTOR_BITS;
+    num_sectors = le32_to_cpu(desc.num_sectors);
+    flags = le32_to_cpu(desc.flags);
+    max_sectors = is_write_zeroes ? VHOST_USER_BLK_MAX_WRITE_ZEROES_SECTORS :
+                                    VHOST_USER_BLK_MAX_DISCARD_SECTORS;
+
+    if (flags & ~(is_write_zeroes ? VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP : 0)) {
+        return VIRTIO_BLK_S_UNSUPP;
+    }
+
+    if (!exp->writable || num_sectors > max_sectors ||
+        !vu_blk_range_ok(exp, offset,
+                         (uint64_t)num_sectors << BDRV_SECTOR_BITS)) {
+        return VIRTIO_BLK_S_IOERR;
+    }
+
+    if (is_write_zeroes) {
+        BdrvRequestFlags req_flags = 0;
+
+        if (flags & VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP) {
+            req_flags |= BDRV_REQ_MAY_UNMAP;
+        }
+        ret = blk_co_pwrite_zeroes(exp->blk, offset,
+                                   num_sectors << BDRV_SECTOR_BITS,
+                                   req_flags);
+    } else {
+        ret = blk_co_pdiscard(exp->blk, offset,
+                              num_sectors << BDRV_SECTOR_BITS);
+    }
+
+    return ret < 0 ? VIRTIO_BLK_S_IOERR : VIRTIO_BLK_S_OK;
+}
+
+static void coroutine_fn vu_blk_co_process_req(void *opaque)
+{
+    VuBlkReq *req = opaque;
+    VuBlkExport *exp = req->exp;
+    VuVirtqElement *elem = &req->elem;
+    struct iovec *in_iov = elem->in_sg;
+    struct iovec *out_iov = elem->out_sg;
+    unsigned int in_num = elem->in_num;
+    unsigned int out_num = elem->out_num;
+    struct virtio_blk_outhdr out;
+    uint8_t *status;
+    size_t in_len = 0;
+    uint32_t type;
+
+    if (out_num < 1 || in_num < 1) {
+        error_report("vhost-user-blk request missing headers");
+        goto drop;
+    }
+
+    if (iov_to_buf(out_iov, out_num, 0, &out, sizeof(out)) != sizeof(out)) {
+        error_report("vhost-user-blk request outhdr too short");
+        goto drop;
+    }
+    iov_discard_front(&out_iov, &out_num, sizeof(out));
+
+    if (in_iov[in_num - 1].iov_len < sizeof(struct virtio_blk_inhdr)) {
+        error_report("vhost-user-blk request inhdr too short");
+        goto drop;
+    }
+    status = in_iov[in_num - 1].iov_base + in_iov[in_num - 1].iov_len -
+             sizeof(struct virtio_blk_inhdr);
+    iov_discard_back(in_iov, &in_num, sizeof(struct virtio_blk_inhdr));
+
+    type = le32_to_cpu(out.type);
+    switch (type & ~VIRTIO_BLK_T_BARRIER) {
+    case VIRTIO_BLK_T_IN:
+    case VIRTIO_BLK_T_OUT: {
+        bool is_write = type & VIRTIO_BLK_T_OUT;
+        int64_t offset = le64_to_cpu(out.sector) << BDRV_SECTOR_BITS;
+        QEMUIOVector qiov;
+        int ret;
+
+        /* The iovecs point straight into the mapped guest memory */
+        if (is_write) {
+            qemu_iovec_init_external(&qiov, out_iov, out_num);
+        } else {
+            qemu_iovec_init_external(&qiov, in_iov, in_num);
+        }
+
+        if ((is_write && !exp->writable) ||
+            !vu_blk_range_ok(exp, offset, qiov.size)) {
+            *status = VIRTIO_BLK_S_IOERR;
+            break;
+        }
+
+        if (is_write) {
+            ret = blk_co_pwritev(exp->blk, offset, qiov.size, &qiov, 0);
+        } else {
+            ret = blk_co_preadv(exp->blk, offset, qiov.size, &qiov, 0);
+            in_len = qiov.size;
+        }
+        *status = ret < 0 ? VIRTIO_BLK_S_IOERR : VIRTIO_BLK_S_OK;
+        break;
+    }
+    case VIRTIO_BLK_T_FLUSH:
+        *status = blk_co_flush(exp->blk) < 0 ? VIRTIO_BLK_S_IOERR :
+                                               VIRTIO_BLK_S_OK;
+        break;
+    case VIRTIO_BLK_T_GET_ID: {
+        char serial[VIRTIO_BLK_ID_BYTES] = "";
+
+        strncpy(serial, exp->name, sizeof(serial));
+        in_len = iov_from_buf(in_iov, in_num, 0, serial,
+                              MIN(iov_size(in_iov, in_num), sizeof(serial)));
+        *status = VIRTIO_BLK_S_OK;
+        break;
+    }
+    case VIRTIO_BLK_T_DISCARD:
+    case VIRTIO_BLK_T_WRITE_ZEROES:
+        *status = vu_blk_co_discard_write_zeroes(exp, out_iov, out_num, type);
+        break;
+    default:
+        *status = VIRTIO_BLK_S_UNSUPP;
+        break;
+    }
+
+    in_len += sizeof(struct virtio_blk_inhdr);
+
+drop:
+    /*
+     * With VIRTIO_RING_F_EVENT_IDX negotiated libvhost-user only signals
+     * the call eventfd when the guest asked for it.
+     */
+    vu_queue_push(&exp->vu_dev, req->vq, elem, in_len);
+    vu_queue_notify(&exp->vu_dev, req->vq);
+    free(req);
+
+    assert(exp->in_flight > 0);
+    if (--exp->in_flight == 0 && exp->disconnecting) {
+        vu_blk_disconnect_finish(exp);
+    }
+}
+
+static void vu_blk_process_vq(VuDev *vu_dev, int idx)
+{
+    VuBlkExport *exp = container_of(vu_dev, VuBlkExport, vu_dev);
+    VuVirtq *vq = vu_get_queue(vu_dev, idx);
+    VuBlkReq *req;
+
+    while (!exp->disconnecting &&
+           (req = vu_queue_pop(vu_dev, vq, sizeof(VuBlkReq)))) {
+        Coroutine *co;
+
+        req->exp = exp;
+        req->vq = vq;
+        exp->in_flight++;
+
+        co = qemu_coroutine_create(vu_blk_co_process_req, req);
+        qemu_coroutine_enter(co);
+    }
+}
+
+static void vu_blk_queue_set_started(VuDev *vu_dev, int idx, bool started)
+{
+    VuVirtq *vq = vu_get_queue(vu_dev, idx);
+
+    vu_set_queue_handler(vu_dev, vq, started ? vu_blk_process_vq : NULL);
+}
+
+static uint64_t vu_blk_get_features(VuDev *vu_dev)
+{
+    VuBlkExport *exp = container_of(vu_dev, VuBlkExport, vu_dev);
+    uint64_t features;
+
+    features = 1ull << VIRTIO_BLK_F_SEG_MAX |
+               1ull << VIRTIO_BLK_F_TOPOLOGY |
+               1ull << VIRTIO_BLK_F_BLK_SIZE |
+               1ull << VIRTIO_BLK_F_FLUSH |
+               1ull << VIRTIO_BLK_F_DISCARD |
+               1ull << VIRTIO_BLK_F_WRITE_ZEROES |
+               1ull << VIRTIO_BLK_F_CONFIG_WCE |
+               1ull << VIRTIO_BLK_F_MQ |
+               1ull << VIRTIO_F_VERSION_1 |
+               1ull << VIRTIO_RING_F_INDIRECT_DESC |
+               1ull << VIRTIO_RING_F_EVENT_IDX |
+               1ull << VHOST_USER_F_PROTOCOL_FEATURES;
+
+    if (!exp->writable) {
+        features |= 1ull << VIRTIO_BLK_F_RO;
+    }
+
+    return features;
+}
+
+static uint64_t vu_blk_get_protocol_features(VuDev *vu_dev)
+{
+    return 1ull << VHOST_USER_PROTOCOL_F_CONFIG;
+}
+
+static int vu_blk_get_config(VuDev *vu_dev, uint8_t *config, uint32_t len)
+{
+    VuBlkExport *exp = container_of(vu_dev, VuBlkExport, vu_dev);
+    struct virtio_blk_config blkcfg;
+    uint32_t blk_sectors = exp->blk_size >> BDRV_SECTOR_BITS;
+    int64_t capacity = blk_getlength(exp->blk);
+
+    if (len > sizeof(blkcfg) || capacity < 0) {
+        return -1;
+    }
+
+    memset(&blkcfg, 0, sizeof(blkcfg));
+    blkcfg.capacity = cpu_to_le64(capacity >> BDRV_SECTOR_BITS);
+    blkcfg.seg_max = cpu_to_le32(VHOST_USER_BLK_SEG_MAX);
+    blkcfg.blk_size = cpu_to_le32(exp->blk_size);
+    blkcfg.min_io_size = cpu_to_le16(1);
+    blkcfg.opt_io_size = cpu_to_le32(1);
+    blkcfg.wce = blk_enable_write_cache(exp->blk);
+    blkcfg.num_queues = cpu_to_le16(exp->num_queues);
+    blkcfg.max_discard_sectors =
+        cpu_to_le32(VHOST_USER_BLK_MAX_DISCARD_SECTORS);
+    blkcfg.max_discard_seg = cpu_to_le32(1);
+    blkcfg.discard_sector_alignment = cpu_to_le32(blk_sectors);
+    blkcfg.max_write_zeroes_sectors =
+        cpu_to_le32(VHOST_USER_BLK_MAX_WRITE_ZEROES_SECTORS);
+    blkcfg.max_write_zeroes_seg = cpu_to_le32(1);
+    blkcfg.write_zeroes_may_unmap = 1;
+
+    memcpy(config, &blkcfg, len);
+    return 0;
+}
+
+static int vu_blk_set_config(VuDev *vu_dev, const uint8_t *data,
+                             uint32_t offset, uint32_t size, uint32_t flags)
+{
+    VuBlkExport *exp = container_of(vu_dev, VuBlkExport, vu_dev);
+
+    /* Only the write cache enable bit is guest writable */
+    if (offset != offsetof(struct virtio_blk_config, wce) || size != 1 ||
+        data[0] > 1) {
+        return -EINVAL;
+    }
+
+    blk_set_enable_write_cache(exp->blk, data[0] == 1);
+    return 0;
+}
+
+static const VuDevIface vu_blk_iface = {
+    .get_features = vu_blk_get_features,
+    .get_protocol_features = vu_blk_get_protocol_features,
+    .queue_set_started = vu_blk_queue_set_started,
+    .get_config = vu_blk_get_config,
+    .set_config = vu_blk_set_config,
+};
+
+static void vu_blk_watch_read(void *opaque)
+{
+    VuBlkWatch *watch = opaque;
+    VuBlkExport *exp = watch->exp;
+
+    /* The callback may remove the watch, so do not touch it afterwards */
+    aio_context_acquire(exp->ctx);
+    watch->cb(&exp->vu_dev, VU_WATCH_IN, watch->cb_data);
+    aio_context_release(exp->ctx);
+}
+
+static VuBlkWatch *vu_blk_find_watch(VuBlkExport *exp, int fd)
+{
+    VuBlkWatch *watch;
+
+    QTAILQ_FOREACH(watch, &exp->watches, next) {
+        if (watch->fd == fd) {
+            return watch;
+        }
+    }
+
+    return NULL;
+}
+
+static void vu_blk_set_watch(VuDev *vu_dev, int fd, int condition,
+                             vu_watch_cb cb, void *data)
+{
+    VuBlkExport *exp = container_of(vu_dev, VuBlkExport, vu_dev);
+    VuBlkWatch *watch;
+
+    /* libvhost-user only watches kick and slave fds for reading */
+    assert(condition == VU_WATCH_IN);
+
+    watch = vu_blk_find_watch(exp, fd);
+    if (!watch) {
+        watch = g_new0(VuBlkWatch, 1);
+        watch->exp = exp;
+        watch->fd = fd;
+        QTAILQ_INSERT_TAIL(&exp->watches, watch, next);
+    }
+    watch->cb = cb;
+    watch->cb_data = data;
+
+    aio_set_fd_handler(exp->ctx, fd, true, vu_blk_watch_read, NULL, NULL,
+                       watch);
+}
+
+static void vu_blk_remove_watch(VuDev *vu_dev, int fd)
+{
+    VuBlkExport *exp = container_of(vu_dev, VuBlkExport, vu_dev);
+    VuBlkWatch *watch = vu_blk_find_watch(exp, fd);
+
+    if (!watch) {
+        return;
+    }
+
+    aio_set_fd_handler(exp->ctx, fd, true, NULL, NULL, NULL, NULL);
+    QTAILQ_REMOVE(&exp->watches, watch, next);
+    g_free(watch);
+}
+
+static void vu_blk_sock_read(void *opaque)
+{
+    VuBlkExport *exp = opaque;
+
+    aio_context_acquire(exp->ctx);
+    if (!vu_dispatch(&exp->vu_dev)) {
+        vu_blk_disconnect(exp);
+    }
+    aio_context_release(exp->ctx);
+}
+
+static void vu_blk_accept(QIONetListener *listener, QIOChannelSocket *sioc,
+                          gpointer opaque)
+{
+    VuBlkExport *exp = opaque;
+
+    aio_context_acquire(exp->ctx);
+
+    if (exp->sioc) {
+        error_report("vhost-user-blk export '%s' is already connected, "
+                     "rejecting new client", exp->name);
+        goto out;
+    }
+
+    /* vu_dispatch() expects to read a whole message at a time */
+    qio_channel_set_blocking(QIO_CHANNEL(sioc), true, NULL);
+
+    if (!vu_init(&exp->vu_dev, exp->num_queues, sioc->fd, vu_blk_panic,
+                 vu_blk_set_watch, vu_blk_remove_watch, &vu_blk_iface)) {
+        error_report("vhost-user-blk export '%s': failed to initialize "
+                     "the vhost-user device", exp->name);
+        goto out;
+    }
+
+    object_ref(OBJECT(sioc));
+    exp->sioc = sioc;
+    aio_set_fd_handler(exp->ctx, sioc->fd, false, vu_blk_sock_read, NULL,
+                       NULL, exp);
+
+out:
+    aio_context_release(exp->ctx);
+}
+
+void vhost_user_blk_server_add(BlockExportVhostUserBlk *arg, Error **errp)
+{
+    BlockDriverState *bs;
+    BlockBackend *blk;
+    AioContext *aio_context;
+    QIONetListener *listener;
+    VuBlkExport *exp;
+    uint64_t blk_size = 512;
+    uint16_t num_queues = 1;
+    uint64_t perm;
+    bool writable;
+    int ret;
+
+    if (vu_blk_export_find(arg->device)) {
+        error_setg(errp, "vhost-user-blk export for '%s' already exists",
+                   arg->device);
+        return;
+    }
+
+    if (arg->addr->type != SOCKET_ADDRESS_TYPE_UNIX &&
+        arg->addr->type != SOCKET_ADDRESS_TYPE_FD) {
+        error_setg(errp, "vhost-user-blk export requires a unix or fd "
+                   "socket address");
+        return;
+    }
+
+    if (arg->has_logical_block_size) {
+        blk_size = arg->logical_block_size;
+    }
+    if (blk_size < BDRV_SECTOR_SIZE || blk_size > 32768 ||
+        !is_power_of_2(blk_size)) {
+        error_setg(errp, "logical-block-size must be a power of two between "
+                   "512 and 32768");
+        return;
+    }
+
+    if (arg->has_num_queues) {
+        num_queues = arg->num_queues;
+    }
+    if (num_queues == 0 || num_queues > VHOST_USER_BLK_MAX_QUEUES) {
+        error_setg(errp, "num-queues must be between 1 and %d",
+                   VHOST_USER_BLK_MAX_QUEUES);
+        return;
+    }
+
+    bs = bdrv_lookup_bs(arg->device, arg->device, errp);
+    if (!bs) {
+        return;
+    }
+
+    aio_context = bdrv_get_aio_context(bs);
+    aio_context_acquire(aio_context);
+
+    if (arg->has_iothread) {
+        IOThread *iothread = iothread_by_id(arg->iothread);
+        AioContext *new_context;
+
+        if (!iothread) {
+            error_setg(errp, "Cannot find iothread %s", arg->iothread);
+            goto out;
+        }
+
+        new_context = iothread_get_aio_context(iothread);
+        ret = bdrv_try_set_aio_context(bs, new_context, errp);
+        if (ret < 0) {
+            goto out;
+        }
+        aio_context_release(aio_context);
+        aio_context = new_context;
+        aio_context_acquire(aio_context);
+    }
+
+    writable = arg->has_writable && arg->writable && !bdrv_is_read_only(bs);
+
+    /* The guest sees a fixed capacity, so do not allow resizing the node */
+    perm = BLK_PERM_CONSISTENT_READ;
+    if (writable) {
+        perm |= BLK_PERM_WRITE;
+    }
+    blk = blk_new(aio_context, perm,
+                  BLK_PERM_CONSISTENT_READ | BLK_PERM_WRITE_UNCHANGED |
+                  BLK_PERM_WRITE | BLK_PERM_GRAPH_MOD);
+    ret = blk_insert_bs(blk, bs, errp);
+    if (ret < 0) {
+        blk_unref(blk);
+        goto out;
+    }
+    blk_set_enable_write_cache(blk, true);
+
+    listener = qio_net_listener_new();
+    qio_net_listener_set_name(listener, "vhost-user-blk-listener");
+    ret = qio_net_listener_open_sync(listener, arg->addr, 1, errp);
+    if (ret < 0) {
+        object_unref(OBJECT(listener));
+        blk_unref(blk);
+        goto out;
+    }
+
+    exp = g_new0(VuBlkExport, 1);
+    exp->name = g_strdup(arg->device);
+    exp->blk = blk;
+    exp->ctx = aio_context;
+    exp->listener = listener;
+    exp->writable = writable;
+    exp->num_queues = num_queues;
+    exp->blk_size = blk_size;
+    QTAILQ_INIT(&exp->watches);
+    QLIST_INSERT_HEAD(&vu_blk_exports, exp, next);
+
+    qio_net_listener_set_client_func(listener, vu_blk_accept, exp, NULL);
+
+out:
+    aio_context_release(aio_context);
+}
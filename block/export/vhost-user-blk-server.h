@@ -0,0 +1,17 @@
+/*
+ * Sharing QEMU block devices via vhost-user protocol
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#ifndef VHOST_USER_BLK_SERVER_H
+#define VHOST_USER_BLK_SERVER_H
+
+#include "qapi/qapi-types-block-core.h"
+
+void vhost_user_blk_server_add(BlockExportVhostUserBlk *arg, Error **errp);
+
+#endif /* VHOST_USER_BLK_SERVER_H */
@@ -17,11 +17,15 @@
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
 #include "qapi/error.h"
+#include "qemu/error-report.h"
 #include "trace.h"
 
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Size of the registered file table, see luring_fixed_file().  */
+#define MAX_FIXED_FILES 64
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -56,6 +60,13 @@ typedef struct LuringState {
 
     /* I/O completion processing.  Only runs in I/O thread.  */
     QEMUBH *completion_bh;
+
+    /*
+     * Registered files, -1 for a free slot.  Requests on a registered
+     * file skip the fd lookup and reference counting in the kernel.
+     */
+    bool fixed_files;
+    int fixed_fds[MAX_FIXED_FILES];
 } LuringState;
 
 /**
@@ -312,6 +323,59 @@ void luring_io_unplug(BlockDriverState *bs, LuringState *s)
     }
 }
 
+/**
+ * luring_fixed_file:
+ * @s: AIO state
+ * @fd: file descriptor for I/O
+ *
+ * Returns the index of @fd in the registered file table, registering it
+ * if there is room, or -1 if @fd has to be used as a plain fd.
+ */
+static int luring_fixed_file(LuringState *s, int fd)
+{
+    int i, free = -1;
+
+    if (!s->fixed_files) {
+        return -1;
+    }
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (s->fixed_fds[i] == fd) {
+            return i;
+        }
+        if (free < 0 && s->fixed_fds[i] == -1) {
+            free = i;
+        }
+    }
+
+    if (free < 0 ||
+        io_uring_register_files_update(&s->ring, free, &fd, 1) != 1) {
+        return -1;
+    }
+    s->fixed_fds[free] = fd;
+    trace_luring_register_file(s, fd, free);
+    return free;
+}
+
+void luring_unregister_fd(LuringState *s, int fd)
+{
+    int unused = -1;
+    int i;
+
+    if (!s->fixed_files || fd < 0) {
+        return;
+    }
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (s->fixed_fds[i] == fd) {
+            /* Requests in flight hold their own reference to the file.  */
+            io_uring_register_files_update(&s->ring, i, &unused, 1);
+            s->fixed_fds[i] = -1;
+            trace_luring_unregister_file(s, fd, i);
+        }
+    }
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
@@ -328,6 +392,7 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    int fixed = luring_fixed_file(s, fd);
 
     switch (type) {
     case QEMU_AIO_WRITE:
@@ -346,6 +411,10 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (fixed >= 0) {
+        sqes->fd = fixed;
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -402,21 +471,43 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
                        qemu_luring_completion_cb, NULL, qemu_luring_poll_cb, s);
 }
 
-LuringState *luring_init(Error **errp)
+LuringState *luring_init(bool sqpoll, Error **errp)
 {
-    int rc;
+    int rc = -1;
+    int i;
     LuringState *s = g_new0(LuringState, 1);
     struct io_uring *ring = &s->ring;
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    /*
+     * With SQPOLL a kernel thread picks up submissions, so submitting
+     * usually needs no system call at all.  It needs privileges on older
+     * kernels, fall back to a normal ring if we can't have one.
+     */
+    if (sqpoll) {
+        rc = io_uring_queue_init(MAX_ENTRIES, ring, IORING_SETUP_SQPOLL);
+        if (rc < 0) {
+            warn_report("failed to init linux io_uring ring with SQPOLL: %s",
+                        strerror(-rc));
+        }
+    }
+    if (rc < 0) {
+        rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    }
     if (rc < 0) {
         error_setg_errno(errp, errno, "failed to init linux io_uring ring");
         g_free(s);
         return NULL;
     }
 
+    /* A sparse table, files get added on first use.  */
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        s->fixed_fds[i] = -1;
+    }
+    s->fixed_files = io_uring_register_files(ring, s->fixed_fds,
+                                             MAX_FIXED_FILES) == 0;
+
     ioq_init(&s->io_q);
     return s;
 
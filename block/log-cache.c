@@ -0,0 +1,990 @@
+/*
+ * Persistent write-back cache filter block driver
+ *
+ * Copyright (c) 2020 Xilinx Inc
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * Guest writes are appended to a log on the cache child, usually a fast
+ * local disk, and complete as soon as they are there.  A background
+ * coroutine destages them to the file child in batches: the data that
+ * later writes have overwritten is skipped, and the rest is written back
+ * sorted by offset, with adjacent pieces merged into one request.
+ *
+ * The log is a ring that follows a superblock.  Every entry starts with a
+ * dm-log-writes entry header, extended with a sequence number and
+ * checksums so that stale and torn entries can be told apart from valid
+ * ones.  An entry never wraps around the end of the ring; if it does not
+ * fit, it is written at the start instead.  The superblock records the
+ * oldest entry that has not been destaged yet, and it is only moved on
+ * after the destaged data has been flushed to the file child.  On open,
+ * the entries from there on are indexed again and destaged like new ones.
+ *
+ * A guest flush waits for all earlier log writes and then flushes the
+ * cache child, which is enough to make them persistent.  The file child
+ * is only flushed by the destaging.
+ *
+ * The image is only consistent together with the cache, so the filter
+ * takes write permissions on both children and shares them with nobody.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "block/block_int.h"
+#include "qemu/bswap.h"
+#include "qemu/coroutine.h"
+#include "qemu/crc32c.h"
+#include "qemu/error-report.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "blklogwrites.h"
+#include "trace.h"
+
+#define LOG_CACHE_MAGIC     0x514c4f4743414348ULL /* "QLOGCACH" */
+#define LOG_CACHE_VERSION   1
+
+/* Granularity of the cache index, and the request alignment of the node */
+#define LOG_CACHE_BLOCK_BITS    12
+#define LOG_CACHE_BLOCK_SIZE    (1 << LOG_CACHE_BLOCK_BITS)
+
+/* The superblock has the first block to itself, the ring follows */
+#define LOG_CACHE_LOG_OFFSET    LOG_CACHE_BLOCK_SIZE
+
+/* Larger writes are split into several entries */
+#define LOG_CACHE_MAX_ENTRY     (1 * MiB)
+#define LOG_CACHE_MIN_LOG_SIZE  (4 * (LOG_CACHE_MAX_ENTRY + LOG_CACHE_BLOCK_SIZE))
+
+/* How much logged data one destaging round looks at */
+#define LOG_CACHE_MAX_BATCH     (16 * MiB)
+/* Largest request that adjacent destaged pieces are merged into */
+#define LOG_CACHE_MAX_DESTAGE   (4 * MiB)
+
+/* All fields are little-endian, like in dm-log-writes.  */
+typedef struct LogCacheSuper {
+    uint64_t magic;
+    uint64_t version;
+    uint32_t sectorsize;
+    uint32_t reserved;
+    uint64_t log_size;
+    uint64_t tail;
+    uint64_t tail_seq;
+} QEMU_PACKED LogCacheSuper;
+
+typedef struct LogCacheEntryHeader {
+    struct log_write_entry entry;
+    uint64_t seq;
+    uint32_t data_crc;
+    /* Covers all of the fields above */
+    uint32_t hdr_crc;
+} QEMU_PACKED LogCacheEntryHeader;
+
+typedef struct LogCacheEntry {
+    /* Position of the header in the log, counting every lap */
+    uint64_t pos;
+    uint64_t seq;
+    uint64_t offset;
+    uint64_t bytes;
+    /* Set once the log write has completed */
+    bool done;
+    bool failed;
+    QSIMPLEQ_ENTRY(LogCacheEntry) next;
+    QLIST_ENTRY(LogCacheEntry) in_flight_next;
+} LogCacheEntry;
+
+/* The newest logged data for a block of the image */
+typedef struct LogCacheBlock {
+    uint64_t block;
+    LogCacheEntry *entry;
+} LogCacheBlock;
+
+typedef struct LogCacheDestage {
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t log_offset;
+} LogCacheDestage;
+
+typedef struct BDRVLogCacheState {
+    BdrvChild *cache;
+
+    uint32_t hdr_size;
+    uint64_t log_size;
+    uint64_t image_size;
+
+    /* Live part of the log, [tail, head) */
+    uint64_t tail;
+    uint64_t head;
+    uint64_t next_seq;
+
+    /* All entries that have not been destaged, oldest first */
+    QSIMPLEQ_HEAD(, LogCacheEntry) entries;
+    /* Entries whose log write is still running */
+    QLIST_HEAD(, LogCacheEntry) in_flight;
+    /* Maps block numbers to LogCacheBlock */
+    GHashTable *map;
+
+    /*
+     * Readers of logged data hold this for reading, so that destaging can't
+     * free and reuse log space under them.
+     */
+    CoRwlock lock;
+    /* Writers waiting for log space */
+    CoQueue space_queue;
+    /* Flushes waiting for log writes */
+    CoQueue flush_queue;
+
+    bool destaging;
+    int destage_ret;
+    /* Once a log write failed, the log can't be trusted past it anymore */
+    int log_ret;
+} BDRVLogCacheState;
+
+static uint64_t log_cache_log_offset(BDRVLogCacheState *s, uint64_t pos)
+{
+    return LOG_CACHE_LOG_OFFSET + pos % s->log_size;
+}
+
+static uint64_t log_cache_data_offset(BDRVLogCacheState *s, LogCacheEntry *e,
+                                      uint64_t block)
+{
+    return log_cache_log_offset(s, e->pos) + s->hdr_size +
+           ((block << LOG_CACHE_BLOCK_BITS) - e->offset);
+}
+
+static LogCacheBlock *log_cache_lookup(BDRVLogCacheState *s, uint64_t block)
+{
+    return g_hash_table_lookup(s->map, &block);
+}
+
+/* Make @e the source of the blocks it covers, unless newer data is logged */
+static void log_cache_index(BDRVLogCacheState *s, LogCacheEntry *e)
+{
+    uint64_t first = e->offset >> LOG_CACHE_BLOCK_BITS;
+    uint64_t end = (e->offset + e->bytes) >> LOG_CACHE_BLOCK_BITS;
+    uint64_t block;
+
+    for (block = first; block < end; block++) {
+        LogCacheBlock *b = log_cache_lookup(s, block);
+
+        if (!b) {
+            b = g_new(LogCacheBlock, 1);
+            b->block = block;
+            g_hash_table_insert(s->map, &b->block, b);
+        } else if (b->entry->seq > e->seq) {
+            continue;
+        }
+        b->entry = e;
+    }
+}
+
+static void log_cache_unindex(BDRVLogCacheState *s, LogCacheEntry *e)
+{
+    uint64_t first = e->offset >> LOG_CACHE_BLOCK_BITS;
+    uint64_t end = (e->offset + e->bytes) >> LOG_CACHE_BLOCK_BITS;
+    uint64_t block;
+
+    for (block = first; block < end; block++) {
+        LogCacheBlock *b = log_cache_lookup(s, block);
+
+        if (b && b->entry == e) {
+            g_hash_table_remove(s->map, &block);
+        }
+    }
+}
+
+static LogCacheEntry *log_cache_add_entry(BDRVLogCacheState *s, uint64_t pos,
+                                          uint64_t offset, uint64_t bytes)
+{
+    LogCacheEntry *e = g_new0(LogCacheEntry, 1);
+
+    e->pos = pos;
+    e->seq = s->next_seq++;
+    e->offset = offset;
+    e->bytes = bytes;
+    QSIMPLEQ_INSERT_TAIL(&s->entries, e, next);
+    return e;
+}
+
+static void log_cache_entry_header(BDRVLogCacheState *s, LogCacheEntry *e,
+                                   uint8_t *buf)
+{
+    LogCacheEntryHeader *h = (LogCacheEntryHeader *)buf;
+
+    memset(buf, 0, s->hdr_size);
+    h->entry.sector = cpu_to_le64(e->offset >> BDRV_SECTOR_BITS);
+    h->entry.nr_sectors = cpu_to_le64(e->bytes >> BDRV_SECTOR_BITS);
+    h->entry.data_len = cpu_to_le64(e->bytes);
+    h->seq = cpu_to_le64(e->seq);
+    h->data_crc = cpu_to_le32(crc32c(0xffffffff, buf + s->hdr_size,
+                                     e->bytes));
+    h->hdr_crc = cpu_to_le32(crc32c(0xffffffff, buf,
+                                    offsetof(LogCacheEntryHeader, hdr_crc)));
+}
+
+static int log_cache_write_super(BDRVLogCacheState *s, uint64_t tail,
+                                 uint64_t tail_seq)
+{
+    LogCacheSuper sb = {
+        .magic      = cpu_to_le64(LOG_CACHE_MAGIC),
+        .version    = cpu_to_le64(LOG_CACHE_VERSION),
+        .sectorsize = cpu_to_le32(s->hdr_size),
+        .log_size   = cpu_to_le64(s->log_size),
+        .tail       = cpu_to_le64(tail),
+        .tail_seq   = cpu_to_le64(tail_seq),
+    };
+    int ret;
+
+    ret = bdrv_pwrite(s->cache, 0, &sb, sizeof(sb));
+    if (ret < 0) {
+        return ret;
+    }
+    return bdrv_flush(s->cache->bs);
+}
+
+/*
+ * Read the entry at @pos into @buf and check that it is the one with
+ * sequence number @seq.  Returns 1 if it is, 0 if not and a negative errno
+ * on I/O errors.
+ */
+static int log_cache_read_entry(BDRVLogCacheState *s, uint64_t pos,
+                                uint64_t seq, uint8_t *buf,
+                                uint64_t *offset, uint64_t *bytes)
+{
+    LogCacheEntryHeader *h = (LogCacheEntryHeader *)buf;
+    uint64_t len;
+    int ret;
+
+    ret = bdrv_pread(s->cache, log_cache_log_offset(s, pos), buf,
+                     s->hdr_size);
+    if (ret < 0) {
+        return ret;
+    }
+
+    len = le64_to_cpu(h->entry.data_len);
+    if (le32_to_cpu(h->hdr_crc) !=
+            crc32c(0xffffffff, buf, offsetof(LogCacheEntryHeader, hdr_crc)) ||
+        le64_to_cpu(h->seq) != seq ||
+        !len || len > LOG_CACHE_MAX_ENTRY ||
+        !QEMU_IS_ALIGNED(len, LOG_CACHE_BLOCK_SIZE) ||
+        le64_to_cpu(h->entry.nr_sectors) != len >> BDRV_SECTOR_BITS ||
+        le64_to_cpu(h->entry.sector) > s->image_size >> BDRV_SECTOR_BITS ||
+        (le64_to_cpu(h->entry.sector) << BDRV_SECTOR_BITS) + len >
+            s->image_size ||
+        pos % s->log_size + s->hdr_size + len > s->log_size)
+    {
+        return 0;
+    }
+
+    ret = bdrv_pread(s->cache, log_cache_log_offset(s, pos) + s->hdr_size,
+                     buf + s->hdr_size, len);
+    if (ret < 0) {
+        return ret;
+    }
+    if (le32_to_cpu(h->data_crc) != crc32c(0xffffffff, buf + s->hdr_size,
+                                           len)) {
+        return 0;
+    }
+
+    *offset = le64_to_cpu(h->entry.sector) << BDRV_SECTOR_BITS;
+    *bytes = len;
+    return 1;
+}
+
+/* Index the entries that were logged but not destaged before the last close */
+static int log_cache_recover(BlockDriverState *bs, Error **errp)
+{
+    BDRVLogCacheState *s = bs->opaque;
+    uint64_t pos = s->tail;
+    uint64_t offset, bytes;
+    uint64_t n = 0;
+    uint8_t *buf;
+    int ret;
+
+    buf = qemu_try_blockalign(s->cache->bs, s->hdr_size + LOG_CACHE_MAX_ENTRY);
+    if (!buf) {
+        error_setg(errp, "Could not allocate the recovery buffer");
+        return -ENOMEM;
+    }
+
+    for (;;) {
+        LogCacheEntry *e;
+
+        ret = log_cache_read_entry(s, pos, s->next_seq, buf, &offset, &bytes);
+        if (ret == 0 && pos % s->log_size) {
+            /* It may not have fit at the end of the ring */
+            uint64_t wrapped = ROUND_UP(pos, s->log_size);
+
+            ret = log_cache_read_entry(s, wrapped, s->next_seq, buf, &offset,
+                                       &bytes);
+            if (ret > 0) {
+                pos = wrapped;
+            }
+        }
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read the cache log");
+            goto out;
+        }
+        if (ret == 0 || pos + s->hdr_size + bytes - s->tail > s->log_size) {
+            break;
+        }
+
+        e = log_cache_add_entry(s, pos, offset, bytes);
+        e->done = true;
+        log_cache_index(s, e);
+        pos += s->hdr_size + bytes;
+        n++;
+    }
+
+    s->head = pos;
+    trace_log_cache_recover(bs, n, s->tail, s->head);
+    ret = 0;
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
+
+/* Read the superblock, or create one if the cache doesn't hold a log yet */
+static int log_cache_load(BlockDriverState *bs, Error **errp)
+{
+    BDRVLogCacheState *s = bs->opaque;
+    LogCacheSuper sb;
+    int64_t len;
+    int ret;
+
+    len = bdrv_getlength(s->cache->bs);
+    if (len < 0) {
+        error_setg_errno(errp, -len, "Could not get the cache length");
+        return len;
+    }
+
+    memset(&sb, 0, sizeof(sb));
+    if (len >= LOG_CACHE_LOG_OFFSET) {
+        ret = bdrv_pread(s->cache, 0, &sb, sizeof(sb));
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read the cache superblock");
+            return ret;
+        }
+    }
+
+    if (le64_to_cpu(sb.magic) == LOG_CACHE_MAGIC) {
+        if (le64_to_cpu(sb.version) != LOG_CACHE_VERSION) {
+            error_setg(errp, "Unsupported cache version %" PRIu64,
+                       le64_to_cpu(sb.version));
+            return -ENOTSUP;
+        }
+        s->hdr_size = le32_to_cpu(sb.sectorsize);
+        s->log_size = le64_to_cpu(sb.log_size);
+        s->tail = le64_to_cpu(sb.tail);
+        s->next_seq = le64_to_cpu(sb.tail_seq);
+        if (!is_power_of_2(s->hdr_size) || s->hdr_size < BDRV_SECTOR_SIZE ||
+            s->hdr_size > LOG_CACHE_BLOCK_SIZE ||
+            s->log_size < LOG_CACHE_MIN_LOG_SIZE ||
+            !QEMU_IS_ALIGNED(s->log_size, LOG_CACHE_BLOCK_SIZE) ||
+            LOG_CACHE_LOG_OFFSET + s->log_size > len ||
+            !QEMU_IS_ALIGNED(s->tail, s->hdr_size))
+        {
+            error_setg(errp, "Invalid cache superblock");
+            return -EINVAL;
+        }
+        return log_cache_recover(bs, errp);
+    }
+
+    if (bdrv_is_read_only(s->cache->bs)) {
+        error_setg(errp, "The cache does not contain a log and is read-only");
+        return -EINVAL;
+    }
+
+    s->hdr_size = MAX(BDRV_SECTOR_SIZE, s->cache->bs->bl.request_alignment);
+    if (s->hdr_size > LOG_CACHE_BLOCK_SIZE) {
+        error_setg(errp, "The cache needs an alignment of at most %d bytes",
+                   LOG_CACHE_BLOCK_SIZE);
+        return -EINVAL;
+    }
+    s->log_size = QEMU_ALIGN_DOWN(MAX(len - LOG_CACHE_LOG_OFFSET, 0),
+                                  LOG_CACHE_BLOCK_SIZE);
+    if (s->log_size < LOG_CACHE_MIN_LOG_SIZE) {
+        error_setg(errp, "The cache must be at least %d bytes large",
+                   LOG_CACHE_LOG_OFFSET + LOG_CACHE_MIN_LOG_SIZE);
+        return -EINVAL;
+    }
+
+    s->tail = s->head = 0;
+    s->next_seq = 1;
+    ret = log_cache_write_super(s, s->tail, s->next_seq);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not write the cache superblock");
+        return ret;
+    }
+    return 0;
+}
+
+static int log_cache_destage_cmp(const void *a, const void *b)
+{
+    const LogCacheDestage *da = a;
+    const LogCacheDestage *db = b;
+
+    return da->offset < db->offset ? -1 : da->offset > db->offset;
+}
+
+/* Queue the blocks for which @e still holds the newest data */
+static void log_cache_collect(BDRVLogCacheState *s, LogCacheEntry *e,
+                              GArray *jobs)
+{
+    uint64_t first = e->offset >> LOG_CACHE_BLOCK_BITS;
+    uint64_t end = (e->offset + e->bytes) >> LOG_CACHE_BLOCK_BITS;
+    LogCacheDestage *d = NULL;
+    uint64_t block;
+
+    for (block = first; block < end; block++) {
+        LogCacheBlock *b = log_cache_lookup(s, block);
+
+        if (!b || b->entry != e) {
+            d = NULL;
+            continue;
+        }
+        if (d) {
+            d->bytes += LOG_CACHE_BLOCK_SIZE;
+            continue;
+        }
+
+        g_array_set_size(jobs, jobs->len + 1);
+        d = &g_array_index(jobs, LogCacheDestage, jobs->len - 1);
+        d->offset = block << LOG_CACHE_BLOCK_BITS;
+        d->bytes = LOG_CACHE_BLOCK_SIZE;
+        d->log_offset = log_cache_data_offset(s, e, block);
+    }
+}
+
+/*
+ * Write the pieces of @jobs that start at index @i and are adjacent in the
+ * image with a single request.  Returns the index of the first piece that
+ * was not written, or a negative errno.
+ */
+static int coroutine_fn log_cache_destage_run(BlockDriverState *bs,
+                                              GArray *jobs, guint i)
+{
+    BDRVLogCacheState *s = bs->opaque;
+    LogCacheDestage *d = &g_array_index(jobs, LogCacheDestage, i);
+    uint64_t offset = d->offset;
+    uint64_t bytes = 0;
+    QEMUIOVector qiov;
+    int ret = 0;
+    int j;
+
+    qemu_iovec_init(&qiov, 8);
+    do {
+        void *buf;
+
+        d = &g_array_index(jobs, LogCacheDestage, i);
+        buf = qemu_try_blockalign(s->cache->bs, d->bytes);
+        if (!buf) {
+            ret = -ENOMEM;
+            break;
+        }
+        qemu_iovec_add(&qiov, buf, d->bytes);
+
+        ret = bdrv_co_pread(s->cache, d->log_offset, d->bytes, buf, 0);
+        bytes += d->bytes;
+        i++;
+    } while (ret >= 0 && i < jobs->len && bytes < LOG_CACHE_MAX_DESTAGE &&
+             g_array_index(jobs, LogCacheDestage, i).offset == offset + bytes);
+
+    if (ret >= 0) {
+        ret = bdrv_co_pwritev(bs->file, offset, bytes, &qiov, 0);
+    }
+
+    for (j = 0; j < qiov.niov; j++) {
+        qemu_vfree(qiov.iov[j].iov_base);
+    }
+    qemu_iovec_destroy(&qiov);
+
+    return ret < 0 ? ret : i;
+}
+
+/* Destage the oldest completed entries and free their log space */
+static int coroutine_fn log_cache_destage_batch(BlockDriverState *bs)
+{
+    BDRVLogCacheState *s = bs->opaque;
+    GArray *jobs = g_array_new(false, false, sizeof(LogCacheDestage));
+    LogCacheEntry *e, *next, *last = NULL;
+    uint64_t batch = 0, written = 0;
+    uint64_t tail, tail_seq;
+    guint i;
+    int ret = 0;
+
+    QSIMPLEQ_FOREACH(e, &s->entries, next) {
+        if (!e->done || (last && batch + e->bytes > LOG_CACHE_MAX_BATCH)) {
+            break;
+        }
+        last = e;
+        batch += e->bytes;
+        if (!e->failed) {
+            log_cache_collect(s, e, jobs);
+        }
+    }
+    assert(last);
+
+    g_array_sort(jobs, log_cache_destage_cmp);
+    for (i = 0; i < jobs->len; ) {
+        ret = log_cache_destage_run(bs, jobs, i);
+        if (ret < 0) {
+            goto out;
+        }
+        for (; i < ret; i++) {
+            written += g_array_index(jobs, LogCacheDestage, i).bytes;
+        }
+    }
+
+    ret = bdrv_co_flush(bs->file->bs);
+    if (ret < 0) {
+        goto out;
+    }
+
+    next = QSIMPLEQ_NEXT(last, next);
+    tail = next ? next->pos : s->head;
+    tail_seq = next ? next->seq : s->next_seq;
+    ret = log_cache_write_super(s, tail, tail_seq);
+    if (ret < 0) {
+        goto out;
+    }
+
+    qemu_co_rwlock_wrlock(&s->lock);
+    do {
+        e = QSIMPLEQ_FIRST(&s->entries);
+        QSIMPLEQ_REMOVE_HEAD(&s->entries, next);
+        log_cache_unindex(s, e);
+        g_free(e);
+    } while (e != last);
+    s->tail = tail;
+    qemu_co_rwlock_unlock(&s->lock);
+
+    trace_log_cache_destage(bs, batch, written, tail);
+    qemu_co_queue_restart_all(&s->space_queue);
+
+out:
+    g_array_free(jobs, true);
+    return ret < 0 ? ret : 0;
+}
+
+static void coroutine_fn log_cache_destage_entry(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVLogCacheState *s = bs->opaque;
+    LogCacheEntry *e;
+    int ret;
+
+    s->destage_ret = 0;
+    while ((e = QSIMPLEQ_FIRST(&s->entries)) && e->done) {
+        ret = log_cache_destage_batch(bs);
+        if (ret < 0) {
+            error_report_once("log-cache: destaging to '%s' failed: %s",
+                              bs->file->bs->filename, strerror(-ret));
+            s->destage_ret = ret;
+            break;
+        }
+    }
+
+    s->destaging = false;
+    qemu_co_queue_restart_all(&s->space_queue);
+    bdrv_dec_in_flight(bs);
+}
+
+static void log_cache_kick_destage(BlockDriverState *bs)
+{
+    BDRVLogCacheState *s = bs->opaque;
+    LogCacheEntry *e = QSIMPLEQ_FIRST(&s->entries);
+    Coroutine *co;
+
+    if (s->destaging || !e || !e->done || bdrv_is_read_only(bs)) {
+        return;
+    }
+
+    s->destaging = true;
+    bdrv_inc_in_flight(bs);
+    co = qemu_coroutine_create(log_cache_destage_entry, bs);
+    aio_co_enter(bdrv_get_aio_context(bs), co);
+}
+
+static QemuOptsList runtime_opts = {
+    .name = "log-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        { /* end of list */ }
+    },
+};
+
+static int log_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                          Error **errp)
+{
+    BDRVLogCacheState *s = bs->opaque;
+    QemuOpts *opts;
+    Error *local_err = NULL;
+    int64_t len;
+    int ret;
+
+    QSIMPLEQ_INIT(&s->entries);
+    QLIST_INIT(&s->in_flight);
+    qemu_co_rwlock_init(&s->lock);
+    qemu_co_queue_init(&s->space_queue);
+    qemu_co_queue_init(&s->flush_queue);
+    s->map = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+
+    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    qemu_opts_absorb_qdict(opts, options, &local_err);
+    if (local_err) {
+        ret = -EINVAL;
+        error_propagate(errp, local_err);
+        goto fail;
+    }
+
+    if (flags & BDRV_O_INACTIVE) {
+        ret = -ENOTSUP;
+        error_setg(errp, "log-cache does not support incoming migration");
+        goto fail;
+    }
+
+    /*
+     * Until its data has been destaged, the log is the only place that has
+     * it, so the image must not be written or resized by anyone else.
+     */
+    bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
+                               BDRV_CHILD_DATA | BDRV_CHILD_METADATA |
+                               BDRV_CHILD_PRIMARY, false, &local_err);
+    if (local_err) {
+        ret = -EINVAL;
+        error_propagate(errp, local_err);
+        goto fail;
+    }
+
+    s->cache = bdrv_open_child(NULL, options, "cache", bs, &child_of_bds,
+                               BDRV_CHILD_METADATA, false, &local_err);
+    if (local_err) {
+        ret = -EINVAL;
+        error_propagate(errp, local_err);
+        goto fail;
+    }
+
+    len = bdrv_getlength(bs->file->bs);
+    if (len < 0) {
+        ret = len;
+        error_setg_errno(errp, -ret, "Could not get the image length");
+        goto fail;
+    }
+    if (!QEMU_IS_ALIGNED(len, LOG_CACHE_BLOCK_SIZE)) {
+        ret = -EINVAL;
+        error_setg(errp, "The image size must be a multiple of %d bytes",
+                   LOG_CACHE_BLOCK_SIZE);
+        goto fail;
+    }
+    s->image_size = len;
+
+    ret = log_cache_load(bs, errp);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    bs->supported_write_flags = BDRV_REQ_FUA;
+
+    /* Write back whatever the last user left in the log */
+    log_cache_kick_destage(bs);
+
+fail:
+    if (ret < 0) {
+        LogCacheEntry *e, *next;
+
+        QSIMPLEQ_FOREACH_SAFE(e, &s->entries, next, next) {
+            g_free(e);
+        }
+        QSIMPLEQ_INIT(&s->entries);
+        g_hash_table_destroy(s->map);
+        s->map = NULL;
+        bdrv_unref_child(bs, s->cache);
+        s->cache = NULL;
+        bdrv_unref_child(bs, bs->file);
+        bs->file = NULL;
+    }
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static void log_cache_close(BlockDriverState *bs)
+{
+    BDRVLogCacheState *s = bs->opaque;
+    LogCacheEntry *e, *next;
+
+    /* The node is drained, so destaging has finished or given up */
+    assert(!s->destaging && QLIST_EMPTY(&s->in_flight));
+    if (!QSIMPLEQ_EMPTY(&s->entries)) {
+        warn_report("log-cache: '%s' still holds data for '%s', it will be "
+                    "written back when the cache is opened again",
+                    s->cache->bs->filename, bs->file->bs->filename);
+    }
+
+    QSIMPLEQ_FOREACH_SAFE(e, &s->entries, next, next) {
+        g_free(e);
+    }
+    g_hash_table_destroy(s->map);
+    s->map = NULL;
+
+    bdrv_unref_child(bs, s->cache);
+    s->cache = NULL;
+}
+
+static void log_cache_refresh_limits(BlockDriverState *bs, Error **errp)
+{
+    bs->bl.request_alignment = LOG_CACHE_BLOCK_SIZE;
+}
+
+static int64_t log_cache_getlength(BlockDriverState *bs)
+{
+    BDRVLogCacheState *s = bs->opaque;
+
+    return s->image_size;
+}
+
+static int coroutine_fn log_cache_co_preadv_part(BlockDriverState *bs,
+                                                 uint64_t offset,
+                                                 uint64_t bytes,
+                                                 QEMUIOVector *qiov,
+                                                 size_t qiov_offset,
+                                                 int flags)
+{
+    BDRVLogCacheState *s = bs->opaque;
+    int ret = 0;
+
+    if (!g_hash_table_size(s->map)) {
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   flags);
+    }
+
+    qemu_co_rwlock_rdlock(&s->lock);
+    while (bytes) {
+        uint64_t block = offset >> LOG_CACHE_BLOCK_BITS;
+        LogCacheBlock *b = log_cache_lookup(s, block);
+        uint64_t n = 1;
+        uint64_t cur_bytes;
+
+        /* Blocks logged by the same entry are contiguous in the log, too */
+        while ((n << LOG_CACHE_BLOCK_BITS) < bytes) {
+            LogCacheBlock *nb = log_cache_lookup(s, block + n);
+
+            if (b ? !nb || nb->entry != b->entry : nb != NULL) {
+                break;
+            }
+            n++;
+        }
+        cur_bytes = MIN(bytes, n << LOG_CACHE_BLOCK_BITS);
+
+        if (b) {
+            ret = bdrv_co_preadv_part(s->cache,
+                                      log_cache_data_offset(s, b->entry, block),
+                                      cur_bytes, qiov, qiov_offset, 0);
+        } else {
+            ret = bdrv_co_preadv_part(bs->file, offset, cur_bytes, qiov,
+                                      qiov_offset, flags);
+        }
+        if (ret < 0) {
+            break;
+        }
+
+        offset += cur_bytes;
+        qiov_offset += cur_bytes;
+        bytes -= cur_bytes;
+    }
+    qemu_co_rwlock_unlock(&s->lock);
+
+    return ret < 0 ? ret : 0;
+}
+
+/* Reserve @size bytes at the head of the log */
+static bool log_cache_reserve(BDRVLogCacheState *s, uint64_t size,
+                              uint64_t *pos)
+{
+    uint64_t start = s->head;
+
+    if (start % s->log_size + size > s->log_size) {
+        start = ROUND_UP(start, s->log_size);
+    }
+    if (start + size - s->tail > s->log_size) {
+        return false;
+    }
+
+    *pos = start;
+    s->head = start + size;
+    return true;
+}
+
+static int coroutine_fn log_cache_append(BlockDriverState *bs,
+                                         uint64_t offset, uint64_t bytes,
+                                         QEMUIOVector *qiov,
+                                         size_t qiov_offset)
+{
+    BDRVLogCacheState *s = bs->opaque;
+    uint64_t size = s->hdr_size + bytes;
+    LogCacheEntry *e;
+    uint64_t pos;
+    uint8_t *buf;
+    int ret;
+
+    /*
+     * The data is copied so that the checksum matches what ends up in the
+     * log even if the guest changes the buffer meanwhile.  This must happen
+     * before the space is reserved: once it is, the entry has to be written.
+     */
+    buf = qemu_try_blockalign(s->cache->bs, size);
+    if (!buf) {
+        return -ENOMEM;
+    }
+    qemu_iovec_to_buf(qiov, qiov_offset, buf + s->hdr_size, bytes);
+
+    while (s->log_ret >= 0 && !log_cache_reserve(s, size, &pos)) {
+        log_cache_kick_destage(bs);
+        if (!s->destaging && s->destage_ret < 0) {
+            qemu_vfree(buf);
+            return s->destage_ret;
+        }
+        qemu_co_queue_wait(&s->space_queue, NULL);
+    }
+    if (s->log_ret < 0) {
+        qemu_vfree(buf);
+        return s->log_ret;
+    }
+
+    e = log_cache_add_entry(s, pos, offset, bytes);
+    QLIST_INSERT_HEAD(&s->in_flight, e, in_flight_next);
+    log_cache_entry_header(s, e, buf);
+
+    ret = bdrv_co_pwrite(s->cache, log_cache_log_offset(s, pos), size, buf, 0);
+    qemu_vfree(buf);
+
+    QLIST_REMOVE(e, in_flight_next);
+    e->done = true;
+    if (ret < 0) {
+        e->failed = true;
+        s->log_ret = ret;
+    } else {
+        log_cache_index(s, e);
+    }
+    trace_log_cache_write(bs, offset, bytes, pos, e->seq, ret);
+
+    qemu_co_queue_restart_all(&s->flush_queue);
+    log_cache_kick_destage(bs);
+    return ret;
+}
+
+static bool log_cache_pending_before(BDRVLogCacheState *s, uint64_t seq)
+{
+    LogCacheEntry *e;
+
+    QLIST_FOREACH(e, &s->in_flight, in_flight_next) {
+        if (e->seq < seq) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int coroutine_fn log_cache_co_flush(BlockDriverState *bs)
+{
+    BDRVLogCacheState *s = bs->opaque;
+    uint64_t seq = s->next_seq;
+
+    /* Recovery stops at the first incomplete entry, so wait for all of them */
+    while (log_cache_pending_before(s, seq)) {
+        qemu_co_queue_wait(&s->flush_queue, NULL);
+    }
+    if (s->log_ret < 0) {
+        return s->log_ret;
+    }
+
+    return bdrv_co_flush(s->cache->bs);
+}
+
+static int coroutine_fn log_cache_co_pwritev_part(BlockDriverState *bs,
+                                                  uint64_t offset,
+                                                  uint64_t bytes,
+                                                  QEMUIOVector *qiov,
+                                                  size_t qiov_offset,
+                                                  int flags)
+{
+    int ret;
+
+    while (bytes) {
+        uint64_t cur_bytes = MIN(bytes, LOG_CACHE_MAX_ENTRY);
+
+        ret = log_cache_append(bs, offset, cur_bytes, qiov, qiov_offset);
+        if (ret < 0) {
+            return ret;
+        }
+
+        offset += cur_bytes;
+        qiov_offset += cur_bytes;
+        bytes -= cur_bytes;
+    }
+
+    if (flags & BDRV_REQ_FUA) {
+        return log_cache_co_flush(bs);
+    }
+    return 0;
+}
+
+static int coroutine_fn log_cache_co_block_status(BlockDriverState *bs,
+                                                  bool want_zero,
+                                                  int64_t offset,
+                                                  int64_t bytes,
+                                                  int64_t *pnum,
+                                                  int64_t *map,
+                                                  BlockDriverState **file)
+{
+    BDRVLogCacheState *s = bs->opaque;
+    uint64_t block = offset >> LOG_CACHE_BLOCK_BITS;
+    bool logged;
+    int64_t n = 1;
+
+    if (!g_hash_table_size(s->map)) {
+        return bdrv_co_block_status_from_file(bs, want_zero, offset, bytes,
+                                              pnum, map, file);
+    }
+
+    logged = log_cache_lookup(s, block) != NULL;
+    while ((n << LOG_CACHE_BLOCK_BITS) < MIN(bytes, LOG_CACHE_MAX_BATCH) &&
+           (log_cache_lookup(s, block + n) != NULL) == logged) {
+        n++;
+    }
+    bytes = MIN(bytes, n << LOG_CACHE_BLOCK_BITS);
+
+    if (logged) {
+        *pnum = bytes;
+        return BDRV_BLOCK_DATA;
+    }
+    return bdrv_co_block_status_from_file(bs, want_zero, offset, bytes,
+                                          pnum, map, file);
+}
+
+static BlockDriver bdrv_log_cache = {
+    .format_name                        = "log-cache",
+    .instance_size                      = sizeof(BDRVLogCacheState),
+
+    .bdrv_open                          = log_cache_open,
+    .bdrv_close                         = log_cache_close,
+    .bdrv_child_perm                    = bdrv_default_perms,
+    .bdrv_refresh_limits                = log_cache_refresh_limits,
+
+    .bdrv_getlength                     = log_cache_getlength,
+
+    .bdrv_co_preadv_part                = log_cache_co_preadv_part,
+    .bdrv_co_pwritev_part               = log_cache_co_pwritev_part,
+    .bdrv_co_flush                      = log_cache_co_flush,
+
+    .bdrv_co_block_status               = log_cache_co_block_status,
+};
+
+static void bdrv_log_cache_init(void)
+{
+    bdrv_register(&bdrv_log_cache);
+}
+
+block_init(bdrv_log_cache_init);
@@ -62,6 +62,14 @@ typedef enum NBDClientState {
     NBD_CLIENT_QUIT
 } NBDClientState;
 
+#define NBD_EXTENT_CACHE_SIZE 16
+
+typedef struct NBDCachedExtent {
+    uint64_t offset;
+    uint64_t length;
+    uint32_t flags;
+} NBDCachedExtent;
+
 typedef struct BDRVNBDState {
     QIOChannelSocket *sioc; /* The master data channel */
     QIOChannel *ioc; /* The current I/O channel which may differ (eg TLS) */
@@ -91,10 +99,67 @@ typedef struct BDRVNBDState {
     QCryptoTLSCreds *tlscreds;
     const char *hostname;
     char *x_dirty_bitmap;
+
+    /*
+     * Recent block status replies, only kept for read-only exports (see
+     * nbd_extent_cache_usable()) and dropped on reconnect.
+     */
+    NBDCachedExtent extent_cache[NBD_EXTENT_CACHE_SIZE];
+    unsigned int extent_cache_next;
 } BDRVNBDState;
 
 static int nbd_client_connect(BlockDriverState *bs, Error **errp);
 
+/*
+ * The allocation status of an export that nobody can write to through NBD
+ * doesn't change, so it can be remembered.  Dirty bitmap contexts report
+ * something else entirely.
+ */
+static bool nbd_extent_cache_usable(BDRVNBDState *s)
+{
+    return s->info.base_allocation && !s->x_dirty_bitmap &&
+           (s->info.flags & NBD_FLAG_READ_ONLY);
+}
+
+static void nbd_extent_cache_clear(BDRVNBDState *s)
+{
+    memset(s->extent_cache, 0, sizeof(s->extent_cache));
+    s->extent_cache_next = 0;
+}
+
+static NBDCachedExtent *nbd_extent_cache_find(BDRVNBDState *s,
+                                              uint64_t offset)
+{
+    int i;
+
+    if (!nbd_extent_cache_usable(s)) {
+        return NULL;
+    }
+    for (i = 0; i < NBD_EXTENT_CACHE_SIZE; i++) {
+        NBDCachedExtent *e = &s->extent_cache[i];
+
+        if (e->length && offset >= e->offset &&
+            offset - e->offset < e->length) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void nbd_extent_cache_add(BDRVNBDState *s, uint64_t offset,
+                                 NBDExtent *extent)
+{
+    if (!nbd_extent_cache_usable(s)) {
+        return;
+    }
+    s->extent_cache[s->extent_cache_next] = (NBDCachedExtent) {
+        .offset = offset,
+        .length = extent->length,
+        .flags = extent->flags,
+    };
+    s->extent_cache_next = (s->extent_cache_next + 1) % NBD_EXTENT_CACHE_SIZE;
+}
+
 static void nbd_clear_bdrvstate(BDRVNBDState *s)
 {
     object_unref(OBJECT(s->tlscreds));
@@ -291,6 +356,7 @@ static coroutine_fn void nbd_reconnect_attempt(BDRVNBDState *s)
     }
 
     /* successfully connected */
+    nbd_extent_cache_clear(s);
     s->state = NBD_CLIENT_CONNECTED;
     qemu_co_queue_restart_all(&s->free_sema);
 }
@@ -1166,6 +1232,7 @@ static int nbd_client_co_preadv(BlockDriverState *bs, uint64_t offset,
     int ret, request_ret;
     Error *local_err = NULL;
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDCachedExtent *e;
     NBDRequest request = {
         .type = NBD_CMD_READ,
         .from = offset,
@@ -1197,6 +1264,14 @@ static int nbd_client_co_preadv(BlockDriverState *bs, uint64_t offset,
         request.len -= slop;
     }
 
+    /* Don't fetch zeroes over the network if we know where they are */
+    e = nbd_extent_cache_find(s, offset);
+    if (e && (e->flags & NBD_STATE_ZERO) &&
+        offset + request.len <= e->offset + e->length) {
+        qemu_iovec_memset(qiov, 0, 0, request.len);
+        return 0;
+    }
+
     do {
         ret = nbd_co_send_request(bs, &request, NULL);
         if (ret < 0) {
@@ -1315,6 +1390,7 @@ static int coroutine_fn nbd_client_co_block_status(
     int ret, request_ret;
     NBDExtent extent = { 0 };
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDCachedExtent *e;
     Error *local_err = NULL;
 
     NBDRequest request = {
@@ -1346,6 +1422,13 @@ static int coroutine_fn nbd_client_co_block_status(
         return BDRV_BLOCK_ZERO;
     }
 
+    e = nbd_extent_cache_find(s, offset);
+    if (e) {
+        extent.length = MIN(bytes, e->offset + e->length - offset);
+        extent.flags = e->flags;
+        goto out;
+    }
+
     if (s->info.min_block) {
         assert(QEMU_IS_ALIGNED(request.len, s->info.min_block));
     }
@@ -1372,6 +1455,9 @@ static int coroutine_fn nbd_client_co_block_status(
         return ret ? ret : request_ret;
     }
 
+    nbd_extent_cache_add(s, offset, &extent);
+
+out:
     assert(extent.length);
     *pnum = extent.length;
     *map = offset;
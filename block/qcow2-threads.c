@@ -33,6 +33,11 @@
 #include <zstd_errors.h>
 #endif
 
+#ifdef CONFIG_LZ4
+#include <lz4.h>
+#endif
+
+#include "qemu/bswap.h"
 #include "qcow2.h"
 #include "block/thread-pool.h"
 #include "crypto.h"
@@ -45,7 +50,7 @@ qcow2_co_process(BlockDriverState *bs, ThreadPoolFunc *func, void *arg)
     ThreadPool *pool = aio_get_thread_pool(bdrv_get_aio_context(bs));
 
     qemu_co_mutex_lock(&s->lock);
-    while (s->nb_threads >= QCOW2_MAX_THREADS) {
+    while (s->nb_threads >= s->max_threads) {
         qemu_co_queue_wait(&s->thread_task_queue, &s->lock);
     }
     s->nb_threads++;
@@ -325,6 +330,77 @@ static ssize_t qcow2_zstd_decompress(void *dest, size_t dest_size,
 }
 #endif
 
+#ifdef CONFIG_LZ4
+
+/*
+ * The compressed data is stored as one LZ4 block, preceded by its length
+ * as a be32.  LZ4 needs the exact size of the block, which the L2 entry
+ * only gives with a precision of one sector.
+ */
+#define QCOW2_LZ4_HDR_SIZE 4
+
+/*
+ * qcow2_lz4_compress()
+ *
+ * Compress @src_size bytes of data using lz4 compression method
+ *
+ * @dest - destination buffer, @dest_size bytes
+ * @src - source buffer, @src_size bytes
+ *
+ * Returns: compressed size on success
+ *          -ENOMEM destination buffer is not enough to store compressed data
+ */
+static ssize_t qcow2_lz4_compress(void *dest, size_t dest_size,
+                                  const void *src, size_t src_size)
+{
+    int ret;
+
+    if (dest_size <= QCOW2_LZ4_HDR_SIZE) {
+        return -ENOMEM;
+    }
+
+    ret = LZ4_compress_default(src, (char *)dest + QCOW2_LZ4_HDR_SIZE,
+                               src_size, dest_size - QCOW2_LZ4_HDR_SIZE);
+    if (ret <= 0) {
+        return -ENOMEM;
+    }
+    stl_be_p(dest, ret);
+
+    return ret + QCOW2_LZ4_HDR_SIZE;
+}
+
+/*
+ * qcow2_lz4_decompress()
+ *
+ * Decompress some data (not more than @src_size bytes) to produce exactly
+ * @dest_size bytes using lz4 compression method
+ *
+ * @dest - destination buffer, @dest_size bytes
+ * @src - source buffer, @src_size bytes
+ *
+ * Returns: 0 on success
+ *          -EIO on any error
+ */
+static ssize_t qcow2_lz4_decompress(void *dest, size_t dest_size,
+                                    const void *src, size_t src_size)
+{
+    uint32_t len;
+    int ret;
+
+    if (src_size < QCOW2_LZ4_HDR_SIZE) {
+        return -EIO;
+    }
+    len = ldl_be_p(src);
+    if (len > src_size - QCOW2_LZ4_HDR_SIZE) {
+        return -EIO;
+    }
+
+    ret = LZ4_decompress_safe((const char *)src + QCOW2_LZ4_HDR_SIZE, dest,
+                              len, dest_size);
+    return ret == dest_size ? 0 : -EIO;
+}
+#endif
+
 static int qcow2_compress_pool_func(void *opaque)
 {
     Qcow2CompressData *data = opaque;
@@ -380,6 +456,11 @@ qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
     case QCOW2_COMPRESSION_TYPE_ZSTD:
         fn = qcow2_zstd_compress;
         break;
+#endif
+#ifdef CONFIG_LZ4
+    case QCOW2_COMPRESSION_TYPE_LZ4:
+        fn = qcow2_lz4_compress;
+        break;
 #endif
     default:
         abort();
@@ -417,6 +498,11 @@ qcow2_co_decompress(BlockDriverState *bs, void *dest, size_t dest_size,
     case QCOW2_COMPRESSION_TYPE_ZSTD:
         fn = qcow2_zstd_decompress;
         break;
+#endif
+#ifdef CONFIG_LZ4
+    case QCOW2_COMPRESSION_TYPE_LZ4:
+        fn = qcow2_lz4_decompress;
+        break;
 #endif
     default:
         abort();
@@ -1248,6 +1248,9 @@ static int validate_compression_type(BDRVQcow2State *s, Error **errp)
     case QCOW2_COMPRESSION_TYPE_ZLIB:
 #ifdef CONFIG_ZSTD
     case QCOW2_COMPRESSION_TYPE_ZSTD:
+#endif
+#ifdef CONFIG_LZ4
+    case QCOW2_COMPRESSION_TYPE_LZ4:
 #endif
         break;
 
@@ -1812,6 +1815,12 @@ static int coroutine_fn qcow2_do_open(BlockDriverState *bs, QDict *options,
 #endif
 
     qemu_co_queue_init(&s->thread_task_queue);
+    /*
+     * Compression of a parallel convert or backup can keep every host CPU
+     * busy, so allow as many jobs as there are CPUs.
+     */
+    s->max_threads = MIN(MAX(QCOW2_MAX_THREADS, g_get_num_processors()),
+                         QCOW2_MAX_THREADS_LIMIT);
 
     return ret;
 
@@ -1878,6 +1887,7 @@ static int qcow2_open(BlockDriverState *bs, QDict *options, int flags,
 
     /* Initialise locks */
     qemu_co_mutex_init(&s->lock);
+    qemu_co_mutex_set_profile_class(&s->lock, "qcow2");
 
     if (qemu_in_coroutine()) {
         /* From bdrv_co_create.  */
@@ -3492,6 +3502,10 @@ qcow2_co_create(BlockdevCreateOptions *create_options, Error **errp)
 #ifdef CONFIG_ZSTD
         case QCOW2_COMPRESSION_TYPE_ZSTD:
             break;
+#endif
+#ifdef CONFIG_LZ4
+        case QCOW2_COMPRESSION_TYPE_LZ4:
+            break;
 #endif
         default:
             error_setg(errp, "Unknown compression type");
@@ -290,6 +290,8 @@ typedef struct Qcow2BitmapHeaderExt {
 } QEMU_PACKED Qcow2BitmapHeaderExt;
 
 #define QCOW2_MAX_THREADS 4
+/* Upper bound for max_threads, the size of the AioContext thread pool */
+#define QCOW2_MAX_THREADS_LIMIT 64
 
 typedef struct BDRVQcow2State {
     int cluster_bits;
@@ -372,6 +374,8 @@ typedef struct BDRVQcow2State {
 
     CoQueue thread_task_queue;
     int nb_threads;
+    /* Maximum number of thread pool jobs, see qcow2_co_process() */
+    int max_threads;
 
     BdrvChild *data_file;
 
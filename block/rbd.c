@@ -77,7 +77,8 @@ typedef enum {
     RBD_AIO_READ,
     RBD_AIO_WRITE,
     RBD_AIO_DISCARD,
-    RBD_AIO_FLUSH
+    RBD_AIO_FLUSH,
+    RBD_AIO_WRITE_ZEROES
 } RBDAIOCmd;
 
 typedef struct RBDAIOCB {
@@ -820,6 +821,10 @@ static int qemu_rbd_open(BlockDriverState *bs, QDict *options, int flags,
     /* When extending regular files, we get zeros from the OS */
     bs->supported_truncate_flags = BDRV_REQ_ZERO_WRITE;
 
+#ifdef LIBRBD_SUPPORTS_WRITE_ZEROES
+    bs->supported_zero_flags = BDRV_REQ_MAY_UNMAP;
+#endif
+
     r = 0;
     goto out;
 
@@ -939,7 +944,8 @@ static BlockAIOCB *rbd_start_aio(BlockDriverState *bs,
                                  int64_t size,
                                  BlockCompletionFunc *cb,
                                  void *opaque,
-                                 RBDAIOCmd cmd)
+                                 RBDAIOCmd cmd,
+                                 BdrvRequestFlags flags)
 {
     RBDAIOCB *acb;
     RADOSCB *rcb = NULL;
@@ -956,7 +962,8 @@ static BlockAIOCB *rbd_start_aio(BlockDriverState *bs,
     rcb = g_new(RADOSCB, 1);
 
     if (!LIBRBD_USE_IOVEC) {
-        if (cmd == RBD_AIO_DISCARD || cmd == RBD_AIO_FLUSH) {
+        if (cmd == RBD_AIO_DISCARD || cmd == RBD_AIO_FLUSH ||
+            cmd == RBD_AIO_WRITE_ZEROES) {
             acb->bounce = NULL;
         } else {
             acb->bounce = qemu_try_blockalign(bs, qiov->size);
@@ -982,19 +989,21 @@ static BlockAIOCB *rbd_start_aio(BlockDriverState *bs,
         goto failed;
     }
 
+    /*
+     * RBD APIs don't allow us to write more than actual size, so in order
+     * to support growing images, we resize the image before write
+     * operations that exceed the current size.
+     */
+    if ((cmd == RBD_AIO_WRITE || cmd == RBD_AIO_WRITE_ZEROES) &&
+        off + size > s->image_size) {
+        r = qemu_rbd_resize(bs, off + size);
+        if (r < 0) {
+            goto failed_completion;
+        }
+    }
+
     switch (cmd) {
     case RBD_AIO_WRITE: {
-        /*
-         * RBD APIs don't allow us to write more than actual size, so in order
-         * to support growing images, we resize the image before write
-         * operations that exceed the current size.
-         */
-        if (off + size > s->image_size) {
-            r = qemu_rbd_resize(bs, off + size);
-            if (r < 0) {
-                goto failed_completion;
-            }
-        }
 #ifdef LIBRBD_SUPPORTS_IOVEC
             r = rbd_aio_writev(s->image, qiov->iov, qiov->niov, off, c);
 #else
@@ -1015,6 +1024,18 @@ static BlockAIOCB *rbd_start_aio(BlockDriverState *bs,
     case RBD_AIO_FLUSH:
         r = rbd_aio_flush_wrapper(s->image, c);
         break;
+#ifdef LIBRBD_SUPPORTS_WRITE_ZEROES
+    case RBD_AIO_WRITE_ZEROES: {
+        int zero_flags = 0;
+#ifdef RBD_WRITE_ZEROES_FLAG_THICK_PROVISION
+        if (!(flags & BDRV_REQ_MAY_UNMAP)) {
+            zero_flags = RBD_WRITE_ZEROES_FLAG_THICK_PROVISION;
+        }
+#endif
+        r = rbd_aio_write_zeroes(s->image, off, size, c, zero_flags, 0);
+        break;
+    }
+#endif
     default:
         r = -EINVAL;
     }
@@ -1043,7 +1064,7 @@ static BlockAIOCB *qemu_rbd_aio_preadv(BlockDriverState *bs,
                                        void *opaque)
 {
     return rbd_start_aio(bs, offset, qiov, bytes, cb, opaque,
-                         RBD_AIO_READ);
+                         RBD_AIO_READ, 0);
 }
 
 static BlockAIOCB *qemu_rbd_aio_pwritev(BlockDriverState *bs,
@@ -1053,7 +1074,7 @@ static BlockAIOCB *qemu_rbd_aio_pwritev(BlockDriverState *bs,
                                         void *opaque)
 {
     return rbd_start_aio(bs, offset, qiov, bytes, cb, opaque,
-                         RBD_AIO_WRITE);
+                         RBD_AIO_WRITE, 0);
 }
 
 #ifdef LIBRBD_SUPPORTS_AIO_FLUSH
@@ -1061,7 +1082,7 @@ static BlockAIOCB *qemu_rbd_aio_flush(BlockDriverState *bs,
                                       BlockCompletionFunc *cb,
                                       void *opaque)
 {
-    return rbd_start_aio(bs, 0, NULL, 0, cb, opaque, RBD_AIO_FLUSH);
+    return rbd_start_aio(bs, 0, NULL, 0, cb, opaque, RBD_AIO_FLUSH, 0);
 }
 
 #else
@@ -1251,7 +1272,57 @@ static BlockAIOCB *qemu_rbd_aio_pdiscard(BlockDriverState *bs,
                                          void *opaque)
 {
     return rbd_start_aio(bs, offset, NULL, bytes, cb, opaque,
-                         RBD_AIO_DISCARD);
+                         RBD_AIO_DISCARD, 0);
+}
+#endif
+
+#ifdef LIBRBD_SUPPORTS_WRITE_ZEROES
+typedef struct RBDCoData {
+    Coroutine *co;
+    int ret;
+    bool done;
+} RBDCoData;
+
+static void qemu_rbd_co_cb(void *opaque, int ret)
+{
+    RBDCoData *data = opaque;
+
+    data->ret = ret;
+    data->done = true;
+    aio_co_wake(data->co);
+}
+
+/*
+ * There is no AIO variant of write_zeroes in BlockDriver, so this runs
+ * the request through rbd_start_aio() and waits for its completion BH.
+ */
+static int coroutine_fn qemu_rbd_co_pwrite_zeroes(BlockDriverState *bs,
+                                                  int64_t offset, int bytes,
+                                                  BdrvRequestFlags flags)
+{
+    RBDCoData data = {
+        .co = qemu_coroutine_self(),
+    };
+
+#ifndef RBD_WRITE_ZEROES_FLAG_THICK_PROVISION
+    /*
+     * Without MAY_UNMAP the zeroed range must stay allocated.  Older
+     * librbd can't promise that, so let the block layer fall back to
+     * writing a zeroed buffer.
+     */
+    if (!(flags & BDRV_REQ_MAY_UNMAP)) {
+        return -ENOTSUP;
+    }
+#endif
+
+    if (!rbd_start_aio(bs, offset, NULL, bytes, qemu_rbd_co_cb, &data,
+                       RBD_AIO_WRITE_ZEROES, flags)) {
+        return -EIO;
+    }
+    while (!data.done) {
+        qemu_coroutine_yield();
+    }
+    return data.ret;
 }
 #endif
 
@@ -1332,6 +1403,10 @@ static BlockDriver bdrv_rbd = {
     .bdrv_aio_pdiscard      = qemu_rbd_aio_pdiscard,
 #endif
 
+#ifdef LIBRBD_SUPPORTS_WRITE_ZEROES
+    .bdrv_co_pwrite_zeroes  = qemu_rbd_co_pwrite_zeroes,
+#endif
+
     .bdrv_snapshot_create   = qemu_rbd_snap_create,
     .bdrv_snapshot_delete   = qemu_rbd_snap_remove,
     .bdrv_snapshot_list     = qemu_rbd_snap_list,
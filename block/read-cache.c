@@ -0,0 +1,654 @@
+/*
+ * Persistent read cache filter block driver
+ *
+ * Copyright (c) 2020 Xilinx Inc
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * The filter keeps a copy of the data read from its file child in a second,
+ * usually local, cache child.  The cache is indexed by offset: cluster N of
+ * the image lives at data_offset + N * cluster_size in the cache file, and a
+ * bitmap records which clusters hold valid data.
+ *
+ * The bitmap is kept in memory and only written back when the node is
+ * closed or inactivated.  While the cache is open for writing, its header
+ * has the in-use flag set, so a cache that was not closed cleanly is
+ * discarded on the next open.
+ *
+ * A cache whose child is read-only is never populated; it serves hits only,
+ * and any number of VMs booting from the same image may share it.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "block/block_int.h"
+#include "qemu/bitmap.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "trace.h"
+
+#define READ_CACHE_MAGIC    0x5143524341434845ULL /* "QCRCACHE" */
+#define READ_CACHE_VERSION  1
+
+#define READ_CACHE_FLAG_IN_USE  (1 << 0)
+
+#define READ_CACHE_BITMAP_OFFSET    4096
+#define READ_CACHE_DEFAULT_CLUSTER  (64 * KiB)
+#define READ_CACHE_MIN_CLUSTER      (4 * KiB)
+#define READ_CACHE_MAX_CLUSTER      (2 * MiB)
+
+/* Largest miss that is read into a bounce buffer to fill the cache.  */
+#define READ_CACHE_MAX_FILL         (4 * MiB)
+
+/* All fields are big-endian.  */
+typedef struct ReadCacheHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t cluster_bits;
+    uint32_t reserved;
+    uint64_t image_size;
+    uint64_t bitmap_offset;
+    uint64_t data_offset;
+} QEMU_PACKED ReadCacheHeader;
+
+typedef struct BDRVReadCacheState {
+    BdrvChild *cache;
+    ReadCacheMode mode;
+    uint32_t cluster_bits;
+
+    /* Set while the cache is loaded and may be used for hits.  */
+    bool active;
+    /* Set if misses and write-through writes may fill the cache.  */
+    bool populate;
+
+    uint64_t image_size;
+    uint64_t nb_clusters;
+    uint64_t data_offset;
+    unsigned long *bitmap;
+
+    /*
+     * Writes bump write_gen when they start.  A fill only marks its
+     * clusters valid if no write was in flight or started while it ran,
+     * otherwise it might cache data that has already been overwritten.
+     */
+    uint64_t write_gen;
+    unsigned int writes_in_flight;
+} BDRVReadCacheState;
+
+static QemuOptsList runtime_opts = {
+    .name = "read-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = "cluster-size",
+            .type = QEMU_OPT_SIZE,
+            .help = "Cache granularity in bytes",
+        },
+        {
+            .name = "mode",
+            .type = QEMU_OPT_STRING,
+            .help = "Write policy (write-around, write-through)",
+        },
+        { /* end of list */ }
+    },
+};
+
+static inline uint64_t read_cache_bitmap_bytes(uint64_t nb_clusters)
+{
+    /* Stored as little-endian 64-bit words, whatever the host word size */
+    return DIV_ROUND_UP(nb_clusters, 64) * 8;
+}
+
+static int read_cache_write_header(BlockDriverState *bs, uint32_t flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    ReadCacheHeader h = {
+        .magic          = cpu_to_be64(READ_CACHE_MAGIC),
+        .version        = cpu_to_be32(READ_CACHE_VERSION),
+        .flags          = cpu_to_be32(flags),
+        .cluster_bits   = cpu_to_be32(s->cluster_bits),
+        .image_size     = cpu_to_be64(s->image_size),
+        .bitmap_offset  = cpu_to_be64(READ_CACHE_BITMAP_OFFSET),
+        .data_offset    = cpu_to_be64(s->data_offset),
+    };
+    int ret;
+
+    ret = bdrv_pwrite(s->cache, 0, &h, sizeof(h));
+    if (ret < 0) {
+        return ret;
+    }
+    return bdrv_flush(s->cache->bs);
+}
+
+/*
+ * Read the cache header and bitmap.  A cache that does not match the image
+ * or was not closed cleanly is reset if it can be written, and ignored
+ * otherwise.
+ */
+static int read_cache_load(BlockDriverState *bs, Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    ReadCacheHeader h;
+    uint64_t bitmap_bytes;
+    int64_t len;
+    bool valid = false;
+    int ret;
+
+    len = bdrv_getlength(bs->file->bs);
+    if (len < 0) {
+        error_setg_errno(errp, -len, "Could not get the image length");
+        return len;
+    }
+
+    s->image_size = len;
+    s->nb_clusters = DIV_ROUND_UP(len, 1ULL << s->cluster_bits);
+    bitmap_bytes = read_cache_bitmap_bytes(s->nb_clusters);
+    s->data_offset = ROUND_UP(READ_CACHE_BITMAP_OFFSET + bitmap_bytes,
+                              1ULL << s->cluster_bits);
+    s->populate = !bdrv_is_read_only(s->cache->bs);
+    g_free(s->bitmap);
+    s->bitmap = bitmap_new(ROUND_UP(s->nb_clusters, 64));
+
+    len = bdrv_getlength(s->cache->bs);
+    if (len < 0) {
+        error_setg_errno(errp, -len, "Could not get the cache length");
+        return len;
+    }
+
+    if (len >= sizeof(h)) {
+        ret = bdrv_pread(s->cache, 0, &h, sizeof(h));
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read the cache header");
+            return ret;
+        }
+        valid = be64_to_cpu(h.magic) == READ_CACHE_MAGIC &&
+                be32_to_cpu(h.version) == READ_CACHE_VERSION &&
+                be32_to_cpu(h.cluster_bits) == s->cluster_bits &&
+                be64_to_cpu(h.image_size) == s->image_size &&
+                be64_to_cpu(h.bitmap_offset) == READ_CACHE_BITMAP_OFFSET &&
+                be64_to_cpu(h.data_offset) == s->data_offset &&
+                !(be32_to_cpu(h.flags) & READ_CACHE_FLAG_IN_USE);
+    }
+
+    if (valid) {
+        unsigned long *le_bitmap = bitmap_new(ROUND_UP(s->nb_clusters, 64));
+
+        ret = bdrv_pread(s->cache, READ_CACHE_BITMAP_OFFSET, le_bitmap,
+                         bitmap_bytes);
+        if (ret < 0) {
+            g_free(le_bitmap);
+            error_setg_errno(errp, -ret, "Could not read the cache bitmap");
+            return ret;
+        }
+        bitmap_from_le(s->bitmap, le_bitmap, s->nb_clusters);
+        g_free(le_bitmap);
+    } else if (!s->populate) {
+        /* Somebody else owns this cache, or it belongs to another image */
+        warn_report("read-cache: cache '%s' is not valid for '%s', ignoring it",
+                    s->cache->bs->filename, bs->file->bs->filename);
+        s->active = false;
+        return 0;
+    }
+
+    if (s->populate) {
+        ret = read_cache_write_header(bs, READ_CACHE_FLAG_IN_USE);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not write the cache header");
+            return ret;
+        }
+    }
+
+    s->active = true;
+    return 0;
+}
+
+/* Write the bitmap back and mark the cache as cleanly closed.  */
+static int read_cache_store(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    unsigned long *le_bitmap;
+    int ret;
+
+    if (!s->active || !s->populate) {
+        return 0;
+    }
+
+    le_bitmap = bitmap_new(ROUND_UP(s->nb_clusters, 64));
+    bitmap_to_le(le_bitmap, s->bitmap, s->nb_clusters);
+    ret = bdrv_pwrite(s->cache, READ_CACHE_BITMAP_OFFSET, le_bitmap,
+                      read_cache_bitmap_bytes(s->nb_clusters));
+    g_free(le_bitmap);
+    if (ret >= 0) {
+        ret = bdrv_flush(s->cache->bs);
+    }
+    if (ret >= 0) {
+        ret = read_cache_write_header(bs, 0);
+    }
+
+    s->active = false;
+    return ret;
+}
+
+static int read_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                           Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    QemuOpts *opts;
+    Error *local_err = NULL;
+    uint64_t cluster_size;
+    int ret;
+
+    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    qemu_opts_absorb_qdict(opts, options, &local_err);
+    if (local_err) {
+        ret = -EINVAL;
+        error_propagate(errp, local_err);
+        goto fail;
+    }
+
+    cluster_size = qemu_opt_get_size(opts, "cluster-size",
+                                     READ_CACHE_DEFAULT_CLUSTER);
+    if (!is_power_of_2(cluster_size) ||
+        cluster_size < READ_CACHE_MIN_CLUSTER ||
+        cluster_size > READ_CACHE_MAX_CLUSTER) {
+        ret = -EINVAL;
+        error_setg(errp, "Cluster size must be a power of two between %d "
+                   "and %d", READ_CACHE_MIN_CLUSTER, READ_CACHE_MAX_CLUSTER);
+        goto fail;
+    }
+    s->cluster_bits = ctz64(cluster_size);
+
+    s->mode = qapi_enum_parse(&ReadCacheMode_lookup,
+                              qemu_opt_get(opts, "mode"),
+                              READ_CACHE_MODE_WRITE_AROUND, &local_err);
+    if (local_err) {
+        ret = -EINVAL;
+        error_propagate(errp, local_err);
+        goto fail;
+    }
+
+    /* Open the image */
+    bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
+                               BDRV_CHILD_FILTERED | BDRV_CHILD_PRIMARY, false,
+                               &local_err);
+    if (local_err) {
+        ret = -EINVAL;
+        error_propagate(errp, local_err);
+        goto fail;
+    }
+
+    /* Open the cache */
+    s->cache = bdrv_open_child(NULL, options, "cache", bs, &child_of_bds,
+                               BDRV_CHILD_METADATA, false, &local_err);
+    if (local_err) {
+        ret = -EINVAL;
+        error_propagate(errp, local_err);
+        goto fail;
+    }
+
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+        (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+
+    /* An incoming migration loads the cache once it is activated */
+    ret = 0;
+    if (!(flags & BDRV_O_INACTIVE)) {
+        ret = read_cache_load(bs, errp);
+    }
+
+fail:
+    if (ret < 0) {
+        bdrv_unref_child(bs, s->cache);
+        s->cache = NULL;
+        bdrv_unref_child(bs, bs->file);
+        bs->file = NULL;
+        g_free(s->bitmap);
+        s->bitmap = NULL;
+    }
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static void read_cache_close(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    ret = read_cache_store(bs);
+    if (ret < 0) {
+        warn_report("read-cache: failed to write back cache '%s': %s",
+                    s->cache->bs->filename, strerror(-ret));
+    }
+
+    bdrv_unref_child(bs, s->cache);
+    s->cache = NULL;
+    g_free(s->bitmap);
+    s->bitmap = NULL;
+}
+
+static int read_cache_inactivate(BlockDriverState *bs)
+{
+    return read_cache_store(bs);
+}
+
+static void coroutine_fn read_cache_co_invalidate_cache(BlockDriverState *bs,
+                                                        Error **errp)
+{
+    read_cache_load(bs, errp);
+}
+
+static void read_cache_child_perm(BlockDriverState *bs, BdrvChild *c,
+                                  BdrvChildRole role,
+                                  BlockReopenQueue *reopen_queue,
+                                  uint64_t perm, uint64_t shared,
+                                  uint64_t *nperm, uint64_t *nshared)
+{
+    BDRVReadCacheState *s = bs->opaque;
+
+    if (c && c == s->cache && bdrv_is_read_only(c->bs)) {
+        /* Readers of a shared cache only need it not to change under them */
+        *nperm = BLK_PERM_CONSISTENT_READ;
+        *nshared = BLK_PERM_ALL & ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+        return;
+    }
+
+    bdrv_default_perms(bs, c, role, reopen_queue, perm, shared,
+                       nperm, nshared);
+}
+
+static int64_t read_cache_getlength(BlockDriverState *bs)
+{
+    return bdrv_getlength(bs->file->bs);
+}
+
+static inline uint64_t read_cache_cluster(BDRVReadCacheState *s,
+                                          uint64_t offset)
+{
+    return offset >> s->cluster_bits;
+}
+
+/*
+ * Read [@offset, @offset + @bytes) from the image and, if nothing gets in
+ * the way, store the clusters it covers in the cache.
+ */
+static int coroutine_fn read_cache_fill(BlockDriverState *bs,
+                                        uint64_t offset, uint64_t bytes,
+                                        QEMUIOVector *qiov, size_t qiov_offset,
+                                        int flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    uint64_t cluster_size = 1ULL << s->cluster_bits;
+    uint64_t start = QEMU_ALIGN_DOWN(offset, cluster_size);
+    uint64_t end = MIN(QEMU_ALIGN_UP(offset + bytes, cluster_size),
+                       s->image_size);
+    uint64_t gen = s->write_gen;
+    uint8_t *buf;
+    int ret;
+
+    if (!s->populate || s->writes_in_flight || end <= offset) {
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   flags);
+    }
+
+    buf = qemu_try_blockalign(bs->file->bs, end - start);
+    if (!buf) {
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   flags);
+    }
+
+    ret = bdrv_co_pread(bs->file, start, end - start, buf, flags);
+    if (ret < 0) {
+        goto out;
+    }
+    qemu_iovec_from_buf(qiov, qiov_offset, buf + (offset - start), bytes);
+
+    if (gen == s->write_gen) {
+        int cache_ret = bdrv_co_pwrite(s->cache, s->data_offset + start,
+                                       end - start, buf, 0);
+        uint64_t first = read_cache_cluster(s, start);
+        uint64_t nb = read_cache_cluster(s, end - 1) - first + 1;
+
+        if (cache_ret < 0) {
+            trace_read_cache_fill_error(bs, start, end - start, cache_ret);
+        } else if (gen == s->write_gen) {
+            bitmap_set(s->bitmap, first, nb);
+            trace_read_cache_fill(bs, start, end - start);
+        } else {
+            /* A write-through write may have been overwritten, drop both */
+            bitmap_clear(s->bitmap, first, nb);
+        }
+    }
+    ret = 0;
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
+
+static int coroutine_fn read_cache_co_preadv_part(BlockDriverState *bs,
+                                                  uint64_t offset,
+                                                  uint64_t bytes,
+                                                  QEMUIOVector *qiov,
+                                                  size_t qiov_offset,
+                                                  int flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret = 0;
+
+    if (!s->active) {
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   flags);
+    }
+
+    while (bytes) {
+        uint64_t cluster = read_cache_cluster(s, offset);
+        uint64_t next, cur_bytes;
+        bool hit;
+
+        if (cluster >= s->nb_clusters) {
+            /* The image grew behind our back, don't cache the tail */
+            return bdrv_co_preadv_part(bs->file, offset, bytes, qiov,
+                                       qiov_offset, flags);
+        }
+
+        hit = test_bit(cluster, s->bitmap);
+        next = hit ? find_next_zero_bit(s->bitmap, s->nb_clusters, cluster)
+                   : find_next_bit(s->bitmap, s->nb_clusters, cluster);
+        cur_bytes = MIN(bytes, (next << s->cluster_bits) - offset);
+
+        if (hit) {
+            ret = bdrv_co_preadv_part(s->cache, s->data_offset + offset,
+                                      cur_bytes, qiov, qiov_offset, 0);
+            trace_read_cache_hit(bs, offset, cur_bytes);
+        } else {
+            cur_bytes = MIN(cur_bytes, READ_CACHE_MAX_FILL);
+            ret = read_cache_fill(bs, offset, cur_bytes, qiov, qiov_offset,
+                                  flags);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+
+        offset += cur_bytes;
+        qiov_offset += cur_bytes;
+        bytes -= cur_bytes;
+    }
+
+    return 0;
+}
+
+static void read_cache_write_begin(BDRVReadCacheState *s,
+                                   uint64_t offset, uint64_t bytes)
+{
+    uint64_t first = read_cache_cluster(s, offset);
+    uint64_t last;
+
+    s->write_gen++;
+    s->writes_in_flight++;
+
+    if (!s->active || !bytes || first >= s->nb_clusters) {
+        return;
+    }
+    last = MIN(read_cache_cluster(s, offset + bytes - 1), s->nb_clusters - 1);
+    bitmap_clear(s->bitmap, first, last - first + 1);
+}
+
+static void read_cache_write_end(BDRVReadCacheState *s)
+{
+    assert(s->writes_in_flight > 0);
+    s->writes_in_flight--;
+}
+
+/*
+ * Store the clusters that a guest write covered completely, if no other
+ * write raced with it.  Partially covered clusters stay invalid.
+ */
+static void coroutine_fn read_cache_write_through(BlockDriverState *bs,
+                                                  uint64_t offset,
+                                                  uint64_t bytes,
+                                                  QEMUIOVector *qiov,
+                                                  size_t qiov_offset,
+                                                  uint64_t gen)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    uint64_t cluster_size = 1ULL << s->cluster_bits;
+    uint64_t start = QEMU_ALIGN_UP(offset, cluster_size);
+    uint64_t end = MIN(offset + bytes, s->image_size);
+    uint64_t first, nb;
+    int ret;
+
+    if (end != s->image_size) {
+        end = QEMU_ALIGN_DOWN(end, cluster_size);
+    }
+    if (start >= end) {
+        return;
+    }
+
+    ret = bdrv_co_pwritev_part(s->cache, s->data_offset + start, end - start,
+                               qiov, qiov_offset + (start - offset), 0);
+    if (ret < 0 || gen != s->write_gen) {
+        return;
+    }
+
+    first = read_cache_cluster(s, start);
+    nb = read_cache_cluster(s, end - 1) - first + 1;
+    bitmap_set(s->bitmap, first, nb);
+}
+
+static int coroutine_fn read_cache_co_pwritev_part(BlockDriverState *bs,
+                                                   uint64_t offset,
+                                                   uint64_t bytes,
+                                                   QEMUIOVector *qiov,
+                                                   size_t qiov_offset,
+                                                   int flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    bool alone = !s->writes_in_flight;
+    uint64_t gen;
+    int ret;
+
+    read_cache_write_begin(s, offset, bytes);
+    gen = s->write_gen;
+
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+    if (ret >= 0 && alone && gen == s->write_gen && s->active &&
+        s->populate && s->mode == READ_CACHE_MODE_WRITE_THROUGH) {
+        read_cache_write_through(bs, offset, bytes, qiov, qiov_offset, gen);
+    }
+
+    read_cache_write_end(s);
+    return ret;
+}
+
+static int coroutine_fn read_cache_co_pwrite_zeroes(BlockDriverState *bs,
+                                                    int64_t offset, int bytes,
+                                                    BdrvRequestFlags flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    read_cache_write_begin(s, offset, bytes);
+    ret = bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+    read_cache_write_end(s);
+
+    return ret;
+}
+
+static int coroutine_fn read_cache_co_pdiscard(BlockDriverState *bs,
+                                               int64_t offset, int bytes)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    read_cache_write_begin(s, offset, bytes);
+    ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+    read_cache_write_end(s);
+
+    return ret;
+}
+
+static int coroutine_fn read_cache_co_flush(BlockDriverState *bs)
+{
+    /* The cache itself is only made persistent on close */
+    return bdrv_co_flush(bs->file->bs);
+}
+
+static void read_cache_eject(BlockDriverState *bs, bool eject_flag)
+{
+    bdrv_eject(bs->file->bs, eject_flag);
+}
+
+static void read_cache_lock_medium(BlockDriverState *bs, bool locked)
+{
+    bdrv_lock_medium(bs->file->bs, locked);
+}
+
+static const char *const read_cache_strong_runtime_opts[] = {
+    "cluster-size",
+
+    NULL
+};
+
+static BlockDriver bdrv_read_cache = {
+    .format_name                        = "read-cache",
+    .instance_size                      = sizeof(BDRVReadCacheState),
+
+    .bdrv_open                          = read_cache_open,
+    .bdrv_close                         = read_cache_close,
+    .bdrv_inactivate                    = read_cache_inactivate,
+    .bdrv_co_invalidate_cache           = read_cache_co_invalidate_cache,
+    .bdrv_child_perm                    = read_cache_child_perm,
+
+    .bdrv_getlength                     = read_cache_getlength,
+
+    .bdrv_co_preadv_part                = read_cache_co_preadv_part,
+    .bdrv_co_pwritev_part               = read_cache_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes              = read_cache_co_pwrite_zeroes,
+    .bdrv_co_pdiscard                   = read_cache_co_pdiscard,
+    .bdrv_co_flush                      = read_cache_co_flush,
+
+    .bdrv_eject                         = read_cache_eject,
+    .bdrv_lock_medium                   = read_cache_lock_medium,
+
+    .bdrv_co_block_status               = bdrv_co_block_status_from_file,
+
+    .is_filter                          = true,
+    .strong_runtime_opts                = read_cache_strong_runtime_opts,
+};
+
+static void bdrv_read_cache_init(void)
+{
+    bdrv_register(&bdrv_read_cache);
+}
+
+block_init(bdrv_read_cache_init);
@@ -206,9 +206,72 @@ static inline bool tgm_has_pending_reqs(ThrottleGroupMember *tgm,
     return tgm->pending_reqs[is_write];
 }
 
+/* The credit that every member gets per round, in bytes if the group
+ * limits bandwidth and in units of requests (one quantum each) otherwise.
+ */
+#define THROTTLE_GROUP_QUANTUM (64 * 1024)
+
+/*
+ * Return the credit that an I/O request consumes from its member.
+ *
+ * @ts:        the ThrottleState of the group
+ * @is_write:  the type of operation (read/write)
+ * @bytes:     the number of bytes for this I/O
+ */
+static int64_t throttle_group_request_cost(ThrottleState *ts, bool is_write,
+                                           unsigned int bytes)
+{
+    BucketType bkt = is_write ? THROTTLE_BPS_WRITE : THROTTLE_BPS_READ;
+
+    if (ts->cfg.buckets[THROTTLE_BPS_TOTAL].avg || ts->cfg.buckets[bkt].avg) {
+        return bytes;
+    }
+    return THROTTLE_GROUP_QUANTUM;
+}
+
+/* Give every member with pending requests the same number of quanta, just
+ * enough for at least one of them to have credit again. Members without
+ * pending requests don't get to keep credit for later.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tg:        the ThrottleGroup
+ * @is_write:  the type of operation (read/write)
+ */
+static void throttle_group_replenish(ThrottleGroup *tg, bool is_write)
+{
+    ThrottleGroupMember *tgm;
+    int64_t best = INT64_MIN;
+    int64_t credit;
+
+    QLIST_FOREACH(tgm, &tg->head, round_robin) {
+        if (tgm_has_pending_reqs(tgm, is_write)) {
+            best = MAX(best, tgm->deficit[is_write]);
+        }
+    }
+    if (best == INT64_MIN) {
+        return;
+    }
+
+    assert(best <= 0);
+    credit = (-best / THROTTLE_GROUP_QUANTUM + 1) * THROTTLE_GROUP_QUANTUM;
+    QLIST_FOREACH(tgm, &tg->head, round_robin) {
+        if (tgm_has_pending_reqs(tgm, is_write)) {
+            tgm->deficit[is_write] += credit;
+        } else {
+            tgm->deficit[is_write] = MIN(tgm->deficit[is_write], 0);
+        }
+    }
+}
+
 /* Return the next ThrottleGroupMember in the round-robin sequence with pending
  * I/O requests.
  *
+ * The members take turns in deficit round-robin fashion: the current token
+ * keeps its turn while it has credit left, and every request consumes
+ * credit according to throttle_group_request_cost(). This way members that
+ * send large requests don't get more bandwidth than the others.
+ *
  * This assumes that tg->lock is held.
  *
  * @tgm:       the current ThrottleGroupMember
@@ -222,6 +285,8 @@ static ThrottleGroupMember *next_throttle_token(ThrottleGroupMember *tgm,
     ThrottleState *ts = tgm->throttle_state;
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
     ThrottleGroupMember *token, *start;
+    bool any_pending = false;
+    int pass;
 
     /* If this member has its I/O limits disabled then it means that
      * it's being drained. Skip the round-robin search and return tgm
@@ -234,10 +299,28 @@ static ThrottleGroupMember *next_throttle_token(ThrottleGroupMember *tgm,
 
     start = token = tg->tokens[is_write];
 
-    /* get next bs round in round robin style */
-    token = throttle_group_next_tgm(token);
-    while (token != start && !tgm_has_pending_reqs(token, is_write)) {
-        token = throttle_group_next_tgm(token);
+    if (tgm_has_pending_reqs(start, is_write) && start->deficit[is_write] > 0) {
+        return start;
+    }
+
+    /* get next bs round in round robin style, skipping the members that
+     * have used up their credit; if that is all of them, start a new round */
+    for (pass = 0; pass < 2; pass++) {
+        token = start;
+        do {
+            token = throttle_group_next_tgm(token);
+            if (tgm_has_pending_reqs(token, is_write)) {
+                any_pending = true;
+                if (token->deficit[is_write] > 0) {
+                    return token;
+                }
+            }
+        } while (token != start);
+
+        if (!any_pending) {
+            break;
+        }
+        throttle_group_replenish(tg, is_write);
     }
 
     /* If no IO are queued for scheduling on the next round robin token
@@ -384,6 +467,8 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
 
     /* The I/O will be executed, so do the accounting */
     throttle_account(tgm->throttle_state, is_write, bytes);
+    tgm->deficit[is_write] -= throttle_group_request_cost(tgm->throttle_state,
+                                                          is_write, bytes);
 
     /* Schedule the next request */
     schedule_next_request(tgm, is_write);
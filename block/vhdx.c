@@ -1237,6 +1237,78 @@ exit:
     return ret;
 }
 
+static int coroutine_fn vhdx_co_block_status(BlockDriverState *bs,
+                                             bool want_zero,
+                                             int64_t offset, int64_t bytes,
+                                             int64_t *pnum, int64_t *map,
+                                             BlockDriverState **file)
+{
+    BDRVVHDXState *s = bs->opaque;
+    int64_t sector_num = offset >> BDRV_SECTOR_BITS;
+    int64_t nb_sectors = bytes >> BDRV_SECTOR_BITS;
+    uint64_t next_file_offset = 0;
+    VHDXSectorInfo sinfo;
+    int ret = 0, block_ret;
+
+    /* The sector bitmaps of differencing files are not supported yet */
+    if (s->params.data_bits & VHDX_PARAMS_HAS_PARENT) {
+        return -ENOTSUP;
+    }
+
+    *pnum = 0;
+    qemu_co_mutex_lock(&s->lock);
+
+    /* The whole BAT is in memory, so merge as many blocks as possible */
+    while (nb_sectors > 0) {
+        vhdx_block_translate(s, sector_num, MIN(nb_sectors, INT_MAX), &sinfo);
+
+        switch (s->bat[sinfo.bat_idx] & VHDX_BAT_STATE_BIT_MASK) {
+        case PAYLOAD_BLOCK_NOT_PRESENT:
+            block_ret = 0;
+            break;
+        case PAYLOAD_BLOCK_UNDEFINED:
+        case PAYLOAD_BLOCK_UNMAPPED:
+        case PAYLOAD_BLOCK_UNMAPPED_v095:
+        case PAYLOAD_BLOCK_ZERO:
+            block_ret = BDRV_BLOCK_ZERO;
+            break;
+        case PAYLOAD_BLOCK_FULLY_PRESENT:
+            block_ret = BDRV_BLOCK_DATA | BDRV_BLOCK_OFFSET_VALID;
+            break;
+        case PAYLOAD_BLOCK_PARTIALLY_PRESENT:
+        default:
+            block_ret = -EIO;
+            break;
+        }
+
+        if (*pnum == 0) {
+            if (block_ret < 0) {
+                ret = block_ret;
+                goto exit;
+            }
+            ret = block_ret;
+            if (ret & BDRV_BLOCK_OFFSET_VALID) {
+                *map = sinfo.file_offset;
+                *file = bs->file->bs;
+            }
+        } else if (block_ret != ret ||
+                   ((ret & BDRV_BLOCK_OFFSET_VALID) &&
+                    sinfo.file_offset != next_file_offset)) {
+            break;
+        }
+
+        *pnum += sinfo.sectors_avail * BDRV_SECTOR_SIZE;
+        next_file_offset = sinfo.file_offset +
+                           sinfo.sectors_avail * BDRV_SECTOR_SIZE;
+        nb_sectors -= sinfo.sectors_avail;
+        sector_num += sinfo.sectors_avail;
+    }
+
+exit:
+    qemu_co_mutex_unlock(&s->lock);
+    return ret;
+}
+
 /*
  * Allocate a new payload block at the end of the file.
  *
@@ -2248,6 +2320,7 @@ static BlockDriver bdrv_vhdx = {
     .bdrv_child_perm        = bdrv_default_perms,
     .bdrv_co_readv          = vhdx_co_readv,
     .bdrv_co_writev         = vhdx_co_writev,
+    .bdrv_co_block_status   = vhdx_co_block_status,
     .bdrv_co_create         = vhdx_co_create,
     .bdrv_co_create_opts    = vhdx_co_create_opts,
     .bdrv_get_info          = vhdx_get_info,
@@ -129,7 +129,7 @@ typedef struct VMDKSESparseVolatileHeader {
     uint8_t pad[480];
 } QEMU_PACKED VMDKSESparseVolatileHeader;
 
-#define L2_CACHE_SIZE 16
+#define L2_CACHE_SIZE 64
 
 typedef struct VmdkExtent {
     BdrvChild *file;
@@ -1702,20 +1702,41 @@ static int coroutine_fn vmdk_co_block_status(BlockDriverState *bs,
                                              BlockDriverState **file)
 {
     BDRVVmdkState *s = bs->opaque;
-    int64_t index_in_cluster, n, ret;
-    uint64_t cluster_offset;
+    int64_t index_in_cluster, n, ret, end;
+    uint64_t cluster_offset, next_cluster_offset;
     VmdkExtent *extent;
 
     extent = find_extent(s, offset >> BDRV_SECTOR_BITS, NULL);
     if (!extent) {
         return -EIO;
     }
+    index_in_cluster = vmdk_find_offset_in_cluster(extent, offset);
+    n = extent->cluster_sectors * BDRV_SECTOR_SIZE - index_in_cluster;
+    end = MIN(offset + bytes, extent->end_sector * BDRV_SECTOR_SIZE);
+
     qemu_co_mutex_lock(&s->lock);
     ret = get_cluster_offset(bs, extent, NULL, offset, false, &cluster_offset,
                              0, 0);
+
+    /*
+     * Extend the result over the following grains as long as they have the
+     * same status, and for allocated grains, as long as they are contiguous
+     * in the file.  This saves callers like qemu-img convert one call per
+     * grain.
+     */
+    while (ret != VMDK_ERROR && !extent->flat && offset + n < end) {
+        if (get_cluster_offset(bs, extent, NULL, offset + n, false,
+                               &next_cluster_offset, 0, 0) != ret) {
+            break;
+        }
+        if (ret == VMDK_OK && !extent->compressed &&
+            next_cluster_offset != cluster_offset + index_in_cluster + n) {
+            break;
+        }
+        n += extent->cluster_sectors * BDRV_SECTOR_SIZE;
+    }
     qemu_co_mutex_unlock(&s->lock);
 
-    index_in_cluster = vmdk_find_offset_in_cluster(extent, offset);
     switch (ret) {
     case VMDK_ERROR:
         ret = -EIO;
@@ -1739,7 +1760,6 @@ static int coroutine_fn vmdk_co_block_status(BlockDriverState *bs,
         break;
     }
 
-    n = extent->cluster_sectors * BDRV_SECTOR_SIZE - index_in_cluster;
     *pnum = MIN(n, bytes);
     return ret;
 }
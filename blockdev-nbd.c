@@ -18,6 +18,7 @@
 #include "block/nbd.h"
 #include "io/channel-socket.h"
 #include "io/net-listener.h"
+#include "sysemu/iothread.h"
 
 typedef struct NBDServerData {
     QIONetListener *listener;
@@ -189,6 +190,27 @@ void qmp_nbd_server_add(BlockExportNbd *arg, Error **errp)
 
     aio_context = bdrv_get_aio_context(bs);
     aio_context_acquire(aio_context);
+
+    if (arg->has_iothread) {
+        IOThread *iothread = iothread_by_id(arg->iothread);
+        AioContext *new_context;
+        int ret;
+
+        if (!iothread) {
+            error_setg(errp, "Cannot find iothread %s", arg->iothread);
+            goto out;
+        }
+
+        new_context = iothread_get_aio_context(iothread);
+        ret = bdrv_try_set_aio_context(bs, new_context, errp);
+        if (ret < 0) {
+            goto out;
+        }
+        aio_context_release(aio_context);
+        aio_context = new_context;
+        aio_context_acquire(aio_context);
+    }
+
     len = bdrv_getlength(bs);
     if (len < 0) {
         error_setg_errno(errp, -len,
@@ -0,0 +1,608 @@
+/*
+ * Loopback remote-port peer
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * A minimal peer for QEMU's remote-port adaptor, standing in for a
+ * SystemC/libsystemctlm-soc model.  It listens on the socket that QEMU
+ * connects to and answers bus accesses from a small loopback memory,
+ * acknowledges interrupts and responds to syncs.
+ *
+ * With -b it also acts as a bus master: it issues a fixed number of
+ * reads or writes to a remote-port-memory-slave in QEMU, optionally
+ * interleaved with syncs, and prints the transaction rate, the round
+ * trip latencies and the sync overhead as one JSON object.
+ * scripts/remote-port-bench.py runs it for each transport and quantum.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-types-sockets.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/sockets.h"
+#include "qemu/timer.h"
+#include <sys/mman.h>
+
+#include "hw/remote-port-proto.h"
+#include "hw/remote-port-shm.h"
+
+#define RP_PEER_DEFAULT_RAM_SIZE  (64 * 1024)
+#define RP_PEER_DEFAULT_COUNT     100000
+
+typedef struct RPPeerArgs {
+    const char *listen;
+    bool shm;
+    const char *shm_path;
+    uint64_t ram_size;
+
+    /* Benchmark mode */
+    bool bench;
+    bool write;
+    uint32_t dev;
+    uint64_t addr;
+    uint32_t size;
+    uint64_t count;
+    uint64_t sync_every;
+} RPPeerArgs;
+
+typedef struct RPPeerStats {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t interrupts;
+    uint64_t syncs;
+    /* Time spent answering syncs from QEMU */
+    uint64_t sync_ns;
+    /* Sum of the deltas between the timestamps of consecutive syncs */
+    uint64_t sync_interval_ns;
+    int64_t last_sync_ts;
+} RPPeerStats;
+
+typedef struct RPPeer {
+    RPPeerArgs *args;
+    int fd;
+    struct rp_peer_state peer;
+    RemotePortDynPkt rx;
+    RemotePortDynPkt tx;
+    uint32_t next_id;
+    int64_t clk_base;
+
+    RemotePortShm shm;
+    bool shm_tx;
+    bool shm_rx;
+
+    uint8_t *ram;
+    RPPeerStats stats;
+} RPPeer;
+
+static int64_t rp_peer_clk(RPPeer *p)
+{
+    return get_clock() - p->clk_base;
+}
+
+static void rp_peer_recv(RPPeer *p, void *buf, size_t count)
+{
+    uint8_t *u8 = buf;
+    ssize_t r;
+
+    while (count) {
+        if (p->shm_rx) {
+            r = rp_shm_read(p->shm.rx, u8, count, NULL);
+        } else {
+            r = read(p->fd, u8, count);
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+        }
+        if (r < 0) {
+            error_report("remote-port-peer: read failed: %s", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (r == 0) {
+            /* QEMU went away; expected in peer mode */
+            if (p->args->bench) {
+                error_report("remote-port-peer: connection closed early");
+                exit(EXIT_FAILURE);
+            }
+            exit(EXIT_SUCCESS);
+        }
+        u8 += r;
+        count -= r;
+    }
+}
+
+static void rp_peer_send(RPPeer *p, const void *buf, size_t count)
+{
+    const uint8_t *u8 = buf;
+    ssize_t r;
+
+    if (!p->shm_tx) {
+        if (qemu_write_full(p->fd, buf, count) != count) {
+            error_report("remote-port-peer: write failed: %s",
+                         strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+
+    while (count) {
+        r = rp_shm_write(p->shm.tx, u8, count, NULL);
+        if (r <= 0) {
+            error_report("remote-port-peer: shm ring closed");
+            exit(EXIT_FAILURE);
+        }
+        u8 += r;
+        count -= r;
+    }
+}
+
+/* Receives one packet into p->rx and decodes it */
+static struct rp_pkt *rp_peer_read_pkt(RPPeer *p)
+{
+    struct rp_pkt *pkt;
+
+    rp_dpkt_alloc(&p->rx, sizeof(struct rp_pkt));
+    pkt = p->rx.pkt;
+    rp_peer_recv(p, &pkt->hdr, sizeof pkt->hdr);
+    rp_decode_hdr(pkt);
+
+    if (pkt->hdr.len) {
+        rp_dpkt_alloc(&p->rx, sizeof pkt->hdr + pkt->hdr.len);
+        /* pkt may move due to realloc. */
+        pkt = p->rx.pkt;
+        rp_peer_recv(p, &pkt->hdr + 1, pkt->hdr.len);
+        rp_decode_payload(pkt);
+    }
+    return pkt;
+}
+
+static void rp_peer_say_hello(RPPeer *p)
+{
+    struct rp_pkt_hello pkt;
+    uint32_t caps[] = {
+        CAP_BUSACCESS_EXT_BASE,
+        CAP_WIRE_POSTED_UPDATES,
+        CAP_BUSACCESS_POSTED_WRITES,
+        CAP_SHM_RING,
+    };
+    unsigned int nr_caps = ARRAY_SIZE(caps) - !p->args->shm;
+    size_t len;
+
+    len = rp_encode_hello_caps(p->next_id++, 0, &pkt, RP_VERSION_MAJOR,
+                               RP_VERSION_MINOR, caps, caps, nr_caps);
+    rp_peer_send(p, &pkt, len);
+    rp_peer_send(p, caps, nr_caps * sizeof caps[0]);
+}
+
+/*
+ * Maps the rings that QEMU created.  Unlike rp_shm_create(), this
+ * neither creates nor initializes the file.
+ */
+static void rp_peer_shm_open(RPPeer *p)
+{
+    RemotePortShm *shm = &p->shm;
+    struct stat st;
+    int fd;
+
+    fd = open(p->args->shm_path, O_RDWR);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        error_report("remote-port-peer: cannot open %s: %s",
+                     p->args->shm_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    shm->map_size = st.st_size;
+    shm->map = mmap(NULL, shm->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    fd, 0);
+    close(fd);
+    if (shm->map == MAP_FAILED) {
+        error_report("remote-port-peer: cannot map %s: %s",
+                     p->args->shm_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    shm->hdr = shm->map;
+    if (shm->hdr->magic != RP_SHM_MAGIC ||
+        shm->hdr->version != RP_SHM_VERSION) {
+        error_report("remote-port-peer: %s is not a remote-port shm file",
+                     p->args->shm_path);
+        exit(EXIT_FAILURE);
+    }
+    /* Seen from the peer, tx is the ring towards the creator */
+    shm->tx = (void *)((uint8_t *)shm->map +
+                       shm->hdr->ring_offset[RP_SHM_RING_FROM_PEER]);
+    shm->rx = (void *)((uint8_t *)shm->map +
+                       shm->hdr->ring_offset[RP_SHM_RING_TO_PEER]);
+}
+
+static void rp_peer_cmd_hello(RPPeer *p, struct rp_pkt *pkt)
+{
+    if (pkt->hello.version.major != RP_VERSION_MAJOR) {
+        error_report("remote-port-peer: version mismatch remote=%d.%d "
+                     "local=%d.%d", pkt->hello.version.major,
+                     pkt->hello.version.minor, RP_VERSION_MAJOR,
+                     RP_VERSION_MINOR);
+        exit(EXIT_FAILURE);
+    }
+    p->peer.version = pkt->hello.version;
+    if (pkt->hello.caps.len) {
+        rp_process_caps(&p->peer, (char *)pkt + pkt->hello.caps.offset,
+                        pkt->hello.caps.len);
+    }
+
+    if (p->args->shm && p->peer.caps.shm_ring) {
+        struct rp_pkt_hdr nop;
+
+        rp_peer_shm_open(p);
+        /* Our last packet on the socket, the rest goes to the ring */
+        rp_encode_hdr(&nop, RP_CMD_nop, p->next_id++, 0, 0, 0);
+        rp_peer_send(p, &nop, sizeof nop);
+        p->shm_tx = true;
+    }
+}
+
+static void rp_peer_ram_access(RPPeer *p, uint64_t addr, uint8_t *data,
+                               uint32_t len, bool write)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        uint8_t *b = &p->ram[(addr + i) % p->args->ram_size];
+
+        if (write) {
+            *b = data[i];
+        } else {
+            data[i] = *b;
+        }
+    }
+}
+
+static void rp_peer_cmd_busaccess(RPPeer *p, struct rp_pkt *pkt)
+{
+    struct rp_pkt_busaccess_ext_base *ba = &pkt->busaccess_ext_base;
+    bool write = pkt->hdr.cmd == RP_CMD_write;
+    struct rp_encode_busaccess_in in;
+    size_t len;
+
+    if (write) {
+        p->stats.writes++;
+        rp_peer_ram_access(p, ba->addr, rp_busaccess_rx_dataptr(&p->peer, ba),
+                           ba->len, true);
+        if (pkt->hdr.flags & RP_PKT_FLAGS_posted) {
+            return;
+        }
+    } else {
+        p->stats.reads++;
+    }
+
+    rp_encode_busaccess_in_rsp_init(&in, pkt);
+    in.clk = ba->timestamp;
+    rp_dpkt_alloc(&p->tx, sizeof *ba + ba->len);
+    len = rp_encode_busaccess(&p->peer, &p->tx.pkt->busaccess_ext_base, &in);
+    if (!write) {
+        rp_peer_ram_access(p, ba->addr,
+                           rp_busaccess_tx_dataptr(&p->peer,
+                                                &p->tx.pkt->busaccess_ext_base),
+                           ba->len, false);
+    }
+    rp_peer_send(p, p->tx.pkt, len);
+}
+
+static void rp_peer_cmd_interrupt(RPPeer *p, struct rp_pkt *pkt)
+{
+    struct rp_pkt_interrupt rsp;
+    size_t len;
+
+    p->stats.interrupts++;
+    if (!p->peer.caps.wire_posted_updates ||
+        (pkt->hdr.flags & RP_PKT_FLAGS_posted)) {
+        return;
+    }
+    len = rp_encode_interrupt_f(pkt->hdr.id, pkt->hdr.dev, &rsp,
+                                pkt->interrupt.timestamp,
+                                pkt->interrupt.line, pkt->interrupt.vector,
+                                pkt->interrupt.val,
+                                pkt->hdr.flags | RP_PKT_FLAGS_response);
+    rp_peer_send(p, &rsp, len);
+}
+
+static void rp_peer_cmd_sync(RPPeer *p, struct rp_pkt *pkt)
+{
+    int64_t start = get_clock();
+    struct rp_pkt_sync rsp;
+    size_t len;
+
+    if (p->stats.syncs) {
+        p->stats.sync_interval_ns += pkt->sync.timestamp -
+                                     p->stats.last_sync_ts;
+    }
+    p->stats.last_sync_ts = pkt->sync.timestamp;
+    p->stats.syncs++;
+
+    /* We have no notion of time of our own, so we are never behind */
+    len = rp_encode_sync_resp(pkt->hdr.id, pkt->hdr.dev, &rsp,
+                              pkt->sync.timestamp);
+    rp_peer_send(p, &rsp, len);
+    p->stats.sync_ns += get_clock() - start;
+}
+
+/* Handles a packet that is not a response to one of ours */
+static void rp_peer_process_pkt(RPPeer *p, struct rp_pkt *pkt)
+{
+    switch (pkt->hdr.cmd) {
+    case RP_CMD_nop:
+        if (p->shm_tx) {
+            /* QEMU has moved its transmissions to the ring */
+            p->shm_rx = true;
+        }
+        break;
+    case RP_CMD_hello:
+        rp_peer_cmd_hello(p, pkt);
+        break;
+    case RP_CMD_read:
+    case RP_CMD_write:
+        rp_peer_cmd_busaccess(p, pkt);
+        break;
+    case RP_CMD_interrupt:
+        rp_peer_cmd_interrupt(p, pkt);
+        break;
+    case RP_CMD_sync:
+        rp_peer_cmd_sync(p, pkt);
+        break;
+    default:
+        error_report("remote-port-peer: unexpected %s packet",
+                     rp_cmd_to_string(pkt->hdr.cmd));
+        break;
+    }
+}
+
+/* Serves QEMU until the response to our packet @id arrives */
+static void rp_peer_wait_rsp(RPPeer *p, uint32_t id)
+{
+    struct rp_pkt *pkt;
+
+    for (;;) {
+        pkt = rp_peer_read_pkt(p);
+        if (!(pkt->hdr.flags & RP_PKT_FLAGS_response)) {
+            rp_peer_process_pkt(p, pkt);
+        } else if (pkt->hdr.id == id) {
+            return;
+        }
+    }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void rp_peer_bench(RPPeer *p)
+{
+    RPPeerArgs *args = p->args;
+    struct rp_encode_busaccess_in in = {
+        .cmd = args->write ? RP_CMD_write : RP_CMD_read,
+        .dev = args->dev,
+        .addr = args->addr,
+        .size = args->size,
+        .width = args->size,
+        .stream_width = args->size,
+    };
+    g_autofree uint64_t *lat = g_new(uint64_t, args->count);
+    uint64_t sync_rtt = 0, nr_syncs = 0, total = 0;
+    int64_t start, t;
+    uint64_t i;
+    size_t len;
+
+    rp_dpkt_alloc(&p->tx, sizeof(struct rp_pkt_busaccess_ext_base) +
+                          args->size);
+    if (args->write) {
+        memset(rp_busaccess_tx_dataptr(&p->peer,
+                                       &p->tx.pkt->busaccess_ext_base),
+               0x5a, args->size);
+    }
+
+    start = get_clock();
+    for (i = 0; i < args->count; i++) {
+        in.id = p->next_id++;
+        in.clk = rp_peer_clk(p);
+        len = rp_encode_busaccess(&p->peer, &p->tx.pkt->busaccess_ext_base,
+                                  &in);
+        t = get_clock();
+        rp_peer_send(p, p->tx.pkt, len);
+        rp_peer_wait_rsp(p, in.id);
+        lat[i] = get_clock() - t;
+        total += lat[i];
+
+        if (args->sync_every && (i + 1) % args->sync_every == 0) {
+            struct rp_pkt_sync sync;
+            uint32_t id = p->next_id++;
+
+            t = get_clock();
+            len = rp_encode_sync(id, 0, &sync, rp_peer_clk(p));
+            rp_peer_send(p, &sync, len);
+            rp_peer_wait_rsp(p, id);
+            sync_rtt += get_clock() - t;
+            nr_syncs++;
+        }
+    }
+    t = get_clock() - start;
+
+    qsort(lat, args->count, sizeof lat[0], cmp_u64);
+    printf("{ \"transport\": \"%s\", \"op\": \"%s\", \"size\": %u, "
+           "\"transactions\": %" PRIu64 ", \"seconds\": %.6f, "
+           "\"transactions-per-second\": %.1f, "
+           "\"latency-ns\": { \"min\": %" PRIu64 ", \"avg\": %" PRIu64
+           ", \"p50\": %" PRIu64 ", \"p99\": %" PRIu64 ", \"max\": %" PRIu64
+           " }, "
+           "\"peer-syncs\": %" PRIu64 ", \"peer-sync-rtt-ns\": %" PRIu64 ", "
+           "\"qemu-syncs\": %" PRIu64 ", \"qemu-sync-ns\": %" PRIu64 ", "
+           "\"qemu-sync-interval-ns\": %" PRIu64 " }\n",
+           p->shm_tx ? "shm" : "socket", args->write ? "write" : "read",
+           args->size, args->count, t / 1e9,
+           t > 0 ? args->count * 1e9 / t : 0.0,
+           lat[0], total / args->count, lat[args->count / 2],
+           lat[args->count * 99 / 100], lat[args->count - 1],
+           nr_syncs, nr_syncs ? sync_rtt / nr_syncs : 0,
+           p->stats.syncs, p->stats.sync_ns,
+           p->stats.syncs > 1 ?
+               p->stats.sync_interval_ns / (p->stats.syncs - 1) : 0);
+    fflush(stdout);
+}
+
+static void rp_peer_usage(const char *progname)
+{
+    printf("Usage: %s [OPTION]... ADDRESS\n"
+           "Serve a QEMU remote-port adaptor on ADDRESS, which is\n"
+           "unix:PATH (QEMU's -machine-path DIR/qemu-rport-NAME) or\n"
+           "tcp:HOST:PORT\n"
+           "  -h: show this help\n"
+           "  -S <path>: switch to the shared-memory rings in <path>\n"
+           "     (QEMU's remote-port shm=on)\n"
+           "  -m <size>: size of the loopback memory, default %u\n"
+           "benchmark mode:\n"
+           "  -b: send bus accesses to QEMU and report their speed\n"
+           "  -d <dev>: remote-port device number of the memory slave\n"
+           "  -a <addr>: address to access, default 0\n"
+           "  -s <size>: bytes per access, default 4\n"
+           "  -n <count>: number of accesses, default %u\n"
+           "  -w: write instead of reading\n"
+           "  -y <n>: send a sync after every <n> accesses\n",
+           progname, RP_PEER_DEFAULT_RAM_SIZE, RP_PEER_DEFAULT_COUNT);
+}
+
+static void rp_peer_parse_args(RPPeerArgs *args, int argc, char **argv)
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "hS:m:bd:a:s:n:wy:")) != -1) {
+        switch (c) {
+        case 'S':
+            args->shm = true;
+            args->shm_path = optarg;
+            break;
+        case 'm':
+            if (qemu_strtosz(optarg, NULL, &args->ram_size) < 0 ||
+                !args->ram_size) {
+                goto err;
+            }
+            break;
+        case 'b':
+            args->bench = true;
+            break;
+        case 'd':
+            if (qemu_strtoui(optarg, NULL, 0, &args->dev) < 0) {
+                goto err;
+            }
+            break;
+        case 'a':
+            if (qemu_strtou64(optarg, NULL, 0, &args->addr) < 0) {
+                goto err;
+            }
+            break;
+        case 's':
+            if (qemu_strtoui(optarg, NULL, 0, &args->size) < 0 ||
+                !args->size || args->size > 4096) {
+                goto err;
+            }
+            break;
+        case 'n':
+            if (qemu_strtou64(optarg, NULL, 0, &args->count) < 0 ||
+                !args->count) {
+                goto err;
+            }
+            break;
+        case 'w':
+            args->write = true;
+            break;
+        case 'y':
+            if (qemu_strtou64(optarg, NULL, 0, &args->sync_every) < 0) {
+                goto err;
+            }
+            break;
+        case 'h':
+            rp_peer_usage(argv[0]);
+            exit(EXIT_SUCCESS);
+        default:
+            goto err;
+        }
+    }
+    if (optind + 1 != argc) {
+        goto err;
+    }
+    args->listen = argv[optind];
+    return;
+
+err:
+    rp_peer_usage(argv[0]);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    RPPeerArgs args = {
+        .ram_size = RP_PEER_DEFAULT_RAM_SIZE,
+        .size = 4,
+        .count = RP_PEER_DEFAULT_COUNT,
+    };
+    RPPeer p = { .args = &args };
+    SocketAddress *addr;
+    Error *err = NULL;
+    int lfd;
+
+    rp_peer_parse_args(&args, argc, argv);
+    signal(SIGPIPE, SIG_IGN);
+
+    addr = socket_parse(args.listen, &err);
+    if (!addr) {
+        error_report_err(err);
+        return EXIT_FAILURE;
+    }
+    if (addr->type == SOCKET_ADDRESS_TYPE_UNIX) {
+        unlink(addr->u.q_unix.path);
+    }
+    lfd = socket_listen(addr, 1, &err);
+    if (lfd < 0) {
+        error_report_err(err);
+        return EXIT_FAILURE;
+    }
+
+    p.fd = qemu_accept(lfd, NULL, NULL);
+    if (p.fd < 0) {
+        error_report("remote-port-peer: accept failed: %s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (addr->type == SOCKET_ADDRESS_TYPE_INET) {
+        socket_set_nodelay(p.fd);
+    }
+    close(lfd);
+    if (addr->type == SOCKET_ADDRESS_TYPE_UNIX) {
+        unlink(addr->u.q_unix.path);
+    }
+    qapi_free_SocketAddress(addr);
+
+    p.ram = g_malloc0(args.ram_size);
+    p.clk_base = get_clock();
+    rp_peer_say_hello(&p);
+
+    if (args.bench) {
+        /* Wait for QEMU's hello, and its nop if it moves to the rings */
+        while (!p.peer.version.major ||
+               (p.shm_tx && !p.shm_rx)) {
+            rp_peer_process_pkt(&p, rp_peer_read_pkt(&p));
+        }
+        rp_peer_bench(&p);
+        return EXIT_SUCCESS;
+    }
+
+    for (;;) {
+        struct rp_pkt *pkt = rp_peer_read_pkt(&p);
+
+        if (!(pkt->hdr.flags & RP_PKT_FLAGS_response)) {
+            rp_peer_process_pkt(&p, pkt);
+        }
+    }
+}
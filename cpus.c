@@ -54,6 +54,7 @@
 #include "qemu/bitmap.h"
 #include "qemu/seqlock.h"
 #include "qemu/guest-random.h"
+#include "qemu/thread-placement.h"
 #include "tcg/tcg.h"
 #include "hw/nmi.h"
 #include "sysemu/replay.h"
@@ -907,6 +908,11 @@ static void qemu_cpu_kick_rr_cpus(void)
     };
 }
 
+static void rr_force_rcu(Notifier *notify, void *data)
+{
+    qemu_cpu_kick_rr_next_cpu();
+}
+
 static void do_nothing(CPUState *cpu, run_on_cpu_data unused)
 {
 }
@@ -1141,6 +1147,7 @@ void qemu_init_cpu_loop(void)
     qemu_cond_init(&qemu_cpu_cond);
     qemu_cond_init(&qemu_pause_cond);
     qemu_mutex_init(&qemu_global_mutex);
+    qemu_mutex_set_profile_class(&qemu_global_mutex, "BQL");
 
     qemu_thread_get_self(&io_thread);
 }
@@ -1198,9 +1205,72 @@ static void qemu_tcg_rr_wait_io_event(void)
     }
 }
 
+/* Initial window of userspace halt polling, as in KVM */
+#define HALT_POLL_NS_START 10000
+
+/* A lockless hint that cpu_thread_is_idle() may have become false */
+static bool cpu_halt_poll_woken(CPUState *cpu)
+{
+    return atomic_read(&cpu->stop) || atomic_read(&cpu->queued_work_first) ||
+           !atomic_read(&cpu->halted) || atomic_read(&cpu->interrupt_request);
+}
+
+/*
+ * Spin for up to cpu->halt_poll_ns before sleeping on halt_cond, since
+ * waking a thread from a condition variable adds tens of microseconds to
+ * the interrupt latency of the guest.  Returns true if the CPU stopped
+ * being idle while polling.
+ */
+static bool qemu_halt_poll(CPUState *cpu, int64_t start)
+{
+    bool woken = false;
+
+    qemu_mutex_unlock_iothread();
+    while (get_clock() - start < cpu->halt_poll_ns) {
+        if (cpu_halt_poll_woken(cpu)) {
+            woken = true;
+            break;
+        }
+        cpu_relax();
+    }
+    qemu_mutex_lock_iothread();
+
+    return woken && !cpu_thread_is_idle(cpu);
+}
+
+/*
+ * Adapt the window like the in-kernel governor: grow it when the halt was
+ * short enough to have been caught by a longer one, drop it to half when
+ * the vCPU stayed idle for longer than polling could ever cover.
+ */
+static void qemu_halt_poll_adjust(CPUState *cpu, int64_t idle_ns)
+{
+    uint32_t ns = cpu->halt_poll_ns;
+
+    if (idle_ns <= ns) {
+        return;
+    }
+    if (idle_ns <= cpu->halt_poll_max_ns) {
+        ns = ns ? MIN(ns * 2, cpu->halt_poll_max_ns) : HALT_POLL_NS_START;
+    } else {
+        ns /= 2;
+    }
+    cpu->halt_poll_ns = ns;
+}
+
 static void qemu_wait_io_event(CPUState *cpu)
 {
     bool slept = false;
+    int64_t start = 0;
+
+    if (cpu->halt_poll_max_ns && cpu_thread_is_idle(cpu) &&
+        !cpu_is_stopped(cpu)) {
+        start = get_clock();
+        if (cpu->halt_poll_ns && qemu_halt_poll(cpu, start)) {
+            cpu->halt_poll_hits++;
+            start = 0;
+        }
+    }
 
     while (cpu_thread_is_idle(cpu)) {
         if (!slept) {
@@ -1212,6 +1282,10 @@ static void qemu_wait_io_event(CPUState *cpu)
     if (slept) {
         qemu_plugin_vcpu_resume_cb(cpu);
     }
+    if (start) {
+        cpu->halt_poll_misses++;
+        qemu_halt_poll_adjust(cpu, get_clock() - start);
+    }
 
 #ifdef _WIN32
     /* Eat dummy APC queued by qemu_cpu_kick_thread.  */
@@ -1446,10 +1520,12 @@ static void deal_with_unplugged_cpus(void)
 
 static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
 {
+    Notifier force_rcu = { .notify = rr_force_rcu };
     CPUState *cpu = arg;
 
     assert(tcg_enabled());
     rcu_register_thread();
+    rcu_add_force_rcu_notifier(&force_rcu);
     tcg_register_thread();
 
     qemu_mutex_lock_iothread();
@@ -1554,6 +1630,7 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
         deal_with_unplugged_cpus();
     }
 
+    rcu_remove_force_rcu_notifier(&force_rcu);
     rcu_unregister_thread();
     return NULL;
 }
@@ -1690,14 +1767,30 @@ static void CALLBACK dummy_apc_func(ULONG_PTR unused)
  * current CPUState for a given thread.
  */
 
+typedef struct MttcgForceRcuNotifier {
+    Notifier notifier;
+    CPUState *cpu;
+} MttcgForceRcuNotifier;
+
+static void mttcg_force_rcu(Notifier *notify, void *data)
+{
+    CPUState *cpu = container_of(notify, MttcgForceRcuNotifier, notifier)->cpu;
+
+    cpu_exit(cpu);
+}
+
 static void *qemu_tcg_cpu_thread_fn(void *arg)
 {
+    MttcgForceRcuNotifier force_rcu;
     CPUState *cpu = arg;
 
     assert(tcg_enabled());
     g_assert(!use_icount);
 
     rcu_register_thread();
+    force_rcu.notifier.notify = mttcg_force_rcu;
+    force_rcu.cpu = cpu;
+    rcu_add_force_rcu_notifier(&force_rcu.notifier);
     tcg_register_thread();
 
     qemu_mutex_lock_iothread();
@@ -1754,6 +1847,7 @@ static void *qemu_tcg_cpu_thread_fn(void *arg)
     cpu->created = false;
     qemu_cond_signal(&qemu_cpu_cond);
     qemu_mutex_unlock_iothread();
+    rcu_remove_force_rcu_notifier(&force_rcu.notifier);
     rcu_unregister_thread();
     return NULL;
 }
@@ -1925,6 +2019,8 @@ void cpu_remove_sync(CPUState *cpu)
     cpu->unplug = true;
     qemu_cpu_kick(cpu);
     qemu_mutex_unlock_iothread();
+    thread_placement_del(cpu->thread_placement);
+    cpu->thread_placement = NULL;
     qemu_thread_join(cpu->thread);
     qemu_mutex_lock_iothread();
 }
@@ -1932,6 +2028,14 @@ void cpu_remove_sync(CPUState *cpu)
 /* For temporary buffers for forming a name */
 #define VCPU_THREAD_NAME_SIZE 16
 
+/* Called once per vCPU thread, right after creating it */
+static void qemu_vcpu_thread_place(CPUState *cpu)
+{
+    cpu->thread_placement = thread_placement_add(cpu->thread,
+                                                 THREAD_PLACEMENT_VCPU,
+                                                 cpu->cpu_index);
+}
+
 static void qemu_tcg_init_vcpu(CPUState *cpu)
 {
     char thread_name[VCPU_THREAD_NAME_SIZE];
@@ -1964,6 +2068,7 @@ static void qemu_tcg_init_vcpu(CPUState *cpu)
 
             qemu_thread_create(cpu->thread, thread_name, qemu_tcg_cpu_thread_fn,
                                cpu, QEMU_THREAD_JOINABLE);
+            qemu_vcpu_thread_place(cpu);
 
         } else {
             /* share a single thread for all cpus with TCG */
@@ -1971,6 +2076,7 @@ static void qemu_tcg_init_vcpu(CPUState *cpu)
             qemu_thread_create(cpu->thread, thread_name,
                                qemu_tcg_rr_cpu_thread_fn,
                                cpu, QEMU_THREAD_JOINABLE);
+            qemu_vcpu_thread_place(cpu);
 
             single_tcg_halt_cond = cpu->halt_cond;
             single_tcg_cpu_thread = cpu->thread;
@@ -2000,6 +2106,7 @@ static void qemu_hax_start_vcpu(CPUState *cpu)
              cpu->cpu_index);
     qemu_thread_create(cpu->thread, thread_name, qemu_hax_cpu_thread_fn,
                        cpu, QEMU_THREAD_JOINABLE);
+    qemu_vcpu_thread_place(cpu);
 #ifdef _WIN32
     cpu->hThread = qemu_thread_get_handle(cpu->thread);
 #endif
@@ -2016,6 +2123,7 @@ static void qemu_kvm_start_vcpu(CPUState *cpu)
              cpu->cpu_index);
     qemu_thread_create(cpu->thread, thread_name, qemu_kvm_cpu_thread_fn,
                        cpu, QEMU_THREAD_JOINABLE);
+    qemu_vcpu_thread_place(cpu);
 }
 
 static void qemu_hvf_start_vcpu(CPUState *cpu)
@@ -2034,6 +2142,7 @@ static void qemu_hvf_start_vcpu(CPUState *cpu)
              cpu->cpu_index);
     qemu_thread_create(cpu->thread, thread_name, qemu_hvf_cpu_thread_fn,
                        cpu, QEMU_THREAD_JOINABLE);
+    qemu_vcpu_thread_place(cpu);
 }
 
 static void qemu_whpx_start_vcpu(CPUState *cpu)
@@ -2047,6 +2156,7 @@ static void qemu_whpx_start_vcpu(CPUState *cpu)
              cpu->cpu_index);
     qemu_thread_create(cpu->thread, thread_name, qemu_whpx_cpu_thread_fn,
                        cpu, QEMU_THREAD_JOINABLE);
+    qemu_vcpu_thread_place(cpu);
 #ifdef _WIN32
     cpu->hThread = qemu_thread_get_handle(cpu->thread);
 #endif
@@ -2063,6 +2173,7 @@ static void qemu_dummy_start_vcpu(CPUState *cpu)
              cpu->cpu_index);
     qemu_thread_create(cpu->thread, thread_name, qemu_dummy_cpu_thread_fn, cpu,
                        QEMU_THREAD_JOINABLE);
+    qemu_vcpu_thread_place(cpu);
 }
 
 void qemu_init_vcpu(CPUState *cpu)
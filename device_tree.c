@@ -227,11 +227,136 @@ void *load_device_tree_from_sysfs(void)
 
 #endif /* CONFIG_LINUX */
 
+/*
+ * Index of the nodes of the last device tree looked up, by path and by
+ * phandle.  The FDT-generic code looks nodes up by path over and over,
+ * and fdt_path_offset() walks the tree from the root every time.
+ *
+ * The index is only trusted while the size of the structure block is
+ * unchanged, since libfdt moves the nodes around whenever it grows or
+ * shrinks, and each hit is checked against the name of the node found.
+ * It is rebuilt on the second lookup after a change, so that a tree
+ * being built node by node does not get rebuilt on every lookup.
+ */
+#define FDT_INDEX_MAX_DEPTH 64
+
+static struct {
+    const void *fdt;
+    int size_dt_struct;
+    int pending_size_dt_struct;
+    GHashTable *offsets;        /* path -> offset */
+    GHashTable *paths;          /* phandle -> path */
+} fdt_index;
+
+static void fdt_index_invalidate(void)
+{
+    if (fdt_index.offsets) {
+        g_hash_table_destroy(fdt_index.paths);
+        g_hash_table_destroy(fdt_index.offsets);
+    }
+    fdt_index.offsets = NULL;
+    fdt_index.paths = NULL;
+    fdt_index.fdt = NULL;
+}
+
+static void fdt_index_build(const void *fdt)
+{
+    GString *path = g_string_new("/");
+    size_t ends[FDT_INDEX_MAX_DEPTH];
+    int offset = 0, depth = 0;
+
+    fdt_index_invalidate();
+    fdt_index.fdt = fdt;
+    fdt_index.size_dt_struct = fdt_size_dt_struct(fdt);
+    fdt_index.offsets = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              g_free, NULL);
+    fdt_index.paths = g_hash_table_new(NULL, NULL);
+
+    ends[0] = 0;
+    do {
+        uint32_t phandle;
+        char *key;
+
+        if (depth >= FDT_INDEX_MAX_DEPTH) {
+            /* Deeper nodes are left to fdt_path_offset() */
+            offset = fdt_next_node(fdt, offset, &depth);
+            continue;
+        }
+        if (depth > 0) {
+            g_string_truncate(path, ends[depth - 1]);
+            g_string_append_c(path, '/');
+            g_string_append(path, fdt_get_name(fdt, offset, NULL));
+            ends[depth] = path->len;
+        }
+
+        key = g_strdup(path->str);
+        g_hash_table_insert(fdt_index.offsets, key, GINT_TO_POINTER(offset));
+        phandle = fdt_get_phandle(fdt, offset);
+        if (phandle) {
+            g_hash_table_insert(fdt_index.paths, GUINT_TO_POINTER(phandle),
+                                key);
+        }
+
+        offset = fdt_next_node(fdt, offset, &depth);
+    } while (offset >= 0 && depth > 0);
+
+    g_string_free(path, true);
+}
+
+/* Returns whether the index can be used for @fdt, building it if needed */
+static bool fdt_index_valid(const void *fdt)
+{
+    int size = fdt_size_dt_struct(fdt);
+
+    if (fdt_index.fdt == fdt && fdt_index.size_dt_struct == size) {
+        return true;
+    }
+    if (fdt_index.pending_size_dt_struct != size) {
+        fdt_index.pending_size_dt_struct = size;
+        return false;
+    }
+    fdt_index_build(fdt);
+    return true;
+}
+
+/* Looks @path up in the index, returns -1 if it is not there */
+static int fdt_index_lookup(const void *fdt, const char *path)
+{
+    gpointer value;
+    const char *name, *last;
+    int offset;
+
+    if (path[0] != '/' || !fdt_index_valid(fdt) ||
+        !g_hash_table_lookup_extended(fdt_index.offsets, path, NULL, &value)) {
+        return -1;
+    }
+
+    offset = GPOINTER_TO_INT(value);
+    if (offset == 0) {
+        return 0;
+    }
+    last = strrchr(path, '/') + 1;
+    name = fdt_get_name(fdt, offset, NULL);
+    if (!name || strcmp(name, last)) {
+        /* Changed behind our back by a direct libfdt call */
+        fdt_index_invalidate();
+        return -1;
+    }
+    return offset;
+}
+
+int qemu_fdt_path_offset(void *fdt, const char *path)
+{
+    int offset = fdt_index_lookup(fdt, path);
+
+    return offset >= 0 ? offset : fdt_path_offset(fdt, path);
+}
+
 static int findnode_nofail(void *fdt, const char *node_path)
 {
     int offset;
 
-    offset = fdt_path_offset(fdt, node_path);
+    offset = qemu_fdt_path_offset(fdt, node_path);
     if (offset < 0) {
         error_report("%s Couldn't find node %s: %s", __func__, node_path,
                      fdt_strerror(offset));
@@ -564,6 +689,8 @@ int qemu_fdt_nop_node(void *fdt, const char *node_path)
     int r;
 
     r = fdt_nop_node(fdt, findnode_nofail(fdt, node_path));
+    /* The nodes do not move, but they are gone */
+    fdt_index_invalidate();
     if (r < 0) {
         error_report("%s: Couldn't nop node %s: %s", __func__, node_path,
                      fdt_strerror(r));
@@ -659,19 +786,20 @@ out:
 
 char *qemu_devtree_get_node_name(void *fdt, const char *node_path)
 {
-    const char *ret = fdt_get_name(fdt, fdt_path_offset(fdt, node_path), NULL);
+    const char *ret = fdt_get_name(fdt, qemu_fdt_path_offset(fdt, node_path),
+                                   NULL);
     return ret ? strdup(ret) : NULL;
 }
 
 int qemu_devtree_get_node_depth(void *fdt, const char *node_path)
 {
-    return fdt_node_depth(fdt, fdt_path_offset(fdt, node_path));
+    return fdt_node_depth(fdt, qemu_fdt_path_offset(fdt, node_path));
 }
 
 
 int qemu_devtree_num_props(void *fdt, const char *node_path)
 {
-    int offset = fdt_path_offset(fdt, node_path);
+    int offset = qemu_fdt_path_offset(fdt, node_path);
     int ret = 0;
 
     for (offset = fdt_first_property_offset(fdt, offset);
@@ -698,7 +826,7 @@ QEMUDevtreeProp *qemu_devtree_get_props(void *fdt, const char *node_path)
 {
     QEMUDevtreeProp *ret = g_new0(QEMUDevtreeProp,
                                     qemu_devtree_num_props(fdt, node_path) + 1);
-    int offset = fdt_path_offset(fdt, node_path);
+    int offset = qemu_fdt_path_offset(fdt, node_path);
     int i = 0;
 
     for (offset = fdt_first_property_offset(fdt, offset);
@@ -717,22 +845,45 @@ QEMUDevtreeProp *qemu_devtree_get_props(void *fdt, const char *node_path)
 
 static void qemu_devtree_children_info(void *fdt, const char *node_path,
         int depth, int *num, char **returned_paths) {
-    int offset = fdt_path_offset(fdt, node_path);
-    int root_depth = fdt_node_depth(fdt, offset);
-    int cur_depth = root_depth;
+    int offset = qemu_fdt_path_offset(fdt, node_path);
+    int root_depth = 0;
+    int cur_depth = 0;
+    /*
+     * Depths are relative to node_path.  The paths of the children are
+     * built while walking rather than with fdt_get_path(), which walks
+     * from the root for each of them.
+     */
+    char path[DT_PATH_LENGTH];
+    size_t ends[FDT_INDEX_MAX_DEPTH];
 
     if (num) {
         *num = 0;
     }
+    if (returned_paths) {
+        fdt_get_path(fdt, offset, path, DT_PATH_LENGTH);
+        /* The root is "/", its children are "/name" */
+        ends[0] = strcmp(path, "/") ? strlen(path) : 0;
+    }
     for (;;) {
         offset = fdt_next_node(fdt, offset, &cur_depth);
-        if (cur_depth <= root_depth) {
+        if (offset < 0 || cur_depth <= root_depth) {
             break;
         }
+        if (returned_paths && cur_depth < FDT_INDEX_MAX_DEPTH) {
+            snprintf(path + ends[cur_depth - 1],
+                     DT_PATH_LENGTH - ends[cur_depth - 1], "/%s",
+                     fdt_get_name(fdt, offset, NULL));
+            ends[cur_depth] = MIN(strlen(path), DT_PATH_LENGTH - 1);
+        }
         if (cur_depth <= root_depth + depth || depth == 0) {
             if (returned_paths) {
                 returned_paths[*num] = g_malloc0(DT_PATH_LENGTH);
-                fdt_get_path(fdt, offset, returned_paths[*num], DT_PATH_LENGTH);
+                if (cur_depth < FDT_INDEX_MAX_DEPTH) {
+                    pstrcpy(returned_paths[*num], DT_PATH_LENGTH, path);
+                } else {
+                    fdt_get_path(fdt, offset, returned_paths[*num],
+                                 DT_PATH_LENGTH);
+                }
             }
             if (num) {
                 (*num)++;
@@ -833,7 +984,7 @@ char *qemu_devtree_get_child_by_name(void *fdt, char *parent_path,
     int namelen = strlen(cmpname);
     char child_path[DT_PATH_LENGTH];
 
-    parent_offset = fdt_path_offset(fdt, parent_path);
+    parent_offset = qemu_fdt_path_offset(fdt, parent_path);
 
     if (parent_offset > 0) {
         offset = fdt_subnode_offset_namelen(fdt, parent_offset,
@@ -848,14 +999,37 @@ char *qemu_devtree_get_child_by_name(void *fdt, char *parent_path,
 
 int qemu_devtree_get_node_by_phandle(void *fdt, char *node_path, int phandle)
 {
+    const char *path = NULL;
+
+    if (fdt_index_valid(fdt)) {
+        path = g_hash_table_lookup(fdt_index.paths, GUINT_TO_POINTER(phandle));
+    }
+    if (path && fdt_index_lookup(fdt, path) >= 0 &&
+        strlen(path) < DT_PATH_LENGTH) {
+        strcpy(node_path, path);
+        return 0;
+    }
+
     return fdt_get_path(fdt, fdt_node_offset_by_phandle(fdt, phandle),
                             node_path, DT_PATH_LENGTH);
 }
 
 int qemu_devtree_getparent(void *fdt, char *node_path, const char *current)
 {
-    int offset = fdt_path_offset(fdt, current);
-    int parent_offset = fdt_supernode_atdepth_offset(fdt, offset,
+    int offset = fdt_index_lookup(fdt, current);
+    int parent_offset;
+
+    /* An indexed path is canonical, its parent is its dirname */
+    if (offset > 0 && strlen(current) < DT_PATH_LENGTH) {
+        size_t len = strrchr(current, '/') - current;
+
+        memcpy(node_path, current, len ? len : 1);
+        node_path[len ? len : 1] = '\0';
+        return 0;
+    }
+
+    offset = qemu_fdt_path_offset(fdt, current);
+    parent_offset = fdt_supernode_atdepth_offset(fdt, offset,
         fdt_node_depth(fdt, offset) - 1, NULL);
 
     return parent_offset >= 0 ?
@@ -29,6 +29,7 @@
 #include "qapi/qmp/qerror.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/thread.h"
 #include "hw/misc/vmcoreinfo.h"
 
 #ifdef TARGET_X86_64
@@ -1301,20 +1302,255 @@ static inline bool is_zero_page(const uint8_t *buf, size_t page_size)
     return buffer_is_zero(buf, page_size);
 }
 
+/*
+ * Pages are checked and compressed in batches by up to
+ * DUMP_COMPRESS_THREADS_MAX threads, then written out in order by the
+ * dump thread, so the vmcore is the same as with a single thread.
+ */
+#define DUMP_COMPRESS_BATCH         256
+#define DUMP_COMPRESS_THREADS_MAX   8
+
+typedef struct DumpPage {
+    uint8_t *buf;               /* the page in guest RAM */
+    uint8_t *buf_out;           /* its compressed data */
+    size_t size_out;            /* 0 for a zero page */
+    uint32_t flags;             /* DUMP_DH_COMPRESSED_*, 0 if not */
+} DumpPage;
+
+typedef struct DumpCompress DumpCompress;
+
+typedef struct DumpCompressThread {
+    QemuThread thread;
+    QemuSemaphore start;
+    DumpCompress *dc;
+    int index;
+#ifdef CONFIG_LZO
+    lzo_bytep wrkmem;
+#endif
+} DumpCompressThread;
+
+struct DumpCompress {
+    DumpState *s;
+    size_t len_buf_out;
+    DumpPage pages[DUMP_COMPRESS_BATCH];
+    int nr_pages;
+    int nr_threads;
+    bool quit;
+    QemuSemaphore done;
+    DumpCompressThread threads[DUMP_COMPRESS_THREADS_MAX];
+};
+
+/*
+ * Only one compression format will be used here, for s->flag_compress
+ * is set.  But when compression fails to work, we fall back to save in
+ * plaintext.
+ */
+static void dump_compress_page(DumpCompressThread *t, DumpPage *p)
+{
+    DumpState *s = t->dc->s;
+    size_t size_out = t->dc->len_buf_out;
+
+    if (is_zero_page(p->buf, s->dump_info.page_size)) {
+        p->size_out = 0;
+        return;
+    }
+
+    if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
+        (compress2(p->buf_out, (uLongf *)&size_out, p->buf,
+                   s->dump_info.page_size, Z_BEST_SPEED) == Z_OK) &&
+        (size_out < s->dump_info.page_size)) {
+        p->flags = DUMP_DH_COMPRESSED_ZLIB;
+#ifdef CONFIG_LZO
+    } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
+               (lzo1x_1_compress(p->buf, s->dump_info.page_size, p->buf_out,
+                                 (lzo_uint *)&size_out, t->wrkmem)
+                == LZO_E_OK) &&
+               (size_out < s->dump_info.page_size)) {
+        p->flags = DUMP_DH_COMPRESSED_LZO;
+#endif
+#ifdef CONFIG_SNAPPY
+    } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
+               (snappy_compress((char *)p->buf, s->dump_info.page_size,
+                                (char *)p->buf_out, &size_out)
+                == SNAPPY_OK) &&
+               (size_out < s->dump_info.page_size)) {
+        p->flags = DUMP_DH_COMPRESSED_SNAPPY;
+#endif
+    } else {
+        /*
+         * fall back to save in plaintext, size_out should be
+         * assigned the target's page size
+         */
+        p->flags = 0;
+        size_out = s->dump_info.page_size;
+    }
+    p->size_out = size_out;
+}
+
+/* Compresses every nr_threads-th page of the batch, from t->index on */
+static void dump_compress_share(DumpCompressThread *t)
+{
+    DumpCompress *dc = t->dc;
+    int i;
+
+    for (i = t->index; i < dc->nr_pages; i += dc->nr_threads) {
+        dump_compress_page(t, &dc->pages[i]);
+    }
+}
+
+static void *dump_compress_thread(void *opaque)
+{
+    DumpCompressThread *t = opaque;
+
+    for (;;) {
+        qemu_sem_wait(&t->start);
+        if (atomic_read(&t->dc->quit)) {
+            break;
+        }
+        dump_compress_share(t);
+        qemu_sem_post(&t->dc->done);
+    }
+    return NULL;
+}
+
+static int dump_compress_nr_threads(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long host_procs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (host_procs > 1) {
+        return MIN(host_procs, DUMP_COMPRESS_THREADS_MAX);
+    }
+#endif
+    return 1;
+}
+
+static DumpCompress *dump_compress_new(DumpState *s, size_t len_buf_out)
+{
+    DumpCompress *dc = g_new0(DumpCompress, 1);
+    int i;
+
+    dc->s = s;
+    dc->len_buf_out = len_buf_out;
+    for (i = 0; i < DUMP_COMPRESS_BATCH; i++) {
+        dc->pages[i].buf_out = g_malloc(len_buf_out);
+    }
+
+    dc->nr_threads = dump_compress_nr_threads();
+    qemu_sem_init(&dc->done, 0);
+    for (i = 0; i < dc->nr_threads; i++) {
+        DumpCompressThread *t = &dc->threads[i];
+
+        t->dc = dc;
+        t->index = i;
+#ifdef CONFIG_LZO
+        t->wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
+#endif
+        /* The dump thread does the first share itself */
+        if (i > 0) {
+            qemu_sem_init(&t->start, 0);
+            qemu_thread_create(&t->thread, "dump-compress",
+                               dump_compress_thread, t,
+                               QEMU_THREAD_JOINABLE);
+        }
+    }
+    return dc;
+}
+
+static void dump_compress_batch(DumpCompress *dc)
+{
+    int i;
+
+    for (i = 1; i < dc->nr_threads; i++) {
+        qemu_sem_post(&dc->threads[i].start);
+    }
+    dump_compress_share(&dc->threads[0]);
+    for (i = 1; i < dc->nr_threads; i++) {
+        qemu_sem_wait(&dc->done);
+    }
+}
+
+static void dump_compress_free(DumpCompress *dc)
+{
+    int i;
+
+    atomic_set(&dc->quit, true);
+    for (i = 0; i < dc->nr_threads; i++) {
+        DumpCompressThread *t = &dc->threads[i];
+
+        if (i > 0) {
+            qemu_sem_post(&t->start);
+            qemu_thread_join(&t->thread);
+            qemu_sem_destroy(&t->start);
+        }
+#ifdef CONFIG_LZO
+        g_free(t->wrkmem);
+#endif
+    }
+    qemu_sem_destroy(&dc->done);
+    for (i = 0; i < DUMP_COMPRESS_BATCH; i++) {
+        g_free(dc->pages[i].buf_out);
+    }
+    g_free(dc);
+}
+
+/*
+ * Writes the data and the page desc of each page of the batch.  Zero
+ * pages all use the page data at pd_zero.
+ */
+static int write_dump_batch(DumpState *s, DumpCompress *dc,
+                            DataCache *page_desc, DataCache *page_data,
+                            PageDescriptor *pd_zero, off_t *offset_data,
+                            Error **errp)
+{
+    PageDescriptor pd;
+    int i;
+
+    for (i = 0; i < dc->nr_pages; i++) {
+        DumpPage *p = &dc->pages[i];
+
+        if (p->size_out == 0) {
+            if (write_cache(page_desc, pd_zero, sizeof(PageDescriptor),
+                            false) < 0) {
+                error_setg(errp, "dump: failed to write page desc");
+                return -1;
+            }
+        } else {
+            if (write_cache(page_data, p->flags ? p->buf_out : p->buf,
+                            p->size_out, false) < 0) {
+                error_setg(errp, "dump: failed to write page data");
+                return -1;
+            }
+
+            pd.flags = cpu_to_dump32(s, p->flags);
+            pd.size = cpu_to_dump32(s, p->size_out);
+            pd.page_flags = cpu_to_dump64(s, 0);
+            pd.offset = cpu_to_dump64(s, *offset_data);
+            *offset_data += p->size_out;
+
+            if (write_cache(page_desc, &pd, sizeof(PageDescriptor),
+                            false) < 0) {
+                error_setg(errp, "dump: failed to write page desc");
+                return -1;
+            }
+        }
+        s->written_size += s->dump_info.page_size;
+    }
+    return 0;
+}
+
 static void write_dump_pages(DumpState *s, Error **errp)
 {
     int ret = 0;
     DataCache page_desc, page_data;
-    size_t len_buf_out, size_out;
-#ifdef CONFIG_LZO
-    lzo_bytep wrkmem = NULL;
-#endif
-    uint8_t *buf_out = NULL;
+    size_t len_buf_out;
+    DumpCompress *dc;
     off_t offset_desc, offset_data;
-    PageDescriptor pd, pd_zero;
+    PageDescriptor pd_zero;
     uint8_t *buf;
     GuestPhysBlock *block_iter = NULL;
     uint64_t pfn_iter;
+    bool more = true;
 
     /* get offset of page_desc and page_data in dump file */
     offset_desc = s->offset_page;
@@ -1327,11 +1563,7 @@ static void write_dump_pages(DumpState *s, Error **errp)
     len_buf_out = get_len_buf_out(s->dump_info.page_size, s->flag_compress);
     assert(len_buf_out != 0);
 
-#ifdef CONFIG_LZO
-    wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
-#endif
-
-    buf_out = g_malloc(len_buf_out);
+    dc = dump_compress_new(s, len_buf_out);
 
     /*
      * init zero page's page_desc and page_data, because every zero page
@@ -1352,101 +1584,22 @@ static void write_dump_pages(DumpState *s, Error **errp)
     offset_data += s->dump_info.page_size;
 
     /*
-     * dump memory to vmcore page by page. zero page will all be resided in the
-     * first page of page section
+     * dump memory to vmcore a batch of pages at a time. zero page will all
+     * be resided in the first page of page section
      */
-    while (get_next_page(&block_iter, &pfn_iter, &buf, s)) {
-        /* check zero page */
-        if (is_zero_page(buf, s->dump_info.page_size)) {
-            ret = write_cache(&page_desc, &pd_zero, sizeof(PageDescriptor),
-                              false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
-            }
-        } else {
-            /*
-             * not zero page, then:
-             * 1. compress the page
-             * 2. write the compressed page into the cache of page_data
-             * 3. get page desc of the compressed page and write it into the
-             *    cache of page_desc
-             *
-             * only one compression format will be used here, for
-             * s->flag_compress is set. But when compression fails to work,
-             * we fall back to save in plaintext.
-             */
-             size_out = len_buf_out;
-             if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
-                    (compress2(buf_out, (uLongf *)&size_out, buf,
-                               s->dump_info.page_size, Z_BEST_SPEED) == Z_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_ZLIB);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#ifdef CONFIG_LZO
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
-                    (lzo1x_1_compress(buf, s->dump_info.page_size, buf_out,
-                    (lzo_uint *)&size_out, wrkmem) == LZO_E_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_LZO);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-#ifdef CONFIG_SNAPPY
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
-                    (snappy_compress((char *)buf, s->dump_info.page_size,
-                    (char *)buf_out, &size_out) == SNAPPY_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_SNAPPY);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-            } else {
-                /*
-                 * fall back to save in plaintext, size_out should be
-                 * assigned the target's page size
-                 */
-                pd.flags = cpu_to_dump32(s, 0);
-                size_out = s->dump_info.page_size;
-                pd.size = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf,
-                                  s->dump_info.page_size, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-            }
-
-            /* get and write page desc here */
-            pd.page_flags = cpu_to_dump64(s, 0);
-            pd.offset = cpu_to_dump64(s, offset_data);
-            offset_data += size_out;
-
-            ret = write_cache(&page_desc, &pd, sizeof(PageDescriptor), false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
-            }
+    do {
+        dc->nr_pages = 0;
+        while (dc->nr_pages < DUMP_COMPRESS_BATCH &&
+               (more = get_next_page(&block_iter, &pfn_iter, &buf, s))) {
+            dc->pages[dc->nr_pages++].buf = buf;
         }
-        s->written_size += s->dump_info.page_size;
-    }
+        dump_compress_batch(dc);
+        ret = write_dump_batch(s, dc, &page_desc, &page_data, &pd_zero,
+                               &offset_data, errp);
+        if (ret < 0) {
+            goto out;
+        }
+    } while (more);
 
     ret = write_cache(&page_desc, NULL, 0, true);
     if (ret < 0) {
@@ -1462,12 +1615,7 @@ static void write_dump_pages(DumpState *s, Error **errp)
 out:
     free_data_cache(&page_desc);
     free_data_cache(&page_data);
-
-#ifdef CONFIG_LZO
-    g_free(wrkmem);
-#endif
-
-    g_free(buf_out);
+    dump_compress_free(dc);
 }
 
 static void create_kdump_vmcore(DumpState *s, Error **errp)
@@ -29,6 +29,14 @@
 #include "qemu-common.h"
 #include "qemu/etrace.h"
 #include "qemu/timer.h"
+#include "qemu/atomic.h"
+#include "qemu/cutils.h"
+#include "qemu/host-utils.h"
+#include "qemu/units.h"
+#include <zlib.h>
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
 #include "exec/memory.h"
 #include "exec/address-spaces.h"
 #include "cpu.h"
@@ -113,6 +121,83 @@ struct etrace_event_u64 {
     uint16_t event_name_len;
 } QEMU_PACKED;
 
+/*
+ * Compressed traces (-etrace-flags compress=...) wrap the plain record
+ * stream in independently compressed blocks, each holding whole records:
+ *
+ *   struct etrace_zfile_hdr
+ *   struct etrace_zblock + payload    (repeated)
+ *   uint64_t index[nr_blocks][2]      (file offset, plain stream offset)
+ *   struct etrace_zfile_trailer
+ *
+ * The trailer sits at the end of the file so readers can locate the index
+ * and seek to any block without decompressing what comes before it.
+ * Uncompressed traces are unchanged.
+ */
+#define ETRACE_ZFILE_MAGIC "ETRACEZ"
+#define ETRACE_ZINDEX_MAGIC "ETRACEI"
+
+struct etrace_zfile_hdr {
+    char magic[8];
+    struct {
+        uint16_t major;
+        uint16_t minor;
+    } version;
+    uint32_t codec;
+    uint32_t block_size;
+    uint32_t reserved;
+} QEMU_PACKED;
+
+struct etrace_zblock {
+    /* Blocks that don't compress well are stored with ETRACE_COMPRESS_NONE. */
+    uint32_t codec;
+    uint32_t raw_len;
+    uint32_t comp_len;
+    uint32_t reserved;
+    uint64_t raw_offset;
+} QEMU_PACKED;
+
+struct etrace_zfile_trailer {
+    uint64_t index_offset;
+    uint64_t nr_blocks;
+    char magic[8];
+} QEMU_PACKED;
+
+#define ETRACE_BLOCK_SIZE (256 * KiB)
+#define ETRACE_RING_SIZE_DEFAULT (4 * MiB)
+#define ETRACE_WRITER_PERIOD_MS 10
+
+/*
+ * Per-thread record ring, single producer (the owning thread) and single
+ * consumer (the writer thread). Positions are free running. The producer
+ * only publishes head at record boundaries so the writer never sees a
+ * partial record.
+ */
+struct etrace_ring {
+    struct etrace_ring *next;
+    uint8_t *data;
+    size_t size;
+    uint64_t head;
+    uint64_t tail;
+    /* Producer private.  */
+    uint64_t wpos;
+    size_t pending;
+    bool direct;
+    bool kicked;
+    QemuEvent space;
+};
+
+static __thread struct etrace_ring *etrace_thread_ring;
+
+/* Exec record in flight and sampling state of the calling vCPU thread.  */
+static __thread struct {
+    uint64_t start;
+    int64_t start_time;
+    bool start_valid;
+    uint64_t tb_count;
+    int64_t next_sample_time;
+} etrace_exec;
+
 const char *qemu_arg_etrace;
 const char *qemu_arg_etrace_flags;
 struct etracer qemu_etracer = {0};
@@ -120,6 +205,7 @@ bool qemu_etrace_enabled;
 
 void qemu_etrace_cleanup(void)
 {
+    qemu_etrace_enabled = false;
     etrace_close(&qemu_etracer);
 }
 
@@ -161,7 +247,96 @@ static uint64_t qemu_etrace_str2flags(const char *str, size_t len)
     return flags;
 }
 
-static uint64_t qemu_etrace_opts2flags(const char *opts)
+static uint64_t qemu_etrace_parse_u64(const char *opt, const char *str,
+                                      const char **endptr)
+{
+    uint64_t v;
+
+    if (qemu_strtou64(str, endptr, 0, &v) < 0) {
+        fprintf(stderr, "Invalid etrace %s value %s\n", opt, str);
+        exit(EXIT_FAILURE);
+    }
+    return v;
+}
+
+/* Parses START..END (inclusive) or START+SIZE.  */
+static void qemu_etrace_parse_range(struct etracer *t, const char *str)
+{
+    const char *end;
+    uint64_t start, last;
+
+    if (t->nr_ranges == ETRACE_MAX_RANGES) {
+        fprintf(stderr, "Too many etrace ranges\n");
+        exit(EXIT_FAILURE);
+    }
+
+    start = qemu_etrace_parse_u64("range", str, &end);
+    if (strstart(end, "..", &end)) {
+        last = qemu_etrace_parse_u64("range", end, NULL);
+    } else if (*end == '+') {
+        last = start + qemu_etrace_parse_u64("range", end + 1, NULL) - 1;
+    } else {
+        fprintf(stderr, "Invalid etrace range %s\n", str);
+        exit(EXIT_FAILURE);
+    }
+
+    if (last < start) {
+        fprintf(stderr, "Invalid etrace range %s\n", str);
+        exit(EXIT_FAILURE);
+    }
+    t->ranges[t->nr_ranges].start = start;
+    t->ranges[t->nr_ranges].end = last;
+    t->nr_ranges++;
+}
+
+static void qemu_etrace_parse_setting(struct etracer *t,
+                                      const char *str, size_t len)
+{
+    g_autofree char *opt = g_strndup(str, len);
+    char *val = strchr(opt, '=');
+    uint64_t size;
+
+    *val++ = 0;
+    if (!strcmp(opt, "range")) {
+        qemu_etrace_parse_range(t, val);
+    } else if (!strcmp(opt, "unit")) {
+        uint64_t unit = qemu_etrace_parse_u64(opt, val, NULL);
+
+        if (unit >= 64) {
+            fprintf(stderr, "etrace unit %s out of range\n", val);
+            exit(EXIT_FAILURE);
+        }
+        t->unit_mask |= 1ULL << unit;
+    } else if (!strcmp(opt, "sample-tbs")) {
+        t->sample_tbs = qemu_etrace_parse_u64(opt, val, NULL);
+    } else if (!strcmp(opt, "sample-ns")) {
+        t->sample_ns = qemu_etrace_parse_u64(opt, val, NULL);
+    } else if (!strcmp(opt, "buffer")) {
+        if (qemu_strtosz(val, NULL, &size) < 0) {
+            fprintf(stderr, "Invalid etrace buffer size %s\n", val);
+            exit(EXIT_FAILURE);
+        }
+        t->ring_size = size ? pow2ceil(MAX(size, 2 * ETRACE_BLOCK_SIZE)) : 0;
+    } else if (!strcmp(opt, "compress")) {
+        if (!strcmp(val, "none")) {
+            t->compress = ETRACE_COMPRESS_NONE;
+        } else if (!strcmp(val, "zlib")) {
+            t->compress = ETRACE_COMPRESS_ZLIB;
+#ifdef CONFIG_ZSTD
+        } else if (!strcmp(val, "zstd")) {
+            t->compress = ETRACE_COMPRESS_ZSTD;
+#endif
+        } else {
+            fprintf(stderr, "Unsupported etrace compression %s\n", val);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        fprintf(stderr, "Invalid etrace option %s\n", opt);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint64_t qemu_etrace_opts2flags(struct etracer *t, const char *opts)
 {
     uint64_t flags = 0;
     const char *prev = opts, *end = opts;
@@ -170,7 +345,11 @@ static uint64_t qemu_etrace_opts2flags(const char *opts)
         while (*end != ',' && *end != 0) {
             end++;
         }
-        flags |= qemu_etrace_str2flags(prev, end - prev);
+        if (memchr(prev, '=', end - prev)) {
+            qemu_etrace_parse_setting(t, prev, end - prev);
+        } else {
+            flags |= qemu_etrace_str2flags(prev, end - prev);
+        }
         while (*end == ',') {
             end++;
         }
@@ -179,7 +358,7 @@ static uint64_t qemu_etrace_opts2flags(const char *opts)
     return flags;
 }
 
-static void etrace_write(struct etracer *t, const void *buf, size_t len)
+static void etrace_fwrite(struct etracer *t, const void *buf, size_t len)
 {
     size_t r;
 
@@ -193,6 +372,272 @@ static void etrace_write(struct etracer *t, const void *buf, size_t len)
     }
     /* FIXME: Make this more robust.  */
     assert(r == len);
+    t->block.file_offset += len;
+}
+
+static size_t etrace_compress_block(struct etracer *t, uint32_t *codec)
+{
+    size_t bound = compressBound(t->block.len);
+    uLongf zlen;
+
+#ifdef CONFIG_ZSTD
+    bound = MAX(bound, ZSTD_compressBound(t->block.len));
+#endif
+    if (t->block.zsize < bound) {
+        t->block.zsize = bound;
+        t->block.zbuf = g_realloc(t->block.zbuf, bound);
+    }
+
+    switch (t->compress) {
+#ifdef CONFIG_ZSTD
+    case ETRACE_COMPRESS_ZSTD:
+        zlen = ZSTD_compress(t->block.zbuf, t->block.zsize,
+                             t->block.buf, t->block.len, 1);
+        if (ZSTD_isError(zlen)) {
+            zlen = t->block.len;
+        }
+        break;
+#endif
+    case ETRACE_COMPRESS_ZLIB:
+        zlen = t->block.zsize;
+        if (compress2(t->block.zbuf, &zlen, t->block.buf, t->block.len,
+                      Z_BEST_SPEED) != Z_OK) {
+            zlen = t->block.len;
+        }
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    *codec = t->compress;
+    if (zlen >= t->block.len) {
+        /* Not worth it, store the block as is.  */
+        *codec = ETRACE_COMPRESS_NONE;
+        memcpy(t->block.zbuf, t->block.buf, t->block.len);
+        zlen = t->block.len;
+    }
+    return zlen;
+}
+
+static void etrace_block_flush(struct etracer *t)
+{
+    struct etrace_zblock zb = {0};
+    size_t zlen;
+
+    if (!t->block.len) {
+        return;
+    }
+
+    if (t->block.nr_blocks * 2 == t->block.index_size) {
+        t->block.index_size = MAX(t->block.index_size * 2, 64);
+        t->block.index = g_renew(uint64_t, t->block.index,
+                                 t->block.index_size);
+    }
+    t->block.index[t->block.nr_blocks * 2] = t->block.file_offset;
+    t->block.index[t->block.nr_blocks * 2 + 1] = t->block.raw_offset;
+    t->block.nr_blocks++;
+
+    zlen = etrace_compress_block(t, &zb.codec);
+    zb.raw_len = t->block.len;
+    zb.comp_len = zlen;
+    zb.raw_offset = t->block.raw_offset;
+    etrace_fwrite(t, &zb, sizeof zb);
+    etrace_fwrite(t, t->block.zbuf, zlen);
+
+    t->block.raw_offset += t->block.len;
+    t->block.len = 0;
+}
+
+/* Emit bytes of the plain record stream. Called with t->lock held.  */
+static void etrace_out(struct etracer *t, const void *buf, size_t len)
+{
+    if (t->compress == ETRACE_COMPRESS_NONE) {
+        etrace_fwrite(t, buf, len);
+        return;
+    }
+
+    if (t->block.len + len > t->block.size) {
+        t->block.size = MAX(t->block.len + len, t->block.size * 2);
+        t->block.buf = g_realloc(t->block.buf, t->block.size);
+    }
+    memcpy(t->block.buf + t->block.len, buf, len);
+    t->block.len += len;
+}
+
+static void etrace_out_record_end(struct etracer *t)
+{
+    if (t->block.len >= ETRACE_BLOCK_SIZE) {
+        etrace_block_flush(t);
+    }
+}
+
+static void etrace_ring_out(struct etracer *t, struct etrace_ring *r,
+                            uint64_t pos, size_t len)
+{
+    size_t offset = pos & (r->size - 1);
+    size_t first = MIN(len, r->size - offset);
+
+    etrace_out(t, r->data + offset, first);
+    if (len > first) {
+        etrace_out(t, r->data, len - first);
+    }
+}
+
+static void etrace_ring_peek(struct etrace_ring *r, uint64_t pos,
+                             void *buf, size_t len)
+{
+    size_t offset = pos & (r->size - 1);
+    size_t first = MIN(len, r->size - offset);
+
+    memcpy(buf, r->data + offset, first);
+    memcpy((uint8_t *)buf + first, r->data, len - first);
+}
+
+/* Writer side. Called with t->lock held.  */
+static void etrace_ring_drain(struct etracer *t, struct etrace_ring *r)
+{
+    uint64_t tail = r->tail;
+    uint64_t head;
+
+    atomic_set(&r->kicked, false);
+    head = atomic_load_acquire(&r->head);
+    if (tail == head) {
+        return;
+    }
+
+    if (t->compress == ETRACE_COMPRESS_NONE) {
+        etrace_ring_out(t, r, tail, head - tail);
+        tail = head;
+    } else {
+        /* Walk the records so that blocks end on record boundaries.  */
+        while (tail != head) {
+            struct etrace_hdr hdr;
+            size_t len;
+
+            etrace_ring_peek(r, tail, &hdr, sizeof hdr);
+            len = sizeof hdr + hdr.len;
+            etrace_ring_out(t, r, tail, len);
+            etrace_out_record_end(t);
+            tail += len;
+        }
+    }
+    atomic_store_release(&r->tail, tail);
+    qemu_event_set(&r->space);
+}
+
+static void *etrace_writer_thread(void *opaque)
+{
+    struct etracer *t = opaque;
+    struct etrace_ring *r;
+    bool stop;
+
+    do {
+        qemu_sem_timedwait(&t->writer_sem, ETRACE_WRITER_PERIOD_MS);
+        stop = atomic_read(&t->writer_stop);
+
+        qemu_mutex_lock(&t->lock);
+        for (r = t->rings; r; r = r->next) {
+            etrace_ring_drain(t, r);
+        }
+        qemu_mutex_unlock(&t->lock);
+    } while (!stop);
+    return NULL;
+}
+
+static struct etrace_ring *etrace_get_ring(struct etracer *t)
+{
+    struct etrace_ring *r = etrace_thread_ring;
+
+    if (likely(r)) {
+        return r;
+    }
+
+    r = g_new0(struct etrace_ring, 1);
+    r->size = t->ring_size;
+    r->data = g_malloc(r->size);
+    qemu_event_init(&r->space, false);
+
+    qemu_mutex_lock(&t->lock);
+    r->next = t->rings;
+    t->rings = r;
+    qemu_mutex_unlock(&t->lock);
+
+    etrace_thread_ring = r;
+    return r;
+}
+
+/* Wait for at least len bytes of free space in r.  */
+static void etrace_ring_wait(struct etracer *t, struct etrace_ring *r,
+                             size_t len)
+{
+    while (r->size - (r->wpos - atomic_load_acquire(&r->tail)) < len) {
+        qemu_event_reset(&r->space);
+        if (r->size - (r->wpos - atomic_load_acquire(&r->tail)) >= len) {
+            break;
+        }
+        qemu_sem_post(&t->writer_sem);
+        qemu_event_wait(&r->space);
+    }
+}
+
+static void etrace_ring_begin(struct etracer *t, size_t len)
+{
+    struct etrace_ring *r = etrace_get_ring(t);
+
+    assert(r->pending == 0);
+    r->pending = len;
+    if (len > r->size / 2) {
+        /*
+         * Too large for the ring. Let the writer catch up with what we
+         * have queued, then write the record through under the lock.
+         */
+        etrace_ring_wait(t, r, r->size);
+        qemu_mutex_lock(&t->lock);
+        r->direct = true;
+    }
+}
+
+static void etrace_ring_write(struct etracer *t, const void *buf, size_t len)
+{
+    struct etrace_ring *r = etrace_thread_ring;
+    size_t offset, first;
+
+    assert(r && len <= r->pending);
+    r->pending -= len;
+
+    if (r->direct) {
+        etrace_out(t, buf, len);
+        if (!r->pending) {
+            etrace_out_record_end(t);
+            r->direct = false;
+            qemu_mutex_unlock(&t->lock);
+        }
+        return;
+    }
+
+    etrace_ring_wait(t, r, len);
+    offset = r->wpos & (r->size - 1);
+    first = MIN(len, r->size - offset);
+    memcpy(r->data + offset, buf, first);
+    memcpy(r->data, (const uint8_t *)buf + first, len - first);
+    r->wpos += len;
+
+    if (!r->pending) {
+        atomic_store_release(&r->head, r->wpos);
+        if (r->wpos - atomic_read(&r->tail) >= r->size / 2
+            && !atomic_xchg(&r->kicked, true)) {
+            qemu_sem_post(&t->writer_sem);
+        }
+    }
+}
+
+static void etrace_write(struct etracer *t, const void *buf, size_t len)
+{
+    if (t->writer_running) {
+        etrace_ring_write(t, buf, len);
+    } else {
+        etrace_out(t, buf, len);
+    }
 }
 
 static void etrace_write_header(struct etracer *t, uint16_t type,
@@ -203,6 +648,10 @@ static void etrace_write_header(struct etracer *t, uint16_t type,
         .unit_id = unit_id,
         .len = len
     };
+
+    if (t->writer_running) {
+        etrace_ring_begin(t, sizeof hdr + len);
+    }
     etrace_write(t, &hdr, sizeof hdr);
 }
 
@@ -274,11 +723,40 @@ bool etrace_init(struct etracer *t, const char *filename,
     struct etrace_arch arch;
 
     memset(t, 0, sizeof *t);
+    t->ring_size = ETRACE_RING_SIZE_DEFAULT;
+    t->flags = qemu_etrace_opts2flags(t, opts);
+    if (t->compress != ETRACE_COMPRESS_NONE && !t->ring_size) {
+        fprintf(stderr, "etrace compression requires buffer > 0\n");
+        exit(EXIT_FAILURE);
+    }
+
     t->fp = etrace_open(filename);
     if (!t->fp) {
         return false;
     }
 
+    if (t->compress != ETRACE_COMPRESS_NONE) {
+        struct etrace_zfile_hdr zh = {
+            .magic = ETRACE_ZFILE_MAGIC,
+            .version.major = ETRACE_VERSION_MAJOR,
+            .version.minor = ETRACE_VERSION_MINOR,
+            .codec = t->compress,
+            .block_size = ETRACE_BLOCK_SIZE,
+        };
+
+        t->block.size = 2 * ETRACE_BLOCK_SIZE;
+        t->block.buf = g_malloc(t->block.size);
+        etrace_fwrite(t, &zh, sizeof zh);
+    }
+
+    qemu_mutex_init(&t->lock);
+    if (t->ring_size) {
+        qemu_sem_init(&t->writer_sem, 0);
+        qemu_thread_create(&t->writer, "etrace-writer", etrace_writer_thread,
+                           t, QEMU_THREAD_JOINABLE);
+        t->writer_running = true;
+    }
+
     memset(&id, 0, sizeof id);
     id.version.major = ETRACE_VERSION_MAJOR;
     id.version.minor = ETRACE_VERSION_MINOR;
@@ -298,8 +776,6 @@ bool etrace_init(struct etracer *t, const char *filename,
 #endif
     etrace_write_header(t, TYPE_ARCH, 0, sizeof arch);
     etrace_write(t, &arch, sizeof arch);
-
-    t->flags = qemu_etrace_opts2flags(opts);
     return true;
 }
 
@@ -506,6 +982,19 @@ void etrace_mem_access(struct etracer *t, uint16_t unit_id,
 {
     struct etrace_mem mem;
 
+    /*
+     * With exec filters active, only keep accesses done by TBs that
+     * are being traced.
+     */
+    if ((t->flags & ETRACE_F_EXEC)
+        && (t->nr_ranges || t->sample_tbs || t->sample_ns)
+        && !etrace_exec.start_valid) {
+        return;
+    }
+    if (t->unit_mask && !(unit_id < 64 && (t->unit_mask >> unit_id) & 1)) {
+        return;
+    }
+
     etrace_flush_exec_cache(t);
     mem.time = etrace_time();
     mem.vaddr = guest_vaddr;
@@ -519,14 +1008,54 @@ void etrace_mem_access(struct etracer *t, uint16_t unit_id,
     etrace_write(t, &mem, sizeof mem);
 }
 
+bool etrace_filter_tb(struct etracer *t, uint64_t start, uint64_t end)
+{
+    unsigned int i;
+
+    if (!t->nr_ranges) {
+        return true;
+    }
+
+    for (i = 0; i < t->nr_ranges; i++) {
+        if (start <= t->ranges[i].end && end > t->ranges[i].start) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool etrace_filter_exec(struct etracer *t, unsigned int unit_id)
+{
+    bool sample = true;
+
+    if (t->unit_mask && !(unit_id < 64 && (t->unit_mask >> unit_id) & 1)) {
+        return false;
+    }
+
+    if (t->sample_tbs) {
+        sample = etrace_exec.tb_count++ % t->sample_tbs == 0;
+    }
+    if (t->sample_ns) {
+        int64_t now = etrace_time();
+
+        if (now >= etrace_exec.next_sample_time) {
+            etrace_exec.next_sample_time = now + t->sample_ns;
+            return true;
+        }
+        /* Both set: either one triggers a sample.  */
+        return t->sample_tbs && sample;
+    }
+    return sample;
+}
+
 void etrace_dump_exec_start(struct etracer *t,
                             unsigned int unit_id,
                             uint64_t start)
 {
-    assert(!t->exec_start_valid);
-    t->exec_start = start;
-    t->exec_start_time = etrace_time();
-    t->exec_start_valid = true;
+    assert(!etrace_exec.start_valid);
+    etrace_exec.start = start;
+    etrace_exec.start_time = etrace_time();
+    etrace_exec.start_valid = true;
 }
 
 void etrace_dump_exec_end(struct etracer *t,
@@ -534,18 +1063,30 @@ void etrace_dump_exec_end(struct etracer *t,
                           uint64_t end)
 {
     int64_t tdiff;
-    if (!t->exec_start_valid) {
-        printf("exec_start not valid! %" PRIx64 " %" PRIx64 "\n", t->exec_start, end);
+    if (!etrace_exec.start_valid) {
+        printf("exec_start not valid! %" PRIx64 " %" PRIx64 "\n",
+               etrace_exec.start, end);
     }
-    tdiff = etrace_time() - t->exec_start_time;
+    tdiff = etrace_time() - etrace_exec.start_time;
     if (tdiff < 0) {
         printf("tdiff=%" PRId64 "\n", tdiff);
         fflush(NULL);
     }
     assert(tdiff >= 0);
-    assert(t->exec_start_valid);
-    t->exec_start_valid = false;
-    etrace_dump_exec(t, unit_id, t->exec_start, end, t->exec_start_time, tdiff);
+    assert(etrace_exec.start_valid);
+    etrace_exec.start_valid = false;
+    etrace_dump_exec(t, unit_id, etrace_exec.start, end,
+                     etrace_exec.start_time, tdiff);
+}
+
+bool etrace_exec_start_valid(struct etracer *t)
+{
+    return etrace_exec.start_valid;
+}
+
+void etrace_exec_cancel(struct etracer *t)
+{
+    etrace_exec.start_valid = false;
 }
 
 void etrace_note_write(struct etracer *t, unsigned int unit_id,
@@ -606,10 +1147,41 @@ void etrace_event_u64(struct etracer *t, uint16_t unit_id,
     etrace_write(t, event_name, event_len);
 }
 
+static void etrace_write_index(struct etracer *t)
+{
+    struct etrace_zfile_trailer tr = {
+        .magic = ETRACE_ZINDEX_MAGIC,
+    };
+
+    etrace_block_flush(t);
+    tr.index_offset = t->block.file_offset;
+    tr.nr_blocks = t->block.nr_blocks;
+    etrace_fwrite(t, t->block.index,
+                  t->block.nr_blocks * 2 * sizeof t->block.index[0]);
+    etrace_fwrite(t, &tr, sizeof tr);
+}
+
 void etrace_close(struct etracer *t)
 {
-    if (t->fp) {
-        etrace_flush_exec_cache(t);
-        fclose(t->fp);
+    if (!t->fp) {
+        return;
+    }
+
+    etrace_flush_exec_cache(t);
+    if (t->writer_running) {
+        if (qemu_thread_is_self(&t->writer)) {
+            /* exit() from the writer itself, nothing more we can do.  */
+            return;
+        }
+        atomic_set(&t->writer_stop, true);
+        qemu_sem_post(&t->writer_sem);
+        qemu_thread_join(&t->writer);
+        t->writer_running = false;
+    }
+
+    if (t->compress != ETRACE_COMPRESS_NONE) {
+        etrace_write_index(t);
     }
+    fclose(t->fp);
+    t->fp = NULL;
 }
@@ -70,6 +70,16 @@ TargetPageBits target_page;
 # endif
 #endif
 
+/*
+ * The largest target page size that set_target_page_bits_floor() accepts;
+ * 64K is the largest translation granule of any CPU with variable pages.
+ */
+#define TARGET_PAGE_BITS_FLOOR_MAX 16
+
+#ifdef TARGET_PAGE_BITS_VARY
+static int target_page_bits_floor;
+#endif
+
 bool set_preferred_target_page_bits(int bits)
 {
     /*
@@ -80,6 +90,10 @@ bool set_preferred_target_page_bits(int bits)
      */
 #ifdef TARGET_PAGE_BITS_VARY
     assert(bits >= TARGET_PAGE_BITS_MIN);
+    if (bits < target_page_bits_floor) {
+        /* The user has promised that the CPUs never map smaller pages */
+        return true;
+    }
     if (init_target_page.bits == 0 || init_target_page.bits > bits) {
         if (init_target_page.decided) {
             return false;
@@ -90,6 +104,21 @@ bool set_preferred_target_page_bits(int bits)
     return true;
 }
 
+bool set_target_page_bits_floor(int bits)
+{
+#ifdef TARGET_PAGE_BITS_VARY
+    if (init_target_page.decided || bits < TARGET_PAGE_BITS_MIN ||
+        bits > TARGET_PAGE_BITS_FLOOR_MAX) {
+        return false;
+    }
+    init_target_page.bits = bits;
+    target_page_bits_floor = bits;
+    return true;
+#else
+    return bits == TARGET_PAGE_BITS;
+#endif
+}
+
 void finalize_target_page_bits(void)
 {
 #ifdef TARGET_PAGE_BITS_VARY
@@ -931,6 +931,10 @@ void cpu_exec_unrealizefn(CPUState *cpu)
     }
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_free_notifier_list(cpu);
+    if (cpu->mmio_poll_timer) {
+        timer_free(cpu->mmio_poll_timer);
+        cpu->mmio_poll_timer = NULL;
+    }
 #endif
 }
 
@@ -1072,10 +1076,12 @@ static void breakpoint_invalidate(CPUState *cpu, target_ulong pc)
     /*
      * There may not be a virtual to physical translation for the pc
      * right now, but there may exist cached TB for this pc.
-     * Flush the whole TB cache to force re-translation of such TBs.
-     * This is heavyweight, but we're debugging anyway.
+     * Invalidate those by virtual address so that they get re-translated
+     * with the breakpoint check, without throwing away the whole TB cache.
      */
-    tb_flush(cpu);
+    if (tcg_enabled()) {
+        tb_invalidate_virt_addr(cpu, pc);
+    }
 }
 #endif
 
@@ -1182,6 +1188,27 @@ int cpu_watchpoint_address_matches(CPUState *cpu, vaddr addr, vaddr len)
     }
     return ret;
 }
+
+uint64_t cpu_watchpoint_page_mask(CPUState *cpu, vaddr page, int flags)
+{
+    vaddr page_end = page + TARGET_PAGE_SIZE - 1;
+    CPUWatchpoint *wp;
+    uint64_t mask = 0;
+
+    QTAILQ_FOREACH(wp, &cpu->watchpoints, entry) {
+        unsigned int first, last;
+
+        if (!(wp->flags & flags) ||
+            !watchpoint_address_matches(wp, page, TARGET_PAGE_SIZE)) {
+            continue;
+        }
+        first = (MAX(wp->vaddr, page) - page) >> TLB_WP_GRANULE_BITS;
+        last = (MIN(wp->vaddr + wp->len - 1, page_end) - page)
+               >> TLB_WP_GRANULE_BITS;
+        mask |= MAKE_64BIT_MASK(first, last - first + 1);
+    }
+    return mask;
+}
 #endif /* !CONFIG_USER_ONLY */
 
 /* Add a breakpoint.  */
@@ -2046,6 +2073,11 @@ bool qemu_ram_is_shared(RAMBlock *rb)
     return rb->flags & RAM_SHARED;
 }
 
+bool qemu_ram_is_clone(RAMBlock *rb)
+{
+    return rb->flags & RAM_CLONE;
+}
+
 /* Note: Only set at the start of postcopy */
 bool qemu_ram_is_uf_zeroable(RAMBlock *rb)
 {
@@ -2364,7 +2396,8 @@ RAMBlock *qemu_ram_alloc_from_fd(ram_addr_t size, MemoryRegion *mr,
     int64_t file_size;
 
     /* Just support these ram flags by now. */
-    assert((ram_flags & ~(RAM_SHARED | RAM_PMEM)) == 0);
+    assert((ram_flags & ~(RAM_SHARED | RAM_PMEM | RAM_CLONE)) == 0);
+    assert(!(ram_flags & RAM_SHARED) || !(ram_flags & RAM_CLONE));
 
     if (xen_enabled()) {
         error_setg(errp, "-mem-path not supported with Xen");
@@ -2396,6 +2429,10 @@ RAMBlock *qemu_ram_alloc_from_fd(ram_addr_t size, MemoryRegion *mr,
                    file_size, size);
         return NULL;
     }
+    if ((ram_flags & RAM_CLONE) && file_size <= 0) {
+        error_setg(errp, "template backing store for guest RAM is empty");
+        return NULL;
+    }
 
     new_block = g_malloc0(sizeof(*new_block));
     new_block->mr = mr;
@@ -2427,7 +2464,22 @@ RAMBlock *qemu_ram_alloc_from_file(ram_addr_t size, MemoryRegion *mr,
     bool created;
     RAMBlock *block;
 
-    fd = file_ram_open(mem_path, memory_region_name(mr), &created, errp);
+    if (ram_flags & RAM_CLONE) {
+        /*
+         * A private mapping may be written even if the file was opened
+         * read-only, which guarantees the template is left untouched.
+         */
+        created = false;
+        fd = qemu_open(mem_path, O_RDONLY);
+        if (fd < 0) {
+            error_setg_errno(errp, errno,
+                             "can't open template %s for guest RAM",
+                             mem_path);
+            return NULL;
+        }
+    } else {
+        fd = file_ram_open(mem_path, memory_region_name(mr), &created, errp);
+    }
     if (fd < 0) {
         return NULL;
     }
@@ -2448,6 +2500,54 @@ RAMBlock *qemu_ram_alloc_from_file(ram_addr_t size, MemoryRegion *mr,
     return block;
 }
 
+RAMBlock *qemu_ram_alloc_hugetlb(ram_addr_t size, uint64_t pagesize,
+                                 bool share, MemoryRegion *mr, Error **errp)
+{
+    RAMBlock *new_block;
+    Error *local_err = NULL;
+
+    if (xen_enabled()) {
+        error_setg(errp, "huge page backed RAM is not supported with Xen");
+        return NULL;
+    }
+    if (phys_mem_alloc != qemu_anon_ram_alloc) {
+        error_setg(errp,
+                   "huge page backed RAM is not supported with this accelerator");
+        return NULL;
+    }
+    if (!is_power_of_2(pagesize) || pagesize <= qemu_real_host_page_size) {
+        error_setg(errp, "invalid huge page size 0x%" PRIx64, pagesize);
+        return NULL;
+    }
+
+    size = QEMU_ALIGN_UP(size, pagesize);
+    new_block = g_malloc0(sizeof(*new_block));
+    new_block->mr = mr;
+    new_block->used_length = size;
+    new_block->max_length = size;
+    new_block->fd = -1;
+    new_block->page_size = pagesize;
+    new_block->host = qemu_ram_mmap_hugetlb(size, pagesize, share);
+    if (new_block->host == MAP_FAILED) {
+        error_setg_errno(errp, errno,
+                         "cannot allocate 0x%" PRIx64 " bytes of huge pages "
+                         "of size 0x%" PRIx64 " for '%s'",
+                         (uint64_t)size, pagesize, memory_region_name(mr));
+        g_free(new_block);
+        return NULL;
+    }
+    mr->align = pagesize;
+
+    ram_block_add(new_block, &local_err, share);
+    if (local_err) {
+        qemu_ram_munmap(-1, new_block->host, size);
+        g_free(new_block);
+        error_propagate(errp, local_err);
+        return NULL;
+    }
+    return new_block;
+}
+
 static
 RAMBlock *qemu_ram_alloc_internal(ram_addr_t size, ram_addr_t max_size,
                                   void (*resized)(const char*,
@@ -3037,6 +3137,10 @@ static void tcg_commit(MemoryListener *listener)
      * may have split the RCU critical section.
      */
     d = address_space_to_dispatch(cpuas->as);
+    if (d == cpuas->memory_dispatch) {
+        /* The flat view of this address space did not change.  */
+        return;
+    }
     atomic_rcu_set(&cpuas->memory_dispatch, d);
     tlb_flush(cpuas->cpu);
 }
@@ -4036,7 +4140,11 @@ int ram_block_discard_range(RAMBlock *rb, uint64_t start, size_t length)
          *    fallocate works on hugepages and shmem
          */
         need_madvise = (rb->page_size == qemu_host_page_size);
-        need_fallocate = rb->fd != -1;
+        /*
+         * Never punch holes into the template of a clone.  Discarded pages
+         * of a clone read back the template contents instead of zeroes.
+         */
+        need_fallocate = rb->fd != -1 && !(rb->flags & RAM_CLONE);
         if (need_fallocate) {
             /* For a file, this causes the area of the file to be zero'd
              * if read, and for hugetlbfs also causes it to be unmapped
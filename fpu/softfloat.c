@@ -2239,6 +2239,22 @@ int16_t float32_to_int16_round_to_zero(float32 a, float_status *s)
 
 int32_t float32_to_int32_round_to_zero(float32 a, float_status *s)
 {
+    union_float32 ua;
+
+    /*
+     * Truncation is what C does, a normal input in range only needs
+     * the inexact flag checked.
+     */
+    ua.s = a;
+    if (likely(float32_is_normal(a)) &&
+        ua.h > -2147483649.0 && ua.h < 2147483648.0) {
+        int32_t r = ua.h;
+
+        if ((double)r != ua.h) {
+            s->float_exception_flags |= float_flag_inexact;
+        }
+        return r;
+    }
     return float32_to_int32_scalbn(a, float_round_to_zero, 0, s);
 }
 
@@ -2254,6 +2270,18 @@ int16_t float64_to_int16_round_to_zero(float64 a, float_status *s)
 
 int32_t float64_to_int32_round_to_zero(float64 a, float_status *s)
 {
+    union_float64 ua;
+
+    ua.s = a;
+    if (likely(float64_is_normal(a)) &&
+        ua.h > -2147483649.0 && ua.h < 2147483648.0) {
+        int32_t r = ua.h;
+
+        if (r != ua.h) {
+            s->float_exception_flags |= float_flag_inexact;
+        }
+        return r;
+    }
     return float64_to_int32_scalbn(a, float_round_to_zero, 0, s);
 }
 
@@ -2452,6 +2480,17 @@ uint16_t float32_to_uint16_round_to_zero(float32 a, float_status *s)
 
 uint32_t float32_to_uint32_round_to_zero(float32 a, float_status *s)
 {
+    union_float32 ua;
+
+    ua.s = a;
+    if (likely(float32_is_normal(a)) && ua.h > 0 && ua.h < 4294967296.0) {
+        uint32_t r = ua.h;
+
+        if ((double)r != ua.h) {
+            s->float_exception_flags |= float_flag_inexact;
+        }
+        return r;
+    }
     return float32_to_uint32_scalbn(a, float_round_to_zero, 0, s);
 }
 
@@ -2562,6 +2601,12 @@ float32 int64_to_float32(int64_t a, float_status *status)
 
 float32 int32_to_float32(int32_t a, float_status *status)
 {
+    if (can_use_fpu(status)) {
+        union_float32 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return int64_to_float32_scalbn(a, 0, status);
 }
 
@@ -2593,7 +2638,11 @@ float64 int64_to_float64(int64_t a, float_status *status)
 
 float64 int32_to_float64(int32_t a, float_status *status)
 {
-    return int64_to_float64_scalbn(a, 0, status);
+    union_float64 ur;
+
+    /* Always exact.  */
+    ur.h = a;
+    return ur.s;
 }
 
 float64 int16_to_float64(int16_t a, float_status *status)
@@ -2687,6 +2736,12 @@ float32 uint64_to_float32(uint64_t a, float_status *status)
 
 float32 uint32_to_float32(uint32_t a, float_status *status)
 {
+    if (can_use_fpu(status)) {
+        union_float32 ur;
+
+        ur.h = a;
+        return ur.s;
+    }
     return uint64_to_float32_scalbn(a, 0, status);
 }
 
@@ -2718,7 +2773,10 @@ float64 uint64_to_float64(uint64_t a, float_status *status)
 
 float64 uint32_to_float64(uint32_t a, float_status *status)
 {
-    return uint64_to_float64_scalbn(a, 0, status);
+    union_float64 ur;
+
+    ur.h = a;
+    return ur.s;
 }
 
 float64 uint16_to_float64(uint16_t a, float_status *status)
@@ -2831,22 +2889,51 @@ MINMAX(16, max, false, false, false)
 MINMAX(16, maxnum, false, true, false)
 MINMAX(16, maxnummag, false, true, true)
 
-MINMAX(32, min, true, false, false)
-MINMAX(32, minnum, true, true, false)
 MINMAX(32, minnummag, true, true, true)
-MINMAX(32, max, false, false, false)
-MINMAX(32, maxnum, false, true, false)
 MINMAX(32, maxnummag, false, true, true)
 
-MINMAX(64, min, true, false, false)
-MINMAX(64, minnum, true, true, false)
 MINMAX(64, minnummag, true, true, true)
-MINMAX(64, max, false, false, false)
-MINMAX(64, maxnum, false, true, false)
 MINMAX(64, maxnummag, false, true, true)
 
 #undef MINMAX
 
+/*
+ * For zero-or-normal inputs min/max neither rounds nor raises any flag,
+ * so a host comparison gives the answer. A pair of zeros is left to
+ * the soft path, the host does not order -0 and +0.
+ */
+#define MINMAX_FAST(sz, name, ismin, isiee)                             \
+float ## sz float ## sz ## _ ## name(float ## sz a, float ## sz b,      \
+                                     float_status *s)                   \
+{                                                                       \
+    union_float ## sz ua, ub;                                           \
+                                                                        \
+    ua.s = a;                                                           \
+    ub.s = b;                                                           \
+    if (likely(f ## sz ## _is_zon2(ua, ub)) &&                          \
+        !(float ## sz ## _is_zero(a) && float ## sz ## _is_zero(b))) {  \
+        return (ua.h < ub.h) ^ ismin ? b : a;                           \
+    } else {                                                            \
+        FloatParts pa = float ## sz ## _unpack_canonical(a, s);         \
+        FloatParts pb = float ## sz ## _unpack_canonical(b, s);         \
+        FloatParts pr = minmax_floats(pa, pb, ismin, isiee, false, s);  \
+                                                                        \
+        return float ## sz ## _round_pack_canonical(pr, s);             \
+    }                                                                   \
+}
+
+MINMAX_FAST(32, min, true, false)
+MINMAX_FAST(32, minnum, true, true)
+MINMAX_FAST(32, max, false, false)
+MINMAX_FAST(32, maxnum, false, true)
+
+MINMAX_FAST(64, min, true, false)
+MINMAX_FAST(64, minnum, true, true)
+MINMAX_FAST(64, max, false, false)
+MINMAX_FAST(64, maxnum, false, true)
+
+#undef MINMAX_FAST
+
 /* Floating point compare */
 static FloatRelation compare_floats(FloatParts a, FloatParts b, bool is_quiet,
                                     float_status *s)
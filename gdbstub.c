@@ -43,7 +43,8 @@
 #include "hw/boards.h"
 #endif
 
-#define MAX_PACKET_LENGTH 4096
+/* Large enough for gdb to load and dump memory in big binary packets */
+#define MAX_PACKET_LENGTH 0x20000
 
 #include "qemu/sockets.h"
 #include "sysemu/hw_accel.h"
@@ -897,7 +898,7 @@ static const char *get_feature_xml(const char *p, const char **newp,
     return name ? xml_builtin[i][1] : NULL;
 }
 
-static int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg)
+int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg)
 {
     CPUClass *cc = CPU_GET_CLASS(cpu);
     CPUArchState *env = cpu->env_ptr;
@@ -1769,6 +1770,75 @@ static void handle_write_mem(GdbCmdContext *gdb_ctx, void *user_ctx)
     put_packet("OK");
 }
 
+static void handle_write_mem_binary(GdbCmdContext *gdb_ctx, void *user_ctx)
+{
+    const char *data;
+    size_t len;
+
+    if (gdb_ctx->num_params < 2) {
+        put_packet("E22");
+        return;
+    }
+
+    /* gdb probes for X support with an empty write */
+    len = gdb_ctx->params[1].val_ull;
+    if (!len) {
+        put_packet("OK");
+        return;
+    }
+
+    /*
+     * The data was unescaped on reception and may contain NUL bytes, so
+     * find it and its length in the line buffer rather than in params.
+     */
+    data = memchr(gdbserver_state.line_buf, ':',
+                  gdbserver_state.line_buf_index);
+    if (!data ||
+        len != gdbserver_state.line_buf + gdbserver_state.line_buf_index -
+               (data + 1)) {
+        put_packet("E22");
+        return;
+    }
+    data++;
+
+    if (target_memory_rw_debug(gdbserver_state.g_cpu, gdb_ctx->params[0].val_ull,
+                               (uint8_t *)data, len, true)) {
+        put_packet("E14");
+        return;
+    }
+
+    put_packet("OK");
+}
+
+static void handle_read_mem_binary(GdbCmdContext *gdb_ctx, void *user_ctx)
+{
+    if (gdb_ctx->num_params != 2) {
+        put_packet("E22");
+        return;
+    }
+
+    /* memtox() at worst doubles the required space */
+    if (gdb_ctx->params[1].val_ull > (MAX_PACKET_LENGTH - 5) / 2) {
+        put_packet("E22");
+        return;
+    }
+
+    g_byte_array_set_size(gdbserver_state.mem_buf, gdb_ctx->params[1].val_ull);
+
+    if (target_memory_rw_debug(gdbserver_state.g_cpu, gdb_ctx->params[0].val_ull,
+                               gdbserver_state.mem_buf->data,
+                               gdbserver_state.mem_buf->len, false)) {
+        put_packet("E14");
+        return;
+    }
+
+    g_string_assign(gdbserver_state.str_buf, "b");
+    memtox(gdbserver_state.str_buf, (const char *)gdbserver_state.mem_buf->data,
+           gdbserver_state.mem_buf->len);
+    put_packet_binary(gdbserver_state.str_buf->str,
+                      gdbserver_state.str_buf->len, true);
+}
+
 static void handle_read_mem(GdbCmdContext *gdb_ctx, void *user_ctx)
 {
     if (gdb_ctx->num_params != 2) {
@@ -2127,6 +2197,7 @@ static void handle_query_supported(GdbCmdContext *gdb_ctx, void *user_ctx)
     }
 
     g_string_append(gdbserver_state.str_buf, ";vContSupported+;multiprocess+");
+    g_string_append(gdbserver_state.str_buf, ";binary-upload+");
     g_string_append(gdbserver_state.str_buf, ";qXfer:osdata:read+");
     put_strbuf();
 }
@@ -2588,6 +2659,28 @@ static int gdb_handle_packet(const char *line_buf)
             cmd_parser = &write_mem_cmd_desc;
         }
         break;
+    case 'x':
+        {
+            static const GdbCmdParseEntry read_mem_binary_cmd_desc = {
+                .handler = handle_read_mem_binary,
+                .cmd = "x",
+                .cmd_startswith = 1,
+                .schema = "L,L0"
+            };
+            cmd_parser = &read_mem_binary_cmd_desc;
+        }
+        break;
+    case 'X':
+        {
+            static const GdbCmdParseEntry write_mem_binary_cmd_desc = {
+                .handler = handle_write_mem_binary,
+                .cmd = "X",
+                .cmd_startswith = 1,
+                .schema = "L,L:s0"
+            };
+            cmd_parser = &write_mem_binary_cmd_desc;
+        }
+        break;
     case 'p':
         {
             static const GdbCmdParseEntry get_reg_cmd_desc = {
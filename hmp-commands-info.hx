@@ -323,6 +323,21 @@ SRST
     being coalesced.
 ERST
 
+    {
+        .name       = "mmio-profile",
+        .args_type  = "max:i?",
+        .params     = "[max]",
+        .help       = "show the registers that took most time in MMIO "
+                      "dispatch, up to max entries (default: 16, 0: all)",
+        .cmd        = hmp_info_mmio_profile,
+    },
+
+SRST
+  ``info mmio-profile`` [*max*]
+    Show MMIO profiling info, up to *max* registers (default: 16), sorted
+    by total host time spent in their accesses.
+ERST
+
     {
         .name       = "kvm",
         .args_type  = "",
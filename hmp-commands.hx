@@ -625,6 +625,21 @@ SRST
   whether profiling is on or off.
 ERST
 
+    {
+        .name       = "mmio-profile",
+        .args_type  = "op:s?",
+        .params     = "[on|off|reset]",
+        .help       = "enable, disable or reset MMIO access profiling. "
+                      "With no arguments, prints whether profiling is on or off.",
+        .cmd        = hmp_mmio_profile,
+    },
+
+SRST
+``mmio-profile [on|off|reset]``
+  Enable, disable or reset MMIO access profiling. With no arguments, prints
+  whether profiling is on or off.
+ERST
+
     {
         .name       = "system_reset",
         .args_type  = "",
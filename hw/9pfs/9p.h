@@ -215,6 +215,13 @@ static inline void v9fs_readdir_init(V9fsDir *dir)
     qemu_co_mutex_init(&dir->readdir_mutex);
 }
 
+/* List of directory entries read by v9fs_co_readdir_many() */
+typedef struct V9fsDirEnt {
+    struct dirent *dent;
+    struct stat *st;            /* NULL unless requested */
+    struct V9fsDirEnt *next;
+} V9fsDirEnt;
+
 /*
  * Filled by fs driver on open and other
  * calls.
@@ -421,6 +428,8 @@ void v9fs_path_sprintf(V9fsPath *path, const char *fmt, ...);
 void v9fs_path_copy(V9fsPath *dst, const V9fsPath *src);
 int v9fs_name_to_path(V9fsState *s, V9fsPath *dirpath,
                       const char *name, V9fsPath *path);
+size_t v9fs_readdir_data_size(V9fsString *name);
+void v9fs_free_dirents(V9fsDirEnt *e);
 int v9fs_device_realize_common(V9fsState *s, const V9fsTransport *t,
                                Error **errp);
 void v9fs_device_unrealize_common(V9fsState *s);
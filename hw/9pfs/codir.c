@@ -43,6 +43,110 @@ int coroutine_fn v9fs_co_readdir(V9fsPDU *pdu, V9fsFidState *fidp,
     return err;
 }
 
+/*
+ * Worker side of v9fs_co_readdir_many(): reads entries as long as their
+ * R_readdir encoding fits in @maxsize bytes, and leaves the directory
+ * stream at the first entry that did not fit.
+ */
+static int do_readdir_many(V9fsPDU *pdu, V9fsFidState *fidp,
+                           V9fsDirEnt **entries, int32_t maxsize,
+                           bool dostat)
+{
+    V9fsState *s = pdu->s;
+    V9fsString name;
+    int32_t size = 0;
+    off_t saved_dir_pos;
+    struct dirent *dent;
+    struct stat stbuf;
+    V9fsDirEnt *e = NULL;
+    V9fsPath path;
+    size_t len;
+    int err = 0;
+
+    *entries = NULL;
+
+    saved_dir_pos = s->ops->telldir(&s->ctx, &fidp->fs);
+    if (saved_dir_pos < 0) {
+        return -errno;
+    }
+
+    v9fs_path_init(&path);
+    while (true) {
+        /* Stop early if the request was flushed */
+        if (v9fs_request_cancelled(pdu)) {
+            err = -EINTR;
+            break;
+        }
+
+        errno = 0;
+        dent = s->ops->readdir(&s->ctx, &fidp->fs);
+        if (!dent) {
+            err = -errno;
+            break;
+        }
+
+        v9fs_string_init(&name);
+        v9fs_string_sprintf(&name, "%s", dent->d_name);
+        len = v9fs_readdir_data_size(&name);
+        v9fs_string_free(&name);
+        if (size + len > maxsize) {
+            /* Ran out of buffer, the client reads this entry next time */
+            s->ops->seekdir(&s->ctx, &fidp->fs, saved_dir_pos);
+            break;
+        }
+        size += len;
+
+        if (e) {
+            e = e->next = g_new0(V9fsDirEnt, 1);
+        } else {
+            e = *entries = g_new0(V9fsDirEnt, 1);
+        }
+        e->dent = g_memdup(dent, sizeof(struct dirent));
+
+        if (dostat) {
+            err = s->ops->name_to_path(&s->ctx, &fidp->path, dent->d_name,
+                                       &path);
+            if (!err) {
+                err = s->ops->lstat(&s->ctx, &path, &stbuf);
+            }
+            v9fs_path_free(&path);
+            if (err < 0) {
+                err = -errno;
+                break;
+            }
+            e->st = g_memdup(&stbuf, sizeof(struct stat));
+        }
+
+        saved_dir_pos = dent->d_off;
+    }
+
+    return err < 0 ? err : size;
+}
+
+/*
+ * Reads as many directory entries as fit in an R_readdir payload of
+ * @maxsize bytes, with the stat of each one if @dostat, in a single
+ * trip to a worker thread rather than one or more per entry.  Returns
+ * the payload size, or a negative errno.  The caller frees @entries
+ * with v9fs_free_dirents() in either case.
+ */
+int coroutine_fn v9fs_co_readdir_many(V9fsPDU *pdu, V9fsFidState *fidp,
+                                      V9fsDirEnt **entries, int32_t maxsize,
+                                      bool dostat)
+{
+    int err = 0;
+
+    *entries = NULL;
+    if (v9fs_request_cancelled(pdu)) {
+        return -EINTR;
+    }
+    v9fs_co_run_in_worker(
+        {
+            err = do_readdir_many(pdu, fidp, entries, maxsize, dostat);
+        });
+    return err;
+}
+
 off_t v9fs_co_telldir(V9fsPDU *pdu, V9fsFidState *fidp)
 {
     off_t err;
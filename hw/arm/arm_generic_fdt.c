@@ -104,7 +104,7 @@ static int zynq7000_mdio_phy_connect(char *node_path, FDTMachineInfo *fdti,
 
     /* Register MDIO obj instance to fdti, useful during child registration */
     fdt_init_set_opaque(fdti, node_path, Opaque);
-    if (qemu_devtree_getparent(fdti->fdt, parent_node_path, node_path)) {
+    if (fdt_init_get_parent(fdti, parent_node_path, node_path)) {
         abort();
     }
 
@@ -134,7 +134,7 @@ static int zynq7000_mdio_phy_create(char *node_path, FDTMachineInfo *fdti,
     DeviceState *dev;
     uint32_t reg;
 
-    if (qemu_devtree_getparent(fdti->fdt, parent_node_path, node_path)) {
+    if (fdt_init_get_parent(fdti, parent_node_path, node_path)) {
         abort();
     }
 
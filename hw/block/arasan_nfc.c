@@ -24,6 +24,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/units.h"
 #include "qemu/timer.h"
 #include "qemu/bitops.h"
 #include "sysemu/sysemu.h"
@@ -258,35 +259,53 @@ static inline bool arasan_nfc_ecc_enabled(ArasanNFCState *s)
 
 static void arasan_nfc_ecc_init(ArasanNFCState *s)
 {
-    /* FIXME: Bad performance */
-    memset(s->ecc_digest, 0xFF, 16 * 1024);
+    /* Only the first ECC_SIZE bytes of the digest are ever consumed */
+    memset(s->ecc_digest, 0xFF, ARRAY_FIELD_EX32(s->regs, ECC, ECC_SIZE));
     s->ecc_pos = 0;
     s->ecc_subpage_offset = 0;
 }
 
 /* not an ECC algorithm, but gives a deterministic OOB that
  * depends on the in band data
+ *
+ * Each codeword is folded into its own ecc_bytes_per_subpage sized slice
+ * of the digest.
  */
 
-static void arasan_nfc_ecc_digest(ArasanNFCState *s, uint8_t data)
+static void arasan_nfc_ecc_digest(ArasanNFCState *s, const uint8_t *data,
+                                  uint32_t len)
 {
     uint32_t page_size = arasan_nfc_page_size_lookup[ARRAY_FIELD_EX32(s->regs,
                                                                       CMD,
                                                                    PAGE_SIZE)];
-    int ecc_bytes_per_subpage = ARRAY_FIELD_EX32(s->regs, ECC, ECC_SIZE) /
-                                (page_size / ECC_CODEWORD_SIZE);
+    uint32_t ecc_bytes_per_subpage = ARRAY_FIELD_EX32(s->regs, ECC, ECC_SIZE) /
+                                     (page_size / ECC_CODEWORD_SIZE);
 
-    s->ecc_digest[s->ecc_pos++] ^= ~data;
-    if (!(s->ecc_pos % ecc_bytes_per_subpage)) {
-        s->ecc_pos -= ecc_bytes_per_subpage;
+    if (!ecc_bytes_per_subpage) {
+        return;
     }
 
-    s->ecc_subpage_offset++;
-    if (s->ecc_subpage_offset == ECC_CODEWORD_SIZE) {
-        s->ecc_subpage_offset = 0;
-        do {
-            s->ecc_pos++;
-        } while (s->ecc_pos % ecc_bytes_per_subpage);
+    while (len) {
+        uint32_t col = s->ecc_pos % ecc_bytes_per_subpage;
+        uint8_t *slice = &s->ecc_digest[s->ecc_pos - col];
+        uint32_t n = MIN(len, ECC_CODEWORD_SIZE - s->ecc_subpage_offset);
+        uint32_t i;
+
+        for (i = 0; i < n; i++) {
+            slice[col] ^= ~data[i];
+            if (++col == ecc_bytes_per_subpage) {
+                col = 0;
+            }
+        }
+        data += n;
+        len -= n;
+
+        s->ecc_subpage_offset += n;
+        if (s->ecc_subpage_offset == ECC_CODEWORD_SIZE) {
+            s->ecc_subpage_offset = 0;
+            col = ecc_bytes_per_subpage;
+        }
+        s->ecc_pos = slice - s->ecc_digest + col;
     }
 }
 
@@ -386,38 +405,39 @@ static inline void arasan_nfc_do_dma(ArasanNFCState *s, bool rnw)
 {
     DMADirection dir = rnw ? DMA_DIRECTION_FROM_DEVICE :
                              DMA_DIRECTION_TO_DEVICE;
-    int debug_squelch = 5;
 
-    /* FIXME: Be less dumb */
+    /* Move as much as possible at once, stopping at the buffer boundary */
     while (ARRAY_FIELD_EX32(s->regs, CMD, DMA_EN) == 0x2 &&
            !(rnw ? fifo_is_empty : fifo_is_full)(&s->buffer) &&
            !s->dbb_blocked) {
         uint32_t dbb_mask = MAKE_64BIT_MASK(0,
                                             s->regs[R_DMA_BUF_BOUNDARY] + 12);
-        uint8_t tmp;
+        bool dbb = s->regs[R_DMA_BUF_BOUNDARY] & 1 << 3;
+        uint8_t tmp[4 * KiB];
+        uint32_t len;
 
-        if (rnw) {
-            tmp = fifo_pop8(&s->buffer);
+        len = rnw ? fifo_num_used(&s->buffer) : fifo_num_free(&s->buffer);
+        if (dbb) {
+            len = MIN(len, dbb_mask - (s->dma_sar & dbb_mask) + 1);
         }
 
-        dma_memory_rw(s->dma_as, s->dma_sar, &tmp, 1, dir);
-
-        if (debug_squelch) {
-            DB_PRINT("Doing dma %s with addr %08" PRIx64 " = %02" PRIx8 "\n",
-                     rnw ? "read" : "write", s->dma_sar, tmp);
-            debug_squelch--;
-        }
+        if (rnw) {
+            const void *buf = fifo_pop_buf(&s->buffer, len, &len);
 
-        if (!rnw) {
-            fifo_push8(&s->buffer, tmp);
+            dma_memory_rw(s->dma_as, s->dma_sar, (void *)buf, len, dir);
+        } else {
+            len = MIN(len, sizeof(tmp));
+            dma_memory_rw(s->dma_as, s->dma_sar, tmp, len, dir);
+            fifo_push_all(&s->buffer, tmp, len);
         }
+        DB_PRINT("Doing dma %s with addr %08" PRIx64 " len %" PRIu32 "\n",
+                 rnw ? "read" : "write", s->dma_sar, len);
 
-        if ((s->regs[R_DMA_BUF_BOUNDARY] & 1 << 3) &&
-            (s->dma_sar & dbb_mask) == dbb_mask) {
+        s->dma_sar += len;
+        if (dbb && ((s->dma_sar - 1) & dbb_mask) == dbb_mask) {
             s->dbb_blocked = true;
-	        arasan_nfc_irq_event(s, R_INT_DMA_INT);
+            arasan_nfc_irq_event(s, R_INT_DMA_INT);
         }
-        s->dma_sar++;
     }
 }
 
@@ -498,14 +518,18 @@ static inline void arasan_nfc_update_state(ArasanNFCState *s)
             if (arasan_nfc_write_check_ecc(s)) {
                 arasan_nfc_ecc_init(s);
             }
-		    while (!fifo_is_empty(&s->buffer)) {
-		    	uint8_t to_write = fifo_pop8(&s->buffer);
+            while (!fifo_is_empty(&s->buffer)) {
+                uint32_t len;
+                const uint8_t *buf = fifo_pop_buf(&s->buffer,
+                                                  fifo_num_used(&s->buffer),
+                                                  &len);
+
                 if (arasan_nfc_write_check_ecc(s)) {
-                    arasan_nfc_ecc_digest(s, to_write);
+                    arasan_nfc_ecc_digest(s, buf, len);
                 }
-		    	nand_setio(s->current, to_write);
-				DB_PRINT("write byte %#02" PRIx8 "\n", to_write);
-		    }
+                nand_setbuf(s->current, buf, len);
+                DB_PRINT("write %" PRIu32 " bytes\n", len);
+            }
             if (arasan_nfc_write_check_ecc(s)) {
                 arasan_nfc_do_cmd(s, 2, true, false);
                 nand_setpins(s->current, 0, 0, 0, 1, 0); /* data */
@@ -610,6 +634,7 @@ static void arasan_nfc_r_dma_system_addr_pw(RegisterInfo *reg, uint64_t val)
 static uint64_t r_program_pre_write(RegisterInfo *reg, uint64_t val)
 {
     ArasanNFCState *s = ARASAN_NFC(reg->opaque);
+    uint8_t *page;
     int i, j;
 
     DB_PRINT("val = %#08" PRIx32 "\n", (uint32_t)val);
@@ -698,14 +723,14 @@ static uint64_t r_program_pre_write(RegisterInfo *reg, uint64_t val)
                 arasan_nfc_ecc_init(s);
             }
             nand_setpins(s->current, 0, 0, 0, 1, 0); /* data */
-            for (j = 0; j < payload_size; ++j) {
-                uint8_t to_read = nand_getio(s->current);
-                if (arasan_nfc_ecc_enabled(s)) {
-                    arasan_nfc_ecc_digest(s, to_read);
-                }
-                fifo_push8(&s->buffer, to_read);
-                DB_PRINT("read byte %#02" PRIx8 "\n", to_read);
+            page = g_malloc(payload_size);
+            nand_getbuf(s->current, page, payload_size);
+            if (arasan_nfc_ecc_enabled(s)) {
+                arasan_nfc_ecc_digest(s, page, payload_size);
             }
+            fifo_push_all(&s->buffer, page, payload_size);
+            g_free(page);
+            DB_PRINT("read %" PRIu32 " bytes\n", payload_size);
             /* FIXME: ECC is done backwards for reads, reading the payload
              * first, then the ECC data late. Real HW is the other way round.
              */
@@ -0,0 +1,164 @@
+/*
+ * Deferred, coalesced write-back for flash models backed by a block device
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/error-report.h"
+#include "qemu/timer.h"
+#include "sysemu/block-backend.h"
+#include "sysemu/runstate.h"
+#include "hw/block/flash.h"
+#include "trace.h"
+
+typedef struct FlashWritebackReq {
+    FlashWriteback *wb;
+    QEMUIOVector qiov;
+} FlashWritebackReq;
+
+static void flash_writeback_complete(void *opaque, int ret)
+{
+    FlashWritebackReq *req = opaque;
+    FlashWriteback *wb = req->wb;
+
+    if (ret < 0) {
+        error_report("Could not update flash backing store: %s",
+                     strerror(-ret));
+    }
+
+    qemu_iovec_destroy(&req->qiov);
+    g_free(req);
+    assert(wb->in_flight);
+    wb->in_flight--;
+}
+
+/* Issue one write for each run of dirty chunks.  */
+static void flash_writeback_issue(FlashWriteback *wb)
+{
+    uint64_t start = find_first_bit(wb->dirty, wb->nb_chunks);
+
+    while (start < wb->nb_chunks) {
+        uint64_t end = find_next_zero_bit(wb->dirty, wb->nb_chunks, start);
+        uint64_t off = start * FLASH_WRITEBACK_CHUNK;
+        uint64_t len = MIN(end * FLASH_WRITEBACK_CHUNK, wb->size) - off;
+        FlashWritebackReq *req = g_new(FlashWritebackReq, 1);
+
+        bitmap_clear(wb->dirty, start, end - start);
+        trace_flash_writeback(wb, off, len);
+
+        req->wb = wb;
+        qemu_iovec_init(&req->qiov, 1);
+        qemu_iovec_add(&req->qiov, wb->storage + off, len);
+        wb->in_flight++;
+        blk_aio_pwritev(wb->blk, off, &req->qiov, 0,
+                        flash_writeback_complete, req);
+
+        start = find_next_bit(wb->dirty, wb->nb_chunks, end);
+    }
+    wb->is_dirty = false;
+}
+
+static void flash_writeback_timer(void *opaque)
+{
+    FlashWriteback *wb = opaque;
+
+    if (wb->in_flight) {
+        /*
+         * Overlapping writes may complete in any order, keep the previous
+         * batch from landing after this one.
+         */
+        timer_mod(wb->timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + wb->delay_ms);
+        return;
+    }
+    flash_writeback_issue(wb);
+}
+
+static void flash_writeback_vm_state(void *opaque, int running,
+                                     RunState state)
+{
+    FlashWriteback *wb = opaque;
+
+    if (!running) {
+        /* The block layer is drained right after this.  */
+        flash_writeback_flush(wb);
+    }
+}
+
+void flash_writeback_init(FlashWriteback *wb, BlockBackend *blk,
+                          void *storage, uint64_t size, uint32_t delay_ms)
+{
+    memset(wb, 0, sizeof(*wb));
+    if (!blk || blk_is_read_only(blk)) {
+        return;
+    }
+
+    wb->blk = blk;
+    wb->storage = storage;
+    wb->size = size;
+    wb->delay_ms = delay_ms;
+    wb->nb_chunks = DIV_ROUND_UP(size, FLASH_WRITEBACK_CHUNK);
+    wb->dirty = bitmap_new(wb->nb_chunks);
+    wb->timer = timer_new_ms(QEMU_CLOCK_REALTIME, flash_writeback_timer, wb);
+    wb->vmstate = qemu_add_vm_change_state_handler(flash_writeback_vm_state,
+                                                   wb);
+}
+
+void flash_writeback_cleanup(FlashWriteback *wb)
+{
+    if (!wb->dirty) {
+        return;
+    }
+
+    flash_writeback_flush(wb);
+    blk_drain(wb->blk);
+    qemu_del_vm_change_state_handler(wb->vmstate);
+    timer_free(wb->timer);
+    g_free(wb->dirty);
+    wb->dirty = NULL;
+}
+
+void flash_writeback_mark(FlashWriteback *wb, uint64_t offset, uint64_t len)
+{
+    uint64_t first, last;
+
+    if (!wb->dirty || !len) {
+        return;
+    }
+
+    assert(offset + len <= wb->size);
+    first = offset / FLASH_WRITEBACK_CHUNK;
+    last = (offset + len - 1) / FLASH_WRITEBACK_CHUNK;
+    if (first == last) {
+        set_bit(first, wb->dirty);
+    } else {
+        bitmap_set(wb->dirty, first, last - first + 1);
+    }
+
+    if (!wb->delay_ms) {
+        flash_writeback_flush(wb);
+    } else if (!wb->is_dirty) {
+        /* The delay counts from the first update of a batch.  */
+        wb->is_dirty = true;
+        timer_mod(wb->timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + wb->delay_ms);
+    }
+}
+
+void flash_writeback_flush(FlashWriteback *wb)
+{
+    if (!wb->dirty) {
+        return;
+    }
+
+    timer_del(wb->timer);
+    if (wb->in_flight) {
+        blk_drain(wb->blk);
+    }
+    flash_writeback_issue(wb);
+}
@@ -25,6 +25,7 @@
 #include "qemu/units.h"
 #include "sysemu/block-backend.h"
 #include "hw/qdev-properties.h"
+#include "hw/block/flash.h"
 #include "hw/ssi/ssi.h"
 #include "migration/vmstate.h"
 #include "qemu/bitops.h"
@@ -470,7 +471,8 @@ typedef struct Flash {
     bool hpm_enable;
     uint8_t ear;
 
-    int64_t dirty_page;
+    FlashWriteback wb;
+    uint32_t writeback_delay_ms;
 
     const FlashPartInfo *pi;
 
@@ -509,49 +511,6 @@ static inline Manufacturer get_man(Flash *s)
     }
 }
 
-static void blk_sync_complete(void *opaque, int ret)
-{
-    QEMUIOVector *iov = opaque;
-
-    qemu_iovec_destroy(iov);
-    g_free(iov);
-
-    /* do nothing. Masters do not directly interact with the backing store,
-     * only the working copy so no mutexing required.
-     */
-}
-
-static void flash_sync_page(Flash *s, int page)
-{
-    QEMUIOVector *iov;
-
-    if (!s->blk || blk_is_read_only(s->blk)) {
-        return;
-    }
-
-    iov = g_new(QEMUIOVector, 1);
-    qemu_iovec_init(iov, 1);
-    qemu_iovec_add(iov, s->storage + page * s->pi->page_size,
-                   s->pi->page_size);
-    blk_aio_pwritev(s->blk, page * s->pi->page_size, iov, 0,
-                    blk_sync_complete, iov);
-}
-
-static inline void flash_sync_area(Flash *s, int64_t off, int64_t len)
-{
-    QEMUIOVector *iov;
-
-    if (!s->blk || blk_is_read_only(s->blk)) {
-        return;
-    }
-
-    assert(!(len % BDRV_SECTOR_SIZE));
-    iov = g_new(QEMUIOVector, 1);
-    qemu_iovec_init(iov, 1);
-    qemu_iovec_add(iov, s->storage + off, len);
-    blk_aio_pwritev(s->blk, off, iov, 0, blk_sync_complete, iov);
-}
-
 static void flash_erase(Flash *s, int offset, FlashCMD cmd)
 {
     uint32_t len;
@@ -601,21 +560,12 @@ static void flash_erase(Flash *s, int offset, FlashCMD cmd)
         return;
     }
     memset(s->storage + offset, 0xff, len);
-    flash_sync_area(s, offset, len);
-}
-
-static inline void flash_sync_dirty(Flash *s, int64_t newpage)
-{
-    if (s->dirty_page >= 0 && s->dirty_page != newpage) {
-        flash_sync_page(s, s->dirty_page);
-        s->dirty_page = newpage;
-    }
+    flash_writeback_mark(&s->wb, offset, len);
 }
 
 static inline
 void flash_write8(Flash *s, uint32_t addr, uint8_t data)
 {
-    uint32_t page = addr / s->pi->page_size;
     uint8_t prev = s->storage[s->cur_addr];
 
     if (!s->write_enable) {
@@ -632,8 +582,7 @@ void flash_write8(Flash *s, uint32_t addr, uint8_t data)
         s->storage[s->cur_addr] &= data;
     }
 
-    flash_sync_dirty(s, page);
-    s->dirty_page = page;
+    flash_writeback_mark(&s->wb, s->cur_addr, 1);
 }
 
 static inline int get_addr_length(Flash *s)
@@ -1310,7 +1259,6 @@ static int m25p80_cs(SSISlave *ss, bool select)
         s->len = 0;
         s->pos = 0;
         s->state = STATE_IDLE;
-        flash_sync_dirty(s, -1);
         s->data_read_loop = false;
     }
 
@@ -1394,10 +1342,89 @@ static uint32_t m25p80_transfer8(SSISlave *ss, uint32_t tx)
     return r;
 }
 
+static size_t m25p80_transfer_bulk(SSISlave *ss, const uint8_t *tx,
+                                   uint8_t *rx, size_t len)
+{
+    Flash *s = M25P80(ss);
+    uint32_t page_size = s->pi->page_size;
+    size_t done = 0;
+
+    switch (s->state) {
+    case STATE_READ:
+        trace_m25p80_transfer_bulk(s, s->state, s->cur_addr, len);
+        while (done < len) {
+            size_t n = MIN(len - done, s->size - s->cur_addr);
+
+            if (rx) {
+                memcpy(rx + done, s->storage + s->cur_addr, n);
+            }
+            s->cur_addr = (s->cur_addr + n) & (s->size - 1);
+            done += n;
+        }
+        break;
+
+    case STATE_PAGE_PROGRAM:
+        trace_m25p80_transfer_bulk(s, s->state, s->cur_addr, len);
+        if (!s->write_enable) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "M25P80: write with write protect!\n");
+        }
+        while (done < len) {
+            size_t n = MIN(len - done, page_size - s->cur_addr % page_size);
+            uint8_t *p = s->storage + s->cur_addr;
+            size_t i;
+
+            n = MIN(n, s->size - s->cur_addr);
+            if (!tx) {
+                /* Programming zeroes clears the bits either way.  */
+                memset(p, 0, n);
+            } else if (s->pi->flags & EEPROM) {
+                memcpy(p, tx + done, n);
+            } else {
+                for (i = 0; i < n; i++) {
+                    p[i] &= tx[done + i];
+                }
+            }
+
+            flash_writeback_mark(&s->wb, s->cur_addr, n);
+            s->cur_addr = (s->cur_addr + n) & (s->size - 1);
+            done += n;
+        }
+        if (rx) {
+            memset(rx, 0, len);
+        }
+        break;
+
+    case STATE_READING_DATA:
+        /* Register reads are short, only the plain loop is worth it.  */
+        if (s->data_read_loop || s->pos >= s->len ||
+            s->len > M25P80_INTERNAL_DATA_BUFFER_SZ) {
+            return 0;
+        }
+        done = MIN(len, s->len - s->pos);
+        if (rx) {
+            memcpy(rx, s->data + s->pos, done);
+        }
+        s->pos += done;
+        if (s->pos == s->len) {
+            s->pos = 0;
+            s->state = STATE_IDLE;
+        }
+        break;
+
+    default:
+        /* Commands and addresses go through the byte state machine.  */
+        return 0;
+    }
+
+    return done;
+}
+
 static void m25p80_exit(Object *obj)
 {
     Flash *s = M25P80(obj);
 
+    flash_writeback_cleanup(&s->wb);
     g_free(s->nonvolatile_cfg_large);
     g_free(s->volatile_cfg_large);
     g_free(s->nv_cfg_large_stage);
@@ -1412,7 +1439,6 @@ static void m25p80_realize(SSISlave *ss, Error **errp)
     s->pi = mc->pi;
 
     s->size = s->pi->sector_size * s->pi->n_sectors;
-    s->dirty_page = -1;
 
     if (get_man(s) == MAN_MICRON_OCTAL) {
         s->nonvolatile_cfg_large = g_new(uint8_t, MICRON_OCTAL_CFG_SIZE);
@@ -1447,6 +1473,8 @@ static void m25p80_realize(SSISlave *ss, Error **errp)
             fprintf(stderr, "failed to read the initial flash content");
             exit(1);
         }
+        flash_writeback_init(&s->wb, s->blk, s->storage, s->size,
+                             s->writeback_delay_ms);
 
     } else {
         trace_m25p80_binding_no_bdrv(s);
@@ -1464,7 +1492,7 @@ static void m25p80_reset(DeviceState *d)
 
 static int m25p80_pre_save(void *opaque)
 {
-    flash_sync_dirty((Flash *)opaque, -1);
+    flash_writeback_flush(&((Flash *)opaque)->wb);
 
     return 0;
 }
@@ -1480,6 +1508,8 @@ static Property m25p80_properties[] = {
                       nv_cfg_large_stage,
                       qdev_prop_uint8, uint8_t),
     DEFINE_PROP_DRIVE("drive", Flash, blk),
+    /* Programs and erases reach the drive this long after the first one.  */
+    DEFINE_PROP_UINT32("writeback-delay-ms", Flash, writeback_delay_ms, 100),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -1595,6 +1625,7 @@ static void m25p80_class_init(ObjectClass *klass, void *data)
 
     k->realize = m25p80_realize;
     k->transfer = m25p80_transfer8;
+    k->transfer_bulk = m25p80_transfer_bulk;
     k->set_cs = m25p80_cs;
     k->cs_polarity = SSI_CS_LOW;
     dc->vmsd = &vmstate_m25p80;
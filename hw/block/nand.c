@@ -790,6 +790,57 @@ uint32_t nand_getio(DeviceState *dev)
     return x;
 }
 
+/*
+ * Bulk versions of nand_getio() and nand_setio() for 8-bit buses: data
+ * cycles within the current page are done with a single copy.
+ */
+void nand_getbuf(DeviceState *dev, uint8_t *buf, int len)
+{
+    NANDFlashState *s = NAND(dev);
+    int n;
+
+    while (len > 0) {
+        if (s->buswidth != 1 || s->cmd == NAND_CMD_READSTATUS ||
+            (!s->iolen && s->cmd == NAND_CMD_READ0)) {
+            /* Let nand_getio() deal with status and page loads */
+            *buf++ = nand_getio(dev);
+            len--;
+            continue;
+        }
+        if (s->ce || s->iolen <= 0) {
+            memset(buf, 0, len);
+            return;
+        }
+        n = MIN(len, s->iolen);
+        memcpy(buf, s->ioaddr, n);
+        s->addr   += n;
+        s->ioaddr += n;
+        s->iolen  -= n;
+        buf += n;
+        len -= n;
+    }
+}
+
+void nand_setbuf(DeviceState *dev, const uint8_t *buf, int len)
+{
+    NANDFlashState *s = NAND(dev);
+    int n;
+
+    if (s->buswidth != 1 || s->cle || s->ale ||
+        s->cmd != NAND_CMD_PAGEPROGRAM1) {
+        for (; len > 0; len--) {
+            nand_setio(dev, *buf++);
+        }
+        return;
+    }
+    /* Data past the end of the page register is dropped, as in nand_setio */
+    n = MIN(len, (1 << s->page_shift) + (1 << s->oob_shift) - s->iolen);
+    if (n > 0) {
+        memcpy(s->io + s->iolen, buf, n);
+        s->iolen += n;
+    }
+}
+
 uint32_t nand_getbuswidth(DeviceState *dev)
 {
     NANDFlashState *s = (NANDFlashState *) dev;
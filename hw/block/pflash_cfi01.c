@@ -94,6 +94,8 @@ struct PFlashCFI01 {
     MemoryRegion mem;
     char *name;
     void *storage;
+    FlashWriteback wb;
+    uint32_t writeback_delay_ms;
     VMChangeStateEntry *vmstate;
     bool old_multiple_chip_handling;
 };
@@ -386,23 +388,9 @@ static uint32_t pflash_read(PFlashCFI01 *pfl, hwaddr offset,
 }
 
 /* update flash content on disk */
-static void pflash_update(PFlashCFI01 *pfl, int offset,
-                          int size)
+static void pflash_update(PFlashCFI01 *pfl, int offset, int size)
 {
-    int offset_end;
-    int ret;
-    if (pfl->blk) {
-        offset_end = offset + size;
-        /* widen to sector boundaries */
-        offset = QEMU_ALIGN_DOWN(offset, BDRV_SECTOR_SIZE);
-        offset_end = QEMU_ALIGN_UP(offset_end, BDRV_SECTOR_SIZE);
-        ret = blk_pwrite(pfl->blk, offset, pfl->storage + offset,
-                   offset_end - offset, 0);
-        if (ret < 0) {
-            /* TODO set error bit in status */
-            error_report("Could not update PFLASH: %s", strerror(-ret));
-        }
-    }
+    flash_writeback_mark(&pfl->wb, offset, size);
 }
 
 static inline void pflash_data_write(PFlashCFI01 *pfl, hwaddr offset,
@@ -762,6 +750,8 @@ static void pflash_cfi01_realize(DeviceState *dev, Error **errp)
             vmstate_unregister_ram(&pfl->mem, DEVICE(pfl));
             return;
         }
+        flash_writeback_init(&pfl->wb, pfl->blk, pfl->storage, total_len,
+                             pfl->writeback_delay_ms);
     }
 
     /* Default to devices being used at their maximum device width. This was
@@ -918,6 +908,8 @@ static Property pflash_cfi01_properties[] = {
     DEFINE_PROP_UINT16("id2", PFlashCFI01, ident2, 0),
     DEFINE_PROP_UINT16("id3", PFlashCFI01, ident3, 0),
     DEFINE_PROP_STRING("name", PFlashCFI01, name),
+    DEFINE_PROP_UINT32("writeback-delay-ms", PFlashCFI01, writeback_delay_ms,
+                       100),
     DEFINE_PROP_BOOL("old-multiple-chip-handling", PFlashCFI01,
                      old_multiple_chip_handling, false),
     DEFINE_PROP_END_OF_LIST(),
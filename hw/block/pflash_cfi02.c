@@ -113,6 +113,8 @@ struct PFlashCFI02 {
     unsigned long *sector_erase_map;
     char *name;
     void *storage;
+    FlashWriteback wb;
+    uint32_t writeback_delay_ms;
 };
 
 /*
@@ -393,20 +395,7 @@ static uint64_t pflash_read(void *opaque, hwaddr offset, unsigned int width)
 /* update flash content on disk */
 static void pflash_update(PFlashCFI02 *pfl, int offset, int size)
 {
-    int offset_end;
-    int ret;
-    if (pfl->blk) {
-        offset_end = offset + size;
-        /* widen to sector boundaries */
-        offset = QEMU_ALIGN_DOWN(offset, BDRV_SECTOR_SIZE);
-        offset_end = QEMU_ALIGN_UP(offset_end, BDRV_SECTOR_SIZE);
-        ret = blk_pwrite(pfl->blk, offset, pfl->storage + offset,
-                   offset_end - offset, 0);
-        if (ret < 0) {
-            /* TODO set error bit in status */
-            error_report("Could not update PFLASH: %s", strerror(-ret));
-        }
-    }
+    flash_writeback_mark(&pfl->wb, offset, size);
 }
 
 static void pflash_sector_erase(PFlashCFI02 *pfl, hwaddr offset)
@@ -818,6 +807,8 @@ static void pflash_cfi02_realize(DeviceState *dev, Error **errp)
             vmstate_unregister_ram(&pfl->orig_mem, DEVICE(pfl));
             return;
         }
+        flash_writeback_init(&pfl->wb, pfl->blk, pfl->storage, pfl->chip_len,
+                             pfl->writeback_delay_ms);
     }
 
     /* Only 11 bits are used in the comparison. */
@@ -952,6 +943,8 @@ static Property pflash_cfi02_properties[] = {
     DEFINE_PROP_UINT16("unlock-addr0", PFlashCFI02, unlock_addr0, 0),
     DEFINE_PROP_UINT16("unlock-addr1", PFlashCFI02, unlock_addr1, 0),
     DEFINE_PROP_STRING("name", PFlashCFI02, name),
+    DEFINE_PROP_UINT32("writeback-delay-ms", PFlashCFI02, writeback_delay_ms,
+                       100),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -959,6 +952,7 @@ static void pflash_cfi02_unrealize(DeviceState *dev)
 {
     PFlashCFI02 *pfl = PFLASH_CFI02(dev);
     timer_del(&pfl->timer);
+    flash_writeback_cleanup(&pfl->wb);
     g_free(pfl->sector_erase_map);
 }
 
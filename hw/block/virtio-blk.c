@@ -17,6 +17,7 @@
 #include "qemu/module.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/coroutine.h"
 #include "trace.h"
 #include "hw/block/block.h"
 #include "hw/qdev-properties.h"
@@ -156,45 +157,64 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
 
 static void virtio_blk_flush_complete(void *opaque, int ret)
 {
-    VirtIOBlockReq *req = opaque;
-    VirtIOBlock *s = req->dev;
+    VirtIOBlockReq *next = opaque;
+    VirtIOBlock *s = next->dev;
 
     aio_context_acquire(blk_get_aio_context(s->conf.conf.blk));
-    if (ret) {
-        if (virtio_blk_handle_rw_error(req, -ret, 0, true)) {
-            goto out;
+    while (next) {
+        VirtIOBlockReq *req = next;
+        next = req->mr_next;
+
+        if (ret) {
+            if (virtio_blk_handle_rw_error(req, -ret, 0, true)) {
+                continue;
+            }
         }
-    }
 
-    virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
-    block_acct_done(blk_get_stats(s->blk), &req->acct);
-    virtio_blk_free_request(req);
+        virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
+        block_acct_done(blk_get_stats(s->blk), &req->acct);
+        virtio_blk_free_request(req);
+    }
 
-out:
+    /*
+     * The flush that just completed may have started before the writes that
+     * the waiting flushes must cover, so issue one more for all of them.
+     */
+    s->flush_in_flight = false;
+    if (s->pending_flushes) {
+        next = s->pending_flushes;
+        s->pending_flushes = NULL;
+        s->flush_in_flight = true;
+        blk_aio_flush(s->blk, virtio_blk_flush_complete, next);
+    }
     aio_context_release(blk_get_aio_context(s->conf.conf.blk));
 }
 
 static void virtio_blk_discard_write_zeroes_complete(void *opaque, int ret)
 {
-    VirtIOBlockReq *req = opaque;
-    VirtIOBlock *s = req->dev;
-    bool is_write_zeroes = (virtio_ldl_p(VIRTIO_DEVICE(s), &req->out.type) &
+    VirtIOBlockReq *next = opaque;
+    VirtIOBlock *s = next->dev;
+    bool is_write_zeroes = (virtio_ldl_p(VIRTIO_DEVICE(s), &next->out.type) &
                             ~VIRTIO_BLK_T_BARRIER) == VIRTIO_BLK_T_WRITE_ZEROES;
 
     aio_context_acquire(blk_get_aio_context(s->conf.conf.blk));
-    if (ret) {
-        if (virtio_blk_handle_rw_error(req, -ret, false, is_write_zeroes)) {
-            goto out;
+    while (next) {
+        VirtIOBlockReq *req = next;
+        next = req->mr_next;
+
+        if (ret) {
+            if (virtio_blk_handle_rw_error(req, -ret, false,
+                                           is_write_zeroes)) {
+                continue;
+            }
         }
-    }
 
-    virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
-    if (is_write_zeroes) {
-        block_acct_done(blk_get_stats(s->blk), &req->acct);
+        virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
+        if (is_write_zeroes) {
+            block_acct_done(blk_get_stats(s->blk), &req->acct);
+        }
+        virtio_blk_free_request(req);
     }
-    virtio_blk_free_request(req);
-
-out:
     aio_context_release(blk_get_aio_context(s->conf.conf.blk));
 }
 
@@ -251,15 +271,8 @@ out:
 
 #endif
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
-{
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
-
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
-    }
-    return req;
-}
+/* Number of requests that virtio_blk_handle_vq() takes off the ring at once */
+#define VIRTIO_BLK_POP_BATCH 32
 
 static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
 {
@@ -495,6 +508,89 @@ static void virtio_blk_submit_multireq(BlockBackend *blk, MultiReqBuffer *mrb)
     mrb->num_reqs = 0;
 }
 
+static void virtio_blk_submit_dwz(VirtIOBlock *s, MultiReqBuffer *mrb)
+{
+    VirtIOBlockReq *req = mrb->dwz_head;
+    int64_t offset = mrb->dwz_sector << BDRV_SECTOR_BITS;
+    int bytes = mrb->dwz_nb_sectors << BDRV_SECTOR_BITS;
+    VirtIOBlockReq *r;
+    int num_reqs = 0;
+
+    if (!req) {
+        return;
+    }
+    mrb->dwz_head = mrb->dwz_tail = NULL;
+
+    for (r = req; r; r = r->mr_next) {
+        num_reqs++;
+    }
+    if (num_reqs > 1) {
+        trace_virtio_blk_submit_discard_write_zeroes(VIRTIO_DEVICE(s), mrb,
+                                                     num_reqs, offset, bytes,
+                                                     mrb->dwz_is_write_zeroes);
+        if (mrb->dwz_is_write_zeroes) {
+            block_acct_merge_done(blk_get_stats(s->blk), BLOCK_ACCT_WRITE,
+                                  num_reqs - 1);
+        }
+    }
+
+    if (mrb->dwz_is_write_zeroes) {
+        blk_aio_pwrite_zeroes(s->blk, offset, bytes, mrb->dwz_flags,
+                              virtio_blk_discard_write_zeroes_complete, req);
+    } else {
+        blk_aio_pdiscard(s->blk, offset, bytes,
+                         virtio_blk_discard_write_zeroes_complete, req);
+    }
+}
+
+/* Submit everything that is waiting in @mrb to be merged */
+static void virtio_blk_submit_pending(VirtIOBlock *s, MultiReqBuffer *mrb)
+{
+    if (mrb->num_reqs) {
+        virtio_blk_submit_multireq(s->blk, mrb);
+    }
+    virtio_blk_submit_dwz(s, mrb);
+}
+
+static void virtio_blk_merge_timer_cb(void *opaque)
+{
+    VirtIOBlock *s = opaque;
+
+    aio_context_acquire(blk_get_aio_context(s->blk));
+    blk_io_plug(s->blk);
+    virtio_blk_submit_pending(s, &s->mrb);
+    blk_io_unplug(s->blk);
+    blk_dec_in_flight(s->blk);
+    aio_context_release(blk_get_aio_context(s->blk));
+}
+
+/*
+ * Hold back the requests in s->mrb so that requests from the next
+ * notifications can still be merged with them.  The BlockBackend stays
+ * busy meanwhile, so draining it submits them once the timer fires.
+ */
+static void virtio_blk_arm_merge_timer(VirtIOBlock *s)
+{
+    AioContext *ctx = blk_get_aio_context(s->blk);
+
+    if (s->merge_timer && timer_pending(s->merge_timer)) {
+        return;
+    }
+
+    if (s->merge_timer_ctx != ctx) {
+        if (s->merge_timer) {
+            timer_free(s->merge_timer);
+        }
+        s->merge_timer = aio_timer_new(ctx, QEMU_CLOCK_REALTIME, SCALE_US,
+                                       virtio_blk_merge_timer_cb, s);
+        s->merge_timer_ctx = ctx;
+    }
+
+    blk_inc_in_flight(s->blk);
+    timer_mod(s->merge_timer, qemu_clock_get_us(QEMU_CLOCK_REALTIME) +
+                              s->conf.merge_window_us);
+}
+
 static void virtio_blk_handle_flush(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 {
     VirtIOBlock *s = req->dev;
@@ -508,6 +604,19 @@ static void virtio_blk_handle_flush(VirtIOBlockReq *req, MultiReqBuffer *mrb)
     if (mrb->is_write && mrb->num_reqs > 0) {
         virtio_blk_submit_multireq(s->blk, mrb);
     }
+    virtio_blk_submit_dwz(s, mrb);
+
+    /*
+     * Only one flush is sent down at a time, flushes arriving meanwhile
+     * are collapsed into a single one issued when it completes.
+     */
+    if (s->flush_in_flight) {
+        trace_virtio_blk_flush_coalesce(VIRTIO_DEVICE(s), req);
+        req->mr_next = s->pending_flushes;
+        s->pending_flushes = req;
+        return;
+    }
+    s->flush_in_flight = true;
     blk_aio_flush(s->blk, virtio_blk_flush_complete, req);
 }
 
@@ -534,13 +643,15 @@ static bool virtio_blk_sect_range_ok(VirtIOBlock *dev,
 }
 
 static uint8_t virtio_blk_handle_discard_write_zeroes(VirtIOBlockReq *req,
-    struct virtio_blk_discard_write_zeroes *dwz_hdr, bool is_write_zeroes)
+    struct virtio_blk_discard_write_zeroes *dwz_hdr, bool is_write_zeroes,
+    MultiReqBuffer *mrb)
 {
     VirtIOBlock *s = req->dev;
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
     uint64_t sector;
     uint32_t num_sectors, flags, max_sectors;
     uint8_t err_status;
+    int blk_aio_flags = 0;
     int bytes;
 
     sector = virtio_ldq_p(vdev, &dwz_hdr->sector);
@@ -576,18 +687,12 @@ static uint8_t virtio_blk_handle_discard_write_zeroes(VirtIOBlockReq *req,
     }
 
     if (is_write_zeroes) { /* VIRTIO_BLK_T_WRITE_ZEROES */
-        int blk_aio_flags = 0;
-
         if (flags & VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP) {
             blk_aio_flags |= BDRV_REQ_MAY_UNMAP;
         }
 
         block_acct_start(blk_get_stats(s->blk), &req->acct, bytes,
                          BLOCK_ACCT_WRITE);
-
-        blk_aio_pwrite_zeroes(s->blk, sector << BDRV_SECTOR_BITS,
-                              bytes, blk_aio_flags,
-                              virtio_blk_discard_write_zeroes_complete, req);
     } else { /* VIRTIO_BLK_T_DISCARD */
         /*
          * The device MUST set the status byte to VIRTIO_BLK_S_UNSUPP for
@@ -597,11 +702,33 @@ static uint8_t virtio_blk_handle_discard_write_zeroes(VirtIOBlockReq *req,
             err_status = VIRTIO_BLK_S_UNSUPP;
             goto err;
         }
+    }
 
-        blk_aio_pdiscard(s->blk, sector << BDRV_SECTOR_BITS, bytes,
-                         virtio_blk_discard_write_zeroes_complete, req);
+    /*
+     * fstrim sends long runs of adjacent ranges, turn them into a single
+     * request as long as the kind of request and the flags match.
+     */
+    if (mrb->dwz_head &&
+        (!s->conf.request_merging ||
+         mrb->dwz_is_write_zeroes != is_write_zeroes ||
+         mrb->dwz_flags != blk_aio_flags ||
+         mrb->dwz_sector + mrb->dwz_nb_sectors != sector ||
+         mrb->dwz_nb_sectors + num_sectors > BDRV_REQUEST_MAX_SECTORS)) {
+        virtio_blk_submit_dwz(s, mrb);
     }
 
+    if (mrb->dwz_head) {
+        mrb->dwz_tail->mr_next = req;
+    } else {
+        mrb->dwz_head = req;
+        mrb->dwz_sector = sector;
+        mrb->dwz_nb_sectors = 0;
+        mrb->dwz_flags = blk_aio_flags;
+        mrb->dwz_is_write_zeroes = is_write_zeroes;
+    }
+    mrb->dwz_tail = req;
+    mrb->dwz_nb_sectors += num_sectors;
+
     return VIRTIO_BLK_S_OK;
 
 err:
@@ -745,7 +872,8 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
         }
 
         err_status = virtio_blk_handle_discard_write_zeroes(req, &dwz_hdr,
-                                                            is_write_zeroes);
+                                                            is_write_zeroes,
+                                                            mrb);
         if (err_status != VIRTIO_BLK_S_OK) {
             virtio_blk_req_complete(req, err_status);
             virtio_blk_free_request(req);
@@ -762,10 +890,13 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
 bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
-    MultiReqBuffer mrb = {};
+    VirtIOBlockReq *reqs[VIRTIO_BLK_POP_BATCH];
+    MultiReqBuffer local_mrb = {};
+    bool merge_window = s->conf.merge_window_us && s->conf.request_merging;
+    MultiReqBuffer *mrb = merge_window ? &s->mrb : &local_mrb;
     bool suppress_notifications = virtio_queue_get_notification(vq);
     bool progress = false;
+    unsigned int i, j, n;
 
     aio_context_acquire(blk_get_aio_context(s->blk));
     blk_io_plug(s->blk);
@@ -775,22 +906,37 @@ bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_blk_get_request(s, vq))) {
-            progress = true;
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
-                break;
+        do {
+            n = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq),
+                                    (void **)reqs, ARRAY_SIZE(reqs));
+            for (i = 0; i < n; i++) {
+                virtio_blk_init_request(s, vq, reqs[i]);
+                progress = true;
+                if (virtio_blk_handle_request(reqs[i], mrb)) {
+                    /* Leave the requests after the bad one on the ring */
+                    for (j = n - 1; j > i; j--) {
+                        virtqueue_unpop(vq, &reqs[j]->elem, 0);
+                        virtio_blk_free_request(reqs[j]);
+                    }
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                    n = 0;
+                    break;
+                }
             }
-        }
+        } while (n == ARRAY_SIZE(reqs));
 
         if (suppress_notifications) {
             virtio_queue_set_notification(vq, 1);
         }
     } while (!virtio_queue_empty(vq));
 
-    if (mrb.num_reqs) {
-        virtio_blk_submit_multireq(s->blk, &mrb);
+    if (merge_window) {
+        if (mrb->num_reqs || mrb->dwz_head) {
+            virtio_blk_arm_merge_timer(s);
+        }
+    } else {
+        virtio_blk_submit_pending(s, mrb);
     }
 
     blk_io_unplug(s->blk);
@@ -848,9 +994,7 @@ static void virtio_blk_dma_restart_bh(void *opaque)
         req = next;
     }
 
-    if (mrb.num_reqs) {
-        virtio_blk_submit_multireq(s->blk, &mrb);
-    }
+    virtio_blk_submit_pending(s, &mrb);
     blk_dec_in_flight(s->conf.conf.blk);
     aio_context_release(blk_get_aio_context(s->conf.conf.blk));
 }
@@ -1217,6 +1361,10 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
 
     blk_iostatus_enable(s->blk);
 
+    /* Each queued request may be backed by a coroutine in the block layer */
+    qemu_coroutine_increase_pool_batch_size(conf->num_queues *
+                                            conf->queue_size / 2);
+
     add_boot_device_lchs(dev, "/disk@0,0",
                          conf->conf.lcyls,
                          conf->conf.lheads,
@@ -1231,6 +1379,12 @@ static void virtio_blk_device_unrealize(DeviceState *dev)
     unsigned i;
 
     blk_drain(s->blk);
+    qemu_coroutine_decrease_pool_batch_size(conf->num_queues *
+                                            conf->queue_size / 2);
+    if (s->merge_timer) {
+        timer_free(s->merge_timer);
+        s->merge_timer = NULL;
+    }
     del_boot_device_lchs(dev, "/disk@0,0");
     virtio_blk_data_plane_destroy(s->dataplane);
     s->dataplane = NULL;
@@ -1287,6 +1441,7 @@ static Property virtio_blk_properties[] = {
                        conf.max_discard_sectors, BDRV_REQUEST_MAX_SECTORS),
     DEFINE_PROP_UINT32("max-write-zeroes-sectors", VirtIOBlock,
                        conf.max_write_zeroes_sectors, BDRV_REQUEST_MAX_SECTORS),
+    DEFINE_PROP_UINT32("merge-window-us", VirtIOBlock, conf.merge_window_us, 0),
     DEFINE_PROP_BOOL("x-enable-wce-if-config-wce", VirtIOBlock,
                      conf.x_enable_wce_if_config_wce, true),
     DEFINE_PROP_END_OF_LIST(),
@@ -42,6 +42,8 @@
 #include "qemu/main-loop.h"
 #include "migration/vmstate.h"
 #include "hw/qdev-properties.h"
+#include "sysemu/runstate.h"
+#include "sysemu/sysemu.h"
 
 #include "sysemu/block-backend.h"
 #include "hw/zynqmp_aes_key.h"
@@ -59,6 +61,13 @@
 #define TBITS_PATTERN    (0x0AU << TBIT0_OFFSET)
 #define TBITS_MASK       (0x0FU << TBIT0_OFFSET)
 
+/*
+ * Programmed rows are written back in runs of consecutive dirty rows,
+ * at most this long after the first of them changed, and whenever the
+ * VM stops or QEMU exits.
+ */
+#define EFUSE_FLUSH_DELAY_MS 50
+
 bool efuse_get_bit(XLNXEFuse *s, unsigned int bit)
 {
     bool b = s->fuse32[bit / 32] & (1 << (bit % 32));
@@ -95,12 +104,12 @@ static bool efuse_bit_is_test(unsigned int fbit)
 }
 #endif
 
-/* Update the u32 array from efuse bits. Slow but simple approach.  */
+/* Update the u32 array from efuse bits.  */
 void efuse_sync_u32(XLNXEFuse *s, uint32_t *u32,
                            unsigned int f_start, unsigned int f_end,
                            unsigned int f_written)
 {
-    unsigned int fbit, wbits = 0, u32_off = 0;
+    unsigned int fbit, u32_off = 0;
 
     /* Avoid working on bits that are not relevant.  */
     if (f_written != FBIT_UNKNOWN
@@ -108,12 +117,26 @@ void efuse_sync_u32(XLNXEFuse *s, uint32_t *u32,
         return;
     }
 
+#ifndef BIT_TEST
+    /* Gather up to 32 bits at a time, they may straddle two rows.  */
+    for (fbit = f_start; fbit <= f_end; fbit += 32, u32_off++) {
+        unsigned int len = MIN(32, f_end - fbit + 1);
+        unsigned int row = fbit / 32;
+        unsigned int sh = fbit % 32;
+        uint64_t v = s->fuse32[row] >> sh;
+
+        if (sh + len > 32) {
+            v |= (uint64_t)s->fuse32[row + 1] << (32 - sh);
+        }
+        u32[u32_off] |= extract64(v, 0, len);
+    }
+#else
+    unsigned int wbits = 0;
+
     for (fbit = f_start; fbit <= f_end; fbit++, wbits++) {
-#ifdef BIT_TEST
         if (efuse_bit_is_test(fbit)) {
             continue;
         }
-#endif
         if (wbits == 32) {
             /* Update the key offset.  */
             u32_off += 1;
@@ -121,24 +144,65 @@ void efuse_sync_u32(XLNXEFuse *s, uint32_t *u32,
         }
         u32[u32_off] |= efuse_get_bit(s, fbit) << wbits;
     }
+#endif
 }
 
-static void efuse_sync_bdrv(XLNXEFuse *s, unsigned int bit)
+static void efuse_flush_bdrv(XLNXEFuse *s)
 {
-    const int bswap_adj = (const_le32(0x1234) != 0x1234 ? 3 : 0);
-    unsigned int efuse_byte;
+    unsigned int nr_rows = DIV_ROUND_UP(s->efuse_nr * s->efuse_size, 32);
+    unsigned long start, end;
+
+    timer_del(s->flush_timer);
+
+    for (start = find_first_bit(s->dirty_rows, nr_rows); start < nr_rows;
+         start = find_next_bit(s->dirty_rows, nr_rows, end)) {
+        g_autofree uint32_t *le = NULL;
+        unsigned long i;
+
+        end = find_next_zero_bit(s->dirty_rows, nr_rows, start);
+        bitmap_clear(s->dirty_rows, start, end - start);
 
+        /* The backstore holds each 32-bit row in little-endian order */
+        le = g_new(uint32_t, end - start);
+        for (i = start; i < end; i++) {
+            le[i - start] = cpu_to_le32(s->fuse32[i]);
+        }
+        if (blk_pwrite(s->blk, start * 4, le, (end - start) * 4, 0) < 0) {
+            error_report("%s: write error in rows %lu-%lu.",
+                          __func__, start, end - 1);
+        }
+    }
+}
+
+static void efuse_flush_timer(void *opaque)
+{
+    efuse_flush_bdrv(opaque);
+}
+
+static void efuse_flush_exit(Notifier *n, void *data)
+{
+    XLNXEFuse *s = container_of(n, XLNXEFuse, exit_notifier);
+
+    efuse_flush_bdrv(s);
+}
+
+static void efuse_flush_vm_state(void *opaque, int running, RunState state)
+{
+    if (!running) {
+        efuse_flush_bdrv(opaque);
+    }
+}
+
+static void efuse_sync_bdrv(XLNXEFuse *s, unsigned int bit)
+{
     if (!s->blk || s->blk_ro) {
         return;  /* Silient on read-only backend to avoid message flood */
     }
 
-    efuse_byte = bit / 8;
-
-    if (blk_pwrite(s->blk, efuse_byte,
-                   ((uint8_t *) s->fuse32) + (efuse_byte ^ bswap_adj),
-                   1, 0) < 0) {
-        error_report("%s: write error in byte %" PRIu32 ".",
-                      __func__, efuse_byte);
+    set_bit(bit / 32, s->dirty_rows);
+    if (!timer_pending(s->flush_timer)) {
+        timer_mod(s->flush_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                                  EFUSE_FLUSH_DELAY_MS);
     }
 }
 
@@ -350,6 +414,15 @@ static void efuse_realize(DeviceState *dev, Error **errp)
                 s->fuse32[nr_u32] = le32_to_cpu(s->fuse32[nr_u32]);
             }
         }
+
+        if (!s->blk_ro) {
+            s->dirty_rows = bitmap_new(nr_bytes / 4);
+            s->flush_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                          efuse_flush_timer, s);
+            s->exit_notifier.notify = efuse_flush_exit;
+            qemu_add_exit_notifier(&s->exit_notifier);
+            qemu_add_vm_change_state_handler(efuse_flush_vm_state, s);
+        }
     }
 
     s->timer_ps = ptimer_init(timer_ps_hit, s, PTIMER_POLICY_DEFAULT);
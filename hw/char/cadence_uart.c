@@ -287,42 +287,94 @@ static void uart_write_rx_fifo(void *opaque, const uint8_t *buf, int size)
     uart_update_status(s);
 }
 
+/*
+ * Bytes leaving the TX FIFO are collected in tx_buf and handed to the
+ * chardev in one write, once CADENCE_UART_TX_BUF_HIGH bytes are pending
+ * or CADENCE_UART_TX_FLUSH_NS after the first one.  The guest-visible
+ * FIFO still drains as soon as there is room in tx_buf.
+ */
+#define CADENCE_UART_TX_BUF_HIGH    (CADENCE_UART_TX_BUF_SIZE / 2)
+#define CADENCE_UART_TX_FLUSH_NS    (1 * SCALE_MS)
+
+static void uart_tx_drain_fifo(CadenceUARTState *s)
+{
+    uint32_t n = MIN(s->tx_count, CADENCE_UART_TX_BUF_SIZE - s->tx_buf_count);
+
+    memcpy(s->tx_buf + s->tx_buf_count, s->tx_fifo, n);
+    s->tx_buf_count += n;
+    s->tx_count -= n;
+    memmove(s->tx_fifo, s->tx_fifo + n, s->tx_count);
+}
+
 static gboolean cadence_uart_xmit(GIOChannel *chan, GIOCondition cond,
                                   void *opaque)
 {
     CadenceUARTState *s = opaque;
     int ret;
 
+    s->tx_watch = 0;
+    timer_del(s->tx_flush_timer);
+
     /* instant drain the fifo when there's no back-end */
     if (!qemu_chr_fe_backend_connected(&s->chr)) {
         s->tx_count = 0;
+        s->tx_buf_count = 0;
+        uart_update_status(s);
         return FALSE;
     }
 
-    if (!s->tx_count) {
+    if (!s->tx_buf_count) {
         return FALSE;
     }
 
-    ret = qemu_chr_fe_write(&s->chr, s->tx_fifo, s->tx_count);
+    ret = qemu_chr_fe_write(&s->chr, s->tx_buf, s->tx_buf_count);
 
     if (ret >= 0) {
-        s->tx_count -= ret;
-        memmove(s->tx_fifo, s->tx_fifo + ret, s->tx_count);
+        s->tx_buf_count -= ret;
+        memmove(s->tx_buf, s->tx_buf + ret, s->tx_buf_count);
     }
 
-    if (s->tx_count) {
-        guint r = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
-                                        cadence_uart_xmit, s);
-        if (!r) {
+    if (s->tx_buf_count) {
+        s->tx_watch = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                            cadence_uart_xmit, s);
+        if (!s->tx_watch) {
             s->tx_count = 0;
-            return FALSE;
+            s->tx_buf_count = 0;
         }
     }
 
+    uart_tx_drain_fifo(s);
     uart_update_status(s);
     return FALSE;
 }
 
+static void uart_tx_flush_timer(void *opaque)
+{
+    cadence_uart_xmit(NULL, G_IO_OUT, opaque);
+}
+
+static void uart_tx_kick(CadenceUARTState *s)
+{
+    if (!qemu_chr_fe_backend_connected(&s->chr)) {
+        s->tx_count = 0;
+        return;
+    }
+
+    uart_tx_drain_fifo(s);
+
+    /* A write is already waiting for the backend */
+    if (s->tx_watch) {
+        return;
+    }
+    if (s->tx_buf_count >= CADENCE_UART_TX_BUF_HIGH) {
+        cadence_uart_xmit(NULL, G_IO_OUT, s);
+    } else if (s->tx_buf_count && !timer_pending(s->tx_flush_timer)) {
+        timer_mod(s->tx_flush_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                  CADENCE_UART_TX_FLUSH_NS);
+    }
+}
+
 static void uart_write_tx_fifo(CadenceUARTState *s, const uint8_t *buf,
                                int size)
 {
@@ -344,7 +396,8 @@ static void uart_write_tx_fifo(CadenceUARTState *s, const uint8_t *buf,
     memcpy(s->tx_fifo + s->tx_count, buf, size);
     s->tx_count += size;
 
-    cadence_uart_xmit(NULL, G_IO_OUT, s);
+    uart_tx_kick(s);
+    uart_update_status(s);
 }
 
 static void uart_receive(void *opaque, const uint8_t *buf, int size)
@@ -513,6 +566,8 @@ static void cadence_uart_realize(DeviceState *dev, Error **errp)
 
     s->fifo_trigger_handle = timer_new_ns(QEMU_CLOCK_VIRTUAL,
                                           fifo_trigger_update, s);
+    s->tx_flush_timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                     uart_tx_flush_timer, s);
 
     qemu_chr_fe_set_handlers(&s->chr, uart_can_receive, uart_receive,
                              uart_event, NULL, s, NULL, true);
@@ -563,11 +618,36 @@ static int cadence_uart_post_load(void *opaque, int version_id)
         return 1;
     }
 
+    if (s->tx_buf_count > CADENCE_UART_TX_BUF_SIZE) {
+        return 1;
+    }
+
     uart_parameters_setup(s);
+    uart_tx_kick(s);
     uart_update_status(s);
     return 0;
 }
 
+static bool cadence_uart_tx_buf_needed(void *opaque)
+{
+    CadenceUARTState *s = opaque;
+
+    return s->tx_buf_count != 0;
+}
+
+static const VMStateDescription vmstate_cadence_uart_tx_buf = {
+    .name = "cadence_uart/tx_buf",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = cadence_uart_tx_buf_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(tx_buf_count, CadenceUARTState),
+        VMSTATE_UINT8_ARRAY(tx_buf, CadenceUARTState,
+                            CADENCE_UART_TX_BUF_SIZE),
+        VMSTATE_END_OF_LIST()
+    },
+};
+
 static const VMStateDescription vmstate_cadence_uart = {
     .name = "cadence_uart",
     .version_id = 3,
@@ -587,6 +667,10 @@ static const VMStateDescription vmstate_cadence_uart = {
         VMSTATE_CLOCK_V(refclk, CadenceUARTState, 3),
         VMSTATE_END_OF_LIST()
     },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_cadence_uart_tx_buf,
+        NULL
+    },
 };
 
 static Property cadence_uart_properties[] = {
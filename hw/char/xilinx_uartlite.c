@@ -28,6 +28,7 @@
 #include "hw/qdev-properties.h"
 #include "hw/sysbus.h"
 #include "qemu/module.h"
+#include "qemu/timer.h"
 #include "chardev/char-fe.h"
 
 #define DUART(x)
@@ -67,8 +68,16 @@ typedef struct XilinxUARTLite {
     unsigned int rx_fifo_len;
 
     uint32_t regs[R_MAX];
+
+    /* Output is handed to the chardev in bursts */
+    uint8_t tx_buf[256];
+    unsigned int tx_buf_len;
+    QEMUTimer *tx_flush_timer;
 } XilinxUARTLite;
 
+/* Longest time a byte waits in tx_buf before it is written out.  */
+#define TX_FLUSH_NS     (1 * SCALE_MS)
+
 static void uart_update_irq(XilinxUARTLite *s)
 {
     unsigned int irq;
@@ -92,6 +101,28 @@ static void uart_update_status(XilinxUARTLite *s)
     s->regs[R_STATUS] = r;
 }
 
+static void uart_tx_flush(void *opaque)
+{
+    XilinxUARTLite *s = opaque;
+
+    timer_del(s->tx_flush_timer);
+    /* XXX this blocks entire thread. Rewrite to use
+     * qemu_chr_fe_write and background I/O callbacks */
+    qemu_chr_fe_write_all(&s->chr, s->tx_buf, s->tx_buf_len);
+    s->tx_buf_len = 0;
+}
+
+static void uart_tx(XilinxUARTLite *s, uint8_t ch)
+{
+    s->tx_buf[s->tx_buf_len++] = ch;
+    if (s->tx_buf_len == sizeof(s->tx_buf)) {
+        uart_tx_flush(s);
+    } else if (!timer_pending(s->tx_flush_timer)) {
+        timer_mod(s->tx_flush_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + TX_FLUSH_NS);
+    }
+}
+
 static void xilinx_uartlite_reset(DeviceState *dev)
 {
     uart_update_status(XILINX_UARTLITE(dev));
@@ -148,9 +179,7 @@ uart_write(void *opaque, hwaddr addr,
             break;
 
         case R_TX:
-            /* XXX this blocks entire thread. Rewrite to use
-             * qemu_chr_fe_write and background I/O callbacks */
-            qemu_chr_fe_write_all(&s->chr, &ch, 1);
+            uart_tx(s, ch);
             s->regs[addr] = value;
 
             /* hax.  */
@@ -216,6 +245,7 @@ static void xilinx_uartlite_realize(DeviceState *dev, Error **errp)
 {
     XilinxUARTLite *s = XILINX_UARTLITE(dev);
 
+    s->tx_flush_timer = timer_new_ns(QEMU_CLOCK_REALTIME, uart_tx_flush, s);
     qemu_chr_fe_set_handlers(&s->chr, uart_can_rx, uart_rx,
                              uart_event, NULL, s, NULL, true);
 }
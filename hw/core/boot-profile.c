@@ -0,0 +1,164 @@
+/*
+ * Boot-time profiling
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * With -boot-profile, option parsing, machine and device creation,
+ * device realize and reset, ROM loading, the first instruction of each
+ * CPU and the markers written by guest firmware are recorded in the
+ * Chrome trace-event format (one complete "X" event per span, one
+ * instant "i" event per mark), ready for chrome://tracing or Perfetto.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qjson.h"
+#include "qapi/qmp/qnum.h"
+#include "qapi/qmp/qstring.h"
+#include "qemu/bitops.h"
+#include "qemu/thread.h"
+#include "qom/object.h"
+#include "hw/boot-profile.h"
+
+#define BOOT_PROFILE_MAX_CPUS 1024
+
+bool boot_profile_enabled;
+
+static struct {
+    QemuMutex lock;
+    FILE *file;
+    int64_t start;
+    bool first;
+    unsigned long cpus_seen[BITS_TO_LONGS(BOOT_PROFILE_MAX_CPUS)];
+} boot_profile;
+
+static void boot_profile_close(void)
+{
+    qemu_mutex_lock(&boot_profile.lock);
+    boot_profile_enabled = false;
+    fprintf(boot_profile.file, "\n]\n");
+    fclose(boot_profile.file);
+    boot_profile.file = NULL;
+    qemu_mutex_unlock(&boot_profile.lock);
+}
+
+bool boot_profile_open(const char *path, int64_t start, Error **errp)
+{
+    boot_profile.file = fopen(path, "w");
+    if (!boot_profile.file) {
+        error_setg_errno(errp, errno, "cannot open boot profile '%s'", path);
+        return false;
+    }
+    qemu_mutex_init(&boot_profile.lock);
+    boot_profile.start = start;
+    boot_profile.first = true;
+    fprintf(boot_profile.file, "[\n");
+    atexit(boot_profile_close);
+    boot_profile_enabled = true;
+    return true;
+}
+
+/* Timestamps are in microseconds from the start of QEMU.  */
+static double boot_profile_us(int64_t t)
+{
+    return (t - boot_profile.start) / 1000.0;
+}
+
+static void boot_profile_emit(QDict *ev, bool flush)
+{
+    QString *json;
+
+    qdict_put_int(ev, "pid", getpid());
+    qdict_put_int(ev, "tid", qemu_get_thread_id());
+    json = qobject_to_json(QOBJECT(ev));
+
+    qemu_mutex_lock(&boot_profile.lock);
+    if (boot_profile.file) {
+        fprintf(boot_profile.file, "%s%s", boot_profile.first ? "" : ",\n",
+                qstring_get_str(json));
+        boot_profile.first = false;
+        if (flush) {
+            fflush(boot_profile.file);
+        }
+    }
+    qemu_mutex_unlock(&boot_profile.lock);
+
+    qobject_unref(json);
+    qobject_unref(ev);
+}
+
+static void boot_profile_complete_args(const char *cat, const char *name,
+                                       int64_t start, QDict *args)
+{
+    int64_t now = get_clock();
+    QDict *ev = qdict_new();
+
+    qdict_put_str(ev, "name", name);
+    qdict_put_str(ev, "cat", cat);
+    qdict_put_str(ev, "ph", "X");
+    qdict_put(ev, "ts", qnum_from_double(boot_profile_us(start)));
+    qdict_put(ev, "dur", qnum_from_double((now - start) / 1000.0));
+    if (args) {
+        qdict_put(ev, "args", args);
+    }
+    boot_profile_emit(ev, false);
+}
+
+void boot_profile_complete(const char *cat, const char *name, int64_t start)
+{
+    boot_profile_complete_args(cat, name, start, NULL);
+}
+
+void boot_profile_complete_object(const char *cat, Object *obj, int64_t start)
+{
+    const char *type = object_get_typename(obj);
+    QDict *args = qdict_new();
+    char *path = NULL;
+
+    /* Devices being realized are not always in the composition tree yet */
+    if (obj->parent) {
+        path = object_get_canonical_path(obj);
+    }
+    qdict_put_str(args, "type", type);
+    boot_profile_complete_args(cat, path ? path : type, start, args);
+    g_free(path);
+}
+
+void boot_profile_instant(const char *cat, const char *name)
+{
+    QDict *ev = qdict_new();
+
+    qdict_put_str(ev, "name", name);
+    qdict_put_str(ev, "cat", cat);
+    qdict_put_str(ev, "ph", "i");
+    /* Global scope, so the mark spans all threads in the viewer */
+    qdict_put_str(ev, "s", "g");
+    qdict_put(ev, "ts", qnum_from_double(boot_profile_us(get_clock())));
+    /* Marks are rare and are what users wait for, keep them on disk */
+    boot_profile_emit(ev, true);
+}
+
+void boot_profile_first_exec(int cpu_index)
+{
+    char *name;
+
+    if (cpu_index >= BOOT_PROFILE_MAX_CPUS ||
+        test_bit(cpu_index, boot_profile.cpus_seen)) {
+        return;
+    }
+    qemu_mutex_lock(&boot_profile.lock);
+    if (test_bit(cpu_index, boot_profile.cpus_seen)) {
+        qemu_mutex_unlock(&boot_profile.lock);
+        return;
+    }
+    set_bit(cpu_index, boot_profile.cpus_seen);
+    qemu_mutex_unlock(&boot_profile.lock);
+
+    name = g_strdup_printf("cpu%d first instruction", cpu_index);
+    boot_profile_instant("cpu", name);
+    g_free(name);
+}
@@ -17,6 +17,51 @@
 
 #define CLOCK_PATH(_clk) (_clk->canonical_path)
 
+/* Clocks whose callback is deferred until the outermost commit */
+static QTAILQ_HEAD(, Clock) clock_pending_callbacks =
+    QTAILQ_HEAD_INITIALIZER(clock_pending_callbacks);
+static unsigned clock_transaction_depth;
+
+void clock_transaction_begin(void)
+{
+    clock_transaction_depth++;
+}
+
+void clock_transaction_commit(void)
+{
+    Clock *clk;
+
+    assert(clock_transaction_depth);
+    if (--clock_transaction_depth) {
+        return;
+    }
+
+    /*
+     * Callbacks may update other clocks, which then propagate at once,
+     * or open their own transaction and add to the list.
+     */
+    while ((clk = QTAILQ_FIRST(&clock_pending_callbacks))) {
+        QTAILQ_REMOVE(&clock_pending_callbacks, clk, pending);
+        clk->callback_pending = false;
+        if (clk->callback) {
+            clk->callback(clk->callback_opaque);
+        }
+    }
+}
+
+static void clock_call_callback(Clock *clk)
+{
+    if (!clk->callback) {
+        return;
+    }
+    if (!clock_transaction_depth) {
+        clk->callback(clk->callback_opaque);
+    } else if (!clk->callback_pending) {
+        clk->callback_pending = true;
+        QTAILQ_INSERT_TAIL(&clock_pending_callbacks, clk, pending);
+    }
+}
+
 void clock_setup_canonical_path(Clock *clk)
 {
     g_free(clk->canonical_path);
@@ -51,8 +96,8 @@ static void clock_propagate_period(Clock *clk, bool call_callbacks)
             trace_clock_update(CLOCK_PATH(child), CLOCK_PATH(clk),
                                CLOCK_PERIOD_TO_NS(clk->period),
                                call_callbacks);
-            if (call_callbacks && child->callback) {
-                child->callback(child->callback_opaque);
+            if (call_callbacks) {
+                clock_call_callback(child);
             }
             clock_propagate_period(child, call_callbacks);
         }
@@ -111,6 +156,10 @@ static void clock_finalizefn(Object *obj)
     /* remove us from source's children list */
     clock_disconnect(clk);
 
+    if (clk->callback_pending) {
+        QTAILQ_REMOVE(&clock_pending_callbacks, clk, pending);
+    }
+
     g_free(clk->canonical_path);
 }
 
@@ -61,11 +61,6 @@ static bool cpu_exec_kick(CPUState *cpu)
     return rc;
 }
 
-static void cpu_exec_ack(CPUState *cpu, run_on_cpu_data arg)
-{
-    /* Do nothing; just to get vCPU out of tb-exec loop */
-}
-
 static void cpu_exec_pin_update(CPUState *cpu, bool reset_pin)
 {
     bool val = reset_pin || cpu->halt_pin || cpu->arch_halt_pin;
@@ -80,7 +75,23 @@ static void cpu_exec_pin_update(CPUState *cpu, bool reset_pin)
     cpu->exception_index = -1;
 }
 
-static void cpu_exec_pin_sync(CPUState *cpu, bool reset_pin)
+typedef struct CPUExecPinWait {
+    QemuCond cond;
+    int pending;
+} CPUExecPinWait;
+
+static void cpu_exec_batch_ack(CPUState *cpu, run_on_cpu_data arg)
+{
+    CPUExecPinWait *w = arg.host_ptr;
+
+    /* Work items run with the iothread lock held, like the waiter */
+    if (--w->pending == 0) {
+        qemu_cond_broadcast(&w->cond);
+    }
+}
+
+static void cpu_exec_pin_sync(CPUState **cpus, unsigned int num_cpus,
+                              bool reset_pin)
 {
     /*
      * Wire actors external to the targeted vCPU must wait for
@@ -97,28 +108,49 @@ static void cpu_exec_pin_sync(CPUState *cpu, bool reset_pin)
      * The solution is to initially poll for kick acknowledge,
      * and switching to use run_on_cpu() after vCPU can indeed
      * acknowledge kicking.
+     *
+     * When several vCPUs change state at once, e.g. a whole cluster,
+     * all of them are notified first and then waited for together,
+     * so that the wait is for the slowest vCPU and not for the sum.
      */
     static uint64_t can_run_on_cpu;
 
-    uint64_t cpu_mask;
-    int cpu_index;
+    CPUExecPinWait w = { .pending = 0 };
+    unsigned int i;
 
-    cpu_exec_pin_update(cpu, reset_pin);
+    qemu_cond_init(&w.cond);
 
-    if (cpu == current_cpu) {
-        return; /* self-acting */
+    for (i = 0; i < num_cpus; i++) {
+        cpu_exec_pin_update(cpus[i], reset_pin);
     }
 
-    cpu_index = cpu->cpu_index;
-    assert(cpu_index >= 0 && cpu_index < 64);
+    for (i = 0; i < num_cpus; i++) {
+        CPUState *cpu = cpus[i];
+        uint64_t cpu_mask;
+        int cpu_index;
 
-    cpu_mask = (uint64_t)1 << cpu_index;
+        if (cpu == current_cpu) {
+            continue; /* self-acting */
+        }
+
+        cpu_index = cpu->cpu_index;
+        assert(cpu_index >= 0 && cpu_index < 64);
+
+        cpu_mask = (uint64_t)1 << cpu_index;
+
+        if ((can_run_on_cpu & cpu_mask) != 0) {
+            w.pending++;
+            async_run_on_cpu(cpu, cpu_exec_batch_ack,
+                             RUN_ON_CPU_HOST_PTR(&w));
+        } else if (cpu_exec_kick(cpu)) {
+            can_run_on_cpu |= cpu_mask;
+        }
+    }
 
-    if ((can_run_on_cpu & cpu_mask) != 0) {
-        run_on_cpu(cpu, cpu_exec_ack, RUN_ON_CPU_NULL);
-    } else if (cpu_exec_kick(cpu)) {
-        can_run_on_cpu |= cpu_mask;
+    while (w.pending) {
+        qemu_cond_wait_iothread(&w.cond);
     }
+    qemu_cond_destroy(&w.cond);
 }
 
 static bool ensure_iothread_lock(void)
@@ -154,12 +186,18 @@ static inline void cpu_reset_pin_activated(CPUState *cs)
 }
 #endif
 
-void cpu_reset_gpio(void *opaque, int irq, int level)
+void cpu_reset_gpio_cpus(CPUState **cpus, unsigned int num_cpus, int level)
 {
-    CPUState *cpu = CPU(opaque);
+    g_autofree CPUState **changed = g_new(CPUState *, num_cpus);
+    unsigned int i, n = 0;
     bool iolock;
 
-    if (level == cpu->reset_pin) {
+    for (i = 0; i < num_cpus; i++) {
+        if (!!level != cpus[i]->reset_pin) {
+            changed[n++] = cpus[i];
+        }
+    }
+    if (!n) {
         return;
     }
 
@@ -182,31 +220,56 @@ void cpu_reset_gpio(void *opaque, int irq, int level)
     iolock = ensure_iothread_lock();
 
     if (level) {
-        cpu->reset_pin = true;
-        cpu_exec_pin_sync(cpu, true);
-        cpu_reset_pin_activated(cpu);
+        for (i = 0; i < n; i++) {
+            changed[i]->reset_pin = true;
+        }
+        cpu_exec_pin_sync(changed, n, true);
+        for (i = 0; i < n; i++) {
+            cpu_reset_pin_activated(changed[i]);
+        }
     } else {
-        cpu_reset(cpu);
-        cpu_exec_pin_sync(cpu, false);
-        cpu->reset_pin = false;
+        for (i = 0; i < n; i++) {
+            cpu_reset(changed[i]);
+        }
+        cpu_exec_pin_sync(changed, n, false);
+        for (i = 0; i < n; i++) {
+            changed[i]->reset_pin = false;
+        }
     }
 
     deref_iothread_lock(iolock);
 }
 
-void cpu_halt_gpio(void *opaque, int irq, int level)
+void cpu_halt_gpio_cpus(CPUState **cpus, unsigned int num_cpus, int level)
 {
-    CPUState *cpu = CPU(opaque);
+    unsigned int i;
     bool iolock;
 
     iolock = ensure_iothread_lock();
 
-    cpu->halt_pin = level;
-    cpu_exec_pin_update(cpu, cpu->reset_pin); /* TBD: _sync not working */
+    for (i = 0; i < num_cpus; i++) {
+        cpus[i]->halt_pin = level;
+        /* TBD: _sync not working */
+        cpu_exec_pin_update(cpus[i], cpus[i]->reset_pin);
+    }
 
     deref_iothread_lock(iolock);
 }
 
+void cpu_reset_gpio(void *opaque, int irq, int level)
+{
+    CPUState *cpu = CPU(opaque);
+
+    cpu_reset_gpio_cpus(&cpu, 1, level);
+}
+
+void cpu_halt_gpio(void *opaque, int irq, int level)
+{
+    CPUState *cpu = CPU(opaque);
+
+    cpu_halt_gpio_cpus(&cpu, 1, level);
+}
+
 void cpu_halt_update(CPUState *cpu)
 {
     bool iolock;
@@ -32,6 +32,9 @@
 #include "qemu/log.h"
 #include "hw/cpu/cluster.h"
 #include "sysemu/reset.h"
+#include "qemu/cutils.h"
+
+#include <libfdt.h>
 
 #ifndef FDT_GENERIC_ERR_DEBUG
 #define FDT_GENERIC_ERR_DEBUG 0
@@ -58,7 +61,8 @@ static void add_to_table(
         FDTInitFn fdt_init,
         const char *key,
         void *opaque,
-        TableListNode **head_p)
+        TableListNode **head_p,
+        GHashTable **index_p)
 {
     TableListNode *nn = malloc(sizeof(*nn));
     nn->next = *head_p;
@@ -66,6 +70,12 @@ static void add_to_table(
     nn->fdt_init = fdt_init;
     nn->opaque = opaque;
     *head_p = nn;
+
+    /* Later registrations take precedence, like in the list.  */
+    if (!*index_p) {
+        *index_p = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+    g_hash_table_insert(*index_p, nn->key, nn);
 }
 
 /* FIXME: add return codes that differentiate between not found and error */
@@ -78,45 +88,46 @@ static int fdt_init_search_table(
         char *node_path,
         FDTMachineInfo *fdti,
         const char *key, /* string to match */
-        TableListNode **head) /* head of the list to search */
+        GHashTable *index) /* index of the table to search */
 {
-    TableListNode *iter;
+    TableListNode *iter = index ? g_hash_table_lookup(index, key) : NULL;
 
-    for (iter = *head; iter != NULL; iter = iter->next) {
-        if (!strcmp(key, iter->key)) {
-            if (iter->fdt_init) {
-                return iter->fdt_init(node_path, fdti, iter->opaque);
-            }
-            return 0;
+    if (iter) {
+        if (iter->fdt_init) {
+            return iter->fdt_init(node_path, fdti, iter->opaque);
         }
+        return 0;
     }
 
     return 1;
 }
 
 TableListNode *compat_list_head;
+static GHashTable *compat_index;
 
 void add_to_compat_table(FDTInitFn fdt_init, const char *compat, void *opaque)
 {
-    add_to_table(fdt_init, compat, opaque, &compat_list_head);
+    add_to_table(fdt_init, compat, opaque, &compat_list_head, &compat_index);
 }
 
 int fdt_init_compat(char *node_path, FDTMachineInfo *fdti, const char *compat)
 {
-    return fdt_init_search_table(node_path, fdti, compat, &compat_list_head);
+    return fdt_init_search_table(node_path, fdti, compat, compat_index);
 }
 
 TableListNode *inst_bind_list_head;
+static GHashTable *inst_bind_index;
 
 void add_to_inst_bind_table(FDTInitFn fdt_init, const char *name, void *opaque)
 {
-    add_to_table(fdt_init, name, opaque, &inst_bind_list_head);
+    add_to_table(fdt_init, name, opaque, &inst_bind_list_head,
+                 &inst_bind_index);
 }
 
 int fdt_init_inst_bind(char *node_path, FDTMachineInfo *fdti,
         const char *name)
 {
-    return fdt_init_search_table(node_path, fdti, name, &inst_bind_list_head);
+    return fdt_init_search_table(node_path, fdti, name, inst_bind_index);
 }
 
 static void dump_table(TableListNode *head)
@@ -152,25 +163,19 @@ void fdt_init_yield(FDTMachineInfo *fdti)
 
 void fdt_init_set_opaque(FDTMachineInfo *fdti, char *node_path, void *opaque)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques;
-        dp->node_path && strcmp(dp->node_path, node_path);
-        dp++);
-    if (!dp->node_path) {
+    FDTDevOpaque *dp = g_hash_table_lookup(fdti->opaque_index, node_path);
+
+    if (!dp) {
+        dp = &fdti->dev_opaques[fdti->num_dev_opaques++];
         dp->node_path = strdup(node_path);
+        g_hash_table_insert(fdti->opaque_index, dp->node_path, dp);
     }
     dp->opaque = opaque;
 }
 
 int fdt_init_has_opaque(FDTMachineInfo *fdti, char *node_path)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques; dp->node_path; dp++) {
-        if (!strcmp(dp->node_path, node_path)) {
-            return 1;
-         }
-    }
-    return 0;
+    return g_hash_table_contains(fdti->opaque_index, node_path);
 }
 
 static void *fdt_init_add_cpu_cluster(FDTMachineInfo *fdti, char *compat)
@@ -212,13 +217,80 @@ void *fdt_init_get_cpu_cluster(FDTMachineInfo *fdti, char *compat)
 
 void *fdt_init_get_opaque(FDTMachineInfo *fdti, char *node_path)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques; dp->node_path; dp++) {
-        if (!strcmp(dp->node_path, node_path)) {
-            return dp->opaque;
+    FDTDevOpaque *dp = g_hash_table_lookup(fdti->opaque_index, node_path);
+
+    return dp ? dp->opaque : NULL;
+}
+
+int fdt_init_get_path_by_phandle(FDTMachineInfo *fdti, char *node_path,
+                                 uint32_t phandle)
+{
+    const char *path = g_hash_table_lookup(fdti->phandle_index,
+                                           GUINT_TO_POINTER(phandle));
+
+    if (!path) {
+        /* Not in the blob we indexed, let libfdt have a go.  */
+        return qemu_devtree_get_node_by_phandle(fdti->fdt, node_path, phandle);
+    }
+    pstrcpy(node_path, DT_PATH_LENGTH, path);
+    return 0;
+}
+
+int fdt_init_get_parent(FDTMachineInfo *fdti, char *node_path,
+                        const char *current)
+{
+    const char *path = g_hash_table_lookup(fdti->parent_index, current);
+
+    if (!path) {
+        return qemu_devtree_getparent(fdti->fdt, node_path, current);
+    }
+    pstrcpy(node_path, DT_PATH_LENGTH, path);
+    return 0;
+}
+
+/*
+ * Walk the blob once and index nodes by phandle and path. libfdt lookups
+ * by phandle or parent rescan the blob from the start on every call,
+ * which gets quadratic on large trees.
+ */
+#define FDT_INDEX_MAX_DEPTH 64
+
+static void fdt_init_index_nodes(FDTMachineInfo *fdti)
+{
+    char *stack[FDT_INDEX_MAX_DEPTH];
+    int offset = 0, depth = 0;
+    uint32_t phandle;
+
+    fdti->node_paths = g_ptr_array_new_with_free_func(g_free);
+    fdti->phandle_index = g_hash_table_new(NULL, NULL);
+    fdti->parent_index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    stack[0] = g_strdup("/");
+    g_ptr_array_add(fdti->node_paths, stack[0]);
+    phandle = fdt_get_phandle(fdti->fdt, 0);
+    if (phandle) {
+        g_hash_table_insert(fdti->phandle_index, GUINT_TO_POINTER(phandle),
+                            stack[0]);
+    }
+
+    while ((offset = fdt_next_node(fdti->fdt, offset, &depth)) >= 0
+           && depth > 0) {
+        const char *name = fdt_get_name(fdti->fdt, offset, NULL);
+        char *path;
+
+        assert(depth < FDT_INDEX_MAX_DEPTH);
+        path = g_strconcat(depth == 1 ? "" : stack[depth - 1], "/", name,
+                           NULL);
+        stack[depth] = path;
+        g_ptr_array_add(fdti->node_paths, path);
+        g_hash_table_insert(fdti->parent_index, path, stack[depth - 1]);
+
+        phandle = fdt_get_phandle(fdti->fdt, offset);
+        if (phandle) {
+            g_hash_table_insert(fdti->phandle_index,
+                                GUINT_TO_POINTER(phandle), path);
         }
     }
-    return NULL;
 }
 
 FDTMachineInfo *fdt_init_new_fdti(void *fdt)
@@ -229,6 +301,8 @@ FDTMachineInfo *fdt_init_new_fdti(void *fdt)
     qemu_co_queue_init(fdti->cq);
     fdti->dev_opaques = g_malloc0(sizeof(*(fdti->dev_opaques)) *
         (devtree_get_num_nodes(fdt) + 1));
+    fdti->opaque_index = g_hash_table_new(g_str_hash, g_str_equal);
+    fdt_init_index_nodes(fdti);
     return fdti;
 }
 
@@ -246,6 +320,10 @@ void fdt_init_destroy_fdti(FDTMachineInfo *fdti)
     for (dp = fdti->dev_opaques; dp->node_path; dp++) {
         g_free(dp->node_path);
     }
+    g_hash_table_destroy(fdti->opaque_index);
+    g_hash_table_destroy(fdti->phandle_index);
+    g_hash_table_destroy(fdti->parent_index);
+    g_ptr_array_free(fdti->node_paths, true);
     g_free(fdti->dev_opaques);
     g_free(fdti);
 }
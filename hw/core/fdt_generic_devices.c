@@ -51,7 +51,7 @@ static int i2c_bus_fdt_init(char *node_path, FDTMachineInfo *fdti, void *priv)
 
     DB_PRINT_NP(1, "\n");
     /* FIXME: share this code with fdt_generic_util.c/fdt_init_qdev() */
-    if (qemu_devtree_getparent(fdti->fdt, parent_node_path, node_path)) {
+    if (fdt_init_get_parent(fdti, parent_node_path, node_path)) {
         abort();
     }
     while (!fdt_init_has_opaque(fdti, parent_node_path)) {
@@ -54,7 +54,7 @@ static QDict *user_creatble_fdt_props_to_qdict(void *fdt,
      * use enumeration instead of direct lookup.
      */
     qprops = qdict_new();
-    offset = fdt_path_offset(fdt, node_path);
+    offset = qemu_fdt_path_offset(fdt, node_path);
     for (offset = fdt_first_property_offset(fdt, offset);
          offset != -FDT_ERR_NOTFOUND;
          offset = fdt_next_property_offset(fdt, offset)) {
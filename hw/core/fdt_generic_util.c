@@ -47,6 +47,7 @@
 #include "hw/boards.h"
 #include "qemu/option.h"
 #include "hw/qdev-properties.h"
+#include "hw/boot-profile.h"
 
 #ifndef FDT_GENERIC_UTIL_ERR_DEBUG
 #define FDT_GENERIC_UTIL_ERR_DEBUG 3
@@ -251,6 +252,7 @@ static void fdt_init_node(void *args)
     char *all_compats = NULL, *node_name;
     char *device_type = NULL;
     int compat_len;
+    int64_t start = boot_profile_start();
 
     DB_PRINT_NP(1, "enter\n");
 
@@ -324,6 +326,7 @@ exit:
     if (!fdt_init_has_opaque(fdti, node_path)) {
         fdt_init_set_opaque(fdti, node_path, NULL);
     }
+    boot_profile_span("fdt", node_path, start);
     g_free(node_path);
     g_free(all_compats);
     g_free(device_type);
@@ -381,7 +384,7 @@ static qemu_irq fdt_get_gpio(FDTMachineInfo *fdti, char *node_path,
         free_reason = true;
         goto fail_silent;
     }
-    if (qemu_devtree_get_node_by_phandle(fdt, parent_node_path,
+    if (fdt_init_get_path_by_phandle(fdti, parent_node_path,
                                          parent_phandle)) {
         *end = true;
         reason = "cant get node from phandle\n";
@@ -582,7 +585,7 @@ qemu_irq *fdt_get_irq_info(FDTMachineInfo *fdti, char *node_path, int irq_idx,
                                            "#interrupt-cells", 0, true, &errp);
         *map_mode = true;
     } else {
-        if (qemu_devtree_get_node_by_phandle(fdt, intc_node_path,
+        if (fdt_init_get_path_by_phandle(fdti, intc_node_path,
                                              intc_phandle)) {
             goto fail;
         }
@@ -698,7 +701,7 @@ qemu_irq *fdt_get_irq_info(FDTMachineInfo *fdti, char *node_path, int irq_idx,
             if (intc_phandle & (0xffu << 24)) {
                 new_intc_cells = (intc_phandle >> 24) - 1;
             } else {
-                if (qemu_devtree_get_node_by_phandle(fdt, intc_node_path,
+                if (fdt_init_get_path_by_phandle(fdti, intc_node_path,
                                                      intc_phandle)) {
                     goto fail;
                 }
@@ -718,7 +721,7 @@ qemu_irq *fdt_get_irq_info(FDTMachineInfo *fdti, char *node_path, int irq_idx,
                 num_matches++;
                 ret = g_renew(qemu_irq, ret, num_matches + 1);
                 if (intc_phandle & (0xffu << 24)) {
-                    if (qemu_devtree_get_node_by_phandle(fdt, intc_node_path,
+                    if (fdt_init_get_path_by_phandle(fdti, intc_node_path,
                                                          intc_phandle &
                                                          ((1 << 24) - 1))) {
                         goto fail;
@@ -929,50 +932,85 @@ static void fdt_attach_drive(FDTMachineInfo *fdti, char *node_path,
     return;
 }
 
-static Object *fdt_create_from_compat(const char *compat, char **dev_type)
+typedef struct FDTCompatType {
+    /* QOM type the compat resolves to, NULL if none.  */
+    char *type;
+    /* Last name tried, handed back as dev_type.  */
+    char *dev_type;
+} FDTCompatType;
+
+static bool fdt_compat_type_exists(const char *name)
 {
-    Object *ret = NULL;
-    char *c = g_strdup(compat);
+    return object_class_by_name(name) != NULL;
+}
 
-    /* Try to create the object */
-    ret = object_new(c);
+static FDTCompatType *fdt_resolve_compat(const char *compat)
+{
+    FDTCompatType *ct = g_new0(FDTCompatType, 1);
+    char *c = g_strdup(compat);
+    bool found;
 
-    if (!ret) {
+    found = fdt_compat_type_exists(c);
+    if (!found) {
         /* Trim the version off the end and try again */
         trim_version(c);
-        ret = object_new(c);
+        found = fdt_compat_type_exists(c);
 
-        if (!ret) {
+        if (!found) {
             /* Replace commas with full stops */
             substitute_char(c, ',', '.');
-            ret = object_new(c);
+            found = fdt_compat_type_exists(c);
         }
     }
 
-    if (!ret) {
+    if (!found) {
         /* Restart with the orginal string and now replace commas with full stops
          * and try again. This means that versions are still included.
          */
         g_free(c);
         c = g_strdup(compat);
         substitute_char(c, ',', '.');
-        ret = object_new(c);
+        found = fdt_compat_type_exists(c);
     }
 
-    if (dev_type) {
-        *dev_type = c;
-    } else {
-        g_free(c);
-    }
-
-    if (!ret) {
+    if (!found) {
         const char *no_vendor = trim_vendor(compat);
 
         if (no_vendor != compat) {
-            return fdt_create_from_compat(no_vendor, dev_type);
+            g_free(c);
+            g_free(ct);
+            return fdt_resolve_compat(no_vendor);
         }
     }
-    return ret;
+
+    ct->type = found ? g_strdup(c) : NULL;
+    ct->dev_type = c;
+    return ct;
+}
+
+/*
+ * Compat strings repeat a lot across a tree. The name mangling above is
+ * a handful of type lookups per try, cache the outcome per compat.
+ */
+static Object *fdt_create_from_compat(const char *compat, char **dev_type)
+{
+    static GHashTable *cache;
+    FDTCompatType *ct;
+
+    if (!cache) {
+        cache = g_hash_table_new(g_str_hash, g_str_equal);
+    }
+
+    ct = g_hash_table_lookup(cache, compat);
+    if (!ct) {
+        ct = fdt_resolve_compat(compat);
+        g_hash_table_insert(cache, g_strdup(compat), ct);
+    }
+
+    if (dev_type) {
+        *dev_type = g_strdup(ct->dev_type);
+    }
+    return ct->type ? object_new(ct->type) : NULL;
 }
 
 /*FIXME: roll into device tree functionality */
@@ -1105,7 +1143,7 @@ static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
         DB_PRINT_NP(0, "is a CPU - total so far %d\n", fdt_generic_num_cpus);
     }
 
-    if (qemu_devtree_getparent(fdti->fdt, parent_node_path, node_path)) {
+    if (fdt_init_get_parent(fdti, parent_node_path, node_path)) {
         abort();
     }
     while (!fdt_init_has_opaque(fdti, parent_node_path)) {
@@ -1265,7 +1303,7 @@ static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
 
             Object *linked_dev, *proxy;
 
-            if (qemu_devtree_get_node_by_phandle(fdti->fdt, target_node_path,
+            if (fdt_init_get_path_by_phandle(fdti, target_node_path,
                                                 get_int_be(val, len))) {
                 abort();
             }
@@ -1327,7 +1365,7 @@ static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
                             "property\n");
                 break;
             }
-            if (qemu_devtree_get_node_by_phandle(fdti->fdt, adaptor_node_path,
+            if (fdt_init_get_path_by_phandle(fdti, adaptor_node_path,
                                                  adaptor_phandle)) {
                 DB_PRINT_NP(1, "cant get node from phandle\n");
                 break;
@@ -1442,7 +1480,7 @@ static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
             error_free(errp);
             errp = NULL;
             extended = false;
-            qemu_devtree_getparent(fdti->fdt, parent_path, node_path);
+            fdt_init_get_parent(fdti, parent_path, node_path);
         }
 
         for (reg.n = 0;; reg.n++) {
@@ -1461,7 +1499,7 @@ static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
                     errp = NULL;
                     goto exit_reg_parse;
                 }
-                if (qemu_devtree_get_node_by_phandle(fdti->fdt, ph_parent,
+                if (fdt_init_get_path_by_phandle(fdti, ph_parent,
                                                      p_ph)) {
                     goto exit_reg_parse;
                 }
@@ -1517,8 +1555,9 @@ exit_reg_parse:
     if (object_dynamic_cast(dev, TYPE_SYS_BUS_DEVICE)) {
         {
             int len;
-            fdt_get_property(fdti->fdt, fdt_path_offset(fdti->fdt, node_path),
-                                    "interrupt-controller", &len);
+            fdt_get_property(fdti->fdt,
+                             qemu_fdt_path_offset(fdti->fdt, node_path),
+                             "interrupt-controller", &len);
             is_intc = len >= 0;
             DB_PRINT_NP(is_intc ? 0 : 1, "is interrupt controller: %c\n",
                         is_intc ? 'y' : 'n');
@@ -1533,7 +1572,8 @@ exit_reg_parse:
             qemu_irq *irqs = fdt_get_irq_info(fdti, node_path, i, irq_info,
                                               &map_mode);
             /* INTCs inferr their top level, if no IRQ connection specified */
-            fdt_get_property(fdti->fdt, fdt_path_offset(fdti->fdt, node_path),
+            fdt_get_property(fdti->fdt,
+                             qemu_fdt_path_offset(fdti->fdt, node_path),
                              "interrupts-extended", &len);
             if (!irqs && is_intc && i == 0 && len <= 0) {
                 FDTGenericIntc *id = (FDTGenericIntc *)object_dynamic_cast(
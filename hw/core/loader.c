@@ -60,6 +60,7 @@
 #include "hw/boards.h"
 #include "qemu/cutils.h"
 #include "sysemu/runstate.h"
+#include "hw/boot-profile.h"
 
 #include <zlib.h>
 
@@ -856,7 +857,7 @@ static QTAILQ_HEAD(, Rom) roms = QTAILQ_HEAD_INITIALIZER(roms);
 
 /*
  * rom->data can be heap-allocated or memory-mapped (e.g. when added with
- * rom_add_elf_program())
+ * rom_add_file() or rom_add_elf_program())
  */
 static void rom_free_data(Rom *rom)
 {
@@ -955,7 +956,7 @@ int rom_add_file(const char *file, const char *fw_dir,
 {
     MachineClass *mc = MACHINE_GET_CLASS(qdev_get_machine());
     Rom *rom;
-    int rc, fd = -1;
+    GError *gerr = NULL;
     char devpath[100];
 
     if (as && mr) {
@@ -973,10 +974,18 @@ int rom_add_file(const char *file, const char *fw_dir,
         rom->path = g_strdup(file);
     }
 
-    fd = open(rom->path, O_RDONLY | O_BINARY);
-    if (fd == -1) {
+    /*
+     * Map the file rather than reading it into the heap: large images are
+     * then only paged in while being copied to the guest, and the pages can
+     * be dropped again under memory pressure.  The mapping is private and
+     * writable, so callers patching the image through rom_ptr() get their
+     * own copy of the pages they touch.
+     */
+    rom->mapped_file = g_mapped_file_new(rom->path, TRUE, &gerr);
+    if (!rom->mapped_file) {
         fprintf(stderr, "Could not open option rom '%s': %s\n",
-                rom->path, strerror(errno));
+                rom->path, gerr->message);
+        g_error_free(gerr);
         goto err;
     }
 
@@ -985,23 +994,9 @@ int rom_add_file(const char *file, const char *fw_dir,
         rom->fw_file = g_strdup(file);
     }
     rom->addr     = addr;
-    rom->romsize  = lseek(fd, 0, SEEK_END);
-    if (rom->romsize == -1) {
-        fprintf(stderr, "rom: file %-20s: get size error: %s\n",
-                rom->name, strerror(errno));
-        goto err;
-    }
-
+    rom->romsize  = g_mapped_file_get_length(rom->mapped_file);
     rom->datasize = rom->romsize;
-    rom->data     = g_malloc0(rom->datasize);
-    lseek(fd, 0, SEEK_SET);
-    rc = read(fd, rom->data, rom->datasize);
-    if (rc != rom->datasize) {
-        fprintf(stderr, "rom: file %-20s: read error: rc=%d (expected %zd)\n",
-                rom->name, rc, rom->datasize);
-        goto err;
-    }
-    close(fd);
+    rom->data     = (uint8_t *)g_mapped_file_get_contents(rom->mapped_file);
     rom_insert(rom);
     if (rom->fw_file && fw_cfg) {
         const char *basename;
@@ -1038,9 +1033,6 @@ int rom_add_file(const char *file, const char *fw_dir,
     return 0;
 
 err:
-    if (fd != -1)
-        close(fd);
-
     rom_free(rom);
     return -1;
 }
@@ -1131,6 +1123,8 @@ static void rom_reset(void *unused)
     Rom *rom;
 
     QTAILQ_FOREACH(rom, &roms, next) {
+        int64_t start = boot_profile_start();
+
         if (rom->fw_file) {
             continue;
         }
@@ -1173,6 +1167,7 @@ static void rom_reset(void *unused)
         cpu_flush_icache_range(rom->addr, rom->datasize);
 
         trace_loader_write_rom(rom->name, rom->addr, rom->datasize, rom->isrom);
+        boot_profile_span("rom", rom->name, start);
     }
 }
 
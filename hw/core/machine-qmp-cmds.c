@@ -191,6 +191,15 @@ CpuInfoFastList *qmp_query_cpus_fast(Error **errp)
             info->value->props = props;
         }
 
+        info->value->has_halt_poll = !!cpu->halt_poll_max_ns;
+        if (info->value->has_halt_poll) {
+            info->value->halt_poll = g_new0(CpuHaltPollInfo, 1);
+            /* Updated by the vCPU thread, a torn value only skews stats */
+            info->value->halt_poll->window_ns = cpu->halt_poll_ns;
+            info->value->halt_poll->hits = cpu->halt_poll_hits;
+            info->value->halt_poll->misses = cpu->halt_poll_misses;
+        }
+
         info->value->arch = sysemu_target_to_cpuinfo_arch(target);
         info->value->target = target;
         if (target == SYS_EMU_TARGET_S390X) {
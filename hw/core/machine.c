@@ -11,6 +11,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/host-utils.h"
 #include "qemu/option.h"
 #include "qapi/qmp/qerror.h"
 #include "sysemu/replay.h"
@@ -310,6 +311,38 @@ static void machine_set_phandle_start(Object *obj, Visitor *v,
     ms->phandle_start = value;
 }
 
+static void machine_get_target_page_size(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    MachineState *ms = MACHINE(obj);
+    uint64_t value = ms->target_page_size;
+
+    visit_type_size(v, name, &value, errp);
+}
+
+static void machine_set_target_page_size(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    MachineState *ms = MACHINE(obj);
+    Error *error = NULL;
+    uint64_t value;
+
+    visit_type_size(v, name, &value, &error);
+    if (error) {
+        error_propagate(errp, error);
+        return;
+    }
+    if (value && !is_power_of_2(value)) {
+        error_setg(errp, "target-page-size must be a power of 2");
+        return;
+    }
+
+    /* Applied by vl.c before the machine is created, see there */
+    ms->target_page_size = value;
+}
+
 static char *machine_get_dt_compatible(Object *obj, Error **errp)
 {
     MachineState *ms = MACHINE(obj);
@@ -846,6 +879,12 @@ static void machine_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "phandle-start",
         "The first phandle ID we may generate dynamically");
 
+    object_class_property_add(oc, "target-page-size", "size",
+        machine_get_target_page_size, machine_set_target_page_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "target-page-size",
+        "TCG page size, for guests that never map smaller pages");
+
     object_class_property_add_str(oc, "dt-compatible",
         machine_get_dt_compatible, machine_set_dt_compatible);
     object_class_property_set_description(oc, "dt-compatible",
@@ -40,8 +40,18 @@ struct ptimer_state
      */
     bool in_transaction;
     bool need_reload;
+    /*
+     * A lazy periodic timer does not arm its QEMUTimer: expiries are
+     * accounted for the next time the counter is read instead.
+     */
+    bool lazy;
 };
 
+static bool ptimer_is_lazy(ptimer_state *s)
+{
+    return s->lazy && s->enabled == 1 && s->limit != 0;
+}
+
 /* Use a bottom-half routine to avoid reentrancy issues.  */
 static void ptimer_trigger(ptimer_state *s)
 {
@@ -144,7 +154,46 @@ static void ptimer_reload(ptimer_state *s, int delta_adjust)
     if (period_frac) {
         s->next_event += ((int64_t)period_frac * delta) >> 32;
     }
-    timer_mod(s->timer, s->next_event);
+    if (ptimer_is_lazy(s)) {
+        timer_del(s->timer);
+    } else {
+        timer_mod(s->timer, s->next_event);
+    }
+}
+
+/*
+ * Account for the expiries a lazy timer has missed since it was last
+ * looked at.  The first reloads go through ptimer_reload() so that the
+ * policy adjustments are applied exactly as ptimer_tick() would; after
+ * that every period has the same length and the rest are skipped in one
+ * step.
+ */
+static void ptimer_catch_up(ptimer_state *s)
+{
+    int64_t now, interval, missed;
+    int i;
+
+    if (!ptimer_is_lazy(s)) {
+        return;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    for (i = 0; i < 2 && now - s->next_event >= 0; i++) {
+        int delta_adjust = s->delta == 0 ? DELTA_NO_ADJUST : DELTA_ADJUST;
+
+        s->delta = s->limit;
+        ptimer_reload(s, delta_adjust);
+        if (!ptimer_is_lazy(s)) {
+            return;
+        }
+    }
+
+    interval = s->next_event - s->last_event;
+    if (now - s->next_event >= 0 && interval > 0) {
+        missed = (now - s->next_event) / interval + 1;
+        s->last_event = s->next_event + (missed - 1) * interval;
+        s->next_event = s->last_event + interval;
+    }
 }
 
 static void ptimer_tick(void *opaque)
@@ -197,6 +246,7 @@ uint64_t ptimer_get_count(ptimer_state *s)
 {
     uint64_t counter;
 
+    ptimer_catch_up(s);
     if (s->enabled && s->delta != 0) {
         int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
         int64_t next = s->next_event;
@@ -372,6 +422,27 @@ uint64_t ptimer_get_limit(ptimer_state *s)
     return s->limit;
 }
 
+void ptimer_set_lazy(ptimer_state *s, bool lazy)
+{
+    assert(s->in_transaction);
+
+    if (s->lazy == lazy) {
+        return;
+    }
+    if (lazy) {
+        s->lazy = true;
+        if (ptimer_is_lazy(s)) {
+            timer_del(s->timer);
+        }
+    } else {
+        ptimer_catch_up(s);
+        s->lazy = false;
+        if (s->enabled == 1 && s->limit != 0) {
+            timer_mod(s->timer, s->next_event);
+        }
+    }
+}
+
 void ptimer_transaction_begin(ptimer_state *s)
 {
     assert(!s->in_transaction);
@@ -398,10 +469,26 @@ void ptimer_transaction_commit(ptimer_state *s)
     s->in_transaction = false;
 }
 
+static int ptimer_pre_save(void *opaque)
+{
+    ptimer_state *s = opaque;
+
+    /*
+     * The destination does not know the timer is lazy until the device
+     * tells it so; arm the QEMUTimer so that it keeps ticking there.
+     */
+    if (ptimer_is_lazy(s)) {
+        ptimer_catch_up(s);
+        timer_mod(s->timer, s->next_event);
+    }
+    return 0;
+}
+
 const VMStateDescription vmstate_ptimer = {
     .name = "ptimer",
     .version_id = 1,
     .minimum_version_id = 1,
+    .pre_save = ptimer_pre_save,
     .fields = (VMStateField[]) {
         VMSTATE_UINT8(enabled, ptimer_state),
         VMSTATE_UINT64(limit, ptimer_state),
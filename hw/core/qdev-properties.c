@@ -137,9 +137,12 @@ static void prop_set_bit(Object *obj, Visitor *v, const char *name,
     bit_prop_set(dev, prop, value);
 }
 
+static void init_default_scalar(Object *obj, ObjectProperty *op);
+
 static void set_default_value_bool(ObjectProperty *op, const Property *prop)
 {
     object_property_set_default_bool(op, prop->defval.u);
+    op->init = init_default_scalar;
 }
 
 const PropertyInfo qdev_prop_bit = {
@@ -270,14 +273,27 @@ static void set_uint8(Object *obj, Visitor *v, const char *name, void *opaque,
     visit_type_uint8(v, name, ptr, errp);
 }
 
+static bool prop_is_plain_integer(const Property *prop)
+{
+    return prop->info == &qdev_prop_uint8 || prop->info == &qdev_prop_uint16 ||
+           prop->info == &qdev_prop_uint32 || prop->info == &qdev_prop_int32 ||
+           prop->info == &qdev_prop_uint64 || prop->info == &qdev_prop_int64;
+}
+
 static void set_default_value_int(ObjectProperty *op, const Property *prop)
 {
     object_property_set_default_int(op, prop->defval.i);
+    if (prop_is_plain_integer(prop)) {
+        op->init = init_default_scalar;
+    }
 }
 
 static void set_default_value_uint(ObjectProperty *op, const Property *prop)
 {
     object_property_set_default_uint(op, prop->defval.u);
+    if (prop_is_plain_integer(prop)) {
+        op->init = init_default_scalar;
+    }
 }
 
 const PropertyInfo qdev_prop_uint8 = {
@@ -453,6 +469,40 @@ const PropertyInfo qdev_prop_int64 = {
     .set_default_value = set_default_value_int,
 };
 
+/*
+ * Defaults are applied to every new instance, so store them directly
+ * rather than through a visitor and the QObject kept in op->defval.
+ * Only for the types above, whose setters do nothing else.
+ */
+static void init_default_scalar(Object *obj, ObjectProperty *op)
+{
+    DeviceState *dev = DEVICE(obj);
+    Property *prop = op->opaque;
+    void *ptr = qdev_get_prop_ptr(dev, prop);
+
+    if (prop->info == &qdev_prop_bit) {
+        bit_prop_set(dev, prop, prop->defval.u);
+    } else if (prop->info == &qdev_prop_bit64) {
+        bit64_prop_set(dev, prop, prop->defval.u);
+    } else if (prop->info == &qdev_prop_bool) {
+        *(bool *)ptr = prop->defval.u;
+    } else if (prop->info == &qdev_prop_uint8) {
+        *(uint8_t *)ptr = prop->defval.u;
+    } else if (prop->info == &qdev_prop_uint16) {
+        *(uint16_t *)ptr = prop->defval.u;
+    } else if (prop->info == &qdev_prop_uint32) {
+        *(uint32_t *)ptr = prop->defval.u;
+    } else if (prop->info == &qdev_prop_int32) {
+        *(int32_t *)ptr = prop->defval.i;
+    } else if (prop->info == &qdev_prop_uint64) {
+        *(uint64_t *)ptr = prop->defval.u;
+    } else if (prop->info == &qdev_prop_int64) {
+        *(int64_t *)ptr = prop->defval.i;
+    } else {
+        abort();
+    }
+}
+
 /* --- string --- */
 
 static void release_string(Object *obj, const char *name, void *opaque)
@@ -39,6 +39,7 @@
 #include "hw/sysbus.h"
 #include "hw/pm_debug.h"
 #include "hw/qdev-clock.h"
+#include "hw/boot-profile.h"
 #include "migration/vmstate.h"
 #include "trace.h"
 
@@ -934,7 +935,10 @@ static void device_set_realized(Object *obj, bool value, Error **errp)
         }
 
         if (dc->realize) {
+            int64_t start = boot_profile_start();
+
             dc->realize(dev, &local_err);
+            boot_profile_span_object("realize", obj, start);
             if (local_err != NULL) {
                 goto fail;
             }
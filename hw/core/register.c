@@ -19,6 +19,12 @@
 #include "hw/register.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
+#include "qemu/main-loop.h"
+
+#ifdef CONFIG_DEBUG_MUTEX
+/* Register block locks held by this thread, for the lock order check */
+static __thread int register_locks_held;
+#endif
 
 static inline void register_write_val(RegisterInfo *reg, uint64_t val)
 {
@@ -178,30 +184,159 @@ void register_reset(RegisterInfo *reg)
 
 void register_init(RegisterInfo *reg)
 {
+    const RegisterAccessInfo *ac;
+
     assert(reg);
 
+    reg->fast_write = false;
+    reg->fast_read = false;
     if (!reg->data || !reg->access) {
         return;
     }
 
     object_initialize((void *)reg, sizeof(*reg), TYPE_REGISTER);
+
+    /* Registers that need no hooks and no logging skip register_write/read. */
+    ac = reg->access;
+    reg->no_w_mask = ac->ro | ac->w1c | ac->rsvd;
+    reg->fast_write = ac->name && !ac->pre_write && !ac->post_write &&
+                      !ac->rsvd && !ac->unimp;
+    reg->fast_read = ac->name && !ac->post_read && !ac->cor;
 }
 
-void register_write_memory(void *opaque, hwaddr addr,
-                           uint64_t value, unsigned size)
+static void register_array_build_index(RegisterInfoArray *reg_array)
+{
+    uint64_t max_addr = 0;
+    unsigned int stride;
+    int i;
+
+    if (!reg_array->num_elements) {
+        reg_array->no_index = true;
+        return;
+    }
+
+    stride = reg_array->r[0]->data_size;
+    for (i = 0; i < reg_array->num_elements; i++) {
+        RegisterInfo *r = reg_array->r[i];
+
+        if (r->data_size != stride || r->access->addr % stride) {
+            /* Mixed layouts stick to the linear search.  */
+            reg_array->no_index = true;
+            return;
+        }
+        max_addr = MAX(max_addr, r->access->addr);
+    }
+
+    reg_array->stride = stride;
+    reg_array->index_len = max_addr / stride + 1;
+    reg_array->index = g_new0(RegisterInfo *, reg_array->index_len);
+    for (i = 0; i < reg_array->num_elements; i++) {
+        RegisterInfo *r = reg_array->r[i];
+        uint64_t idx = r->access->addr / stride;
+
+        /* Same as the linear search, the first match wins.  */
+        if (!reg_array->index[idx]) {
+            reg_array->index[idx] = r;
+        }
+    }
+}
+
+static RegisterInfo *register_array_lookup(RegisterInfoArray *reg_array,
+                                           hwaddr addr)
 {
-    RegisterInfoArray *reg_array = opaque;
-    RegisterInfo *reg = NULL;
-    uint64_t we;
     int i;
 
+    if (!reg_array->index && !reg_array->no_index) {
+        register_array_build_index(reg_array);
+    }
+
+    if (reg_array->index) {
+        uint64_t idx = addr / reg_array->stride;
+
+        if (addr % reg_array->stride || idx >= reg_array->index_len) {
+            return NULL;
+        }
+        return reg_array->index[idx];
+    }
+
     for (i = 0; i < reg_array->num_elements; i++) {
         if (reg_array->r[i]->access->addr == addr) {
-            reg = reg_array->r[i];
-            break;
+            return reg_array->r[i];
         }
     }
+    return NULL;
+}
+
+/*
+ * Take the locks a lockless register block needs for an access; @slow is
+ * set if the access may run hooks or log.  Returns true if the BQL was
+ * taken here and must be dropped by register_array_end().
+ */
+static bool register_array_begin(RegisterInfoArray *reg_array, bool slow)
+{
+    bool bql = false;
+
+    if (!reg_array->lockless) {
+        return false;
+    }
+
+    if (slow && !qemu_mutex_iothread_locked()) {
+#ifdef CONFIG_DEBUG_MUTEX
+        /* The BQL must never be taken with a register block lock held */
+        g_assert(register_locks_held == 0);
+#endif
+        qemu_mutex_lock_iothread();
+        bql = true;
+    }
+    qemu_rec_mutex_lock(&reg_array->lock);
+#ifdef CONFIG_DEBUG_MUTEX
+    register_locks_held++;
+#endif
+    return bql;
+}
+
+static void register_array_end(RegisterInfoArray *reg_array, bool bql)
+{
+    if (!reg_array->lockless) {
+        return;
+    }
 
+#ifdef CONFIG_DEBUG_MUTEX
+    register_locks_held--;
+#endif
+    qemu_rec_mutex_unlock(&reg_array->lock);
+    if (bql) {
+        qemu_mutex_unlock_iothread();
+    }
+}
+
+/* Whether a fast path write may run without the BQL */
+static inline bool register_write_unlocked(RegisterInfoArray *reg_array,
+                                           RegisterInfo *reg)
+{
+    return reg->fast_write && !reg->no_w_mask && !reg_array->debug;
+}
+
+static inline void register_write_fast(RegisterInfo *reg, uint64_t val,
+                                       uint64_t we)
+{
+    uint64_t no_w_mask = reg->no_w_mask | ~we;
+    uint64_t new_val;
+
+    new_val = (val & ~no_w_mask) | (register_read_val(reg) & no_w_mask);
+    new_val &= ~(val & reg->access->w1c);
+    register_write_val(reg, new_val);
+}
+
+void register_write_memory(void *opaque, hwaddr addr,
+                           uint64_t value, unsigned size)
+{
+    RegisterInfoArray *reg_array = opaque;
+    RegisterInfo *reg;
+    uint64_t we;
+    bool bql;
+
+    reg = register_array_lookup(reg_array, addr);
     if (!reg) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s: write to unimplemented register " \
                       "at address: %#" PRIx64 "\n", reg_array->prefix, addr);
@@ -211,8 +346,15 @@ void register_write_memory(void *opaque, hwaddr addr,
     /* Generate appropriate write enable mask */
     we = register_enabled_mask(reg->data_size, size);
 
-    register_write(reg, value, we, reg_array->prefix,
-                   reg_array->debug);
+    bql = register_array_begin(reg_array,
+                               !register_write_unlocked(reg_array, reg));
+    if (reg->fast_write && !reg_array->debug) {
+        register_write_fast(reg, value, we);
+    } else {
+        register_write(reg, value, we, reg_array->prefix,
+                       reg_array->debug);
+    }
+    register_array_end(reg_array, bql);
 }
 
 void register_trap_access(RegisterInfo *reg,
@@ -232,33 +374,34 @@ MemTxResult register_write_memory_with_attrs(void *opaque, hwaddr addr,
     RegisterInfo reg_d;
     RegisterAccessInfo access_d;
     RegisterInfoArray *reg_array = opaque;
-    RegisterInfo *reg = NULL;
+    RegisterInfo *reg;
     uint64_t we;
-    int i;
-
-    for (i = 0; i < reg_array->num_elements; i++) {
-        if (reg_array->r[i]->access->addr == addr) {
-            reg = reg_array->r[i];
-            break;
-        }
-    }
+    bool bql;
 
+    reg = register_array_lookup(reg_array, addr);
     if (!reg) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s: write to unimplemented register " \
                       "at address: %#" PRIx64 "\n", reg_array->prefix, addr);
         return MEMTX_DECODE_ERROR;
     }
 
+    /* Generate appropriate write enable mask */
+    we = register_enabled_mask(reg->data_size, size);
+
+    bql = register_array_begin(reg_array, attrs.debug ||
+                               !register_write_unlocked(reg_array, reg));
     if (attrs.debug) {
         register_trap_access(reg, &reg_d, &access_d);
         reg = &reg_d;
+    } else if (reg->fast_write && !reg_array->debug) {
+        register_write_fast(reg, value, we);
+        register_array_end(reg_array, bql);
+        return MEMTX_OK;
     }
 
-    /* Generate appropriate write enable mask */
-    we = register_enabled_mask(reg->data_size, size);
-
     register_write(reg, value, we, reg_array->prefix,
                    reg_array->debug);
+    register_array_end(reg_array, bql);
 
     return MEMTX_OK;
 }
@@ -268,18 +411,12 @@ uint64_t register_read_memory(void *opaque, hwaddr addr,
                               unsigned size)
 {
     RegisterInfoArray *reg_array = opaque;
-    RegisterInfo *reg = NULL;
+    RegisterInfo *reg;
     uint64_t read_val;
     uint64_t re;
-    int i;
-
-    for (i = 0; i < reg_array->num_elements; i++) {
-        if (reg_array->r[i]->access->addr == addr) {
-            reg = reg_array->r[i];
-            break;
-        }
-    }
+    bool fast, bql;
 
+    reg = register_array_lookup(reg_array, addr);
     if (!reg) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s:  read to unimplemented register " \
                       "at address: %#" PRIx64 "\n", reg_array->prefix, addr);
@@ -289,8 +426,15 @@ uint64_t register_read_memory(void *opaque, hwaddr addr,
     /* Generate appropriate read enable mask */
     re = register_enabled_mask(reg->data_size, size);
 
-    read_val = register_read(reg, re, reg_array->prefix,
-                             reg_array->debug);
+    fast = reg->fast_read && !reg_array->debug;
+    bql = register_array_begin(reg_array, !fast);
+    if (fast) {
+        read_val = register_read_val(reg) & re;
+    } else {
+        read_val = register_read(reg, re, reg_array->prefix,
+                                 reg_array->debug);
+    }
+    register_array_end(reg_array, bql);
 
     return extract64(read_val, 0, size * 8);
 }
@@ -329,6 +473,7 @@ static RegisterInfoArray *register_init_block(DeviceState *owner,
         r_array->r[i] = r;
     }
 
+    register_array_build_index(r_array);
     memory_region_init_io(&r_array->mem, OBJECT(owner), ops, r_array,
                           device_prefix, memory_size);
 
@@ -359,9 +504,24 @@ RegisterInfoArray *register_init_block32(DeviceState *owner,
                                data, ops, debug_enabled, memory_size, 32);
 }
 
+void register_array_set_lockless(RegisterInfoArray *r_array)
+{
+    if (r_array->lockless) {
+        return;
+    }
+
+    qemu_rec_mutex_init(&r_array->lock);
+    r_array->lockless = true;
+    memory_region_clear_global_locking(&r_array->mem);
+}
+
 void register_finalize_block(RegisterInfoArray *r_array)
 {
+    if (r_array->lockless) {
+        qemu_rec_mutex_destroy(&r_array->lock);
+    }
     object_unparent(OBJECT(&r_array->mem));
+    g_free(r_array->index);
     g_free(r_array->r);
     g_free(r_array);
 }
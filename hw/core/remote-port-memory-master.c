@@ -42,10 +42,11 @@
 
 #define RP_MAX_ACCESS_SIZE 4096
 
-void rp_mm_access(RemotePort *rp, uint32_t rp_dev,
-                  struct rp_peer_state *peer,
-                  MemoryTransaction *tr,
-                  bool relative, uint64_t offset)
+void rp_mm_access_f(RemotePort *rp, uint32_t rp_dev,
+                    struct rp_peer_state *peer,
+                    MemoryTransaction *tr,
+                    bool relative, uint64_t offset,
+                    uint32_t flags)
 {
     uint64_t addr = tr->addr;
     RemotePortRespSlot *rsp_slot;
@@ -77,6 +78,7 @@ void rp_mm_access(RemotePort *rp, uint32_t rp_dev,
 
     in.cmd = tr->rw ? RP_CMD_write : RP_CMD_read;
     in.id = rp_new_id(rp);
+    in.flags = flags;
     in.dev = rp_dev;
     in.clk = rp_normalized_vmclk(rp);
     in.master_id = tr->attr.requester_id;
@@ -87,6 +89,16 @@ void rp_mm_access(RemotePort *rp, uint32_t rp_dev,
     len = rp_encode_busaccess(peer, &pay.pkt, &in);
     len += tr->rw ? tr->size : 0;
 
+    if (flags & RP_PKT_FLAGS_posted) {
+        /*
+         * Nobody waits for posted writes. They get flushed out together
+         * with the next non-posted packet at the latest.
+         */
+        assert(tr->rw);
+        rp_write_posted(rp, (void *) &pay, len);
+        return;
+    }
+
     rp_rsp_mutex_lock(rp);
     rp_write(rp, (void *) &pay, len);
 
@@ -131,12 +143,25 @@ void rp_mm_access(RemotePort *rp, uint32_t rp_dev,
     DB_PRINT_L(1, "\n");
 }
 
+void rp_mm_access(RemotePort *rp, uint32_t rp_dev,
+                  struct rp_peer_state *peer,
+                  MemoryTransaction *tr,
+                  bool relative, uint64_t offset)
+{
+    rp_mm_access_f(rp, rp_dev, peer, tr, relative, offset, 0);
+}
+
 static void rp_access(MemoryTransaction *tr)
 {
     RemotePortMap *map = tr->opaque;
     RemotePortMemoryMaster *s = map->parent;
+    uint32_t flags = 0;
 
-    rp_mm_access(s->rp, s->rp_dev, s->peer, tr, s->relative, map->offset);
+    if (tr->rw && s->posted_writes && s->peer->caps.busaccess_posted_writes) {
+        flags |= RP_PKT_FLAGS_posted;
+    }
+    rp_mm_access_f(s->rp, s->rp_dev, s->peer, tr, s->relative, map->offset,
+                   flags);
 }
 
 static const MemoryRegionOps rp_ops_template = {
@@ -234,6 +259,8 @@ static Property rp_properties[] = {
     DEFINE_PROP_BOOL("relative", RemotePortMemoryMaster, relative, false),
     DEFINE_PROP_UINT32("max-access-size", RemotePortMemoryMaster,
                        max_access_size, RP_MAX_ACCESS_SIZE),
+    DEFINE_PROP_BOOL("posted-writes", RemotePortMemoryMaster, posted_writes,
+                     false),
     DEFINE_PROP_END_OF_LIST()
 };
 
@@ -18,6 +18,7 @@
 #include "hw/qdev-core.h"
 #include "migration/vmstate.h"
 #include "hw/qdev-properties.h"
+#include "qemu/rcu.h"
 
 #include "hw/remote-port-proto.h"
 #include "hw/remote-port-device.h"
@@ -36,25 +37,101 @@
     } \
 } while (0);
 
-/* Slow path dealing with odd stuff like byte-enables.  */
+/*
+ * Map the window covered by a stream word if it is plain RAM.
+ * Returns NULL if the window needs to go through the normal dispatch,
+ * e.g because it hits MMIO or isn't fully mappable.
+ */
+static uint8_t *rp_ms_map_ram(RemotePortMemorySlave *s, hwaddr addr,
+                              hwaddr len, bool is_write)
+{
+    MemoryRegion *mr;
+    hwaddr xlat;
+    hwaddr l = len;
+    bool direct;
+    void *host;
+
+    RCU_READ_LOCK_GUARD();
+    mr = address_space_translate(&s->as, addr, &xlat, &l, is_write, s->attr);
+    direct = l == len && memory_access_is_direct(mr, is_write);
+    if (!direct) {
+        return NULL;
+    }
+
+    host = address_space_map(&s->as, addr, &l, is_write, s->attr);
+    if (host && l < len) {
+        address_space_unmap(&s->as, host, l, is_write, 0);
+        return NULL;
+    }
+    return host;
+}
+
+/*
+ * Slow path dealing with odd stuff like byte-enables and streaming.
+ * Contiguous runs of enabled bytes within a stream word are issued as
+ * single accesses. If the stream window is RAM, we map it once and
+ * copy the runs directly.
+ */
 static void process_data_slow(RemotePortMemorySlave *s,
                               struct rp_pkt *pkt,
                               DMADirection dir,
                               uint8_t *data, uint8_t *byte_en)
 {
-    unsigned int i;
     unsigned int byte_en_len = pkt->busaccess_ext_base.byte_enable_len;
     unsigned int sw = pkt->busaccess.stream_width;
+    unsigned int len = pkt->busaccess.len;
+    uint64_t addr = pkt->busaccess.addr;
+    bool is_write = dir == DMA_DIRECTION_FROM_DEVICE;
+    hwaddr map_len;
+    uint8_t *host;
+    unsigned int pos = 0;
 
     assert(sw);
 
-    for (i = 0; i < pkt->busaccess.len; i++) {
-        if (byte_en && !byte_en[i % byte_en_len]) {
+    map_len = MIN(sw, len);
+    host = rp_ms_map_ram(s, addr, map_len, is_write);
+    if (host) {
+        dma_barrier(&s->as, dir);
+    }
+
+    while (pos < len) {
+        unsigned int end;
+        unsigned int n;
+
+        if (byte_en && !byte_en[pos % byte_en_len]) {
+            pos++;
             continue;
         }
 
-        dma_memory_rw_attr(&s->as, pkt->busaccess.addr + i % sw, data + i,
-                           1, dir, s->attr);
+        /* Extend the run up to a disabled lane or the end of the word.  */
+        end = MIN(len, pos - pos % sw + sw);
+        if (byte_en) {
+            unsigned int i;
+
+            for (i = pos + 1; i < end; i++) {
+                if (!byte_en[i % byte_en_len]) {
+                    break;
+                }
+            }
+            end = i;
+        }
+        n = end - pos;
+
+        if (host) {
+            if (is_write) {
+                memcpy(host + pos % sw, data + pos, n);
+            } else {
+                memcpy(data + pos, host + pos % sw, n);
+            }
+        } else {
+            dma_memory_rw_attr(&s->as, addr + pos % sw, data + pos,
+                               n, dir, s->attr);
+        }
+        pos = end;
+    }
+
+    if (host) {
+        address_space_unmap(&s->as, host, map_len, is_write, map_len);
     }
 }
 
@@ -103,6 +180,12 @@ static void rp_cmd_rw(RemotePortMemorySlave *s, struct rp_pkt *pkt,
         qemu_hexdump((const char *)data, stderr, ": read: ",
                      pkt->busaccess.len);
     }
+    if (dir == DMA_DIRECTION_FROM_DEVICE
+        && (pkt->hdr.flags & RP_PKT_FLAGS_posted)) {
+        /* Posted writes don't get a response.  */
+        return;
+    }
+
     /* delay here could be set to the annotated cost of doing issuing
        these accesses. QEMU doesn't support this kind of annotations
        at the moment. So we just clear the delay.  */
@@ -137,6 +220,31 @@ static void rp_memory_slave_read(RemotePortDevice *s, struct rp_pkt *pkt)
                      DMA_DIRECTION_TO_DEVICE);
 }
 
+/*
+ * Accesses that only hit RAM can be serviced by a worker thread without
+ * the iothread lock. Should the memory map change under our feet, the
+ * memory core takes the lock itself for any MMIO it ends up dispatching.
+ */
+static bool rp_memory_slave_bql_free(RemotePortDevice *obj,
+                                     struct rp_pkt *pkt)
+{
+    RemotePortMemorySlave *s = REMOTE_PORT_MEMORY_SLAVE(obj);
+    bool is_write = pkt->hdr.cmd == RP_CMD_write;
+    hwaddr len = MIN(pkt->busaccess.len, pkt->busaccess.stream_width);
+    hwaddr l = len;
+    MemoryRegion *mr;
+    hwaddr xlat;
+
+    if (pkt->hdr.cmd != RP_CMD_read && pkt->hdr.cmd != RP_CMD_write) {
+        return false;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    mr = address_space_translate(&s->as, pkt->busaccess.addr, &xlat, &l,
+                                 is_write, MEMTXATTRS_UNSPECIFIED);
+    return l == len && memory_access_is_direct(mr, is_write);
+}
+
 static void rp_memory_slave_init(Object *obj)
 {
     RemotePortMemorySlave *rpms = REMOTE_PORT_MEMORY_SLAVE(obj);
@@ -165,6 +273,7 @@ static void rp_memory_slave_class_init(ObjectClass *oc, void *data)
 
     rpdc->ops[RP_CMD_write] = rp_memory_slave_write;
     rpdc->ops[RP_CMD_read] = rp_memory_slave_read;
+    rpdc->bql_free = rp_memory_slave_bql_free;
     dc->realize = rp_memory_slave_realize;
     dc->unrealize = rp_memory_slave_unrealize;
 }
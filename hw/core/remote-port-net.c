@@ -102,19 +102,12 @@ static bool rp_net_can_rx(NetClientState *nc)
     return true;
 }
 
-#define RP_NET_MAX_PACKET_SIZE (4 * 1024)
 static ssize_t rp_net_rx(NetClientState *nc, const uint8_t *buf, size_t size)
 {
     struct RemotePortNet *s = qemu_get_nic_opaque(nc);
-    struct  {
-        struct rp_pkt_busaccess_ext_base pkt;
-        uint8_t reserved[RP_NET_MAX_PACKET_SIZE];
-    } pay;
-    uint8_t *data = rp_busaccess_tx_dataptr(s->rx.peer, &pay.pkt);
+    struct rp_pkt_busaccess_ext_base pkt;
     struct rp_encode_busaccess_in in = {0};
-    int len;
-
-    memcpy(data, buf, size);
+    struct iovec iov[2];
 
     in.cmd = RP_CMD_write;
     in.flags = RP_PKT_FLAGS_posted;
@@ -126,10 +119,16 @@ static ssize_t rp_net_rx(NetClientState *nc, const uint8_t *buf, size_t size)
     in.attr = RP_BUS_ATTR_EOP;
     in.size = size;
     in.stream_width = size;
-    len = rp_encode_busaccess(s->rx.peer, &pay.pkt, &in);
-    len += size;
 
-    rp_write(s->rx.rp, (void *) &pay, len);
+    /* The payload immediately follows the header, send it from buf.  */
+    iov[0].iov_base = &pkt;
+    iov[0].iov_len = rp_encode_busaccess(s->rx.peer, &pkt, &in);
+    iov[1].iov_base = (void *) buf;
+    iov[1].iov_len = size;
+    assert(rp_busaccess_tx_dataptr(s->rx.peer, &pkt) ==
+           (uint8_t *) &pkt + iov[0].iov_len);
+
+    rp_writev(s->rx.rp, iov, ARRAY_SIZE(iov));
     return size;
 }
 
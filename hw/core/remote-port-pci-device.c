@@ -18,6 +18,7 @@
 #include "hw/sysbus.h"
 #include "migration/vmstate.h"
 #include "hw/qdev-properties.h"
+#include "sysemu/hostmem.h"
 
 #include "hw/remote-port.h"
 #include "hw/remote-port-device.h"
@@ -59,6 +60,14 @@
  * 3            DMA from the End-point towards us.
  * 4 - 9        Reserved
  * 10 - 20      IO or Memory Mapped BARs (6 + 4 reserved)
+ *
+ * A memory BAR can instead be backed by a shared memory backend
+ * (memdev-barN).  The guest then accesses it directly and the peer
+ * sees the data in its own mapping of the same file, without
+ * remote-port transactions.
+ *
+ * Interrupt line N of the legacy IRQ channel raises MSI or MSI-X
+ * vector N when the guest has enabled them.
  */
 #define RPDEV_PCI_CONFIG        0
 #define RPDEV_PCI_LEGACY_IRQ    1
@@ -66,6 +75,13 @@
 #define RPDEV_PCI_DMA           3
 #define RPDEV_PCI_BAR_BASE     10
 
+/*
+ * With config-read-ahead, remote config space reads fetch and cache a
+ * whole block.  Any config write, reset or interrupt from the peer
+ * drops the cache.
+ */
+#define RP_PCI_CONFIG_BLOCK     64
+
 typedef struct RemotePortPCIDevice RemotePortPCIDevice;
 
 struct RemotePortPCIDevice {
@@ -95,7 +111,15 @@ struct RemotePortPCIDevice {
 
         bool msi;
         bool msix;
+        uint32_t msi_vectors;
+        uint32_t msix_vectors;
+        bool config_read_ahead;
+        HostMemoryBackend *bar_memdev[6];
     } cfg;
+
+    uint8_t config_cache[PCI_CONFIG_SPACE_SIZE];
+    DECLARE_BITMAP(config_cached, PCI_CONFIG_SPACE_SIZE / RP_PCI_CONFIG_BLOCK);
+
     struct RemotePort *rp;
     struct rp_peer_state *peer;
 };
@@ -113,6 +137,37 @@ static const MemoryRegionOps rp_ops = {
     .endianness = DEVICE_LITTLE_ENDIAN,
 };
 
+static void rp_pci_config_flush(RemotePortPCIDevice *s)
+{
+    bitmap_zero(s->config_cached, PCI_CONFIG_SPACE_SIZE / RP_PCI_CONFIG_BLOCK);
+}
+
+static uint32_t rp_pci_read_config_cached(RemotePortPCIDevice *s,
+                                          uint32_t addr, int size)
+{
+    unsigned int block = addr / RP_PCI_CONFIG_BLOCK;
+    uint32_t base = block * RP_PCI_CONFIG_BLOCK;
+    MemoryTransaction tr = {
+        .addr = base,
+        .rw = false,
+        .size = RP_PCI_CONFIG_BLOCK,
+        .data.p8 = s->config_cache + base,
+        .attr = MEMTXATTRS_UNSPECIFIED
+    };
+    uint32_t val = 0;
+    int i;
+
+    if (!test_bit(block, s->config_cached)) {
+        rp_mm_access(s->rp, s->cfg.rp_dev, s->peer, &tr, true, 0);
+        set_bit(block, s->config_cached);
+    }
+
+    for (i = 0; i < size; i++) {
+        val |= s->config_cache[addr + i] << (i * 8);
+    }
+    return val;
+}
+
 static uint32_t rp_pci_read_config(PCIDevice *pci_dev, uint32_t addr, int size)
 {
     RemotePortPCIDevice *s = REMOTE_PORT_PCI_DEVICE(pci_dev);
@@ -123,7 +178,12 @@ static uint32_t rp_pci_read_config(PCIDevice *pci_dev, uint32_t addr, int size)
         .attr = MEMTXATTRS_UNSPECIFIED
     };
 
-    rp_mm_access(s->rp, s->cfg.rp_dev, s->peer, &tr, true, 0);
+    /* Config accesses never cross a dword, nor a block.  */
+    if (s->cfg.config_read_ahead && addr + size <= PCI_CONFIG_SPACE_SIZE) {
+        tr.data.u64 = rp_pci_read_config_cached(s, addr, size);
+    } else {
+        rp_mm_access(s->rp, s->cfg.rp_dev, s->peer, &tr, true, 0);
+    }
     DB_PRINT_L(0, "addr: %x data: %x\n", addr, (uint32_t) tr.data.u64);
     return tr.data.u64;
 }
@@ -141,6 +201,7 @@ static void rp_pci_write_config(PCIDevice *pci_dev, uint32_t addr,
     };
 
     DB_PRINT_L(0, "addr: %x data: %x\n", addr, value);
+    rp_pci_config_flush(s);
     rp_mm_access(s->rp, s->cfg.rp_dev, s->peer, &tr, true, 0);
     pci_default_write_config(pci_dev, addr, value, size);
     DB_PRINT_L(1, "\n");
@@ -155,17 +216,31 @@ static void rp_gpio_interrupt(RemotePortDevice *rpd, struct rp_pkt *pkt)
 
     DB_PRINT_L(0, "%s: irq[%d]=%d\n", __func__, irq, level);
 
+    /* The peer may have changed its config space along with the IRQ.  */
+    rp_pci_config_flush(s);
+
     /*
-     * If MSI/MSI-X is enabled, map interrupt wires onto MSI.
+     * If MSI/MSI-X is enabled, map interrupt wire N onto vector N.
      * This will only work when QEMU owns the CONFIG space.
      */
     if (s->cfg.msix && msix_enabled(d)) {
         if (level) {
-            msix_notify(d, 0);
+            if (irq >= s->cfg.msix_vectors) {
+                qemu_log_mask(LOG_GUEST_ERROR, "%s: no MSI-X vector %d\n",
+                              TYPE_REMOTE_PORT_PCI_DEVICE, irq);
+                return;
+            }
+            msix_notify(d, irq);
         }
     } else if (s->cfg.msi && msi_enabled(d)) {
         if (level) {
-            msi_notify(d, 0);
+            uint16_t flags = pci_get_word(d->config + d->msi_cap +
+                                          PCI_MSI_FLAGS);
+            unsigned int nr = 1U << ((flags & PCI_MSI_FLAGS_QSIZE) >>
+                                     ctz32(PCI_MSI_FLAGS_QSIZE));
+
+            /* With fewer vectors enabled, the last one is shared.  */
+            msi_notify(d, MIN(irq, nr - 1));
         }
     } else {
         pci_set_irq(d, level);
@@ -196,7 +271,11 @@ static void rp_pci_realize(PCIDevice *pci_dev, Error **errp)
     pci_dev->config_write = rp_pci_write_config;
 
     if (s->cfg.msi) {
-        msi_init(pci_dev, 0x60, 1, true, false, &error_fatal);
+        if (!is_power_of_2(s->cfg.msi_vectors) || s->cfg.msi_vectors > 32) {
+            error_setg(errp, "msi-vectors must be a power of 2 up to 32");
+            return;
+        }
+        msi_init(pci_dev, 0x60, s->cfg.msi_vectors, true, false, &error_fatal);
     }
 
     /* Create and hook up the BARs.  */
@@ -208,19 +287,45 @@ static void rp_pci_realize(PCIDevice *pci_dev, Error **errp)
         uint8_t attr = io_bar ?
                PCI_BASE_ADDRESS_SPACE_IO : PCI_BASE_ADDRESS_SPACE_MEMORY;
 
-        memory_region_init_io(&s->maps[i].iomem, OBJECT(s), &rp_ops,
-                              &s->maps[i], name, s->cfg.bar_size[i]);
-        pci_register_bar(pci_dev, i, attr, &s->maps[i].iomem);
+        HostMemoryBackend *memdev = i < 6 ? s->cfg.bar_memdev[i] : NULL;
+
         s->maps[i].rp_dev = RPDEV_PCI_BAR_BASE + i;
         s->maps[i].parent = s;
+
+        if (memdev) {
+            MemoryRegion *mr = host_memory_backend_get_memory(memdev);
+
+            if (io_bar || host_memory_backend_is_mapped(memdev) ||
+                !is_power_of_2(memory_region_size(mr))) {
+                error_setg(errp, "memdev-bar%d must be an unused memory "
+                           "backend with a power of 2 size backing a "
+                           "memory BAR", i);
+                g_free(name);
+                return;
+            }
+            host_memory_backend_set_mapped(memdev, true);
+            pci_register_bar(pci_dev, i, attr, mr);
+        } else {
+            memory_region_init_io(&s->maps[i].iomem, OBJECT(s), &rp_ops,
+                                  &s->maps[i], name, s->cfg.bar_size[i]);
+            pci_register_bar(pci_dev, i, attr, &s->maps[i].iomem);
+        }
         g_free(name);
     }
 
     if (s->cfg.msix) {
-        msix_init_exclusive_bar(pci_dev, 1,
+        if (!s->cfg.msix_vectors ||
+            s->cfg.msix_vectors > PCI_MSIX_FLAGS_QSIZE + 1) {
+            error_setg(errp, "msix-vectors must be between 1 and %d",
+                       PCI_MSIX_FLAGS_QSIZE + 1);
+            return;
+        }
+        msix_init_exclusive_bar(pci_dev, s->cfg.msix_vectors,
                                 s->cfg.nr_io_bars + s->cfg.nr_mm_bars,
                                 NULL);
-        msix_vector_use(pci_dev, 0);
+        for (i = 0; i < s->cfg.msix_vectors; i++) {
+            msix_vector_use(pci_dev, i);
+        }
     }
 
     /* Setup the DMA dev.  */
@@ -237,6 +342,13 @@ static void rp_pci_realize(PCIDevice *pci_dev, Error **errp)
 static void rp_pci_exit(PCIDevice *pci_dev)
 {
     RemotePortPCIDevice *s = REMOTE_PORT_PCI_DEVICE(pci_dev);
+    int i;
+
+    for (i = 0; i < 6; i++) {
+        if (s->cfg.bar_memdev[i]) {
+            host_memory_backend_set_mapped(s->cfg.bar_memdev[i], false);
+        }
+    }
 
     /* Setup the DMA dev.  */
     rp_device_detach(OBJECT(s->rp), OBJECT(s->rp_dma), 0,
@@ -251,6 +363,11 @@ static void rp_pci_exit(PCIDevice *pci_dev)
     object_unparent(OBJECT(s->rp_dma));
 }
 
+static void rp_pci_reset(DeviceState *dev)
+{
+    rp_pci_config_flush(REMOTE_PORT_PCI_DEVICE(dev));
+}
+
 static void rp_pci_init(Object *obj)
 {
     RemotePortPCIDevice *s = REMOTE_PORT_PCI_DEVICE(obj);
@@ -298,6 +415,25 @@ static Property rp_properties[] = {
                      cfg.remote_config, false),
     DEFINE_PROP_BOOL("msi", RemotePortPCIDevice, cfg.msi, false),
     DEFINE_PROP_BOOL("msix", RemotePortPCIDevice, cfg.msix, false),
+    DEFINE_PROP_UINT32("msi-vectors", RemotePortPCIDevice,
+                       cfg.msi_vectors, 1),
+    DEFINE_PROP_UINT32("msix-vectors", RemotePortPCIDevice,
+                       cfg.msix_vectors, 1),
+    DEFINE_PROP_BOOL("config-read-ahead", RemotePortPCIDevice,
+                     cfg.config_read_ahead, false),
+
+    DEFINE_PROP_LINK("memdev-bar0", RemotePortPCIDevice, cfg.bar_memdev[0],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_LINK("memdev-bar1", RemotePortPCIDevice, cfg.bar_memdev[1],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_LINK("memdev-bar2", RemotePortPCIDevice, cfg.bar_memdev[2],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_LINK("memdev-bar3", RemotePortPCIDevice, cfg.bar_memdev[3],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_LINK("memdev-bar4", RemotePortPCIDevice, cfg.bar_memdev[4],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_LINK("memdev-bar5", RemotePortPCIDevice, cfg.bar_memdev[5],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
 
     /* These are read-only.  */
     DEFINE_PROP_UINT32("nr-devs", RemotePortPCIDevice, cfg.nr_devs, 20),
@@ -311,6 +447,7 @@ static void rp_pci_class_init(ObjectClass *oc, void *data)
     PCIDeviceClass *k = PCI_DEVICE_CLASS(oc);
 
     dc->desc = "Remote-Port PCI Device";
+    dc->reset = rp_pci_reset;
     device_class_set_props(dc, rp_properties);
 
     rpdc->ops[RP_CMD_interrupt] = rp_gpio_interrupt;
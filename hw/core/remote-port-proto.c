@@ -87,6 +87,7 @@ static const char *rp_cmd_names[RP_CMD_max + 1] = {
     [RP_CMD_write] = "write",
     [RP_CMD_interrupt] = "interrupt",
     [RP_CMD_sync] = "sync",
+    [RP_CMD_checkpoint] = "checkpoint",
 };
 
 const char *rp_cmd_to_string(enum rp_cmd cmd)
@@ -188,6 +189,14 @@ int rp_decode_payload(struct rp_pkt *pkt)
         pkt->sync.timestamp = be64toh(pkt->interrupt.timestamp);
         used += pkt->hdr.len;
         break;
+    case RP_CMD_checkpoint:
+        assert(pkt->hdr.len >= sizeof pkt->checkpoint - sizeof pkt->hdr);
+        pkt->checkpoint.timestamp = be64toh(pkt->checkpoint.timestamp);
+        pkt->checkpoint.op = be32toh(pkt->checkpoint.op);
+        pkt->checkpoint.status = be32toh(pkt->checkpoint.status);
+        pkt->checkpoint.len = be32toh(pkt->checkpoint.len);
+        used += pkt->hdr.len;
+        break;
     default:
         break;
     }
@@ -397,6 +406,21 @@ size_t rp_encode_sync_resp(uint32_t id, uint32_t dev,
     return rp_encode_sync_common(id, dev, pkt, clk, RP_PKT_FLAGS_response);
 }
 
+size_t rp_encode_checkpoint(uint32_t id, uint32_t dev,
+                            struct rp_pkt_checkpoint *pkt,
+                            int64_t clk, uint32_t op, uint32_t status,
+                            uint32_t len, uint32_t flags)
+{
+    rp_encode_hdr(&pkt->hdr, RP_CMD_checkpoint, id, dev,
+                  sizeof *pkt - sizeof pkt->hdr + len, flags);
+    pkt->timestamp = htobe64(clk);
+    pkt->op = htobe32(op);
+    pkt->status = htobe32(status);
+    pkt->len = htobe32(len);
+    /* Caller adds the blob.  */
+    return sizeof *pkt;
+}
+
 void rp_process_caps(struct rp_peer_state *peer,
                      void *caps, size_t caps_len)
 {
@@ -419,6 +443,15 @@ void rp_process_caps(struct rp_peer_state *peer,
         case CAP_WIRE_POSTED_UPDATES:
             peer->caps.wire_posted_updates = true;
             break;
+        case CAP_SHM_RING:
+            peer->caps.shm_ring = true;
+            break;
+        case CAP_BUSACCESS_POSTED_WRITES:
+            peer->caps.busaccess_posted_writes = true;
+            break;
+        case CAP_CHECKPOINT:
+            peer->caps.checkpoint = true;
+            break;
         }
     }
 }
@@ -0,0 +1,242 @@
+/*
+ * QEMU remote-port shared-memory transport.
+ *
+ * Copyright (c) 2020 Xilinx Inc
+ *
+ * This code is licensed under the GNU GPL.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/processor.h"
+#include "qemu/host-utils.h"
+#include "qapi/error.h"
+
+#ifdef CONFIG_LINUX
+#include <sys/mman.h>
+#include "qemu/futex.h"
+#endif
+
+#include "hw/remote-port-shm.h"
+
+/* Number of polls before falling back to sleeping on the futex.  */
+#define RP_SHM_SPIN      4096
+/* Upper bound on each sleep so that we notice stop requests.  */
+#define RP_SHM_SLEEP_NS  (100 * 1000 * 1000)
+
+#ifdef CONFIG_LINUX
+static void rp_shm_kick(struct rp_shm_ring *r)
+{
+    atomic_inc(&r->seq);
+    smp_mb();
+    if (atomic_read(&r->waiters)) {
+        qemu_futex_wake(&r->seq, INT_MAX);
+    }
+}
+
+/*
+ * Wait for *idx to move away from old.
+ * Returns false if the ring got closed or *stop was set.
+ */
+static bool rp_shm_wait_idx(struct rp_shm_ring *r, uint32_t *idx,
+                            uint32_t old, const bool *stop)
+{
+    unsigned int spin;
+
+    for (spin = 0; spin < RP_SHM_SPIN; spin++) {
+        if (atomic_read(idx) != old) {
+            return true;
+        }
+        cpu_relax();
+    }
+
+    while (atomic_read(idx) == old) {
+        struct timespec ts = { .tv_sec = 0, .tv_nsec = RP_SHM_SLEEP_NS };
+        uint32_t seq = atomic_read(&r->seq);
+
+        if (atomic_read(&r->closed) || (stop && atomic_read(stop))) {
+            return false;
+        }
+
+        atomic_inc(&r->waiters);
+        smp_mb();
+        if (atomic_read(idx) == old) {
+            qemu_futex(&r->seq, FUTEX_WAIT, (int) seq, &ts, NULL, 0);
+        }
+        atomic_dec(&r->waiters);
+    }
+    return true;
+}
+
+ssize_t rp_shm_write(struct rp_shm_ring *r, const void *buf, size_t count,
+                     const bool *stop)
+{
+    uint32_t size = r->size;
+    const uint8_t *p = buf;
+    size_t done = 0;
+
+    while (done < count) {
+        uint32_t head = r->head;
+        uint32_t tail = atomic_load_acquire(&r->tail);
+        uint32_t space = size - (head - tail);
+        uint32_t off = head & (size - 1);
+        uint32_t chunk;
+
+        if (atomic_read(&r->closed)) {
+            break;
+        }
+        if (space == 0) {
+            if (!rp_shm_wait_idx(r, &r->tail, tail, stop)) {
+                break;
+            }
+            continue;
+        }
+
+        chunk = MIN(space, count - done);
+        chunk = MIN(chunk, size - off);
+        memcpy(r->data + off, p + done, chunk);
+        atomic_store_release(&r->head, head + chunk);
+        rp_shm_kick(r);
+        done += chunk;
+    }
+    return done;
+}
+
+ssize_t rp_shm_read(struct rp_shm_ring *r, void *buf, size_t count,
+                    const bool *stop)
+{
+    uint32_t size = r->size;
+    uint8_t *p = buf;
+    size_t done = 0;
+
+    while (done < count) {
+        uint32_t tail = r->tail;
+        uint32_t head = atomic_load_acquire(&r->head);
+        uint32_t avail = head - tail;
+        uint32_t off = tail & (size - 1);
+        uint32_t chunk;
+
+        if (avail == 0) {
+            if (!rp_shm_wait_idx(r, &r->head, head, stop)) {
+                break;
+            }
+            continue;
+        }
+
+        chunk = MIN(avail, count - done);
+        chunk = MIN(chunk, size - off);
+        memcpy(p + done, r->data + off, chunk);
+        atomic_store_release(&r->tail, tail + chunk);
+        rp_shm_kick(r);
+        done += chunk;
+    }
+    return done;
+}
+
+static void rp_shm_ring_init(struct rp_shm_ring *r, uint32_t size)
+{
+    memset(r, 0, sizeof *r);
+    r->size = size;
+}
+
+bool rp_shm_create(RemotePortShm *shm, const char *path, uint32_t ring_size,
+                   Error **errp)
+{
+    size_t ring_bytes;
+    void *map;
+    int fd;
+
+    ring_size = pow2ceil(MAX(ring_size, qemu_real_host_page_size));
+    ring_bytes = QEMU_ALIGN_UP(sizeof(struct rp_shm_ring) + ring_size,
+                               qemu_real_host_page_size);
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "unable to create %s", path);
+        return false;
+    }
+
+    shm->map_size = qemu_real_host_page_size + 2 * ring_bytes;
+    if (ftruncate(fd, shm->map_size) < 0) {
+        error_setg_errno(errp, errno, "unable to size %s", path);
+        close(fd);
+        unlink(path);
+        return false;
+    }
+
+    map = mmap(NULL, shm->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        error_setg_errno(errp, errno, "unable to map %s", path);
+        unlink(path);
+        return false;
+    }
+
+    shm->path = g_strdup(path);
+    shm->map = map;
+    shm->hdr = map;
+    shm->hdr->version = RP_SHM_VERSION;
+    shm->hdr->ring_size = ring_size;
+    shm->hdr->ring_offset[RP_SHM_RING_TO_PEER] = qemu_real_host_page_size;
+    shm->hdr->ring_offset[RP_SHM_RING_FROM_PEER] = qemu_real_host_page_size
+                                                   + ring_bytes;
+    shm->tx = map + shm->hdr->ring_offset[RP_SHM_RING_TO_PEER];
+    shm->rx = map + shm->hdr->ring_offset[RP_SHM_RING_FROM_PEER];
+    rp_shm_ring_init(shm->tx, ring_size);
+    rp_shm_ring_init(shm->rx, ring_size);
+
+    /* Publish the magic last, peers wait for it.  */
+    smp_wmb();
+    atomic_set(&shm->hdr->magic, RP_SHM_MAGIC);
+    return true;
+}
+
+void rp_shm_close(RemotePortShm *shm)
+{
+    if (!shm->map) {
+        return;
+    }
+    atomic_set(&shm->tx->closed, 1);
+    atomic_set(&shm->rx->closed, 1);
+    rp_shm_kick(shm->tx);
+    rp_shm_kick(shm->rx);
+}
+
+void rp_shm_destroy(RemotePortShm *shm)
+{
+    if (!shm->map) {
+        return;
+    }
+    munmap(shm->map, shm->map_size);
+    unlink(shm->path);
+    g_free(shm->path);
+    memset(shm, 0, sizeof *shm);
+}
+#else
+bool rp_shm_create(RemotePortShm *shm, const char *path, uint32_t ring_size,
+                   Error **errp)
+{
+    error_setg(errp, "shared-memory transport is not supported on this host");
+    return false;
+}
+
+void rp_shm_close(RemotePortShm *shm)
+{
+}
+
+void rp_shm_destroy(RemotePortShm *shm)
+{
+}
+
+ssize_t rp_shm_write(struct rp_shm_ring *r, const void *buf, size_t count,
+                     const bool *stop)
+{
+    g_assert_not_reached();
+}
+
+ssize_t rp_shm_read(struct rp_shm_ring *r, void *buf, size_t count,
+                    const bool *stop)
+{
+    g_assert_not_reached();
+}
+#endif
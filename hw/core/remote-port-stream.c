@@ -57,39 +57,43 @@ struct RemotePortStream {
     StreamCanPushNotifyFn notify;
     void *notify_opaque;
 
+    /* Data waiting for the consumer to accept it.  */
     uint8_t *buf;
+    size_t buf_len;
     struct rp_pkt pkt;
 
     bool rsp_pending;
     uint32_t current_id;
 };
 
+static void rp_stream_respond(RemotePortStream *s, struct rp_pkt *pkt)
+{
+    struct rp_pkt_busaccess_ext_base rsp;
+    struct rp_encode_busaccess_in in = {0};
+    int64_t delay = 0; /* FIXME - Implement */
+    size_t enclen;
+
+    rp_encode_busaccess_in_rsp_init(&in, pkt);
+    in.clk = pkt->busaccess.timestamp + delay;
+    enclen = rp_encode_busaccess(rp_get_peer(s->rp), &rsp, &in);
+    assert(enclen <= sizeof rsp);
+
+    rp_write(s->rp, (void *) &rsp, enclen);
+}
+
 static void rp_stream_notify(void *opaque)
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(opaque);
 
-    /* FIXME: This is completely bogus.  */
     if (s->buf && stream_can_push(s->tx_dev, rp_stream_notify, s)) {
-        RemotePortDynPkt rsp;
-        struct rp_encode_busaccess_in in = {0};
-        size_t pktlen = sizeof(struct rp_pkt_busaccess_ext_base);
-        size_t enclen;
-        int64_t delay = 0; /* FIXME - Implement */
-
-        size_t ret = stream_push(s->tx_dev, s->buf, 4, 0);
-        assert(ret == 4);
-        s->buf = NULL;
+        bool eop = s->pkt.busaccess.attributes & RP_BUS_ATTR_EOP;
+        size_t ret = stream_push(s->tx_dev, s->buf, s->buf_len, eop);
 
-        memset(&rsp, 0, sizeof(rsp));
-        rp_dpkt_alloc(&rsp, pktlen);
-        rp_encode_busaccess_in_rsp_init(&in, &s->pkt);
-        in.clk = s->pkt.busaccess.timestamp + delay;
-        enclen = rp_encode_busaccess(rp_get_peer(s->rp),
-                                     &rsp.pkt->busaccess_ext_base,
-                                     &in);
-        assert(enclen <= pktlen);
+        assert(ret == s->buf_len);
+        g_free(s->buf);
+        s->buf = NULL;
 
-        rp_write(s->rp, (void *)rsp.pkt, pktlen);
+        rp_stream_respond(s, &s->pkt);
     }
 }
 
@@ -111,10 +115,24 @@ static void rp_stream_write(RemotePortDevice *obj, struct rp_pkt *pkt)
             notify(s->notify_opaque);
         }
     } else {
+        uint8_t *data = rp_busaccess_rx_dataptr(rp_get_peer(s->rp),
+                                                &pkt->busaccess_ext_base);
+        bool eop = pkt->busaccess.attributes & RP_BUS_ATTR_EOP;
+
         assert(!s->buf);
-        s->buf = g_memdup(pkt + 1, 4);
+        if (stream_can_push(s->tx_dev, rp_stream_notify, s)) {
+            /* Fast path, hand the packet data straight to the consumer.  */
+            size_t ret = stream_push(s->tx_dev, data, pkt->busaccess.len, eop);
+
+            assert(ret == pkt->busaccess.len);
+            rp_stream_respond(s, pkt);
+            return;
+        }
+
+        /* The packet gets recycled once we return, keep a copy.  */
+        s->buf = g_memdup(data, pkt->busaccess.len);
+        s->buf_len = pkt->busaccess.len;
         s->pkt = *pkt;
-        rp_stream_notify(s);
     }
 }
 
@@ -140,6 +158,7 @@ static size_t rp_stream_stream_push(StreamSlave *obj, uint8_t *buf,
     struct rp_pkt_busaccess_ext_base pkt;
     struct rp_encode_busaccess_in in = {0};
     uint64_t rp_attr = eop ? RP_BUS_ATTR_EOP : 0;
+    struct iovec iov[2];
     int64_t clk;
     int enclen;
 
@@ -154,9 +173,13 @@ static size_t rp_stream_stream_push(StreamSlave *obj, uint8_t *buf,
     in.stream_width = s->stream_width;
     enclen = rp_encode_busaccess(rp_get_peer(s->rp), &pkt, &in);
 
+    iov[0].iov_base = &pkt;
+    iov[0].iov_len = enclen;
+    iov[1].iov_base = buf;
+    iov[1].iov_len = len;
+
     rp_rsp_mutex_lock(s->rp);
-    rp_write(s->rp, (void *) &pkt, enclen);
-    rp_write(s->rp, buf, len);
+    rp_writev(s->rp, iov, ARRAY_SIZE(iov));
     rsp = rp_wait_resp(s->rp);
     assert(rsp.pkt->hdr.id == be32_to_cpu(pkt.hdr.id));
     rp_dpkt_invalidate(&rsp);
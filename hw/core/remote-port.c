@@ -18,10 +18,19 @@
 #include "qemu/sockets.h"
 #include "qemu/thread.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
 #include "migration/vmstate.h"
 #include "hw/qdev-properties.h"
+#include "qemu/units.h"
+#include "qemu/timer.h"
+#include "qemu/host-utils.h"
+#include "qemu/iov.h"
+#include "qapi/qapi-commands-remote-port.h"
+#include "monitor/stats.h"
+#include "trace.h"
 
 #ifndef _WIN32
 #include <sys/mman.h>
@@ -77,7 +86,66 @@ uint32_t rp_new_id(RemotePort *s)
 
 void rp_rsp_mutex_lock(RemotePort *s)
 {
+    int64_t t;
+
+    if (qemu_mutex_trylock(&s->rsp_mutex) == 0) {
+        return;
+    }
+
+    t = get_clock();
     qemu_mutex_lock(&s->rsp_mutex);
+    stat64_add(&s->stats.rsp_lock_wait_ns, get_clock() - t);
+}
+
+static void rp_stats_pkt(RemotePortPktCounters *st, size_t len)
+{
+    stat64_add(&st->packets, 1);
+    stat64_add(&st->bytes, len);
+}
+
+/* Account for an encoded (network byte order) packet we are sending.  */
+static void rp_stats_tx(RemotePort *s, const void *buf, size_t len)
+{
+    const struct rp_pkt_hdr *hdr = buf;
+    uint32_t cmd = ldl_be_p(&hdr->cmd);
+    uint32_t dev = ldl_be_p(&hdr->dev);
+
+    assert(len >= sizeof *hdr);
+    if (cmd <= RP_CMD_max) {
+        rp_stats_pkt(&s->stats.tx[cmd], len);
+        trace_remote_port_tx(s->prefix, rp_cmd_to_string(cmd), dev,
+                             ldl_be_p(&hdr->id), ldl_be_p(&hdr->flags), len);
+    }
+    if (dev < ARRAY_SIZE(s->dev_state)) {
+        rp_stats_pkt(&s->dev_state[dev].tx_stats, len);
+    }
+}
+
+static void rp_stats_rx(RemotePort *s, struct rp_pkt *pkt)
+{
+    size_t len = sizeof pkt->hdr + pkt->hdr.len;
+
+    if (pkt->hdr.cmd <= RP_CMD_max) {
+        rp_stats_pkt(&s->stats.rx[pkt->hdr.cmd], len);
+        trace_remote_port_rx(s->prefix, rp_cmd_to_string(pkt->hdr.cmd),
+                             pkt->hdr.dev, pkt->hdr.id, pkt->hdr.flags, len);
+    }
+    if (pkt->hdr.dev < ARRAY_SIZE(s->dev_state)) {
+        rp_stats_pkt(&s->dev_state[pkt->hdr.dev].rx_stats, len);
+    }
+}
+
+static void rp_stats_rtt(RemotePort *s, uint32_t dev, uint32_t id,
+                         int64_t start)
+{
+    int64_t ns = get_clock() - start;
+    int64_t us = ns / SCALE_US;
+    unsigned int bucket;
+
+    bucket = us ? 64 - clz64(us) : 0;
+    bucket = MIN(bucket, RP_STATS_RTT_BUCKETS - 1);
+    stat64_add(&s->stats.rtt[bucket], 1);
+    trace_remote_port_rtt(s->prefix, dev, id, ns);
 }
 
 void rp_rsp_mutex_unlock(RemotePort *s)
@@ -128,7 +196,11 @@ static ssize_t rp_recv(RemotePort *s, void *buf, size_t count)
 {
     ssize_t r;
 
-    r = qemu_chr_fe_read_all(&s->chr, buf, count);
+    if (s->shm.rx_active) {
+        r = rp_shm_read(s->shm.rings.rx, buf, count, &s->finalizing);
+    } else {
+        r = qemu_chr_fe_read_all(&s->chr, buf, count);
+    }
     if (r <= 0) {
         return r;
     }
@@ -141,13 +213,16 @@ static ssize_t rp_recv(RemotePort *s, void *buf, size_t count)
     return r;
 }
 
-ssize_t rp_write(RemotePort *s, const void *buf, size_t count)
+/* Called with write_mutex held.  */
+static ssize_t rp_write_locked(RemotePort *s, const void *buf, size_t count)
 {
     ssize_t r;
 
-    qemu_mutex_lock(&s->write_mutex);
-    r = qemu_chr_fe_write_all(&s->chr, buf, count);
-    qemu_mutex_unlock(&s->write_mutex);
+    if (s->shm.tx_active) {
+        r = rp_shm_write(s->shm.rings.tx, buf, count, &s->finalizing);
+    } else {
+        r = qemu_chr_fe_write_all(&s->chr, buf, count);
+    }
     assert(r == count);
     if (r <= 0) {
         error_report("%s: Disconnected r=%zd buf=%p count=%zd\n",
@@ -157,6 +232,78 @@ ssize_t rp_write(RemotePort *s, const void *buf, size_t count)
     return r;
 }
 
+/* Called with write_mutex held.  */
+static void rp_flush_posted_locked(RemotePort *s)
+{
+    if (s->posted.len) {
+        rp_write_locked(s, s->posted.buf, s->posted.len);
+        s->posted.len = 0;
+    }
+}
+
+static void rp_posted_bh(void *opaque)
+{
+    RemotePort *s = REMOTE_PORT(opaque);
+
+    qemu_mutex_lock(&s->write_mutex);
+    rp_flush_posted_locked(s);
+    qemu_mutex_unlock(&s->write_mutex);
+}
+
+ssize_t rp_write(RemotePort *s, const void *buf, size_t count)
+{
+    ssize_t r;
+
+    rp_stats_tx(s, buf, count);
+    qemu_mutex_lock(&s->write_mutex);
+    /* Anything not posted is a barrier for the queued posted packets.  */
+    rp_flush_posted_locked(s);
+    r = rp_write_locked(s, buf, count);
+    qemu_mutex_unlock(&s->write_mutex);
+    return r;
+}
+
+ssize_t rp_writev(RemotePort *s, const struct iovec *iov, int iovcnt)
+{
+    ssize_t r = 0;
+    int i;
+
+    assert(iovcnt > 0);
+    rp_stats_tx(s, iov[0].iov_base, iov_size(iov, iovcnt));
+    qemu_mutex_lock(&s->write_mutex);
+    rp_flush_posted_locked(s);
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len) {
+            r += rp_write_locked(s, iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+    qemu_mutex_unlock(&s->write_mutex);
+    return r;
+}
+
+void rp_write_posted(RemotePort *s, const void *buf, size_t count)
+{
+    /* Posted packets get no responses, account for them here.  */
+    atomic_inc(&s->sync.activity);
+    rp_stats_tx(s, buf, count);
+
+    qemu_mutex_lock(&s->write_mutex);
+    if (s->posted.len + count > RP_POSTED_BUF_SIZE) {
+        rp_flush_posted_locked(s);
+    }
+
+    if (count > RP_POSTED_BUF_SIZE) {
+        rp_write_locked(s, buf, count);
+    } else {
+        if (!s->posted.len) {
+            qemu_bh_schedule(s->posted.bh);
+        }
+        memcpy(s->posted.buf + s->posted.len, buf, count);
+        s->posted.len += count;
+    }
+    qemu_mutex_unlock(&s->write_mutex);
+}
+
 static unsigned int rp_has_work(RemotePort *s)
 {
     unsigned int work = s->rx_queue.wpos - s->rx_queue.rpos;
@@ -166,6 +313,7 @@ static unsigned int rp_has_work(RemotePort *s)
 /* Response handling.  */
 RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id)
 {
+    int64_t start = get_clock();
     int i;
 
     assert(s->devs[dev]);
@@ -199,11 +347,14 @@ RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id)
             qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
         }
     }
+    rp_stats_rtt(s, dev, id, start);
     return &s->dev_state[dev].rsp_queue[i];
 }
 
 RemotePortDynPkt rp_wait_resp(RemotePort *s)
 {
+    int64_t start = get_clock();
+
     while (!rp_dpkt_is_valid(&s->rspqueue)) {
         rp_rsp_mutex_unlock(s);
         rp_event_read(s);
@@ -217,6 +368,7 @@ RemotePortDynPkt rp_wait_resp(RemotePort *s)
             qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
         }
     }
+    rp_stats_rtt(s, s->rspqueue.pkt->hdr.dev, s->rspqueue.pkt->hdr.id, start);
     return s->rspqueue;
 }
 
@@ -235,6 +387,20 @@ static void rp_cmd_hello(RemotePort *s, struct rp_pkt *pkt)
 
         rp_process_caps(&s->peer, caps, pkt->hello.caps.len);
     }
+
+    if (s->peer.caps.shm_ring && s->shm.rings.map) {
+        struct rp_pkt_hdr nop;
+
+        /*
+         * Our last packet on the chardev is a nop, it tells the peer to
+         * start reading from the rings.
+         */
+        rp_encode_hdr(&nop, RP_CMD_nop, rp_new_id(s), 0, 0, 0);
+        qemu_mutex_lock(&s->write_mutex);
+        qemu_chr_fe_write_all(&s->chr, (void *) &nop, sizeof nop);
+        s->shm.tx_active = true;
+        qemu_mutex_unlock(&s->write_mutex);
+    }
 }
 
 static void rp_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
@@ -273,21 +439,30 @@ static void rp_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
 static void rp_say_hello(RemotePort *s)
 {
     struct rp_pkt_hello pkt;
-    uint32_t caps[] = {
+    uint32_t caps[6] = {
         CAP_BUSACCESS_EXT_BASE,
         CAP_BUSACCESS_EXT_BYTE_EN,
         CAP_WIRE_POSTED_UPDATES,
+        CAP_BUSACCESS_POSTED_WRITES,
+        CAP_CHECKPOINT,
     };
+    unsigned int nr_caps = 5;
     size_t len;
 
+    if (s->shm.rings.map) {
+        caps[nr_caps++] = CAP_SHM_RING;
+    }
+
+    struct iovec iov[2];
+
     len = rp_encode_hello_caps(s->current_id++, 0, &pkt, RP_VERSION_MAJOR,
                                RP_VERSION_MINOR,
-                               caps, caps, sizeof caps / sizeof caps[0]);
-    rp_write(s, (void *) &pkt, len);
-
-    if (sizeof caps) {
-        rp_write(s, caps, sizeof caps);
-    }
+                               caps, caps, nr_caps);
+    iov[0].iov_base = &pkt;
+    iov[0].iov_len = len;
+    iov[1].iov_base = caps;
+    iov[1].iov_len = nr_caps * sizeof caps[0];
+    rp_writev(s, iov, ARRAY_SIZE(iov));
 }
 
 static void rp_say_sync(RemotePort *s, int64_t clk)
@@ -309,10 +484,24 @@ static void syncresp_timer_hit(void *opaque)
     memset(&s->sync.rsp, 0, sizeof s->sync.rsp);
 }
 
+/* Pick the next quantum based on the activity of the last period.  */
+static void rp_adapt_quantum(RemotePort *s)
+{
+    uint64_t quantum = s->sync.quantum;
+
+    if (atomic_xchg(&s->sync.activity, 0)) {
+        quantum = MAX(quantum / 2, s->sync.quantum_min);
+    } else {
+        quantum = MIN(quantum * 2, s->sync.quantum_max);
+    }
+    atomic_set(&s->sync.quantum, quantum);
+}
+
 static void sync_timer_hit(void *opaque)
 {
     RemotePort *s = REMOTE_PORT(opaque);
     int64_t clk;
+    int64_t stall;
     RemotePortDynPkt rsp;
 
     clk = rp_normalized_vmclk(s);
@@ -330,13 +519,21 @@ static void sync_timer_hit(void *opaque)
     qemu_mutex_lock(&s->rsp_mutex);
     /* Send the sync.  */
     rp_say_sync(s, clk);
+    s->sync.tx_count++;
 
     SYNCD(printf("%s: syncing wait for resp %lu\n", s->prefix, clk));
+    stall = get_clock();
     rsp = rp_wait_resp(s);
     rp_dpkt_invalidate(&rsp);
     qemu_mutex_unlock(&s->rsp_mutex);
     s->doing_sync = false;
+    stall = get_clock() - stall;
+    stat64_add(&s->stats.sync_stall_ns, stall);
+    trace_remote_port_sync(s->prefix, clk, stall, s->sync.quantum);
 
+    if (s->sync.adaptive) {
+        rp_adapt_quantum(s);
+    }
     rp_restart_sync_timer_bare(s);
 }
 
@@ -367,6 +564,35 @@ static char *rp_autocreate_chardesc(RemotePort *s, bool server)
     return chardesc;
 }
 
+static void rp_shm_setup(RemotePort *s)
+{
+    Error *err = NULL;
+    char *path = s->shm.path;
+
+    if (!path) {
+        char *prefix;
+
+        if (!machine_path) {
+            warn_report("%s: shm transport needs shm-path or -machine-path,"
+                        " using the chardev only", s->prefix);
+            return;
+        }
+        /* Same naming as the auto-created socket, with a -shm suffix.  */
+        prefix = rp_sanitize_prefix(s);
+        path = g_strdup_printf("%s/qemu-rport-%s-shm", machine_path, prefix);
+        g_free(prefix);
+    }
+
+    if (!rp_shm_create(&s->shm.rings, path, s->shm.ring_size, &err)) {
+        warn_report_err(err);
+        warn_report("%s: falling back to the chardev transport", s->prefix);
+    }
+
+    if (path != s->shm.path) {
+        g_free(path);
+    }
+}
+
 static Chardev *rp_autocreate_chardev(RemotePort *s, char *name)
 {
     Chardev *chr;
@@ -454,6 +680,31 @@ static void rp_event_read(void *opaque)
     rp_process(s);
 }
 
+static void rp_event_read_iothread(void *opaque)
+{
+    RemotePort *s = REMOTE_PORT(opaque);
+
+    /* Device ops expect the BQL, as they would get it in the main loop.  */
+    qemu_mutex_lock_iothread();
+    if (!s->finalizing) {
+        rp_event_read(s);
+    }
+    qemu_mutex_unlock_iothread();
+}
+
+static void rp_event_set_handler(RemotePort *s, bool enable)
+{
+    if (s->iothread) {
+        aio_set_fd_handler(iothread_get_aio_context(s->iothread),
+                           s->event.pipe.read, false,
+                           enable ? rp_event_read_iothread : NULL,
+                           NULL, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->event.pipe.read,
+                            enable ? rp_event_read : NULL, NULL, s);
+    }
+}
+
 static void rp_event_notify(RemotePort *s)
 {
     unsigned char d = 0;
@@ -503,6 +754,122 @@ static void rp_pt_handover_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
     } while (full);
 }
 
+static void *rp_worker_thread(void *opaque)
+{
+    RemotePortWorker *w = opaque;
+    RemotePortDeviceClass *rpdc = REMOTE_PORT_DEVICE_GET_CLASS(w->dev);
+
+    rcu_register_thread();
+
+    qemu_mutex_lock(&w->mutex);
+    while (!w->stop) {
+        struct rp_pkt *pkt;
+        bool bql;
+
+        if (w->rpos == w->wpos) {
+            qemu_cond_wait(&w->cond, &w->mutex);
+            continue;
+        }
+        pkt = w->pkt[w->rpos % RP_WORKER_QUEUE_SIZE].pkt;
+        qemu_mutex_unlock(&w->mutex);
+
+        bql = !rpdc->bql_free(w->dev, pkt);
+        if (bql) {
+            qemu_mutex_lock_iothread();
+        }
+        if (rpdc->ops[pkt->hdr.cmd]) {
+            rpdc->ops[pkt->hdr.cmd](w->dev, pkt);
+        }
+        if (bql) {
+            qemu_mutex_unlock_iothread();
+        }
+
+        qemu_mutex_lock(&w->mutex);
+        w->rpos++;
+        qemu_cond_broadcast(&w->cond);
+    }
+    qemu_mutex_unlock(&w->mutex);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static RemotePortWorker *rp_worker_new(RemotePort *s, RemotePortDevice *dev)
+{
+    RemotePortWorker *w = g_new0(RemotePortWorker, 1);
+    unsigned int i;
+
+    w->rp = s;
+    w->dev = dev;
+    for (i = 0; i < ARRAY_SIZE(w->pkt); i++) {
+        rp_dpkt_alloc(&w->pkt[i], sizeof w->pkt[i].pkt->busaccess + 1024);
+    }
+    qemu_mutex_init(&w->mutex);
+    qemu_cond_init(&w->cond);
+    qemu_thread_create(&w->thread, "remote-port-dev", rp_worker_thread, w,
+                       QEMU_THREAD_JOINABLE);
+    return w;
+}
+
+static void rp_worker_free(RemotePortWorker *w)
+{
+    unsigned int i;
+
+    qemu_mutex_lock(&w->mutex);
+    w->stop = true;
+    qemu_cond_broadcast(&w->cond);
+    qemu_mutex_unlock(&w->mutex);
+
+    /* The worker may be waiting for the BQL to finish its current pkt.  */
+    if (qemu_mutex_iothread_locked()) {
+        qemu_mutex_unlock_iothread();
+        qemu_thread_join(&w->thread);
+        qemu_mutex_lock_iothread();
+    } else {
+        qemu_thread_join(&w->thread);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(w->pkt); i++) {
+        rp_dpkt_free(&w->pkt[i]);
+    }
+    qemu_cond_destroy(&w->cond);
+    qemu_mutex_destroy(&w->mutex);
+    g_free(w);
+}
+
+/*
+ * Hand a pkt over to its device's worker, if it has one. All packets
+ * for such a device take this path so per-device ordering is kept.
+ * The rx-queue slot gets a free buffer back in exchange.
+ */
+static bool rp_pt_worker_handover(RemotePort *s, RemotePortDynPkt *dpkt)
+{
+    uint32_t devnr = dpkt->pkt->hdr.dev;
+    RemotePortDevice *dev = s->devs[devnr];
+    RemotePortWorker *w;
+
+    if (!s->dev_workers || !dev
+        || !REMOTE_PORT_DEVICE_GET_CLASS(dev)->bql_free) {
+        return false;
+    }
+
+    w = s->dev_state[devnr].worker;
+    if (!w) {
+        w = rp_worker_new(s, dev);
+        s->dev_state[devnr].worker = w;
+    }
+
+    qemu_mutex_lock(&w->mutex);
+    while (w->wpos - w->rpos == RP_WORKER_QUEUE_SIZE) {
+        qemu_cond_wait(&w->cond, &w->mutex);
+    }
+    rp_dpkt_swap(&w->pkt[w->wpos % RP_WORKER_QUEUE_SIZE], dpkt);
+    w->wpos++;
+    qemu_cond_broadcast(&w->cond);
+    qemu_mutex_unlock(&w->mutex);
+    return true;
+}
+
 static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
 {
     size_t enclen;
@@ -512,6 +879,7 @@ static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
 
     assert(!(pkt->hdr.flags & RP_PKT_FLAGS_response));
 
+    atomic_inc(&s->sync.rx_count);
     if (use_icount) {
         clk = rp_normalized_vmclk(s);
         diff = pkt->sync.timestamp - clk;
@@ -520,7 +888,7 @@ static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
                                  pkt->sync.timestamp);
     assert(enclen == sizeof rsp.sync);
 
-    if (!use_icount || diff < s->sync.quantum) {
+    if (!use_icount || diff < atomic_read(&s->sync.quantum)) {
         /* We are still OK.  */
         rp_write(s, (void *) &rsp, enclen);
         return true;
@@ -530,6 +898,19 @@ static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
     return false;
 }
 
+static void rp_pt_cmd_checkpoint(RemotePort *s, struct rp_pkt *pkt)
+{
+    struct rp_pkt_checkpoint rsp;
+    size_t enclen;
+
+    /* Checkpoints are driven by QEMU, refuse requests from the peer.  */
+    enclen = rp_encode_checkpoint(pkt->hdr.id, pkt->hdr.dev, &rsp,
+                                  pkt->checkpoint.timestamp,
+                                  pkt->checkpoint.op, 1, 0,
+                                  pkt->hdr.flags | RP_PKT_FLAGS_response);
+    rp_write(s, (void *) &rsp, enclen);
+}
+
 static bool rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
 {
     struct rp_pkt *pkt = dpkt->pkt;
@@ -543,13 +924,17 @@ static bool rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
         return true;
     }
 
+    if (pkt->hdr.cmd != RP_CMD_sync) {
+        atomic_inc(&s->sync.activity);
+    }
+
     if (pkt->hdr.flags & RP_PKT_FLAGS_response) {
         uint32_t dev = pkt->hdr.dev;
         uint32_t id = pkt->hdr.id;
         int i;
 
         if (pkt->hdr.flags & RP_PKT_FLAGS_posted) {
-            printf("Drop response for posted packets\n");
+            D(qemu_log("%s: drop response for posted packet\n", s->prefix));
             return true;
         }
 
@@ -581,9 +966,18 @@ static bool rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
     }
 
     switch (pkt->hdr.cmd) {
+    case RP_CMD_nop:
+        if (s->shm.tx_active) {
+            /* The peer has moved its transmissions to the rings.  */
+            s->shm.rx_active = true;
+        }
+        break;
     case RP_CMD_hello:
         rp_cmd_hello(s, pkt);
         break;
+    case RP_CMD_checkpoint:
+        rp_pt_cmd_checkpoint(s, pkt);
+        break;
     case RP_CMD_sync:
         if (rp_pt_cmd_sync(s, pkt)) {
             return true;
@@ -592,6 +986,9 @@ static bool rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
     case RP_CMD_read:
     case RP_CMD_write:
     case RP_CMD_interrupt:
+        if (pkt->hdr.cmd != RP_CMD_sync && rp_pt_worker_handover(s, dpkt)) {
+            return true;
+        }
         rp_pt_handover_pkt(s, dpkt);
         break;
     default:
@@ -662,6 +1059,7 @@ static void *rp_protocol_thread(void *arg)
             rp_pkt_dump("rport-pkt", (void *) dpkt->pkt,
                         sizeof dpkt->pkt->hdr + dpkt->pkt->hdr.len);
         }
+        rp_stats_rx(s, dpkt->pkt);
         handled = rp_pt_process_pkt(s, dpkt);
         if (handled) {
             s->rx_queue.inuse[wpos] = false;
@@ -681,10 +1079,26 @@ static void rp_realize(DeviceState *dev, Error **errp)
 
     s->prefix = object_get_canonical_path(OBJECT(dev));
 
+    if (s->sync.adaptive) {
+        if (!s->sync.quantum_min) {
+            s->sync.quantum_min = s->peer.local_cfg.quantum;
+        }
+        if (!s->sync.quantum_max) {
+            s->sync.quantum_max = s->peer.local_cfg.quantum * 64;
+        }
+        if (!s->sync.quantum_min
+            || s->sync.quantum_min > s->sync.quantum_max) {
+            error_setg(errp, "%s: bad sync-quantum-min/max range", s->prefix);
+            return;
+        }
+    }
+
     s->peer.clk_base = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
 
     qemu_mutex_init(&s->write_mutex);
     qemu_mutex_init(&s->rsp_mutex);
+    s->posted.buf = g_malloc(RP_POSTED_BUF_SIZE);
+    s->posted.bh = qemu_bh_new(rp_posted_bh, s);
     qemu_cond_init(&s->progress_cond);
 
     if (!qemu_chr_fe_get_driver(&s->chr)) {
@@ -787,7 +1201,7 @@ static void rp_realize(DeviceState *dev, Error **errp)
         }
 
         qemu_set_nonblock(s->event.pipe.read);
-        qemu_set_fd_handler(s->event.pipe.read, rp_event_read, NULL, s);
+        rp_event_set_handler(s, true);
     }
 #else
     r = qemu_pipe(s->event.pipes);
@@ -797,7 +1211,7 @@ static void rp_realize(DeviceState *dev, Error **errp)
         exit(EXIT_FAILURE);
     }
     qemu_set_nonblock(s->event.pipe.read);
-    qemu_set_fd_handler(s->event.pipe.read, rp_event_read, NULL, s);
+    rp_event_set_handler(s, true);
 #endif
 
 
@@ -805,6 +1219,10 @@ static void rp_realize(DeviceState *dev, Error **errp)
        After config negotiation with the peer, sync.quantum value might
        change.  */
     s->sync.quantum = s->peer.local_cfg.quantum;
+    if (s->sync.adaptive) {
+        s->sync.quantum = MIN(MAX(s->sync.quantum, s->sync.quantum_min),
+                              s->sync.quantum_max);
+    }
 
     s->sync.ptimer = ptimer_init(sync_timer_hit, s, PTIMER_POLICY_DEFAULT);
     s->sync.ptimer_resp = ptimer_init(syncresp_timer_hit, s,
@@ -819,6 +1237,11 @@ static void rp_realize(DeviceState *dev, Error **errp)
     ptimer_set_freq(s->sync.ptimer_resp, 1000 * 1000 * 1000);
     ptimer_transaction_commit(s->sync.ptimer_resp);
 
+    if (s->shm.enable) {
+        /* Must be in place before we say hello.  */
+        rp_shm_setup(s);
+    }
+
     qemu_sem_init(&s->rx_queue.sem, ARRAY_SIZE(s->rx_queue.pkt) - 1);
     qemu_thread_create(&s->thread, "remote-port", rp_protocol_thread, s,
                        QEMU_THREAD_JOINABLE);
@@ -829,21 +1252,149 @@ static void rp_realize(DeviceState *dev, Error **errp)
 static void rp_unrealize(DeviceState *dev)
 {
     RemotePort *s = REMOTE_PORT(dev);
+    unsigned int i;
 
     s->finalizing = true;
 
     /* Unregister handler.  */
-    qemu_set_fd_handler(s->event.pipe.read, NULL, NULL, s);
+    rp_event_set_handler(s, false);
 
     info_report("%s: Wait for remote-port to disconnect\n", s->prefix);
+    rp_posted_bh(s);
+    qemu_bh_delete(s->posted.bh);
+    g_free(s->posted.buf);
+
+    rp_shm_close(&s->shm.rings);
     qemu_chr_fe_disconnect(&s->chr);
     qemu_thread_join(&s->thread);
+    rp_shm_destroy(&s->shm.rings);
+
+    for (i = 0; i < ARRAY_SIZE(s->dev_state); i++) {
+        if (s->dev_state[i].worker) {
+            rp_worker_free(s->dev_state[i].worker);
+            s->dev_state[i].worker = NULL;
+        }
+    }
 
     close(s->event.pipe.read);
     close(s->event.pipe.write);
     object_unparent(OBJECT(s->chrdev));
 }
 
+/*
+ * Run a checkpoint operation on the peer and wait for it to complete.
+ * A blob is sent along with restore requests. For save requests the
+ * returned blob is stored in s->checkpoint.
+ */
+static int rp_checkpoint_xfer(RemotePort *s, uint32_t op)
+{
+    struct rp_pkt_checkpoint pkt;
+    struct rp_pkt_checkpoint *c;
+    RemotePortDynPkt rsp;
+    struct iovec iov[2];
+    uint32_t len = 0;
+    int ret = 0;
+
+    if (op == RP_CHECKPOINT_restore) {
+        len = s->checkpoint.len;
+    }
+
+    iov[0].iov_base = &pkt;
+    iov[0].iov_len = rp_encode_checkpoint(rp_new_id(s), 0, &pkt,
+                                          rp_normalized_vmclk(s),
+                                          op, 0, len, 0);
+    iov[1].iov_base = s->checkpoint.blob;
+    iov[1].iov_len = len;
+
+    /*
+     * The VM is stopped so the only transactions in flight are queued
+     * posted writes. The checkpoint request is a barrier for those and
+     * the peer answers it only after everything sent before it.
+     */
+    rp_rsp_mutex_lock(s);
+    rp_writev(s, iov, ARRAY_SIZE(iov));
+    rsp = rp_wait_resp(s);
+    c = &rsp.pkt->checkpoint;
+    assert(c->hdr.id == be32_to_cpu(pkt.hdr.id));
+
+    if (c->hdr.cmd != RP_CMD_checkpoint || c->status) {
+        error_report("%s: peer failed to %s its state (status %u)",
+                     s->prefix, op == RP_CHECKPOINT_save ? "save" : "restore",
+                     c->status);
+        ret = -EIO;
+    } else if (op == RP_CHECKPOINT_save) {
+        if (c->hdr.len < sizeof *c - sizeof c->hdr + c->len) {
+            error_report("%s: truncated checkpoint from peer", s->prefix);
+            ret = -EIO;
+        } else {
+            g_free(s->checkpoint.blob);
+            s->checkpoint.blob = g_memdup(rp_checkpoint_dataptr(c), c->len);
+            s->checkpoint.len = c->len;
+        }
+    }
+    rp_dpkt_invalidate(&rsp);
+    rp_rsp_mutex_unlock(s);
+    return ret;
+}
+
+static void rp_checkpoint_free(RemotePort *s)
+{
+    g_free(s->checkpoint.blob);
+    s->checkpoint.blob = NULL;
+    s->checkpoint.len = 0;
+}
+
+static bool rp_checkpoint_needed(void *opaque)
+{
+    RemotePort *s = REMOTE_PORT(opaque);
+
+    return s->peer.caps.checkpoint;
+}
+
+static int rp_checkpoint_pre_save(void *opaque)
+{
+    RemotePort *s = REMOTE_PORT(opaque);
+
+    return rp_checkpoint_xfer(s, RP_CHECKPOINT_save);
+}
+
+static int rp_checkpoint_post_save(void *opaque)
+{
+    rp_checkpoint_free(REMOTE_PORT(opaque));
+    return 0;
+}
+
+static int rp_checkpoint_post_load(void *opaque, int version_id)
+{
+    RemotePort *s = REMOTE_PORT(opaque);
+    int ret;
+
+    if (!s->peer.caps.checkpoint) {
+        error_report("%s: peer can not restore a checkpoint", s->prefix);
+        ret = -EINVAL;
+    } else {
+        ret = rp_checkpoint_xfer(s, RP_CHECKPOINT_restore);
+    }
+    rp_checkpoint_free(s);
+    return ret;
+}
+
+static const VMStateDescription vmstate_rp_checkpoint = {
+    .name = TYPE_REMOTE_PORT "/checkpoint",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = rp_checkpoint_needed,
+    .pre_save = rp_checkpoint_pre_save,
+    .post_save = rp_checkpoint_post_save,
+    .post_load = rp_checkpoint_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(checkpoint.len, RemotePort),
+        VMSTATE_VBUFFER_ALLOC_UINT32(checkpoint.blob, RemotePort, 0, NULL,
+                                     checkpoint.len),
+        VMSTATE_END_OF_LIST(),
+    }
+};
+
 static const VMStateDescription vmstate_rp = {
     .name = TYPE_REMOTE_PORT,
     .version_id = 1,
@@ -851,6 +1402,10 @@ static const VMStateDescription vmstate_rp = {
     .minimum_version_id_old = 1,
     .fields = (VMStateField[]) {
         VMSTATE_END_OF_LIST(),
+    },
+    .subsections = (const VMStateDescription*[]) {
+        &vmstate_rp_checkpoint,
+        NULL
     }
 };
 
@@ -861,6 +1416,16 @@ static Property rp_properties[] = {
     DEFINE_PROP_BOOL("sync", RemotePort, do_sync, false),
     DEFINE_PROP_UINT64("sync-quantum", RemotePort, peer.local_cfg.quantum,
                        1000000),
+    DEFINE_PROP_BOOL("sync-adaptive", RemotePort, sync.adaptive, false),
+    DEFINE_PROP_UINT64("sync-quantum-min", RemotePort, sync.quantum_min, 0),
+    DEFINE_PROP_UINT64("sync-quantum-max", RemotePort, sync.quantum_max, 0),
+    DEFINE_PROP_BOOL("dev-workers", RemotePort, dev_workers, false),
+    DEFINE_PROP_LINK("iothread", RemotePort, iothread, TYPE_IOTHREAD,
+                     IOThread *),
+    DEFINE_PROP_BOOL("shm", RemotePort, shm.enable, false),
+    DEFINE_PROP_STRING("shm-path", RemotePort, shm.path),
+    DEFINE_PROP_UINT32("shm-ring-size", RemotePort, shm.ring_size,
+                       1 * MiB),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -870,6 +1435,13 @@ static void rp_init(Object *obj)
     int t;
     int i;
 
+    object_property_add_uint64_ptr(obj, "sync-quantum-current",
+                                   &s->sync.quantum, OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "sync-tx-count",
+                                   &s->sync.tx_count, OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "sync-rx-count",
+                                   &s->sync.rx_count, OBJ_PROP_FLAG_READ);
+
     for (i = 0; i < REMOTE_PORT_MAX_DEVS; ++i) {
         char *name = g_strdup_printf("remote-port-dev%d", i);
         object_property_add_link(obj, name, TYPE_REMOTE_PORT_DEVICE,
@@ -888,6 +1460,139 @@ static void rp_init(Object *obj)
     }
 }
 
+static RemotePortStats *rp_query_stats_one(RemotePort *s)
+{
+    RemotePortStats *info = g_new0(RemotePortStats, 1);
+    RemotePortCounters *st = &s->stats;
+    int i;
+
+    info->path = object_get_canonical_path(OBJECT(s));
+    info->sync_quantum = atomic_read(&s->sync.quantum);
+    info->sync_tx = s->sync.tx_count;
+    info->sync_rx = atomic_read(&s->sync.rx_count);
+    info->sync_stall_ns = stat64_get(&st->sync_stall_ns);
+    info->rsp_lock_wait_ns = stat64_get(&st->rsp_lock_wait_ns);
+
+    for (i = RP_STATS_RTT_BUCKETS - 1; i >= 0; i--) {
+        uint64List *entry = g_new0(uint64List, 1);
+
+        entry->value = stat64_get(&st->rtt[i]);
+        entry->next = info->rtt_histogram;
+        info->rtt_histogram = entry;
+    }
+
+    for (i = RP_CMD_max; i >= 0; i--) {
+        RemotePortCommandStatsList *entry;
+        RemotePortCommandStats *cs;
+
+        if (!stat64_get(&st->tx[i].packets)
+            && !stat64_get(&st->rx[i].packets)) {
+            continue;
+        }
+
+        cs = g_new0(RemotePortCommandStats, 1);
+        cs->cmd = g_strdup(rp_cmd_to_string(i));
+        cs->tx_packets = stat64_get(&st->tx[i].packets);
+        cs->tx_bytes = stat64_get(&st->tx[i].bytes);
+        cs->rx_packets = stat64_get(&st->rx[i].packets);
+        cs->rx_bytes = stat64_get(&st->rx[i].bytes);
+
+        entry = g_new0(RemotePortCommandStatsList, 1);
+        entry->value = cs;
+        entry->next = info->commands;
+        info->commands = entry;
+    }
+
+    for (i = ARRAY_SIZE(s->devs) - 1; i >= 0; i--) {
+        RemotePortDeviceStatsList *entry;
+        RemotePortDeviceStats *ds;
+
+        if (!s->devs[i]) {
+            continue;
+        }
+
+        ds = g_new0(RemotePortDeviceStats, 1);
+        ds->dev = i;
+        ds->path = object_get_canonical_path(OBJECT(s->devs[i]));
+        ds->tx_packets = stat64_get(&s->dev_state[i].tx_stats.packets);
+        ds->tx_bytes = stat64_get(&s->dev_state[i].tx_stats.bytes);
+        ds->rx_packets = stat64_get(&s->dev_state[i].rx_stats.packets);
+        ds->rx_bytes = stat64_get(&s->dev_state[i].rx_stats.bytes);
+
+        entry = g_new0(RemotePortDeviceStatsList, 1);
+        entry->value = ds;
+        entry->next = info->devices;
+        info->devices = entry;
+    }
+    return info;
+}
+
+static int rp_query_stats_foreach(Object *obj, void *opaque)
+{
+    RemotePortStatsList **list = opaque;
+    RemotePortStatsList *entry;
+
+    if (object_dynamic_cast(obj, TYPE_REMOTE_PORT) && DEVICE(obj)->realized) {
+        entry = g_new0(RemotePortStatsList, 1);
+        entry->value = rp_query_stats_one(REMOTE_PORT(obj));
+        entry->next = *list;
+        *list = entry;
+    }
+    return 0;
+}
+
+RemotePortStatsList *qmp_query_remote_port_stats(Error **errp)
+{
+    RemotePortStatsList *list = NULL;
+
+    object_child_foreach_recursive(object_get_root(),
+                                   rp_query_stats_foreach, &list);
+    return list;
+}
+
+static const StatsDescriptor rp_stats[] = {
+    { "sync-quantum", STATS_TYPE_INSTANT, true, STATS_UNIT_NANOSECONDS },
+    { "sync-tx", STATS_TYPE_CUMULATIVE },
+    { "sync-rx", STATS_TYPE_CUMULATIVE },
+    { "sync-stall", STATS_TYPE_CUMULATIVE, true, STATS_UNIT_NANOSECONDS },
+    { "rsp-lock-wait", STATS_TYPE_CUMULATIVE, true, STATS_UNIT_NANOSECONDS },
+    { "tx-packets", STATS_TYPE_CUMULATIVE },
+    { "rx-packets", STATS_TYPE_CUMULATIVE },
+};
+
+static int rp_stats_foreach(Object *obj, void *opaque)
+{
+    StatsCollector *c = opaque;
+    RemotePort *s;
+    g_autofree char *path = NULL;
+    uint64_t values[ARRAY_SIZE(rp_stats)];
+    int i;
+
+    if (!object_dynamic_cast(obj, TYPE_REMOTE_PORT) || !DEVICE(obj)->realized) {
+        return 0;
+    }
+    s = REMOTE_PORT(obj);
+    path = object_get_canonical_path(obj);
+
+    values[0] = atomic_read(&s->sync.quantum);
+    values[1] = s->sync.tx_count;
+    values[2] = atomic_read(&s->sync.rx_count);
+    values[3] = stat64_get(&s->stats.sync_stall_ns);
+    values[4] = stat64_get(&s->stats.rsp_lock_wait_ns);
+    values[5] = values[6] = 0;
+    for (i = 0; i <= RP_CMD_max; i++) {
+        values[5] += stat64_get(&s->stats.tx[i].packets);
+        values[6] += stat64_get(&s->stats.rx[i].packets);
+    }
+    stats_collect(c, path, values);
+    return 0;
+}
+
+static void rp_stats_retrieve(StatsCollector *c)
+{
+    object_child_foreach_recursive(object_get_root(), rp_stats_foreach, c);
+}
+
 struct rp_peer_state *rp_get_peer(RemotePort *s)
 {
     return &s->peer;
@@ -924,6 +1629,8 @@ static void rp_register_types(void)
 {
     type_register_static(&rp_info);
     type_register_static(&rp_device_info);
+    stats_register(STATS_PROVIDER_REMOTE_PORT, STATS_TARGET_DEVICE,
+                   rp_stats, ARRAY_SIZE(rp_stats), rp_stats_retrieve);
 }
 
 type_init(rp_register_types)
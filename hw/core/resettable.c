@@ -13,6 +13,7 @@
 #include "qemu/osdep.h"
 #include "qemu/module.h"
 #include "hw/resettable.h"
+#include "hw/boot-profile.h"
 #include "trace.h"
 
 /**
@@ -176,6 +177,7 @@ static void resettable_phase_hold(Object *obj, void *opaque, ResetType type)
     if (s->hold_phase_pending) {
         s->hold_phase_pending = false;
         ResettableTrFunction tr_func = resettable_get_tr_func(rc, obj);
+        int64_t start = boot_profile_start();
         trace_resettable_phase_hold_exec(obj, obj_typename, !!rc->phases.hold);
         if (tr_func) {
             trace_resettable_transitional_function(obj, obj_typename);
@@ -183,6 +185,7 @@ static void resettable_phase_hold(Object *obj, void *opaque, ResetType type)
         } else if (rc->phases.hold) {
             rc->phases.hold(obj);
         }
+        boot_profile_span_object("reset", obj, start);
     }
     trace_resettable_phase_hold_end(obj, obj_typename, s->count);
 }
@@ -10,6 +10,29 @@ stream_push(StreamSlave *sink, uint8_t *buf, size_t len, bool eop)
     return k->push(sink, buf, len, eop);
 }
 
+size_t
+stream_pushv(StreamSlave *sink, const struct iovec *iov, int iovcnt, bool eop)
+{
+    StreamSlaveClass *k =  STREAM_SLAVE_GET_CLASS(sink);
+    size_t total = 0;
+    int i;
+
+    if (k->pushv) {
+        return k->pushv(sink, iov, iovcnt, eop);
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        size_t ret = k->push(sink, iov[i].iov_base, iov[i].iov_len,
+                             eop && i == iovcnt - 1);
+
+        total += ret;
+        if (ret < iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
 bool
 stream_can_push(StreamSlave *sink, StreamCanPushNotifyFn notify,
                 void *notify_opaque)
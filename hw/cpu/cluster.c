@@ -22,6 +22,7 @@
 #include "hw/cpu/cluster.h"
 #include "hw/qdev-properties.h"
 #include "hw/core/cpu.h"
+#include "hw/core/cpu-exec-gpio.h"
 #include "qapi/error.h"
 #include "qemu/module.h"
 #include "qemu/cutils.h"
@@ -42,12 +43,30 @@ static int add_cpu_to_cluster(Object *obj, void *opaque)
     CPUState *cpu = (CPUState *)object_dynamic_cast(obj, TYPE_CPU);
 
     if (cpu) {
-        cpu->cluster_index = cbdata->cluster->cluster_id;
-        cbdata->cpu_count++;
+        CPUClusterState *cluster = cbdata->cluster;
+
+        cpu->cluster_index = cluster->cluster_id;
+        cluster->cpus = g_renew(CPUState *, cluster->cpus,
+                                cbdata->cpu_count + 1);
+        cluster->cpus[cbdata->cpu_count++] = cpu;
     }
     return 0;
 }
 
+static void cpu_cluster_reset_gpio(void *opaque, int irq, int level)
+{
+    CPUClusterState *cluster = CPU_CLUSTER(opaque);
+
+    cpu_reset_gpio_cpus(cluster->cpus, cluster->num_cpus, level);
+}
+
+static void cpu_cluster_halt_gpio(void *opaque, int irq, int level)
+{
+    CPUClusterState *cluster = CPU_CLUSTER(opaque);
+
+    cpu_halt_gpio_cpus(cluster->cpus, cluster->num_cpus, level);
+}
+
 static void cpu_cluster_realize(DeviceState *dev, Error **errp)
 {
     /* Iterate through all our CPU children and set their cluster_index */
@@ -72,6 +91,23 @@ static void cpu_cluster_realize(DeviceState *dev, Error **errp)
      * realizing the cluster object.
      */
     assert(cbdata.cpu_count > 0);
+    cluster->num_cpus = cbdata.cpu_count;
+}
+
+static void cpu_cluster_init(Object *obj)
+{
+    DeviceState *dev = DEVICE(obj);
+
+    /* Like the per-CPU lines, but acting on every CPU of the cluster */
+    qdev_init_gpio_in_named(dev, cpu_cluster_reset_gpio, "reset", 1);
+    qdev_init_gpio_in_named(dev, cpu_cluster_halt_gpio, "halt", 1);
+}
+
+static void cpu_cluster_finalize(Object *obj)
+{
+    CPUClusterState *cluster = CPU_CLUSTER(obj);
+
+    g_free(cluster->cpus);
 }
 
 static void cpu_cluster_class_init(ObjectClass *klass, void *data)
@@ -89,6 +125,8 @@ static const TypeInfo cpu_cluster_type_info = {
     .name = TYPE_CPU_CLUSTER,
     .parent = TYPE_DEVICE,
     .instance_size = sizeof(CPUClusterState),
+    .instance_init = cpu_cluster_init,
+    .instance_finalize = cpu_cluster_finalize,
     .class_init = cpu_cluster_class_init,
 };
 
@@ -332,6 +332,11 @@ static inline void xlnx_dp_audio_activate(XlnxDPState *s)
                                       &s->audio_buffer_1);
 }
 
+static inline int16_t xlnx_dp_audio_saturate(int32_t v)
+{
+    return MAX(-32767, MIN(v, 32767));
+}
+
 static inline void xlnx_dp_audio_mix_buffer(XlnxDPState *s)
 {
     /*
@@ -340,34 +345,48 @@ static inline void xlnx_dp_audio_mix_buffer(XlnxDPState *s)
      * | R3 | L3 | R2 | L2 | R1 | L1 | R0 | L0 |
      *
      * Output audio is 16bits saturated.
+     *
+     * A sample scaled by a 16bit volume still fits in 32bits, so the
+     * loops below stay in int32 and without branches, which lets the
+     * compiler vectorize them.
      */
-    int i;
-
-    if ((s->audio_data_available[0]) && (xlnx_dp_audio_get_volume(s, 0))) {
-        for (i = 0; i < s->audio_data_available[0] / 2; i++) {
-            s->temp_buffer[i] = (int64_t)(s->audio_buffer_0[i])
-                              * xlnx_dp_audio_get_volume(s, 0) / 8192;
-        }
+    int32_t vol0 = xlnx_dp_audio_get_volume(s, 0);
+    int32_t vol1 = xlnx_dp_audio_get_volume(s, 1);
+    bool use0 = s->audio_data_available[0] && vol0;
+    bool use1 = s->audio_data_available[1] && vol1
+                && (!s->audio_data_available[0]
+                    || s->audio_data_available[1]
+                       == s->audio_data_available[0]);
+    const int16_t *in0 = s->audio_buffer_0;
+    const int16_t *in1 = s->audio_buffer_1;
+    int16_t *out = s->out_buffer;
+    int i, n;
+
+    if (use0 && use1) {
         s->byte_left = s->audio_data_available[0];
-    } else {
-        memset(s->temp_buffer, 0, s->audio_data_available[1] / 2);
-    }
-
-    if ((s->audio_data_available[1]) && (xlnx_dp_audio_get_volume(s, 1))) {
-        if ((s->audio_data_available[0] == 0)
-        || (s->audio_data_available[1] == s->audio_data_available[0])) {
-            for (i = 0; i < s->audio_data_available[1] / 2; i++) {
-                s->temp_buffer[i] += (int64_t)(s->audio_buffer_1[i])
-                                   * xlnx_dp_audio_get_volume(s, 1) / 8192;
+        n = s->byte_left / 2;
+        for (i = 0; i < n; i++) {
+            out[i] = xlnx_dp_audio_saturate(in0[i] * vol0 / 8192
+                                            + in1[i] * vol1 / 8192);
+        }
+    } else if (use0 || use1) {
+        const int16_t *in = use0 ? in0 : in1;
+        int32_t vol = use0 ? vol0 : vol1;
+
+        s->byte_left = s->audio_data_available[use0 ? 0 : 1];
+        n = s->byte_left / 2;
+        if (vol == 8192) {
+            /* Unity gain, only the saturation is left to do.  */
+            for (i = 0; i < n; i++) {
+                out[i] = MAX(in[i], -32767);
+            }
+        } else {
+            for (i = 0; i < n; i++) {
+                out[i] = xlnx_dp_audio_saturate(in[i] * vol / 8192);
             }
-            s->byte_left = s->audio_data_available[1];
         }
     }
 
-    for (i = 0; i < s->byte_left / 2; i++) {
-        s->out_buffer[i] = MAX(-32767, MIN(s->temp_buffer[i], 32767));
-    }
-
     s->data_ptr = 0;
 }
 
@@ -560,7 +579,16 @@ static inline bool xlnx_dp_global_alpha_enabled(XlnxDPState *s)
            ((s->vblend_registers[V_BLEND_SET_GLOBAL_ALPHA_REG] & 0x01) != 0));
 }
 
-static void xlnx_dp_recreate_surface(XlnxDPState *s)
+static void xlnx_dp_drop_direct_scanout(XlnxDPState *s)
+{
+    if (s->g_direct.mr) {
+        memory_region_set_log(s->g_direct.mr, false, DIRTY_MEMORY_VGA);
+        memory_region_unref(s->g_direct.mr);
+        s->g_direct.mr = NULL;
+    }
+}
+
+static void xlnx_dp_do_recreate_surface(XlnxDPState *s, bool direct)
 {
     /*
      * Two possibilities, if blending is enabled the console displays
@@ -571,6 +599,10 @@ static void xlnx_dp_recreate_surface(XlnxDPState *s)
     DisplaySurface *current_console_surface = qemu_console_surface(s->console);
 
     if ((width != 0) && (height != 0)) {
+        if (!direct) {
+            xlnx_dp_drop_direct_scanout(s);
+        }
+
         /*
          * As dpy_gfx_replace_surface calls qemu_free_displaysurface on the
          * surface we need to be careful and don't free the surface associated
@@ -586,9 +618,19 @@ static void xlnx_dp_recreate_surface(XlnxDPState *s)
             qemu_free_displaysurface(s->g_plane.surface);
         }
 
-        s->g_plane.surface
+        if (s->g_direct.mr) {
+            uint8_t *fb = memory_region_get_ram_ptr(s->g_direct.mr)
+                          + s->g_direct.offset_within_region;
+
+            s->g_plane.surface
+                = qemu_create_displaysurface_from(width, height,
+                                                  s->g_plane.format,
+                                                  s->g_direct_stride, fb);
+        } else {
+            s->g_plane.surface
                 = qemu_create_displaysurface_from(width, height,
                                                   s->g_plane.format, 0, NULL);
+        }
         s->v_plane.surface
                 = qemu_create_displaysurface_from(width, height,
                                                   s->v_plane.format, 0, NULL);
@@ -605,12 +647,99 @@ static void xlnx_dp_recreate_surface(XlnxDPState *s)
         }
 
         xlnx_dpdma_set_host_data_location(s->dpdma, DP_GRAPHIC_DMA_CHANNEL,
-                                            surface_data(s->g_plane.surface));
+                                          s->g_direct.mr ? NULL :
+                                          surface_data(s->g_plane.surface));
         xlnx_dpdma_set_host_data_location(s->dpdma, DP_VIDEO_DMA_CHANNEL,
                                             surface_data(s->v_plane.surface));
     }
 }
 
+static void xlnx_dp_recreate_surface(XlnxDPState *s)
+{
+    xlnx_dp_do_recreate_surface(s, false);
+}
+
+/*
+ * If the graphic frame is a single contiguous buffer in guest RAM, display it
+ * in place instead of having the DPDMA copy it on every refresh.  Only
+ * possible when the graphic plane is displayed without blending.
+ */
+static bool xlnx_dp_try_direct_scanout(XlnxDPState *s, XlnxDPDMAFrame *frame)
+{
+    DisplaySurface *surface = s->g_plane.surface;
+    MemoryRegionSection section;
+    uint32_t line_size;
+    uint64_t size;
+    int height;
+
+    if (!surface || surface != qemu_console_surface(s->console)
+        || xlnx_dp_global_alpha_enabled(s) || !frame->valid) {
+        return false;
+    }
+
+    height = surface_height(surface);
+    line_size = surface_width(surface) * surface_bytes_per_pixel(surface);
+    if ((frame->line_size < line_size)
+        || (frame->line_stride < frame->line_size)
+        || ((frame->addr | frame->line_stride) & 0x3)
+        || (frame->size / frame->line_size < height)) {
+        return false;
+    }
+
+    size = (uint64_t)frame->line_stride * (height - 1) + line_size;
+    section = memory_region_find(s->dpdma->dma_as->root, frame->addr, size);
+    if (!section.mr) {
+        return false;
+    }
+    if (!memory_region_is_ram(section.mr)
+        || int128_get64(section.size) < size) {
+        memory_region_unref(section.mr);
+        return false;
+    }
+
+    memory_region_set_log(section.mr, true, DIRTY_MEMORY_VGA);
+    s->g_direct = section;
+    s->g_direct_addr = frame->addr;
+    s->g_direct_stride = frame->line_stride;
+    xlnx_dp_do_recreate_surface(s, true);
+    return true;
+}
+
+/*
+ * Refresh only the lines of the framebuffer the guest wrote to.
+ */
+static void xlnx_dp_update_direct_scanout(XlnxDPState *s)
+{
+    DisplaySurface *surface = s->g_plane.surface;
+    MemoryRegion *mr = s->g_direct.mr;
+    hwaddr addr = s->g_direct.offset_within_region;
+    int width = surface_width(surface);
+    int height = surface_height(surface);
+    uint32_t line_size = width * surface_bytes_per_pixel(surface);
+    DirtyBitmapSnapshot *snap;
+    int first = -1;
+    int y;
+
+    snap = memory_region_snapshot_and_clear_dirty(mr, addr,
+                           (uint64_t)s->g_direct_stride * (height - 1)
+                           + line_size, DIRTY_MEMORY_VGA);
+    for (y = 0; y < height; y++) {
+        if (memory_region_snapshot_get_dirty(mr, snap, addr, line_size)) {
+            if (first < 0) {
+                first = y;
+            }
+        } else if (first >= 0) {
+            dpy_gfx_update(s->console, 0, first, width, y - first);
+            first = -1;
+        }
+        addr += s->g_direct_stride;
+    }
+    if (first >= 0) {
+        dpy_gfx_update(s->console, 0, first, width, height - first);
+    }
+    g_free(snap);
+}
+
 /*
  * Change the graphic format of the surface.
  */
@@ -1132,50 +1261,84 @@ static const MemoryRegionOps avbufm_ops = {
     },
 };
 
+/*
+ * The global alpha replaces the per-pixel alpha of the graphic plane.
+ */
+static pixman_format_code_t xlnx_dp_opaque_format(pixman_format_code_t format)
+{
+    switch (format) {
+    case PIXMAN_r8g8b8a8:
+        return PIXMAN_r8g8b8x8;
+    case PIXMAN_a8b8g8r8:
+        return PIXMAN_x8b8g8r8;
+    default:
+        return format;
+    }
+}
+
 /*
  * This is a global alpha blending using pixman.
- * Both graphic and video planes are multiplied with the global alpha
- * coefficient and added.
+ * The video plane is copied to the output and the graphic plane is composed
+ * over it with the global alpha as a solid mask, which keeps both passes on
+ * pixman's fast paths rather than a per-pixel convolution.
  */
-static inline void xlnx_dp_blend_surface(XlnxDPState *s)
+static inline void xlnx_dp_blend_surface(XlnxDPState *s, int y, int h)
 {
-    pixman_fixed_t alpha1[] = { pixman_double_to_fixed(1),
-                                pixman_double_to_fixed(1),
-                                pixman_double_to_fixed(1.0) };
-    pixman_fixed_t alpha2[] = { pixman_double_to_fixed(1),
-                                pixman_double_to_fixed(1),
-                                pixman_double_to_fixed(1.0) };
-
-    if ((surface_width(s->g_plane.surface)
-         != surface_width(s->v_plane.surface)) ||
-        (surface_height(s->g_plane.surface)
-         != surface_height(s->v_plane.surface))) {
+    DisplaySurface *g = s->g_plane.surface;
+    int width = surface_width(g);
+    int height = surface_height(g);
+    pixman_color_t alpha = {
+        .alpha = xlnx_dp_global_alpha_value(s) * 0x101,
+    };
+    pixman_image_t *mask;
+    pixman_image_t *src;
+
+    if ((width != surface_width(s->v_plane.surface)) ||
+        (height != surface_height(s->v_plane.surface))) {
         return;
     }
 
-    alpha1[2] = pixman_double_to_fixed((double)(xlnx_dp_global_alpha_value(s))
-                                       / 256.0);
-    alpha2[2] = pixman_double_to_fixed((255.0
-                                    - (double)xlnx_dp_global_alpha_value(s))
-                                       / 256.0);
-
-    pixman_image_set_filter(s->g_plane.surface->image,
-                            PIXMAN_FILTER_CONVOLUTION, alpha1, 3);
-    pixman_image_composite(PIXMAN_OP_SRC, s->g_plane.surface->image, 0,
-                           s->bout_plane.surface->image, 0, 0, 0, 0, 0, 0,
-                           surface_width(s->g_plane.surface),
-                           surface_height(s->g_plane.surface));
-    pixman_image_set_filter(s->v_plane.surface->image,
-                            PIXMAN_FILTER_CONVOLUTION, alpha2, 3);
-    pixman_image_composite(PIXMAN_OP_ADD, s->v_plane.surface->image, 0,
-                           s->bout_plane.surface->image, 0, 0, 0, 0, 0, 0,
-                           surface_width(s->g_plane.surface),
-                           surface_height(s->g_plane.surface));
+    mask = pixman_image_create_solid_fill(&alpha);
+    src = pixman_image_create_bits(xlnx_dp_opaque_format(s->g_plane.format),
+                                   width, height,
+                                   (uint32_t *)surface_data(g),
+                                   surface_stride(g));
+
+    pixman_image_composite(PIXMAN_OP_SRC, s->v_plane.surface->image, NULL,
+                           s->bout_plane.surface->image, 0, y, 0, 0, 0, y,
+                           width, h);
+    pixman_image_composite(PIXMAN_OP_OVER, src, mask,
+                           s->bout_plane.surface->image, 0, y, 0, 0, 0, y,
+                           width, h);
+
+    pixman_image_unref(src);
+    pixman_image_unref(mask);
+}
+
+/*
+ * Get the rows of the surface that the DPDMA copied again on @channel during
+ * this refresh.  All rows are reported if this is not known.
+ */
+static void xlnx_dp_dirty_rows(XlnxDPState *s, uint8_t channel, int height,
+                               int *y, int *h)
+{
+    uint32_t first, num;
+
+    if (!xlnx_dpdma_get_dirty_lines(s->dpdma, channel, &first, &num)) {
+        *y = 0;
+        *h = height;
+        return;
+    }
+    *y = MIN(first, height);
+    *h = MIN(num, height - *y);
 }
 
 static void xlnx_dp_update_display(void *opaque)
 {
     XlnxDPState *s = XLNX_DP(opaque);
+    XlnxDPDMAFrame frame;
+    size_t len;
+    int gy, gh, vy, vh, y, h;
 
     if ((s->core_registers[DP_TRANSMITTER_ENABLE] & 0x01) == 0) {
         return;
@@ -1186,7 +1349,35 @@ static void xlnx_dp_update_display(void *opaque)
     /*
      * Trigger the DMA channel.
      */
-    if (!xlnx_dpdma_start_operation(s->dpdma, 3, false)) {
+    len = xlnx_dpdma_start_operation(s->dpdma, DP_GRAPHIC_DMA_CHANNEL, false);
+    xlnx_dpdma_get_frame(s->dpdma, DP_GRAPHIC_DMA_CHANNEL, &frame);
+
+    if (s->g_direct.mr) {
+        if (frame.valid && (frame.addr == s->g_direct_addr)
+            && (frame.line_stride == s->g_direct_stride)) {
+            xlnx_dp_update_direct_scanout(s);
+            return;
+        }
+
+        /*
+         * The guest flipped to another buffer or split its frame: go back to
+         * a copied surface and fetch this frame into it.  A fragmented frame
+         * wasn't fetched at all so it is dropped.
+         */
+        xlnx_dp_recreate_surface(s);
+        if (s->g_direct.mr) {
+            return;
+        }
+        if (!xlnx_dp_try_direct_scanout(s, &frame)
+            && !xlnx_dpdma_copy_frame(s->dpdma, DP_GRAPHIC_DMA_CHANNEL,
+                                      surface_data(s->g_plane.surface))) {
+            return;
+        }
+        dpy_gfx_update_full(s->console);
+        return;
+    }
+
+    if (!len) {
         /*
          * An error occurred don't do anything with the data..
          * Trigger an underflow interrupt.
@@ -1197,18 +1388,52 @@ static void xlnx_dp_update_display(void *opaque)
     }
 
     if (xlnx_dp_global_alpha_enabled(s)) {
+        uint8_t alpha = xlnx_dp_global_alpha_value(s);
+        int height = surface_height(s->g_plane.surface);
+
         if (!xlnx_dpdma_start_operation(s->dpdma, 0, false)) {
             s->core_registers[DP_INT_STATUS] |= (1 << 21);
             xlnx_dp_update_irq(s);
             return;
         }
-        xlnx_dp_blend_surface(s);
+
+        /*
+         * Only blend again the rows where either plane changed, unless the
+         * alpha changed too.
+         */
+        xlnx_dp_dirty_rows(s, DP_GRAPHIC_DMA_CHANNEL, height, &gy, &gh);
+        xlnx_dp_dirty_rows(s, DP_VIDEO_DMA_CHANNEL, height, &vy, &vh);
+        if (alpha != s->blend_alpha) {
+            s->blend_alpha = alpha;
+            y = 0;
+            h = height;
+        } else if (!gh || !vh) {
+            y = gh ? gy : vy;
+            h = gh ? gh : vh;
+        } else {
+            y = MIN(gy, vy);
+            h = MAX(gy + gh, vy + vh) - y;
+        }
+        if (h) {
+            xlnx_dp_blend_surface(s, y, h);
+            dpy_gfx_update(s->console, 0, y,
+                           surface_width(s->g_plane.surface), h);
+        }
+        return;
     }
 
-    /*
-     * XXX: We might want to update only what changed.
-     */
-    dpy_gfx_update_full(s->console);
+    if (xlnx_dp_try_direct_scanout(s, &frame)) {
+        dpy_gfx_update_full(s->console);
+        return;
+    }
+
+    /* Only the rows copied again have changed. */
+    xlnx_dp_dirty_rows(s, DP_GRAPHIC_DMA_CHANNEL,
+                       surface_height(s->g_plane.surface), &gy, &gh);
+    if (gh) {
+        dpy_gfx_update(s->console, 0, gy,
+                       surface_width(s->g_plane.surface), gh);
+    }
 }
 
 static const GraphicHwOps xlnx_dp_gfx_ops = {
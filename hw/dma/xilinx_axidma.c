@@ -32,6 +32,7 @@
 #include "hw/qdev-properties.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
+#include "qemu/rcu.h"
 
 #include "sysemu/dma.h"
 #include "hw/stream.h"
@@ -103,6 +104,9 @@ enum {
     SDESC_STATUS_COMPLETE = (1 << 31)
 };
 
+/* Max number of buffers handed to the data stream in one go.  */
+#define MEM2S_MAX_IOV 32
+
 struct Stream {
     struct XilinxAXIDMA *dma;
     ptimer_state *ptimer;
@@ -265,9 +269,56 @@ static void stream_complete(struct Stream *s)
     ptimer_transaction_commit(s->ptimer);
 }
 
+/*
+ * Map len bytes of guest memory for reading if they are plain RAM,
+ * returns NULL otherwise.
+ */
+static void *stream_map_ram(struct Stream *s, uint64_t addr, hwaddr len)
+{
+    MemoryRegion *mr;
+    hwaddr xlat, l = len;
+    void *p;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        mr = address_space_translate(&s->dma->as, addr, &xlat, &l, false,
+                                     MEMTXATTRS_UNSPECIFIED);
+        if (l < len || !memory_access_is_direct(mr, false)) {
+            return NULL;
+        }
+    }
+
+    p = address_space_map(&s->dma->as, addr, &l, false,
+                          MEMTXATTRS_UNSPECIFIED);
+    if (p && l < len) {
+        address_space_unmap(&s->dma->as, p, l, false, 0);
+        p = NULL;
+    }
+    return p;
+}
+
+/* Push and unmap the packet data gathered so far.  */
+static void stream_flush_iov(struct Stream *s, StreamSlave *tx_data_dev,
+                             struct iovec *iov, int *niov, bool eop)
+{
+    int i;
+
+    if (!*niov) {
+        return;
+    }
+
+    stream_pushv(tx_data_dev, iov, *niov, eop);
+    for (i = 0; i < *niov; i++) {
+        address_space_unmap(&s->dma->as, iov[i].iov_base, iov[i].iov_len,
+                            false, 0);
+    }
+    *niov = 0;
+}
+
 static void stream_process_mem2s(struct Stream *s, StreamSlave *tx_data_dev,
                                  StreamSlave *tx_control_dev)
 {
+    struct iovec iov[MEM2S_MAX_IOV];
+    int niov = 0;
     uint32_t prev_d;
     uint32_t txlen;
     uint64_t addr;
@@ -286,6 +337,7 @@ static void stream_process_mem2s(struct Stream *s, StreamSlave *tx_data_dev,
         }
 
         if (stream_desc_sof(&s->desc)) {
+            stream_flush_iov(s, tx_data_dev, iov, &niov, false);
             stream_push(tx_control_dev, s->desc.app, sizeof(s->desc.app), true);
         }
 
@@ -293,6 +345,27 @@ static void stream_process_mem2s(struct Stream *s, StreamSlave *tx_data_dev,
 
         eop = stream_desc_eof(&s->desc);
         addr = s->desc.buffer_address;
+
+        /*
+         * Buffers in RAM are collected across descriptors and handed over
+         * as one scatter list, ideally holding the whole packet.
+         */
+        if (txlen) {
+            void *p;
+
+            if (niov == MEM2S_MAX_IOV) {
+                stream_flush_iov(s, tx_data_dev, iov, &niov, false);
+            }
+            p = stream_map_ram(s, addr, txlen);
+            if (p) {
+                iov[niov].iov_base = p;
+                iov[niov++].iov_len = txlen;
+                txlen = 0;
+            } else {
+                stream_flush_iov(s, tx_data_dev, iov, &niov, false);
+            }
+        }
+
         while (txlen) {
             unsigned int len;
 
@@ -306,6 +379,7 @@ static void stream_process_mem2s(struct Stream *s, StreamSlave *tx_data_dev,
         }
 
         if (eop) {
+            stream_flush_iov(s, tx_data_dev, iov, &niov, true);
             stream_complete(s);
         }
 
@@ -321,6 +395,9 @@ static void stream_process_mem2s(struct Stream *s, StreamSlave *tx_data_dev,
             break;
         }
     }
+
+    /* The rest of the packet follows once the guest queues it.  */
+    stream_flush_iov(s, tx_data_dev, iov, &niov, false);
 }
 
 static size_t stream_process_s2mem(struct Stream *s, unsigned char *buf,
@@ -34,6 +34,8 @@
 #include "qemu/bitops.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
+#include "qemu/timer.h"
+#include "qemu/rcu.h"
 #include "qapi/error.h"
 
 #ifndef XLNX_ZDMA_ERR_DEBUG
@@ -206,6 +208,14 @@ enum {
     AXI_BURST_INCR  = 1,
 };
 
+enum {
+    DSCR_CACHE_SRC = 0,
+    DSCR_CACHE_DST = 1,
+};
+
+/* Bytes moved per timer tick when a bandwidth is modelled.  */
+#define ZDMA_BURST_SIZE (64 * 1024)
+
 static void zdma_ch_imr_update_irq(XlnxZDMA *s)
 {
     bool pending;
@@ -307,9 +317,54 @@ static void zdma_load_descriptor_reg(XlnxZDMA *s, unsigned int reg,
     descr->attr = s->regs[reg + 3];
 }
 
-static bool zdma_load_descriptor(XlnxZDMA *s, uint64_t addr,
-                                 XlnxZDMADescr *descr)
+static bool zdma_is_ram(XlnxZDMA *s, uint64_t addr, hwaddr len, bool is_write)
+{
+    MemoryRegion *mr;
+    hwaddr xlat, l = len;
+
+    RCU_READ_LOCK_GUARD();
+    mr = address_space_translate(s->dma_as, addr, &xlat, &l, is_write, s->attr);
+    return l == len && memory_access_is_direct(mr, is_write);
+}
+
+/*
+ * Read descriptor data through a small cache. Consecutive descriptors are
+ * fetched in one go when they live in RAM. The cache is dropped every time
+ * the channel starts running, the guest may rewrite descriptors while the
+ * channel is idle.
+ */
+static void zdma_dscr_read(XlnxZDMA *s, unsigned int cache_idx,
+                           uint64_t addr, void *buf, uint32_t len)
+{
+    XlnxZDMADescrCache *c = &s->dscr_cache[cache_idx];
+    uint32_t fill;
+
+    if (addr < c->addr || addr + len > c->addr + c->len) {
+        /* Don't stray into the next 4K, it may not be RAM.  */
+        fill = MIN(ZDMA_DSCR_CACHE_SIZE, 0x1000 - (addr & 0xfff));
+        if (fill < len || !zdma_is_ram(s, addr, fill, false)) {
+            c->len = 0;
+            address_space_read(s->dma_as, addr, s->attr, buf, len);
+            return;
+        }
+        address_space_read(s->dma_as, addr, s->attr, c->data, fill);
+        c->addr = addr;
+        c->len = fill;
+    }
+    memcpy(buf, c->data + (addr - c->addr), len);
+}
+
+static void zdma_dscr_cache_flush(XlnxZDMA *s)
+{
+    s->dscr_cache[DSCR_CACHE_SRC].len = 0;
+    s->dscr_cache[DSCR_CACHE_DST].len = 0;
+}
+
+static bool zdma_load_descriptor(XlnxZDMA *s, unsigned int cache_idx,
+                                 uint64_t addr, XlnxZDMADescr *descr)
 {
+    XlnxZDMADescr raw;
+
     /* ZDMA descriptors must be aligned to their own size.  */
     if (addr % sizeof(XlnxZDMADescr)) {
         qemu_log_mask(LOG_GUEST_ERROR,
@@ -320,9 +375,10 @@ static bool zdma_load_descriptor(XlnxZDMA *s, uint64_t addr,
         return false;
     }
 
-    descr->addr = address_space_ldq_le(s->dma_as, addr, s->attr, NULL);
-    descr->size = address_space_ldl_le(s->dma_as, addr + 8, s->attr, NULL);
-    descr->attr = address_space_ldl_le(s->dma_as, addr + 12, s->attr, NULL);
+    zdma_dscr_read(s, cache_idx, addr, &raw, sizeof raw);
+    descr->addr = le64_to_cpu(raw.addr);
+    descr->size = le32_to_cpu(raw.size);
+    descr->attr = le32_to_cpu(raw.attr);
     return true;
 }
 
@@ -338,7 +394,7 @@ static void zdma_load_src_descriptor(XlnxZDMA *s)
 
     src_addr = zdma_get_regaddr64(s, R_ZDMA_CH_SRC_CUR_DSCR_LSB);
 
-    if (!zdma_load_descriptor(s, src_addr, &s->dsc_src)) {
+    if (!zdma_load_descriptor(s, DSCR_CACHE_SRC, src_addr, &s->dsc_src)) {
         ARRAY_FIELD_DP32(s->regs, ZDMA_CH_ISR, AXI_RD_SRC_DSCR, true);
     }
 }
@@ -346,6 +402,8 @@ static void zdma_load_src_descriptor(XlnxZDMA *s)
 static void zdma_update_descr_addr(XlnxZDMA *s, bool type,
                                    unsigned int basereg)
 {
+    unsigned int cache_idx = basereg == R_ZDMA_CH_SRC_CUR_DSCR_LSB ?
+                             DSCR_CACHE_SRC : DSCR_CACHE_DST;
     uint64_t addr, next;
 
     if (type == DTYPE_LINEAR) {
@@ -354,7 +412,8 @@ static void zdma_update_descr_addr(XlnxZDMA *s, bool type,
     } else {
         addr = zdma_get_regaddr64(s, basereg);
         addr += sizeof(s->dsc_dst);
-        next = address_space_ldq_le(s->dma_as, addr, s->attr, NULL);
+        zdma_dscr_read(s, cache_idx, addr, &next, sizeof next);
+        next = le64_to_cpu(next);
     }
 
     zdma_put_regaddr64(s, basereg, next);
@@ -373,7 +432,7 @@ static void zdma_load_dst_descriptor(XlnxZDMA *s)
 
     dst_addr = zdma_get_regaddr64(s, R_ZDMA_CH_DST_CUR_DSCR_LSB);
 
-    if (!zdma_load_descriptor(s, dst_addr, &s->dsc_dst)) {
+    if (!zdma_load_descriptor(s, DSCR_CACHE_DST, dst_addr, &s->dsc_dst)) {
         ARRAY_FIELD_DP32(s->regs, ZDMA_CH_ISR, AXI_RD_DST_DSCR, true);
     }
 
@@ -441,7 +500,44 @@ static void zdma_write_dst(XlnxZDMA *s, uint8_t *buf, uint32_t len)
     }
 }
 
-static void zdma_process_descr(XlnxZDMA *s)
+/*
+ * Returns a host pointer to len bytes of RAM at addr for a RAM to RAM copy
+ * into the current destination, or NULL if the bounce buffer must be used.
+ * *len may be reduced.
+ */
+static void *zdma_map_src(XlnxZDMA *s, uint64_t addr, hwaddr *len)
+{
+    uint32_t dst_size = FIELD_EX32(s->dsc_dst.words[2],
+                                   ZDMA_CH_DST_DSCR_WORD2, SIZE);
+    unsigned int ptype = ARRAY_FIELD_EX32(s->regs, ZDMA_CH_CTRL0, POINT_TYPE);
+    uint64_t dst = s->dsc_dst.addr;
+
+    if (ptype == PT_MEM) {
+        if (dst_size == 0) {
+            /* Needs a descriptor load, leave that to zdma_write_dst.  */
+            return NULL;
+        }
+        *len = MIN(*len, dst_size);
+    }
+
+    /* The bounce buffer gives overlapping copies memmove semantics.  */
+    if (addr < dst + *len && dst < addr + *len) {
+        return NULL;
+    }
+
+    if (!zdma_is_ram(s, addr, *len, false)
+        || !zdma_is_ram(s, dst, *len, true)) {
+        return NULL;
+    }
+    return address_space_map(s->dma_as, addr, len, false, s->attr);
+}
+
+/*
+ * Process up to *budget bytes of the current source descriptor.
+ * Returns false if the budget ran out before the descriptor completed,
+ * progress is then kept in dsc_src.
+ */
+static bool zdma_process_descr(XlnxZDMA *s, uint64_t *budget)
 {
     uint64_t src_addr;
     uint32_t src_size, len;
@@ -484,7 +580,7 @@ static void zdma_process_descr(XlnxZDMA *s)
         memcpy(s->buf, &s->regs[R_ZDMA_CH_WR_ONLY_WORD0], s->cfg.bus_width / 8);
     }
 
-    while (src_size) {
+    while (src_size && *budget) {
         len = src_size > ARRAY_SIZE(s->buf) ? ARRAY_SIZE(s->buf) : src_size;
         if (burst_type == AXI_BURST_FIXED) {
             if (len > (s->cfg.bus_width / 8)) {
@@ -496,6 +592,22 @@ static void zdma_process_descr(XlnxZDMA *s)
             if (len > s->cfg.bus_width / 8) {
                 len = s->cfg.bus_width / 8;
             }
+        } else if (rw_mode == RW_MODE_RW && burst_type == AXI_BURST_INCR) {
+            hwaddr maplen = MIN(src_size, *budget);
+            void *p = zdma_map_src(s, src_addr, &maplen);
+
+            if (p) {
+                /* Straight from guest RAM, no bounce buffer.  */
+                zdma_write_dst(s, p, maplen);
+                address_space_unmap(s->dma_as, p, maplen, false, maplen);
+                src_addr += maplen;
+                s->regs[R_ZDMA_CH_TOTAL_BYTE] += maplen;
+                src_size -= maplen;
+                *budget -= MIN(*budget, maplen);
+                continue;
+            }
+            address_space_read(s->dma_as, src_addr, s->attr, s->buf, len);
+            src_addr += len;
         } else {
             address_space_read(s->dma_as, src_addr, s->attr, s->buf, len);
             if (burst_type == AXI_BURST_INCR) {
@@ -509,8 +621,20 @@ static void zdma_process_descr(XlnxZDMA *s)
 
         s->regs[R_ZDMA_CH_TOTAL_BYTE] += len;
         src_size -= len;
+        *budget -= MIN(*budget, len);
     }
 
+    if (src_size) {
+        /* Out of budget, pick up from here on the next run.  */
+        s->dsc_src.addr = src_addr;
+        s->dsc_src.words[2] = FIELD_DP32(s->dsc_src.words[2],
+                                         ZDMA_CH_SRC_DSCR_WORD2, SIZE,
+                                         src_size);
+        s->src_pending = true;
+        return false;
+    }
+    s->src_pending = false;
+
     ARRAY_FIELD_DP32(s->regs, ZDMA_CH_ISR, DMA_DONE, true);
 
     if (src_intr) {
@@ -527,27 +651,48 @@ static void zdma_process_descr(XlnxZDMA *s)
         ARRAY_FIELD_DP32(s->regs, ZDMA_CH_ISR, DMA_PAUSE, 1);
         ARRAY_FIELD_DP32(s->regs, ZDMA_CH_ISR, DMA_DONE, false);
         zdma_ch_imr_update_irq(s);
-        return;
+        return true;
     }
 
     zdma_update_descr_addr(s, src_type, R_ZDMA_CH_SRC_CUR_DSCR_LSB);
+    return true;
 }
 
 static void zdma_run(XlnxZDMA *s)
 {
+    uint64_t budget = s->cfg.bandwidth ? ZDMA_BURST_SIZE : UINT64_MAX;
+    uint64_t start = budget;
+
     while (s->state == ENABLED && !s->error) {
-        zdma_load_src_descriptor(s);
+        if (!s->src_pending) {
+            zdma_load_src_descriptor(s);
+        }
 
         if (s->error) {
             zdma_set_state(s, DISABLED);
-        } else {
-            zdma_process_descr(s);
+        } else if (!zdma_process_descr(s, &budget)) {
+            break;
         }
     }
 
+    if (s->cfg.bandwidth && s->state == ENABLED && !s->error) {
+        /* Come back once the bytes we just moved would have been moved.  */
+        uint64_t ns = muldiv64(start - budget, NANOSECONDS_PER_SECOND,
+                               s->cfg.bandwidth);
+
+        timer_mod(s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + ns);
+    }
+
     zdma_ch_imr_update_irq(s);
 }
 
+static void zdma_timer_hit(void *opaque)
+{
+    XlnxZDMA *s = XLNX_ZDMA(opaque);
+
+    zdma_run(s);
+}
+
 static void zdma_update_descr_addr_from_start(XlnxZDMA *s)
 {
     uint64_t src_addr, dst_addr;
@@ -578,9 +723,12 @@ static void zdma_ch_ctrlx_postw(RegisterInfo *reg, uint64_t val64)
             }
             ARRAY_FIELD_DP32(s->regs, ZDMA_CH_CTRL0, CONT, false);
             zdma_set_state(s, ENABLED);
+            s->src_pending = false;
         } else if (s->state == DISABLED) {
+            zdma_dscr_cache_flush(s);
             zdma_update_descr_addr_from_start(s);
             zdma_set_state(s, ENABLED);
+            s->src_pending = false;
         }
     } else {
         /* Leave Paused state?  */
@@ -590,6 +738,17 @@ static void zdma_ch_ctrlx_postw(RegisterInfo *reg, uint64_t val64)
         }
     }
 
+    if (s->cfg.bandwidth) {
+        /* Let the register write complete, the timer moves the data.  */
+        if (s->state == ENABLED && !timer_pending(s->timer)) {
+            zdma_dscr_cache_flush(s);
+            timer_mod(s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+        }
+        zdma_ch_imr_update_irq(s);
+        return;
+    }
+
+    zdma_dscr_cache_flush(s);
     zdma_run(s);
 }
 
@@ -710,6 +869,9 @@ static void zdma_reset(DeviceState *dev)
         register_reset(&s->regs_info[i]);
     }
 
+    timer_del(s->timer);
+    s->src_pending = false;
+    zdma_dscr_cache_flush(s);
     zdma_ch_imr_update_irq(s);
 }
 
@@ -787,6 +949,7 @@ static void zdma_realize(DeviceState *dev, Error **errp)
     if (s->attr_ptr) {
         s->attr = *s->attr_ptr;
     }
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, zdma_timer_hit, s);
 }
 
 static void zdma_init(Object *obj)
@@ -809,6 +972,25 @@ static void zdma_init(Object *obj)
                              OBJ_PROP_LINK_STRONG);
 }
 
+static bool zdma_async_needed(void *opaque)
+{
+    XlnxZDMA *s = XLNX_ZDMA(opaque);
+
+    return s->cfg.bandwidth;
+}
+
+static const VMStateDescription vmstate_zdma_async = {
+    .name = TYPE_XLNX_ZDMA "/async",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = zdma_async_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_BOOL(src_pending, XlnxZDMA),
+        VMSTATE_TIMER_PTR(timer, XlnxZDMA),
+        VMSTATE_END_OF_LIST(),
+    }
+};
+
 static const VMStateDescription vmstate_zdma = {
     .name = TYPE_XLNX_ZDMA,
     .version_id = 1,
@@ -820,11 +1002,16 @@ static const VMStateDescription vmstate_zdma = {
         VMSTATE_UINT32_ARRAY(dsc_src.words, XlnxZDMA, 4),
         VMSTATE_UINT32_ARRAY(dsc_dst.words, XlnxZDMA, 4),
         VMSTATE_END_OF_LIST(),
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_zdma_async,
+        NULL
     }
 };
 
 static Property zdma_props[] = {
     DEFINE_PROP_UINT32("bus-width", XlnxZDMA, cfg.bus_width, 64),
+    DEFINE_PROP_UINT64("bandwidth", XlnxZDMA, cfg.bandwidth, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
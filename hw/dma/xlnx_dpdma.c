@@ -42,6 +42,9 @@
     }                                                                          \
 } while (0)
 
+/* Channels 4 and 5 carry audio, which is consumed rather than displayed.  */
+#define DPDMA_FIRST_AUDIO_CHANNEL             4
+
 /*
  * Registers offset for DPDMA.
  */
@@ -607,6 +610,8 @@ static void xlnx_dpdma_reset(DeviceState *dev)
 
     for (i = 0; i < 6; i++) {
         s->data[i] = NULL;
+        s->frame[i].valid = false;
+        xlnx_dpdma_drop_dirty(s, i);
         s->operation_finished[i] = true;
     }
 }
@@ -633,12 +638,116 @@ static void xlnx_dpdma_register_types(void)
     type_register_static(&xlnx_dpdma_info);
 }
 
+static size_t xlnx_dpdma_read_lines(XlnxDPDMAState *s, uint8_t channel,
+                                    uint8_t *dst, uint64_t source_addr,
+                                    int64_t transfer_len, uint32_t line_size,
+                                    uint32_t line_stride)
+{
+    size_t ptr = 0;
+
+    while (transfer_len != 0) {
+        if (dma_memory_read(s->dma_as, source_addr, &dst[ptr], line_size)) {
+            s->registers[DPDMA_ISR] |= ((1 << 12) << channel);
+            xlnx_dpdma_update_irq(s);
+            DPRINTF("Can't get data.\n");
+            break;
+        }
+        ptr += line_size;
+        transfer_len -= line_size;
+        source_addr += line_stride;
+    }
+
+    return ptr;
+}
+
+static void xlnx_dpdma_drop_dirty(XlnxDPDMAState *s, uint8_t channel)
+{
+    XlnxDPDMADirty *d = &s->dirty[channel];
+
+    if (d->section.mr) {
+        memory_region_set_log(d->section.mr, false, DIRTY_MEMORY_VGA);
+        memory_region_unref(d->section.mr);
+        d->section.mr = NULL;
+    }
+    d->lines_valid = false;
+}
+
+/*
+ * Fetch a frame made of a single contiguous descriptor into the host data
+ * location.  When the frame is in guest RAM, its dirty log is used to copy
+ * only the lines written since the previous operation on the same frame.
+ */
+static size_t xlnx_dpdma_read_frame(XlnxDPDMAState *s, uint8_t channel)
+{
+    XlnxDPDMAFrame *frame = &s->frame[channel];
+    XlnxDPDMADirty *d = &s->dirty[channel];
+    uint8_t *dst = s->data[channel];
+    DirtyBitmapSnapshot *snap;
+    bool full = false;
+    uint32_t lines, y;
+    int64_t first = -1, last = -1;
+    uint64_t span;
+    uint8_t *src;
+    hwaddr addr;
+
+    if (!frame->line_size || frame->size % frame->line_size) {
+        xlnx_dpdma_drop_dirty(s, channel);
+        return xlnx_dpdma_read_lines(s, channel, dst, frame->addr, frame->size,
+                                     frame->line_size, frame->line_stride);
+    }
+    lines = frame->size / frame->line_size;
+    span = (uint64_t)frame->line_stride * (lines - 1) + frame->line_size;
+
+    if (!d->section.mr || memcmp(&d->frame, frame, sizeof(*frame))) {
+        xlnx_dpdma_drop_dirty(s, channel);
+        d->section = memory_region_find(s->dma_as->root, frame->addr, span);
+        if (d->section.mr && (!memory_region_is_ram(d->section.mr)
+                              || int128_get64(d->section.size) < span)) {
+            memory_region_unref(d->section.mr);
+            d->section.mr = NULL;
+        }
+        if (!d->section.mr) {
+            return xlnx_dpdma_read_lines(s, channel, dst, frame->addr,
+                                         frame->size, frame->line_size,
+                                         frame->line_stride);
+        }
+        memory_region_set_log(d->section.mr, true, DIRTY_MEMORY_VGA);
+        d->frame = *frame;
+        full = true;
+    }
+
+    addr = d->section.offset_within_region;
+    src = (uint8_t *)memory_region_get_ram_ptr(d->section.mr) + addr;
+    snap = memory_region_snapshot_and_clear_dirty(d->section.mr, addr, span,
+                                                  DIRTY_MEMORY_VGA);
+    for (y = 0; y < lines; y++) {
+        if (full || memory_region_snapshot_get_dirty(d->section.mr, snap, addr,
+                                                     frame->line_size)) {
+            memcpy(&dst[y * frame->line_size], src, frame->line_size);
+            if (first < 0) {
+                first = y;
+            }
+            last = y;
+        }
+        addr += frame->line_stride;
+        src += frame->line_stride;
+    }
+    g_free(snap);
+
+    d->lines_valid = true;
+    d->first_line = first < 0 ? 0 : first;
+    d->num_lines = first < 0 ? 0 : last - first + 1;
+    return frame->size;
+}
+
 size_t xlnx_dpdma_start_operation(XlnxDPDMAState *s, uint8_t channel,
                                     bool one_desc)
 {
     uint64_t desc_addr;
     uint64_t source_addr[6];
     DPDMADescriptor desc;
+    XlnxDPDMAFrame *frame = &s->frame[channel];
+    unsigned int ndesc = 0;
     bool done = false;
     size_t ptr = 0;
 
@@ -661,6 +770,8 @@ size_t xlnx_dpdma_start_operation(XlnxDPDMAState *s, uint8_t channel,
         return 0;
     }
 
+    frame->valid = false;
+
     do {
         if ((s->operation_finished[channel])
           || xlnx_dpdma_is_channel_retriggered(s, channel)) {
@@ -717,27 +828,38 @@ size_t xlnx_dpdma_start_operation(XlnxDPDMAState *s, uint8_t channel,
              || xlnx_dpdma_desc_is_last_of_frame(&desc);
 
         s->operation_finished[channel] = done;
-        if (s->data[channel]) {
+        ndesc++;
+
+        /*
+         * Remember where a frame made of a single contiguous descriptor is,
+         * so that a client can use it in place instead of having it copied.
+         */
+        if (xlnx_dpdma_desc_is_contiguous(&desc)) {
+            frame->valid = done && ndesc == 1;
+            frame->addr = xlnx_dpdma_desc_get_source_address(&desc, 0);
+            frame->line_size = xlnx_dpdma_desc_get_line_size(&desc);
+            frame->line_stride = xlnx_dpdma_desc_get_line_stride(&desc);
+            frame->size = xlnx_dpdma_desc_get_transfer_size(&desc);
+        } else {
+            frame->valid = false;
+        }
+
+        if (!s->data[channel] && frame->valid) {
+            ptr += frame->size;
+        } else if (s->data[channel]) {
             int64_t transfer_len = xlnx_dpdma_desc_get_transfer_size(&desc);
             uint32_t line_size = xlnx_dpdma_desc_get_line_size(&desc);
             uint32_t line_stride = xlnx_dpdma_desc_get_line_stride(&desc);
-            if (xlnx_dpdma_desc_is_contiguous(&desc)) {
+            if (frame->valid && channel < DPDMA_FIRST_AUDIO_CHANNEL) {
+                ptr += xlnx_dpdma_read_frame(s, channel);
+            } else if (xlnx_dpdma_desc_is_contiguous(&desc)) {
+                xlnx_dpdma_drop_dirty(s, channel);
                 source_addr[0] = xlnx_dpdma_desc_get_source_address(&desc, 0);
-                while (transfer_len != 0) {
-                    if (dma_memory_read(s->dma_as,
-                                        source_addr[0],
-                                        &s->data[channel][ptr],
-                                        line_size)) {
-                        s->registers[DPDMA_ISR] |= ((1 << 12) << channel);
-                        xlnx_dpdma_update_irq(s);
-                        DPRINTF("Can't get data.\n");
-                        break;
-                    }
-                    ptr += line_size;
-                    transfer_len -= line_size;
-                    source_addr[0] += line_stride;
-                }
+                ptr += xlnx_dpdma_read_lines(s, channel, &s->data[channel][ptr],
+                                             source_addr[0], transfer_len,
+                                             line_size, line_stride);
             } else {
+                xlnx_dpdma_drop_dirty(s, channel);
                 DPRINTF("Source address:\n");
                 int frag;
                 for (frag = 0; frag < 5; frag++) {
@@ -798,6 +920,40 @@ void xlnx_dpdma_set_host_data_location(XlnxDPDMAState *s, uint8_t channel,
 
     assert(channel <= 5);
     s->data[channel] = p;
+    /* Whatever was copied before isn't in the new location.  */
+    xlnx_dpdma_drop_dirty(s, channel);
+}
+
+bool xlnx_dpdma_get_frame(XlnxDPDMAState *s, uint8_t channel,
+                          XlnxDPDMAFrame *frame)
+{
+    assert(channel <= 5);
+    *frame = s->frame[channel];
+    return frame->valid;
+}
+
+size_t xlnx_dpdma_copy_frame(XlnxDPDMAState *s, uint8_t channel, void *p)
+{
+    XlnxDPDMAFrame *frame = &s->frame[channel];
+
+    assert(channel <= 5);
+    if (!frame->valid) {
+        return 0;
+    }
+
+    return xlnx_dpdma_read_lines(s, channel, p, frame->addr, frame->size,
+                                 frame->line_size, frame->line_stride);
+}
+
+bool xlnx_dpdma_get_dirty_lines(XlnxDPDMAState *s, uint8_t channel,
+                                uint32_t *first, uint32_t *num)
+{
+    XlnxDPDMADirty *d = &s->dirty[channel];
+
+    assert(channel <= 5);
+    *first = d->first_line;
+    *num = d->num_lines;
+    return d->lines_valid;
 }
 
 void xlnx_dpdma_trigger_vsync_irq(XlnxDPDMAState *s)
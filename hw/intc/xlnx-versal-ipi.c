@@ -32,7 +32,10 @@
 #include "qemu/bitops.h"
 #include "migration/vmstate.h"
 #include "hw/qdev-properties.h"
+#include "qemu/host-utils.h"
 #include "qemu/log.h"
+#include "qemu/timer.h"
+#include "trace.h"
 
 #ifndef XILINX_IPI_ERR_DEBUG
 #define XILINX_IPI_ERR_DEBUG 0
@@ -923,6 +926,11 @@ REG32(IPI6_IDR, 0xa001c)
 
 #define IPI_R_MAX (R_IPI6_IDR + 1)
 
+/* Number of agent areas, PSM up to and including IPI6.  */
+#define IPI_NUM_AGENTS 10
+/* Pseudo agent index standing for the IPI block's own error interrupt.  */
+#define IPI_AGENT_INT IPI_NUM_AGENTS
+
 typedef struct XlnxVersalIPI {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
@@ -934,6 +942,9 @@ typedef struct XlnxVersalIPI {
 
     uint32_t regs[IPI_R_MAX];
     RegisterInfo regs_info[IPI_R_MAX];
+
+    /* When each agent last triggered each other agent, for tracing.  */
+    int64_t trig_ns[IPI_NUM_AGENTS][IPI_NUM_AGENTS];
 } XlnxVersalIPI;
 
 #define MAP_AGENT_TO_REG(agent, reg) \
@@ -986,86 +997,111 @@ static unsigned int map_base_to_agent(hwaddr addr)
     return 0;
 }
 
-/* Generate all observer bits.  */
-static void ipi_update_obs(XlnxVersalIPI *s)
+/*
+ * This maps any register address to the agent owning it, or to
+ * IPI_AGENT_INT for the global registers.
+ */
+static unsigned int map_addr_to_agent(hwaddr addr)
 {
-    unsigned int agent2isr[] = {
-        R_PSM_ISR,
-        R_PMC_ISR,
-        R_IPI0_ISR,
-        R_IPI1_ISR,
-        R_IPI2_ISR,
-        R_IPI3_ISR,
-        R_IPI4_ISR,
-        R_IPI5_ISR,
-        R_PMC_NOBUF_ISR,
-        R_IPI6_ISR,
-    };
-    int agent;
-    int i;
-
-    for (agent = 0; agent < ARRAY_SIZE(agent2isr); agent++) {
-        for (i = 0; i < ARRAY_SIZE(map_agent_to_obs); i++) {
-            hwaddr target_obs = map_agent_to_obs[i];
-            unsigned int r_isr = agent2isr[agent];
-            uint32_t isr = s->regs[r_isr];
-            bool active;
+    if (addr < A_PSM_TRIG) {
+        return IPI_AGENT_INT;
+    }
+    return map_base_to_agent(addr & ~(hwaddr)(A_PMC_TRIG - A_PSM_TRIG - 1));
+}
 
-            active = extract32(isr, i, 1);
-            s->regs[target_obs] = deposit32(s->regs[target_obs],
-                                            agent, 1, active);
-        }
+static qemu_irq ipi_agent_irq(XlnxVersalIPI *s, unsigned int agent)
+{
+    switch (agent) {
+    case R_PSM_TRIG_PSM_SHIFT:
+        return s->irq_psm;
+    case R_PSM_TRIG_PMC_SHIFT:
+        return s->irq_pmc;
+    case R_PSM_TRIG_PMC_NOBUF_SHIFT:
+        return s->irq_pmc_nobuf;
+    case R_PSM_TRIG_IPI6_SHIFT:
+        return s->irq_ipi[6];
+    case IPI_AGENT_INT:
+        return s->irq_ipi_int;
+    default:
+        return s->irq_ipi[agent - R_PSM_TRIG_IPI0_SHIFT];
     }
 }
 
-/* The IPIs connected between agents.  */
-static void x_update_irq(XlnxVersalIPI *s)
+/*
+ * Update the observer bits and the interrupt line of every agent in
+ * @agents, a mask of agent indexes.  Only an agent whose ISR or IMR
+ * changed needs updating: its ISR only feeds its own bit of the other
+ * agents' OBS registers.
+ */
+static void ipi_update_agents(XlnxVersalIPI *s, uint32_t agents)
 {
-    struct {
+    for (; agents; agents &= agents - 1) {
+        unsigned int agent = ctz32(agents);
         unsigned int r_isr;
-        unsigned int r_imr;
-        qemu_irq *irq;
-    } irqmap[] = {
-        { R_PSM_ISR, R_PSM_IMR, &s->irq_psm },
-        { R_PMC_ISR, R_PMC_IMR, &s->irq_pmc },
-        { R_IPI0_ISR, R_IPI0_IMR, &s->irq_ipi[0] },
-        { R_IPI1_ISR, R_IPI1_IMR, &s->irq_ipi[1] },
-        { R_IPI2_ISR, R_IPI2_IMR, &s->irq_ipi[2] },
-        { R_IPI3_ISR, R_IPI3_IMR, &s->irq_ipi[3] },
-        { R_IPI4_ISR, R_IPI4_IMR, &s->irq_ipi[4] },
-        { R_IPI5_ISR, R_IPI5_IMR, &s->irq_ipi[5] },
-        { R_PMC_NOBUF_ISR, R_PMC_NOBUF_IMR, &s->irq_pmc_nobuf },
-        { R_IPI6_ISR, R_IPI6_IMR, &s->irq_ipi[6] },
-        { R_IPI_ISR, R_IPI_IMR, &s->irq_ipi_int },
-    };
-    int i;
+        uint32_t isr;
+        int i;
 
-    /* Update the observer registers.  */
-    ipi_update_obs(s);
+        if (agent == IPI_AGENT_INT) {
+            r_isr = R_IPI_ISR;
+        } else {
+            r_isr = map_agent_to_isr[agent];
+        }
+        isr = s->regs[r_isr];
 
-    for (i = 0; i < ARRAY_SIZE(irqmap); i++) {
-        uint32_t isr = s->regs[irqmap[i].r_isr];
-        uint32_t imr = s->regs[irqmap[i].r_imr];
-        bool pending = isr & ~imr;
+        if (agent != IPI_AGENT_INT) {
+            for (i = 0; i < ARRAY_SIZE(map_agent_to_obs); i++) {
+                hwaddr target_obs = map_agent_to_obs[i];
 
-        qemu_set_irq(*irqmap[i].irq, pending);
+                s->regs[target_obs] = deposit32(s->regs[target_obs],
+                                                agent, 1, extract32(isr, i, 1));
+            }
+        }
+        /* IMR always follows ISR.  */
+        qemu_set_irq(ipi_agent_irq(s, agent), isr & ~s->regs[r_isr + 1]);
     }
 }
 
+/* The IPIs connected between agents.  */
+static void x_update_irq(XlnxVersalIPI *s)
+{
+    ipi_update_agents(s, MAKE_64BIT_MASK(0, IPI_NUM_AGENTS + 1));
+}
+
 static uint64_t ipi_int_trig_prew(RegisterInfo *reg, uint64_t val64)
 {
     XlnxVersalIPI *s = XILINX_IPI(reg->opaque);
     uint32_t val = val64;
 
     s->regs[R_IPI_ISR] |= val;
-    x_update_irq(s);
+    ipi_update_agents(s, 1 << IPI_AGENT_INT);
     return 0;
 }
 
+static uint64_t x_isr_prew(RegisterInfo *reg, uint64_t val64)
+{
+    XlnxVersalIPI *s = XILINX_IPI(reg->opaque);
+    unsigned int agent = map_addr_to_agent(reg->access->addr);
+    uint32_t acked = s->regs[reg->access->addr / 4] & ~val64;
+    int64_t now;
+
+    if (!trace_event_get_state_backends(TRACE_XLNX_VERSAL_IPI_ACK)) {
+        return val64;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    for (; acked; acked &= acked - 1) {
+        unsigned int src = ctz32(acked);
+
+        trace_xlnx_versal_ipi_ack(agent, src, now - s->trig_ns[agent][src]);
+    }
+    return val64;
+}
+
 static void x_isr_postw(RegisterInfo *reg, uint64_t val64)
 {
     XlnxVersalIPI *s = XILINX_IPI(reg->opaque);
-    x_update_irq(s);
+
+    ipi_update_agents(s, 1 << map_addr_to_agent(reg->access->addr));
 }
 
 static uint64_t x_ier_prew(RegisterInfo *reg, uint64_t val64)
@@ -1075,7 +1111,7 @@ static uint64_t x_ier_prew(RegisterInfo *reg, uint64_t val64)
     uint32_t val = val64;
 
     s->regs[r_imr] &= ~val;
-    x_update_irq(s);
+    ipi_update_agents(s, 1 << map_addr_to_agent(reg->access->addr));
     return 0;
 }
 
@@ -1086,29 +1122,31 @@ static uint64_t x_idr_prew(RegisterInfo *reg, uint64_t val64)
     uint32_t val = val64;
 
     s->regs[r_imr] |= val;
-    x_update_irq(s);
+    ipi_update_agents(s, 1 << map_addr_to_agent(reg->access->addr));
     return 0;
 }
 
 static void x_trig_postw(RegisterInfo *reg, uint64_t val64)
 {
     XlnxVersalIPI *s = XILINX_IPI(reg->opaque);
-    /*
-     * Maps agent index to corresponding ISR register.
-     */
-    uint32_t val = val64;
-    int i;
+    unsigned int src = map_base_to_agent(reg->access->addr);
+    uint32_t targets = val64 & MAKE_64BIT_MASK(0, IPI_NUM_AGENTS);
+    uint32_t pending;
+    int64_t now = 0;
+
+    trace_xlnx_versal_ipi_trig(src, targets);
+    if (trace_event_get_state_backends(TRACE_XLNX_VERSAL_IPI_ACK)) {
+        now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    }
 
-    for (i = 0; i < ARRAY_SIZE(map_agent_to_isr); i++) {
-        hwaddr target_isr = map_agent_to_isr[i];
-        unsigned int target_bit = map_base_to_agent(reg->access->addr);
+    for (pending = targets; pending; pending &= pending - 1) {
+        unsigned int target = ctz32(pending);
 
-        if (val & (1 << i)) {
-            s->regs[target_isr] |= 1UL << target_bit;
-        }
+        s->regs[map_agent_to_isr[target]] |= 1UL << src;
+        s->trig_ns[target][src] = now;
     }
 
-    x_update_irq(s);
+    ipi_update_agents(s, targets);
 }
 
 static const RegisterAccessInfo ipi_regs_info[] = {
@@ -1297,7 +1335,7 @@ static const RegisterAccessInfo ipi_regs_info[] = {
 #define GEN_IPI_REG_ACCESS_INFO(AGENT)                              \
     GEN_IPI_REG(AGENT, TRIG, 0xfffffc00, 0, NULL, x_trig_postw),    \
     GEN_IPI_REG(AGENT, OBS, 0xffffffff, 0, NULL, NULL),             \
-    GEN_IPI_REG(AGENT, ISR, 0, 0xffffffff, NULL, x_isr_postw),      \
+    GEN_IPI_REG(AGENT, ISR, 0, 0xffffffff, x_isr_prew, x_isr_postw), \
     GEN_IPI_REG(AGENT, IMR, 0xffffffff, 0, NULL, NULL),             \
     GEN_IPI_REG(AGENT, IER, 0xfffffc00, 0, x_ier_prew, NULL),       \
     GEN_IPI_REG(AGENT, IDR, 0xfffffc00, 0, x_idr_prew, NULL)
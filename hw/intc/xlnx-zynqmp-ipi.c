@@ -140,26 +140,36 @@ static const char *index_array_names[NUM_IPIS] = {"APU", "RPU_0", "RPU_1",
                                                   "PMU_3", "PL_0", "PL_1",
                                                   "PL_2", "PL_3"};
 
-static void xlnx_zynqmp_ipi_set_trig(XlnxZynqMPIPI *s, uint32_t val)
+/* Drive the outbound TRIG lines selected by @mask to @level */
+static void xlnx_zynqmp_ipi_set_trig(XlnxZynqMPIPI *s, uint32_t mask,
+                                     int level)
 {
     int i, ipi_index, ipi_mask;
 
-    for (i = 0; i < NUM_IPIS; i++) {
+    for (i = 0; i < NUM_IPIS && mask; i++) {
         ipi_index = index_array[i];
         ipi_mask = (1 << ipi_index);
-        DB_PRINT("Setting %s=%d\n", index_array_names[i],
-                 !!(val & ipi_mask));
-        qemu_set_irq(s->irq_trig_out[i], !!(val & ipi_mask));
+        if (!(mask & ipi_mask)) {
+            continue;
+        }
+        DB_PRINT("Setting %s=%d\n", index_array_names[i], level);
+        qemu_set_irq(s->irq_trig_out[i], level);
     }
 }
 
-static void xlnx_zynqmp_ipi_set_obs(XlnxZynqMPIPI *s, uint32_t val)
+/* Update the outbound OBS lines whose ISR bit changed from @old to @val */
+static void xlnx_zynqmp_ipi_set_obs(XlnxZynqMPIPI *s, uint32_t old,
+                                    uint32_t val)
 {
+    uint32_t changed = old ^ val;
     int i, ipi_index, ipi_mask;
 
-    for (i = 0; i < NUM_IPIS; i++) {
+    for (i = 0; i < NUM_IPIS && changed; i++) {
         ipi_index = index_array[i];
         ipi_mask = (1 << ipi_index);
+        if (!(changed & ipi_mask)) {
+            continue;
+        }
         DB_PRINT("Setting %s=%d\n", index_array_names[i],
                  !!(val & ipi_mask));
         qemu_set_irq(s->irq_obs_out[i], !!(val & ipi_mask));
@@ -179,7 +189,7 @@ static uint64_t xlnx_zynqmp_ipi_trig_prew(RegisterInfo *reg, uint64_t val64)
 {
     XlnxZynqMPIPI *s = XLNX_ZYNQMP_IPI(reg->opaque);
 
-    xlnx_zynqmp_ipi_set_trig(s, val64);
+    xlnx_zynqmp_ipi_set_trig(s, val64, 1);
 
     return val64;
 }
@@ -189,18 +199,18 @@ static void xlnx_zynqmp_ipi_trig_postw(RegisterInfo *reg, uint64_t val64)
     XlnxZynqMPIPI *s = XLNX_ZYNQMP_IPI(reg->opaque);
 
     /* TRIG generates a pulse on the outbound signals. We use the
-     * post-write callback to bring the signal back-down.
+     * post-write callback to bring the raised signals back-down.
      */
     s->regs[R_IPI_TRIG] = 0;
 
-    xlnx_zynqmp_ipi_set_trig(s, 0);
+    xlnx_zynqmp_ipi_set_trig(s, val64, 0);
 }
 
 static uint64_t xlnx_zynqmp_ipi_isr_prew(RegisterInfo *reg, uint64_t val64)
 {
     XlnxZynqMPIPI *s = XLNX_ZYNQMP_IPI(reg->opaque);
 
-    xlnx_zynqmp_ipi_set_obs(s, val64);
+    xlnx_zynqmp_ipi_set_obs(s, s->regs[R_IPI_ISR], val64);
 
     return val64;
 }
@@ -278,11 +288,12 @@ static void xlnx_zynqmp_ipi_handler(void *opaque, int n, int level)
 {
     XlnxZynqMPIPI *s = XLNX_ZYNQMP_IPI(opaque);
     uint32_t val = (!!level) << n;
+    uint32_t old = s->regs[R_IPI_ISR];
 
     DB_PRINT("IPI input irq[%d]=%d\n", n, level);
 
     s->regs[R_IPI_ISR] |= val;
-    xlnx_zynqmp_ipi_set_obs(s, s->regs[R_IPI_ISR]);
+    xlnx_zynqmp_ipi_set_obs(s, old, s->regs[R_IPI_ISR]);
     xlnx_zynqmp_ipi_update_irq(s);
 }
 
@@ -23,6 +23,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/host-utils.h"
 #include "hw/intc/xlnx_scu_gic.h"
 #include "hw/fdt_generic_util.h"
 
@@ -62,26 +63,42 @@ static void xlnx_scu_gic_set_irq(void *opaque, int irq, int level)
     agc->parent_irq_handler(opaque, irq, level);
 }
 
-static void xlnx_scu_gic_update_irq(XlnxSCUGICState *s, unsigned int reg)
+/* The levels seen by the GIC for the 32 interrupts of @reg */
+static uint32_t xlnx_scu_gic_levels(XlnxSCUGICState *s, unsigned int reg)
+{
+    uint32_t levels = s->ext_level[reg];
+    uint8_t i;
+
+    for (i = 0; i < XLNX_SCU_GIC_MAX_INJECTOR; i++) {
+        levels |= s->intr_inj[i][reg];
+    }
+    return levels;
+}
+
+static void xlnx_scu_gic_update_irq(XlnxSCUGICState *s, unsigned int reg,
+                                    uint32_t changed)
 {
     XlnxSCUGICClass *agc = XLNX_SCU_GIC_GET_CLASS(s);
-    int irq, level;
+    uint32_t levels = xlnx_scu_gic_levels(s, reg);
+    int bit;
 
-    for (irq = reg * 32; irq < (reg + 1) * 32; irq++) {
-        level = xlnx_scu_gic_inject_error(s, irq,
-                                          s->ext_level[irq / 32] &
-                                              (1 << irq % 32));
-        agc->parent_irq_handler(s, irq, level);
+    /* Only tell the GIC about the lines whose level changed */
+    for (; changed; changed &= changed - 1) {
+        bit = ctz32(changed);
+        agc->parent_irq_handler(s, reg * 32 + bit, extract32(levels, bit, 1));
     }
 }
 
 void xlnx_scu_gic_set_intr(XlnxSCUGICState *s, unsigned int reg, uint32_t val,
                            uint8_t injector)
 {
+    uint32_t old;
+
     assert(reg < XLNX_SCU_GIC_IRQ_REG);
 
+    old = xlnx_scu_gic_levels(s, reg);
     s->intr_inj[injector][reg] = val;
-    xlnx_scu_gic_update_irq(s, reg);
+    xlnx_scu_gic_update_irq(s, reg, old ^ xlnx_scu_gic_levels(s, reg));
 }
 
 static void xlnx_scu_gic_class_init(ObjectClass *klass, void *data)
@@ -1055,6 +1055,21 @@ REG32(SMMU_GATSR, 0x188)
 /* Maximum number of TBUs supported by this model.  */
 #define MAX_TBU 16
 
+/* Number of entries in the direct-mapped translation cache.  */
+#define SMMU_TLB_SIZE 256
+
+/*
+ * A successful translation of one 4K page for the master in iommu_idx.
+ * Faults are never cached so that they are reported on every access.
+ */
+typedef struct SMMUTLBEntry {
+    uint64_t va;
+    uint64_t pa;
+    int iommu_idx;
+    int prot;
+    bool valid;
+} SMMUTLBEntry;
+
 typedef struct SMMU SMMU;
 typedef struct TBU {
     SMMU *smmu;
@@ -1088,6 +1103,8 @@ struct SMMU {
     RegisterAccessInfo *rai_cb;
     uint32_t regs[R_MAX];
     RegisterInfo regs_info[R_MAX];
+
+    SMMUTLBEntry tlb[SMMU_TLB_SIZE];
 };
 
 /* Generic page attributes.  */
@@ -1697,6 +1714,18 @@ static int smmu_num_indexes(IOMMUMemoryRegion *iommu)
     return (1 << 17) - 1;
 }
 
+static void smmu_tlb_flush(SMMU *s)
+{
+    memset(s->tlb, 0, sizeof s->tlb);
+}
+
+static SMMUTLBEntry *smmu_tlb_entry(SMMU *s, uint64_t va, int iommu_idx)
+{
+    unsigned int h = (va >> 12) ^ ((uint32_t)iommu_idx * 0x9e3779b1);
+
+    return &s->tlb[(h ^ (h >> 16)) & (SMMU_TLB_SIZE - 1)];
+}
+
 static IOMMUTLBEntry smmu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
                                     IOMMUAccessFlags flags, int iommu_idx)
 
@@ -1716,11 +1745,19 @@ static IOMMUTLBEntry smmu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
     bool err = false;
     uint16_t master_id = iommu_idx >> 1;
     bool clientpd = ARRAY_FIELD_EX32(s->regs, SMMU_SCR0, CLIENTPD);
+    SMMUTLBEntry *te;
 
     if (clientpd) {
         return ret;
     }
 
+    te = smmu_tlb_entry(s, va, iommu_idx);
+    if (te->valid && te->va == va && te->iommu_idx == iommu_idx) {
+        ret.translated_addr = te->pa;
+        ret.perm = te->prot;
+        return ret;
+    }
+
     cb = smmu_stream_id_match(s, master_id);
 
     if (cb >= 0) {
@@ -1730,8 +1767,17 @@ static IOMMUTLBEntry smmu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
         if (err) {
             memset(&ret, 0, sizeof ret);
             ret.perm = IOMMU_NONE;
+            return ret;
         }
     }
+
+    *te = (SMMUTLBEntry) {
+        .va = va,
+        .pa = ret.translated_addr,
+        .iommu_idx = iommu_idx,
+        .prot = ret.perm,
+        .valid = true,
+    };
     return ret;
 }
 
@@ -2075,11 +2121,27 @@ static void smmu500_reset(DeviceState *dev)
     ARRAY_FIELD_DP32(s->regs, SMMU_SIDR0, NUMSMRG, s->cfg.num_smr);
     ARRAY_FIELD_DP32(s->regs, SMMU_SIDR1, NUMCB, s->cfg.num_cb);
     ARRAY_FIELD_DP32(s->regs, SMMU_SIDR1, NUMPAGENDXB, num_pages_log2 - 1);
+    smmu_tlb_flush(s);
+}
+
+/*
+ * Any register write may be a TLB invalidation or change the stream
+ * matching, the translation regime or the page-table base, so the
+ * translation cache is dropped before it takes effect.  Writes are
+ * rare compared to DMA and this keeps the cache trivially coherent.
+ */
+static void smmu500_write(void *opaque, hwaddr addr, uint64_t value,
+                          unsigned size)
+{
+    RegisterInfoArray *reg_array = opaque;
+
+    smmu_tlb_flush(XILINX_SMMU500(reg_array->mem.owner));
+    register_write_memory(opaque, addr, value, size);
 }
 
 static const MemoryRegionOps smmu500_ops = {
     .read = register_read_memory,
-    .write = register_write_memory,
+    .write = smmu500_write,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -2317,11 +2379,18 @@ static Property smmu_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static int smmu500_post_load(void *opaque, int version_id)
+{
+    smmu_tlb_flush(opaque);
+    return 0;
+}
+
 static const VMStateDescription vmstate_smmu500 = {
     .name = TYPE_XILINX_SMMU500,
     .version_id = 1,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = smmu500_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, SMMU, R_MAX),
         VMSTATE_END_OF_LIST(),
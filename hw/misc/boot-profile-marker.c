@@ -0,0 +1,121 @@
+/*
+ * Boot profile marker
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Lets guest firmware mark its boot phases in the -boot-profile trace.
+ * A write of N to MARK records "fw N".  Bytes written to NAME are
+ * collected until a NUL byte, which records the collected string.
+ * Reads return 0.  Without -boot-profile all writes are ignored, so the
+ * device can stay in the device tree.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/sysbus.h"
+#include "hw/boot-profile.h"
+#include "qemu/module.h"
+
+#define TYPE_BOOT_PROFILE_MARKER "boot-profile-marker"
+#define BOOT_PROFILE_MARKER(obj) \
+    OBJECT_CHECK(BootProfileMarker, (obj), TYPE_BOOT_PROFILE_MARKER)
+
+#define R_MARK  0x0
+#define R_NAME  0x4
+
+#define BOOT_PROFILE_MARKER_NAME_LEN 64
+
+typedef struct BootProfileMarker {
+    SysBusDevice parent_obj;
+
+    MemoryRegion iomem;
+    char name[BOOT_PROFILE_MARKER_NAME_LEN];
+    unsigned name_len;
+} BootProfileMarker;
+
+static uint64_t boot_profile_marker_read(void *opaque, hwaddr offset,
+                                         unsigned size)
+{
+    return 0;
+}
+
+static void boot_profile_marker_write(void *opaque, hwaddr offset,
+                                      uint64_t value, unsigned size)
+{
+    BootProfileMarker *s = BOOT_PROFILE_MARKER(opaque);
+    char *name;
+
+    if (!boot_profile_enabled) {
+        return;
+    }
+
+    switch (offset) {
+    case R_MARK:
+        name = g_strdup_printf("fw %" PRIu64, value);
+        boot_profile_mark("firmware", name);
+        g_free(name);
+        break;
+    case R_NAME:
+        if (value & 0xff) {
+            /* Overlong names are truncated */
+            if (s->name_len < sizeof(s->name) - 1) {
+                s->name[s->name_len++] = value;
+            }
+            break;
+        }
+        s->name[s->name_len] = '\0';
+        boot_profile_mark("firmware", s->name);
+        s->name_len = 0;
+        break;
+    }
+}
+
+static const MemoryRegionOps boot_profile_marker_ops = {
+    .read = boot_profile_marker_read,
+    .write = boot_profile_marker_write,
+    .impl.min_access_size = 1,
+    .impl.max_access_size = 4,
+    .valid.min_access_size = 1,
+    .valid.max_access_size = 4,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+};
+
+static void boot_profile_marker_init(Object *obj)
+{
+    BootProfileMarker *s = BOOT_PROFILE_MARKER(obj);
+
+    memory_region_init_io(&s->iomem, obj, &boot_profile_marker_ops, s,
+                          TYPE_BOOT_PROFILE_MARKER, 0x8);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->iomem);
+}
+
+static void boot_profile_marker_reset(DeviceState *dev)
+{
+    BootProfileMarker *s = BOOT_PROFILE_MARKER(dev);
+
+    s->name_len = 0;
+}
+
+static void boot_profile_marker_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->reset = boot_profile_marker_reset;
+}
+
+static const TypeInfo boot_profile_marker_info = {
+    .name = TYPE_BOOT_PROFILE_MARKER,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(BootProfileMarker),
+    .instance_init = boot_profile_marker_init,
+    .class_init = boot_profile_marker_class_init,
+};
+
+static void boot_profile_marker_register_types(void)
+{
+    type_register_static(&boot_profile_marker_info);
+}
+
+type_init(boot_profile_marker_register_types)
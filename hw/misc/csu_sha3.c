@@ -281,6 +281,14 @@ static void memxor(uint8_t *a, const uint8_t *b, unsigned int len)
 {
     int i;
 
+    for (; len >= 8; len -= 8, a += 8, b += 8) {
+        uint64_t va, vb;
+
+        memcpy(&va, a, sizeof va);
+        memcpy(&vb, b, sizeof vb);
+        va ^= vb;
+        memcpy(a, &va, sizeof va);
+    }
     for (i = 0; i < len; i++) {
         *a = *a ^ *b;
          a++;
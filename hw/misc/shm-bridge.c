@@ -0,0 +1,395 @@
+/*
+ * Shared memory bridge between QEMU instances
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Multi-board systems are simulated as one QEMU process per board.  This
+ * device maps a file shared by those processes (typically in /dev/shm) into
+ * the guest physical address space as plain RAM, so data moved across the
+ * boards is neither serialized nor copied.
+ *
+ * A small register block lets each side ring a doorbell in its peer.  When
+ * the UNIX socket chardev connects, each instance sends its own eventfd to
+ * the other side; ringing the doorbell is then a single write to the
+ * peer's eventfd, and the socket is not used again.  As with a real shared
+ * memory link, ordering data against doorbells is up to the guests.
+ *
+ * Register map (32-bit):
+ *   0x00 ID          RO  SHM_BRIDGE_ID
+ *   0x04 STATUS      RO  bit 0: a peer is connected
+ *   0x08 DOORBELL    WO  any write rings the peer
+ *   0x0c ISR         W1C bit 0: the peer rang our doorbell
+ *   0x10 IER         RW  interrupt enable for ISR
+ *   0x14 RING_COUNT  RO  doorbells received, low 32 bits
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+#include "qemu/event_notifier.h"
+#include "qemu/log.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "chardev/char-fe.h"
+#include "exec/memory.h"
+#include "exec/ram_addr.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/sysbus.h"
+#include "migration/vmstate.h"
+#include "trace.h"
+
+#define TYPE_SHM_BRIDGE "shm-bridge"
+#define SHM_BRIDGE(obj) OBJECT_CHECK(ShmBridge, (obj), TYPE_SHM_BRIDGE)
+
+#define SHM_BRIDGE_ID           0x53484d42      /* "SHMB" */
+#define SHM_BRIDGE_VERSION      1
+
+#define R_ID            0x00
+#define R_STATUS        0x04
+#define R_DOORBELL      0x08
+#define R_ISR           0x0c
+#define R_IER           0x10
+#define R_RING_COUNT    0x14
+
+#define STATUS_PEER     (1 << 0)
+#define ISR_DOORBELL    (1 << 0)
+
+/* Sent once in each direction with our eventfd attached */
+typedef struct ShmBridgeHello {
+    uint32_t magic;
+    uint32_t version;
+} QEMU_PACKED ShmBridgeHello;
+
+typedef struct ShmBridge {
+    SysBusDevice parent_obj;
+
+    MemoryRegion shm;
+    MemoryRegion regs;
+    qemu_irq irq;
+    CharBackend chr;
+
+    EventNotifier doorbell;
+    int peer_fd;
+    uint8_t hello[sizeof(ShmBridgeHello)];
+    unsigned int hello_len;
+
+    uint32_t isr;
+    uint32_t ier;
+    uint32_t rings;
+
+    char *mem_path;
+    uint64_t size;
+} ShmBridge;
+
+static bool shm_bridge_peer_ready(ShmBridge *s)
+{
+    return s->peer_fd >= 0 && s->hello_len == sizeof(s->hello);
+}
+
+static void shm_bridge_update_irq(ShmBridge *s)
+{
+    qemu_set_irq(s->irq, !!(s->isr & s->ier));
+}
+
+static void shm_bridge_doorbell(void *opaque)
+{
+    ShmBridge *s = opaque;
+
+    if (event_notifier_test_and_clear(&s->doorbell)) {
+        trace_shm_bridge_doorbell_rx(s);
+        s->rings++;
+        s->isr |= ISR_DOORBELL;
+        shm_bridge_update_irq(s);
+    }
+}
+
+static void shm_bridge_ring(ShmBridge *s)
+{
+    uint64_t value = 1;
+    ssize_t ret;
+
+    if (!shm_bridge_peer_ready(s)) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: doorbell rung without a peer\n", TYPE_SHM_BRIDGE);
+        return;
+    }
+
+    trace_shm_bridge_doorbell_tx(s);
+    do {
+        ret = write(s->peer_fd, &value, sizeof(value));
+    } while (ret < 0 && errno == EINTR);
+    /* EAGAIN means the counter is saturated, i.e. the peer is already rung */
+    if (ret < 0 && errno != EAGAIN) {
+        error_report("%s: cannot ring the peer: %s", TYPE_SHM_BRIDGE,
+                     strerror(errno));
+    }
+}
+
+static uint64_t shm_bridge_read(void *opaque, hwaddr addr, unsigned size)
+{
+    ShmBridge *s = opaque;
+
+    switch (addr) {
+    case R_ID:
+        return SHM_BRIDGE_ID;
+    case R_STATUS:
+        return shm_bridge_peer_ready(s) ? STATUS_PEER : 0;
+    case R_ISR:
+        return s->isr;
+    case R_IER:
+        return s->ier;
+    case R_RING_COUNT:
+        return s->rings;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad read offset 0x%" HWADDR_PRIx
+                      "\n", TYPE_SHM_BRIDGE, addr);
+        return 0;
+    }
+}
+
+static void shm_bridge_write(void *opaque, hwaddr addr, uint64_t value,
+                             unsigned size)
+{
+    ShmBridge *s = opaque;
+
+    switch (addr) {
+    case R_DOORBELL:
+        shm_bridge_ring(s);
+        break;
+    case R_ISR:
+        s->isr &= ~value;
+        shm_bridge_update_irq(s);
+        break;
+    case R_IER:
+        s->ier = value & ISR_DOORBELL;
+        shm_bridge_update_irq(s);
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad write offset 0x%" HWADDR_PRIx
+                      "\n", TYPE_SHM_BRIDGE, addr);
+        break;
+    }
+}
+
+static const MemoryRegionOps shm_bridge_ops = {
+    .read = shm_bridge_read,
+    .write = shm_bridge_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+static void shm_bridge_peer_gone(ShmBridge *s)
+{
+    if (s->peer_fd >= 0) {
+        close(s->peer_fd);
+        s->peer_fd = -1;
+    }
+    s->hello_len = 0;
+}
+
+static void shm_bridge_send_hello(ShmBridge *s)
+{
+    ShmBridgeHello hello = {
+        .magic = cpu_to_le32(SHM_BRIDGE_ID),
+        .version = cpu_to_le32(SHM_BRIDGE_VERSION),
+    };
+    int fd = event_notifier_get_fd(&s->doorbell);
+
+    if (qemu_chr_fe_set_msgfds(&s->chr, &fd, 1) < 0 ||
+        qemu_chr_fe_write_all(&s->chr, (uint8_t *)&hello,
+                              sizeof(hello)) != sizeof(hello)) {
+        error_report("%s: cannot send the doorbell to the peer",
+                     TYPE_SHM_BRIDGE);
+    }
+}
+
+static int shm_bridge_can_receive(void *opaque)
+{
+    ShmBridge *s = opaque;
+
+    /* Keep reading after the hello, so that a hangup is noticed */
+    return s->hello_len < sizeof(s->hello) ? sizeof(s->hello) - s->hello_len
+                                          : 1;
+}
+
+static void shm_bridge_receive(void *opaque, const uint8_t *buf, int size)
+{
+    ShmBridge *s = opaque;
+    ShmBridgeHello hello;
+    int fd;
+
+    if (s->hello_len == sizeof(s->hello)) {
+        return;
+    }
+    if (s->hello_len == 0) {
+        /* The fd travels with the first bytes of the hello */
+        fd = qemu_chr_fe_get_msgfd(&s->chr);
+        if (fd >= 0) {
+            shm_bridge_peer_gone(s);
+            s->peer_fd = fd;
+        }
+    }
+
+    size = MIN(size, shm_bridge_can_receive(s));
+    memcpy(s->hello + s->hello_len, buf, size);
+    s->hello_len += size;
+    if (s->hello_len < sizeof(s->hello)) {
+        return;
+    }
+
+    memcpy(&hello, s->hello, sizeof(hello));
+    if (le32_to_cpu(hello.magic) != SHM_BRIDGE_ID ||
+        le32_to_cpu(hello.version) != SHM_BRIDGE_VERSION ||
+        s->peer_fd < 0) {
+        error_report("%s: invalid hello from the peer", TYPE_SHM_BRIDGE);
+        shm_bridge_peer_gone(s);
+        qemu_chr_fe_disconnect(&s->chr);
+        return;
+    }
+    trace_shm_bridge_connected(s, s->peer_fd);
+}
+
+static void shm_bridge_event(void *opaque, QEMUChrEvent event)
+{
+    ShmBridge *s = opaque;
+
+    switch (event) {
+    case CHR_EVENT_OPENED:
+        shm_bridge_peer_gone(s);
+        shm_bridge_send_hello(s);
+        break;
+    case CHR_EVENT_CLOSED:
+        trace_shm_bridge_disconnected(s);
+        shm_bridge_peer_gone(s);
+        break;
+    default:
+        break;
+    }
+}
+
+static void shm_bridge_realize(DeviceState *dev, Error **errp)
+{
+    ShmBridge *s = SHM_BRIDGE(dev);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
+    Error *local_err = NULL;
+    g_autofree char *path = NULL;
+    g_autofree char *name = NULL;
+    int ret;
+
+    if (!s->mem_path || !s->size) {
+        error_setg(errp, "%s needs mem-path and size", TYPE_SHM_BRIDGE);
+        return;
+    }
+    if (!qemu_chr_fe_backend_connected(&s->chr)) {
+        error_setg(errp, "%s needs a chardev", TYPE_SHM_BRIDGE);
+        return;
+    }
+
+    path = object_get_canonical_path(OBJECT(s));
+    name = g_strdup_printf("%s.shm", path);
+    memory_region_init_ram_from_file(&s->shm, OBJECT(s), name, s->size, 0,
+                                     RAM_SHARED, s->mem_path, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+
+    ret = event_notifier_init(&s->doorbell, false);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "cannot create the doorbell");
+        object_unparent(OBJECT(&s->shm));
+        return;
+    }
+    qemu_set_fd_handler(event_notifier_get_fd(&s->doorbell),
+                        shm_bridge_doorbell, NULL, s);
+
+    memory_region_init_io(&s->regs, OBJECT(s), &shm_bridge_ops, s,
+                          TYPE_SHM_BRIDGE ".regs", 0x1000);
+    sysbus_init_mmio(sbd, &s->shm);
+    sysbus_init_mmio(sbd, &s->regs);
+    sysbus_init_irq(sbd, &s->irq);
+
+    qemu_chr_fe_set_handlers(&s->chr, shm_bridge_can_receive,
+                             shm_bridge_receive, shm_bridge_event, NULL,
+                             s, NULL, true);
+}
+
+static void shm_bridge_unrealize(DeviceState *dev)
+{
+    ShmBridge *s = SHM_BRIDGE(dev);
+
+    qemu_chr_fe_deinit(&s->chr, false);
+    shm_bridge_peer_gone(s);
+    qemu_set_fd_handler(event_notifier_get_fd(&s->doorbell), NULL, NULL, NULL);
+    event_notifier_cleanup(&s->doorbell);
+}
+
+static void shm_bridge_init(Object *obj)
+{
+    ShmBridge *s = SHM_BRIDGE(obj);
+
+    s->peer_fd = -1;
+}
+
+static void shm_bridge_reset(DeviceState *dev)
+{
+    ShmBridge *s = SHM_BRIDGE(dev);
+
+    s->isr = 0;
+    s->ier = 0;
+    s->rings = 0;
+    shm_bridge_update_irq(s);
+}
+
+static const VMStateDescription vmstate_shm_bridge = {
+    .name = TYPE_SHM_BRIDGE,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(isr, ShmBridge),
+        VMSTATE_UINT32(ier, ShmBridge),
+        VMSTATE_UINT32(rings, ShmBridge),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property shm_bridge_properties[] = {
+    DEFINE_PROP_STRING("mem-path", ShmBridge, mem_path),
+    DEFINE_PROP_SIZE("size", ShmBridge, size, 0),
+    DEFINE_PROP_CHR("chardev", ShmBridge, chr),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void shm_bridge_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = shm_bridge_realize;
+    dc->unrealize = shm_bridge_unrealize;
+    dc->reset = shm_bridge_reset;
+    dc->vmsd = &vmstate_shm_bridge;
+    device_class_set_props(dc, shm_bridge_properties);
+    set_bit(DEVICE_CATEGORY_MISC, dc->categories);
+}
+
+static const TypeInfo shm_bridge_info = {
+    .name          = TYPE_SHM_BRIDGE,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(ShmBridge),
+    .instance_init = shm_bridge_init,
+    .class_init    = shm_bridge_class_init,
+};
+
+static void shm_bridge_register_types(void)
+{
+    type_register_static(&shm_bridge_info);
+}
+
+type_init(shm_bridge_register_types)
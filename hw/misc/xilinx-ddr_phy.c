@@ -4951,6 +4951,8 @@ static void ddr_phy_init(Object *obj)
                               &ddr_phy_ops,
                               XILINX_DDR_PHY_ERR_DEBUG,
                               DDR_PHY_R_MAX * 4);
+    /* Only MMIO touches the registers, firmware polls them on many CPUs */
+    register_array_set_lockless(reg_array);
     memory_region_add_subregion(&s->iomem,
                                 0x0,
                                 &reg_array->mem);
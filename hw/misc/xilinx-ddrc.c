@@ -1180,6 +1180,8 @@ static void ddrc_init(Object *obj)
                               &ddrc_ops,
                               XILINX_DDRC_ERR_DEBUG,
                               R_MAX * 4);
+    /* Only MMIO touches the registers, firmware polls them on many CPUs */
+    register_array_set_lockless(reg_array);
     memory_region_add_subregion(&s->iomem,
                                 0x0,
                                 &reg_array->mem);
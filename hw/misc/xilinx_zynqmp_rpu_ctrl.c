@@ -550,12 +550,15 @@ static void rpu_rpu_glbl_cntl_postw(RegisterInfo *reg, uint64_t val64)
     bool tcm_comb = ARRAY_FIELD_EX32(s->regs, RPU_GLBL_CNTL, TCM_COMB);
     bool sls_split = ARRAY_FIELD_EX32(s->regs, RPU_GLBL_CNTL, SLSPLIT);
 
+    /* Apply the TCM and cache mapping changes as one topology update.  */
+    memory_region_transaction_begin();
     memory_region_set_enabled(&s->atcm1_mask, !tcm_comb);
     memory_region_set_enabled(&s->btcm1_mask, !tcm_comb);
 
     memory_region_set_enabled(s->icache_for_rpu1, sls_split);
     memory_region_set_enabled(s->dcache_for_rpu1, sls_split);
     memory_region_set_enabled(s->ddr, sls_split);
+    memory_region_transaction_commit();
 
     rpu_update_split_gpio(s);
 }
@@ -136,9 +136,55 @@ void xlnx_aes_key_zero(XlnxAES *s)
         return;
     }
     memset(s->key, 0, sizeof s->key);
+    qcrypto_cipher_free(s->cipher);
+    s->cipher = NULL;
+    memset(&s->gcm_ctx, 0, sizeof s->gcm_ctx);
     s->key_zeroed = 1;
 }
 
+static void xlnx_aes_ecb(void *opaque, unsigned char *buf, size_t len)
+{
+    XlnxAES *s = opaque;
+
+    qcrypto_cipher_encrypt(s->cipher, buf, buf, len, &error_abort);
+}
+
+/*
+ * Hand the bulk of the payload to the host crypto backend, which may
+ * use AES-NI or the ARMv8 crypto extensions. GHASH and the partial
+ * blocks stay in util/gcm.c.
+ */
+static void xlnx_aes_setup_cipher(XlnxAES *s, unsigned int keylen)
+{
+    QCryptoCipherAlgorithm alg;
+
+    qcrypto_cipher_free(s->cipher);
+    s->cipher = NULL;
+
+    switch (keylen) {
+    case 128:
+        alg = QCRYPTO_CIPHER_ALG_AES_128;
+        break;
+    case 192:
+        alg = QCRYPTO_CIPHER_ALG_AES_192;
+        break;
+    case 256:
+        alg = QCRYPTO_CIPHER_ALG_AES_256;
+        break;
+    default:
+        return;
+    }
+
+    if (qcrypto_cipher_supports(alg, QCRYPTO_CIPHER_MODE_ECB)) {
+        s->cipher = qcrypto_cipher_new(alg, QCRYPTO_CIPHER_MODE_ECB,
+                                       (const uint8_t *) s->key, keylen / 8,
+                                       NULL);
+    }
+    if (s->cipher) {
+        gcm_set_ecb(&s->gcm_ctx, xlnx_aes_ecb, s);
+    }
+}
+
 static void xlnx_aes_push_iv(XlnxAES *s, uint32_t v)
 {
     if (s->state < IV0 || s->state > IV3) {
@@ -163,6 +209,7 @@ static void xlnx_aes_push_iv(XlnxAES *s, uint32_t v)
             qemu_log_mask(LOG_GUEST_ERROR, "CSU-AES: GCM init failed\n");
             return;
         }
+        xlnx_aes_setup_cipher(s, keylen);
         gcm_push_iv(&s->gcm_ctx, (void *) s->iv, 12, 16);
         DPRINT("IV (big endian):\n");
         for (i = 0; i < 4; i++) {
@@ -319,6 +366,13 @@ static void xlnx_aes_realize(DeviceState *dev, Error **errp)
     qdev_init_gpio_in_named(dev, reset_handler, "reset", 1);
 }
 
+static void xlnx_aes_finalize(Object *obj)
+{
+    XlnxAES *s = XLNX_AES(obj);
+
+    qcrypto_cipher_free(s->cipher);
+}
+
 static void xlnx_aes_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -332,6 +386,7 @@ static const TypeInfo xlnx_aes_info = {
     .parent        = TYPE_DEVICE,
     .instance_size = sizeof(XlnxAES),
     .class_init    = xlnx_aes_class_init,
+    .instance_finalize = xlnx_aes_finalize,
 };
 
 static void xlnx_aes_types(void)
@@ -0,0 +1,203 @@
+/*
+ * Versal NoC performance model
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * A NoC port sits in the DMA path of a master (as an NMU) or in front
+ * of a shared target (as an NSU) and forwards every transaction to its
+ * "mr" link unchanged.  On the way it works out when the transaction
+ * would have completed on a port with the configured bandwidth and
+ * latency, and accumulates the time spent queueing behind earlier
+ * traffic.  A transaction queues behind traffic of its own QoS class
+ * and of the classes above it: 0 best effort, 1 isochronous,
+ * 2 low latency.  A port with a non-zero "qos" tags the traffic going
+ * through it, so that ports further down see its class.
+ *
+ * Functional timing is not changed, DMA still completes at once.  The
+ * counters are read-only QOM properties and can be fetched with qom-get.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
+#include "qemu/timer.h"
+#include "qemu/module.h"
+#include "exec/address-spaces.h"
+#include "hw/sysbus.h"
+#include "hw/qdev-properties.h"
+
+#define TYPE_XLNX_NOC_PERF_PORT "xlnx.noc-perf-port"
+#define XLNX_NOC_PERF_PORT(obj) \
+     OBJECT_CHECK(NocPerfPort, (obj), TYPE_XLNX_NOC_PERF_PORT)
+
+#define NOC_QOS_NR 3
+
+#define NOC_PERF_MAX_ACCESS 4096
+
+typedef struct NocPerfPort {
+    SysBusDevice parent_obj;
+    MemoryRegion iomem;
+
+    MemoryRegion *mr;
+    AddressSpace as;
+
+    struct {
+        uint64_t bandwidth;     /* Bytes per second, 0 for unlimited */
+        uint32_t latency;       /* ns per transaction */
+        uint8_t qos;
+    } cfg;
+
+    /* Modelled time at which each class has drained its backlog */
+    int64_t busy_until[NOC_QOS_NR];
+
+    struct {
+        uint64_t transactions;
+        uint64_t bytes_read;
+        uint64_t bytes_written;
+        uint64_t busy_ns;
+        uint64_t stall_ns;
+        uint64_t latency_ns;
+    } stats;
+} NocPerfPort;
+
+static void noc_perf_account(NocPerfPort *s, unsigned int qos, unsigned size,
+                             bool wr)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t start = now;
+    uint64_t xfer = 0;
+    unsigned int c;
+
+    for (c = qos; c < NOC_QOS_NR; c++) {
+        start = MAX(start, s->busy_until[c]);
+    }
+    if (s->cfg.bandwidth) {
+        xfer = muldiv64(size, NANOSECONDS_PER_SECOND, s->cfg.bandwidth);
+    }
+    s->busy_until[qos] = start + xfer;
+
+    s->stats.transactions++;
+    if (wr) {
+        s->stats.bytes_written += size;
+    } else {
+        s->stats.bytes_read += size;
+    }
+    s->stats.busy_ns += xfer;
+    s->stats.stall_ns += start - now;
+    s->stats.latency_ns += start - now + xfer + s->cfg.latency;
+}
+
+static void noc_perf_access(MemoryTransaction *tr)
+{
+    NocPerfPort *s = tr->opaque;
+    MemTxAttrs attrs = tr->attr;
+    uint8_t buf[8];
+    uint8_t *data = tr->size <= 8 ? buf : tr->data.p8;
+
+    if (s->cfg.qos) {
+        attrs.qos = s->cfg.qos;
+    }
+    noc_perf_account(s, MIN(attrs.qos, NOC_QOS_NR - 1), tr->size, tr->rw);
+
+    if (tr->rw) {
+        if (tr->size <= 8) {
+            stn_le_p(buf, tr->size, tr->data.u64);
+        }
+        address_space_write(&s->as, tr->addr, attrs, data, tr->size);
+    } else {
+        address_space_read(&s->as, tr->addr, attrs, data, tr->size);
+        if (tr->size <= 8) {
+            tr->data.u64 = ldn_le_p(buf, tr->size);
+        }
+    }
+}
+
+static const MemoryRegionOps noc_perf_ops = {
+    .access = noc_perf_access,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.max_access_size = NOC_PERF_MAX_ACCESS,
+};
+
+static void noc_perf_reset(DeviceState *dev)
+{
+    NocPerfPort *s = XLNX_NOC_PERF_PORT(dev);
+
+    memset(s->busy_until, 0, sizeof(s->busy_until));
+}
+
+static void noc_perf_realize(DeviceState *dev, Error **errp)
+{
+    NocPerfPort *s = XLNX_NOC_PERF_PORT(dev);
+
+    if (s->cfg.qos >= NOC_QOS_NR) {
+        error_setg(errp, "qos must be below %d", NOC_QOS_NR);
+        return;
+    }
+
+    address_space_init(&s->as, s->mr ? s->mr : get_system_memory(),
+                       TYPE_XLNX_NOC_PERF_PORT);
+}
+
+static void noc_perf_init(Object *obj)
+{
+    NocPerfPort *s = XLNX_NOC_PERF_PORT(obj);
+
+    memory_region_init_io(&s->iomem, obj, &noc_perf_ops, s,
+                          TYPE_XLNX_NOC_PERF_PORT, UINT64_MAX);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->iomem);
+
+    object_property_add_link(obj, "mr", TYPE_MEMORY_REGION,
+                             (Object **)&s->mr,
+                             qdev_prop_allow_set_link_before_realize,
+                             OBJ_PROP_LINK_STRONG);
+
+    object_property_add_uint64_ptr(obj, "transactions",
+                                   &s->stats.transactions,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "bytes-read", &s->stats.bytes_read,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "bytes-written",
+                                   &s->stats.bytes_written,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "busy-ns", &s->stats.busy_ns,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "stall-ns", &s->stats.stall_ns,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "latency-ns", &s->stats.latency_ns,
+                                   OBJ_PROP_FLAG_READ);
+}
+
+static Property noc_perf_properties[] = {
+    DEFINE_PROP_UINT64("bandwidth", NocPerfPort, cfg.bandwidth, 0),
+    DEFINE_PROP_UINT32("latency", NocPerfPort, cfg.latency, 0),
+    DEFINE_PROP_UINT8("qos", NocPerfPort, cfg.qos, 0),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void noc_perf_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->reset = noc_perf_reset;
+    dc->realize = noc_perf_realize;
+    device_class_set_props(dc, noc_perf_properties);
+}
+
+static const TypeInfo noc_perf_info = {
+    .name          = TYPE_XLNX_NOC_PERF_PORT,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(NocPerfPort),
+    .class_init    = noc_perf_class_init,
+    .instance_init = noc_perf_init,
+};
+
+static void noc_perf_register_types(void)
+{
+    type_register_static(&noc_perf_info);
+}
+
+type_init(noc_perf_register_types)
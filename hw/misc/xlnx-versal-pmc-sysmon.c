@@ -24,12 +24,30 @@
  * THE SOFTWARE.
  */
 
+/*
+ * The sensors follow traces pushed by the host through the
+ * "temperature-trace" and "supplyN-trace" properties, for example
+ *
+ *   qom-set path=/machine/.../sysmon property=temperature-trace
+ *           value="0:0x9a00,5000000:0xa400"
+ *
+ * Each sample is "NS:VALUE", with NS the QEMU_CLOCK_VIRTUAL time relative
+ * to the qom-set.  Nothing runs as time passes: the samples that are due
+ * are applied when the guest reads the sensor or alarm registers, and the
+ * only timer is armed for the next sample that would raise an unmasked
+ * alarm.
+ */
+
 #include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
 #include "hw/sysbus.h"
 #include "hw/register.h"
 #include "hw/irq.h"
 #include "qemu/bitops.h"
+#include "qemu/cutils.h"
 #include "qemu/log.h"
+#include "qemu/timer.h"
 #include "migration/vmstate.h"
 #include "hw/qdev-properties.h"
 
@@ -244,15 +262,40 @@ REG32(ABUS_SWITCH1415, 0x394)
 
 #define SYSMON_R_MAX (R_ABUS_SWITCH1415 + 1)
 
-typedef struct PMCSysMon {
+/*
+ * TEMPERATURE and SUPPLY0..6, the registers of sensor N are at
+ * R_TEMPERATURE + N, R_TEMPERATURE_MAX + N and so on.  Sensor N drives
+ * ALARM bit N.
+ */
+#define SYSMON_NUM_SENSORS 8
+
+typedef struct PMCSysMon PMCSysMon;
+
+typedef struct SysMonSample {
+    int64_t time;
+    uint16_t val;
+} SysMonSample;
+
+typedef struct SysMonSensor {
+    PMCSysMon *s;
+    char *trace;
+    SysMonSample *samples;
+    unsigned int nr_samples;
+    unsigned int cur;       /* The samples before @cur have been applied */
+} SysMonSensor;
+
+struct PMCSysMon {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
     qemu_irq irq_sysmon_alarm_imr;
     qemu_irq irq_sysmon_ot_imr;
 
+    SysMonSensor sensors[SYSMON_NUM_SENSORS];
+    QEMUTimer *alarm_timer;
+
     uint32_t regs[SYSMON_R_MAX];
     RegisterInfo regs_info[SYSMON_R_MAX];
-} PMCSysMon;
+};
 
 static void sysmon_alarm_imr_update_irq(PMCSysMon *s)
 {
@@ -260,10 +303,90 @@ static void sysmon_alarm_imr_update_irq(PMCSysMon *s)
     qemu_set_irq(s->irq_sysmon_alarm_imr, pending);
 }
 
+static bool sysmon_out_of_range(PMCSysMon *s, unsigned int i, uint16_t val)
+{
+    return val > s->regs[R_TEMPERATURE_TH_UPPER + i] ||
+           val < s->regs[R_TEMPERATURE_TH_LOWER + i];
+}
+
+static void sysmon_apply(PMCSysMon *s, unsigned int i, uint16_t val)
+{
+    s->regs[R_TEMPERATURE + i] = val;
+    s->regs[R_TEMPERATURE_MAX + i] = MAX(s->regs[R_TEMPERATURE_MAX + i], val);
+    s->regs[R_TEMPERATURE_MIN + i] = MIN(s->regs[R_TEMPERATURE_MIN + i], val);
+    if (sysmon_out_of_range(s, i, val)) {
+        s->regs[R_SYSMON_ALARM_ISR] |= 1 << i;
+    }
+}
+
+/*
+ * Catches the sensors up with the virtual clock, then arms the alarm
+ * timer for the first future sample that would raise an alarm the guest
+ * is waiting for.
+ */
+static void sysmon_update(PMCSysMon *s)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t next = INT64_MAX;
+    unsigned int i, j;
+
+    for (i = 0; i < SYSMON_NUM_SENSORS; i++) {
+        SysMonSensor *sn = &s->sensors[i];
+        uint32_t bit = 1 << i;
+
+        if (!sn->nr_samples) {
+            continue;
+        }
+        while (sn->cur < sn->nr_samples && sn->samples[sn->cur].time <= now) {
+            sysmon_apply(s, i, sn->samples[sn->cur++].val);
+        }
+        /* The thresholds may have moved since the last sample */
+        if (sn->cur) {
+            sysmon_apply(s, i, sn->samples[sn->cur - 1].val);
+        }
+
+        if ((s->regs[R_SYSMON_ALARM_ISR] | s->regs[R_SYSMON_ALARM_IMR]) & bit) {
+            continue;
+        }
+        for (j = sn->cur; j < sn->nr_samples; j++) {
+            if (sysmon_out_of_range(s, i, sn->samples[j].val)) {
+                next = MIN(next, sn->samples[j].time);
+                break;
+            }
+        }
+    }
+
+    sysmon_alarm_imr_update_irq(s);
+    if (next != INT64_MAX) {
+        timer_mod_ns(s->alarm_timer, next);
+    } else {
+        timer_del(s->alarm_timer);
+    }
+}
+
+static void sysmon_alarm_timer_cb(void *opaque)
+{
+    sysmon_update(PMC_SYSMON(opaque));
+}
+
+static uint64_t sysmon_sensor_postr(RegisterInfo *reg, uint64_t val64)
+{
+    PMCSysMon *s = PMC_SYSMON(reg->opaque);
+
+    sysmon_update(s);
+    return *(uint32_t *)reg->data & ~reg->access->rsvd;
+}
+
+static void sysmon_th_postw(RegisterInfo *reg, uint64_t val64)
+{
+    PMCSysMon *s = PMC_SYSMON(reg->opaque);
+    sysmon_update(s);
+}
+
 static void sysmon_alarm_isr_postw(RegisterInfo *reg, uint64_t val64)
 {
     PMCSysMon *s = PMC_SYSMON(reg->opaque);
-    sysmon_alarm_imr_update_irq(s);
+    sysmon_update(s);
 }
 
 static uint64_t sysmon_alarm_ien_prew(RegisterInfo *reg, uint64_t val64)
@@ -272,7 +395,7 @@ static uint64_t sysmon_alarm_ien_prew(RegisterInfo *reg, uint64_t val64)
     uint32_t val = val64;
 
     s->regs[R_SYSMON_ALARM_IMR] &= ~val;
-    sysmon_alarm_imr_update_irq(s);
+    sysmon_update(s);
     return 0;
 }
 
@@ -282,7 +405,7 @@ static uint64_t sysmon_alarm_ids_prew(RegisterInfo *reg, uint64_t val64)
     uint32_t val = val64;
 
     s->regs[R_SYSMON_ALARM_IMR] |= val;
-    sysmon_alarm_imr_update_irq(s);
+    sysmon_update(s);
     return 0;
 }
 
@@ -333,6 +456,7 @@ static const RegisterAccessInfo sysmon_regs_info[] = {
         .rsvd = 0xffffff00,
         .w1c = 0xff,
         .post_write = sysmon_alarm_isr_postw,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SYSMON_ALARM_IMR",  .addr = A_SYSMON_ALARM_IMR,
         .rsvd = 0xffffff00,
         .w1c = 0xff,
@@ -362,83 +486,107 @@ static const RegisterAccessInfo sysmon_regs_info[] = {
     },{ .name = "TEMPERATURE",  .addr = A_TEMPERATURE,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY0",  .addr = A_SUPPLY0,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY1",  .addr = A_SUPPLY1,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY2",  .addr = A_SUPPLY2,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY3",  .addr = A_SUPPLY3,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY4",  .addr = A_SUPPLY4,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY5",  .addr = A_SUPPLY5,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY6",  .addr = A_SUPPLY6,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "TEMPERATURE_MAX",  .addr = A_TEMPERATURE_MAX,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY0_MAX",  .addr = A_SUPPLY0_MAX,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY1_MAX",  .addr = A_SUPPLY1_MAX,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY2_MAX",  .addr = A_SUPPLY2_MAX,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY3_MAX",  .addr = A_SUPPLY3_MAX,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY4_MAX",  .addr = A_SUPPLY4_MAX,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY5_MAX",  .addr = A_SUPPLY5_MAX,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY6_MAX",  .addr = A_SUPPLY6_MAX,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "TEMPERATURE_MIN",  .addr = A_TEMPERATURE_MIN,
         .reset = 0xffff,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY0_MIN",  .addr = A_SUPPLY0_MIN,
         .reset = 0xffff,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY1_MIN",  .addr = A_SUPPLY1_MIN,
         .reset = 0xffff,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY2_MIN",  .addr = A_SUPPLY2_MIN,
         .reset = 0xffff,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY3_MIN",  .addr = A_SUPPLY3_MIN,
         .reset = 0xffff,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY4_MIN",  .addr = A_SUPPLY4_MIN,
         .reset = 0xffff,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY5_MIN",  .addr = A_SUPPLY5_MIN,
         .reset = 0xffff,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "SUPPLY6_MIN",  .addr = A_SUPPLY6_MIN,
         .reset = 0xffff,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sensor_postr,
     },{ .name = "CAL_0",  .addr = A_CAL_0,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
@@ -485,36 +633,52 @@ static const RegisterAccessInfo sysmon_regs_info[] = {
     },{ .name = "SEQUENCE_ACQUISITION",  .addr = A_SEQUENCE_ACQUISITION,
     },{ .name = "TEMPERATURE_TH_UPPER",  .addr = A_TEMPERATURE_TH_UPPER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY0_TH_UPPER",  .addr = A_SUPPLY0_TH_UPPER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY1_TH_UPPER",  .addr = A_SUPPLY1_TH_UPPER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY2_TH_UPPER",  .addr = A_SUPPLY2_TH_UPPER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY3_TH_UPPER",  .addr = A_SUPPLY3_TH_UPPER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY4_TH_UPPER",  .addr = A_SUPPLY4_TH_UPPER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY5_TH_UPPER",  .addr = A_SUPPLY5_TH_UPPER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY6_TH_UPPER",  .addr = A_SUPPLY6_TH_UPPER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "TEMPERATURE_TH_LOWER",  .addr = A_TEMPERATURE_TH_LOWER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY0_TH_LOWER",  .addr = A_SUPPLY0_TH_LOWER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY1_TH_LOWER",  .addr = A_SUPPLY1_TH_LOWER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY2_TH_LOWER",  .addr = A_SUPPLY2_TH_LOWER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY3_TH_LOWER",  .addr = A_SUPPLY3_TH_LOWER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY4_TH_LOWER",  .addr = A_SUPPLY4_TH_LOWER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY5_TH_LOWER",  .addr = A_SUPPLY5_TH_LOWER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "SUPPLY6_TH_LOWER",  .addr = A_SUPPLY6_TH_LOWER,
         .rsvd = 0xffff0000,
+        .post_write = sysmon_th_postw,
     },{ .name = "ABUS_SWITCH01",  .addr = A_ABUS_SWITCH01,
     },{ .name = "ABUS_SWITCH23",  .addr = A_ABUS_SWITCH23,
     },{ .name = "ABUS_SWITCH45",  .addr = A_ABUS_SWITCH45,
@@ -535,10 +699,80 @@ static void sysmon_reset(DeviceState *dev)
         register_reset(&s->regs_info[i]);
     }
 
-    sysmon_alarm_imr_update_irq(s);
+    sysmon_update(s);
     sysmon_ot_imr_update_irq(s);
 }
 
+static void sysmon_get_trace(Object *obj, Visitor *v, const char *name,
+                             void *opaque, Error **errp)
+{
+    SysMonSensor *sn = opaque;
+    char *trace = g_strdup(sn->trace ? sn->trace : "");
+
+    visit_type_str(v, name, &trace, errp);
+    g_free(trace);
+}
+
+static void sysmon_set_trace(Object *obj, Visitor *v, const char *name,
+                             void *opaque, Error **errp)
+{
+    SysMonSensor *sn = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    Error *local_err = NULL;
+    SysMonSample *samples;
+    char **elems = NULL;
+    char *trace;
+    unsigned int i, n;
+
+    visit_type_str(v, name, &trace, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+
+    elems = g_strsplit(trace, ",", 0);
+    n = *trace ? g_strv_length(elems) : 0;
+    samples = g_new(SysMonSample, n);
+    for (i = 0; i < n; i++) {
+        const char *end;
+        int64_t t;
+        uint64_t val;
+
+        if (qemu_strtoi64(elems[i], &end, 10, &t) < 0 || *end != ':' ||
+            qemu_strtou64(end + 1, NULL, 0, &val) < 0) {
+            error_setg(errp, "%s: sample '%s' is not NS:VALUE", name, elems[i]);
+            goto fail;
+        }
+        if (t < 0 || (i && t < samples[i - 1].time - now)) {
+            error_setg(errp, "%s: sample times must not be negative or "
+                       "go backwards", name);
+            goto fail;
+        }
+        if (val > 0xffff) {
+            error_setg(errp, "%s: sample value 0x%" PRIx64 " is not 16 bits",
+                       name, val);
+            goto fail;
+        }
+        samples[i].time = now + t;
+        samples[i].val = val;
+    }
+
+    g_strfreev(elems);
+    g_free(sn->trace);
+    g_free(sn->samples);
+    sn->trace = trace;
+    sn->samples = samples;
+    sn->nr_samples = n;
+    sn->cur = 0;
+    sysmon_update(sn->s);
+    return;
+
+fail:
+    g_strfreev(elems);
+    g_free(samples);
+    g_free(trace);
+}
+
 static const MemoryRegionOps sysmon_ops = {
     .read = register_read_memory,
     .write = register_write_memory,
@@ -559,6 +793,7 @@ static void sysmon_init(Object *obj)
     PMCSysMon *s = PMC_SYSMON(obj);
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
     RegisterInfoArray *reg_array;
+    unsigned int i;
 
     memory_region_init(&s->iomem, obj, TYPE_PMC_SYSMON, SYSMON_R_MAX * 4);
     reg_array =
@@ -574,12 +809,44 @@ static void sysmon_init(Object *obj)
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->irq_sysmon_alarm_imr);
     sysbus_init_irq(sbd, &s->irq_sysmon_ot_imr);
+
+    s->alarm_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                  sysmon_alarm_timer_cb, s);
+    for (i = 0; i < SYSMON_NUM_SENSORS; i++) {
+        SysMonSensor *sn = &s->sensors[i];
+        char *name = i ? g_strdup_printf("supply%u-trace", i - 1)
+                       : g_strdup("temperature-trace");
+
+        sn->s = s;
+        object_property_add(obj, name, "str",
+                            sysmon_get_trace, sysmon_set_trace, NULL, sn);
+        g_free(name);
+    }
+}
+
+static void sysmon_finalize(Object *obj)
+{
+    PMCSysMon *s = PMC_SYSMON(obj);
+    unsigned int i;
+
+    timer_free(s->alarm_timer);
+    for (i = 0; i < SYSMON_NUM_SENSORS; i++) {
+        g_free(s->sensors[i].trace);
+        g_free(s->sensors[i].samples);
+    }
+}
+
+static int sysmon_post_load(void *opaque, int version_id)
+{
+    sysmon_update(opaque);
+    return 0;
 }
 
 static const VMStateDescription vmstate_sysmon = {
     .name = TYPE_PMC_SYSMON,
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = sysmon_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, PMCSysMon, SYSMON_R_MAX),
         VMSTATE_END_OF_LIST(),
@@ -601,6 +868,7 @@ static const TypeInfo sysmon_info = {
     .instance_size = sizeof(PMCSysMon),
     .class_init    = sysmon_class_init,
     .instance_init = sysmon_init,
+    .instance_finalize = sysmon_finalize,
 };
 
 static void sysmon_register_types(void)
@@ -462,6 +462,11 @@ static void rpu_setup_tcm(RPU *s)
     DPRINTF("%s: sl_clamp=%d sl_split=%d tcm_combine=%d\n",
              __func__, sl_clamp, sl_split, tcm_combine);
 
+    /*
+     * Each alias toggle is a separate topology change and flushes the
+     * TLBs of every vCPU. Commit them as one.
+     */
+    memory_region_transaction_begin();
     if (tcm_combine) {
         memory_region_set_enabled(&s->tcm_A1_alias[0], true);
         memory_region_set_enabled(&s->tcm_A1_alias[1], false);
@@ -473,6 +478,7 @@ static void rpu_setup_tcm(RPU *s)
         memory_region_set_enabled(&s->tcm_B1_alias[0], false);
         memory_region_set_enabled(&s->tcm_B1_alias[1], true);
     }
+    memory_region_transaction_commit();
 
     /* Catch a few invalid combinations.  */
     if (sl_split) {
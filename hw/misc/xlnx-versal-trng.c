@@ -29,7 +29,9 @@
 #include "hw/sysbus.h"
 #include "hw/register.h"
 #include "qemu/bitops.h"
+#include "qemu/guest-random.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "migration/vmstate.h"
 #include "hw/qdev-properties.h"
 #include "hw/irq.h"
@@ -113,6 +115,14 @@ REG32(SLV_ERR_CTRL, 0xf0)
 
 #define R_MAX (R_SLV_ERR_CTRL + 1)
 
+/*
+ * Output is generated ahead in blocks, into a FIFO that a bottom half
+ * tops up once it is half empty.  The words come out in generation
+ * order whenever the refill runs, so a given seed always yields the
+ * same stream.
+ */
+#define TRNG_POOL_WORDS 1024
+
 typedef struct TRNG {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
@@ -122,7 +132,12 @@ typedef struct TRNG {
      * to be indicated in the status reg.  */
     uint32_t out[7];
     uint32_t count;
-    unsigned int seed;
+
+    GRand *rand;
+    QEMUBH *refill_bh;
+    uint32_t pool[TRNG_POOL_WORDS];
+    unsigned int pool_head;
+    unsigned int pool_len;
 
     uint32_t regs[R_MAX];
     RegisterInfo regs_info[R_MAX];
@@ -186,23 +201,58 @@ static void trng_done(TRNG *s)
     trng_imr_update_irq(s);
 }
 
-static inline void trng_reseed(TRNG *s, bool ext)
+static void trng_pool_fill(TRNG *s)
 {
-    int i;
+    while (s->pool_len < TRNG_POOL_WORDS) {
+        unsigned int i = (s->pool_head + s->pool_len) % TRNG_POOL_WORDS;
 
-    /* Accumulate the seed regs and the personalization string.  */
-    s->seed = 0;
+        s->pool[i] = g_rand_int(s->rand);
+        s->pool_len++;
+    }
+}
 
-    for (i = 0; i < 12; i++) {
-        s->seed += s->regs[R_PER_STRNG_0 + i];
+static void trng_refill_bh(void *opaque)
+{
+    trng_pool_fill(opaque);
+}
+
+static uint32_t trng_pool_take(TRNG *s)
+{
+    uint32_t r;
+
+    if (!s->pool_len) {
+        /* The guest drained the pool before the bottom half ran */
+        trng_pool_fill(s);
     }
+    r = s->pool[s->pool_head];
+    s->pool_head = (s->pool_head + 1) % TRNG_POOL_WORDS;
+    s->pool_len--;
 
-    if (ext) {
-        for (i = 0; i < 12; i++) {
-            s->seed += s->regs[R_EXT_SEED_0 + i];
-        }
+    if (s->pool_len == TRNG_POOL_WORDS / 2) {
+        qemu_bh_schedule(s->refill_bh);
     }
-    srand(s->seed);
+    return r;
+}
+
+static void trng_pool_reseed(TRNG *s, const guint32 *seed, guint len)
+{
+    g_rand_set_seed_array(s->rand, seed, len);
+    s->pool_head = 0;
+    s->pool_len = 0;
+    qemu_bh_schedule(s->refill_bh);
+}
+
+static inline void trng_reseed(TRNG *s, bool ext)
+{
+    guint32 seed[24];
+    int i;
+
+    /* Seed with the personalization string and the seed regs.  */
+    for (i = 0; i < 12; i++) {
+        seed[i] = s->regs[R_PER_STRNG_0 + i];
+        seed[i + 12] = s->regs[R_EXT_SEED_0 + i];
+    }
+    trng_pool_reseed(s, seed, ext ? 24 : 12);
 }
 
 static inline void trng_regen(TRNG *s)
@@ -211,7 +261,7 @@ static inline void trng_regen(TRNG *s)
 
     /* Re-gen.  */
     for (i = 0; i < ARRAY_SIZE(s->out); i++) {
-        s->out[i] = rand();
+        s->out[i] = trng_pool_take(s);
     }
 
     s->count = ARRAY_SIZE(s->out);
@@ -344,7 +394,14 @@ static const MemoryRegionOps trng_ops = {
 
 static void trng_realize(DeviceState *dev, Error **errp)
 {
-    /* Delete this if not necessary */
+    TRNG *s = XILINX_TRNG(dev);
+    guint32 seed;
+
+    /* Until the guest seeds it, follow -seed or the host's entropy.  */
+    qemu_guest_getrandom_nofail(&seed, sizeof(seed));
+    s->rand = g_rand_new_with_seed(seed);
+    s->refill_bh = qemu_bh_new(trng_refill_bh, s);
+    trng_pool_fill(s);
 }
 
 static void trng_init(Object *obj)
@@ -367,11 +424,25 @@ static void trng_init(Object *obj)
     sysbus_init_irq(sbd, &s->irq_int_imr);
 }
 
+static int trng_post_load(void *opaque, int version_id)
+{
+    TRNG *s = XILINX_TRNG(opaque);
+    guint32 seed;
+
+    s->count = ARRAY_FIELD_EX32(s->regs, STATUS, QCNT);
+
+    /* The generator state does not migrate, carry on from a fresh seed.  */
+    qemu_guest_getrandom_nofail(&seed, sizeof(seed));
+    trng_pool_reseed(s, &seed, 1);
+    return 0;
+}
+
 static const VMStateDescription vmstate_trng = {
     .name = TYPE_XILINX_TRNG,
     .version_id = 1,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = trng_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(out, TRNG, 7),
         VMSTATE_UINT32_ARRAY(regs, TRNG, R_MAX),
@@ -39,18 +39,65 @@
 
 #include "hw/misc/xlnx-xmpu.h"
 
+/*
+ * Decoding the regions takes a dozen register reads each, so keep the
+ * decoded table around until the registers change.
+ */
+static const XMPURegion *xmpu_get_regions(XMPU *s)
+{
+    unsigned int i;
+
+    if (s->regions_valid) {
+        return s->regions;
+    }
+
+    for (i = 0; i < NR_XMPU_REGIONS; i++) {
+        XMPURegion *xr = &s->regions[i];
+
+        s->decode_region(s, xr, i);
+        if (!xr->config.enable) {
+            continue;
+        }
+
+        if (xr->start & s->addr_mask) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: Bad region start address %" PRIx64 "\n",
+                          s->prefix, xr->start);
+        }
+
+        if (xr->end & s->addr_mask) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: Bad region end address %" PRIx64 "\n",
+                           s->prefix, xr->end);
+        }
+
+        if (xr->start < s->addr_mask) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: Too low region start address %" PRIx64 "\n",
+                           s->prefix, xr->end);
+        }
+
+        xr->start &= ~s->addr_mask;
+        xr->end &= ~s->addr_mask;
+    }
+    s->regions_valid = true;
+    return s->regions;
+}
+
 void xmpu_update_enabled(XMPU *s)
 {
+    const XMPURegion *regions;
     bool regions_enabled = false;
     bool default_wr = ARRAY_FIELD_EX32(s->regs, CTRL, DEFWRALLOWED);
     bool default_rd = ARRAY_FIELD_EX32(s->regs, CTRL, DEFRDALLOWED);
     int i;
 
+    s->regions_valid = false;
+    regions = xmpu_get_regions(s);
+
     /* Lookup if this address fits a region.  */
     for (i = NR_XMPU_REGIONS - 1; i >= 0; i--) {
-        XMPURegion xr;
-        s->decode_region(s, &xr, i);
-        if (!xr.config.enable) {
+        if (!regions[i].config.enable) {
             continue;
         }
         regions_enabled = true;
@@ -89,6 +136,12 @@ void xmpu_flush(XMPU *s)
     }
 }
 
+int xmpu_post_load(void *opaque, int version_id)
+{
+    xmpu_flush(opaque);
+    return 0;
+}
+
 MemTxResult xmpu_read_common(void *opaque, XMPU *s, hwaddr addr, uint64_t *val,
                              unsigned size, MemTxAttrs attr)
 {
@@ -132,6 +185,7 @@ MemTxResult xmpu_write_common(void *opaque, XMPU *s, hwaddr addr, uint64_t val,
         return MEMTX_DECODE_ERROR;
     }
     register_write_memory(opaque, addr, val, size);
+    s->regions_valid = false;
 
     return MEMTX_OK;
 }
@@ -153,7 +207,7 @@ IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
                                     bool *sec_vio, int *perm)
 {
     XMPU *s = xm->parent;
-    XMPURegion xr;
+    const XMPURegion *regions;
     IOMMUTLBEntry ret = {
         .iova = addr,
         .translated_addr = addr,
@@ -185,39 +239,19 @@ IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
     addr += s->cfg.base;
 
     /* Lookup if this address fits a region.  */
+    regions = xmpu_get_regions(s);
     for (i = NR_XMPU_REGIONS - 1; i >= 0; i--) {
+        const XMPURegion *xr = &regions[i];
         bool id_match;
         bool match;
 
-        s->decode_region(s, &xr, i);
-        if (!xr.config.enable) {
+        if (!xr->config.enable) {
             continue;
         }
 
-        if (xr.start & s->addr_mask) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Bad region start address %" PRIx64 "\n",
-                          s->prefix, xr.start);
-        }
-
-        if (xr.end & s->addr_mask) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Bad region end address %" PRIx64 "\n",
-                           s->prefix, xr.end);
-        }
-
-        if (xr.start < s->addr_mask) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Too low region start address %" PRIx64 "\n",
-                           s->prefix, xr.end);
-        }
-
-        xr.start &= ~s->addr_mask;
-        xr.end &= ~s->addr_mask;
-
-        id_match = (xr.master.mask & xr.master.id) ==
-                       (xr.master.mask & master_id);
-        match = id_match && (addr >= xr.start && addr < xr.end);
+        id_match = (xr->master.mask & xr->master.id) ==
+                       (xr->master.mask & master_id);
+        match = id_match && (addr >= xr->start && addr < xr->end);
         if (match) {
             nr_matched++;
             xm->curr_region = i;
@@ -225,25 +259,25 @@ IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
              * Determine if this region is accessible by the transactions
              * security domain.
              */
-            if (xr.config.nschecktype) {
+            if (xr->config.nschecktype) {
                 /*
                  * In strict mode, secure accesses are not allowed to
                  * non-secure regions (and vice-versa).
                  */
-                sec_access_check = (sec != xr.config.regionns);
+                sec_access_check = (sec != xr->config.regionns);
             } else {
                 /*
                  * In relaxed mode secure accesses can access any region
                  * while non-secure can only access non-secure areas.
                  */
-                sec_access_check = (sec || xr.config.regionns);
+                sec_access_check = (sec || xr->config.regionns);
             }
 
             if (sec_access_check) {
-                if (xr.config.rdallowed) {
+                if (xr->config.rdallowed) {
                     ret.perm |= IOMMU_RO;
                 }
-                if (xr.config.wrallowed) {
+                if (xr->config.wrallowed) {
                     ret.perm |= IOMMU_WO;
                 }
             } else {
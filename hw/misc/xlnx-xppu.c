@@ -29,10 +29,12 @@
 #include "hw/sysbus.h"
 #include "hw/register.h"
 #include "qemu/bitops.h"
+#include "qemu/units.h"
 #include "qemu/log.h"
 #include "hw/irq.h"
 #include "qapi/error.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "migration/vmstate.h"
 #include "hw/qdev-properties.h"
 
@@ -92,7 +94,7 @@ void check_mid_parities(XPPU *s)
     }
 }
 
-bool check_apl_parity(XPPU *s, uint32_t val32)
+static bool apl_parity_ok(XPPU *s, uint32_t val32)
 {
     unsigned int i;
     /*
@@ -108,7 +110,6 @@ bool check_apl_parity(XPPU *s, uint32_t val32)
         (0x1f << 15) | 1 << 27,
     };
     uint32_t p = 0, p_written;
-    bool ok;
 
     if (!ARRAY_FIELD_EX32(s->regs, CTRL, APER_PARITY_EN)) {
         return true;
@@ -125,7 +126,12 @@ bool check_apl_parity(XPPU *s, uint32_t val32)
     }
 
     p_written = val32 >> 28;
-    ok = p_written == p;
+    return p_written == p;
+}
+
+bool check_apl_parity(XPPU *s, uint32_t val32)
+{
+    bool ok = apl_parity_ok(s, val32);
 
     if (!ok) {
         qemu_log_mask(LOG_GUEST_ERROR, "Bad APL parity!\n");
@@ -142,6 +148,167 @@ void update_mrs(XPPU *s)
     for (i = 0; i < s->num_ap; i++) {
         memory_region_set_enabled(&s->ap[i].iomem, xppu_enabled);
     }
+    xppu_perm_changed(s);
+}
+
+static uint64_t xppu_granule_size(XPPUGranule granule)
+{
+    switch (granule) {
+    case GRANULE_32B:
+        return 32;
+    case GRANULE_64K:
+        return 64 * KiB;
+    case GRANULE_1M:
+        return 1 * MiB;
+    case GRANULE_512M:
+        return 512 * MiB;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static uint32_t xppu_ap_ram_offset(XPPUAperture *ap, hwaddr addr)
+{
+    return ((addr & ap->extract_mask) >> ap->extract_shift) + ap->ram_base;
+}
+
+/*
+ * Whether every access to a granule with this APL passes the check without
+ * side effects. That is the case when the first MID entry it enables
+ * matches any master with write permission and good parity.
+ */
+static bool xppu_apl_open(XPPU *s, uint32_t apl)
+{
+    unsigned int i;
+
+    if (!extract32(apl, 27, 1) || !apl_parity_ok(s, apl)) {
+        return false;
+    }
+
+    for (i = 0; i < NR_MID_ENTRIES; i++) {
+        uint32_t val32 = s->regs[R_MASTER_ID00 + i];
+
+        if (!extract32(apl, i, 1)) {
+            continue;
+        }
+        return !FIELD_EX32(val32, MASTER_ID00, MIDM) &&
+               !FIELD_EX32(val32, MASTER_ID00, MIDR) &&
+               check_mid_parity(s, val32);
+    }
+    return false;
+}
+
+static void xppu_passthrough_update(void *opaque)
+{
+    XPPU *s = opaque;
+    unsigned int i, e;
+
+    /* Aliasing into our own address space would recurse.  */
+    if (!s->mr) {
+        return;
+    }
+
+    memory_region_transaction_begin();
+    for (i = 0; i < s->num_ap; i++) {
+        XPPUAperture *ap = &s->ap[i];
+        uint64_t gsize = xppu_granule_size(ap->granule);
+
+        if (!ap->parent) {
+            continue;
+        }
+
+        if (!ap->passthrough) {
+            ap->nr_passthrough = memory_region_size(&ap->iomem) / gsize;
+            ap->passthrough = g_new0(MemoryRegion, ap->nr_passthrough);
+            for (e = 0; e < ap->nr_passthrough; e++) {
+                memory_region_init_alias(&ap->passthrough[e], OBJECT(s),
+                                         "xppu-passthrough", s->mr,
+                                         ap->base + e * gsize, gsize);
+                memory_region_set_enabled(&ap->passthrough[e], false);
+                memory_region_add_subregion_overlap(&ap->iomem, e * gsize,
+                                                    &ap->passthrough[e], 1);
+            }
+        }
+
+        for (e = 0; e < ap->nr_passthrough; e++) {
+            hwaddr addr = ap->base + e * gsize;
+            uint32_t apl = s->perm_ram[xppu_ap_ram_offset(ap, addr)];
+            bool open = xppu_apl_open(s, apl);
+
+            memory_region_set_enabled(&ap->passthrough[e], open);
+            ap->passthrough_active |= open;
+        }
+    }
+    memory_region_transaction_commit();
+}
+
+void xppu_perm_changed(XPPU *s)
+{
+    unsigned int i, e;
+
+    if (++s->perm_gen == 0) {
+        memset(s->perm_cache, 0, sizeof(s->perm_cache));
+        s->perm_gen = 1;
+    }
+
+    /*
+     * Shutting the bypass has to happen right away, opening it again can
+     * wait for the burst of configuration writes to settle.
+     */
+    memory_region_transaction_begin();
+    for (i = 0; i < s->num_ap; i++) {
+        XPPUAperture *ap = &s->ap[i];
+
+        if (!ap->passthrough_active) {
+            continue;
+        }
+        for (e = 0; e < ap->nr_passthrough; e++) {
+            memory_region_set_enabled(&ap->passthrough[e], false);
+        }
+        ap->passthrough_active = false;
+    }
+    memory_region_transaction_commit();
+
+    if (s->passthrough_bh) {
+        qemu_bh_schedule(s->passthrough_bh);
+    }
+}
+
+bool xppu_perm_check(XPPU *s, MemTxAttrs attr, bool rw, uint32_t ram_offset)
+{
+    uint8_t flags = (attr.secure ? 1 : 0) | (rw ? 2 : 0);
+    XPPUPermCacheEntry *ce;
+    uint32_t isr;
+    bool valid;
+
+    ce = &s->perm_cache[(ram_offset ^ (attr.requester_id << 2) ^ flags) %
+                        XPPU_PERM_CACHE_SIZE];
+    if (ce->gen == s->perm_gen && ce->ram_offset == ram_offset &&
+        ce->requester_id == attr.requester_id && ce->flags == flags) {
+        return true;
+    }
+
+    isr = s->regs[R_ISR];
+    valid = xppu_ap_check(s, attr, rw, s->perm_ram[ram_offset]);
+
+    /* Only clean passes can be replayed, anything else updates the ISR.  */
+    if (valid && s->regs[R_ISR] == isr) {
+        *ce = (XPPUPermCacheEntry) {
+            .gen = s->perm_gen,
+            .ram_offset = ram_offset,
+            .requester_id = attr.requester_id,
+            .flags = flags,
+        };
+    }
+    return valid;
+}
+
+int xppu_post_load(void *opaque, int version_id)
+{
+    XPPU *s = opaque;
+
+    update_mrs(s);
+    return 0;
 }
 
 bool xppu_ap_check(XPPU *s, MemTxAttrs attr, bool rw, uint32_t apl)
@@ -250,6 +417,7 @@ MemTxResult xppu_write_common(void *opaque, XPPU *s, hwaddr addr, uint64_t val,
     }
 
     register_write_memory(opaque, addr, val, size);
+    xppu_perm_changed(s);
     return MEMTX_OK;
 }
 
@@ -273,6 +441,7 @@ MemTxResult xppu_perm_ram_write_common(XPPU *s, hwaddr addr, uint64_t val,
     }
 
     s->perm_ram[i] = val;
+    xppu_perm_changed(s);
     return MEMTX_OK;
 }
 
@@ -322,6 +491,8 @@ void xppu_init_common(XPPU *s, Object *obj, const char *tn,
                              OBJ_PROP_LINK_STRONG);
 
     sysbus_init_irq(sbd, &s->irq_isr);
+    s->perm_gen = 1;
+    s->passthrough_bh = qemu_bh_new(xppu_passthrough_update, s);
 }
 
 bool xppu_parse_reg_common(XPPU *s, const char *tn, FDTGenericRegPropInfo reg,
@@ -787,6 +787,7 @@ static const VMStateDescription vmstate_xmpu = {
     .name = TYPE_XILINX_XMPU,
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = xmpu_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, XMPU, XMPU_VERSAL_R_MAX),
         VMSTATE_END_OF_LIST(),
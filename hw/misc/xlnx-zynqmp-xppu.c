@@ -257,7 +257,6 @@ static void xppu_ap_access(void *opaque, hwaddr addr, uint64_t *value, bool rw,
     XPPUAperture *ap = opaque;
     XPPU *s = ap->parent;
     uint32_t ram_offset;
-    uint32_t apl;
     bool valid;
     bool isr_free;
     bool xppu_enabled = ARRAY_FIELD_EX32(s->regs, CTRL, ENABLE);
@@ -273,8 +272,7 @@ static void xppu_ap_access(void *opaque, hwaddr addr, uint64_t *value, bool rw,
     ram_offset >>= ap->extract_shift;
 
     ram_offset += ap->ram_base;
-    apl = s->perm_ram[ram_offset];
-    valid = xppu_ap_check(s, attr, rw, apl);
+    valid = xppu_perm_check(s, attr, rw, ram_offset);
 
     if (!valid) {
         if (isr_free) {
@@ -413,7 +411,7 @@ static void xppu_init(Object *obj)
     XPPU *s = XILINX_XPPU(obj);
 
     s->num_ap = 4;
-    s->ap = g_new(XPPUAperture, s->num_ap);
+    s->ap = g_new0(XPPUAperture, s->num_ap);
 
     xppu_init_common(s, obj, TYPE_XILINX_XPPU, &xppu_ops, &xppu_perm_ram_ops,
                      xppu_regs_info, ARRAY_SIZE(xppu_regs_info));
@@ -470,6 +468,7 @@ static const VMStateDescription vmstate_xppu = {
     .name = TYPE_XILINX_XPPU,
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = xppu_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, XPPU, XPPU_R_MAX),
         VMSTATE_END_OF_LIST(),
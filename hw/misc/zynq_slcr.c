@@ -415,8 +415,11 @@ static void zynq_slcr_compute_clocks(ZynqSLCRState *s)
  */
 static void zynq_slcr_propagate_clocks(ZynqSLCRState *s)
 {
+    /* Users see both new periods by the time they are notified */
+    clock_transaction_begin();
     clock_propagate(s->uart0_ref_clk);
     clock_propagate(s->uart1_ref_clk);
+    clock_transaction_commit();
 }
 
 static void zynq_slcr_ps_clk_callback(void *opaque)
@@ -36,6 +36,8 @@
 #include "net/checksum.h"
 #include "net/eth.h"
 #include "exec/address-spaces.h"
+#include "qemu/iov.h"
+#include "qemu/rcu.h"
 
 #define CADENCE_GEM_ERR_DEBUG 0
 #define DB_PRINT(...) do {\
@@ -63,6 +65,7 @@
 #define GEM_TXPAUSE       (0x0000003C/4) /* TX Pause Time reg */
 #define GEM_TXPARTIALSF   (0x00000040/4) /* TX Partial Store and Forward */
 #define GEM_RXPARTIALSF   (0x00000044/4) /* RX Partial Store and Forward */
+#define GEM_INTMOD        (0x0000005C/4) /* Interrupt Moderation reg */
 #define GEM_HASHLO        (0x00000080/4) /* Hash Low address reg */
 #define GEM_HASHHI        (0x00000084/4) /* Hash High address reg */
 #define GEM_SPADDR1LO     (0x00000088/4) /* Specific addr 1 low reg */
@@ -237,6 +240,11 @@
 #define GEM_INT_RXUSED         0x00000004
 #define GEM_INT_RXCMPL        0x00000002
 
+#define GEM_INTMOD_RX_SHIFT    0
+#define GEM_INTMOD_TX_SHIFT    16
+#define GEM_INTMOD_WIDTH       8
+#define GEM_INTMOD_UNIT_NS     800 /* One moderation tick at 1Gbps */
+
 #define GEM_PHYMNTNC_OP_R      0x20000000 /* read operation */
 #define GEM_PHYMNTNC_OP_W      0x10000000 /* write operation */
 #define GEM_PHYMNTNC_ADDR      0x0F800000 /* Address bits */
@@ -468,6 +476,7 @@ static void gem_init_register_masks(CadenceGEMState *s)
     s->regs_ro[GEM_ISR]      = 0xFFFFFFFF;
     s->regs_ro[GEM_IMR]      = 0xFFFFFFFF;
     s->regs_ro[GEM_MODID]    = 0xFFFFFFFF;
+    s->regs_ro[GEM_INTMOD]   = 0xFF00FF00;
     for (i = 0; i < s->num_priority_queues; i++) {
         s->regs_ro[GEM_INT_Q1_STATUS + i] = 0xFFFFFFFF;
         s->regs_ro[GEM_INT_Q1_ENABLE + i] = 0xFFFFE319;
@@ -563,13 +572,64 @@ static bool gem_can_receive(NetClientState *nc)
  */
 static void gem_update_int_status(CadenceGEMState *s)
 {
+    uint32_t held = 0;
     int i;
 
-    qemu_set_irq(s->irq[0], !!s->regs[GEM_ISR]);
+    /* Completions stay invisible while their moderation timer runs.  */
+    if (timer_pending(s->intmod_timer[0])) {
+        held |= GEM_INT_RXCMPL;
+    }
+    if (timer_pending(s->intmod_timer[1])) {
+        held |= GEM_INT_TXCMPL;
+    }
+
+    qemu_set_irq(s->irq[0], !!(s->regs[GEM_ISR] & ~held));
+
+    for (i = 1; i < s->num_priority_queues; ++i) {
+        qemu_set_irq(s->irq[i],
+                     !!(s->regs[GEM_INT_Q1_STATUS + i - 1] & ~held));
+    }
+}
+
+/*
+ * gem_int_moderate:
+ * Called before a completion interrupt is flagged. If the driver has set up
+ * interrupt moderation for that direction, the interrupt is held back until
+ * the moderation period that starts with this frame has passed.
+ */
+static void gem_int_moderate(CadenceGEMState *s, bool tx)
+{
+    uint32_t bit = tx ? GEM_INT_TXCMPL : GEM_INT_RXCMPL;
+    QEMUTimer *timer = s->intmod_timer[tx];
+    uint32_t ticks;
+    int i;
+
+    ticks = extract32(s->regs[GEM_INTMOD],
+                      tx ? GEM_INTMOD_TX_SHIFT : GEM_INTMOD_RX_SHIFT,
+                      GEM_INTMOD_WIDTH);
+    if (!ticks || timer_pending(timer)) {
+        return;
+    }
 
+    /* Don't hide an interrupt that the driver can already see.  */
+    if (s->regs[GEM_ISR] & bit) {
+        return;
+    }
     for (i = 1; i < s->num_priority_queues; ++i) {
-        qemu_set_irq(s->irq[i], !!s->regs[GEM_INT_Q1_STATUS + i - 1]);
+        if (s->regs[GEM_INT_Q1_STATUS + i - 1] & bit) {
+            return;
+        }
     }
+
+    timer_mod(timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                     (int64_t)ticks * GEM_INTMOD_UNIT_NS);
+}
+
+static void gem_intmod_expired(void *opaque)
+{
+    CadenceGEMState *s = opaque;
+
+    gem_update_int_status(s);
 }
 
 /*
@@ -873,6 +933,96 @@ static hwaddr gem_get_rx_desc_addr(CadenceGEMState *s, int q)
     return gem_get_desc_addr(s, false, q);
 }
 
+static hwaddr gem_get_ring_base(CadenceGEMState *s, bool tx, int q)
+{
+    hwaddr base = 0;
+
+    if (s->regs[GEM_DMACFG] & GEM_DMACFG_ADDR_64B) {
+        base = s->regs[tx ? GEM_TBQPH : GEM_RBQPH];
+    }
+    base <<= 32;
+    base |= gem_get_queue_base_addr(s, tx, q);
+    return base;
+}
+
+static void gem_ring_cache_flush(CadenceGEMRingCache *rc)
+{
+    if (rc->valid) {
+        address_space_cache_destroy(&rc->mrc);
+        rc->valid = false;
+    }
+    rc->len = 0;
+}
+
+static void gem_ring_cache_flush_all(CadenceGEMState *s)
+{
+    int i;
+
+    for (i = 0; i < MAX_PRIORITY_QUEUES; i++) {
+        gem_ring_cache_flush(&s->rx_ring[i]);
+        gem_ring_cache_flush(&s->tx_ring[i]);
+    }
+}
+
+/*
+ * gem_ring_cache:
+ * Return the mapped ring window covering [addr, addr + len), or NULL if
+ * the access has to go through the address space. The window starts at
+ * the queue base and is only used when it is plain RAM, which behaves the
+ * same whatever the bus attributes are.
+ */
+static CadenceGEMRingCache *gem_ring_cache(CadenceGEMState *s, bool tx, int q,
+                                           hwaddr addr, hwaddr len)
+{
+    CadenceGEMRingCache *rc = tx ? &s->tx_ring[q] : &s->rx_ring[q];
+
+    /* A new flatview means the memory map changed under us.  */
+    if (rc->valid && rc->mrc.fv != atomic_read(&s->dma_as.current_map)) {
+        gem_ring_cache_flush(rc);
+    }
+
+    if (!rc->valid) {
+        rc->base = gem_get_ring_base(s, tx, q);
+        rc->len = address_space_cache_init(&rc->mrc, &s->dma_as, rc->base,
+                                           GEM_RING_CACHE_SIZE, true);
+        rc->valid = true;
+        if (!rc->mrc.ptr) {
+            rc->len = 0;
+        }
+    }
+
+    if (addr < rc->base || addr - rc->base + len > rc->len) {
+        return NULL;
+    }
+    return rc;
+}
+
+static void gem_desc_read(CadenceGEMState *s, bool tx, int q, hwaddr addr,
+                          uint32_t *desc, unsigned words)
+{
+    CadenceGEMRingCache *rc = gem_ring_cache(s, tx, q, addr, words * 4);
+
+    if (rc) {
+        address_space_read_cached(&rc->mrc, addr - rc->base, desc, words * 4);
+    } else {
+        address_space_read(&s->dma_as, addr, *s->attr,
+                           (uint8_t *)desc, words * 4);
+    }
+}
+
+static void gem_desc_write(CadenceGEMState *s, bool tx, int q, hwaddr addr,
+                           uint32_t *desc, unsigned words)
+{
+    CadenceGEMRingCache *rc = gem_ring_cache(s, tx, q, addr, words * 4);
+
+    if (rc) {
+        address_space_write_cached(&rc->mrc, addr - rc->base, desc, words * 4);
+    } else {
+        address_space_write(&s->dma_as, addr, *s->attr,
+                            (uint8_t *)desc, words * 4);
+    }
+}
+
 static void gem_get_rx_desc(CadenceGEMState *s, int q)
 {
     hwaddr desc_addr = gem_get_rx_desc_addr(s, q);
@@ -880,9 +1030,8 @@ static void gem_get_rx_desc(CadenceGEMState *s, int q)
     DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", desc_addr);
 
     /* read current descriptor */
-    address_space_read(&s->dma_as, desc_addr, *s->attr,
-                     (uint8_t *)s->rx_desc[q],
-                     sizeof(uint32_t) * gem_get_desc_len(s, true));
+    gem_desc_read(s, false, q, desc_addr, s->rx_desc[q],
+                  gem_get_desc_len(s, true));
 
     /* Descriptor owned by software ? */
     if (rx_desc_get_ownership(s->rx_desc[q]) == 1) {
@@ -1048,10 +1197,8 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
 
         /* Descriptor write-back.  */
         desc_addr = gem_get_rx_desc_addr(s, q);
-        address_space_write(&s->dma_as, desc_addr,
-                            *s->attr,
-                            (uint8_t *)s->rx_desc[q],
-                            sizeof(uint32_t) * gem_get_desc_len(s, true));
+        gem_desc_write(s, false, q, desc_addr, s->rx_desc[q],
+                       gem_get_desc_len(s, true));
 
         /* Next descriptor */
         if (rx_desc_get_wrap(s->rx_desc[q])) {
@@ -1069,6 +1216,7 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
     gem_receive_updatestats(s, buf, size);
 
     s->regs[GEM_RXSTATUS] |= GEM_RXSTATUS_FRMRCVD;
+    gem_int_moderate(s, false);
     if (q == 0) {
         s->regs[GEM_ISR] |= GEM_INT_RXCMPL & ~(s->regs[GEM_IMR]);
     } else {
@@ -1127,6 +1275,100 @@ static void gem_transmit_updatestats(CadenceGEMState *s, const uint8_t *packet,
     }
 }
 
+/*
+ * gem_tx_map_frag:
+ * Map a TX fragment so that it can be handed to the net layer without
+ * copying it. Returns NULL if the fragment isn't entirely in RAM.
+ */
+static void *gem_tx_map_frag(CadenceGEMState *s, hwaddr addr, hwaddr len)
+{
+    MemoryRegion *mr;
+    hwaddr xlat, l = len;
+    void *p;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        mr = address_space_translate(&s->dma_as, addr, &xlat, &l, false,
+                                     *s->attr);
+        if (l < len || !memory_access_is_direct(mr, false)) {
+            return NULL;
+        }
+    }
+
+    l = len;
+    p = address_space_map(&s->dma_as, addr, &l, false, *s->attr);
+    if (p && l < len) {
+        address_space_unmap(&s->dma_as, p, l, false, 0);
+        p = NULL;
+    }
+    return p;
+}
+
+/*
+ * A frame being gathered for transmission. Fragments are either mapped
+ * guest RAM or copied into buf; copies that follow each other share an
+ * iovec entry. The last entry is kept for copies so that frames with lots
+ * of fragments still fit.
+ */
+#define GEM_TX_MAX_FRAGS 32
+
+typedef struct GEMTxFrame {
+    struct iovec iov[GEM_TX_MAX_FRAGS];
+    bool mapped[GEM_TX_MAX_FRAGS];
+    int niov;
+    uint8_t *p;
+    unsigned total_bytes;
+    uint8_t buf[10240];
+} GEMTxFrame;
+
+static void gem_tx_frame_init(GEMTxFrame *f)
+{
+    f->niov = 0;
+    f->p = f->buf;
+    f->total_bytes = 0;
+}
+
+static void gem_tx_frame_release(CadenceGEMState *s, GEMTxFrame *f)
+{
+    int i;
+
+    for (i = 0; i < f->niov; i++) {
+        if (f->mapped[i]) {
+            address_space_unmap(&s->dma_as, f->iov[i].iov_base,
+                                f->iov[i].iov_len, false, 0);
+        }
+    }
+    gem_tx_frame_init(f);
+}
+
+static void gem_tx_frame_add(CadenceGEMState *s, GEMTxFrame *f,
+                             hwaddr addr, unsigned len, bool zero_copy)
+{
+    struct iovec *last = f->niov ? &f->iov[f->niov - 1] : NULL;
+    void *map = NULL;
+
+    if (zero_copy && f->niov < GEM_TX_MAX_FRAGS - 1) {
+        map = gem_tx_map_frag(s, addr, len);
+    }
+
+    if (map) {
+        f->iov[f->niov].iov_base = map;
+        f->iov[f->niov].iov_len = len;
+        f->mapped[f->niov++] = true;
+    } else {
+        address_space_read(&s->dma_as, addr, *s->attr, f->p, len);
+        if (last && !f->mapped[f->niov - 1] &&
+            (uint8_t *)last->iov_base + last->iov_len == f->p) {
+            last->iov_len += len;
+        } else {
+            f->iov[f->niov].iov_base = f->p;
+            f->iov[f->niov].iov_len = len;
+            f->mapped[f->niov++] = false;
+        }
+        f->p += len;
+    }
+    f->total_bytes += len;
+}
+
 /*
  * gem_transmit:
  * Fish packets out of the descriptor ring and feed them to QEMU
@@ -1135,9 +1377,8 @@ static void gem_transmit(CadenceGEMState *s)
 {
     uint32_t desc[DESC_MAX_NUM_WORDS];
     hwaddr packet_desc_addr;
-    uint8_t     tx_packet[10240];
-    uint8_t     *p;
-    unsigned    total_bytes;
+    GEMTxFrame frame, *f = &frame;
+    bool zero_copy;
     int q = 0;
 
     /* Do nothing if transmit is not enabled. */
@@ -1148,26 +1389,27 @@ static void gem_transmit(CadenceGEMState *s)
     DB_PRINT("\n");
 
     /* The packet we will hand off to QEMU.
-     * Packets scattered across multiple descriptors are gathered to this
-     * one contiguous buffer first.
+     * Fragments in RAM are passed on as they are. The checksum offload and
+     * the loopback paths need the whole packet in one contiguous buffer, so
+     * in those cases everything is gathered into f->buf first.
      */
-    p = tx_packet;
-    total_bytes = 0;
+    gem_tx_frame_init(f);
+    zero_copy = !(s->regs[GEM_DMACFG] & GEM_DMACFG_TXCSUM_OFFL) &&
+                !s->phy_loop && !(s->regs[GEM_NWCTRL] & GEM_NWCTRL_LOCALLOOP);
 
     for (q = s->num_priority_queues - 1; q >= 0; q--) {
         /* read current descriptor */
         packet_desc_addr = gem_get_tx_desc_addr(s, q);
 
         DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", packet_desc_addr);
-        address_space_read(&s->dma_as, packet_desc_addr,
-                           *s->attr, (uint8_t *)desc,
-                           sizeof(uint32_t) * gem_get_desc_len(s, false));
+        gem_desc_read(s, true, q, packet_desc_addr, desc,
+                      gem_get_desc_len(s, false));
         /* Handle all descriptors owned by hardware */
         while (tx_desc_get_used(desc) == 0) {
 
             /* Do nothing if transmit is not enabled. */
             if (!(s->regs[GEM_NWCTRL] & GEM_NWCTRL_TXENA)) {
-                return;
+                goto out;
             }
             print_gem_tx_desc(desc, q);
 
@@ -1181,41 +1423,32 @@ static void gem_transmit(CadenceGEMState *s)
                 break;
             }
 
-            if (tx_desc_get_length(desc) > sizeof(tx_packet) -
-                                               (p - tx_packet)) {
+            if (tx_desc_get_length(desc) > sizeof(f->buf) - f->total_bytes) {
                 DB_PRINT("TX descriptor @ 0x%" HWADDR_PRIx \
                          " too large: size 0x%x space 0x%zx\n",
                          packet_desc_addr, tx_desc_get_length(desc),
-                         sizeof(tx_packet) - (p - tx_packet));
+                         sizeof(f->buf) - f->total_bytes);
                 break;
             }
 
-            /* Gather this fragment of the packet from "dma memory" to our
-             * contig buffer.
-             */
-            address_space_read(&s->dma_as, tx_desc_get_buffer(s, desc),
-                               *s->attr,
-                               p, tx_desc_get_length(desc));
-            p += tx_desc_get_length(desc);
-            total_bytes += tx_desc_get_length(desc);
+            /* Gather this fragment of the packet.  */
+            gem_tx_frame_add(s, f, tx_desc_get_buffer(s, desc),
+                             tx_desc_get_length(desc), zero_copy);
 
             /* Last descriptor for this packet; hand the whole thing off */
             if (tx_desc_get_last(desc)) {
-                uint32_t desc_first[DESC_MAX_NUM_WORDS];
+                uint32_t desc_first[2];
+                uint8_t hdr[ETH_ALEN] = { 0 };
                 hwaddr desc_addr = gem_get_tx_desc_addr(s, q);
 
                 /* Modify the 1st descriptor of this packet to be owned by
                  * the processor.
                  */
-                address_space_read(&s->dma_as, desc_addr,
-                                   *s->attr,
-                                   (uint8_t *)desc_first,
-                                   sizeof(desc_first));
+                gem_desc_read(s, true, q, desc_addr, desc_first,
+                              ARRAY_SIZE(desc_first));
                 tx_desc_set_used(desc_first);
-                address_space_write(&s->dma_as, desc_addr,
-                                   *s->attr,
-                                   (uint8_t *)desc_first,
-                                    sizeof(desc_first));
+                gem_desc_write(s, true, q, desc_addr, desc_first,
+                               ARRAY_SIZE(desc_first));
                 /* Advance the hardware current descriptor past this packet */
                 if (tx_desc_get_wrap(desc)) {
                     s->tx_desc_addr[q] = gem_get_queue_base_addr(s,
@@ -1227,6 +1460,7 @@ static void gem_transmit(CadenceGEMState *s)
                 DB_PRINT("TX descriptor next: 0x%08x\n", s->tx_desc_addr[q]);
 
                 s->regs[GEM_TXSTATUS] |= GEM_TXSTATUS_TXCMPL;
+                gem_int_moderate(s, true);
                 if (q == 0) {
                     s->regs[GEM_ISR] |= GEM_INT_TXCMPL & ~(s->regs[GEM_IMR]);
                 } else {
@@ -1235,30 +1469,27 @@ static void gem_transmit(CadenceGEMState *s)
                             GEM_INT_TXCMPL & ~s->regs[GEM_INT_Q1_MASK + q - 1];
                 }
 
-                /* Handle interrupt consequences */
-                gem_update_int_status(s);
-
                 /* Is checksum offload enabled? */
                 if (s->regs[GEM_DMACFG] & GEM_DMACFG_TXCSUM_OFFL) {
-                    net_checksum_calculate(tx_packet, total_bytes);
+                    net_checksum_calculate(f->buf, f->total_bytes);
                 }
 
                 /* Update MAC statistics */
-                gem_transmit_updatestats(s, tx_packet, total_bytes);
+                iov_to_buf(f->iov, f->niov, 0, hdr, sizeof(hdr));
+                gem_transmit_updatestats(s, hdr, f->total_bytes);
 
                 /* Send the packet somewhere */
                 if (s->phy_loop || (s->regs[GEM_NWCTRL] &
                                     GEM_NWCTRL_LOCALLOOP)) {
-                    gem_receive(qemu_get_queue(s->nic), tx_packet,
-                                total_bytes);
+                    gem_receive(qemu_get_queue(s->nic), f->buf,
+                                f->total_bytes);
                 } else {
-                    qemu_send_packet(qemu_get_queue(s->nic), tx_packet,
-                                     total_bytes);
+                    qemu_sendv_packet(qemu_get_queue(s->nic), f->iov,
+                                      f->niov);
                 }
 
                 /* Prepare for next packet */
-                p = tx_packet;
-                total_bytes = 0;
+                gem_tx_frame_release(s, f);
             }
 
             /* read next descriptor */
@@ -1273,20 +1504,26 @@ static void gem_transmit(CadenceGEMState *s)
                 packet_desc_addr += 4 * gem_get_desc_len(s, false);
             }
             DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", packet_desc_addr);
-            address_space_read(&s->dma_as, packet_desc_addr,
-                               *s->attr, (uint8_t *)desc,
-                               sizeof(uint32_t) * gem_get_desc_len(s, false));
+            gem_desc_read(s, true, q, packet_desc_addr, desc,
+                          gem_get_desc_len(s, false));
         }
 
+        /* A partially gathered packet does not carry over to the next Q.  */
+        gem_tx_frame_release(s, f);
+
         if (tx_desc_get_used(desc)) {
             s->regs[GEM_TXSTATUS] |= GEM_TXSTATUS_USED;
             /* IRQ TXUSED is defined only for queue 0 */
             if (q == 0) {
                 s->regs[GEM_ISR] |= GEM_INT_TXUSED & ~(s->regs[GEM_IMR]);
             }
-            gem_update_int_status(s);
         }
     }
+
+out:
+    gem_tx_frame_release(s, f);
+    /* Handle interrupt consequences, once for the whole drain.  */
+    gem_update_int_status(s);
 }
 
 static void gem_phy_reset(CadenceGEMState *s)
@@ -1359,6 +1596,11 @@ static void gem_reset(DeviceState *d)
         gem_phy_reset(s);
     }
 
+    gem_ring_cache_flush_all(s);
+    for (i = 0; i < ARRAY_SIZE(s->intmod_timer); i++) {
+        timer_del(s->intmod_timer[i]);
+    }
+
     gem_update_int_status(s);
 }
 
@@ -1525,15 +1767,32 @@ static void gem_write(void *opaque, hwaddr offset, uint64_t val,
         break;
     case GEM_RXQBASE:
         s->rx_desc_addr[0] = val;
+        gem_ring_cache_flush(&s->rx_ring[0]);
         break;
     case GEM_RECEIVE_Q1_PTR ... GEM_RECEIVE_Q7_PTR:
         s->rx_desc_addr[offset - GEM_RECEIVE_Q1_PTR + 1] = val;
+        gem_ring_cache_flush(&s->rx_ring[offset - GEM_RECEIVE_Q1_PTR + 1]);
         break;
     case GEM_TXQBASE:
         s->tx_desc_addr[0] = val;
+        gem_ring_cache_flush(&s->tx_ring[0]);
         break;
     case GEM_TRANSMIT_Q1_PTR ... GEM_TRANSMIT_Q7_PTR:
         s->tx_desc_addr[offset - GEM_TRANSMIT_Q1_PTR + 1] = val;
+        gem_ring_cache_flush(&s->tx_ring[offset - GEM_TRANSMIT_Q1_PTR + 1]);
+        break;
+    case GEM_DMACFG:
+    case GEM_TBQPH:
+    case GEM_RBQPH:
+        /* These move the rings in the 64-bit address space.  */
+        gem_ring_cache_flush_all(s);
+        break;
+    case GEM_INTMOD:
+        /* A shorter period applies to what is being held right now.  */
+        for (i = 0; i < ARRAY_SIZE(s->intmod_timer); i++) {
+            timer_del(s->intmod_timer[i]);
+        }
+        gem_update_int_status(s);
         break;
     case GEM_RXSTATUS:
         gem_update_int_status(s);
@@ -1636,6 +1895,11 @@ static void gem_realize(DeviceState *dev, Error **errp)
         sysbus_init_irq(SYS_BUS_DEVICE(dev), &s->irq[i]);
     }
 
+    for (i = 0; i < ARRAY_SIZE(s->intmod_timer); i++) {
+        s->intmod_timer[i] = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                          gem_intmod_expired, s);
+    }
+
     if (!s->attr) {
         s->attr = MEMORY_TRANSACTION_ATTR(
                       object_new(TYPE_MEMORY_TRANSACTION_ATTR));
@@ -1673,6 +1937,25 @@ static void gem_init(Object *obj)
                              OBJ_PROP_LINK_STRONG);
 }
 
+static bool gem_intmod_needed(void *opaque)
+{
+    CadenceGEMState *s = opaque;
+
+    return timer_pending(s->intmod_timer[0]) ||
+           timer_pending(s->intmod_timer[1]);
+}
+
+static const VMStateDescription vmstate_cadence_gem_intmod = {
+    .name = "cadence_gem/intmod",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = gem_intmod_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_TIMER_PTR_ARRAY(intmod_timer, CadenceGEMState, 2),
+        VMSTATE_END_OF_LIST(),
+    }
+};
+
 static const VMStateDescription vmstate_cadence_gem = {
     .name = "cadence_gem",
     .version_id = 4,
@@ -1686,6 +1969,10 @@ static const VMStateDescription vmstate_cadence_gem = {
                              MAX_PRIORITY_QUEUES),
         VMSTATE_BOOL_ARRAY(sar_active, CadenceGEMState, 4),
         VMSTATE_END_OF_LIST(),
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_cadence_gem_intmod,
+        NULL
     }
 };
 
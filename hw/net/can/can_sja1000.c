@@ -750,18 +750,13 @@ bool can_sja_can_receive(CanBusClientState *client)
     return true; /* always return true, when operation mode */
 }
 
-ssize_t can_sja_receive(CanBusClientState *client, const qemu_can_frame *frames,
-                        size_t frames_cnt)
+static ssize_t can_sja_receive_frame(CanSJA1000State *s,
+                                     const qemu_can_frame *frame)
 {
-    CanSJA1000State *s = container_of(client, CanSJA1000State, bus_client);
     static uint8_t rcv[SJA_MSG_MAX_LEN];
     int i;
     int ret = -1;
-    const qemu_can_frame *frame = frames;
 
-    if (frames_cnt <= 0) {
-        return 0;
-    }
     if (DEBUG_FILTER) {
         can_display_msg("[cansja]: receive ", frame);
     }
@@ -858,6 +853,24 @@ ssize_t can_sja_receive(CanBusClientState *client, const qemu_can_frame *frames,
     return 1;
 }
 
+ssize_t can_sja_receive(CanBusClientState *client, const qemu_can_frame *frames,
+                        size_t frames_cnt)
+{
+    CanSJA1000State *s = container_of(client, CanSJA1000State, bus_client);
+    ssize_t ret = 0;
+    size_t i;
+
+    /* Frames of a batch are received in order, as if sent one by one. */
+    for (i = 0; i < frames_cnt; i++) {
+        ssize_t res = can_sja_receive_frame(s, &frames[i]);
+
+        if (ret <= 0) {
+            ret = res;
+        }
+    }
+    return ret;
+}
+
 static CanBusClientInfo can_sja_bus_client_info = {
     .can_receive = can_sja_can_receive,
     .receive = can_sja_receive,
@@ -435,7 +435,8 @@ static bool tx_ready_check(XlnxZynqMPCAN *s)
 
 static void transfer_fifo(XlnxZynqMPCAN *s, Fifo *fifo)
 {
-    qemu_can_frame frame;
+    qemu_can_frame frames[MAILBOX_CAPACITY];
+    size_t nframes = 0;
     uint32_t data[CAN_FRAME_SIZE];
     int i;
     bool can_tx = tx_ready_check(s);
@@ -470,12 +471,15 @@ static void transfer_fifo(XlnxZynqMPCAN *s, Fifo *fifo)
                 }
             } else {
                 /* Normal mode Tx. */
-                generate_frame(&frame, data);
-
-                can_bus_client_send(&s->bus_client, &frame, 1);
+                generate_frame(&frames[nframes++], data);
             }
         }
 
+        /* Hand the whole FIFO over to the bus at once, in order. */
+        if (nframes) {
+            can_bus_client_send(&s->bus_client, frames, nframes);
+        }
+
         ARRAY_FIELD_DP32(s->regs, INTERRUPT_STATUS_REGISTER, TXOK, 1);
         ARRAY_FIELD_DP32(s->regs, STATUS_REGISTER, TXBFLL, 0);
 
@@ -603,6 +607,7 @@ static uint64_t can_tcr_pre_write(RegisterInfo  *reg, uint64_t val64)
     return 0;
 }
 
+/* Callers must call can_update_irq() once they have stored all frames. */
 static void update_rx_fifo(XlnxZynqMPCAN *s, const qemu_can_frame *frame)
 {
     uint32_t filter_pass = 0;
@@ -703,9 +708,6 @@ static void update_rx_fifo(XlnxZynqMPCAN *s, const qemu_can_frame *frame)
 
             ARRAY_FIELD_DP32(s->regs, INTERRUPT_STATUS_REGISTER, RXOK, 1);
         }
-
-        can_update_irq(s);
-
     } else {
         DB_PRINT("Message didn't pass through any filter"
                   "or dlc is not in range\n");
@@ -957,7 +959,7 @@ static bool xlnx_zynqmp_can_can_receive(CanBusClientState *client)
 static ssize_t xlnx_zynqmp_can_receive(CanBusClientState *client,
                                const qemu_can_frame *buf, size_t buf_size) {
     XlnxZynqMPCAN *s = container_of(client, XlnxZynqMPCAN, bus_client);
-    const qemu_can_frame *frame = buf;
+    const qemu_can_frame *frame;
 
     DB_PRINT("Incoming data for CAN%d\n", s->cfg.ctrl_idx);
 
@@ -972,22 +974,29 @@ static ssize_t xlnx_zynqmp_can_receive(CanBusClientState *client,
          */
         DB_PRINT("XlnxZynqMPCAN is in loopback mode."
                 " It will not receive data.\n");
+        return 1;
+    }
 
-    } else if (ARRAY_FIELD_EX32(s->regs, STATUS_REGISTER, SNOOP)) {
-        /* Snoop Mode: Just keep the data. no response back. */
-        update_rx_fifo(s, frame);
-    } else if ((ARRAY_FIELD_EX32(s->regs, STATUS_REGISTER, SLEEP))) {
-        /*
-         * XlnxZynqMPCAN is in sleep mode. Any data on bus will bring it to wake
-         * up state.
-         */
-        can_exit_sleep_mode(s);
-        update_rx_fifo(s, frame);
-    } else if ((ARRAY_FIELD_EX32(s->regs, STATUS_REGISTER, SLEEP)) == 0) {
-        update_rx_fifo(s, frame);
-    } else {
-        DB_PRINT("Can't receive data as XlnxZynqMPCAN is not set correctly.\n");
+    /* Fill the RX FIFO with the whole batch, then update the IRQ once. */
+    for (frame = buf; frame < buf + buf_size; frame++) {
+        if (ARRAY_FIELD_EX32(s->regs, STATUS_REGISTER, SNOOP)) {
+            /* Snoop Mode: Just keep the data. no response back. */
+            update_rx_fifo(s, frame);
+        } else if ((ARRAY_FIELD_EX32(s->regs, STATUS_REGISTER, SLEEP))) {
+            /*
+             * XlnxZynqMPCAN is in sleep mode. Any data on bus will bring it
+             * to wake up state.
+             */
+            can_exit_sleep_mode(s);
+            update_rx_fifo(s, frame);
+        } else if ((ARRAY_FIELD_EX32(s->regs, STATUS_REGISTER, SLEEP)) == 0) {
+            update_rx_fifo(s, frame);
+        } else {
+            DB_PRINT("Can't receive data as XlnxZynqMPCAN is not set "
+                     "correctly.\n");
+        }
     }
+    can_update_irq(s);
 
     return 1;
 }
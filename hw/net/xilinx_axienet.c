@@ -30,6 +30,8 @@
 #include "qemu/module.h"
 #include "net/net.h"
 #include "net/checksum.h"
+#include "qemu/iov.h"
+#include "standard-headers/linux/virtio_net.h"
 
 #include "hw/hw.h"
 #include "hw/irq.h"
@@ -325,6 +327,9 @@ enum {
 #define R_AF1      (0x714 / 4)
 #define R_MAX      (0x34 / 4)
 
+/* Max number of buffers in a frame that is sent without gathering it.  */
+#define AXIENET_TX_MAX_IOV 64
+
 /* Indirect registers.  */
 struct TEMAC  {
     struct MDIOBus mdio_bus;
@@ -414,6 +419,10 @@ struct XilinxAXIEnet {
 
     /* Whether axienet_eth_rx_notify should flush incoming queue. */
     bool need_flush;
+
+    /* Frames to and from the peer carry a virtio-net header.  */
+    bool disable_vnet;
+    bool has_vnet_hdr;
 };
 
 static void axienet_rx_reset(XilinxAXIEnet *s)
@@ -742,6 +751,15 @@ static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
         return 0;
     }
 
+    /* RX offloads are off, so the header carries nothing for us.  */
+    if (s->has_vnet_hdr) {
+        if (size <= sizeof(struct virtio_net_hdr)) {
+            return -1;
+        }
+        buf += sizeof(struct virtio_net_hdr);
+        size -= sizeof(struct virtio_net_hdr);
+    }
+
     unicast = ~buf[0] & 0x1;
     broadcast = memcmp(buf, sa_bcast, 6) == 0;
     multicast = !unicast && !broadcast;
@@ -899,12 +917,80 @@ xilinx_axienet_control_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
     return len;
 }
 
+/*
+ * Check whether the partial checksum requested by the control words can be
+ * left to the host, filling in @vhdr. Returns false if it has to be done
+ * in software.
+ */
+static bool axienet_tx_host_csum(XilinxAXIEnet *s, size_t len,
+                                 struct virtio_net_hdr *vhdr)
+{
+    unsigned int start_off = s->hdr[1] >> 16;
+    unsigned int write_off = s->hdr[1] & 0xffff;
+
+    memset(vhdr, 0, sizeof(*vhdr));
+    if (!(s->hdr[0] & 1)) {
+        return true;
+    }
+
+    /* The virtio header has no room for a seed.  */
+    if (!s->has_vnet_hdr || (s->hdr[2] & 0xffff) ||
+        write_off < start_off || write_off + 2 > len) {
+        return false;
+    }
+
+    vhdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    vhdr->csum_start = start_off;
+    vhdr->csum_offset = write_off - start_off;
+    return true;
+}
+
+static void axienet_tx_sw_csum(XilinxAXIEnet *s, uint8_t *buf, size_t len)
+{
+    unsigned int start_off = s->hdr[1] >> 16;
+    unsigned int write_off = s->hdr[1] & 0xffff;
+    uint32_t tmp_csum;
+    uint16_t csum;
+
+    tmp_csum = net_checksum_add(len - start_off, buf + start_off);
+    /* Accumulate the seed.  */
+    tmp_csum += s->hdr[2] & 0xffff;
+
+    /* Fold the 32bit partial checksum.  */
+    csum = net_checksum_finish(tmp_csum);
+
+    /* Writeback.  */
+    buf[write_off] = csum >> 8;
+    buf[write_off + 1] = csum & 0xff;
+}
+
+static void axienet_tx_sendv(XilinxAXIEnet *s, const struct iovec *iov,
+                             int iovcnt, struct virtio_net_hdr *vhdr)
+{
+    NetClientState *nc = qemu_get_queue(s->nic);
+    struct iovec vio[AXIENET_TX_MAX_IOV + 1];
+
+    if (!s->has_vnet_hdr) {
+        qemu_sendv_packet(nc, iov, iovcnt);
+        return;
+    }
+
+    assert(iovcnt <= AXIENET_TX_MAX_IOV);
+    vio[0].iov_base = vhdr;
+    vio[0].iov_len = sizeof(*vhdr);
+    memcpy(&vio[1], iov, iovcnt * sizeof(*iov));
+    qemu_sendv_packet(nc, vio, iovcnt + 1);
+}
+
 static size_t
-xilinx_axienet_data_stream_push(StreamSlave *obj, uint8_t *buf, size_t size,
-                                bool eop)
+xilinx_axienet_data_stream_pushv(StreamSlave *obj, const struct iovec *iov,
+                                 int iovcnt, bool eop)
 {
     XilinxAXIEnetStreamSlave *ds = XILINX_AXI_ENET_DATA_STREAM(obj);
     XilinxAXIEnet *s = ds->enet;
+    size_t size = iov_size(iov, iovcnt);
+    struct virtio_net_hdr vhdr;
+    struct iovec frame;
 
     /* TX enable ?  */
     if (!(s->tc & TC_TX)) {
@@ -918,17 +1004,25 @@ xilinx_axienet_data_stream_push(StreamSlave *obj, uint8_t *buf, size_t size,
         return size;
     }
 
-    if (s->txpos == 0 && eop) {
-        /* Fast path single fragment.  */
+    if (s->txpos == 0 && eop && iovcnt <= AXIENET_TX_MAX_IOV &&
+        axienet_tx_host_csum(s, size, &vhdr)) {
+        /* Fast path, the whole frame is here and goes out untouched.  */
         s->txpos = size;
     } else {
-        memcpy(s->txmem + s->txpos, buf, size);
-        buf = s->txmem;
+        iov_to_buf(iov, iovcnt, 0, s->txmem + s->txpos, size);
         s->txpos += size;
 
         if (!eop) {
             return size;
         }
+
+        if (!axienet_tx_host_csum(s, s->txpos, &vhdr)) {
+            axienet_tx_sw_csum(s, s->txmem, s->txpos);
+        }
+        frame.iov_base = s->txmem;
+        frame.iov_len = s->txpos;
+        iov = &frame;
+        iovcnt = 1;
     }
 
     /* Jumbo or vlan sizes ?  */
@@ -939,26 +1033,7 @@ xilinx_axienet_data_stream_push(StreamSlave *obj, uint8_t *buf, size_t size,
         }
     }
 
-    if (s->hdr[0] & 1) {
-        unsigned int start_off = s->hdr[1] >> 16;
-        unsigned int write_off = s->hdr[1] & 0xffff;
-        uint32_t tmp_csum;
-        uint16_t csum;
-
-        tmp_csum = net_checksum_add(s->txpos - start_off,
-                                    buf + start_off);
-        /* Accumulate the seed.  */
-        tmp_csum += s->hdr[2] & 0xffff;
-
-        /* Fold the 32bit partial checksum.  */
-        csum = net_checksum_finish(tmp_csum);
-
-        /* Writeback.  */
-        buf[write_off] = csum >> 8;
-        buf[write_off + 1] = csum & 0xff;
-    }
-
-    qemu_send_packet(qemu_get_queue(s->nic), buf, s->txpos);
+    axienet_tx_sendv(s, iov, iovcnt, &vhdr);
 
     s->stats.tx_bytes += s->txpos;
     s->regs[R_IS] |= IS_TX_COMPLETE;
@@ -968,6 +1043,18 @@ xilinx_axienet_data_stream_push(StreamSlave *obj, uint8_t *buf, size_t size,
     return size;
 }
 
+static size_t
+xilinx_axienet_data_stream_push(StreamSlave *obj, uint8_t *buf, size_t size,
+                                bool eop)
+{
+    struct iovec iov = {
+        .iov_base = buf,
+        .iov_len = size,
+    };
+
+    return xilinx_axienet_data_stream_pushv(obj, &iov, 1, eop);
+}
+
 static NetClientInfo net_xilinx_enet_info = {
     .type = NET_CLIENT_DRIVER_NIC,
     .size = sizeof(NICState),
@@ -981,6 +1068,7 @@ static void xilinx_enet_realize(DeviceState *dev, Error **errp)
     XilinxAXIEnetStreamSlave *cs = XILINX_AXI_ENET_CONTROL_STREAM(
                                                             &s->rx_control_dev);
     Error *local_err = NULL;
+    NetClientState *nc;
 
     object_property_add_link(OBJECT(ds), "enet", "xlnx.axi-ethernet",
                              (Object **) &ds->enet,
@@ -1001,6 +1089,14 @@ static void xilinx_enet_realize(DeviceState *dev, Error **errp)
                           object_get_typename(OBJECT(dev)), dev->id, s);
     qemu_format_nic_info_str(qemu_get_queue(s->nic), s->conf.macaddr.a);
 
+    /* Let the host finish TX checksums if the backend can do it.  */
+    nc = qemu_get_queue(s->nic);
+    if (!s->disable_vnet && qemu_has_vnet_hdr(nc->peer)) {
+        s->has_vnet_hdr = true;
+        qemu_using_vnet_hdr(nc->peer, true);
+        qemu_set_offload(nc->peer, 0, 0, 0, 0, 0);
+    }
+
     tdk_init(&s->TEMAC.phy);
     mdio_attach(&s->TEMAC.mdio_bus, &s->TEMAC.phy, s->c_phyaddr);
 
@@ -1037,6 +1133,7 @@ static Property xilinx_enet_properties[] = {
     DEFINE_PROP_UINT32("phyaddr", XilinxAXIEnet, c_phyaddr, 7),
     DEFINE_PROP_UINT32("rxmem", XilinxAXIEnet, c_rxmem, 0x1000),
     DEFINE_PROP_UINT32("txmem", XilinxAXIEnet, c_txmem, 0x1000),
+    DEFINE_PROP_BOOL("disable_vnet_hdr", XilinxAXIEnet, disable_vnet, false),
     DEFINE_NIC_PROPERTIES(XilinxAXIEnet, conf),
     DEFINE_PROP_LINK("axistream-connected", XilinxAXIEnet,
                      tx_data_dev, TYPE_STREAM_SLAVE, StreamSlave *),
@@ -1067,6 +1164,7 @@ static void xilinx_enet_data_stream_class_init(ObjectClass *klass, void *data)
     StreamSlaveClass *ssc = STREAM_SLAVE_CLASS(klass);
 
     ssc->push = xilinx_axienet_data_stream_push;
+    ssc->pushv = xilinx_axienet_data_stream_pushv;
 }
 
 static const TypeInfo xilinx_enet_info = {
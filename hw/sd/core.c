@@ -129,6 +129,48 @@ uint8_t sdbus_read_data(SDBus *sdbus)
     return value;
 }
 
+void sdbus_write_block(SDBus *sdbus, const void *buf, size_t length)
+{
+    SDState *card = get_card(sdbus);
+    const uint8_t *data = buf;
+
+    trace_sdbus_write_block(sdbus_name(sdbus), length);
+    if (card) {
+        SDCardClass *sc = SD_CARD_GET_CLASS(card);
+        size_t i;
+
+        if (sc->write_block) {
+            sc->write_block(card, data, length);
+            return;
+        }
+        for (i = 0; i < length; i++) {
+            sc->write_data(card, data[i]);
+        }
+    }
+}
+
+void sdbus_read_block(SDBus *sdbus, void *buf, size_t length)
+{
+    SDState *card = get_card(sdbus);
+    uint8_t *data = buf;
+
+    trace_sdbus_read_block(sdbus_name(sdbus), length);
+    if (card) {
+        SDCardClass *sc = SD_CARD_GET_CLASS(card);
+        size_t i;
+
+        if (sc->read_block) {
+            sc->read_block(card, data, length);
+            return;
+        }
+        for (i = 0; i < length; i++) {
+            data[i] = sc->read_data(card);
+        }
+        return;
+    }
+    memset(data, 0, length);
+}
+
 bool sdbus_data_ready(SDBus *sdbus)
 {
     SDState *card = get_card(sdbus);
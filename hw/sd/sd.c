@@ -2181,6 +2181,126 @@ uint8_t sd_read_data(SDState *sd)
     return ret;
 }
 
+/*
+ * Read @length bytes for the current data command.  Whole blocks of
+ * READ_SINGLE_BLOCK and READ_MULTIPLE_BLOCK are read from the backend in a
+ * single request; anything else goes through sd_read_data() byte by byte.
+ */
+static void sd_read_block(SDState *sd, uint8_t *buf, size_t length)
+{
+    size_t done = 0;
+
+    if (sd->blk && blk_is_inserted(sd->blk) && sd->enable &&
+        sd->state == sd_sendingdata_state &&
+        !(sd->card_status & (ADDRESS_ERROR | WP_VIOLATION)) &&
+        (sd->current_cmd == 17 || sd->current_cmd == 18) &&
+        sd->data_offset == 0) {
+        uint32_t io_len = (sd->ocr & (1 << 30)) ? 512 : sd->blk_len;
+        uint64_t n = io_len ? length / io_len : 0;
+
+        if (sd->current_cmd == 17) {
+            n = MIN(n, 1);
+        } else {
+            /* Leave out of range blocks to sd_read_data() to flag them */
+            n = MIN(n, sd->data_start < sd->size ?
+                       (sd->size - sd->data_start) / io_len : 0);
+            if (sd->multi_blk_cnt != 0) {
+                n = MIN(n, sd->multi_blk_cnt);
+            }
+        }
+
+        if (n) {
+            done = n * io_len;
+            trace_sdcard_read_block(sd->data_start, done);
+            if (blk_pread(sd->blk, sd->data_start, buf, done) < 0) {
+                fprintf(stderr, "sd_read_block: read error on host side\n");
+            }
+            if (sd->current_cmd == 17) {
+                sd->data_offset = io_len;
+                sd->state = sd_transfer_state;
+            } else {
+                sd->data_start += done;
+                if (sd->multi_blk_cnt != 0) {
+                    sd->multi_blk_cnt -= n;
+                    if (sd->multi_blk_cnt == 0) {
+                        sd->state = sd_transfer_state;
+                    }
+                }
+            }
+        }
+    }
+
+    for (; done < length; done++) {
+        buf[done] = sd_read_data(sd);
+    }
+}
+
+/*
+ * Write @length bytes for the current data command, the counterpart of
+ * sd_read_block() for WRITE_BLOCK and WRITE_MULTIPLE_BLOCK.
+ */
+static void sd_write_block(SDState *sd, const uint8_t *buf, size_t length)
+{
+    size_t done = 0;
+
+    if (sd->blk && blk_is_inserted(sd->blk) && sd->enable &&
+        sd->state == sd_receivingdata_state &&
+        !(sd->card_status & (ADDRESS_ERROR | WP_VIOLATION)) &&
+        (sd->current_cmd == 24 || sd->current_cmd == 25) &&
+        sd->data_offset == 0 && sd->blk_len) {
+        uint64_t max = length / sd->blk_len;
+        uint64_t n;
+
+        if (sd->current_cmd == 24) {
+            max = MIN(max, 1);
+        } else if (sd->multi_blk_cnt != 0) {
+            max = MIN(max, sd->multi_blk_cnt);
+        }
+        /*
+         * CMD25 checks every block; stop before the first one that fails
+         * and let sd_write_data() flag it.
+         */
+        for (n = 0; n < max && sd->current_cmd == 25; n++) {
+            uint64_t addr = sd->data_start + n * sd->blk_len;
+
+            if (addr + sd->blk_len > sd->size || sd_wp_addr(sd, addr)) {
+                break;
+            }
+        }
+        if (sd->current_cmd == 24) {
+            n = max;
+        }
+
+        if (n) {
+            done = n * sd->blk_len;
+            trace_sdcard_write_block(sd->data_start, done);
+            sd->state = sd_programming_state;
+            if (blk_pwrite(sd->blk, sd->data_start, buf, done, 0) < 0) {
+                fprintf(stderr, "sd_write_block: write error on host side\n");
+            }
+            sd->blk_written += n;
+            sd->csd[14] |= 0x40;
+            if (sd->current_cmd == 24) {
+                sd->data_offset = sd->blk_len;
+                sd->state = sd_transfer_state;
+            } else {
+                sd->data_start += done;
+                sd->state = sd_receivingdata_state;
+                if (sd->multi_blk_cnt != 0) {
+                    sd->multi_blk_cnt -= n;
+                    if (sd->multi_blk_cnt == 0) {
+                        sd->state = sd_transfer_state;
+                    }
+                }
+            }
+        }
+    }
+
+    for (; done < length; done++) {
+        sd_write_data(sd, buf[done]);
+    }
+}
+
 bool sd_data_ready(SDState *sd)
 {
     return sd->state == sd_sendingdata_state;
@@ -2269,6 +2389,8 @@ static void sd_class_init(ObjectClass *klass, void *data)
     sc->do_command = sd_do_command;
     sc->write_data = sd_write_data;
     sc->read_data = sd_read_data;
+    sc->write_block = sd_write_block;
+    sc->read_block = sd_read_block;
     sc->data_ready = sd_data_ready;
     sc->enable = sd_enable;
     sc->get_inserted = sd_get_inserted;
@@ -588,6 +588,45 @@ static void sdhci_write_dataport(SDHCIState *s, uint32_t value, unsigned size)
     }
 }
 
+/*
+ * Transfer up to @nblocks whole blocks between the card and guest memory at
+ * @addr without going through the FIFO.  Returns the number of blocks
+ * transferred, which is 0 if @addr cannot be mapped directly (e.g. MMIO).
+ */
+static unsigned int sdhci_dma_blocks(SDHCIState *s, hwaddr addr,
+                                     unsigned int nblocks, bool is_read)
+{
+    const uint16_t block_size = s->blksize & BLOCK_SIZE_MASK;
+    hwaddr len;
+    void *mem;
+
+    if (s->trnmod & SDHC_TRNS_BLK_CNT_EN) {
+        nblocks = MIN(nblocks, s->blkcnt);
+    }
+    if (!nblocks || !block_size) {
+        return 0;
+    }
+
+    len = (hwaddr)nblocks * block_size;
+    mem = address_space_map(s->dma_as, addr, &len, is_read, *s->memattr);
+    if (!mem) {
+        return 0;
+    }
+    nblocks = len / block_size;
+    len = (hwaddr)nblocks * block_size;
+    if (is_read) {
+        sdbus_read_block(&s->sdbus, mem, len);
+    } else {
+        sdbus_write_block(&s->sdbus, mem, len);
+    }
+    address_space_unmap(s->dma_as, mem, len, is_read, len);
+
+    if (s->trnmod & SDHC_TRNS_BLK_CNT_EN) {
+        s->blkcnt -= nblocks;
+    }
+    return nblocks;
+}
+
 /*
  * Single DMA data transfer
  */
@@ -618,9 +657,18 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
                 SDHC_DAT_LINE_ACTIVE;
         while (s->blkcnt) {
             if (s->data_count == 0) {
-                for (n = 0; n < block_size; n++) {
-                    s->fifo_buffer[n] = sdbus_read_data(&s->sdbus);
+                n = sdhci_dma_blocks(s, s->sdmasysad,
+                                     page_aligned ? boundary_count / block_size
+                                                  : s->blkcnt, true);
+                if (n) {
+                    s->sdmasysad += n * block_size;
+                    boundary_count -= n * block_size;
+                    if (page_aligned && boundary_count == 0) {
+                        break;
+                    }
+                    continue;
                 }
+                sdbus_read_block(&s->sdbus, s->fifo_buffer, block_size);
             }
             begin = s->data_count;
             if (((boundary_count + begin) < block_size) && page_aligned) {
@@ -648,6 +696,19 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
         s->prnsts |= SDHC_DOING_WRITE | SDHC_DATA_INHIBIT |
                 SDHC_DAT_LINE_ACTIVE;
         while (s->blkcnt) {
+            if (s->data_count == 0) {
+                n = sdhci_dma_blocks(s, s->sdmasysad,
+                                     page_aligned ? boundary_count / block_size
+                                                  : s->blkcnt, false);
+                if (n) {
+                    s->sdmasysad += n * block_size;
+                    boundary_count -= n * block_size;
+                    if (page_aligned && boundary_count == 0) {
+                        break;
+                    }
+                    continue;
+                }
+            }
             begin = s->data_count;
             if (((boundary_count + begin) < block_size) && page_aligned) {
                 s->data_count = boundary_count + begin;
@@ -661,9 +722,7 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
                             DMA_DIRECTION_TO_DEVICE, *s->memattr);
             s->sdmasysad += s->data_count - begin;
             if (s->data_count == block_size) {
-                for (n = 0; n < block_size; n++) {
-                    sdbus_write_data(&s->sdbus, s->fifo_buffer[n]);
-                }
+                sdbus_write_block(&s->sdbus, s->fifo_buffer, block_size);
                 s->data_count = 0;
                 if (s->trnmod & SDHC_TRNS_BLK_CNT_EN) {
                     s->blkcnt--;
@@ -688,21 +747,16 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
 /* single block SDMA transfer */
 static void sdhci_sdma_transfer_single_block(SDHCIState *s)
 {
-    int n;
     uint32_t datacnt = s->blksize & BLOCK_SIZE_MASK;
 
     if (s->trnmod & SDHC_TRNS_READ) {
-        for (n = 0; n < datacnt; n++) {
-            s->fifo_buffer[n] = sdbus_read_data(&s->sdbus);
-        }
+        sdbus_read_block(&s->sdbus, s->fifo_buffer, datacnt);
         dma_memory_rw_attr(s->dma_as, s->sdmasysad, s->fifo_buffer, datacnt,
                          DMA_DIRECTION_FROM_DEVICE, *s->memattr);
     } else {
         dma_memory_rw_attr(s->dma_as, s->sdmasysad, s->fifo_buffer, datacnt,
                          DMA_DIRECTION_TO_DEVICE, *s->memattr);
-        for (n = 0; n < datacnt; n++) {
-            sdbus_write_data(&s->sdbus, s->fifo_buffer[n]);
-        }
+        sdbus_write_block(&s->sdbus, s->fifo_buffer, datacnt);
     }
     s->blkcnt--;
 
@@ -805,9 +859,19 @@ static void sdhci_do_adma(SDHCIState *s)
             if (s->trnmod & SDHC_TRNS_READ) {
                 while (length) {
                     if (s->data_count == 0) {
-                        for (n = 0; n < block_size; n++) {
-                            s->fifo_buffer[n] = sdbus_read_data(&s->sdbus);
+                        n = sdhci_dma_blocks(s, dscr.addr,
+                                             length / block_size, true);
+                        if (n) {
+                            dscr.addr += n * block_size;
+                            length -= n * block_size;
+                            if ((s->trnmod & SDHC_TRNS_BLK_CNT_EN) &&
+                                s->blkcnt == 0) {
+                                break;
+                            }
+                            continue;
                         }
+                        sdbus_read_block(&s->sdbus, s->fifo_buffer,
+                                         block_size);
                     }
                     begin = s->data_count;
                     if ((length + begin) < block_size) {
@@ -834,6 +898,19 @@ static void sdhci_do_adma(SDHCIState *s)
                 }
             } else {
                 while (length) {
+                    if (s->data_count == 0) {
+                        n = sdhci_dma_blocks(s, dscr.addr,
+                                             length / block_size, false);
+                        if (n) {
+                            dscr.addr += n * block_size;
+                            length -= n * block_size;
+                            if ((s->trnmod & SDHC_TRNS_BLK_CNT_EN) &&
+                                s->blkcnt == 0) {
+                                break;
+                            }
+                            continue;
+                        }
+                    }
                     begin = s->data_count;
                     if ((length + begin) < block_size) {
                         s->data_count = length + begin;
@@ -848,9 +925,8 @@ static void sdhci_do_adma(SDHCIState *s)
                                     DMA_DIRECTION_TO_DEVICE, *s->memattr);
                     dscr.addr += s->data_count - begin;
                     if (s->data_count == block_size) {
-                        for (n = 0; n < block_size; n++) {
-                            sdbus_write_data(&s->sdbus, s->fifo_buffer[n]);
-                        }
+                        sdbus_write_block(&s->sdbus, s->fifo_buffer,
+                                          block_size);
                         s->data_count = 0;
                         if (s->trnmod & SDHC_TRNS_BLK_CNT_EN) {
                             s->blkcnt--;
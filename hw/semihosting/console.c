@@ -27,17 +27,93 @@
 #include "chardev/char-fe.h"
 #include "sysemu/sysemu.h"
 #include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "sysemu/runstate.h"
 #include "qapi/error.h"
 #include "qemu/fifo8.h"
 
-int qemu_semihosting_log_out(const char *s, int len)
+#define OUT_BUF_SIZE    4096
+#define OUT_FLUSH_MS    10
+
+/*
+ * Console output is collected here and written out when the buffer
+ * fills, shortly after the last write, before console input and at
+ * exit, so that a guest printing one character per trap does not pay
+ * one host write per character.  Semihosting calls do not all hold
+ * the BQL, hence the lock.
+ */
+static struct {
+    QemuMutex lock;
+    QEMUTimer *timer;
+    char buf[OUT_BUF_SIZE];
+    int len;
+} out;
+
+static void log_out_write(const char *s, int len)
 {
     Chardev *chardev = semihosting_get_chardev();
+
     if (chardev) {
-        return qemu_chr_write_all(chardev, (uint8_t *) s, len);
+        qemu_chr_write_all(chardev, (uint8_t *) s, len);
+    } else {
+        while (len > 0) {
+            ssize_t n = write(STDERR_FILENO, s, len);
+
+            if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n <= 0) {
+                break;
+            }
+            s += n;
+            len -= n;
+        }
+    }
+}
+
+static void log_out_flush_locked(void)
+{
+    if (out.len) {
+        log_out_write(out.buf, out.len);
+        out.len = 0;
+    }
+}
+
+static void log_out_flush(void)
+{
+    if (out.timer) {
+        qemu_mutex_lock(&out.lock);
+        log_out_flush_locked();
+        qemu_mutex_unlock(&out.lock);
+    }
+}
+
+static void log_out_flush_timer(void *opaque)
+{
+    log_out_flush();
+}
+
+int qemu_semihosting_log_out(const char *s, int len)
+{
+    if (!out.timer) {
+        /* Not initialised yet, write through */
+        log_out_write(s, len);
+        return len;
+    }
+
+    qemu_mutex_lock(&out.lock);
+    if (out.len + len > OUT_BUF_SIZE) {
+        log_out_flush_locked();
+    }
+    if (len > OUT_BUF_SIZE) {
+        log_out_write(s, len);
     } else {
-        return write(STDERR_FILENO, s, len);
+        memcpy(out.buf + out.len, s, len);
+        out.len += len;
+        timer_mod(out.timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + OUT_FLUSH_MS);
     }
+    qemu_mutex_unlock(&out.lock);
+    return len;
 }
 
 /*
@@ -49,18 +125,30 @@ static GString *copy_user_string(CPUArchState *env, target_ulong addr)
 {
     CPUState *cpu = env_cpu(env);
     GString *s = g_string_sized_new(128);
-    uint8_t c;
+    uint8_t buf[128];
 
-    do {
-        if (cpu_memory_rw_debug(cpu, addr++, &c, 1, 0) == 0) {
-            s = g_string_append_c(s, c);
-        } else {
+    /*
+     * Read up to the end of the page at a time rather than byte by
+     * byte, each debug read walks the page tables.
+     */
+    for (;;) {
+        int len = MIN(sizeof(buf),
+                      TARGET_PAGE_SIZE - (addr & ~TARGET_PAGE_MASK));
+        uint8_t *end;
+
+        if (cpu_memory_rw_debug(cpu, addr, buf, len, 0) != 0) {
             qemu_log_mask(LOG_GUEST_ERROR,
                           "%s: passed inaccessible address " TARGET_FMT_lx,
                           __func__, addr);
             break;
         }
-    } while (c!=0);
+        end = memchr(buf, 0, len);
+        g_string_append_len(s, (char *)buf, end ? end - buf : len);
+        if (end) {
+            break;
+        }
+        addr += len;
+    }
 
     return s;
 }
@@ -79,6 +167,7 @@ int qemu_semihosting_console_outs(CPUArchState *env, target_ulong addr)
     int out = s->len;
 
     if (use_gdb_syscalls()) {
+        log_out_flush();
         gdb_do_syscall(semihosting_cb, "write,2,%x,%x", addr, s->len);
     } else {
         out = qemu_semihosting_log_out(s->str, s->len);
@@ -95,6 +184,7 @@ void qemu_semihosting_console_outc(CPUArchState *env, target_ulong addr)
 
     if (cpu_memory_rw_debug(cpu, addr, &c, 1, 0) == 0) {
         if (use_gdb_syscalls()) {
+            log_out_flush();
             gdb_do_syscall(semihosting_cb, "write,2,%x,%x", addr, 1);
         } else {
             qemu_semihosting_log_out((const char *) &c, 1);
@@ -152,6 +242,8 @@ target_ulong qemu_semihosting_console_inc(CPUArchState *env)
     SemihostingConsole *c = &console;
     g_assert(qemu_mutex_iothread_locked());
     g_assert(current_cpu);
+    /* A prompt must be visible before we wait for the answer */
+    log_out_flush();
     if (fifo8_is_empty(&c->fifo)) {
         c->sleeping_cpus = g_slist_prepend(c->sleeping_cpus, current_cpu);
         current_cpu->halted = 1;
@@ -163,10 +255,31 @@ target_ulong qemu_semihosting_console_inc(CPUArchState *env)
     return (target_ulong) ch;
 }
 
+/*
+ * SYS_EXIT leaves through exit() directly.  Any other shutdown stops
+ * the VM first, while the chardev is still there.
+ */
+static void log_out_atexit(void)
+{
+    log_out_flush();
+}
+
+static void log_out_vm_state(void *opaque, int running, RunState state)
+{
+    if (!running) {
+        log_out_flush();
+    }
+}
+
 void qemu_semihosting_console_init(void)
 {
     Chardev *chr = semihosting_get_chardev();
 
+    qemu_mutex_init(&out.lock);
+    out.timer = timer_new_ms(QEMU_CLOCK_REALTIME, log_out_flush_timer, NULL);
+    atexit(log_out_atexit);
+    qemu_add_vm_change_state_handler(log_out_vm_state, NULL);
+
     if  (chr) {
         fifo8_create(&console.fifo, FIFO_SIZE);
         qemu_chr_fe_init(&console.backend, chr, &error_abort);
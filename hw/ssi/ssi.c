@@ -171,6 +171,68 @@ uint32_t ssi_transfer(SSIBus *bus, uint32_t val)
     return r;
 }
 
+/*
+ * Hand up to len bytes to the single selected slave of the bus if it can
+ * take them in bulk. Returns the number of bytes handled, 0 means that the
+ * caller has to fall back to single byte transfers.
+ */
+static size_t ssi_try_transfer_bulk(SSIBus *bus, const uint8_t *tx,
+                                    uint8_t *rx, size_t len)
+{
+    BusState *b = BUS(bus);
+    BusChild *kid;
+    SSISlave *target = NULL;
+
+    QTAILQ_FOREACH(kid, &b->children, sibling) {
+        SSISlave *slave = SSI_SLAVE(kid->child);
+        SSISlaveClass *ssc = SSI_SLAVE_GET_CLASS(slave);
+
+        if (ssc->transfer_raw != ssi_transfer_raw_default) {
+            /* No idea when this one listens.  */
+            return 0;
+        }
+        if ((slave->cs && ssc->cs_polarity == SSI_CS_HIGH) ||
+            (!slave->cs && ssc->cs_polarity == SSI_CS_LOW) ||
+            ssc->cs_polarity == SSI_CS_NONE) {
+            if (target || !ssc->transfer_bulk) {
+                return 0;
+            }
+            target = slave;
+        }
+    }
+
+    if (!target) {
+        /* Nobody is listening, the bus reads back zeroes.  */
+        if (rx) {
+            memset(rx, 0, len);
+        }
+        return len;
+    }
+    return SSI_SLAVE_GET_CLASS(target)->transfer_bulk(target, tx, rx, len);
+}
+
+void ssi_transfer_bulk(SSIBus *bus, const uint8_t *tx, uint8_t *rx,
+                       size_t len)
+{
+    while (len) {
+        size_t n = ssi_try_transfer_bulk(bus, tx, rx, len);
+
+        if (!n) {
+            uint32_t r = ssi_transfer(bus, tx ? *tx : 0);
+
+            if (rx) {
+                *rx = r;
+            }
+            n = 1;
+        }
+
+        assert(n <= len);
+        tx = tx ? tx + n : NULL;
+        rx = rx ? rx + n : NULL;
+        len -= n;
+    }
+}
+
 const VMStateDescription vmstate_ssi_slave = {
     .name = "SSISlave",
     .version_id = 1,
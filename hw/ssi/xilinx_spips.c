@@ -30,6 +30,8 @@
 #include "qemu/log.h"
 #include "qemu/module.h"
 #include "qemu/bitops.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
 #include "hw/ssi/xilinx_spips.h"
 #include "qapi/error.h"
 #include "hw/register.h"
@@ -459,6 +461,73 @@ static inline void stripe8(uint8_t *x, int num, bool dir)
     memcpy(x, r, sizeof(uint8_t) * num);
 }
 
+/* Drop everything held in the linear mode read cache.  */
+static void lqspi_cache_invalidate(XilinxQSPIPS *q)
+{
+    unsigned int i;
+
+    for (i = 0; i < q->lqspi_cache.num_lines; i++) {
+        q->lqspi_cache.addr[i] = ~0ULL;
+    }
+}
+
+static void xlnx_zynqmp_qspips_gf_done(XlnxZynqMPQSPIPS *s)
+{
+    for (; s->tx_fifo_g_align % 4; s->tx_fifo_g_align++) {
+        fifo8_pop(&s->tx_fifo_g);
+    }
+    for (; s->rx_fifo_g_align % 4; s->rx_fifo_g_align++) {
+        fifo8_push(&s->rx_fifo_g, 0);
+    }
+}
+
+/*
+ * Receive-only data transfers from a single bus are handed to the flash in
+ * one go instead of byte by byte. Returns false if the command needs the
+ * byte path.
+ */
+static bool xlnx_zynqmp_qspips_rx_bulk(XlnxZynqMPQSPIPS *s)
+{
+    XilinxSPIPS *xs = XILINX_SPIPS(s);
+    uint8_t buf[256];
+    uint8_t busses;
+    uint32_t n;
+    int bus;
+
+    if (!ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, DATA_XFER) ||
+        !ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, RECIEVE) ||
+        ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, TRANSMIT) ||
+        ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, STRIPE)) {
+        return false;
+    }
+    busses = ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, DATA_BUS_SELECT);
+    if (busses != 0x1 && busses != 0x2) {
+        return false;
+    }
+
+    /* Keep room for the word alignment padding at the end.  */
+    n = fifo8_num_free(&s->rx_fifo_g);
+    if (n < 4) {
+        return false;
+    }
+    n = MIN(s->regs[R_GQSPI_DATA_STS], n - 3);
+    n = MIN(n, sizeof(buf));
+    bus = busses == 0x2;
+
+    /* Both busses are clocked, only the selected one is sampled.  */
+    ssi_transfer_bulk(xs->spi[bus], NULL, buf, n);
+    ssi_transfer_bulk(xs->spi[!bus], NULL, NULL, n);
+    fifo8_push_all(&s->rx_fifo_g, buf, n);
+    s->rx_fifo_g_align += n;
+    s->regs[R_GQSPI_DATA_STS] -= n;
+    DB_PRINT_L(1, "bus %d bulk rx of %" PRIu32 " bytes\n", bus, n);
+
+    if (!s->regs[R_GQSPI_DATA_STS]) {
+        xlnx_zynqmp_qspips_gf_done(s);
+    }
+    return true;
+}
+
 static void xlnx_zynqmp_qspips_flush_fifo_g(XlnxZynqMPQSPIPS *s)
 {
     while (s->regs[R_GQSPI_DATA_STS] || !fifo32_is_empty(&s->fifo_g)) {
@@ -477,6 +546,8 @@ static void xlnx_zynqmp_qspips_flush_fifo_g(XlnxZynqMPQSPIPS *s)
                 continue;
             }
             xlnx_zynqmp_qspips_update_cs_lines(s);
+            /* The generic FIFO bypasses the snooper, this might program.  */
+            lqspi_cache_invalidate(XILINX_QSPIPS(s));
 
             imm = ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, IMMEDIATE_DATA);
             if (!ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, DATA_XFER)) {
@@ -512,6 +583,9 @@ static void xlnx_zynqmp_qspips_flush_fifo_g(XlnxZynqMPQSPIPS *s)
              ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, RECIEVE))) {
             num_stripes = 2;
         }
+        if (xlnx_zynqmp_qspips_rx_bulk(s)) {
+            continue;
+        }
         if (!ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, DATA_XFER)) {
             tx_rx[0] = ARRAY_FIELD_EX32(s->regs,
                                         GQSPI_GF_SNAPSHOT, IMMEDIATE_DATA);
@@ -551,12 +625,7 @@ static void xlnx_zynqmp_qspips_flush_fifo_g(XlnxZynqMPQSPIPS *s)
             }
         }
         if (!s->regs[R_GQSPI_DATA_STS]) {
-            for (; s->tx_fifo_g_align % 4; s->tx_fifo_g_align++) {
-                fifo8_pop(&s->tx_fifo_g);
-            }
-            for (; s->rx_fifo_g_align % 4; s->rx_fifo_g_align++) {
-                fifo8_push(&s->rx_fifo_g, 0);
-            }
+            xlnx_zynqmp_qspips_gf_done(s);
         }
     }
 }
@@ -622,6 +691,29 @@ static inline uint8_t get_addr_length(XilinxSPIPS *s, uint8_t cmd)
    }
 }
 
+/* Commands that leave the flash contents alone.  */
+static bool xilinx_spips_is_read_cmd(uint8_t cmd)
+{
+    switch (cmd) {
+    case READ:
+    case READ_4:
+    case FAST_READ:
+    case FAST_READ_4:
+    case DOR:
+    case DOR_4:
+    case QOR:
+    case QOR_4:
+    case DIOR:
+    case DIOR_4:
+    case QIOR:
+    case QIOR_4:
+    case JEDEC_READ:
+        return true;
+    default:
+        return false;
+    }
+}
+
 static void xilinx_spips_flush_txfifo(XilinxSPIPS *s)
 {
     int debug_level = 0;
@@ -704,6 +796,13 @@ static void xilinx_spips_flush_txfifo(XilinxSPIPS *s)
             /* Store the count of dummy bytes in the txfifo */
             s->cmd_dummies = xilinx_spips_num_dummies(q, tx);
             addr_length = get_addr_length(s, tx);
+            /*
+             * Anything but a read may program or erase, after which the
+             * linear mode view of the flash is stale.
+             */
+            if (q && !xilinx_spips_is_read_cmd(tx)) {
+                lqspi_cache_invalidate(q);
+            }
             if (s->cmd_dummies < 0) {
                 s->snoop_state = SNOOP_NONE;
             } else {
@@ -1062,11 +1161,6 @@ static const MemoryRegionOps spips_ops = {
     .endianness = DEVICE_LITTLE_ENDIAN,
 };
 
-static void xilinx_qspips_invalidate_mmio_ptr(XilinxQSPIPS *q)
-{
-    q->lqspi_cached_addr = ~0ULL;
-}
-
 static void xilinx_qspips_write(void *opaque, hwaddr addr,
                                 uint64_t value, unsigned size)
 {
@@ -1080,7 +1174,7 @@ static void xilinx_qspips_write(void *opaque, hwaddr addr,
 
     if (addr == R_LQSPI_CFG &&
                ((lqspi_cfg_old ^ value) & ~LQSPI_CFG_U_PAGE)) {
-        q->lqspi_cached_addr = ~0ULL;
+        lqspi_cache_invalidate(q);
         if (q->lqspi_size) {
             uint32_t src = q->lqspi_src;
             uint32_t dst = q->lqspi_dst;
@@ -1187,95 +1281,165 @@ static const MemoryRegionOps xlnx_zynqmp_qspips_ops = {
     .endianness = DEVICE_LITTLE_ENDIAN,
 };
 
-#define LQSPI_CACHE_SIZE 1024
+/* Returns the index of the cache line holding addr, or -1.  */
+static int lqspi_cache_lookup(XilinxQSPIPS *q, hwaddr addr)
+{
+    hwaddr line_addr = addr & ~(hwaddr)(q->lqspi_cache.line_size - 1);
+    unsigned int i;
 
+    if (q->lqspi_cache.addr[q->lqspi_cache.last] == line_addr) {
+        return q->lqspi_cache.last;
+    }
+    for (i = 0; i < q->lqspi_cache.num_lines; i++) {
+        if (q->lqspi_cache.addr[i] == line_addr) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Pick the least recently used line for refilling.  */
+static unsigned int lqspi_cache_victim(XilinxQSPIPS *q)
+{
+    unsigned int i, victim = 0;
+
+    for (i = 0; i < q->lqspi_cache.num_lines; i++) {
+        if (q->lqspi_cache.addr[i] == ~0ULL) {
+            return i;
+        }
+        if (q->lqspi_cache.lru[i] < q->lqspi_cache.lru[victim]) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+/*
+ * Fill the line holding addr, and up to lqspi_cache.prefetch lines after
+ * it, with a single read command. Sequential XIP fetches then only pay
+ * for the command and address once per burst rather than once per line.
+ */
 static void lqspi_load_cache(void *opaque, hwaddr addr)
 {
     XilinxQSPIPS *q = opaque;
     XilinxSPIPS *s = opaque;
+    uint32_t line_size = q->lqspi_cache.line_size;
+    hwaddr line_addr = addr & ~(hwaddr)(line_size - 1);
     int i;
-    int flash_addr = ((addr & ~(LQSPI_CACHE_SIZE - 1))
-                   / num_effective_busses(s));
+    int flash_addr = line_addr / num_effective_busses(s);
     int slave = flash_addr >> LQSPI_ADDRESS_BITS;
-    int cache_entry = 0;
     uint32_t u_page_save = s->regs[R_LQSPI_STS] & ~LQSPI_CFG_U_PAGE;
+    unsigned int nlines, n;
 
-    if (addr < q->lqspi_cached_addr ||
-            addr > q->lqspi_cached_addr + LQSPI_CACHE_SIZE - 4) {
-        xilinx_qspips_invalidate_mmio_ptr(q);
-        s->regs[R_LQSPI_STS] &= ~LQSPI_CFG_U_PAGE;
-        s->regs[R_LQSPI_STS] |= slave ? LQSPI_CFG_U_PAGE : 0;
+    /* The burst stops at the next cached line or the end of the slave.  */
+    for (nlines = 1; nlines <= q->lqspi_cache.prefetch; nlines++) {
+        hwaddr next = line_addr + (hwaddr)nlines * line_size;
 
-        DB_PRINT_L(0, "config reg status: %08x\n", s->regs[R_LQSPI_CFG]);
+        if (next >= memory_region_size(&s->mmlqspi) ||
+            (next / num_effective_busses(s)) >> LQSPI_ADDRESS_BITS != slave ||
+            lqspi_cache_lookup(q, next) >= 0) {
+            break;
+        }
+    }
 
-        fifo8_reset(&s->tx_fifo);
-        fifo8_reset(&s->rx_fifo);
+    s->regs[R_LQSPI_STS] &= ~LQSPI_CFG_U_PAGE;
+    s->regs[R_LQSPI_STS] |= slave ? LQSPI_CFG_U_PAGE : 0;
 
-        /* instruction */
-        DB_PRINT_L(0, "pushing read instruction: %02x\n",
-                   (unsigned)(uint8_t)(s->regs[R_LQSPI_CFG] &
-                                       LQSPI_CFG_INST_CODE));
-        fifo8_push(&s->tx_fifo, s->regs[R_LQSPI_CFG] & LQSPI_CFG_INST_CODE);
-        /* read address */
-        DB_PRINT_L(0, "pushing read address %06x\n", flash_addr);
-        if (s->regs[R_LQSPI_CFG] & LQSPI_CFG_ADDR4) {
-            fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 24));
-        }
-        fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 16));
-        fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 8));
-        fifo8_push(&s->tx_fifo, (uint8_t)flash_addr);
-        /* mode bits */
-        if (s->regs[R_LQSPI_CFG] & LQSPI_CFG_MODE_EN) {
-            fifo8_push(&s->tx_fifo, extract32(s->regs[R_LQSPI_CFG],
-                                              LQSPI_CFG_MODE_SHIFT,
-                                              LQSPI_CFG_MODE_WIDTH));
-        }
-        /* dummy bytes */
-        for (i = 0; i < (extract32(s->regs[R_LQSPI_CFG], LQSPI_CFG_DUMMY_SHIFT,
-                                   LQSPI_CFG_DUMMY_WIDTH)); ++i) {
-            DB_PRINT_L(0, "pushing dummy byte\n");
-            fifo8_push(&s->tx_fifo, 0);
-        }
-        xilinx_spips_update_cs_lines(s);
-        xilinx_spips_flush_txfifo(s);
-        fifo8_reset(&s->rx_fifo);
+    DB_PRINT_L(0, "config reg status: %08x\n", s->regs[R_LQSPI_CFG]);
 
-        DB_PRINT_L(0, "starting QSPI data read\n");
+    fifo8_reset(&s->tx_fifo);
+    fifo8_reset(&s->rx_fifo);
 
-        while (cache_entry < LQSPI_CACHE_SIZE) {
+    /* instruction */
+    DB_PRINT_L(0, "pushing read instruction: %02x\n",
+               (unsigned)(uint8_t)(s->regs[R_LQSPI_CFG] &
+                                   LQSPI_CFG_INST_CODE));
+    fifo8_push(&s->tx_fifo, s->regs[R_LQSPI_CFG] & LQSPI_CFG_INST_CODE);
+    /* read address */
+    DB_PRINT_L(0, "pushing read address %06x\n", flash_addr);
+    if (s->regs[R_LQSPI_CFG] & LQSPI_CFG_ADDR4) {
+        fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 24));
+    }
+    fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 16));
+    fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 8));
+    fifo8_push(&s->tx_fifo, (uint8_t)flash_addr);
+    /* mode bits */
+    if (s->regs[R_LQSPI_CFG] & LQSPI_CFG_MODE_EN) {
+        fifo8_push(&s->tx_fifo, extract32(s->regs[R_LQSPI_CFG],
+                                          LQSPI_CFG_MODE_SHIFT,
+                                          LQSPI_CFG_MODE_WIDTH));
+    }
+    /* dummy bytes */
+    for (i = 0; i < (extract32(s->regs[R_LQSPI_CFG], LQSPI_CFG_DUMMY_SHIFT,
+                               LQSPI_CFG_DUMMY_WIDTH)); ++i) {
+        DB_PRINT_L(0, "pushing dummy byte\n");
+        fifo8_push(&s->tx_fifo, 0);
+    }
+    xilinx_spips_update_cs_lines(s);
+    xilinx_spips_flush_txfifo(s);
+    fifo8_reset(&s->rx_fifo);
+
+    DB_PRINT_L(0, "starting QSPI data read of %u lines\n", nlines);
+
+    for (n = 0; n < nlines; n++) {
+        unsigned int line = lqspi_cache_victim(q);
+        uint8_t *buf = q->lqspi_cache.data + (size_t)line * line_size;
+        uint32_t cache_entry = 0;
+
+        /*
+         * Past the dummy cycles a single flash just streams data, fetch the
+         * whole line in one transfer when nothing is left to snoop.
+         */
+        if (num_effective_busses(s) == 1 && s->snoop_state == SNOOP_NONE &&
+            !s->link_state_next_when && !s->rx_discard &&
+            !(s->regs[R_CMND] & R_CMND_RXFIFO_DRAIN)) {
+            ssi_transfer_bulk(s->spi[0], NULL, buf, line_size);
+            cache_entry = line_size;
+        }
+
+        while (cache_entry < line_size) {
             for (i = 0; i < 64; ++i) {
                 tx_data_bytes(&s->tx_fifo, 0, 1, false);
             }
             xilinx_spips_flush_txfifo(s);
             for (i = 0; i < 64; ++i) {
-                rx_data_bytes(&s->rx_fifo, &q->lqspi_buf[cache_entry++], 1);
+                rx_data_bytes(&s->rx_fifo, &buf[cache_entry++], 1);
             }
         }
 
-        s->regs[R_LQSPI_STS] &= ~LQSPI_CFG_U_PAGE;
-        s->regs[R_LQSPI_STS] |= u_page_save;
-        xilinx_spips_update_cs_lines(s);
-
-        q->lqspi_cached_addr = flash_addr * num_effective_busses(s);
+        q->lqspi_cache.addr[line] = line_addr + (hwaddr)n * line_size;
+        q->lqspi_cache.lru[line] = ++q->lqspi_cache.stamp;
     }
+
+    s->regs[R_LQSPI_STS] &= ~LQSPI_CFG_U_PAGE;
+    s->regs[R_LQSPI_STS] |= u_page_save;
+    xilinx_spips_update_cs_lines(s);
 }
 
 static MemTxResult lqspi_read(void *opaque, hwaddr addr, uint64_t *value,
                               unsigned size, MemTxAttrs attrs)
 {
     XilinxQSPIPS *q = XILINX_QSPIPS(opaque);
-
-    if (addr >= q->lqspi_cached_addr &&
-            addr <= q->lqspi_cached_addr + LQSPI_CACHE_SIZE - 4) {
-        uint8_t *retp = &q->lqspi_buf[addr - q->lqspi_cached_addr];
-        *value = cpu_to_le32(*(uint32_t *)retp);
-        DB_PRINT_L(1, "addr: %08" HWADDR_PRIx ", data: %08" PRIx64 "\n",
-                   addr, *value);
-        return MEMTX_OK;
+    uint32_t offset = addr & (q->lqspi_cache.line_size - 1);
+    int line = lqspi_cache_lookup(q, addr);
+    uint8_t *retp;
+
+    if (line < 0) {
+        lqspi_load_cache(opaque, addr);
+        line = lqspi_cache_lookup(q, addr);
+        assert(line >= 0);
     }
 
-    lqspi_load_cache(opaque, addr);
-    return lqspi_read(opaque, addr, value, size, attrs);
+    q->lqspi_cache.last = line;
+    q->lqspi_cache.lru[line] = ++q->lqspi_cache.stamp;
+
+    /* Accesses are aligned by the core, they never straddle two lines.  */
+    retp = q->lqspi_cache.data + (size_t)line * q->lqspi_cache.line_size +
+           offset;
+    *value = ldn_le_p(retp, size);
+    DB_PRINT_L(1, "addr: %08" HWADDR_PRIx ", data: %08" PRIx64 "\n",
+               addr, *value);
+    return MEMTX_OK;
 }
 
 static MemTxResult lqspi_write(void *opaque, hwaddr offset, uint64_t value,
@@ -1369,13 +1533,31 @@ static void xilinx_qspips_realize(DeviceState *dev, Error **errp)
     s->num_txrx_bytes = 4;
 
     xilinx_spips_realize(dev, errp);
+
+    if (!is_power_of_2(q->lqspi_cache.line_size) ||
+        q->lqspi_cache.line_size < 64 ||
+        q->lqspi_cache.line_size > (1 << LQSPI_ADDRESS_BITS)) {
+        error_setg(errp, "lqspi-cache-line-size must be a power of 2 "
+                   "between 64 and %d", 1 << LQSPI_ADDRESS_BITS);
+        return;
+    }
+    if (!q->lqspi_cache.num_lines) {
+        error_setg(errp, "lqspi-cache-lines must be at least 1");
+        return;
+    }
+    q->lqspi_cache.prefetch = MIN(q->lqspi_cache.prefetch,
+                                  q->lqspi_cache.num_lines - 1);
+    q->lqspi_cache.data = g_malloc((size_t)q->lqspi_cache.num_lines *
+                                   q->lqspi_cache.line_size);
+    q->lqspi_cache.addr = g_new(hwaddr, q->lqspi_cache.num_lines);
+    q->lqspi_cache.lru = g_new0(uint64_t, q->lqspi_cache.num_lines);
+    lqspi_cache_invalidate(q);
+
     q->hack_as = q->hack_dma ? address_space_init_shareable(q->hack_dma,
                 NULL) : &address_space_memory;
     memory_region_init_io(&s->mmlqspi, OBJECT(s), &lqspi_ops, s, "lqspi",
                           (1 << LQSPI_ADDRESS_BITS) * 2);
     sysbus_init_mmio(sbd, &s->mmlqspi);
-
-    q->lqspi_cached_addr = ~0ULL;
 }
 
 static void xlnx_zynqmp_qspips_realize(DeviceState *dev, Error **errp)
@@ -1475,6 +1657,12 @@ static Property xilinx_qspips_properties[] = {
     DEFINE_PROP_UINT32("lqspi-size", XilinxQSPIPS, lqspi_size, 0),
     DEFINE_PROP_UINT32("lqspi-src", XilinxQSPIPS, lqspi_src, 0),
     DEFINE_PROP_UINT32("lqspi-dst", XilinxQSPIPS, lqspi_dst, 0),
+    DEFINE_PROP_UINT32("lqspi-cache-lines", XilinxQSPIPS,
+                       lqspi_cache.num_lines, LQSPI_CACHE_LINES),
+    DEFINE_PROP_UINT32("lqspi-cache-line-size", XilinxQSPIPS,
+                       lqspi_cache.line_size, LQSPI_CACHE_LINE_SIZE),
+    DEFINE_PROP_UINT32("lqspi-prefetch", XilinxQSPIPS,
+                       lqspi_cache.prefetch, 1),
     /* We had to turn this off for 2.10 as it is not compatible with migration.
      * It can be enabled but will prevent the device to be migrated.
      * This will go aways when a fix will be released.
@@ -835,7 +835,7 @@ static void ospi_rx_fifo_pop_stig_rd_data(OSPI *s)
 
 static void ospi_ind_read(OSPI *s, uint32_t flash_addr, uint32_t len)
 {
-    int i;
+    uint8_t buf[256];
 
     /* Create first section of read cmd */
     ospi_tx_fifo_push_rd_op_addr(s, flash_addr);
@@ -846,14 +846,13 @@ static void ospi_ind_read(OSPI *s, uint32_t flash_addr, uint32_t len)
 
     fifo_reset(&s->rx_fifo);
 
-    /* transmit second part (data) */
-    for (i = 0; i < len; ++i) {
-        fifo_push8(&s->tx_fifo, 0);
-    }
-    ospi_flush_txfifo(s);
+    /* second part (data), straight from the flash into the SRAM */
+    while (len) {
+        uint32_t n = MIN(len, sizeof(buf));
 
-    for (i = 0; i < len; ++i) {
-        fifo_push8(&s->rx_sram, fifo_pop8(&s->rx_fifo));
+        ssi_transfer_bulk(s->spi, NULL, buf, n);
+        fifo_push_all(&s->rx_sram, buf, n);
+        len -= n;
     }
 
     /* done */
@@ -1016,7 +1015,6 @@ static void ospi_ind_write(OSPI *s, uint32_t flash_addr, uint32_t len)
 {
     bool ahb_decoder_cs = false;
     uint8_t inst_code;
-    int i;
 
     assert(fifo_num_used(&s->tx_sram) >= len);
 
@@ -1035,15 +1033,20 @@ static void ospi_ind_write(OSPI *s, uint32_t flash_addr, uint32_t len)
     /* Push write address */
     ospi_tx_fifo_push_address(s, flash_addr);
 
-    /* data */
-    for (i = 0; i < len; i++) {
-        fifo_push8(&s->tx_fifo, fifo_pop8(&s->tx_sram));
-    }
-
-    /* transmit */
+    /* transmit opcode and address */
     ospi_update_cs_lines(s);
     ospi_flush_txfifo(s);
 
+    /* data, straight from the SRAM to the flash */
+    while (len) {
+        const uint8_t *data;
+        uint32_t n;
+
+        data = fifo_pop_buf(&s->tx_sram, len, &n);
+        ssi_transfer_bulk(s->spi, data, NULL, n);
+        len -= n;
+    }
+
     /* done */
     ospi_disable_cs(s);
     fifo_reset(&s->rx_fifo);
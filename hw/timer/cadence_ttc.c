@@ -155,7 +155,7 @@ static inline int64_t is_between(int64_t x, int64_t a, int64_t b)
 static void cadence_timer_run(CadenceTimerState *s)
 {
     int i;
-    int64_t event_interval, next_value;
+    int64_t event_interval, next_value, next_event;
 
     assert(s->cpu_time_valid); /* cadence_timer_sync must be called first */
 
@@ -182,9 +182,19 @@ static void cadence_timer_run(CadenceTimerState *s)
 
     event_interval = next_value - (int64_t)s->reg_value;
     event_interval = (event_interval < 0) ? -event_interval : event_interval;
+    next_event = s->cpu_time + cadence_timer_get_ns(s, event_interval);
+
+    /*
+     * If every enabled interrupt is already pending, the next rollover or
+     * match has nothing to signal: cadence_timer_sync() works it out when
+     * the guest next looks.  Still sync once a second so that the step
+     * count there stays within the precise range.
+     */
+    if (!(s->reg_intr_en & ~s->reg_intr)) {
+        next_event = MAX(next_event, s->cpu_time + NANOSECONDS_PER_SECOND);
+    }
 
-    timer_mod(s->timer, s->cpu_time +
-                cadence_timer_get_ns(s, event_interval));
+    timer_mod(s->timer, next_event);
 }
 
 static void cadence_timer_sync(CadenceTimerState *s)
@@ -214,8 +224,10 @@ static void cadence_timer_sync(CadenceTimerState *s)
             continue;
         }
         /* check to see if match event has occurred. check m +/- interval
-         * to account for match events in wrap around cases */
-        if (is_between(m, s->reg_value, x) ||
+         * to account for match events in wrap around cases; a full
+         * interval or more passes every match */
+        if (r >= interval ||
+            is_between(m, s->reg_value, x) ||
             is_between(m + interval, s->reg_value, x) ||
             is_between(m - interval, s->reg_value, x)) {
             s->reg_intr |= (2 << i);
@@ -293,6 +305,10 @@ static uint32_t cadence_ttc_read_imp(void *opaque, hwaddr offset)
         value = s->reg_intr;
         s->reg_intr = 0;
         cadence_timer_update(s);
+        if (s->cpu_time_valid) {
+            /* cleared interrupts can be signalled again */
+            cadence_timer_run(s);
+        }
         return value;
 
     case 0x60: /* interrupt enable */
@@ -56,6 +56,7 @@ struct xlx_timer
     int nr; /* for debug.  */
 
     unsigned long timer_div;
+    bool periodic;
 
     uint32_t regs[R_MAX];
 };
@@ -132,22 +133,39 @@ timer_read(void *opaque, hwaddr addr, unsigned int size)
     return r;
 }
 
+static uint64_t timer_load_value(struct xlx_timer *xt)
+{
+    if (xt->regs[R_TCSR] & TCSR_UDT) {
+        return xt->regs[R_TLR];
+    }
+    return (uint32_t)~0 - xt->regs[R_TLR];
+}
+
+/*
+ * An auto-reloading timer whose interrupt is already pending and masked
+ * has nothing to signal on expiry, so let the ptimer skip the wakeups.
+ * Must be called inside ptimer transaction block.
+ */
+static void timer_update_lazy(struct xlx_timer *xt)
+{
+    uint32_t csr = xt->regs[R_TCSR];
+
+    ptimer_set_lazy(xt->ptimer, xt->periodic && (csr & TCSR_TINT) &&
+                                !(csr & TCSR_ENIT));
+}
+
 /* Must be called inside ptimer transaction block */
 static void timer_enable(struct xlx_timer *xt)
 {
-    uint64_t count;
-
     D(fprintf(stderr, "%s timer=%d down=%d\n", __func__,
               xt->nr, xt->regs[R_TCSR] & TCSR_UDT));
 
     ptimer_stop(xt->ptimer);
 
-    if (xt->regs[R_TCSR] & TCSR_UDT)
-        count = xt->regs[R_TLR];
-    else
-        count = ~0 - xt->regs[R_TLR];
-    ptimer_set_limit(xt->ptimer, count, 1);
-    ptimer_run(xt->ptimer, 1);
+    /* Auto-reload runs as a periodic ptimer rather than re-arming on hit */
+    xt->periodic = xt->regs[R_TCSR] & TCSR_ARHT;
+    ptimer_set_limit(xt->ptimer, timer_load_value(xt), 1);
+    ptimer_run(xt->ptimer, !xt->periodic);
 }
 
 static void
@@ -173,13 +191,31 @@ timer_write(void *opaque, hwaddr addr,
                 value &= ~TCSR_TINT;
 
             xt->regs[addr] = value & 0x7ff;
+            ptimer_transaction_begin(xt->ptimer);
             if (value & TCSR_ENT) {
-                ptimer_transaction_begin(xt->ptimer);
                 timer_enable(xt);
+            } else if (xt->periodic) {
+                if (!(value & TCSR_ARHT)) {
+                    /* Auto-reload turned off: stop after this period */
+                    xt->periodic = false;
+                    ptimer_run(xt->ptimer, 1);
+                } else {
+                    ptimer_set_limit(xt->ptimer, timer_load_value(xt), 0);
+                }
+            }
+            timer_update_lazy(xt);
+            ptimer_transaction_commit(xt->ptimer);
+            break;
+
+        case R_TLR:
+            xt->regs[addr] = value;
+            if (xt->periodic) {
+                ptimer_transaction_begin(xt->ptimer);
+                ptimer_set_limit(xt->ptimer, timer_load_value(xt), 0);
                 ptimer_transaction_commit(xt->ptimer);
             }
             break;
- 
+
         default:
             if (addr < ARRAY_SIZE(xt->regs))
                 xt->regs[addr] = value;
@@ -205,8 +241,11 @@ static void timer_hit(void *opaque)
     D(fprintf(stderr, "%s %d\n", __func__, xt->nr));
     xt->regs[R_TCSR] |= TCSR_TINT;
 
-    if (xt->regs[R_TCSR] & TCSR_ARHT)
+    /* Auto-reload enabled after the timer was started as a one-shot */
+    if (!xt->periodic && (xt->regs[R_TCSR] & TCSR_ARHT)) {
         timer_enable(xt);
+    }
+    timer_update_lazy(xt);
     timer_update_irq(t);
 }
 
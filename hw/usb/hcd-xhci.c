@@ -715,22 +715,60 @@ static void xhci_ring_init(XHCIState *xhci, XHCIRing *ring,
 {
     ring->dequeue = base;
     ring->ccs = 1;
+    ring->cache_len = 0;
+}
+
+static void xhci_ring_flush(XHCIRing *ring)
+{
+    ring->cache_len = 0;
+}
+
+/*
+ * Read the TRB at @addr of @ring, whose cycle state there is @ccs.
+ *
+ * TRBs are read in blocks of up to XHCI_RING_CACHE_TRBS that do not cross
+ * a page, and the rest of the block is kept for the next reads.  A cached
+ * TRB is only used while its cycle bit says that it belongs to the
+ * controller.  Software does not touch such TRBs while the endpoint is
+ * running, so they cannot be stale.  Any other TRB is read again, as
+ * software may just have handed it over.
+ */
+static void xhci_ring_read(XHCIState *xhci, XHCIRing *ring, dma_addr_t addr,
+                           bool ccs, XHCITRB *trb)
+{
+    PCIDevice *pci_dev = PCI_DEVICE(xhci);
+    dma_addr_t off = addr - ring->cache_base;
+
+    if (addr < ring->cache_base || off >= ring->cache_len * TRB_SIZE ||
+        (ldl_le_p(ring->cache + off + 12) & TRB_C) != ccs) {
+        dma_addr_t len = MIN(sizeof(ring->cache), 0x1000 - (addr & 0xfff));
+
+        /* The block may run past the end of the segment, into nothing */
+        if (len < TRB_SIZE ||
+            pci_dma_read(pci_dev, addr, ring->cache, len) != 0) {
+            len = TRB_SIZE;
+            pci_dma_read(pci_dev, addr, ring->cache, len);
+        }
+        ring->cache_base = addr;
+        ring->cache_len = len / TRB_SIZE;
+        off = 0;
+    }
+
+    trb->parameter = ldq_le_p(ring->cache + off);
+    trb->status = ldl_le_p(ring->cache + off + 8);
+    trb->control = ldl_le_p(ring->cache + off + 12);
 }
 
 static TRBType xhci_ring_fetch(XHCIState *xhci, XHCIRing *ring, XHCITRB *trb,
                                dma_addr_t *addr)
 {
-    PCIDevice *pci_dev = PCI_DEVICE(xhci);
     uint32_t link_cnt = 0;
 
     while (1) {
         TRBType type;
-        pci_dma_read(pci_dev, ring->dequeue, trb, TRB_SIZE);
+        xhci_ring_read(xhci, ring, ring->dequeue, ring->ccs, trb);
         trb->addr = ring->dequeue;
         trb->ccs = ring->ccs;
-        le64_to_cpus(&trb->parameter);
-        le32_to_cpus(&trb->status);
-        le32_to_cpus(&trb->control);
 
         trace_usb_xhci_fetch_trb(ring->dequeue, trb_name(trb),
                                  trb->parameter, trb->status, trb->control);
@@ -760,9 +798,8 @@ static TRBType xhci_ring_fetch(XHCIState *xhci, XHCIRing *ring, XHCITRB *trb,
     }
 }
 
-static int xhci_ring_chain_length(XHCIState *xhci, const XHCIRing *ring)
+static int xhci_ring_chain_length(XHCIState *xhci, XHCIRing *ring)
 {
-    PCIDevice *pci_dev = PCI_DEVICE(xhci);
     XHCITRB trb;
     int length = 0;
     dma_addr_t dequeue = ring->dequeue;
@@ -773,10 +810,7 @@ static int xhci_ring_chain_length(XHCIState *xhci, const XHCIRing *ring)
 
     while (1) {
         TRBType type;
-        pci_dma_read(pci_dev, dequeue, &trb, TRB_SIZE);
-        le64_to_cpus(&trb.parameter);
-        le32_to_cpus(&trb.status);
-        le32_to_cpus(&trb.control);
+        xhci_ring_read(xhci, ring, dequeue, ccs, &trb);
 
         if ((trb.control & TRB_C) != ccs) {
             return -length;
@@ -1071,6 +1105,10 @@ static void xhci_set_ep_state(XHCIState *xhci, XHCIEPContext *epctx,
     }
 
     xhci_dma_write_u32s(xhci, epctx->pctx, ctx, sizeof(ctx));
+    if (ring && state != EP_RUNNING) {
+        /* Software may now edit the TRBs that the controller owned */
+        xhci_ring_flush(ring);
+    }
     if (epctx->state != state) {
         trace_usb_xhci_ep_state(epctx->slotid, epctx->epid,
                                 ep_state_name(epctx->state),
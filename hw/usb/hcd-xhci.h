@@ -125,9 +125,16 @@ typedef enum TRBCCode {
     CC_SPLIT_TRANSACTION_ERROR
 } TRBCCode;
 
+/* Number of TRBs that are read from a ring at once */
+#define XHCI_RING_CACHE_TRBS 16
+
 typedef struct XHCIRing {
     dma_addr_t dequeue;
     bool ccs;
+    /* TRBs read ahead from @cache_base, in guest byte order */
+    dma_addr_t cache_base;
+    unsigned int cache_len;
+    uint8_t cache[XHCI_RING_CACHE_TRBS * 16];
 } XHCIRing;
 
 typedef struct XHCIPort {
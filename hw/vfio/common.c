@@ -356,6 +356,58 @@ static int vfio_dma_map(VFIOContainer *container, hwaddr iova,
     return -errno;
 }
 
+/*
+ * Guest IOMMU drivers tend to tear down large buffers one page at a time.
+ * When lazy unmapping is enabled on the container, contiguous unmaps are
+ * merged into a single pending range that is handed to the kernel from a
+ * bottom half, or before anything else touches the container mappings.
+ */
+static void vfio_dma_unmap_flush(VFIOContainer *container)
+{
+    hwaddr iova = container->unmap_iova;
+    hwaddr size = container->unmap_size;
+    int ret;
+
+    if (!size) {
+        return;
+    }
+    container->unmap_size = 0;
+
+    trace_vfio_dma_unmap_flush(iova, size);
+    ret = vfio_dma_unmap(container, iova, size);
+    if (ret) {
+        error_report("vfio_dma_unmap(%p, 0x%"HWADDR_PRIx", "
+                     "0x%"HWADDR_PRIx") = %d (%m)",
+                     container, iova, size, ret);
+    }
+}
+
+static void vfio_dma_unmap_bh(void *opaque)
+{
+    vfio_dma_unmap_flush(opaque);
+}
+
+static void vfio_dma_unmap_lazy(VFIOContainer *container,
+                                hwaddr iova, hwaddr size)
+{
+    if (container->unmap_size) {
+        if (iova == container->unmap_iova + container->unmap_size) {
+            container->unmap_size += size;
+            return;
+        }
+        if (iova + size == container->unmap_iova) {
+            container->unmap_iova = iova;
+            container->unmap_size += size;
+            return;
+        }
+        vfio_dma_unmap_flush(container);
+    }
+
+    container->unmap_iova = iova;
+    container->unmap_size = size;
+    qemu_bh_schedule(container->unmap_bh);
+}
+
 static void vfio_host_win_add(VFIOContainer *container,
                               hwaddr min_iova, hwaddr max_iova,
                               uint64_t iova_pgsizes)
@@ -470,6 +522,8 @@ static void vfio_iommu_map_notify(IOMMUNotifier *n, IOMMUTLBEntry *iotlb)
         if (!vfio_get_vaddr(iotlb, &vaddr, &read_only)) {
             goto out;
         }
+        /* The kernel rejects maps overlapping a range still mapped */
+        vfio_dma_unmap_flush(container);
         /*
          * vaddr is only valid until rcu_read_unlock(). But after
          * vfio_dma_map has set up the mapping the pages will be
@@ -486,6 +540,8 @@ static void vfio_iommu_map_notify(IOMMUNotifier *n, IOMMUTLBEntry *iotlb)
                          container, iova,
                          iotlb->addr_mask + 1, vaddr, ret);
         }
+    } else if (container->unmap_bh) {
+        vfio_dma_unmap_lazy(container, iova, iotlb->addr_mask + 1);
     } else {
         ret = vfio_dma_unmap(container, iova, iotlb->addr_mask + 1);
         if (ret) {
@@ -748,6 +804,7 @@ static void vfio_listener_region_del(MemoryListener *listener,
                 break;
             }
         }
+        vfio_dma_unmap_flush(container);
 
         /*
          * FIXME: We assume the one big unmap below is adequate to
@@ -1415,6 +1472,7 @@ static void vfio_disconnect_container(VFIOGroup *group)
 {
     VFIOContainer *container = group->container;
 
+    vfio_dma_unmap_flush(container);
     QLIST_REMOVE(group, container_next);
     group->container = NULL;
 
@@ -1445,6 +1503,10 @@ static void vfio_disconnect_container(VFIOGroup *group)
             g_free(giommu);
         }
 
+        if (container->unmap_bh) {
+            qemu_bh_delete(container->unmap_bh);
+        }
+
         trace_vfio_disconnect_container(container->fd);
         close(container->fd);
         g_free(container);
@@ -1584,6 +1646,12 @@ int vfio_get_device(VFIOGroup *group, const char *name,
         }
     }
 
+    /* One device asking for it is enough, unmaps are per container */
+    if (vbasedev->lazy_iommu_unmap && !group->container->unmap_bh) {
+        group->container->unmap_bh = qemu_bh_new(vfio_dma_unmap_bh,
+                                                 group->container);
+    }
+
     vbasedev->fd = fd;
     vbasedev->group = group;
     QLIST_INSERT_HEAD(&group->device_list, vbasedev, next);
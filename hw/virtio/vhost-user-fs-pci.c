@@ -13,12 +13,15 @@
 
 #include "qemu/osdep.h"
 #include "hw/qdev-properties.h"
+#include "qapi/error.h"
 #include "hw/virtio/vhost-user-fs.h"
+#include "standard-headers/linux/virtio_fs.h"
 #include "virtio-pci.h"
 
 struct VHostUserFSPCI {
     VirtIOPCIProxy parent_obj;
     VHostUserFS vdev;
+    MemoryRegion cachebar;
 };
 
 typedef struct VHostUserFSPCI VHostUserFSPCI;
@@ -28,6 +31,9 @@ typedef struct VHostUserFSPCI VHostUserFSPCI;
 #define VHOST_USER_FS_PCI(obj) \
         OBJECT_CHECK(VHostUserFSPCI, (obj), TYPE_VHOST_USER_FS_PCI)
 
+/* The DAX cache BAR, shared with the modern PIO notify BAR */
+#define VIRTIO_FS_PCI_CACHE_BAR 2
+
 static Property vhost_user_fs_pci_properties[] = {
     DEFINE_PROP_UINT32("vectors", VirtIOPCIProxy, nvectors,
                        DEV_NVECTORS_UNSPECIFIED),
@@ -38,6 +44,13 @@ static void vhost_user_fs_pci_realize(VirtIOPCIProxy *vpci_dev, Error **errp)
 {
     VHostUserFSPCI *dev = VHOST_USER_FS_PCI(vpci_dev);
     DeviceState *vdev = DEVICE(&dev->vdev);
+    uint64_t cachesize = dev->vdev.conf.cache_size;
+    Error *local_err = NULL;
+
+    if (cachesize && (vpci_dev->flags & VIRTIO_PCI_FLAG_MODERN_PIO_NOTIFY)) {
+        error_setg(errp, "cache-size cannot be used with modern-pio-notify");
+        return;
+    }
 
     if (vpci_dev->nvectors == DEV_NVECTORS_UNSPECIFIED) {
         /* Also reserve config change and hiprio queue vectors */
@@ -45,7 +58,26 @@ static void vhost_user_fs_pci_realize(VirtIOPCIProxy *vpci_dev, Error **errp)
     }
 
     qdev_set_parent_bus(vdev, BUS(&vpci_dev->bus));
-    object_property_set_bool(OBJECT(vdev), true, "realized", errp);
+    object_property_set_bool(OBJECT(vdev), true, "realized", &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+
+    if (cachesize) {
+        memory_region_init(&dev->cachebar, OBJECT(vpci_dev),
+                           "vhost-fs-pci-cachebar", cachesize);
+        memory_region_add_subregion(&dev->cachebar, 0, &dev->vdev.cache);
+        virtio_pci_add_shm_cap(vpci_dev, VIRTIO_FS_PCI_CACHE_BAR, 0, cachesize,
+                               VIRTIO_FS_SHMCAP_ID_CACHE);
+
+        /* After 'realized' so the memory region exists */
+        pci_register_bar(&vpci_dev->pci_dev, VIRTIO_FS_PCI_CACHE_BAR,
+                         PCI_BASE_ADDRESS_SPACE_MEMORY |
+                         PCI_BASE_ADDRESS_MEM_PREFETCH |
+                         PCI_BASE_ADDRESS_MEM_TYPE_64,
+                         &dev->cachebar);
+    }
 }
 
 static void vhost_user_fs_pci_class_init(ObjectClass *klass, void *data)
@@ -13,6 +13,7 @@
 
 #include "qemu/osdep.h"
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include "standard-headers/linux/virtio_fs.h"
 #include "qapi/error.h"
 #include "hw/qdev-properties.h"
@@ -21,6 +22,141 @@
 #include "qemu/error-report.h"
 #include "hw/virtio/vhost-user-fs.h"
 #include "monitor/monitor.h"
+#include "trace.h"
+
+/*
+ * Replace a range of the DAX cache with inaccessible anonymous memory, which
+ * drops whatever file the daemon had mapped there.
+ */
+static int vuf_cache_clear(VHostUserFS *fs, uint64_t offset, uint64_t len)
+{
+    uint8_t *ptr = memory_region_get_ram_ptr(&fs->cache) + offset;
+
+    if (mmap(ptr, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+             -1, 0) != ptr) {
+        return -errno;
+    }
+    return 0;
+}
+
+static VHostUserFS *vuf_from_vhost_dev(struct vhost_dev *dev)
+{
+    VHostUserFS *fs = NULL;
+
+    if (dev->vdev) {
+        fs = (VHostUserFS *)object_dynamic_cast(OBJECT(dev->vdev),
+                                                TYPE_VHOST_USER_FS);
+    }
+    if (!fs || !fs->conf.cache_size) {
+        error_report("vhost-user-fs: DAX request without a cache");
+        return NULL;
+    }
+    return fs;
+}
+
+static bool vuf_cache_range_valid(VHostUserFS *fs, uint64_t offset,
+                                  uint64_t len)
+{
+    return offset + len >= offset && offset + len <= fs->conf.cache_size;
+}
+
+int vhost_user_fs_slave_map(struct vhost_dev *dev, VhostUserFSSlaveMsg *sm,
+                            int fd)
+{
+    VHostUserFS *fs = vuf_from_vhost_dev(dev);
+    uint8_t *cache_host;
+    unsigned int i;
+    int res = 0;
+
+    if (!fs) {
+        return -1;
+    }
+    if (fd < 0) {
+        error_report("vhost-user-fs: DAX map request without a file");
+        return -1;
+    }
+
+    cache_host = memory_region_get_ram_ptr(&fs->cache);
+    for (i = 0; i < VHOST_USER_FS_SLAVE_ENTRIES; i++) {
+        int prot = 0;
+        void *ptr;
+
+        if (sm->len[i] == 0) {
+            continue;
+        }
+
+        if (!vuf_cache_range_valid(fs, sm->c_offset[i], sm->len[i])) {
+            error_report("vhost-user-fs: bad DAX map range 0x%" PRIx64
+                         "+0x%" PRIx64, sm->c_offset[i], sm->len[i]);
+            res = -1;
+            break;
+        }
+
+        if (sm->flags[i] & VHOST_USER_FS_FLAG_MAP_R) {
+            prot |= PROT_READ;
+        }
+        if (sm->flags[i] & VHOST_USER_FS_FLAG_MAP_W) {
+            prot |= PROT_WRITE;
+        }
+
+        trace_vhost_user_fs_slave_map(sm->c_offset[i], sm->len[i],
+                                      sm->fd_offset[i], sm->flags[i]);
+        ptr = mmap(cache_host + sm->c_offset[i], sm->len[i], prot,
+                   MAP_SHARED | MAP_FIXED, fd, sm->fd_offset[i]);
+        if (ptr != cache_host + sm->c_offset[i]) {
+            res = -errno;
+            error_report("vhost-user-fs: DAX map failed: %s", strerror(errno));
+            break;
+        }
+    }
+
+    if (res) {
+        /* Don't leave a partial request behind */
+        vhost_user_fs_slave_unmap(dev, sm);
+    }
+    return res;
+}
+
+int vhost_user_fs_slave_unmap(struct vhost_dev *dev, VhostUserFSSlaveMsg *sm)
+{
+    VHostUserFS *fs = vuf_from_vhost_dev(dev);
+    unsigned int i;
+    int res = 0;
+
+    if (!fs) {
+        return -1;
+    }
+
+    for (i = 0; i < VHOST_USER_FS_SLAVE_ENTRIES; i++) {
+        uint64_t offset = sm->c_offset[i];
+        uint64_t len = sm->len[i];
+        int ret;
+
+        if (len == 0) {
+            continue;
+        }
+        if (len == ~(uint64_t)0) {
+            offset = 0;
+            len = fs->conf.cache_size;
+        }
+
+        if (!vuf_cache_range_valid(fs, offset, len)) {
+            error_report("vhost-user-fs: bad DAX unmap range 0x%" PRIx64
+                         "+0x%" PRIx64, offset, len);
+            res = -1;
+            continue;
+        }
+
+        trace_vhost_user_fs_slave_unmap(offset, len);
+        ret = vuf_cache_clear(fs, offset, len);
+        if (ret < 0) {
+            error_report("vhost-user-fs: DAX unmap failed: %s", strerror(-ret));
+            res = ret;
+        }
+    }
+
+    return res;
+}
 
 static void vuf_get_config(VirtIODevice *vdev, uint8_t *config)
 {
@@ -97,6 +233,11 @@ static void vuf_stop(VirtIODevice *vdev)
 
     vhost_dev_stop(&fs->vhost_dev, vdev);
 
+    /* The guest's view of the cache doesn't survive a reset */
+    if (fs->conf.cache_size) {
+        vuf_cache_clear(fs, 0, fs->conf.cache_size);
+    }
+
     ret = k->set_guest_notifiers(qbus->parent, fs->vhost_dev.nvqs, false);
     if (ret < 0) {
         error_report("vhost guest notifier cleanup failed: %d", ret);
@@ -201,10 +342,36 @@ static void vuf_device_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (fs->conf.cache_size &&
+        (!is_power_of_2(fs->conf.cache_size) ||
+         fs->conf.cache_size < qemu_real_host_page_size)) {
+        error_setg(errp, "cache-size property must be a power of 2 "
+                         "no smaller than the page size");
+        return;
+    }
+
     if (!vhost_user_init(&fs->vhost_user, &fs->conf.chardev, errp)) {
         return;
     }
 
+    if (fs->conf.cache_size) {
+        /*
+         * Reserve the DAX window; the daemon maps file ranges into it on
+         * request of the guest driver, which decides which ranges to keep.
+         */
+        void *cache_ptr = mmap(NULL, fs->conf.cache_size, PROT_NONE,
+                               MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (cache_ptr == MAP_FAILED) {
+            error_setg_errno(errp, errno, "Unable to mmap blank cache");
+            vhost_user_cleanup(&fs->vhost_user);
+            return;
+        }
+
+        memory_region_init_ram_device_ptr(&fs->cache, OBJECT(vdev),
+                                          "virtio-fs-cache",
+                                          fs->conf.cache_size, cache_ptr);
+    }
+
     virtio_init(vdev, "vhost-user-fs", VIRTIO_ID_FS,
                 sizeof(struct virtio_fs_config));
 
@@ -231,6 +398,10 @@ static void vuf_device_realize(DeviceState *dev, Error **errp)
 
 err_virtio:
     vhost_user_cleanup(&fs->vhost_user);
+    if (fs->conf.cache_size) {
+        object_unparent(OBJECT(&fs->cache));
+        munmap(memory_region_get_ram_ptr(&fs->cache), fs->conf.cache_size);
+    }
     virtio_delete_queue(fs->hiprio_vq);
     for (i = 0; i < fs->conf.num_request_queues; i++) {
         virtio_delete_queue(fs->req_vqs[i]);
@@ -254,6 +425,10 @@ static void vuf_device_unrealize(DeviceState *dev)
 
     vhost_user_cleanup(&fs->vhost_user);
 
+    if (fs->conf.cache_size) {
+        munmap(memory_region_get_ram_ptr(&fs->cache), fs->conf.cache_size);
+    }
+
     virtio_delete_queue(fs->hiprio_vq);
     for (i = 0; i < fs->conf.num_request_queues; i++) {
         virtio_delete_queue(fs->req_vqs[i]);
@@ -275,6 +450,7 @@ static Property vuf_properties[] = {
     DEFINE_PROP_UINT16("num-request-queues", VHostUserFS,
                        conf.num_request_queues, 1),
     DEFINE_PROP_UINT16("queue-size", VHostUserFS, conf.queue_size, 128),
+    DEFINE_PROP_SIZE("cache-size", VHostUserFS, conf.cache_size, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
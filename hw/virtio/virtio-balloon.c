@@ -432,6 +432,99 @@ out:
     }
 }
 
+/*
+ * Discard one run of host-contiguous reported memory.  The guest only
+ * reports high-order free pages, so a run is normally a single descriptor,
+ * but adjacent descriptors are merged to keep it to one discard per range.
+ */
+static void virtio_balloon_report_range(VirtIOBalloon *s, void *addr,
+                                        size_t size)
+{
+    ram_addr_t ram_offset;
+    RAMBlock *rb;
+
+    rb = qemu_ram_block_from_host(addr, false, &ram_offset);
+    if (!rb) {
+        return;
+    }
+
+    /* Ignore ranges that are unaligned or overrun the end of the RAMBlock */
+    if (!QEMU_IS_ALIGNED(ram_offset | size, qemu_ram_pagesize(rb)) ||
+        ram_offset + size > qemu_ram_get_used_length(rb)) {
+        return;
+    }
+
+    trace_virtio_balloon_report_range(ram_offset, size);
+    ram_block_discard_range(rb, ram_offset, size);
+
+    /*
+     * The content of reported pages is meaningless to the guest, so they
+     * need not be sent during precopy.  Writes after the guest reuses them
+     * are caught by the next bitmap sync.
+     */
+    qemu_mutex_lock(&s->report_lock);
+    if (s->report_skip_migration) {
+        qemu_guest_free_page_hint(addr, size);
+    }
+    qemu_mutex_unlock(&s->report_lock);
+}
+
+static void virtio_balloon_report(void *opaque)
+{
+    VirtIOBalloon *s = opaque;
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    VirtQueue *vq = s->reporting_vq;
+    VirtQueueElement *elem;
+
+    while ((elem = virtqueue_pop(vq, sizeof(VirtQueueElement)))) {
+        void *start = NULL;
+        size_t len = 0;
+        unsigned int i;
+
+        /*
+         * Discarding a page zeroes it, so leave it alone while another
+         * device or process may access guest memory.
+         */
+        if (qemu_balloon_is_inhibited()) {
+            goto skip_element;
+        }
+
+        for (i = 0; i < elem->in_num; i++) {
+            void *addr = elem->in_sg[i].iov_base;
+            size_t size = elem->in_sg[i].iov_len;
+
+            if (len && addr == start + len) {
+                len += size;
+                continue;
+            }
+            if (len) {
+                virtio_balloon_report_range(s, start, len);
+            }
+            start = addr;
+            len = size;
+        }
+        if (len) {
+            virtio_balloon_report_range(s, start, len);
+        }
+
+skip_element:
+        virtqueue_push(vq, elem, 0);
+        virtio_notify(vdev, vq);
+        g_free(elem);
+    }
+}
+
+static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
+{
+    VirtIOBalloon *s = VIRTIO_BALLOON(vdev);
+
+    if (s->report_bh) {
+        qemu_bh_schedule(s->report_bh);
+    } else {
+        virtio_balloon_report(s);
+    }
+}
+
 static void virtio_balloon_handle_free_page_vq(VirtIODevice *vdev,
                                                VirtQueue *vq)
 {
@@ -579,6 +672,17 @@ virtio_balloon_free_page_report_notify(NotifierWithReturn *n, void *data)
     VirtIODevice *vdev = VIRTIO_DEVICE(dev);
     PrecopyNotifyData *pnd = data;
 
+    if (virtio_vdev_has_feature(vdev, VIRTIO_BALLOON_F_REPORTING)) {
+        qemu_mutex_lock(&dev->report_lock);
+        if (pnd->reason == PRECOPY_NOTIFY_AFTER_BITMAP_SYNC) {
+            dev->report_skip_migration = true;
+        } else if (pnd->reason == PRECOPY_NOTIFY_COMPLETE ||
+                   pnd->reason == PRECOPY_NOTIFY_CLEANUP) {
+            dev->report_skip_migration = false;
+        }
+        qemu_mutex_unlock(&dev->report_lock);
+    }
+
     if (!virtio_balloon_free_page_support(dev)) {
         /*
          * This is an optimization provided to migration, so just return 0 to
@@ -800,9 +904,6 @@ static void virtio_balloon_device_realize(DeviceState *dev, Error **errp)
         s->free_page_report_status = FREE_PAGE_REPORT_S_STOP;
         s->free_page_report_cmd_id =
                            VIRTIO_BALLOON_FREE_PAGE_REPORT_CMD_ID_MIN;
-        s->free_page_report_notify.notify =
-                                       virtio_balloon_free_page_report_notify;
-        precopy_add_notifier(&s->free_page_report_notify);
         if (s->iothread) {
             object_ref(OBJECT(s->iothread));
             s->free_page_bh = aio_bh_new(iothread_get_aio_context(s->iothread),
@@ -816,6 +917,26 @@ static void virtio_balloon_device_realize(DeviceState *dev, Error **errp)
             virtio_error(vdev, "iothread is missing");
         }
     }
+
+    if (virtio_has_feature(s->host_features, VIRTIO_BALLOON_F_REPORTING)) {
+        s->reporting_vq = virtio_add_queue(vdev, 32,
+                                           virtio_balloon_handle_report);
+        qemu_mutex_init(&s->report_lock);
+        /* Discarding large ranges can take a while, keep it off the vCPUs */
+        if (s->iothread) {
+            object_ref(OBJECT(s->iothread));
+            s->report_bh = aio_bh_new(iothread_get_aio_context(s->iothread),
+                                      virtio_balloon_report, s);
+        }
+    }
+
+    if (virtio_has_feature(s->host_features,
+                           VIRTIO_BALLOON_F_FREE_PAGE_HINT) ||
+        virtio_has_feature(s->host_features, VIRTIO_BALLOON_F_REPORTING)) {
+        s->free_page_report_notify.notify =
+                                       virtio_balloon_free_page_report_notify;
+        precopy_add_notifier(&s->free_page_report_notify);
+    }
     reset_stats(s);
 }
 
@@ -827,8 +948,17 @@ static void virtio_balloon_device_unrealize(DeviceState *dev)
     if (virtio_balloon_free_page_support(s)) {
         qemu_bh_delete(s->free_page_bh);
         virtio_balloon_free_page_stop(s);
+    }
+    if (s->free_page_report_notify.notify) {
         precopy_remove_notifier(&s->free_page_report_notify);
     }
+    if (s->report_bh) {
+        qemu_bh_delete(s->report_bh);
+        object_unref(OBJECT(s->iothread));
+    }
+    if (s->reporting_vq) {
+        qemu_mutex_destroy(&s->report_lock);
+    }
     balloon_stats_destroy_timer(s);
     qemu_remove_balloon_handler(s);
 
@@ -838,6 +968,9 @@ static void virtio_balloon_device_unrealize(DeviceState *dev)
     if (s->free_page_vq) {
         virtio_delete_queue(s->free_page_vq);
     }
+    if (s->reporting_vq) {
+        virtio_delete_queue(s->reporting_vq);
+    }
     virtio_cleanup(vdev);
 }
 
@@ -916,6 +1049,8 @@ static Property virtio_balloon_properties[] = {
                     VIRTIO_BALLOON_F_DEFLATE_ON_OOM, false),
     DEFINE_PROP_BIT("free-page-hint", VirtIOBalloon, host_features,
                     VIRTIO_BALLOON_F_FREE_PAGE_HINT, false),
+    DEFINE_PROP_BIT("free-page-reporting", VirtIOBalloon, host_features,
+                    VIRTIO_BALLOON_F_REPORTING, false),
     /* QEMU 4.0 accidentally changed the config size even when free-page-hint
      * is disabled, resulting in QEMU 3.1 migration incompatibility.  This
      * property retains this quirk for QEMU 4.1 machine types.
@@ -27,6 +27,7 @@
 #include "hw/virtio/virtio-access.h"
 #include "sysemu/dma.h"
 #include "sysemu/runstate.h"
+#include "monitor/stats.h"
 
 /*
  * The alignment to use between consumer and producer parts of vring.
@@ -130,6 +131,11 @@ struct VirtQueue
     EventNotifier host_notifier;
     bool host_notifier_enabled;
     QLIST_ENTRY(VirtQueue) node;
+
+    /* Statistics, only written by the thread that processes the queue */
+    uint64_t kicks;
+    uint64_t interrupts;
+    uint64_t popped;
 };
 
 static void virtio_free_region_cache(VRingMemoryRegionCaches *caches)
@@ -918,6 +924,31 @@ void virtqueue_push(VirtQueue *vq, const VirtQueueElement *elem,
     virtqueue_flush(vq, 1);
 }
 
+/* virtqueue_push_batch:
+ * @vq: The #VirtQueue
+ * @elems: The elements to return to the guest
+ * @lens: Number of bytes written into each element
+ * @count: Number of elements
+ *
+ * Like virtqueue_push() for each element, but the used index is only
+ * updated once, behind a single write barrier.
+ */
+void virtqueue_push_batch(VirtQueue *vq, VirtQueueElement *const *elems,
+                          const unsigned int *lens, unsigned int count)
+{
+    unsigned int i;
+
+    if (!count) {
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    for (i = 0; i < count; i++) {
+        virtqueue_fill(vq, elems[i], lens ? lens[i] : 0, i);
+    }
+    virtqueue_flush(vq, count);
+}
+
 /* Called within rcu_read_lock().  */
 static int virtqueue_num_heads(VirtQueue *vq, unsigned int idx)
 {
@@ -1409,7 +1440,7 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     return elem;
 }
 
-static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+static void *virtqueue_split_pop(VirtQueue *vq, size_t sz, bool set_event)
 {
     unsigned int i, head, max;
     VRingMemoryRegionCaches *caches;
@@ -1446,7 +1477,7 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
         goto done;
     }
 
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
+    if (set_event && virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
         vring_set_avail_event(vq, vq->last_avail_idx);
     }
 
@@ -1683,15 +1714,60 @@ err_undo_map:
 
 void *virtqueue_pop(VirtQueue *vq, size_t sz)
 {
+    void *elem;
+
     if (virtio_device_disabled(vq->vdev)) {
         return NULL;
     }
 
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
-        return virtqueue_packed_pop(vq, sz);
+        elem = virtqueue_packed_pop(vq, sz);
     } else {
-        return virtqueue_split_pop(vq, sz);
+        elem = virtqueue_split_pop(vq, sz, true);
+    }
+    if (elem) {
+        vq->popped++;
+    }
+    return elem;
+}
+
+/* virtqueue_pop_batch:
+ * @vq: The #VirtQueue
+ * @sz: Size of each element, as for virtqueue_pop()
+ * @elems: Array that receives the elements
+ * @max: Size of @elems
+ *
+ * Pop up to @max elements in one go.  This is the same as calling
+ * virtqueue_pop() until it fails or @max elements have been popped, but
+ * the avail event is only published once, after the last element.
+ *
+ * Returns the number of elements stored in @elems.
+ */
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
+{
+    bool packed = virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED);
+    unsigned int n;
+
+    if (virtio_device_disabled(vq->vdev)) {
+        return 0;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    for (n = 0; n < max; n++) {
+        elems[n] = packed ? virtqueue_packed_pop(vq, sz) :
+                            virtqueue_split_pop(vq, sz, false);
+        if (!elems[n]) {
+            break;
+        }
+    }
+
+    if (n && !packed &&
+        virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
     }
+    vq->popped += n;
+    return n;
 }
 
 static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
@@ -2321,6 +2397,7 @@ static bool virtio_queue_notify_aio_vq(VirtQueue *vq)
         VirtIODevice *vdev = vq->vdev;
 
         trace_virtio_queue_notify(vdev, vq - vdev->vq, vq);
+        vq->kicks++;
         ret = vq->handle_aio_output(vdev, vq);
 
         if (unlikely(vdev->start_on_kick)) {
@@ -2341,6 +2418,7 @@ static void virtio_queue_notify_vq(VirtQueue *vq)
         }
 
         trace_virtio_queue_notify(vdev, vq - vdev->vq, vq);
+        vq->kicks++;
         vq->handle_output(vdev, vq);
 
         if (unlikely(vdev->start_on_kick)) {
@@ -2361,6 +2439,7 @@ void virtio_queue_notify(VirtIODevice *vdev, int n)
     if (vq->host_notifier_enabled) {
         event_notifier_set(&vq->host_notifier);
     } else if (vq->handle_output) {
+        vq->kicks++;
         vq->handle_output(vdev, vq);
 
         if (unlikely(vdev->start_on_kick)) {
@@ -2549,11 +2628,13 @@ void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
      * to an atomic operation.
      */
     virtio_set_isr(vq->vdev, 0x1);
+    vq->interrupts++;
     event_notifier_set(&vq->guest_notifier);
 }
 
 static void virtio_irq(VirtQueue *vq)
 {
+    vq->interrupts++;
     virtio_set_isr(vq->vdev, 0x1);
     virtio_notify_vector(vq->vdev, vq->vector);
 }
@@ -3367,7 +3448,7 @@ static void virtio_queue_packed_set_last_avail_idx(VirtIODevice *vdev,
     vq->last_avail_wrap_counter =
         vq->shadow_avail_wrap_counter = !!(idx & 0x8000);
     idx >>= 16;
-    vq->used_idx = idx & 0x7ffff;
+    vq->used_idx = idx & 0x7fff;
     vq->used_wrap_counter = !!(idx & 0x8000);
 }
 
@@ -3817,9 +3898,55 @@ static const TypeInfo virtio_device_info = {
     .class_size = sizeof(VirtioDeviceClass),
 };
 
+static const StatsDescriptor virtio_device_stats[] = {
+    { "kicks", STATS_TYPE_CUMULATIVE },
+    { "interrupts", STATS_TYPE_CUMULATIVE },
+    { "elements", STATS_TYPE_CUMULATIVE },
+    { "inflight", STATS_TYPE_INSTANT },
+};
+
+static int virtio_device_stats_one(Object *obj, void *opaque)
+{
+    StatsCollector *c = opaque;
+    VirtIODevice *vdev;
+    g_autofree char *path = NULL;
+    uint64_t values[ARRAY_SIZE(virtio_device_stats)] = { 0 };
+    int i, n;
+
+    vdev = (VirtIODevice *)object_dynamic_cast(obj, TYPE_VIRTIO_DEVICE);
+    if (!vdev || !DEVICE(vdev)->realized) {
+        return 0;
+    }
+    path = object_get_canonical_path(obj);
+    if (!stats_wanted(c, path)) {
+        return 0;
+    }
+
+    n = virtio_get_num_queues(vdev);
+    for (i = 0; i < n; i++) {
+        VirtQueue *vq = &vdev->vq[i];
+
+        values[0] += vq->kicks;
+        values[1] += vq->interrupts;
+        values[2] += vq->popped;
+        values[3] += vq->inuse;
+    }
+    stats_collect(c, path, values);
+    return 0;
+}
+
+static void virtio_device_stats_retrieve(StatsCollector *c)
+{
+    object_child_foreach_recursive(object_get_root(),
+                                   virtio_device_stats_one, c);
+}
+
 static void virtio_register_types(void)
 {
     type_register_static(&virtio_device_info);
+    stats_register(STATS_PROVIDER_VIRTIO, STATS_TARGET_DEVICE,
+                   virtio_device_stats, ARRAY_SIZE(virtio_device_stats),
+                   virtio_device_stats_retrieve);
 }
 
 type_init(virtio_register_types)
@@ -103,6 +103,40 @@ typedef struct {
      * Returns: true if ->wait() should be called, false otherwise.
      */
     bool (*need_wait)(AioContext *ctx);
+
+    /*
+     * gsource_prepare:
+     * @ctx: the AioContext
+     *
+     * Optional.  Implementations that monitor file descriptors through a
+     * single fd of their own, rather than through the GPollFDs of each
+     * handler, submit pending changes here before the glib event loop
+     * blocks.  Handler GPollFDs are not added to the GSource when this is
+     * set.
+     *
+     * Called from aio_ctx_prepare().
+     */
+    void (*gsource_prepare)(AioContext *ctx);
+
+    /*
+     * gsource_check:
+     * @ctx: the AioContext
+     *
+     * Returns: true if ->gsource_dispatch() has handlers to place on a
+     * ready list.  Called from aio_ctx_check().
+     */
+    bool (*gsource_check)(AioContext *ctx);
+
+    /*
+     * gsource_dispatch:
+     * @ctx: the AioContext
+     * @ready_list: list for handlers that became ready
+     *
+     * Like ->wait() with a zero timeout, for use after glib polled.
+     *
+     * Called with ctx->list_lock incremented but not locked.
+     */
+    void (*gsource_dispatch)(AioContext *ctx, AioHandlerList *ready_list);
 } FDMonOps;
 
 /*
@@ -209,10 +243,14 @@ struct AioContext {
      * locking.
      */
     struct LuringState *linux_io_uring;
+    /* Whether linux_io_uring gets a kernel submission thread.  */
+    bool linux_io_uring_sqpoll;
 
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
     AioHandlerSList submit_list;
+    /* glib tag of the io_uring fd in the GSource */
+    gpointer fdmon_io_uring_tag;
 #endif
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -717,4 +755,15 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
                                  int64_t grow, int64_t shrink,
                                  Error **errp);
 
+/**
+ * aio_context_set_io_uring_sqpoll:
+ * @ctx: the aio context
+ * @sqpoll: whether to use a kernel side submission thread
+ *
+ * Only affects the io_uring ring set up by aio_setup_linux_io_uring(),
+ * so it must be called before any block device uses it.
+ */
+void aio_context_set_io_uring_sqpoll(AioContext *ctx, bool sqpoll,
+                                     Error **errp);
+
 #endif
@@ -54,6 +54,8 @@ typedef struct ThrottleGroupMember {
     ThrottleState *throttle_state;
     ThrottleTimers throttle_timers;
     unsigned       pending_reqs[2];
+    /* Credit left in the current round, see next_throttle_token() */
+    int64_t        deficit[2];
     QLIST_ENTRY(ThrottleGroupMember) round_robin;
 
 } ThrottleGroupMember;
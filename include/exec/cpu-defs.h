@@ -81,6 +81,8 @@ typedef uint64_t target_ulong;
 
 /* use a fully associative victim tlb of 8 entries */
 #define CPU_VTLB_SIZE 8
+/* Number of block mappings remembered per MMU mode.  */
+#define CPU_BTLB_SIZE 8
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -134,6 +136,8 @@ QEMU_BUILD_BUG_ON(sizeof(CPUTLBEntry) != (1 << CPU_TLB_ENTRY_BITS));
  * CPUTLBEntry. (This is also why we don't want to combine the two
  * structs into one.)
  */
+#define TLB_WP_GRANULE_BITS  (TARGET_PAGE_BITS - 6)
+
 typedef struct CPUIOTLBEntry {
     /*
      * @addr contains:
@@ -145,13 +149,39 @@ typedef struct CPUIOTLBEntry {
      *     + the offset within the target MemoryRegion (otherwise)
      */
     hwaddr addr;
+    /*
+     * Added to the offset within the target MemoryRegion of an I/O access.
+     * Non-zero only for translations finer than the target page that move
+     * the address to a different offset within the page.
+     */
+    hwaddr subpage;
     MemTxAttrs attrs;
+    /*
+     * For pages marked TLB_WATCHPOINT, one bit per TLB_WP_GRANULE_BITS
+     * sized granule of the page that a read or write watchpoint covers.
+     * Accesses outside of these skip the watchpoint list walk.
+     */
+    uint64_t wp_read;
+    uint64_t wp_write;
 } CPUIOTLBEntry;
 
 #ifndef NB_MEM_ATTR
 #define NB_MEM_ATTR 2
 #endif
 
+/*
+ * A block mapping installed with tlb_set_block_with_attrs. Pages
+ * within it are filled from here without calling back into the
+ * target's tlb_fill. The entry is unused if prot is zero.
+ */
+typedef struct CPUTLBBlock {
+    target_ulong vaddr;
+    target_ulong mask;
+    hwaddr paddr;
+    MemTxAttrs attrs;
+    int prot;
+} CPUTLBBlock;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
@@ -159,12 +189,16 @@ typedef struct CPUIOTLBEntry {
 typedef struct CPUTLBDesc {
     /*
      * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * into the tlb that are not tracked in btable.  When any page
+     * within this region is flushed, we must flush the entire tlb.
+     * The region is matched if (addr & large_page_mask) == large_page_addr.
      */
     target_ulong large_page_addr;
     target_ulong large_page_mask;
+    /* The next index to use in the block table.  */
+    size_t bindex;
+    /* Block mappings; flushing a page within one flushes just the block. */
+    CPUTLBBlock btable[CPU_BTLB_SIZE];
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -74,6 +74,16 @@ void gdb_register_coprocessor(CPUState *cpu,
                               gdb_get_reg_cb get_reg, gdb_set_reg_cb set_reg,
                               int num_regs, const char *xml, int g_pos);
 
+/**
+ * gdb_read_register() - append the value of a register to @buf
+ * @cpu: the CPU to read from
+ * @buf: the array the value is appended to, in target byte order
+ * @reg: the register number, as used by the gdb remote protocol
+ *
+ * Returns the size of the register, or 0 if @reg does not exist.
+ */
+int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg);
+
 /*
  * The GDB remote protocol transfers values in target byte order. As
  * the gdbstub may be batching up several register values we always
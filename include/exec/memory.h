@@ -156,6 +156,12 @@ typedef struct IOMMUNotifier IOMMUNotifier;
 /* RAM is a persistent kind memory */
 #define RAM_PMEM (1 << 5)
 
+/*
+ * RAM is a private copy-on-write mapping of a read-only template file,
+ * typically the RAM of a saved guest.  The file is never written to.
+ */
+#define RAM_CLONE (1 << 6)
+
 static inline void iommu_notifier_init(IOMMUNotifier *n, IOMMUNotify fn,
                                        IOMMUNotifierFlag flags,
                                        hwaddr start, hwaddr end,
@@ -566,6 +572,18 @@ struct MemoryListener {
      */
     void (*log_sync)(MemoryListener *listener, MemoryRegionSection *section);
 
+    /**
+     * @log_sync_global:
+     *
+     * This is the global version of @log_sync when the listener does
+     * not have a way to synchronize the log with finer granularity.
+     * When the listener registers with @log_sync_global defined, then
+     * its @log_sync must be NULL.  Vice versa.
+     *
+     * @listener: The #MemoryListener.
+     */
+    void (*log_sync_global)(MemoryListener *listener);
+
     /**
      * @log_clear:
      *
@@ -915,6 +933,7 @@ void memory_region_init_resizeable_ram(MemoryRegion *mr,
  * @ram_flags: Memory region features:
  *             - RAM_SHARED: memory must be mmaped with the MAP_SHARED flag
  *             - RAM_PMEM: the memory is persistent memory
+ *             - RAM_CLONE: map the existing file @path copy-on-write
  *             Other bits are ignored now.
  * @path: the path in which to allocate the RAM.
  * @errp: pointer to Error*, to store an error if it happens.
@@ -955,6 +974,30 @@ void memory_region_init_ram_from_fd(MemoryRegion *mr,
                                     Error **errp);
 #endif
 
+/**
+ * memory_region_init_ram_hugetlb:  Initialize RAM memory region backed by
+ *                                  anonymous huge pages.
+ *
+ * @mr: the #MemoryRegion to be initialized.
+ * @owner: the object that tracks the region's reference count
+ * @name: Region name, becomes part of RAMBlock name used in migration stream
+ *        must be unique within any device
+ * @size: size of the region, a multiple of @pagesize.
+ * @pagesize: the host huge page size, e.g. 2 MiB or 1 GiB.
+ * @share: %true if memory must be mmaped with the MAP_SHARED flag
+ * @errp: pointer to Error*, to store an error if it happens.
+ *
+ * Note that this function does not do anything to cause the data in the
+ * RAM memory region to be migrated; that is the responsibility of the caller.
+ */
+void memory_region_init_ram_hugetlb(MemoryRegion *mr,
+                                    struct Object *owner,
+                                    const char *name,
+                                    uint64_t size,
+                                    uint64_t pagesize,
+                                    bool share,
+                                    Error **errp);
+
 /**
  * memory_region_init_ram_ptr:  Initialize RAM memory region from a
  *                              user-provided pointer.  Accesses into the
@@ -0,0 +1,70 @@
+/*
+ * MMIO access profiler
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Counts the accesses that go through memory_region_dispatch_read() and
+ * memory_region_dispatch_write(), and the host time spent in them, per
+ * region and offset.  The profiler is compiled in unconditionally and is
+ * switched on at run time with mmio-profile-set-state; while it is off,
+ * dispatch only tests a flag.
+ */
+#ifndef EXEC_MMIO_PROFILE_H
+#define EXEC_MMIO_PROFILE_H
+
+#include "exec/hwaddr.h"
+#include "qemu/atomic.h"
+#include "qemu/timer.h"
+
+extern bool mmio_profile_enabled;
+
+typedef struct MmioProfileStats {
+    MemoryRegion *mr;       /* NULL for the accesses that did not fit */
+    hwaddr offset;
+    uint64_t count[2];      /* indexed by is_write */
+    uint64_t ns[2];
+} MmioProfileStats;
+
+typedef void MmioProfileIterFunc(const MmioProfileStats *stats,
+                                 void *opaque);
+
+void mmio_profile_record(MemoryRegion *mr, hwaddr offset, bool is_write,
+                         int64_t start);
+
+/**
+ * mmio_profile_foreach:
+ * @func: called once per profiled register
+ * @opaque: passed to @func
+ *
+ * Merges the samples of all threads and calls @func for each register,
+ * in decreasing order of total access time.  Must be called with the
+ * BQL held.
+ */
+void mmio_profile_foreach(MmioProfileIterFunc *func, void *opaque);
+
+/**
+ * mmio_profile_reset:
+ *
+ * Drops all samples, and the references that the profiler holds on the
+ * regions it has seen.  Must be called with the BQL held.
+ */
+void mmio_profile_reset(void);
+
+/* Returns the start time of an access, or 0 when not profiling.  */
+static inline int64_t mmio_profile_start(void)
+{
+    return unlikely(atomic_read(&mmio_profile_enabled)) ? get_clock() : 0;
+}
+
+static inline void mmio_profile_end(MemoryRegion *mr, hwaddr offset,
+                                    bool is_write, int64_t start)
+{
+    if (unlikely(start)) {
+        mmio_profile_record(mr, offset, is_write, start);
+    }
+}
+
+#endif
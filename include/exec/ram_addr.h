@@ -108,6 +108,7 @@ long qemu_maxrampagesize(void);
  *              or bit-or of following values
  *              - RAM_SHARED: mmap the backing file or device with MAP_SHARED
  *              - RAM_PMEM: the backend @mem_path or @fd is persistent memory
+ *              - RAM_CLONE: map the template @mem_path or @fd copy-on-write
  *              Other bits are ignored.
  *  @mem_path or @fd: specify the backing file or device
  *  @errp: pointer to Error*, to store an error if it happens
@@ -123,6 +124,24 @@ RAMBlock *qemu_ram_alloc_from_fd(ram_addr_t size, MemoryRegion *mr,
                                  uint32_t ram_flags, int fd,
                                  Error **errp);
 
+/**
+ * qemu_ram_alloc_hugetlb: Allocate an anonymous ram block backed by
+ *                         huge pages
+ *
+ * Parameters:
+ *  @size: the size in bytes of the ram block, rounded up to @pagesize
+ *  @pagesize: the huge page size
+ *  @share: mmap the block with MAP_SHARED
+ *  @mr: the memory region where the ram block is
+ *  @errp: pointer to Error*, to store an error if it happens
+ *
+ * Return:
+ *  On success, return a pointer to the ram block.
+ *  On failure, return NULL.
+ */
+RAMBlock *qemu_ram_alloc_hugetlb(ram_addr_t size, uint64_t pagesize,
+                                 bool share, MemoryRegion *mr, Error **errp);
+
 RAMBlock *qemu_ram_alloc_from_ptr(ram_addr_t size, void *host,
                                   MemoryRegion *mr, Error **errp);
 RAMBlock *qemu_ram_alloc(ram_addr_t size, bool share, MemoryRegion *mr,
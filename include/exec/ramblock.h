@@ -22,6 +22,13 @@
 #ifndef CONFIG_USER_ONLY
 #include "cpu-common.h"
 
+typedef struct RAMBlockHeat {
+    /* Consecutive bitmap syncs that found the chunk dirty again */
+    uint8_t heat;
+    /* Dirty pages in the chunk at the last bitmap sync */
+    uint16_t dirty;
+} RAMBlockHeat;
+
 struct RAMBlock {
     struct rcu_head rcu;
     struct MemoryRegion *mr;
@@ -63,6 +70,13 @@ struct RAMBlock {
      */
     unsigned long *clear_bmap;
     uint8_t clear_bmap_shift;
+
+    /*
+     * Dirty heat of each RAM_HOT_CHUNK_SIZE chunk of the block, used to
+     * leave the hottest chunks for the end of precopy.  NULL unless the
+     * defer-hot-pages migration capability is enabled on the source.
+     */
+    RAMBlockHeat *heat;
 };
 #endif
 #endif
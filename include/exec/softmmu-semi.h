@@ -11,6 +11,7 @@
 #define SOFTMMU_SEMI_H
 
 #include "cpu.h"
+#include "exec/memory.h"
 
 static inline uint64_t softmmu_tget64(CPUArchState *env, target_ulong addr)
 {
@@ -98,4 +99,71 @@ static void softmmu_unlock_user(CPUArchState *env, void *p, target_ulong addr,
 }
 #define unlock_user(s, args, len) softmmu_unlock_user(env, s, args, len)
 
+/*
+ * Read from host file descriptor @fd straight into guest memory at
+ * @addr, one read() per run of physically contiguous pages instead of
+ * going through a bounce buffer.  Returns the number of bytes read,
+ * or -1 with errno set if nothing could be read.
+ */
+static inline ssize_t softmmu_read_user(CPUArchState *env, int fd,
+                                        target_ulong addr, target_ulong len)
+{
+    CPUState *cs = env_cpu(env);
+    ssize_t done = 0;
+
+    while (len) {
+        target_ulong chunk;
+        AddressSpace *as;
+        MemTxAttrs attrs;
+        hwaddr phys, plen;
+        ssize_t n;
+        int asidx;
+        void *p;
+
+        phys = cpu_get_phys_page_attrs_debug(cs, addr & TARGET_PAGE_MASK,
+                                             &attrs);
+        asidx = cpu_asidx_from_attrs(cs, attrs);
+        if (phys == -1) {
+            errno = EFAULT;
+            return done ? done : -1;
+        }
+        phys += addr & ~TARGET_PAGE_MASK;
+        chunk = MIN(len, TARGET_PAGE_SIZE - (addr & ~TARGET_PAGE_MASK));
+        while (chunk < len) {
+            MemTxAttrs next_attrs;
+            hwaddr next = cpu_get_phys_page_attrs_debug(cs, addr + chunk,
+                                                        &next_attrs);
+
+            if (next != phys + chunk ||
+                cpu_asidx_from_attrs(cs, next_attrs) != asidx) {
+                break;
+            }
+            chunk += MIN(len - chunk, TARGET_PAGE_SIZE);
+        }
+
+        as = cpu_get_address_space(cs, asidx);
+        plen = chunk;
+        p = address_space_map(as, phys, &plen, true, attrs);
+        if (!p) {
+            errno = EFAULT;
+            return done ? done : -1;
+        }
+        do {
+            n = read(fd, p, plen);
+        } while (n < 0 && errno == EINTR);
+        address_space_unmap(as, p, plen, true, n > 0 ? n : 0);
+
+        if (n < 0) {
+            return done ? done : -1;
+        }
+        done += n;
+        if (n < plen) {
+            break;
+        }
+        addr += n;
+        len -= n;
+    }
+    return done;
+}
+
 #endif
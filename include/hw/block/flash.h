@@ -54,6 +54,8 @@ void nand_setpins(DeviceState *dev, uint8_t cle, uint8_t ale,
 void nand_getpins(DeviceState *dev, int *rb);
 void nand_setio(DeviceState *dev, uint32_t value);
 uint32_t nand_getio(DeviceState *dev);
+void nand_getbuf(DeviceState *dev, uint8_t *buf, int len);
+void nand_setbuf(DeviceState *dev, const uint8_t *buf, int len);
 uint32_t nand_getbuswidth(DeviceState *dev);
 
 #define NAND_MFR_TOSHIBA	0x98
@@ -68,6 +70,35 @@ uint32_t nand_getbuswidth(DeviceState *dev);
 /* onenand.c */
 void *onenand_raw_otp(DeviceState *onenand_device);
 
+/* flash-writeback.c */
+
+/*
+ * Deferred write-back of a flash model's working copy to its block backend.
+ * Updates only mark the touched range dirty, the dirty runs are written out
+ * in one go once the delay expires, when the VM stops or on explicit flush.
+ */
+#define FLASH_WRITEBACK_CHUNK 4096
+
+typedef struct FlashWriteback {
+    BlockBackend *blk;
+    uint8_t *storage;
+    uint64_t size;
+    uint32_t delay_ms;
+    unsigned long *dirty;
+    uint64_t nb_chunks;
+    bool is_dirty;
+    unsigned int in_flight;
+    QEMUTimer *timer;
+    VMChangeStateEntry *vmstate;
+} FlashWriteback;
+
+/* A NULL or read-only @blk turns the other calls into no-ops.  */
+void flash_writeback_init(FlashWriteback *wb, BlockBackend *blk,
+                          void *storage, uint64_t size, uint32_t delay_ms);
+void flash_writeback_cleanup(FlashWriteback *wb);
+void flash_writeback_mark(FlashWriteback *wb, uint64_t offset, uint64_t len);
+void flash_writeback_flush(FlashWriteback *wb);
+
 /* ecc.c */
 typedef struct {
     uint8_t cp;		/* Column parity */
@@ -30,6 +30,8 @@
 
 #define TYPE_XLNX_EFUSE "xlnx.efuse"
 #include "hw/ptimer.h"
+#include "qemu/notify.h"
+#include "qemu/timer.h"
 #include "sysemu/block-backend.h"
 #include "hw/zynqmp_aes_key.h"
 
@@ -44,6 +46,11 @@ typedef struct XLNXEFuse {
     bool blk_ro;
     uint32_t *fuse32;
 
+    /* Rows programmed since the last write-back to blk */
+    unsigned long *dirty_rows;
+    QEMUTimer *flush_timer;
+    Notifier exit_notifier;
+
     void (*pgm_done)(DeviceState *dev, bool failed);
     DeviceState *dev;
 
@@ -269,6 +269,7 @@ struct MachineState {
     char *dumpdtb;
     bool is_linux;
     int phandle_start;
+    uint64_t target_page_size;
     char *dt_compatible;
     bool dump_guest_core;
     bool mem_merge;
@@ -0,0 +1,65 @@
+/*
+ * Boot-time profiling
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef HW_BOOT_PROFILE_H
+#define HW_BOOT_PROFILE_H
+
+#include "qemu/timer.h"
+
+extern bool boot_profile_enabled;
+
+/**
+ * boot_profile_open:
+ * @path: file that receives the events as Chrome trace-event JSON
+ * @start: get_clock() value that becomes time zero in the trace
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Starts recording.  Events are written as they happen and the file
+ * is completed at exit, so a truncated file still loads in a viewer.
+ */
+bool boot_profile_open(const char *path, int64_t start, Error **errp);
+
+void boot_profile_complete(const char *cat, const char *name, int64_t start);
+void boot_profile_complete_object(const char *cat, Object *obj,
+                                  int64_t start);
+void boot_profile_instant(const char *cat, const char *name);
+void boot_profile_first_exec(int cpu_index);
+
+/* Returns the start time of a span, or 0 when not profiling.  */
+static inline int64_t boot_profile_start(void)
+{
+    return unlikely(boot_profile_enabled) ? get_clock() : 0;
+}
+
+/* Records the span from @start until now.  */
+static inline void boot_profile_span(const char *cat, const char *name,
+                                     int64_t start)
+{
+    if (unlikely(boot_profile_enabled)) {
+        boot_profile_complete(cat, name, start);
+    }
+}
+
+/* Same, named after the QOM path or the type of @obj.  */
+static inline void boot_profile_span_object(const char *cat, Object *obj,
+                                            int64_t start)
+{
+    if (unlikely(boot_profile_enabled)) {
+        boot_profile_complete_object(cat, obj, start);
+    }
+}
+
+static inline void boot_profile_mark(const char *cat, const char *name)
+{
+    if (unlikely(boot_profile_enabled)) {
+        boot_profile_instant(cat, name);
+    }
+}
+
+#endif
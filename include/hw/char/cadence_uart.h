@@ -26,6 +26,8 @@
 
 #define CADENCE_UART_RX_FIFO_SIZE           64
 #define CADENCE_UART_TX_FIFO_SIZE           64
+/* Host-side buffer that coalesces writes to the chardev */
+#define CADENCE_UART_TX_BUF_SIZE            1024
 
 #define CADENCE_UART_R_MAX (0x48/4)
 
@@ -50,6 +52,11 @@ typedef struct {
     qemu_irq irq;
     QEMUTimer *fifo_trigger_handle;
     Clock *refclk;
+
+    uint8_t tx_buf[CADENCE_UART_TX_BUF_SIZE];
+    uint32_t tx_buf_count;
+    QEMUTimer *tx_flush_timer;
+    guint tx_watch;
 } CadenceUARTState;
 
 static inline DeviceState *cadence_uart_create(hwaddr addr,
@@ -52,6 +52,8 @@ typedef void ClockCallback(void *opaque);
  * @source: source (or parent in clock tree) of the clock
  * @children: list of clocks connected to this one (it is their source)
  * @sibling: structure used to form a clock list
+ * @callback_pending: @callback is deferred to the end of a transaction
+ * @pending: entry in the list of deferred callbacks
  */
 
 typedef struct Clock Clock;
@@ -72,6 +74,9 @@ struct Clock {
     Clock *source;
     QLIST_HEAD(, Clock) children;
     QLIST_ENTRY(Clock) sibling;
+
+    bool callback_pending;
+    QTAILQ_ENTRY(Clock) pending;
 };
 
 /*
@@ -152,6 +157,25 @@ static inline void clock_set_ns(Clock *clk, unsigned ns)
  */
 void clock_propagate(Clock *clk);
 
+/**
+ * clock_transaction_begin:
+ *
+ * Start a clock transaction.  Until the matching
+ * clock_transaction_commit(), clock_propagate() still updates the
+ * periods of the whole subtree, but the callbacks of the clocks it
+ * changes are only recorded.  Transactions nest.
+ */
+void clock_transaction_begin(void);
+
+/**
+ * clock_transaction_commit:
+ *
+ * End a clock transaction.  When the outermost one ends, the callback
+ * of every clock updated during it is called once, however many times
+ * its period changed, in the order of the first update.
+ */
+void clock_transaction_commit(void);
+
 /**
  * clock_update:
  * @clk: the clock to update.
@@ -25,4 +25,12 @@ void cpu_halt_gpio(void *opaque, int irq, int level);
 void cpu_reset_gpio(void *opaque, int irq, int level);
 void cpu_halt_update(CPUState *cpu);
 
+/*
+ * Drive the reset or halt pin of all @num_cpus CPUs in @cpus to @level
+ * in one operation, e.g. for a whole cluster.  The CPUs are all told
+ * first and then waited for together.
+ */
+void cpu_reset_gpio_cpus(CPUState **cpus, unsigned int num_cpus, int level);
+void cpu_halt_gpio_cpus(CPUState **cpus, unsigned int num_cpus, int level);
+
 #endif
@@ -264,6 +264,7 @@ struct CPUWatchpoint {
 
 struct KVMState;
 struct kvm_run;
+struct kvm_dirty_gfn;
 
 struct hax_vcpu_state;
 
@@ -305,10 +306,18 @@ struct qemu_work_item;
  *   QOM parent.
  * @nr_cores: Number of cores within this CPU package.
  * @nr_threads: Number of threads within this CPU.
+ * @thread_placement: Host CPU placement of @thread, if it is not shared.
  * @running: #true if CPU is currently running (lockless).
  * @has_waiter: #true if a CPU is currently waiting for the cpu_exec_end;
  * valid under cpu_list_lock.
  * @created: Indicates whether the CPU thread has been successfully created.
+ * @halt_poll_max_ns: Upper bound of the userspace halt polling window,
+ *   0 if halts are not polled.
+ * @halt_poll_ns: Current userspace halt polling window.
+ * @halt_poll_hits: Halts that ended while polling.
+ * @halt_poll_misses: Halts that went to sleep.
+ * @kvm_exits: KVM_RUN returns, @kvm_io_exits, @kvm_mmio_exits and
+ *   @kvm_intr_exits being those due to port I/O, MMIO and signals.
  * @interrupt_request: Indicates a pending interrupt request.
  * @halted: Nonzero if the CPU is in suspended state.
  * @stop: Indicates a pending stop request.
@@ -355,11 +364,16 @@ struct CPUState {
     int nr_threads;
 
     struct QemuThread *thread;
+    struct ThreadPlacement *thread_placement;
 #ifdef _WIN32
     HANDLE hThread;
 #endif
     int thread_id;
     bool running, has_waiter;
+    uint32_t halt_poll_max_ns;
+    uint32_t halt_poll_ns;
+    uint64_t halt_poll_hits;
+    uint64_t halt_poll_misses;
     struct QemuCond *halt_cond;
     bool thread_kicked;
     bool created;
@@ -410,9 +424,25 @@ struct CPUState {
      */
     uintptr_t mem_io_pc;
 
+    /* The last MMIO read, to spot polling loops (see io_readx) */
+    struct {
+        MemoryRegion *mr;
+        hwaddr addr;
+        uint64_t val;
+        uintptr_t ra;
+        unsigned int count;
+    } mmio_poll;
+    QEMUTimer *mmio_poll_timer;
+
     int kvm_fd;
     struct KVMState *kvm_state;
     struct kvm_run *kvm_run;
+    struct kvm_dirty_gfn *kvm_dirty_gfns;
+    uint32_t kvm_fetch_index;
+    uint64_t kvm_exits;
+    uint64_t kvm_io_exits;
+    uint64_t kvm_mmio_exits;
+    uint64_t kvm_intr_exits;
 
     /* Used for events with 'vcpu' and *without* the 'disabled' properties */
     DECLARE_BITMAP(trace_dstate_delayed, CPU_TRACE_DSTATE_MAX_EVENTS);
@@ -1106,6 +1136,12 @@ static inline int cpu_watchpoint_address_matches(CPUState *cpu,
 {
     return 0;
 }
+
+static inline uint64_t cpu_watchpoint_page_mask(CPUState *cpu, vaddr page,
+                                                int flags)
+{
+    return 0;
+}
 #else
 int cpu_watchpoint_insert(CPUState *cpu, vaddr addr, vaddr len,
                           int flags, CPUWatchpoint **watchpoint);
@@ -1139,6 +1175,18 @@ void cpu_check_watchpoint(CPUState *cpu, vaddr addr, vaddr len,
  * If no watchpoint is registered for the range, the result is 0.
  */
 int cpu_watchpoint_address_matches(CPUState *cpu, vaddr addr, vaddr len);
+
+/**
+ * cpu_watchpoint_page_mask:
+ * @cpu: cpu context
+ * @page: guest virtual address of a target page
+ * @flags: watchpoint access type
+ *
+ * Return a mask with bit N set when a watchpoint of type @flags covers
+ * part of the Nth 64th of the page.  Adjusting the watchpoint address
+ * must not move an access out of the granule it started in.
+ */
+uint64_t cpu_watchpoint_page_mask(CPUState *cpu, vaddr page, int flags);
 #endif
 
 /**
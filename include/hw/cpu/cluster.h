@@ -51,6 +51,9 @@
  * A CPU which is not put into any cluster will be considered implicitly
  * to be in a cluster with all the other "loose" CPUs, so all CPUs that are
  * not assigned to clusters must be identical.
+ *
+ * A cluster has "reset" and "halt" GPIO inputs that drive the pins of the
+ * same name of all its CPUs at once (see cpu-exec-gpio.h).
  */
 
 #define TYPE_CPU_CLUSTER "cpu-cluster"
@@ -67,6 +70,8 @@
  * CPUClusterState:
  * @cluster_id: The cluster ID. This value is for internal use only and should
  *   not be exposed directly to the user or to the guest.
+ * @cpus: The CPUs of the cluster, collected at realize time.
+ * @num_cpus: The number of entries in @cpus.
  *
  * State of a CPU cluster.
  */
@@ -76,6 +81,8 @@ typedef struct CPUClusterState {
 
     /*< public >*/
     uint32_t cluster_id;
+    CPUState **cpus;
+    unsigned int num_cpus;
 } CPUClusterState;
 
 #endif
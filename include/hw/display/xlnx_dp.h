@@ -79,12 +79,21 @@ typedef struct XlnxDPState {
     struct PixmanPlane v_plane;
     struct PixmanPlane bout_plane;
 
+    /*
+     * When set g_plane is a surface on the guest framebuffer and the DPDMA
+     * doesn't copy the graphic channel.
+     */
+    MemoryRegionSection g_direct;
+    hwaddr g_direct_addr;
+    uint32_t g_direct_stride;
+    /* Global alpha the output plane was last blended with */
+    uint8_t blend_alpha;
+
     QEMUSoundCard aud_card;
     SWVoiceOut *amixer_output_stream;
     int16_t audio_buffer_0[AUD_CHBUF_MAX_DEPTH];
     int16_t audio_buffer_1[AUD_CHBUF_MAX_DEPTH];
     size_t audio_data_available[2];
-    int64_t temp_buffer[AUD_CHBUF_MAX_DEPTH];
     int16_t out_buffer[AUD_CHBUF_MAX_DEPTH];
     size_t byte_left; /* byte available in out_buffer. */
     size_t data_ptr;  /* next byte to be sent to QEMU. */
@@ -50,6 +50,15 @@ typedef union {
     uint32_t words[4];
 } XlnxZDMADescr;
 
+/* Descriptors are fetched from RAM this many bytes at a time.  */
+#define ZDMA_DSCR_CACHE_SIZE 256
+
+typedef struct XlnxZDMADescrCache {
+    uint64_t addr;
+    uint32_t len;
+    uint8_t data[ZDMA_DSCR_CACHE_SIZE];
+} XlnxZDMADescrCache;
+
 typedef struct XlnxZDMA {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
@@ -61,6 +70,8 @@ typedef struct XlnxZDMA {
 
     struct {
         uint32_t bus_width;
+        /* Modelled bandwidth in bytes per second, 0 runs synchronously.  */
+        uint64_t bandwidth;
     } cfg;
 
     XlnxZDMAState state;
@@ -69,6 +80,11 @@ typedef struct XlnxZDMA {
     XlnxZDMADescr dsc_src;
     XlnxZDMADescr dsc_dst;
 
+    /* dsc_src is partially processed, resume it rather than reloading.  */
+    bool src_pending;
+    QEMUTimer *timer;
+    XlnxZDMADescrCache dscr_cache[2];
+
     uint32_t regs[ZDMA_R_MAX];
     RegisterInfo regs_info[ZDMA_R_MAX];
 
@@ -31,6 +31,31 @@
 
 #define XLNX_DPDMA_REG_ARRAY_SIZE (0x1000 >> 2)
 
+/*
+ * Where the last frame of a channel lives in guest memory, valid only if it
+ * was fetched with a single contiguous descriptor.
+ */
+typedef struct XlnxDPDMAFrame {
+    bool valid;
+    uint64_t addr;
+    uint32_t line_size;
+    uint32_t line_stride;
+    uint64_t size;
+} XlnxDPDMAFrame;
+
+/*
+ * Dirty tracking of a frame that is copied to a host data location, so that
+ * only the lines the guest wrote to are copied again.  @first_line and
+ * @num_lines are the lines the last operation copied, valid if @lines_valid.
+ */
+typedef struct XlnxDPDMADirty {
+    MemoryRegionSection section;
+    XlnxDPDMAFrame frame;
+    bool lines_valid;
+    uint32_t first_line;
+    uint32_t num_lines;
+} XlnxDPDMADirty;
+
 struct XlnxDPDMAState {
     /*< private >*/
     SysBusDevice parent_obj;
@@ -40,6 +65,8 @@ struct XlnxDPDMAState {
     MemoryRegion iomem;
     uint32_t registers[XLNX_DPDMA_REG_ARRAY_SIZE];
     uint8_t *data[6];
+    XlnxDPDMAFrame frame[6];
+    XlnxDPDMADirty dirty[6];
     bool operation_finished[6];
     qemu_irq irq;
 };
@@ -77,6 +104,49 @@ size_t xlnx_dpdma_start_operation(XlnxDPDMAState *s, uint8_t channel,
 void xlnx_dpdma_set_host_data_location(XlnxDPDMAState *s, uint8_t channel,
                                        void *p);
 
+/*
+ * xlnx_dpdma_get_frame: Get the location in guest memory of the last frame
+ *                       fetched by the channel.  Lets the client scan it out
+ *                       without a copy if it has no host data location.
+ *
+ * Returns true if the frame was a single contiguous descriptor.
+ *
+ * @s The DPDMA state.
+ * @channel The channel to query.
+ * @frame Filled with the frame geometry.
+ */
+bool xlnx_dpdma_get_frame(XlnxDPDMAState *s, uint8_t channel,
+                          XlnxDPDMAFrame *frame);
+
+/*
+ * xlnx_dpdma_copy_frame: Copy the last frame fetched by the channel to @p,
+ *                        for a client that did not set a host data location
+ *                        but cannot use the frame in place.
+ *
+ * Returns The number of bytes copied.
+ *
+ * @s The DPDMA state.
+ * @channel The channel the frame was fetched on.
+ * @p The buffer where to store the data.
+ */
+size_t xlnx_dpdma_copy_frame(XlnxDPDMAState *s, uint8_t channel, void *p);
+
+/*
+ * xlnx_dpdma_get_dirty_lines: Get the lines of the frame that the last
+ *                             operation on the channel copied to the host
+ *                             data location, the others are unchanged.
+ *
+ * Returns false if this is not known, in which case the whole frame must be
+ * considered changed.
+ *
+ * @s The DPDMA state.
+ * @channel The channel to query.
+ * @first Filled with the first copied line.
+ * @num Filled with the number of lines from @first on, 0 if none changed.
+ */
+bool xlnx_dpdma_get_dirty_lines(XlnxDPDMAState *s, uint8_t channel,
+                                uint32_t *first, uint32_t *num);
+
 /*
  * xlnx_dpdma_trigger_vsync_irq: Trigger a VSYNC IRQ when the display is
  *                               updated.
@@ -42,6 +42,15 @@ typedef struct FDTMachineInfo {
     qemu_irq *irq_base;
     /* per-device specific opaques */
     FDTDevOpaque *dev_opaques;
+    int num_dev_opaques;
+    /* node_path -> FDTDevOpaque */
+    GHashTable *opaque_index;
+    /* Indexes built once from the blob, see fdt_init_new_fdti.  */
+    GPtrArray *node_paths;
+    /* phandle -> node_path */
+    GHashTable *phandle_index;
+    /* node_path -> parent node_path */
+    GHashTable *parent_index;
     /* recheck coroutine queue */
     CoQueue *cq;
     /* list of all IRQ connections */
@@ -95,6 +104,16 @@ void *fdt_init_get_opaque(FDTMachineInfo *fdti, char *node_path);
 
 void *fdt_init_get_cpu_cluster(FDTMachineInfo *fdti, char *compat);
 
+/* Indexed replacements for qemu_devtree_get_node_by_phandle and
+ * qemu_devtree_getparent. node_path must hold DT_PATH_LENGTH bytes.
+ * Return 0 on success.
+ */
+
+int fdt_init_get_path_by_phandle(FDTMachineInfo *fdti, char *node_path,
+                                 uint32_t phandle);
+int fdt_init_get_parent(FDTMachineInfo *fdti, char *node_path,
+                        const char *current);
+
 /* statically register a FDTInitFn as being associate with a compatibility */
 
 #define fdt_register_compatibility_opaque(function, compat, n, opaque) \
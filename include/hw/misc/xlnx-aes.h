@@ -28,6 +28,7 @@
 #define XLNX_AES_H
 
 #include "qemu/gcm.h"
+#include "crypto/cipher.h"
 #include "hw/qdev-core.h"
 
 #define TYPE_XLNX_AES "xlnx-aes"
@@ -35,6 +36,8 @@
 typedef struct XlnxAES {
     DeviceState parent_obj;
     gcm_context gcm_ctx;
+    /* Host cipher for the payload key stream, NULL if unavailable.  */
+    QCryptoCipher *cipher;
     const char *prefix;
     qemu_irq s_done;
     qemu_irq s_busy;
@@ -148,10 +148,15 @@ struct XMPU {
     uint64_t addr_mask;
 
     void (*decode_region)(XMPU *s, XMPURegion *xr, unsigned int region);
+
+    /* Decoded and aligned regions, rebuilt after register updates.  */
+    XMPURegion regions[NR_XMPU_REGIONS];
+    bool regions_valid;
 };
 
 void xmpu_update_enabled(XMPU *s);
 void xmpu_flush(XMPU *s);
+int xmpu_post_load(void *opaque, int version_id);
 MemTxResult xmpu_read_common(void *opaque, XMPU *s, hwaddr addr, uint64_t *val,
                              unsigned size, MemTxAttrs attr);
 
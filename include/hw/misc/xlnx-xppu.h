@@ -242,8 +242,29 @@ typedef struct XPPUAperture {
     uint64_t extract_shift;
     /* RAM base. Start of APL tables for this particular Aperture.  */
     uint32_t ram_base;
+
+    /*
+     * Aliases that map granules open to every master straight through to
+     * the protected region, so those accesses never reach the check.
+     */
+    MemoryRegion *passthrough;
+    unsigned int nr_passthrough;
+    bool passthrough_active;
 } XPPUAperture;
 
+/*
+ * Cache of accesses that passed the APL check without side effects,
+ * tagged with the generation of the permission state they were made in.
+ */
+#define XPPU_PERM_CACHE_SIZE 256
+
+typedef struct XPPUPermCacheEntry {
+    uint32_t gen;
+    uint32_t ram_offset;
+    uint16_t requester_id;
+    uint8_t flags;
+} XPPUPermCacheEntry;
+
 struct XPPU {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
@@ -258,6 +279,10 @@ struct XPPU {
 
     uint32_t perm_ram[NR_APL_ENTRIES];
 
+    XPPUPermCacheEntry perm_cache[XPPU_PERM_CACHE_SIZE];
+    uint32_t perm_gen;
+    QEMUBH *passthrough_bh;
+
     uint32_t regs[XPPU_R_MAX];
     RegisterInfo regs_info[XPPU_R_MAX];
     uint8_t region;
@@ -269,6 +294,9 @@ void check_mid_parities(XPPU *s);
 bool check_apl_parity(XPPU *s, uint32_t val32);
 void update_mrs(XPPU *s);
 bool xppu_ap_check(XPPU *s, MemTxAttrs attr, bool rw, uint32_t apl);
+bool xppu_perm_check(XPPU *s, MemTxAttrs attr, bool rw, uint32_t ram_offset);
+void xppu_perm_changed(XPPU *s);
+int xppu_post_load(void *opaque, int version_id);
 void isr_update_irq(XPPU *s);
 MemTxResult xppu_read_common(void *opaque, XPPU *s, hwaddr addr,
                              uint64_t *value, unsigned size, MemTxAttrs attr);
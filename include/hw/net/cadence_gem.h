@@ -31,6 +31,7 @@
 #include "net/net.h"
 #include "hw/sysbus.h"
 #include "hw/mdio/mdio.h"
+#include "qemu/timer.h"
 
 #define CADENCE_GEM_MAXREG        (0x00000800 / 4) /* Last valid GEM address */
 
@@ -41,6 +42,17 @@
 #define MAX_TYPE1_SCREENERS             16
 #define MAX_TYPE2_SCREENERS             16
 
+/* Size of the window into each descriptor ring that is kept mapped.  */
+#define GEM_RING_CACHE_SIZE             (64 * 1024)
+
+typedef struct CadenceGEMRingCache {
+    MemoryRegionCache mrc;
+    hwaddr base;
+    /* Number of bytes from base that are directly accessible, may be 0.  */
+    hwaddr len;
+    bool valid;
+} CadenceGEMRingCache;
+
 typedef struct CadenceGEMState {
     /*< private >*/
     SysBusDevice parent_obj;
@@ -84,6 +96,13 @@ typedef struct CadenceGEMState {
 
     uint32_t rx_desc[MAX_PRIORITY_QUEUES][DESC_MAX_NUM_WORDS];
 
+    /* Mapped descriptor rings, dropped when the ring base moves.  */
+    CadenceGEMRingCache rx_ring[MAX_PRIORITY_QUEUES];
+    CadenceGEMRingCache tx_ring[MAX_PRIORITY_QUEUES];
+
+    /* Interrupt moderation timers, RX and TX.  */
+    QEMUTimer *intmod_timer[2];
+
     bool sar_active[4];
     MDIO *mdio;
 } CadenceGEMState;
@@ -267,6 +267,24 @@ void ptimer_run(ptimer_state *s, int oneshot);
  */
 void ptimer_stop(ptimer_state *s);
 
+/**
+ * ptimer_set_lazy - Select lazy evaluation of a periodic ptimer
+ * @s: ptimer
+ * @lazy: true if periodic expiries need not call the callback
+ *
+ * A device whose periodic timer expiry would have no visible effect (for
+ * instance because the interrupt it raises is masked or already pending)
+ * can set the timer to lazy mode.  The ptimer then stops arming its
+ * underlying QEMUTimer and works out the expiries it missed the next time
+ * the counter is read; the callback is not called for them.  Setting
+ * @lazy back to false re-arms the timer at the next expiry.  One-shot
+ * timers are not affected.
+ *
+ * This function will assert if it is called outside a
+ * ptimer_transaction_begin/commit block.
+ */
+void ptimer_set_lazy(ptimer_state *s, bool lazy);
+
 extern const VMStateDescription vmstate_ptimer;
 
 #define VMSTATE_PTIMER(_field, _state) \
@@ -14,6 +14,7 @@
 #include "hw/qdev-core.h"
 #include "exec/memory.h"
 #include "hw/registerfields.h"
+#include "qemu/thread.h"
 
 typedef struct RegisterInfo RegisterInfo;
 typedef struct RegisterAccessInfo RegisterAccessInfo;
@@ -71,6 +72,9 @@ struct RegisterAccessInfo {
  * @prefix: String prefix for log and debug messages
  *
  * @opaque: Opaque data for the register
+ *
+ * @no_w_mask, @fast_write and @fast_read are filled in by register_init()
+ * for the MMIO fast paths.
  */
 
 struct RegisterInfo {
@@ -84,6 +88,11 @@ struct RegisterInfo {
     const RegisterAccessInfo *access;
 
     void *opaque;
+
+    /* <private> */
+    uint64_t no_w_mask;
+    bool fast_write;
+    bool fast_read;
 };
 
 #define TYPE_REGISTER "qemu,register"
@@ -98,6 +107,12 @@ struct RegisterInfo {
  * @num_elements is the number of elements in the array r
  *
  * @mem: optional Memory region for the register
+ *
+ * @index maps addr / @stride to the register at that address, it is built
+ * on first use if the array was put together by hand.
+ *
+ * @lock serialises MMIO accesses once register_array_set_lockless() has
+ * taken @mem off the BQL.
  */
 
 struct RegisterInfoArray {
@@ -106,6 +121,15 @@ struct RegisterInfoArray {
     int num_elements;
     RegisterInfo **r;
 
+    /* <private> */
+    RegisterInfo **index;
+    uint64_t index_len;
+    unsigned int stride;
+    bool no_index;
+
+    bool lockless;
+    QemuRecMutex lock;
+
     bool debug;
     const char *prefix;
 };
@@ -228,6 +252,27 @@ RegisterInfoArray *register_init_block32(DeviceState *owner,
 
 void register_finalize_block(RegisterInfoArray *r_array);
 
+/**
+ * Dispatch MMIO to the register block without the BQL.
+ *
+ * Accesses then take a per-block lock instead.  Reads of registers without
+ * hooks, and writes to hook-free registers the guest fully owns (no ro,
+ * w1c or reserved bits), take only that lock.  Any access that runs a
+ * hook, does clear-on-read or logs still takes the BQL first, so hooks
+ * keep their usual environment.  The lock order is always BQL, then the
+ * block lock.
+ *
+ * A device may only opt in if code that runs outside MMIO, such as
+ * timers, GPIO inputs or other devices, never changes the hook-free
+ * registers above.  Device reset is fine because it runs with the vCPUs
+ * stopped.
+ *
+ * @r_array: A structure containing all of the registers, as returned by
+ *           register_init_block32()
+ */
+
+void register_array_set_lockless(RegisterInfoArray *r_array);
+
 /**
  * This function create a copy of RegisterInfo &  RegisterAccessInfo,
  * even alters the access config data removing ro and w1c properties.
@@ -37,6 +37,18 @@ typedef struct RemotePortDeviceClass {
 
     void (*ops[RP_CMD_max+1])(RemotePortDevice *obj, struct rp_pkt *pkt);
 
+    /**
+     * bql_free - optional. When the adaptor runs with dev-workers=on,
+     * packets for devices implementing this hook are dispatched in order
+     * from a per-device worker thread instead of the main queue.
+     * Return true if @pkt may be processed without holding the iothread
+     * lock, false to have the worker take the lock around ops[].
+     *
+     * @obj - Remote port device to recieve packet
+     * @pkt - remote port packets
+     */
+    bool (*bql_free)(RemotePortDevice *obj, struct rp_pkt *pkt);
+
 } RemotePortDeviceClass;
 
 uint32_t rp_new_id(RemotePort *s);
@@ -46,6 +58,18 @@ void rp_rsp_mutex_unlock(RemotePort *s);
 void rp_restart_sync_timer(RemotePort *s);
 
 ssize_t rp_write(RemotePort *s, const void *buf, size_t count);
+/*
+ * Write a packet made up of several buffers, e.g a header and its
+ * payload, without staging it. The segments go out back to back with
+ * no other writer in between.
+ */
+ssize_t rp_writev(RemotePort *s, const struct iovec *iov, int iovcnt);
+/*
+ * Queue a posted packet. Queued packets are sent as a single transfer
+ * when the queue fills up, before the next rp_write() or from a bottom
+ * half, whichever comes first.
+ */
+void rp_write_posted(RemotePort *s, const void *buf, size_t count);
 
 RemotePortDynPkt rp_wait_resp(RemotePort *s);
 
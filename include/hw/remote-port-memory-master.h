@@ -40,6 +40,7 @@ struct RemotePortMemoryMaster {
     uint32_t rp_dev;
     bool relative;
     uint32_t max_access_size;
+    bool posted_writes;
     struct RemotePort *rp;
     struct rp_peer_state *peer;
 };
@@ -48,4 +49,14 @@ void rp_mm_access(RemotePort *rp, uint32_t rp_dev,
                   struct rp_peer_state *peer,
                   MemoryTransaction *tr,
                   bool relative, uint64_t offset);
+
+/*
+ * Same as rp_mm_access but with additional RP packet header flags.
+ * Writes with RP_PKT_FLAGS_posted are queued and return immediately.
+ */
+void rp_mm_access_f(RemotePort *rp, uint32_t rp_dev,
+                    struct rp_peer_state *peer,
+                    MemoryTransaction *tr,
+                    bool relative, uint64_t offset,
+                    uint32_t flags);
 #endif
@@ -69,7 +69,8 @@ enum rp_cmd {
     RP_CMD_write       = 4,
     RP_CMD_interrupt   = 5,
     RP_CMD_sync        = 6,
-    RP_CMD_max         = 6
+    RP_CMD_checkpoint  = 7,
+    RP_CMD_max         = 7
 };
 
 enum {
@@ -135,6 +136,33 @@ enum {
      * of the posted header-flag.
      */
     CAP_WIRE_POSTED_UPDATES = 3,
+
+    /*
+     * Shared-memory ring transport. See struct rp_shm_hdr below.
+     * When both sides advertise this capability, each side sends a
+     * single RP_CMD_nop packet on the original channel and moves all of
+     * its following transmissions to the shared-memory rings.
+     * A receiver switches over to the ring when it sees the peer's nop.
+     */
+    CAP_SHM_RING = 4,
+
+    /*
+     * Posted bus-access writes.
+     * If the peer supports this, it will not respond to write packets
+     * that carry the RP_PKT_FLAGS_posted flag. Senders may then queue
+     * several posted writes and transmit them back to back in a single
+     * transfer without waiting for each one to complete. Any non-posted
+     * packet, e.g a read, acts as a barrier and is only sent after all
+     * previously queued posted writes.
+     */
+    CAP_BUSACCESS_POSTED_WRITES = 5,
+
+    /*
+     * Coordinated checkpoints, see struct rp_pkt_checkpoint below.
+     * If the peer supports this, it can serialize its state into a blob
+     * on request and later restore itself from that same blob.
+     */
+    CAP_CHECKPOINT = 6,
 };
 
 struct rp_pkt_hello {
@@ -230,6 +258,77 @@ struct rp_pkt_sync {
     uint64_t timestamp;
 } PACKED;
 
+/*
+ * Checkpoint packets.
+ *
+ * A RP_CHECKPOINT_save request asks the peer to serialize its state. It
+ * is sent with all earlier transactions completed, so the peer is idle.
+ * The response carries the state as a blob of len bytes directly after
+ * the packet.
+ * A RP_CHECKPOINT_restore request carries a blob previously returned by
+ * a save and asks the peer to load it. Its response has no blob.
+ * A status other than zero in a response means the operation failed.
+ */
+enum {
+    RP_CHECKPOINT_save    = 0,
+    RP_CHECKPOINT_restore = 1,
+};
+
+struct rp_pkt_checkpoint {
+    struct rp_pkt_hdr hdr;
+    uint64_t timestamp;
+    uint32_t op;
+    uint32_t status;
+    uint32_t len;
+} PACKED;
+
+/*
+ * Shared-memory transport layout.
+ *
+ * The side that creates the file (QEMU) places a struct rp_shm_hdr at
+ * offset 0 followed by two rings at hdr.ring_offset[]. Ring
+ * RP_SHM_RING_TO_PEER carries data from the creator to the peer and
+ * RP_SHM_RING_FROM_PEER the opposite direction. Each ring is a single
+ * producer, single consumer byte stream carrying RP packets exactly as
+ * they would appear on the socket. head and tail are free running byte
+ * counters. Fields are in host byte order since both sides share a host.
+ *
+ * Producers bump seq after moving head and consumers after moving tail.
+ * A side that wants to block increments waiters, re-checks the indexes
+ * and then sleeps on seq (e.g. with a futex).
+ */
+#define RP_SHM_MAGIC    0x52505348 /* RPSH */
+#define RP_SHM_VERSION  1
+
+enum {
+    RP_SHM_RING_TO_PEER   = 0,
+    RP_SHM_RING_FROM_PEER = 1,
+};
+
+struct rp_shm_hdr {
+    uint32_t magic;
+    uint32_t version;
+    /* Size of the data area of each ring. Always a power of 2.  */
+    uint32_t ring_size;
+    uint32_t reserved0;
+    uint64_t ring_offset[2];
+};
+
+struct rp_shm_ring {
+    /* Keep producer and consumer owned fields in separate cache lines.  */
+    uint32_t head;
+    uint32_t pad0[15];
+    uint32_t tail;
+    uint32_t pad1[15];
+    uint32_t seq;
+    uint32_t waiters;
+    uint32_t closed;
+    /* Copy of rp_shm_hdr.ring_size.  */
+    uint32_t size;
+    uint32_t pad2[12];
+    uint8_t data[];
+};
+
 struct rp_pkt {
     union {
         struct rp_pkt_hdr hdr;
@@ -238,6 +337,7 @@ struct rp_pkt {
         struct rp_pkt_busaccess_ext_base busaccess_ext_base;
         struct rp_pkt_interrupt interrupt;
         struct rp_pkt_sync sync;
+        struct rp_pkt_checkpoint checkpoint;
     };
 };
 
@@ -253,6 +353,9 @@ struct rp_peer_state {
         bool busaccess_ext_base;
         bool busaccess_ext_byte_en;
         bool wire_posted_updates;
+        bool shm_ring;
+        bool busaccess_posted_writes;
+        bool checkpoint;
     } caps;
 
     /* Used to normalize our clk.  */
@@ -435,6 +538,17 @@ size_t rp_encode_sync_resp(uint32_t id, uint32_t dev,
                            struct rp_pkt_sync *pkt,
                            int64_t clk);
 
+size_t rp_encode_checkpoint(uint32_t id, uint32_t dev,
+                            struct rp_pkt_checkpoint *pkt,
+                            int64_t clk, uint32_t op, uint32_t status,
+                            uint32_t len, uint32_t flags);
+
+/* Returns a pointer to the blob carried by a decoded checkpoint pkt.  */
+static inline void *rp_checkpoint_dataptr(struct rp_pkt_checkpoint *pkt)
+{
+    return (uint8_t *)pkt + sizeof *pkt;
+}
+
 void rp_process_caps(struct rp_peer_state *peer,
                      void *caps, size_t caps_len);
 
@@ -0,0 +1,54 @@
+/*
+ * QEMU remote-port shared-memory transport.
+ *
+ * Copyright (c) 2020 Xilinx Inc
+ *
+ * This code is licensed under the GNU GPL.
+ */
+#ifndef REMOTE_PORT_SHM_H
+#define REMOTE_PORT_SHM_H
+
+#include "hw/remote-port-proto.h"
+
+typedef struct RemotePortShm {
+    char *path;
+    void *map;
+    size_t map_size;
+    struct rp_shm_hdr *hdr;
+    /* Seen from our side, tx is the creator-to-peer ring.  */
+    struct rp_shm_ring *tx;
+    struct rp_shm_ring *rx;
+} RemotePortShm;
+
+/**
+ * rp_shm_create:
+ * @shm: The transport state to initialize
+ * @path: File to create and map
+ * @ring_size: Size in bytes of each ring data area, rounded up to a
+ *             power of 2
+ * @errp: returns an error if this function fails
+ *
+ * Creates, sizes and maps the shared file and initializes both rings.
+ * Returns true on success.
+ */
+bool rp_shm_create(RemotePortShm *shm, const char *path, uint32_t ring_size,
+                   Error **errp);
+
+/*
+ * Mark both rings as closed and wake up anyone blocked on them.
+ */
+void rp_shm_close(RemotePortShm *shm);
+void rp_shm_destroy(RemotePortShm *shm);
+
+/*
+ * Blocking byte stream accessors. @stop is polled while waiting and
+ * makes the call return early when it becomes true.
+ * Both return the number of transferred bytes, 0 once the ring has been
+ * closed and drained.
+ */
+ssize_t rp_shm_write(struct rp_shm_ring *ring, const void *buf, size_t count,
+                     const bool *stop);
+ssize_t rp_shm_read(struct rp_shm_ring *ring, void *buf, size_t count,
+                    const bool *stop);
+
+#endif
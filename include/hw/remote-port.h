@@ -12,13 +12,44 @@
 #include <stdbool.h>
 #include "hw/remote-port-proto.h"
 #include "hw/remote-port-device.h"
+#include "hw/remote-port-shm.h"
 #include "chardev/char.h"
 #include "chardev/char-fe.h"
 #include "hw/ptimer.h"
+#include "qemu/stats64.h"
+#include "sysemu/iothread.h"
 
 #define TYPE_REMOTE_PORT "remote-port"
 #define REMOTE_PORT(obj) OBJECT_CHECK(RemotePort, (obj), TYPE_REMOTE_PORT)
 
+#define RP_WORKER_QUEUE_SIZE 64
+typedef struct RemotePortWorker {
+    struct RemotePort *rp;
+    RemotePortDevice *dev;
+    QemuThread thread;
+    QemuMutex mutex;
+    QemuCond cond;
+    /* Packets are owned by the worker while queued.  */
+    RemotePortDynPkt pkt[RP_WORKER_QUEUE_SIZE];
+    unsigned int rpos;
+    unsigned int wpos;
+    bool stop;
+} RemotePortWorker;
+
+typedef struct RemotePortPktCounters {
+    Stat64 packets;
+    Stat64 bytes;
+} RemotePortPktCounters;
+
+#define RP_STATS_RTT_BUCKETS 24
+typedef struct RemotePortCounters {
+    RemotePortPktCounters tx[RP_CMD_max + 1];
+    RemotePortPktCounters rx[RP_CMD_max + 1];
+    Stat64 rtt[RP_STATS_RTT_BUCKETS];
+    Stat64 rsp_lock_wait_ns;
+    Stat64 sync_stall_ns;
+} RemotePortCounters;
+
 typedef struct RemotePortRespSlot {
             RemotePortDynPkt rsp;
             uint32_t id;
@@ -56,8 +87,49 @@ struct RemotePort {
         bool need_sync;
         struct rp_pkt rsp;
         uint64_t quantum;
+
+        /*
+         * Adaptive mode. The quantum doubles for every idle sync period
+         * and halves for every busy one, within [quantum_min, quantum_max].
+         */
+        bool adaptive;
+        uint64_t quantum_min;
+        uint64_t quantum_max;
+        /* Bus accesses and wire updates seen since the last sync.  */
+        uint32_t activity;
+
+        /* Statistics, exposed as QOM properties.  */
+        uint64_t tx_count;
+        uint64_t rx_count;
     } sync;
 
+    struct {
+        bool enable;
+        char *path;
+        uint32_t ring_size;
+        RemotePortShm rings;
+        /* Set once the respective direction has moved over to the rings.  */
+        bool tx_active;
+        bool rx_active;
+    } shm;
+
+    /*
+     * Posted packets that are transmitted in one go, see rp_write_posted.
+     * Protected by write_mutex.
+     */
+#define RP_POSTED_BUF_SIZE (64 * 1024)
+    struct {
+        uint8_t *buf;
+        size_t len;
+        QEMUBH *bh;
+    } posted;
+
+    /* Peer state blob, only valid while migrating.  */
+    struct {
+        uint8_t *blob;
+        uint32_t len;
+    } checkpoint;
+
     QemuMutex rsp_mutex;
     QemuCond progress_cond;
 
@@ -95,8 +167,18 @@ struct RemotePort {
 #define RP_MAX_OUTSTANDING_TRANSACTIONS 32
     struct {
         RemotePortRespSlot rsp_queue[RP_MAX_OUTSTANDING_TRANSACTIONS];
+        /* Created by the protocol thread on first use.  */
+        RemotePortWorker *worker;
+        RemotePortPktCounters tx_stats;
+        RemotePortPktCounters rx_stats;
     } dev_state[REMOTE_PORT_MAX_DEVS];
 
+    RemotePortCounters stats;
+
+    bool dev_workers;
+    /* Dispatches the packets that need the BQL, instead of the main loop.  */
+    IOThread *iothread;
+
     RemotePortDevice *devs[REMOTE_PORT_MAX_DEVS];
 };
 
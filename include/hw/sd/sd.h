@@ -106,6 +106,12 @@ typedef struct {
     int (*do_command)(SDState *sd, SDRequest *req, uint8_t *response);
     void (*write_data)(SDState *sd, uint8_t value);
     uint8_t (*read_data)(SDState *sd);
+    /*
+     * Optional: transfer @length bytes at once, so that whole blocks can
+     * be moved to and from the backend in a single request.
+     */
+    void (*write_block)(SDState *sd, const uint8_t *buf, size_t length);
+    void (*read_block)(SDState *sd, uint8_t *buf, size_t length);
     bool (*data_ready)(SDState *sd);
     void (*set_voltage)(SDState *sd, uint16_t millivolts);
     uint8_t (*get_dat_lines)(SDState *sd);
@@ -162,6 +168,26 @@ bool sdbus_get_cmd_line(SDBus *sdbus);
 int sdbus_do_command(SDBus *sd, SDRequest *req, uint8_t *response);
 void sdbus_write_data(SDBus *sd, uint8_t value);
 uint8_t sdbus_read_data(SDBus *sd);
+/**
+ * sdbus_write_block: Write data to the card
+ * @sd: bus
+ * @buf: data to write
+ * @length: number of bytes to write
+ *
+ * Same as calling sdbus_write_data() for each byte of @buf, but lets the
+ * card submit whole blocks to its backend at once.
+ */
+void sdbus_write_block(SDBus *sd, const void *buf, size_t length);
+/**
+ * sdbus_read_block: Read data from the card
+ * @sd: bus
+ * @buf: buffer to fill
+ * @length: number of bytes to read
+ *
+ * Same as calling sdbus_read_data() for each byte of @buf, but lets the
+ * card read whole blocks from its backend at once.
+ */
+void sdbus_read_block(SDBus *sd, void *buf, size_t length);
 bool sdbus_data_ready(SDBus *sd);
 bool sdbus_get_inserted(SDBus *sd);
 bool sdbus_get_readonly(SDBus *sd);
@@ -57,6 +57,16 @@ struct SSISlaveClass {
      * always be called for the device for every txrx access to the parent bus
      */
     uint32_t (*transfer_raw)(SSISlave *dev, uint32_t val);
+
+    /* Optional, move up to len bytes while the device is selected, as if
+     * transfer had been called for each of them. tx may be NULL to send
+     * zeroes and rx may be NULL to discard what is received. Returns the
+     * number of bytes handled, which may be short or 0 if the device is
+     * not in a state where it can stream data (e.g. while collecting a
+     * command), the master then carries on byte by byte.
+     */
+    size_t (*transfer_bulk)(SSISlave *dev, const uint8_t *tx, uint8_t *rx,
+                            size_t len);
 };
 
 struct SSISlave {
@@ -86,6 +96,13 @@ SSIBus *ssi_create_bus(DeviceState *parent, const char *name);
 
 uint32_t ssi_transfer(SSIBus *bus, uint32_t val);
 
+/* Transfer len bytes, same result as calling ssi_transfer for each one.
+ * Slaves implementing transfer_bulk get the data in one go where they can.
+ * tx may be NULL to send zeroes and rx NULL to discard the received data.
+ */
+void ssi_transfer_bulk(SSIBus *bus, const uint8_t *tx, uint8_t *rx,
+                       size_t len);
+
 /* Automatically connect all children nodes a spi controller as slaves */
 void ssi_auto_connect_slaves(DeviceState *parent, qemu_irq *cs_lines,
                              SSIBus *bus);
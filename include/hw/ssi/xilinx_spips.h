@@ -35,8 +35,9 @@ typedef struct XilinxSPIPS XilinxSPIPS;
 #define XLNX_SPIPS_R_MAX        (0x100 / 4)
 #define XLNX_ZYNQMP_SPIPS_R_MAX (0x800 / 4)
 
-/* Bite off 4k chunks at a time */
-#define LQSPI_CACHE_SIZE 1024
+/* Default geometry of the linear mode read cache */
+#define LQSPI_CACHE_LINES 64
+#define LQSPI_CACHE_LINE_SIZE 4096
 
 #define QSPI_DMA_MAX_BURST_SIZE 2048
 
@@ -101,8 +102,17 @@ typedef struct {
     MemoryRegion *hack_dma;
     AddressSpace *hack_as;
 
-    uint8_t lqspi_buf[LQSPI_CACHE_SIZE];
-    hwaddr lqspi_cached_addr;
+    /* Linear mode read cache, see lqspi_load_cache.  */
+    struct {
+        uint32_t num_lines;
+        uint32_t line_size;
+        uint32_t prefetch;
+        uint8_t *data;
+        hwaddr *addr;
+        uint64_t *lru;
+        uint64_t stamp;
+        unsigned int last;
+    } lqspi_cache;
     Error *migration_blocker;
     bool mmio_execution_enabled;
 } XilinxQSPIPS;
@@ -42,11 +42,27 @@ typedef struct StreamSlaveClass {
      * @eop: End of packet flag
      */
     size_t (*push)(StreamSlave *obj, unsigned char *buf, size_t len, bool eop);
+    /**
+     * pushv - push scattered data to a Stream slave. Same semantics as push,
+     * the elements of @iov form one contiguous piece of the stream. Slaves
+     * that can consume a whole packet in one go implement this to avoid
+     * their masters gathering it into a bounce buffer. Optional, if not
+     * implemented push is called for each element.
+     * @obj: Stream slave to push to
+     * @iov: Data to write
+     * @iovcnt: Number of elements in @iov
+     * @eop: End of packet flag, applies to the last element
+     */
+    size_t (*pushv)(StreamSlave *obj, const struct iovec *iov, int iovcnt,
+                    bool eop);
 } StreamSlaveClass;
 
 size_t
 stream_push(StreamSlave *sink, uint8_t *buf, size_t len, bool eop);
 
+size_t
+stream_pushv(StreamSlave *sink, const struct iovec *iov, int iovcnt, bool eop);
+
 bool
 stream_can_push(StreamSlave *sink, StreamCanPushNotifyFn notify,
                 void *notify_opaque);
@@ -78,6 +78,10 @@ typedef struct VFIOContainer {
     QLIST_HEAD(, VFIOHostDMAWindow) hostwin_list;
     QLIST_HEAD(, VFIOGroup) group_list;
     QLIST_ENTRY(VFIOContainer) next;
+    /* Pending guest IOMMU unmap, only used with lazy unmapping */
+    QEMUBH *unmap_bh;
+    hwaddr unmap_iova;
+    hwaddr unmap_size;
 } VFIOContainer;
 
 typedef struct VFIOGuestIOMMU {
@@ -109,6 +113,7 @@ typedef struct VFIODevice {
     bool needs_reset;
     bool no_mmap;
     bool balloon_allowed;
+    bool lazy_iommu_unmap;
     VFIODeviceOps *ops;
     unsigned int num_irqs;
     unsigned int num_regions;
@@ -42,7 +42,7 @@ enum virtio_balloon_free_page_report_status {
 
 typedef struct VirtIOBalloon {
     VirtIODevice parent_obj;
-    VirtQueue *ivq, *dvq, *svq, *free_page_vq;
+    VirtQueue *ivq, *dvq, *svq, *free_page_vq, *reporting_vq;
     uint32_t free_page_report_status;
     uint32_t num_pages;
     uint32_t actual;
@@ -64,6 +64,12 @@ typedef struct VirtIOBalloon {
      * stopped.
      */
     bool block_iothread;
+    /* Runs free page reporting in @iothread, if one was given */
+    QEMUBH *report_bh;
+    /* Protects report_skip_migration against the precopy notifier */
+    QemuMutex report_lock;
+    /* Reported pages may be dropped from the precopy bitmap */
+    bool report_skip_migration;
     NotifierWithReturn free_page_report_notify;
     int64_t stats_last_update;
     int64_t stats_poll_interval;
@@ -41,12 +41,29 @@ struct VirtIOBlkConf
     bool seg_max_adjust;
     uint32_t max_discard_sectors;
     uint32_t max_write_zeroes_sectors;
+    uint32_t merge_window_us;
     bool x_enable_wce_if_config_wce;
 };
 
 struct VirtIOBlockDataPlane;
 
 struct VirtIOBlockReq;
+
+#define VIRTIO_BLK_MAX_MERGE_REQS 32
+
+typedef struct MultiReqBuffer {
+    struct VirtIOBlockReq *reqs[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int num_reqs;
+    bool is_write;
+    /* Contiguous discard or write zeroes requests, linked by mr_next */
+    struct VirtIOBlockReq *dwz_head;
+    struct VirtIOBlockReq *dwz_tail;
+    uint64_t dwz_sector;
+    uint64_t dwz_nb_sectors;
+    int dwz_flags;
+    bool dwz_is_write_zeroes;
+} MultiReqBuffer;
+
 typedef struct VirtIOBlock {
     VirtIODevice parent_obj;
     BlockBackend *blk;
@@ -61,6 +78,13 @@ typedef struct VirtIOBlock {
     struct VirtIOBlockDataPlane *dataplane;
     uint64_t host_features;
     size_t config_size;
+    /* Requests held back for up to conf.merge_window_us to merge them */
+    MultiReqBuffer mrb;
+    QEMUTimer *merge_timer;
+    AioContext *merge_timer_ctx;
+    /* Flushes that arrived while another flush was in flight */
+    struct VirtIOBlockReq *pending_flushes;
+    bool flush_in_flight;
 } VirtIOBlock;
 
 typedef struct VirtIOBlockReq {
@@ -77,14 +101,6 @@ typedef struct VirtIOBlockReq {
     BlockAcctCookie acct;
 } VirtIOBlockReq;
 
-#define VIRTIO_BLK_MAX_MERGE_REQS 32
-
-typedef struct MultiReqBuffer {
-    VirtIOBlockReq *reqs[VIRTIO_BLK_MAX_MERGE_REQS];
-    unsigned int num_reqs;
-    bool is_write;
-} MultiReqBuffer;
-
 bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq);
 
 #endif
@@ -0,0 +1,61 @@
+/*
+ * Runtime statistics reported by query-stats
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef MONITOR_STATS_H
+#define MONITOR_STATS_H
+
+#include "qapi/qapi-types-stats.h"
+
+/*
+ * A provider describes the statistics it reports for one kind of object
+ * with a static array of descriptors.  Its retrieve function is called with
+ * the BQL held for every query and passes the current values of each object
+ * to stats_collect(), in descriptor order.
+ */
+typedef struct StatsDescriptor {
+    const char *name;
+    StatsType type;
+    bool has_unit;
+    StatsUnit unit;
+} StatsDescriptor;
+
+typedef struct StatsCollector StatsCollector;
+
+typedef void StatsRetrieveFunc(StatsCollector *c);
+
+/**
+ * stats_register: Add a group of statistics to query-stats
+ * @provider: the provider reporting the statistics
+ * @target: the kind of object described
+ * @desc: @num descriptors, which must outlive the process
+ * @retrieve: function reporting the values
+ */
+void stats_register(StatsProvider provider, StatsTarget target,
+                    const StatsDescriptor *desc, unsigned int num,
+                    StatsRetrieveFunc *retrieve);
+
+/**
+ * stats_wanted: Check whether the values of an object are requested
+ * @c: the collector passed to the retrieve function
+ * @qom_path: the QOM path of the object, NULL for StatsTarget vm
+ *
+ * Lets providers skip objects whose values are expensive to compute.
+ */
+bool stats_wanted(StatsCollector *c, const char *qom_path);
+
+/**
+ * stats_collect: Report the values of one object
+ * @c: the collector passed to the retrieve function
+ * @qom_path: the QOM path of the object, NULL for StatsTarget vm
+ * @values: one value per descriptor of the provider
+ */
+void stats_collect(StatsCollector *c, const char *qom_path,
+                   const uint64_t *values);
+
+#endif /* MONITOR_STATS_H */
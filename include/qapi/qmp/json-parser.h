@@ -20,14 +20,27 @@ typedef struct JSONLexer {
     int x, y;
 } JSONLexer;
 
+typedef struct JSONParserFrame JSONParserFrame;
+
+typedef struct JSONParser {
+    va_list *ap;
+    Error *err;
+    QObject *result;
+    bool complete;
+    /* Objects and arrays that are still open, innermost last */
+    JSONParserFrame *stack;
+    int depth;
+    int stack_size;
+} JSONParser;
+
 typedef struct JSONMessageParser {
     void (*emit)(void *opaque, QObject *json, Error *err);
     void *opaque;
-    va_list *ap;
     JSONLexer lexer;
+    JSONParser parser;
     int brace_count;
     int bracket_count;
-    GQueue tokens;
+    uint64_t token_count;
     uint64_t token_size;
 } JSONMessageParser;
 
@@ -74,6 +74,21 @@ void cpu_exec_step_atomic(CPUState *cpu);
  */
 bool set_preferred_target_page_bits(int bits);
 
+/**
+ * set_target_page_bits_floor:
+ * @bits: number of bits needed to represent an address within the page
+ *
+ * Set the target page size to @bits, even if the CPUs would prefer a
+ * smaller one.  This is only correct if the guest never maps memory in
+ * units smaller than this: translations that are finer than a target
+ * page are handled like sub-page protection, by repeating the MMU lookup
+ * on every access.  Later calls to set_preferred_target_page_bits() with
+ * smaller sizes succeed and are ignored.
+ * Returns false if the size is out of range for the target, or if the
+ * page size has already been finalized.
+ */
+bool set_target_page_bits_floor(int bits);
+
 /**
  * finalize_target_page_bits:
  * Commit the final value set by set_preferred_target_page_bits.
@@ -147,6 +147,9 @@ struct CoMutex {
     unsigned handoff, sequence;
 
     Coroutine *holder;
+
+    /* Lock class for the contention profiler, see lock-profile.h */
+    const char *profile_class;
 };
 
 /**
@@ -155,6 +158,13 @@ struct CoMutex {
  */
 void qemu_co_mutex_init(CoMutex *mutex);
 
+/**
+ * Report contended acquisitions of the mutex under @name in the lock
+ * contention profiler.  Mutexes without a class are reported as "CoMutex".
+ * @name must outlive the process, e.g. a string literal.
+ */
+void qemu_co_mutex_set_profile_class(CoMutex *mutex, const char *name);
+
 /**
  * Locks the mutex. If the lock cannot be taken immediately, control is
  * transferred to the caller of the current coroutine.
@@ -319,6 +329,21 @@ void qemu_co_sleep_wake(QemuCoSleepState *sleep_state);
  */
 void coroutine_fn yield_until_fd_readable(int fd);
 
+/**
+ * Increase coroutine pool size
+ *
+ * Devices that keep many requests in flight call this with the number of
+ * coroutines they may need at once, so that the pool does not thrash.
+ */
+void qemu_coroutine_increase_pool_batch_size(unsigned int additional_pool_size);
+
+/**
+ * Decrease coroutine pool size
+ *
+ * Undo a previous qemu_coroutine_increase_pool_batch_size() call.
+ */
+void qemu_coroutine_decrease_pool_batch_size(unsigned int removing_pool_size);
+
 #include "qemu/lockable.h"
 
 #endif /* QEMU_COROUTINE_H */
@@ -28,7 +28,14 @@
 #include "qemu/queue.h"
 #include "qemu/coroutine.h"
 
+#ifdef CONFIG_COROUTINE_STACK_SIZE
+#define COROUTINE_STACK_SIZE CONFIG_COROUTINE_STACK_SIZE
+#else
 #define COROUTINE_STACK_SIZE (1 << 20)
+#endif
+
+/* Part of a pooled coroutine's stack that qemu_coroutine_trim() leaves */
+#define COROUTINE_STACK_KEEP (64 * 1024)
 
 typedef enum {
     COROUTINE_YIELD = 1,
@@ -66,6 +73,7 @@ struct Coroutine {
 
 Coroutine *qemu_coroutine_new(void);
 void qemu_coroutine_delete(Coroutine *co);
+void qemu_coroutine_trim(Coroutine *co);
 CoroutineAction qemu_coroutine_switch(Coroutine *from, Coroutine *to,
                                       CoroutineAction action);
 
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include "qemu/thread.h"
 
 struct etrace_entry32 {
     uint32_t duration;
@@ -51,19 +52,71 @@ enum etrace_mem_attr {
     MEM_WRITE   = (1 << 0),
 };
 
+enum etrace_compress {
+    ETRACE_COMPRESS_NONE = 0,
+    ETRACE_COMPRESS_ZLIB = 1,
+    ETRACE_COMPRESS_ZSTD = 2,
+};
+
+struct etrace_ring;
+
 struct etracer {
     const char *filename;
     FILE *fp;
     unsigned int arch_bits;
     uint64_t flags;
 
+    /*
+     * Buffered mode. Every thread that emits records gets its own ring
+     * (see etrace.c) and a writer thread drains them into fp. With
+     * ring_size == 0 records are written synchronously by the caller.
+     */
+    size_t ring_size;
+    struct etrace_ring *rings;
+    QemuMutex lock;
+    QemuThread writer;
+    QemuSemaphore writer_sem;
+    bool writer_running;
+    bool writer_stop;
+
+    /* Block compression, done by the writer thread.  */
+    enum etrace_compress compress;
+    struct {
+        uint8_t *buf;
+        size_t len;
+        size_t size;
+        uint8_t *zbuf;
+        size_t zsize;
+        /* Offset in the uncompressed stream of buf[0].  */
+        uint64_t raw_offset;
+        /* Number of bytes written to fp so far.  */
+        uint64_t file_offset;
+        /* Seek index, one entry per block.  */
+        uint64_t *index;
+        size_t nr_blocks;
+        size_t index_size;
+    } block;
+
     /* FIXME: Removeme.  */
     unsigned int current_unit_id;
 
+    /*
+     * Filters. Address ranges are resolved when a TB is translated,
+     * CPU and sampling filters when it executes.
+     */
+#define ETRACE_MAX_RANGES 16
+    struct {
+        uint64_t start;
+        uint64_t end;
+    } ranges[ETRACE_MAX_RANGES];
+    unsigned int nr_ranges;
+    /* Bit N set traces unit N. 0 traces all units.  */
+    uint64_t unit_mask;
+    /* Trace one TB every sample_tbs TBs and/or every sample_ns ns.  */
+    uint64_t sample_tbs;
+    uint64_t sample_ns;
+
 #define EXEC_CACHE_SIZE (16 * 1024)
-    uint64_t exec_start;
-    bool exec_start_valid;
-    int64_t exec_start_time;
     struct {
         union {
             struct etrace_entry64 t64[EXEC_CACHE_SIZE];
@@ -92,6 +145,15 @@ void etrace_dump_exec_end(struct etracer *t,
                           unsigned int unit_id,
                           uint64_t end);
 
+/* True if the calling thread has an exec record started.  */
+bool etrace_exec_start_valid(struct etracer *t);
+void etrace_exec_cancel(struct etracer *t);
+
+/* Translation time filter for code in [start, end).  */
+bool etrace_filter_tb(struct etracer *t, uint64_t start, uint64_t end);
+/* Execution time filter, called for TBs that passed etrace_filter_tb.  */
+bool etrace_filter_exec(struct etracer *t, unsigned int unit_id);
+
 void etrace_mem_access(struct etracer *t, uint16_t unit_id,
                        uint64_t guest_vaddr, uint64_t guest_paddr,
                        size_t size, uint64_t attr, uint64_t val);
@@ -123,7 +185,7 @@ void qemu_etrace_cleanup(void);
 
 static inline bool qemu_etrace_mask(uint64_t mask)
 {
-    if (qemu_etrace_enabled
+    if (unlikely(qemu_etrace_enabled)
         && (qemu_etracer.flags & mask)) {
         return true;
     }
@@ -80,11 +80,21 @@ typedef UINT64 uint64_t;
 #define POLARSSL_ERR_GCM_AUTH_FAILED                       -0x0012  /**< Authenticated decryption failed. */
 #define POLARSSL_ERR_GCM_BAD_INPUT                         -0x0014  /**< Bad input parameters to function. */
 
+/**
+ * \brief          Optional bulk block cipher
+ *
+ * Encrypts \p len bytes (a multiple of 16) in place in ECB mode with the
+ * key the context was initialized with.
+ */
+typedef void (*gcm_ecb_fn)(void *opaque, unsigned char *buf, size_t len);
+
 /**
  * \brief          GCM context structure
  */
 typedef struct {
     aes_context aes_ctx;        /*!< AES context used */
+    gcm_ecb_fn ecb;             /*!< Optional bulk cipher for the payload */
+    void *ecb_opaque;
     uint8_t iv[16];
     uint8_t ectr[16];
     uint8_t mul[16];
@@ -114,6 +124,16 @@ extern "C" {
  */
 int gcm_init( gcm_context *ctx, const unsigned char *key, unsigned int keysize );
 
+/**
+ * \brief           Route whole payload blocks through an external cipher
+ *
+ * \param ctx       GCM context, already initialized with gcm_init()
+ * \param ecb       ECB encryption function using the same key, or NULL
+ *                  to use the built-in AES implementation
+ * \param opaque    passed to \p ecb
+ */
+void gcm_set_ecb(gcm_context *ctx, gcm_ecb_fn ecb, void *opaque);
+
 void gcm_push_iv(gcm_context *ctx,
                  const unsigned char *iv,
                  size_t iv_len, size_t tag_len);
@@ -0,0 +1,71 @@
+/*
+ * Lock contention profiler
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Unlike QSP (see qsp.h), which intercepts every acquisition once enabled,
+ * this profiler is always on and only looks at acquisitions that did not
+ * succeed on the first try.  The uncontended path costs nothing beyond the
+ * trylock that the lock implementation would issue anyway.
+ *
+ * Samples are accumulated in per-thread tables keyed by lock class.  A
+ * class is either a name attached to the lock with
+ * qemu_mutex_set_profile_class() and friends, or the file:line of the
+ * acquiring call site for anonymous locks.
+ */
+#ifndef QEMU_LOCK_PROFILE_H
+#define QEMU_LOCK_PROFILE_H
+
+/*
+ * Bucket 0 counts waits shorter than 1024 ns, bucket i counts waits in
+ * [2^(9+i), 2^(10+i)) ns and the last bucket is open-ended.
+ */
+#define LOCK_PROFILE_BUCKETS 24
+
+typedef struct LockProfileStats {
+    const char *name;       /* class name, or file of the call site */
+    int line;               /* call site line; 0 for named classes */
+    uint64_t count;
+    uint64_t wait_ns;
+    uint64_t max_ns;
+    uint64_t hist[LOCK_PROFILE_BUCKETS];
+} LockProfileStats;
+
+typedef void LockProfileIterFunc(const LockProfileStats *stats, void *opaque);
+
+/**
+ * lock_profile_begin: Start timing a contended acquisition
+ *
+ * Returns a timestamp to pass to lock_profile_end().
+ */
+int64_t lock_profile_begin(void);
+
+/**
+ * lock_profile_end: Account a contended acquisition
+ * @class: the name of the lock class, or NULL for anonymous locks; must
+ *         outlive the process, e.g. a string literal
+ * @file: the file of the acquiring call site
+ * @line: the line of the acquiring call site
+ * @start: the value returned by lock_profile_begin()
+ *
+ * Must not take any QemuMutex, since it is called from within
+ * qemu_mutex_lock().
+ */
+void lock_profile_end(const char *class, const char *file, int line,
+                      int64_t start);
+
+/**
+ * lock_profile_foreach: Iterate over the aggregated per-class statistics
+ * @func: called once per lock class, sorted by decreasing total wait time
+ * @opaque: passed to @func
+ *
+ * Samples from all threads, including exited ones, are merged.  Values
+ * are read without stopping the producers, so a class may be slightly
+ * inconsistent with itself (e.g. @count vs. the histogram).
+ */
+void lock_profile_foreach(LockProfileIterFunc *func, void *opaque);
+
+#endif /* QEMU_LOCK_PROFILE_H */
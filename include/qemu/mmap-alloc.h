@@ -27,6 +27,25 @@ void *qemu_ram_mmap(int fd,
                     bool shared,
                     bool is_pmem);
 
+/**
+ * qemu_ram_mmap_hugetlb: mmap anonymous memory backed by huge pages.
+ *
+ * Parameters:
+ *  @size: the number of bytes to be mmaped, a multiple of @pagesize
+ *  @pagesize: the huge page size, e.g. 2 MiB or 1 GiB; it is also the
+ *             alignment of the mapping
+ *  @shared: map with MAP_SHARED rather than MAP_PRIVATE.
+ *
+ * The pages come from the host's hugetlb pool and are reserved when the
+ * mapping is created, so no hugetlbfs mount is needed.  Free the mapping
+ * with qemu_ram_munmap(-1, ...).
+ *
+ * Return:
+ *  On success, return a pointer to the mapped area.
+ *  On failure, return MAP_FAILED and set errno.
+ */
+void *qemu_ram_mmap_hugetlb(size_t size, size_t pagesize, bool shared);
+
 void qemu_ram_munmap(int fd, void *ptr, size_t size);
 
 #endif
@@ -230,8 +230,16 @@ void qemu_plugin_register_vcpu_tb_exec_cb(struct qemu_plugin_tb *tb,
                                           enum qemu_plugin_cb_flags flags,
                                           void *userdata);
 
+/**
+ * enum qemu_plugin_op - inline operations
+ *
+ * @QEMU_PLUGIN_INLINE_ADD_U64: add @imm to the uint64_t at @ptr
+ * @QEMU_PLUGIN_INLINE_STORE_U64: store @imm to the uint64_t at @ptr, e.g.
+ * to mark a block or instruction as covered without reading memory first
+ */
 enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
+    QEMU_PLUGIN_INLINE_STORE_U64,
 };
 
 /**
@@ -397,6 +405,47 @@ void qemu_plugin_register_flush_cb(qemu_plugin_id_t id,
 void qemu_plugin_register_atexit_cb(qemu_plugin_id_t id,
                                     qemu_plugin_udata_cb_t cb, void *userdata);
 
+/**
+ * qemu_plugin_read_register() - read a register of the current vCPU
+ * @reg: register number, as in the target's gdb register description
+ * @buf: buffer receiving the value, in target byte order
+ * @len: size of @buf; longer registers are truncated
+ *
+ * Only valid from a vCPU callback. The numbering is the one the gdbstub
+ * uses, i.e. the core registers followed by those of the extra XML
+ * features in gdb-xml/.
+ *
+ * Returns the size of the register in bytes, 0 if @reg does not exist.
+ */
+int qemu_plugin_read_register(int reg, void *buf, size_t len);
+
+/**
+ * qemu_plugin_read_memory_vaddr() - read guest memory
+ * @addr: guest virtual address, translated with the current vCPU's MMU
+ * @buf: buffer receiving the data
+ * @len: number of bytes to read
+ *
+ * Only valid from a vCPU callback. Returns false if any part of the
+ * range is not mapped.
+ */
+bool qemu_plugin_read_memory_vaddr(uint64_t addr, void *buf, size_t len);
+
+/**
+ * qemu_plugin_register_vcpu_sample_cb() - register a sampling callback
+ * @id: plugin ID
+ * @period_ns: sampling period in virtual time, 0 to stop sampling
+ * @cb: callback function
+ *
+ * Every @period_ns the @cb function is called once on each vCPU, between
+ * two translation blocks. Together with qemu_plugin_read_register() this
+ * allows statistical profiling without per-instruction callbacks.
+ * Only one sampling callback per plugin is supported; registering again
+ * replaces it. Not available in user-mode.
+ */
+void qemu_plugin_register_vcpu_sample_cb(qemu_plugin_id_t id,
+                                         uint64_t period_ns,
+                                         qemu_plugin_vcpu_simple_cb_t cb);
+
 /* returns -1 in user-mode */
 int qemu_plugin_n_vcpus(void);
 
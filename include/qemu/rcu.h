@@ -27,6 +27,7 @@
 #include "qemu/thread.h"
 #include "qemu/queue.h"
 #include "qemu/atomic.h"
+#include "qemu/notify.h"
 #include "qemu/sys_membarrier.h"
 
 #ifdef __cplusplus
@@ -66,6 +67,13 @@ struct rcu_reader_data {
 
     /* Data used for registry, protected by rcu_registry_lock */
     QLIST_ENTRY(rcu_reader_data) node;
+
+    /*
+     * Notifiers that make this thread leave its read-side critical
+     * section during an expedited grace period.  Protected by
+     * rcu_registry_lock.
+     */
+    NotifierList force_rcu;
 };
 
 extern __thread struct rcu_reader_data rcu_reader;
@@ -112,6 +120,21 @@ static inline void rcu_read_unlock(void)
 
 extern void synchronize_rcu(void);
 
+/*
+ * Like synchronize_rcu(), but also runs the force_rcu notifiers of the
+ * readers that hold up the grace period.
+ */
+extern void synchronize_rcu_expedited(void);
+
+/*
+ * The notifier is called with rcu_registry_lock held, from a thread that
+ * waits for an expedited grace period while the calling thread is in a
+ * read-side critical section.  It must only ask the thread to leave the
+ * critical section soon, e.g. with cpu_exit().
+ */
+void rcu_add_force_rcu_notifier(Notifier *n);
+void rcu_remove_force_rcu_notifier(Notifier *n);
+
 /*
  * Reader thread registration.
  */
@@ -0,0 +1,63 @@
+/*
+ * Host CPU placement of QEMU threads
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Threads register themselves, or are registered by their creator, under
+ * a placement class.  Whenever the policy of a class changes, the
+ * affinity of every registered thread of that class is updated, and new
+ * threads pick up the current policy when they are registered.  There is
+ * therefore no window in which a hotplugged vCPU runs unplaced.
+ */
+#ifndef QEMU_THREAD_PLACEMENT_H
+#define QEMU_THREAD_PLACEMENT_H
+
+#include "qemu/thread.h"
+
+/* Host CPUs above this limit cannot be named in a placement policy */
+#define THREAD_PLACEMENT_MAX_CPUS 1024
+
+typedef enum ThreadPlacementClass {
+    THREAD_PLACEMENT_VCPU,
+    THREAD_PLACEMENT_IOTHREAD,
+    /* Thread pool, migration compression and multifd threads */
+    THREAD_PLACEMENT_WORKER,
+    THREAD_PLACEMENT__MAX,
+} ThreadPlacementClass;
+
+typedef struct ThreadPlacement ThreadPlacement;
+
+/**
+ * thread_placement_add: Register a thread and apply the current policy
+ * @thread: the thread, copied; may be the result of qemu_thread_get_self()
+ * @cls: the placement class of the thread
+ * @index: the index of the thread within its class, e.g. the vCPU index
+ *
+ * The thread must stay alive until thread_placement_del() is called.
+ */
+ThreadPlacement *thread_placement_add(QemuThread *thread,
+                                      ThreadPlacementClass cls, int index);
+
+/**
+ * thread_placement_del: Unregister a thread
+ * @tp: the value returned by thread_placement_add(), or NULL
+ */
+void thread_placement_del(ThreadPlacement *tp);
+
+/**
+ * thread_placement_set_policy: Change the policy of a class
+ * @cls: the placement class
+ * @cpus: bitmap of THREAD_PLACEMENT_MAX_CPUS host CPUs, or NULL to lift
+ *        any restriction; copied
+ * @pin: if true, the thread of index i only runs on the i-th CPU of
+ *       @cpus (modulo their number) instead of on any of them
+ *
+ * Updates all registered threads of @cls.
+ */
+void thread_placement_set_policy(ThreadPlacementClass cls,
+                                 const unsigned long *cpus, bool pin);
+
+#endif /* QEMU_THREAD_PLACEMENT_H */
@@ -9,6 +9,7 @@ typedef QemuMutex QemuRecMutex;
 #define qemu_rec_mutex_lock_impl    qemu_mutex_lock_impl
 #define qemu_rec_mutex_trylock_impl qemu_mutex_trylock_impl
 #define qemu_rec_mutex_unlock qemu_mutex_unlock
+#define qemu_rec_mutex_set_profile_class qemu_mutex_set_profile_class
 
 struct QemuMutex {
     pthread_mutex_t lock;
@@ -16,6 +17,7 @@ struct QemuMutex {
     const char *file;
     int line;
 #endif
+    const char *profile_class;
     bool initialized;
 };
 
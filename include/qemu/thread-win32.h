@@ -9,16 +9,19 @@ struct QemuMutex {
     const char *file;
     int line;
 #endif
+    const char *profile_class;
     bool initialized;
 };
 
 typedef struct QemuRecMutex QemuRecMutex;
 struct QemuRecMutex {
     CRITICAL_SECTION lock;
+    const char *profile_class;
     bool initialized;
 };
 
 void qemu_rec_mutex_destroy(QemuRecMutex *mutex);
+void qemu_rec_mutex_set_profile_class(QemuRecMutex *mutex, const char *name);
 void qemu_rec_mutex_lock_impl(QemuRecMutex *mutex, const char *file, int line);
 int qemu_rec_mutex_trylock_impl(QemuRecMutex *mutex, const char *file,
                                 int line);
@@ -24,6 +24,12 @@ typedef struct QemuThread QemuThread;
 
 void qemu_mutex_init(QemuMutex *mutex);
 void qemu_mutex_destroy(QemuMutex *mutex);
+/*
+ * Report contended acquisitions of @mutex under @name in the lock
+ * contention profiler (see lock-profile.h), rather than by call site.
+ * @name must be a string literal or otherwise outlive the process.
+ */
+void qemu_mutex_set_profile_class(QemuMutex *mutex, const char *name);
 int qemu_mutex_trylock_impl(QemuMutex *mutex, const char *file, const int line);
 void qemu_mutex_lock_impl(QemuMutex *mutex, const char *file, const int line);
 void qemu_mutex_unlock_impl(QemuMutex *mutex, const char *file, const int line);
@@ -180,6 +186,19 @@ bool qemu_thread_is_self(QemuThread *thread);
 void qemu_thread_exit(void *retval);
 void qemu_thread_naming(bool enable);
 
+/**
+ * qemu_thread_set_affinity:
+ * @thread: the thread to move
+ * @host_cpus: bitmap of the host CPUs @thread may run on, or NULL for all
+ * @nbits: the number of bits in @host_cpus
+ *
+ * Returns 0 on success, -ENOSYS if the host does not support it or
+ * another negative errno value.
+ */
+int qemu_thread_set_affinity(QemuThread *thread,
+                             const unsigned long *host_cpus,
+                             unsigned long nbits);
+
 struct Notifier;
 /**
  * qemu_thread_atexit_add:
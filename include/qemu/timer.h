@@ -86,7 +86,11 @@ struct QEMUTimer {
     QEMUTimerList *timer_list;
     QEMUTimerCB *cb;
     void *opaque;
+    /* Pairing heap links: next sibling, leftmost child, previous or parent */
     QEMUTimer *next;
+    QEMUTimer *child;
+    QEMUTimer *prev;
+    uint64_t seq;               /* orders timers with the same expire_time */
     int attributes;
     int scale;
 };
@@ -418,6 +418,15 @@ struct ObjectClass
     ObjectUnparent *unparent;
 
     GHashTable *properties;
+
+    /*
+     * Own and inherited properties, and those of them with an init hook,
+     * flattened on first instantiation and rebuilt when any class gains
+     * a property.
+     */
+    GHashTable *properties_all;
+    GPtrArray *properties_init;
+    unsigned properties_gen;
 };
 
 /**
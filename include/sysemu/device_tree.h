@@ -244,6 +244,16 @@ int qemu_devtree_get_n_nodes_by_name(void *fdt, char ***array,
 
 /* misc */
 
+/**
+ * qemu_fdt_path_offset:
+ * @fdt: device tree blob
+ * @path: node path
+ *
+ * Same as fdt_path_offset(), but looks @path up in an index of the nodes
+ * of @fdt when @fdt has not changed since the previous lookup.
+ */
+int qemu_fdt_path_offset(void *fdt, const char *path);
+
 int devtree_get_num_nodes(void *fdt);
 void devtree_info_dump(void *fdt);
 
@@ -37,6 +37,9 @@ typedef struct {
     int64_t poll_max_ns;
     int64_t poll_grow;
     int64_t poll_shrink;
+
+    /* Use a kernel submission thread for io_uring */
+    bool io_uring_sqpoll;
 } IOThread;
 
 #define IOTHREAD(obj) \
@@ -27,9 +27,13 @@ typedef struct KVMSlot
 
 typedef struct KVMMemoryListener {
     MemoryListener listener;
-    /* Protects the slots and all inside them */
-    QemuMutex slots_lock;
     KVMSlot *slots;
+    /* The slots in use, sorted by address; they never overlap */
+    KVMSlot **used_slots;
+    int nr_used_slots;
+    /* Stack of the indexes in @slots of the free slots */
+    int *free_slots;
+    int nr_free_slots;
     int as_id;
 } KVMMemoryListener;
 
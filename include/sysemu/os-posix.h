@@ -80,6 +80,18 @@ void *qemu_alloc_stack(size_t *sz);
  */
 void qemu_free_stack(void *stack, size_t sz);
 
+/**
+ * qemu_trim_stack:
+ * @stack: stack allocated via qemu_alloc_stack()
+ * @sz: size of stack in bytes, as returned by qemu_alloc_stack()
+ * @keep: number of bytes at the top of the stack to leave resident
+ *
+ * Let the host reclaim the pages of an unused stack below its top @keep
+ * bytes.  The stack stays mapped and can be used again straight away;
+ * reclaimed pages come back zeroed on the next touch.
+ */
+void qemu_trim_stack(void *stack, size_t sz, size_t keep);
+
 /* POSIX and Mingw32 differ in the name of the stdio lock functions.  */
 
 static inline void qemu_flockfile(FILE *f)
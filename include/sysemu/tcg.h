@@ -9,6 +9,7 @@
 #define SYSEMU_TCG_H
 
 extern bool tcg_allowed;
+extern bool tcg_mmio_poll_sleep;
 void tcg_exec_init(unsigned long tb_size);
 #ifdef CONFIG_TCG
 #define tcg_enabled() (tcg_allowed)
@@ -820,6 +820,7 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_init(void);
 void tcg_region_reset_all(void);
+int tcg_region_evict(GTraverseFunc invalidate);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -23,13 +23,12 @@
 #include "exec/memory.h"
 #include "hw/irq.h"
 #include "qemu/log.h"
-#include "qemu/queue.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/runstate.h"
 #include "exec/exec-all.h"
 
 typedef struct FaultEventEntry FaultEventEntry;
-static QLIST_HEAD(, FaultEventEntry) events = QLIST_HEAD_INITIALIZER(events);
+static GSequence *events;
 static QEMUTimer *timer;
 
 #ifndef DEBUG_FAULT_INJECTION
@@ -121,52 +120,128 @@ ReadValue *qmp_read_mem(int64_t addr, int64_t size, bool has_cpu, int64_t cpu,
     }
 }
 
+/*
+ * Pending events, sorted by time and then by submission order so that
+ * events due at the same time run in the order they were scheduled.
+ */
 struct FaultEventEntry {
     uint64_t time_ns;
-    int64_t val;
-    QLIST_ENTRY(FaultEventEntry) node;
+    uint64_t seq;
+    InjectionEventType type;
+    int64_t val;            /* event id, value to write or mask to flip */
+    int cpu_index;
+    hwaddr addr;
+    int size;
+    bool debug;
+    qemu_irq irq;
 };
 
+static uint64_t next_seq;
+
+static gint fault_event_cmp(gconstpointer a, gconstpointer b,
+                            gpointer unused)
+{
+    const FaultEventEntry *ea = a;
+    const FaultEventEntry *eb = b;
+
+    if (ea->time_ns != eb->time_ns) {
+        return ea->time_ns < eb->time_ns ? -1 : 1;
+    }
+    return ea->seq < eb->seq ? -1 : ea->seq > eb->seq;
+}
+
 static void mod_next_event_timer(void)
 {
-    uint64_t val;
-    FaultEventEntry *entry;
+    GSequenceIter *first;
 
-    if (QLIST_EMPTY(&events)) {
+    if (!events) {
         return;
-    } else {
-        val = QLIST_FIRST(&events)->time_ns;
     }
+    first = g_sequence_get_begin_iter(events);
+    if (g_sequence_iter_is_end(first)) {
+        return;
+    }
+    timer_mod(timer, ((FaultEventEntry *)g_sequence_get(first))->time_ns);
+}
 
-    QLIST_FOREACH(entry, &events, node) {
-        if (val > entry->time_ns) {
-            val = entry->time_ns;
+static void do_mem_fault(FaultEventEntry *entry)
+{
+    CPUState *cpu = qemu_get_cpu(entry->cpu_index);
+    MemTxAttrs attrs = MEMTXATTRS_UNSPECIFIED;
+    uint64_t val = entry->val;
+    AddressSpace *as;
+
+    if (!cpu) {
+        DPRINTF("CPU %d disappeared.\n", entry->cpu_index);
+        return;
+    }
+    as = cpu_get_address_space(cpu, 0);
+    attrs.debug = entry->debug;
+    if (entry->type == INJECTION_EVENT_TYPE_FLIP_MEM) {
+        val = 0;
+        if (address_space_read(as, entry->addr, attrs, (uint8_t *)&val,
+                               entry->size)) {
+            DPRINTF("flip memory read failed.\n");
+            return;
         }
+        val ^= entry->val;
+    }
+    if (address_space_write(as, entry->addr, attrs, (uint8_t *)&val,
+                            entry->size)) {
+        DPRINTF("write memory failed.\n");
     }
-
-    timer_mod(timer, val);
 }
 
 static void do_fault(void *opaque)
 {
-    FaultEventEntry *entry;
-    FaultEventEntry *next;
     uint64_t current_time = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    GSequenceIter *first;
+
+    for (first = g_sequence_get_begin_iter(events);
+         !g_sequence_iter_is_end(first);
+         first = g_sequence_get_begin_iter(events)) {
+        FaultEventEntry *entry = g_sequence_get(first);
+
+        if (entry->time_ns > current_time) {
+            break;
+        }
 
-    QLIST_FOREACH_SAFE(entry, &events, node, next) {
-        if (entry->time_ns < current_time) {
+        switch (entry->type) {
+        case INJECTION_EVENT_TYPE_EVENT:
             DPRINTF("fault %"PRId64" happened @%"PRId64"!\n", entry->val,
-                    qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+                    current_time);
             qapi_event_send_fault_event(entry->val, current_time);
-            QLIST_REMOVE(entry, node);
-            g_free(entry);
             vm_stop_from_timer(RUN_STATE_DEBUG);
+            break;
+        case INJECTION_EVENT_TYPE_WRITE_MEM:
+        case INJECTION_EVENT_TYPE_FLIP_MEM:
+            do_mem_fault(entry);
+            break;
+        case INJECTION_EVENT_TYPE_GPIO:
+            qemu_set_irq(entry->irq, entry->val);
+            break;
+        default:
+            g_assert_not_reached();
         }
+        g_sequence_remove(first);
     }
 
     mod_next_event_timer();
 }
 
+static void fault_event_queue(FaultEventEntry *entry, uint64_t now,
+                              int64_t time_ns)
+{
+    if (!timer) {
+        events = g_sequence_new(g_free);
+        timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, do_fault, NULL);
+    }
+
+    entry->time_ns = now + time_ns;
+    entry->seq = next_seq++;
+    g_sequence_insert_sorted(events, entry, fault_event_cmp, NULL);
+}
+
 void qmp_trigger_event(int64_t time_ns, int64_t event_id, Error **errp)
 {
     FaultEventEntry *entry;
@@ -174,14 +249,129 @@ void qmp_trigger_event(int64_t time_ns, int64_t event_id, Error **errp)
     DPRINTF("trigger_event(%"PRId64", %"PRId64")\n", time_ns, event_id);
 
     entry = g_new0(FaultEventEntry, 1);
-    entry->time_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + time_ns;
+    entry->type = INJECTION_EVENT_TYPE_EVENT;
     entry->val = event_id;
-    QLIST_INSERT_HEAD(&events, entry, node);
+    fault_event_queue(entry, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL), time_ns);
 
-    if (!timer) {
-        timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, do_fault, NULL);
+    mod_next_event_timer();
+}
+
+static int injection_cpu_index(bool has_cpu, int64_t cpu, bool has_qom,
+                               const char *qom, Error **errp)
+{
+    CPUState *s;
+
+    if (has_qom) {
+        s = (CPUState *)object_dynamic_cast(object_resolve_path(qom, NULL),
+                                            TYPE_CPU);
+        if (!s) {
+            error_setg(errp, "'%s' is not a CPU or doesn't exists", qom);
+            return -1;
+        }
+        return s->cpu_index;
+    }
+    if (has_cpu && !qemu_get_cpu(cpu)) {
+        error_setg(errp, "CPU %" PRId64 " doesn't exists", cpu);
+        return -1;
+    }
+    return has_cpu ? cpu : 0;
+}
+
+static bool injection_check_size(int64_t size, Error **errp)
+{
+    if (size < 1 || size > sizeof(uint64_t)) {
+        error_setg(errp, "Invalid access size %" PRId64, size);
+        return false;
+    }
+    return true;
+}
+
+static FaultEventEntry *injection_event_prepare(InjectionEvent *ev,
+                                                Error **errp)
+{
+    g_autofree FaultEventEntry *entry = g_new0(FaultEventEntry, 1);
+    InjectionEventWriteMem *w;
+    InjectionEventFlipMem *f;
+    InjectionEventGpio *g;
+    DeviceState *dev;
+
+    entry->type = ev->type;
+    switch (ev->type) {
+    case INJECTION_EVENT_TYPE_EVENT:
+        entry->val = ev->u.event.event_id;
+        break;
+    case INJECTION_EVENT_TYPE_WRITE_MEM:
+        w = &ev->u.write_mem;
+        entry->cpu_index = injection_cpu_index(w->has_cpu, w->cpu, w->has_qom,
+                                               w->qom, errp);
+        if (entry->cpu_index < 0 || !injection_check_size(w->size, errp)) {
+            return NULL;
+        }
+        entry->addr = w->addr;
+        entry->val = w->val;
+        entry->size = w->size;
+        entry->debug = w->has_debug && w->debug;
+        break;
+    case INJECTION_EVENT_TYPE_FLIP_MEM:
+        f = &ev->u.flip_mem;
+        entry->cpu_index = injection_cpu_index(f->has_cpu, f->cpu, f->has_qom,
+                                               f->qom, errp);
+        if (entry->cpu_index < 0 || !injection_check_size(f->size, errp)) {
+            return NULL;
+        }
+        entry->addr = f->addr;
+        entry->val = f->mask;
+        entry->size = f->size;
+        entry->debug = f->has_debug && f->debug;
+        break;
+    case INJECTION_EVENT_TYPE_GPIO:
+        g = &ev->u.gpio;
+        dev = (DeviceState *)object_dynamic_cast(
+            object_resolve_path(g->device_name, NULL), TYPE_DEVICE);
+        if (!dev) {
+            error_setg(errp, "Device '%s' is not a device", g->device_name);
+            return NULL;
+        }
+        entry->irq = qdev_get_gpio_in_named(dev, g->has_gpio ? g->gpio : NULL,
+                                            g->num);
+        if (!entry->irq) {
+            error_setg(errp, "GPIO '%s' doesn't exists",
+                       g->has_gpio ? g->gpio : "unnammed");
+            return NULL;
+        }
+        entry->val = g->val;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    return g_steal_pointer(&entry);
+}
+
+void qmp_inject_events(InjectionEventList *events_list, Error **errp)
+{
+    uint64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    g_autoptr(GPtrArray) entries = g_ptr_array_new_with_free_func(g_free);
+    InjectionEventList *l;
+    guint i;
+
+    /* Resolve everything first so that a bad event schedules nothing */
+    for (l = events_list; l; l = l->next) {
+        FaultEventEntry *entry = injection_event_prepare(l->value, errp);
+
+        if (!entry) {
+            return;
+        }
+        g_ptr_array_add(entries, entry);
+    }
+
+    for (i = 0, l = events_list; l; i++, l = l->next) {
+        fault_event_queue(g_ptr_array_index(entries, i), now,
+                          l->value->time_ns);
     }
+    /* The queue owns the entries now */
+    g_ptr_array_set_free_func(entries, NULL);
 
+    DPRINTF("inject_events: %u events\n", entries->len);
     mod_next_event_timer();
 }
 
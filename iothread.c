@@ -23,6 +23,8 @@
 #include "qemu/error-report.h"
 #include "qemu/rcu.h"
 #include "qemu/main-loop.h"
+#include "qemu/thread-placement.h"
+#include "monitor/stats.h"
 
 typedef ObjectClass IOThreadClass;
 
@@ -51,7 +53,11 @@ AioContext *qemu_get_current_aio_context(void)
 static void *iothread_run(void *opaque)
 {
     IOThread *iothread = opaque;
+    ThreadPlacement *placement;
+    QemuThread self;
 
+    qemu_thread_get_self(&self);
+    placement = thread_placement_add(&self, THREAD_PLACEMENT_IOTHREAD, 0);
     rcu_register_thread();
     /*
      * g_main_context_push_thread_default() must be called before anything
@@ -85,6 +91,7 @@ static void *iothread_run(void *opaque)
 
     g_main_context_pop_thread_default(iothread->worker_context);
     rcu_unregister_thread();
+    thread_placement_del(placement);
     return NULL;
 }
 
@@ -186,6 +193,11 @@ static void iothread_complete(UserCreatable *obj, Error **errp)
                                 iothread->poll_grow,
                                 iothread->poll_shrink,
                                 &local_error);
+    if (!local_error) {
+        aio_context_set_io_uring_sqpoll(iothread->ctx,
+                                        iothread->io_uring_sqpoll,
+                                        &local_error);
+    }
     if (local_error) {
         error_propagate(errp, local_error);
         aio_context_unref(iothread->ctx);
@@ -268,6 +280,25 @@ out:
     error_propagate(errp, local_err);
 }
 
+static bool iothread_get_io_uring_sqpoll(Object *obj, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    return iothread->io_uring_sqpoll;
+}
+
+static void iothread_set_io_uring_sqpoll(Object *obj, bool value,
+                                         Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    if (iothread->ctx) {
+        error_setg(errp, "io-uring-sqpoll can only be set at creation");
+        return;
+    }
+    iothread->io_uring_sqpoll = value;
+}
+
 static void iothread_class_init(ObjectClass *klass, void *class_data)
 {
     UserCreatableClass *ucc = USER_CREATABLE_CLASS(klass);
@@ -285,6 +316,9 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info);
+    object_class_property_add_bool(klass, "io-uring-sqpoll",
+                                   iothread_get_io_uring_sqpoll,
+                                   iothread_set_io_uring_sqpoll);
 }
 
 static const TypeInfo iothread_info = {
@@ -300,9 +334,41 @@ static const TypeInfo iothread_info = {
     },
 };
 
+static const StatsDescriptor iothread_stats[] = {
+    { "poll", STATS_TYPE_INSTANT, true, STATS_UNIT_NANOSECONDS },
+    { "poll-max", STATS_TYPE_INSTANT, true, STATS_UNIT_NANOSECONDS },
+};
+
+static int iothread_stats_one(Object *object, void *opaque)
+{
+    StatsCollector *c = opaque;
+    IOThread *iothread;
+    g_autofree char *path = NULL;
+    uint64_t values[ARRAY_SIZE(iothread_stats)];
+
+    iothread = (IOThread *)object_dynamic_cast(object, TYPE_IOTHREAD);
+    if (!iothread || !iothread->ctx) {
+        return 0;
+    }
+
+    path = object_get_canonical_path(object);
+    values[0] = atomic_read(&iothread->ctx->poll_ns);
+    values[1] = iothread->poll_max_ns;
+    stats_collect(c, path, values);
+    return 0;
+}
+
+static void iothread_stats_retrieve(StatsCollector *c)
+{
+    object_child_foreach(object_get_objects_root(), iothread_stats_one, c);
+}
+
 static void iothread_register_types(void)
 {
     type_register_static(&iothread_info);
+    stats_register(STATS_PROVIDER_IOTHREAD, STATS_TARGET_IOTHREAD,
+                   iothread_stats, ARRAY_SIZE(iothread_stats),
+                   iothread_stats_retrieve);
 }
 
 type_init(iothread_register_types)
@@ -28,6 +28,7 @@
 #include "trace-root.h"
 
 #include "exec/memory-internal.h"
+#include "exec/mmio-profile.h"
 #include "exec/ram_addr.h"
 #include "sysemu/kvm.h"
 #include "sysemu/runstate.h"
@@ -758,7 +759,30 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
 }
 
 /* Render a memory topology into a list of disjoint absolute ranges. */
-static FlatView *generate_memory_topology(MemoryRegion *mr)
+static bool flatview_equal(FlatView *a, FlatView *b)
+{
+    unsigned i;
+
+    if (a->nr != b->nr) {
+        return false;
+    }
+    for (i = 0; i < a->nr; i++) {
+        if (!flatrange_equal(&a->ranges[i], &b->ranges[i]) ||
+            a->ranges[i].dirty_log_mask != b->ranges[i].dirty_log_mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Render the flat view of @mr.  If it comes out identical to @old, @old
+ * is reused so that address spaces using it see no change at all and
+ * their listeners are left alone.  Otherwise an identical view already
+ * rendered for another root is shared.
+ */
+static FlatView *generate_memory_topology_from(MemoryRegion *mr,
+                                               FlatView *old)
 {
     int i;
     FlatView *view;
@@ -772,6 +796,32 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     }
     flatview_simplify(view);
 
+    if (!old || !flatview_equal(old, view)) {
+        GHashTableIter iter;
+        FlatView *other;
+
+        /*
+         * Distinct roots often render to the same ranges, e.g. the
+         * per-cluster views of a mostly shared bus. Let them share one
+         * view and dispatch tree.
+         */
+        old = NULL;
+        g_hash_table_iter_init(&iter, flat_views);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&other)) {
+            if (flatview_equal(other, view)) {
+                old = other;
+                break;
+            }
+        }
+    }
+
+    if (old) {
+        flatview_unref(view);
+        flatview_ref(old);
+        g_hash_table_replace(flat_views, mr, old);
+        return old;
+    }
+
     view->dispatch = address_space_dispatch_new(view);
     for (i = 0; i < view->nr; i++) {
         MemoryRegionSection mrs =
@@ -784,6 +834,11 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     return view;
 }
 
+static FlatView *generate_memory_topology(MemoryRegion *mr)
+{
+    return generate_memory_topology_from(mr, NULL);
+}
+
 static void address_space_add_del_ioeventfds(AddressSpace *as,
                                              MemoryRegionIoeventfd *fds_new,
                                              unsigned fds_new_nb,
@@ -1036,23 +1091,29 @@ static void flatviews_init(void)
 
 static void flatviews_reset(void)
 {
+    GHashTable *old_views = flat_views;
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
     /* Render unique FVs */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *old = NULL;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
-        generate_memory_topology(physmr);
+        if (old_views) {
+            old = g_hash_table_lookup(old_views, physmr);
+        }
+        generate_memory_topology_from(physmr, old);
+    }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
     }
 }
 
@@ -1391,6 +1452,7 @@ static void memory_region_do_set_ram(MemoryRegion *mr)
         mr->ram_block = qemu_ram_alloc(int128_get64(mr->size), true, mr, &error_abort);
         break;
     case(2):
+    case(3):
         if (mr->filename) {
             filename = g_strdup_printf("%s%s%s",
                                        machine_path ? machine_path : "",
@@ -1409,8 +1471,15 @@ static void memory_region_do_set_ram(MemoryRegion *mr)
                                        sanitized_name);
             g_free(sanitized_name);
         }
+        /*
+         * 2 maps the file shared, so it always holds the current guest RAM.
+         * 3 maps it private, a copy-on-write clone of whatever the file
+         * holds (e.g. a snapshot saved with x-ignore-shared). Many instances
+         * can start from one file and only pay for the pages they dirty.
+         */
         mr->ram_block = qemu_ram_alloc_from_file(int128_get64(mr->size), mr,
-                                                 RAM_SHARED, filename, &error_abort);
+                                                 mr->ram == 2 ? RAM_SHARED : 0,
+                                                 filename, &error_abort);
         g_free(filename);
         break;
     default:
@@ -1680,6 +1749,21 @@ bool memory_region_access_valid(MemoryRegion *mr,
     return true;
 }
 
+/*
+ * Transaction based regions see the size of every access, so unless
+ * they say otherwise they get anything their valid constraints accept.
+ */
+static unsigned memory_region_access_impl_max(MemoryRegion *mr)
+{
+    if (mr->ops->impl.max_access_size) {
+        return mr->ops->impl.max_access_size;
+    }
+    if (mr->ops->valid.max_access_size) {
+        return mr->ops->valid.max_access_size;
+    }
+    return 4;
+}
+
 static MemTxResult memory_region_dispatch_read1(MemoryRegion *mr,
                                                 hwaddr addr,
                                                 uint64_t *pval,
@@ -1689,9 +1773,18 @@ static MemTxResult memory_region_dispatch_read1(MemoryRegion *mr,
     *pval = 0;
 
     if (mr->ops->access) {
+        unsigned impl_max = memory_region_access_impl_max(mr);
+
+        if (size <= impl_max && size >= mr->ops->impl.min_access_size) {
+            /* Hand the whole access over as one transaction.  */
+            return memory_region_read_accessor_attr(mr, addr, pval, size, 0,
+                                                    MAKE_64BIT_MASK(0,
+                                                                    size * 8),
+                                                    attrs);
+        }
         return access_with_adjusted_size(addr, pval, size,
                                          mr->ops->impl.min_access_size,
-                                         mr->ops->impl.max_access_size,
+                                         impl_max,
                                          memory_region_read_accessor_attr,
                                          mr, attrs);
     } else if (mr->ops->read) {
@@ -1716,6 +1809,7 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
                                         MemTxAttrs attrs)
 {
     unsigned size = memop_size(op);
+    int64_t start;
     MemTxResult r;
 
     if (!memory_region_access_valid(mr, addr, size, false, attrs)) {
@@ -1723,7 +1817,9 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
         return MEMTX_DECODE_ERROR;
     }
 
+    start = mmio_profile_start();
     r = memory_region_dispatch_read1(mr, addr, pval, size, attrs);
+    mmio_profile_end(mr, addr, false, start);
     adjust_endianness(mr, pval, op);
     return r;
 }
@@ -1754,30 +1850,29 @@ static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
     return false;
 }
 
-MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
-                                         hwaddr addr,
-                                         uint64_t data,
-                                         MemOp op,
-                                         MemTxAttrs attrs)
+static MemTxResult memory_region_dispatch_write1(MemoryRegion *mr,
+                                                 hwaddr addr,
+                                                 uint64_t data,
+                                                 unsigned size,
+                                                 MemTxAttrs attrs)
 {
-    unsigned size = memop_size(op);
-
-    if (!memory_region_access_valid(mr, addr, size, true, attrs)) {
-        unassigned_mem_write(mr, addr, data, size);
-        return MEMTX_DECODE_ERROR;
-    }
-
-    adjust_endianness(mr, &data, op);
-
     if ((!kvm_eventfds_enabled()) &&
         memory_region_dispatch_write_eventfds(mr, addr, data, size, attrs)) {
         return MEMTX_OK;
     }
 
     if (mr->ops->access) {
+        unsigned impl_max = memory_region_access_impl_max(mr);
+
+        if (size <= impl_max && size >= mr->ops->impl.min_access_size) {
+            return memory_region_write_accessor_attr(mr, addr, &data, size, 0,
+                                                     MAKE_64BIT_MASK(0,
+                                                                     size * 8),
+                                                     attrs);
+        }
         return access_with_adjusted_size(addr, &data, size,
                                          mr->ops->impl.min_access_size,
-                                         mr->ops->impl.max_access_size,
+                                         impl_max,
                                          memory_region_write_accessor_attr,
                                          mr, attrs);
     } else if (mr->ops->write) {
@@ -1796,6 +1891,29 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
     }
 }
 
+MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
+                                         hwaddr addr,
+                                         uint64_t data,
+                                         MemOp op,
+                                         MemTxAttrs attrs)
+{
+    unsigned size = memop_size(op);
+    int64_t start;
+    MemTxResult r;
+
+    if (!memory_region_access_valid(mr, addr, size, true, attrs)) {
+        unassigned_mem_write(mr, addr, data, size);
+        return MEMTX_DECODE_ERROR;
+    }
+
+    adjust_endianness(mr, &data, op);
+
+    start = mmio_profile_start();
+    r = memory_region_dispatch_write1(mr, addr, data, size, attrs);
+    mmio_profile_end(mr, addr, true, start);
+    return r;
+}
+
 void memory_region_init_io(MemoryRegion *mr,
                            Object *owner,
                            const MemoryRegionOps *ops,
@@ -1914,6 +2032,28 @@ void memory_region_init_ram_from_fd(MemoryRegion *mr,
 }
 #endif
 
+void memory_region_init_ram_hugetlb(MemoryRegion *mr,
+                                    Object *owner,
+                                    const char *name,
+                                    uint64_t size,
+                                    uint64_t pagesize,
+                                    bool share,
+                                    Error **errp)
+{
+    Error *err = NULL;
+    memory_region_init(mr, owner, name, size);
+    mr->ram = true;
+    mr->terminates = true;
+    mr->destructor = memory_region_destructor_ram;
+    mr->ram_block = qemu_ram_alloc_hugetlb(size, pagesize, share, mr, &err);
+    mr->dirty_log_mask = tcg_enabled() ? (1 << DIRTY_MEMORY_CODE) : 0;
+    if (err) {
+        mr->size = int128_zero();
+        object_unparent(OBJECT(mr));
+        error_propagate(errp, err);
+    }
+}
+
 void memory_region_init_ram_ptr(MemoryRegion *mr,
                                 Object *owner,
                                 const char *name,
@@ -2327,18 +2467,26 @@ static void memory_region_sync_dirty_bitmap(MemoryRegion *mr)
      * address space once.
      */
     QTAILQ_FOREACH(listener, &memory_listeners, link) {
-        if (!listener->log_sync) {
-            continue;
-        }
-        as = listener->address_space;
-        view = address_space_get_flatview(as);
-        FOR_EACH_FLAT_RANGE(fr, view) {
-            if (fr->dirty_log_mask && (!mr || fr->mr == mr)) {
-                MemoryRegionSection mrs = section_from_flat_range(fr, view);
-                listener->log_sync(listener, &mrs);
+        if (listener->log_sync) {
+            as = listener->address_space;
+            view = address_space_get_flatview(as);
+            FOR_EACH_FLAT_RANGE(fr, view) {
+                if (fr->dirty_log_mask && (!mr || fr->mr == mr)) {
+                    MemoryRegionSection mrs;
+
+                    mrs = section_from_flat_range(fr, view);
+                    listener->log_sync(listener, &mrs);
+                }
             }
+            flatview_unref(view);
+        } else if (listener->log_sync_global) {
+            /*
+             * No matter whether MR is specified, what we can do here
+             * is to do a global sync, because we are not capable to
+             * sync in a finer granularity.
+             */
+            listener->log_sync_global(listener);
         }
-        flatview_unref(view);
     }
 }
 
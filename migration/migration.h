@@ -75,6 +75,10 @@ struct MigrationIncomingState {
     QemuMutex rp_mutex;    /* We send replies from multiple threads */
     /* RAMBlock of last request sent to source */
     RAMBlock *last_rb;
+    /* Last userfault and the stride to the one before, for prefetching */
+    RAMBlock *last_fault_rb;
+    uint64_t last_fault_offset;
+    int64_t last_fault_stride;
     void     *postcopy_tmp_page;
     void     *postcopy_tmp_zero_page;
     /* PostCopyFD's for external userfaultfds & handlers of shared memory */
@@ -298,6 +302,9 @@ bool migrate_validate_uuid(void);
 
 bool migrate_auto_converge(void);
 bool migrate_use_multifd(void);
+bool migrate_multifd_zero_page(void);
+bool migrate_defer_hot_pages(void);
+bool migrate_postcopy_prefetch(void);
 bool migrate_pause_before_switchover(void);
 int migrate_multifd_channels(void);
 MultiFDCompression migrate_multifd_compression(void);
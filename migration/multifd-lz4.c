@@ -0,0 +1,259 @@
+/*
+ * Multifd lz4 compression implementation
+ *
+ * Copyright (c) 2020 Xilinx Inc
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <lz4.h>
+#include "qemu/bswap.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "multifd.h"
+
+/*
+ * Every page is compressed on its own, as an LZ4 block.  That keeps the
+ * match window inside the page, which is what makes lz4 fast for this.
+ * In the packet each page is a be32 length followed by the data.  A page
+ * that doesn't compress is sent as is, with its length equal to the page
+ * size.
+ */
+#define LZ4_PAGE_HDR_SIZE 4
+
+struct lz4_data {
+    /* compressed buffer */
+    uint8_t *zbuff;
+    /* size of compressed buffer */
+    uint32_t zbuff_len;
+};
+
+/* Multifd lz4 compression */
+
+static struct lz4_data *lz4_data_new(Error **errp, uint8_t id)
+{
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    /* We will never have more than page_count pages */
+    z->zbuff_len = page_count * (qemu_target_page_size() + LZ4_PAGE_HDR_SIZE);
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        g_free(z);
+        error_setg(errp, "multifd %d: out of memory for zbuff", id);
+        return NULL;
+    }
+    return z;
+}
+
+static void lz4_data_free(struct lz4_data *z)
+{
+    g_free(z->zbuff);
+    g_free(z);
+}
+
+/**
+ * lz4_send_setup: setup send side
+ *
+ * Setup each channel with lz4 compression.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    p->data = lz4_data_new(errp, p->id);
+    return p->data ? 0 : -1;
+}
+
+/**
+ * lz4_send_cleanup: cleanup send side
+ *
+ * Return the memory.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    lz4_data_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_send_prepare: prepare date to be able to send
+ *
+ * Create a buffer with all the pages that we are going to send,
+ * each one compressed on its own.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ */
+static int lz4_send_prepare(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct iovec *iov = p->pages->iov;
+    struct lz4_data *z = p->data;
+    uint32_t pos = 0;
+    uint32_t i;
+
+    for (i = 0; i < used; i++) {
+        uint8_t *dst = z->zbuff + pos + LZ4_PAGE_HDR_SIZE;
+        int len;
+
+        /* Only keep the compressed page if it is smaller */
+        len = LZ4_compress_default(iov[i].iov_base, (char *)dst,
+                                   iov[i].iov_len, iov[i].iov_len - 1);
+        if (len <= 0) {
+            memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+            len = iov[i].iov_len;
+        }
+        stl_be_p(z->zbuff + pos, len);
+        pos += LZ4_PAGE_HDR_SIZE + len;
+    }
+    p->next_packet_size = pos;
+    p->flags |= MULTIFD_FLAG_LZ4;
+
+    return 0;
+}
+
+/**
+ * lz4_send_write: do the actual write of the data
+ *
+ * Do the actual write of the comprresed buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int lz4_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    return qio_channel_write_all(p->c, (void *)z->zbuff, p->next_packet_size,
+                                 errp);
+}
+
+/**
+ * lz4_recv_setup: setup receive side
+ *
+ * Create the compressed buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    p->data = lz4_data_new(errp, p->id);
+    return p->data ? 0 : -1;
+}
+
+/**
+ * lz4_recv_cleanup: cleanup receive side
+ *
+ * Return the memory.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    lz4_data_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the compressed buffer, and uncompress it into the actual
+ * pages.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int lz4_recv_pages(MultiFDRecvParams *p, uint32_t used, Error **errp)
+{
+    uint32_t in_size = p->next_packet_size;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    struct lz4_data *z = p->data;
+    uint32_t pos = 0;
+    uint32_t i;
+    int ret;
+
+    if (flags != MULTIFD_FLAG_LZ4) {
+        error_setg(errp, "multifd %d: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_LZ4);
+        return -1;
+    }
+    if (in_size > z->zbuff_len) {
+        error_setg(errp, "multifd %d: packet size received %d size max %d",
+                   p->id, in_size, z->zbuff_len);
+        return -1;
+    }
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < used; i++) {
+        struct iovec *iov = &p->pages->iov[i];
+        uint32_t len;
+
+        if (in_size - pos < LZ4_PAGE_HDR_SIZE) {
+            break;
+        }
+        len = ldl_be_p(z->zbuff + pos);
+        pos += LZ4_PAGE_HDR_SIZE;
+        if (len > in_size - pos || len > iov->iov_len) {
+            break;
+        }
+
+        if (len == iov->iov_len) {
+            memcpy(iov->iov_base, z->zbuff + pos, len);
+        } else {
+            ret = LZ4_decompress_safe((char *)z->zbuff + pos, iov->iov_base,
+                                      len, iov->iov_len);
+            if (ret != iov->iov_len) {
+                error_setg(errp, "multifd %d: decompress of page %d "
+                           "returned %d", p->id, i, ret);
+                return -1;
+            }
+        }
+        pos += len;
+    }
+    if (i != used || pos != in_size) {
+        error_setg(errp, "multifd %d: packet of %d bytes is malformed "
+                   "at page %d of %d", p->id, in_size, i, used);
+        return -1;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_lz4_ops = {
+    .send_setup = lz4_send_setup,
+    .send_cleanup = lz4_send_cleanup,
+    .send_prepare = lz4_send_prepare,
+    .send_write = lz4_send_write,
+    .recv_setup = lz4_recv_setup,
+    .recv_cleanup = lz4_recv_cleanup,
+    .recv_pages = lz4_recv_pages
+};
+
+static void multifd_lz4_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_LZ4, &multifd_lz4_ops);
+}
+
+migration_init(multifd_lz4_register);
@@ -12,6 +12,8 @@
 
 #include "qemu/osdep.h"
 #include "qemu/rcu.h"
+#include "qemu/cutils.h"
+#include "qemu/thread-placement.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
 #include "exec/ramblock.h"
@@ -268,6 +270,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->pages_used = cpu_to_be32(p->pages->used);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
+    packet->zero_pages = cpu_to_be32(p->zero_pages);
 
     if (p->pages->block) {
         strncpy(packet->ramblock, p->pages->block->idstr, 256);
@@ -337,6 +340,14 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
+    p->zero_pages = be32_to_cpu(packet->zero_pages);
+    if (p->zero_pages > p->pages->used) {
+        error_setg(errp, "multifd: received packet "
+                   "with %d zero pages and %d pages",
+                   p->zero_pages, p->pages->used);
+        return -1;
+    }
+
     if (p->pages->used == 0) {
         return 0;
     }
@@ -603,18 +614,70 @@ void multifd_send_sync_main(QEMUFile *f)
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
     }
+    for (i = 0; i < migrate_multifd_channels(); i++) {
+        MultiFDSendParams *p = &multifd_send_state->params[i];
+        uint64_t zero_pages, zero_bytes;
+
+        qemu_mutex_lock(&p->mutex);
+        zero_pages = p->zero_pages_pending;
+        p->zero_pages_pending = 0;
+        qemu_mutex_unlock(&p->mutex);
+
+        /* Zero pages were accounted as normal ones when they were queued */
+        zero_bytes = zero_pages * qemu_target_page_size();
+        ram_counters.normal -= zero_pages;
+        ram_counters.duplicate += zero_pages;
+        ram_counters.multifd_bytes -= zero_bytes;
+        ram_counters.transferred -= zero_bytes;
+    }
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
 }
 
+/**
+ * multifd_send_zero_page_detect: move the zero pages to the end
+ *
+ * Returns the number of pages that are not zero, they are the first
+ * ones in @p->pages after the call.
+ *
+ * @p: Params for the channel that we are using
+ */
+static uint32_t multifd_send_zero_page_detect(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = p->pages;
+    size_t page_size = qemu_target_page_size();
+    uint32_t normal = pages->used;
+    uint32_t i = 0;
+
+    while (i < normal) {
+        if (buffer_is_zero(pages->iov[i].iov_base, page_size)) {
+            ram_addr_t offset = pages->offset[i];
+            struct iovec iov = pages->iov[i];
+
+            normal--;
+            pages->offset[i] = pages->offset[normal];
+            pages->iov[i] = pages->iov[normal];
+            pages->offset[normal] = offset;
+            pages->iov[normal] = iov;
+        } else {
+            i++;
+        }
+    }
+    return normal;
+}
+
 static void *multifd_send_thread(void *opaque)
 {
     MultiFDSendParams *p = opaque;
     Error *local_err = NULL;
+    ThreadPlacement *placement;
+    QemuThread self;
     int ret = 0;
     uint32_t flags = 0;
 
     trace_multifd_send_thread_start(p->id);
     rcu_register_thread();
+    qemu_thread_get_self(&self);
+    placement = thread_placement_add(&self, THREAD_PLACEMENT_WORKER, p->id);
 
     if (multifd_send_initial_packet(p, &local_err) < 0) {
         ret = -1;
@@ -632,10 +695,17 @@ static void *multifd_send_thread(void *opaque)
         qemu_mutex_lock(&p->mutex);
 
         if (p->pending_job) {
-            uint32_t used = p->pages->used;
+            uint32_t total = p->pages->used;
+            uint32_t used = total;
             uint64_t packet_num = p->packet_num;
             flags = p->flags;
 
+            if (used && migrate_multifd_zero_page()) {
+                used = multifd_send_zero_page_detect(p);
+            }
+            p->zero_pages = total - used;
+            p->zero_pages_pending += p->zero_pages;
+
             if (used) {
                 ret = multifd_send_state->ops->send_prepare(p, used,
                                                             &local_err);
@@ -647,7 +717,7 @@ static void *multifd_send_thread(void *opaque)
             multifd_send_fill_packet(p);
             p->flags = 0;
             p->num_packets++;
-            p->num_pages += used;
+            p->num_pages += total;
             p->pages->used = 0;
             p->pages->block = NULL;
             qemu_mutex_unlock(&p->mutex);
@@ -705,6 +775,7 @@ out:
     p->running = false;
     qemu_mutex_unlock(&p->mutex);
 
+    thread_placement_del(placement);
     rcu_unregister_thread();
     trace_multifd_send_thread_end(p->id, p->num_packets, p->num_pages);
 
@@ -913,13 +984,17 @@ static void *multifd_recv_thread(void *opaque)
 {
     MultiFDRecvParams *p = opaque;
     Error *local_err = NULL;
+    ThreadPlacement *placement;
+    QemuThread self;
     int ret;
 
     trace_multifd_recv_thread_start(p->id);
     rcu_register_thread();
+    qemu_thread_get_self(&self);
+    placement = thread_placement_add(&self, THREAD_PLACEMENT_WORKER, p->id);
 
     while (true) {
-        uint32_t used;
+        uint32_t used, total, i;
         uint32_t flags;
 
         if (p->quit) {
@@ -942,14 +1017,15 @@ static void *multifd_recv_thread(void *opaque)
             break;
         }
 
-        used = p->pages->used;
+        total = p->pages->used;
+        used = total - p->zero_pages;
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
         trace_multifd_recv(p->id, p->packet_num, used, flags,
                            p->next_packet_size);
         p->num_packets++;
-        p->num_pages += used;
+        p->num_pages += total;
         qemu_mutex_unlock(&p->mutex);
 
         if (used) {
@@ -959,6 +1035,11 @@ static void *multifd_recv_thread(void *opaque)
             }
         }
 
+        for (i = used; i < total; i++) {
+            ram_handle_compressed(p->pages->iov[i].iov_base, 0,
+                                  p->pages->iov[i].iov_len);
+        }
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -973,6 +1054,7 @@ static void *multifd_recv_thread(void *opaque)
     p->running = false;
     qemu_mutex_unlock(&p->mutex);
 
+    thread_placement_del(placement);
     rcu_unregister_thread();
     trace_multifd_recv_thread_end(p->id, p->num_packets, p->num_pages);
 
@@ -32,6 +32,7 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
 #define MULTIFD_FLAG_NOCOMP (0 << 1)
 #define MULTIFD_FLAG_ZLIB (1 << 1)
 #define MULTIFD_FLAG_ZSTD (2 << 1)
+#define MULTIFD_FLAG_LZ4 (3 << 1)
 
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
@@ -46,7 +47,13 @@ typedef struct {
     /* size of the next packet that contains pages */
     uint32_t next_packet_size;
     uint64_t packet_num;
-    uint64_t unused[4];    /* Reserved for future use */
+    /*
+     * The last zero_pages entries of offset[] are zero pages, they have
+     * no data in the next packet.
+     */
+    uint32_t zero_pages;
+    uint32_t unused32;     /* Reserved for future use */
+    uint64_t unused[3];    /* Reserved for future use */
     char ramblock[256];
     uint64_t offset[];
 } __attribute__((packed)) MultiFDPacket_t;
@@ -97,7 +104,11 @@ typedef struct {
     uint32_t next_packet_size;
     /* global number of generated multifd packets */
     uint64_t packet_num;
+    /* zero pages found since the last sync, accounted by the main thread */
+    uint64_t zero_pages_pending;
     /* thread local variables */
+    /* zero pages at the end of the current packet */
+    uint32_t zero_pages;
     /* packets sent through this channel */
     uint64_t num_packets;
     /* pages sent through this channel */
@@ -134,6 +145,8 @@ typedef struct {
     uint32_t flags;
     /* global number of generated multifd packets */
     uint64_t packet_num;
+    /* zero pages at the end of the current packet */
+    uint32_t zero_pages;
     /* thread local variables */
     /* size of the next packet that contains pages */
     uint32_t next_packet_size;
@@ -712,6 +712,98 @@ int postcopy_request_shared_page(struct PostCopyFD *pcfd, RAMBlock *rb,
     return 0;
 }
 
+/* Host pages asked for on top of a faulting one */
+#define POSTCOPY_PREFETCH_PAGES      16
+/* Largest stride, in host pages, that is followed */
+#define POSTCOPY_PREFETCH_MAX_STRIDE 16
+
+static int postcopy_send_req_pages(MigrationIncomingState *mis, RAMBlock *rb,
+                                   uint64_t start, uint64_t len)
+{
+    if (rb != mis->last_rb) {
+        mis->last_rb = rb;
+        return migrate_send_rp_req_pages(mis, qemu_ram_get_idstr(rb),
+                                         start, len);
+    }
+    /* Save some space */
+    return migrate_send_rp_req_pages(mis, NULL, start, len);
+}
+
+/*
+ * Ask for the pages in [@start, @start + @len) of @rb that we don't have
+ * yet, one request per run of missing pages.
+ */
+static void postcopy_prefetch_range(MigrationIncomingState *mis, RAMBlock *rb,
+                                    uint64_t start, uint64_t len)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    uint64_t end = MIN(start + len, qemu_ram_get_used_length(rb));
+    uint64_t run = start;
+    uint64_t addr;
+
+    for (addr = start; addr <= end; addr += pagesize) {
+        if (addr == end || ramblock_recv_bitmap_test_byte_offset(rb, addr)) {
+            if (addr > run) {
+                trace_postcopy_prefetch(qemu_ram_get_idstr(rb), run,
+                                        addr - run);
+                postcopy_send_req_pages(mis, rb, run, addr - run);
+            }
+            run = addr + pagesize;
+        }
+    }
+}
+
+/*
+ * Prefetch after the demand request for the fault at @rb_offset.  When the
+ * last faults were a fixed stride apart, follow that stride, otherwise get
+ * the aligned neighbourhood of the fault.  The source skips pages that it
+ * sent already.
+ */
+static void postcopy_prefetch(MigrationIncomingState *mis, RAMBlock *rb,
+                              uint64_t rb_offset)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    uint64_t window = POSTCOPY_PREFETCH_PAGES * pagesize;
+    int64_t stride = 0;
+
+    /* Huge pages are big enough on their own */
+    if (pagesize != qemu_real_host_page_size) {
+        return;
+    }
+
+    if (rb == mis->last_fault_rb) {
+        stride = rb_offset - mis->last_fault_offset;
+    }
+
+    if (stride && stride == mis->last_fault_stride &&
+        ABS(stride) <= (int64_t)(POSTCOPY_PREFETCH_MAX_STRIDE * pagesize)) {
+        if (stride == (int64_t)pagesize) {
+            postcopy_prefetch_range(mis, rb, rb_offset + pagesize, window);
+        } else {
+            int i;
+
+            for (i = 1; i <= POSTCOPY_PREFETCH_PAGES / 4; i++) {
+                int64_t next = rb_offset + i * stride;
+
+                if (next < 0) {
+                    break;
+                }
+                postcopy_prefetch_range(mis, rb, next, pagesize);
+            }
+        }
+    } else {
+        uint64_t base = QEMU_ALIGN_DOWN(rb_offset, window);
+
+        postcopy_prefetch_range(mis, rb, base, rb_offset - base);
+        postcopy_prefetch_range(mis, rb, rb_offset + pagesize,
+                                base + window - rb_offset - pagesize);
+    }
+
+    mis->last_fault_rb = rb;
+    mis->last_fault_offset = rb_offset;
+    mis->last_fault_stride = stride;
+}
+
 static int get_mem_fault_cpu_index(uint32_t pid)
 {
     CPUState *cpu_iter;
@@ -1003,18 +1095,10 @@ retry:
              * Send the request to the source - we want to request one
              * of our host page sizes (which is >= TPS)
              */
-            if (rb != mis->last_rb) {
-                mis->last_rb = rb;
-                ret = migrate_send_rp_req_pages(mis,
-                                                qemu_ram_get_idstr(rb),
-                                                rb_offset,
-                                                qemu_ram_pagesize(rb));
-            } else {
-                /* Save some space */
-                ret = migrate_send_rp_req_pages(mis,
-                                                NULL,
-                                                rb_offset,
-                                                qemu_ram_pagesize(rb));
+            ret = postcopy_send_req_pages(mis, rb, rb_offset,
+                                          qemu_ram_pagesize(rb));
+            if (!ret && migrate_postcopy_prefetch()) {
+                postcopy_prefetch(mis, rb, rb_offset);
             }
 
             if (ret) {
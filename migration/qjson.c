@@ -88,6 +88,13 @@ void json_prop_str(QJSON *json, const char *name, const char *str)
     qstring_append_chr(json->str, '"');
 }
 
+/* Add @obj, which must have been finished, as an element of @json */
+void json_append_object(QJSON *json, const char *name, QJSON *obj)
+{
+    json_emit_element(json, name);
+    qstring_append(json->str, qjson_get_str(obj));
+}
+
 const char *qjson_get_str(QJSON *json)
 {
     return qstring_get_str(json->str);
@@ -29,9 +29,11 @@
 #include "qemu/osdep.h"
 #include "cpu.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/main-loop.h"
+#include "qemu/thread-placement.h"
 #include "xbzrle.h"
 #include "ram.h"
 #include "migration.h"
@@ -157,10 +159,20 @@ out:
     return ret;
 }
 
+/* Set between load_setup and load_cleanup of the incoming side */
+static bool ram_loading;
+
+/*
+ * With x-ignore-shared, a clone loading from its template already holds
+ * the template RAM, so only the device state is read from the stream.
+ * Once running it owns private pages, which are migrated as usual.
+ */
 static bool ramblock_is_ignored(RAMBlock *block)
 {
     return !qemu_ram_is_migratable(block) ||
-           (migrate_ignore_shared() && qemu_ram_is_shared(block));
+           (migrate_ignore_shared() &&
+            (qemu_ram_is_shared(block) ||
+             (ram_loading && qemu_ram_is_clone(block))));
 }
 
 /* Should be holding either ram_list.mutex, or the RCU lock. */
@@ -346,6 +358,10 @@ struct RAMState {
     uint64_t target_page_count;
     /* number of dirty bits in the bitmap */
     uint64_t migration_dirty_pages;
+    /* Leave the hot chunks of RAM for the final stage */
+    bool defer_hot_pages;
+    /* dirty bits in the deferred chunks as of the last bitmap sync */
+    uint64_t migration_deferred_pages;
     /* Protects modification of the bitmap and migration dirty pages */
     QemuMutex bitmap_mutex;
     /* The RAMBlock used in the last src_page_requests */
@@ -465,10 +481,15 @@ static bool do_compress_ram_page(QEMUFile *f, z_stream *stream, RAMBlock *block,
 static void *do_data_compress(void *opaque)
 {
     CompressParam *param = opaque;
+    ThreadPlacement *placement;
+    QemuThread self;
     RAMBlock *block;
     ram_addr_t offset;
     bool zero_page;
 
+    qemu_thread_get_self(&self);
+    placement = thread_placement_add(&self, THREAD_PLACEMENT_WORKER, 0);
+
     qemu_mutex_lock(&param->mutex);
     while (!param->quit) {
         if (param->block) {
@@ -493,6 +514,7 @@ static void *do_data_compress(void *opaque)
     }
     qemu_mutex_unlock(&param->mutex);
 
+    thread_placement_del(placement);
     return NULL;
 }
 
@@ -778,6 +800,19 @@ static int save_xbzrle_page(RAMState *rs, uint8_t **current_data,
     return 1;
 }
 
+/* Granularity of the dirty heat tracking, see RAMBlock.heat */
+#define RAM_HOT_CHUNK_SIZE  (2 * MiB)
+#define RAM_HOT_CHUNK_PAGES (RAM_HOT_CHUNK_SIZE >> TARGET_PAGE_BITS)
+/* Chunks found dirty again by this many bitmap syncs in a row are deferred */
+#define RAM_HOT_CHUNK_HEAT  3
+
+static inline bool ram_page_deferred(RAMState *rs, RAMBlock *rb,
+                                     unsigned long page)
+{
+    return rs->defer_hot_pages && rb->heat &&
+           rb->heat[page / RAM_HOT_CHUNK_PAGES].heat >= RAM_HOT_CHUNK_HEAT;
+}
+
 /**
  * migration_bitmap_find_dirty: find the next dirty page from start
  *
@@ -807,6 +842,10 @@ unsigned long migration_bitmap_find_dirty(RAMState *rs, RAMBlock *rb,
         next = start + 1;
     } else {
         next = find_next_bit(bitmap, size, start);
+        while (next < size && ram_page_deferred(rs, rb, next)) {
+            next = find_next_bit(bitmap, size,
+                                 QEMU_ALIGN_UP(next + 1, RAM_HOT_CHUNK_PAGES));
+        }
     }
 
     return next;
@@ -864,6 +903,37 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
                                               &rs->num_dirty_pages_period);
 }
 
+/*
+ * Update the dirty heat of @rb after its bitmap was synced.  Dirty pages
+ * mostly got sent since the previous sync, so a chunk that is dirty again
+ * is getting hotter.  A deferred chunk was not sent, it only stays hot as
+ * long as it keeps gaining dirty pages.
+ *
+ * Called with RCU critical section and bitmap_mutex held
+ */
+static void ramblock_update_heat(RAMState *rs, RAMBlock *rb)
+{
+    unsigned long pages = rb->used_length >> TARGET_PAGE_BITS;
+    unsigned long page;
+    RAMBlockHeat *h = rb->heat;
+
+    for (page = 0; page < pages; page += RAM_HOT_CHUNK_PAGES, h++) {
+        long nr = MIN(RAM_HOT_CHUNK_PAGES, pages - page);
+        long dirty = bitmap_count_one_with_offset(rb->bmap, page, nr);
+        bool deferred = h->heat >= RAM_HOT_CHUNK_HEAT;
+
+        if (dirty && (!deferred || dirty > h->dirty)) {
+            h->heat = MIN(h->heat + 1, RAM_HOT_CHUNK_HEAT);
+        } else {
+            h->heat = 0;
+        }
+        h->dirty = dirty;
+        if (h->heat >= RAM_HOT_CHUNK_HEAT) {
+            rs->migration_deferred_pages += dirty;
+        }
+    }
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -989,9 +1059,13 @@ static void migration_bitmap_sync(RAMState *rs)
     memory_global_dirty_log_sync();
 
     qemu_mutex_lock(&rs->bitmap_mutex);
+    rs->migration_deferred_pages = 0;
     WITH_RCU_READ_LOCK_GUARD() {
         RAMBLOCK_FOREACH_NOT_IGNORED(block) {
             ramblock_sync_dirty_bitmap(rs, block);
+            if (rs->defer_hot_pages && block->heat && !rs->ram_bulk_stage) {
+                ramblock_update_heat(rs, block);
+            }
         }
         ram_counters.remaining = ram_bytes_remaining();
     }
@@ -1659,6 +1733,7 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
 {
     RAMBlock *block = pss->block;
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    bool use_multifd;
     int res;
 
     if (control_save_page(rs, block, offset, &res)) {
@@ -1669,6 +1744,20 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return 1;
     }
 
+    /*
+     * Do not use multifd for:
+     * 1. Compression as the first page in the new block should be posted out
+     *    before sending the compressed page
+     * 2. In postcopy as one whole host page should be placed
+     */
+    use_multifd = !save_page_use_compression(rs) && migrate_use_multifd()
+                  && !migration_in_postcopy();
+
+    /* The multifd channel threads look for zero pages themselves */
+    if (use_multifd && migrate_multifd_zero_page()) {
+        return ram_save_multifd_page(rs, block, offset);
+    }
+
     res = save_zero_page(rs, block, offset);
     if (res > 0) {
         /* Must let xbzrle know, otherwise a previous (now 0'd) cached
@@ -1683,14 +1772,7 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return res;
     }
 
-    /*
-     * Do not use multifd for:
-     * 1. Compression as the first page in the new block should be posted out
-     *    before sending the compressed page
-     * 2. In postcopy as one whole host page should be placed
-     */
-    if (!save_page_use_compression(rs) && migrate_use_multifd()
-        && !migration_in_postcopy()) {
+    if (use_multifd) {
         return ram_save_multifd_page(rs, block, offset);
     }
 
@@ -1896,6 +1978,8 @@ static void ram_save_cleanup(void *opaque)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->heat);
+        block->heat = NULL;
     }
 
     xbzrle_cleanup();
@@ -2162,6 +2246,9 @@ int ram_postcopy_send_discard_bitmap(MigrationState *ms)
 
     RCU_READ_LOCK_GUARD();
 
+    /* Everything has to go now, postcopy only pulls what the guest touches */
+    rs->defer_hot_pages = false;
+
     /* This should be our last sync, the src is now paused */
     migration_bitmap_sync(rs);
 
@@ -2297,6 +2384,7 @@ static int ram_state_init(RAMState **rsp)
      * This must match with the initial values of dirty bitmap.
      */
     (*rsp)->migration_dirty_pages = ram_bytes_total() >> TARGET_PAGE_BITS;
+    (*rsp)->defer_hot_pages = migrate_defer_hot_pages();
     ram_state_reset(*rsp);
 
     return 0;
@@ -2337,6 +2425,12 @@ static void ram_list_init_bitmaps(void)
             bitmap_set(block->bmap, 0, pages);
             block->clear_bmap_shift = shift;
             block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
+            /* A host page must not straddle two chunks */
+            if (migrate_defer_hot_pages() &&
+                block->page_size <= RAM_HOT_CHUNK_SIZE) {
+                block->heat = g_new0(RAMBlockHeat,
+                                     DIV_ROUND_UP(pages, RAM_HOT_CHUNK_PAGES));
+            }
         }
     }
 }
@@ -2638,6 +2732,9 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
     int ret = 0;
 
     WITH_RCU_READ_LOCK_GUARD() {
+        /* This is the stop-and-copy stage the hot chunks were left for */
+        rs->defer_hot_pages = false;
+
         if (!migration_in_postcopy()) {
             migration_bitmap_sync_precopy(rs);
         }
@@ -2681,12 +2778,17 @@ static void ram_save_pending(QEMUFile *f, void *opaque, uint64_t max_size,
 {
     RAMState **temp = opaque;
     RAMState *rs = *temp;
-    uint64_t remaining_size;
+    uint64_t remaining_size, deferred_pages = 0;
 
     remaining_size = rs->migration_dirty_pages * TARGET_PAGE_SIZE;
+    if (rs->defer_hot_pages) {
+        deferred_pages = MIN(rs->migration_deferred_pages,
+                             rs->migration_dirty_pages);
+    }
 
+    /* Deferred pages are not sent before the end, don't wait for them */
     if (!migration_in_postcopy() &&
-        remaining_size < max_size) {
+        remaining_size - deferred_pages * TARGET_PAGE_SIZE < max_size) {
         qemu_mutex_lock_iothread();
         WITH_RCU_READ_LOCK_GUARD() {
             migration_bitmap_sync_precopy(rs);
@@ -2858,10 +2960,15 @@ qemu_uncompress_data(z_stream *stream, uint8_t *dest, size_t dest_len,
 static void *do_data_decompress(void *opaque)
 {
     DecompressParam *param = opaque;
+    ThreadPlacement *placement;
+    QemuThread self;
     unsigned long pagesize;
     uint8_t *des;
     int len, ret;
 
+    qemu_thread_get_self(&self);
+    placement = thread_placement_add(&self, THREAD_PLACEMENT_WORKER, 0);
+
     qemu_mutex_lock(&param->mutex);
     while (!param->quit) {
         if (param->des) {
@@ -2891,6 +2998,7 @@ static void *do_data_decompress(void *opaque)
     }
     qemu_mutex_unlock(&param->mutex);
 
+    thread_placement_del(placement);
     return NULL;
 }
 
@@ -3122,6 +3230,8 @@ static int ram_load_setup(QEMUFile *f, void *opaque)
         return -1;
     }
 
+    ram_loading = true;
+
     xbzrle_load_setup();
     ramblock_recv_map_init();
 
@@ -3144,6 +3254,7 @@ static int ram_load_cleanup(void *opaque)
         rb->receivedmap = NULL;
     }
 
+    ram_loading = false;
     return 0;
 }
 
@@ -1354,23 +1354,184 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 }
 
 static
+/*
+ * Devices with an independent vmsd are saved by worker threads, each into
+ * its own buffer.  The buffers are then put into the stream in the usual
+ * order, so the stream is the same as if they were saved serially.
+ */
+#define SAVEVM_PARALLEL_THREADS 8
+
+typedef struct SaveStateJob {
+    SaveStateEntry *se;
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    QJSON *vmdesc;
+    int ret;
+    QemuEvent done;
+} SaveStateJob;
+
+typedef struct SaveStateJobs {
+    SaveStateJob *jobs;
+    int nr;
+    /* Next job to pick up, updated atomically */
+    int next;
+    QemuThread threads[SAVEVM_PARALLEL_THREADS];
+    int nr_threads;
+} SaveStateJobs;
+
+static bool savevm_entry_is_independent(SaveStateEntry *se)
+{
+    return se->vmsd && se->vmsd->independent &&
+           (!se->ops || !se->ops->save_state);
+}
+
+static void *savevm_parallel_thread(void *opaque)
+{
+    SaveStateJobs *p = opaque;
+    int i;
+
+    rcu_register_thread();
+    while ((i = atomic_fetch_inc(&p->next)) < p->nr) {
+        SaveStateJob *job = &p->jobs[i];
+        SaveStateEntry *se = job->se;
+
+        job->bioc = qio_channel_buffer_new(4096);
+        job->f = qemu_fopen_channel_output(QIO_CHANNEL(job->bioc));
+        job->vmdesc = qjson_new();
+        json_prop_str(job->vmdesc, "name", se->idstr);
+        json_prop_int(job->vmdesc, "instance_id", se->instance_id);
+
+        trace_savevm_section_start(se->idstr, se->section_id);
+        save_section_header(job->f, se, QEMU_VM_SECTION_FULL);
+        job->ret = vmstate_save(job->f, se, job->vmdesc);
+        trace_savevm_section_end(se->idstr, se->section_id, job->ret);
+        save_section_footer(job->f, se);
+        qjson_finish(job->vmdesc);
+
+        qemu_fflush(job->f);
+        if (!job->ret) {
+            job->ret = qemu_file_get_error(job->f);
+        }
+        qemu_event_set(&job->done);
+    }
+    rcu_unregister_thread();
+
+    return NULL;
+}
+
+/* Start saving the independent entries, returns NULL if there are none */
+static SaveStateJobs *savevm_parallel_start(void)
+{
+    SaveStateJobs *p;
+    SaveStateEntry *se;
+    int nr = 0, i;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        if (savevm_entry_is_independent(se) &&
+            vmstate_save_needed(se->vmsd, se->opaque)) {
+            nr++;
+        }
+    }
+    /* Not worth a thread */
+    if (nr < 2) {
+        return NULL;
+    }
+
+    p = g_new0(SaveStateJobs, 1);
+    p->jobs = g_new0(SaveStateJob, nr);
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        if (savevm_entry_is_independent(se) &&
+            vmstate_save_needed(se->vmsd, se->opaque)) {
+            p->jobs[p->nr].se = se;
+            qemu_event_init(&p->jobs[p->nr].done, false);
+            p->nr++;
+        }
+    }
+
+    p->nr_threads = MIN(nr, SAVEVM_PARALLEL_THREADS);
+    for (i = 0; i < p->nr_threads; i++) {
+        qemu_thread_create(&p->threads[i], "savevm-parallel",
+                           savevm_parallel_thread, p, QEMU_THREAD_JOINABLE);
+    }
+    return p;
+}
+
+static SaveStateJob *savevm_parallel_find(SaveStateJobs *p,
+                                          SaveStateEntry *se)
+{
+    int i;
+
+    for (i = 0; p && i < p->nr; i++) {
+        if (p->jobs[i].se == se) {
+            return &p->jobs[i];
+        }
+    }
+    return NULL;
+}
+
+static void savevm_parallel_finish(SaveStateJobs *p)
+{
+    int i;
+
+    if (!p) {
+        return;
+    }
+    for (i = 0; i < p->nr_threads; i++) {
+        qemu_thread_join(&p->threads[i]);
+    }
+    for (i = 0; i < p->nr; i++) {
+        SaveStateJob *job = &p->jobs[i];
+
+        if (job->f) {
+            qemu_fclose(job->f);
+        }
+        if (job->bioc) {
+            object_unref(OBJECT(job->bioc));
+        }
+        if (job->vmdesc) {
+            qjson_destroy(job->vmdesc);
+        }
+        qemu_event_destroy(&job->done);
+    }
+    g_free(p->jobs);
+    g_free(p);
+}
+
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                                     bool in_postcopy,
                                                     bool inactivate_disks)
 {
     g_autoptr(QJSON) vmdesc = NULL;
+    SaveStateJobs *jobs;
     int vmdesc_len;
     SaveStateEntry *se;
     int ret;
 
+    jobs = savevm_parallel_start();
+
     vmdesc = qjson_new();
     json_prop_int(vmdesc, "page_size", qemu_target_page_size());
     json_start_array(vmdesc, "devices");
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        SaveStateJob *job;
 
         if ((!se->ops || !se->ops->save_state) && !se->vmsd) {
             continue;
         }
+
+        job = savevm_parallel_find(jobs, se);
+        if (job) {
+            qemu_event_wait(&job->done);
+            if (job->ret) {
+                qemu_file_set_error(f, job->ret);
+                savevm_parallel_finish(jobs);
+                return job->ret;
+            }
+            qemu_put_buffer(f, job->bioc->data, job->bioc->usage);
+            json_append_object(vmdesc, NULL, job->vmdesc);
+            continue;
+        }
+
         if (se->vmsd && !vmstate_save_needed(se->vmsd, se->opaque)) {
             trace_savevm_section_skip(se->idstr, se->section_id);
             continue;
@@ -1386,6 +1547,7 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         ret = vmstate_save(f, se, vmdesc);
         if (ret) {
             qemu_file_set_error(f, ret);
+            savevm_parallel_finish(jobs);
             return ret;
         }
         trace_savevm_section_end(se->idstr, se->section_id, 0);
@@ -1393,6 +1555,7 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
 
         json_end_object(vmdesc);
     }
+    savevm_parallel_finish(jobs);
 
     if (inactivate_disks) {
         /* Inactivate before sending QEMU_VM_EOF so that the
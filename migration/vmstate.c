@@ -75,6 +75,49 @@ static void vmstate_handle_alloc(void *ptr, const VMStateField *field,
     }
 }
 
+/*
+ * Plain uint32 arrays, e.g the regs[] of register API devices, are moved
+ * in bulk instead of element by element. The stream format is the same.
+ */
+static bool vmstate_field_is_u32_array(const VMStateField *field,
+                                       int n_elems, int size)
+{
+    return field->info == &vmstate_info_uint32 && n_elems > 1 &&
+           size == sizeof(uint32_t) && !field->field_exists &&
+           !(field->flags & (VMS_ARRAY_OF_POINTER | VMS_STRUCT |
+                             VMS_VSTRUCT));
+}
+
+static void vmstate_put_u32_array(QEMUFile *f, const uint32_t *v, int n)
+{
+#ifdef HOST_WORDS_BIGENDIAN
+    qemu_put_buffer(f, (const uint8_t *)v, n * sizeof(*v));
+#else
+    uint32_t buf[256];
+
+    while (n) {
+        int i, chunk = MIN(n, ARRAY_SIZE(buf));
+
+        for (i = 0; i < chunk; i++) {
+            buf[i] = cpu_to_be32(v[i]);
+        }
+        qemu_put_buffer(f, (uint8_t *)buf, chunk * sizeof(buf[0]));
+        v += chunk;
+        n -= chunk;
+    }
+#endif
+}
+
+static void vmstate_get_u32_array(QEMUFile *f, uint32_t *v, int n)
+{
+    int i;
+
+    qemu_get_buffer(f, (uint8_t *)v, n * sizeof(*v));
+    for (i = 0; i < n; i++) {
+        be32_to_cpus(&v[i]);
+    }
+}
+
 int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                        void *opaque, int version_id)
 {
@@ -123,6 +166,17 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                 first_elem = *(void **)first_elem;
                 assert(first_elem || !n_elems || !size);
             }
+            if (vmstate_field_is_u32_array(field, n_elems, size)) {
+                vmstate_get_u32_array(f, first_elem, n_elems);
+                ret = qemu_file_get_error(f);
+                if (ret < 0) {
+                    error_report("Failed to load %s:%s", vmsd->name,
+                                 field->name);
+                    trace_vmstate_load_field_error(field->name, ret);
+                    return ret;
+                }
+                n_elems = 0;
+            }
             for (i = 0; i < n_elems; i++) {
                 void *curr_elem = first_elem + size * i;
 
@@ -360,6 +414,13 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
                 first_elem = *(void **)first_elem;
                 assert(first_elem || !n_elems || !size);
             }
+            if (vmstate_field_is_u32_array(field, n_elems, size)) {
+                /* Describe it like a compressed array of n_elems.  */
+                vmsd_desc_field_start(vmsd, vmdesc_loop, field, 0, n_elems);
+                vmstate_put_u32_array(f, first_elem, n_elems);
+                vmsd_desc_field_end(vmsd, vmdesc_loop, field, size, 0);
+                n_elems = 0;
+            }
             for (i = 0; i < n_elems; i++) {
                 void *curr_elem = first_elem + size * i;
 
@@ -12,8 +12,43 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "xbzrle.h"
 
+#define XBZRLE_LOW7 ((unsigned long)0x7f7f7f7f7f7f7f7fULL)
+
+/* Index of the first byte in memory order that is non-zero in @x != 0 */
+static inline int xbzrle_first_nonzero_byte(unsigned long x)
+{
+#ifdef HOST_WORDS_BIGENDIAN
+    return (sizeof(long) == 8 ? clz64(x) : clz32(x)) / 8;
+#else
+    return (sizeof(long) == 8 ? ctz64(x) : ctz32(x)) / 8;
+#endif
+}
+
+/*
+ * Index of the first byte in memory order that is zero in @x, or
+ * sizeof(long) if there is none.  Unlike the usual haszero trick this
+ * has no false positives, so the position is exact.
+ */
+static inline int xbzrle_first_zero_byte(unsigned long x)
+{
+    unsigned long zero = ~(((x & XBZRLE_LOW7) + XBZRLE_LOW7) | x | XBZRLE_LOW7);
+
+    return zero ? xbzrle_first_nonzero_byte(zero) : sizeof(long);
+}
+
+/* The four words at @a and @b differ if the result is non-zero */
+static inline unsigned long xbzrle_xor4(const uint8_t *a, const uint8_t *b)
+{
+    const unsigned long *la = (const unsigned long *)a;
+    const unsigned long *lb = (const unsigned long *)b;
+
+    return (la[0] ^ lb[0]) | (la[1] ^ lb[1]) |
+           (la[2] ^ lb[2]) | (la[3] ^ lb[3]);
+}
+
 /*
   page = zrun nzrun
        | zrun nzrun page
@@ -49,19 +84,26 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
             res--;
         }
 
-        /* word at a time for speed */
+        /* word at a time for speed, four of them while the run goes on */
         if (!res) {
-            while (i < slen &&
-                   (*(long *)(old_buf + i)) == (*(long *)(new_buf + i))) {
+            while (i + 4 * sizeof(long) <= slen &&
+                   !xbzrle_xor4(old_buf + i, new_buf + i)) {
+                i += 4 * sizeof(long);
+                zrun_len += 4 * sizeof(long);
+            }
+            while (i < slen) {
+                unsigned long xor = *(unsigned long *)(old_buf + i)
+                                  ^ *(unsigned long *)(new_buf + i);
+                if (xor) {
+                    /* the zrun ends within the current long */
+                    int n = xbzrle_first_nonzero_byte(xor);
+                    i += n;
+                    zrun_len += n;
+                    break;
+                }
                 i += sizeof(long);
                 zrun_len += sizeof(long);
             }
-
-            /* go over the rest */
-            while (i < slen && old_buf[i] == new_buf[i]) {
-                zrun_len++;
-                i++;
-            }
         }
 
         /* buffer unchanged */
@@ -93,22 +135,18 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 
         /* word at a time for speed, use of 32-bit long okay */
         if (!res) {
-            /* truncation to 32-bit long okay */
-            unsigned long mask = (unsigned long)0x0101010101010101ULL;
             while (i < slen) {
                 unsigned long xor;
+                int n;
+
                 xor = *(unsigned long *)(old_buf + i)
                     ^ *(unsigned long *)(new_buf + i);
-                if ((xor - mask) & ~xor & (mask << 7)) {
+                n = xbzrle_first_zero_byte(xor);
+                i += n;
+                nzrun_len += n;
+                if (n < sizeof(long)) {
                     /* found the end of an nzrun within the current long */
-                    while (old_buf[i] != new_buf[i]) {
-                        nzrun_len++;
-                        i++;
-                    }
                     break;
-                } else {
-                    i += sizeof(long);
-                    nzrun_len += sizeof(long);
                 }
             }
         }
@@ -49,6 +49,7 @@
 #include "ui/console.h"
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
+#include "exec/mmio-profile.h"
 #include "exec/ramlist.h"
 #include "hw/intc/intc.h"
 #include "hw/rdma/rdma.h"
@@ -944,6 +945,29 @@ void hmp_sync_profile(Monitor *mon, const QDict *qdict)
     }
 }
 
+void hmp_mmio_profile(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_try_str(qdict, "op");
+    Error *err = NULL;
+
+    if (op == NULL) {
+        bool on = atomic_read(&mmio_profile_enabled);
+
+        monitor_printf(mon, "mmio-profile is %s\n", on ? "on" : "off");
+        return;
+    }
+    if (!strcmp(op, "on")) {
+        qmp_mmio_profile_set_state(true, false, false, &err);
+    } else if (!strcmp(op, "off")) {
+        qmp_mmio_profile_set_state(false, false, false, &err);
+    } else if (!strcmp(op, "reset")) {
+        mmio_profile_reset();
+    } else {
+        error_setg(&err, QERR_INVALID_PARAMETER, op);
+    }
+    hmp_handle_error(mon, err);
+}
+
 void hmp_system_reset(Monitor *mon, const QDict *qdict)
 {
     qmp_system_reset(NULL);
@@ -1880,6 +1904,34 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
     qapi_free_IOThreadInfoList(info_list);
 }
 
+void hmp_info_mmio_profile(Monitor *mon, const QDict *qdict)
+{
+    int64_t max = qdict_get_try_int(qdict, "max", 16);
+    MmioProfileInfoList *info_list, *info;
+    Error *err = NULL;
+
+    info_list = qmp_query_mmio_profile(true, max, &err);
+    if (err) {
+        hmp_handle_error(mon, err);
+        return;
+    }
+
+    monitor_printf(mon, "%-40s %-24s %8s %12s %12s %12s %12s\n",
+                   "Owner", "Region", "Offset", "Reads", "Writes",
+                   "Read ns", "Write ns");
+    for (info = info_list; info; info = info->next) {
+        MmioProfileInfo *value = info->value;
+
+        monitor_printf(mon, "%-40s %-24s %8" PRIx64 " %12" PRId64
+                       " %12" PRId64 " %12" PRId64 " %12" PRId64 "\n",
+                       value->has_owner ? value->owner : "-",
+                       value->region, value->offset, value->reads,
+                       value->writes, value->read_ns, value->write_ns);
+    }
+
+    qapi_free_MmioProfileInfoList(info_list);
+}
+
 void hmp_rocker(Monitor *mon, const QDict *qdict)
 {
     const char *name = qdict_get_str(qdict, "name");
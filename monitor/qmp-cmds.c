@@ -16,6 +16,7 @@
 #include "qemu/osdep.h"
 #include "qemu-common.h"
 #include "qemu/cutils.h"
+#include "qemu/lock-profile.h"
 #include "qemu/option.h"
 #include "monitor/monitor.h"
 #include "sysemu/sysemu.h"
@@ -35,9 +36,13 @@
 #include "qapi/qapi-commands-machine.h"
 #include "qapi/qapi-commands-misc.h"
 #include "qapi/qapi-commands-ui.h"
+#include "qapi/qmp/dispatch.h"
+#include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qerror.h"
 #include "hw/mem/memory-device.h"
 #include "hw/acpi/acpi_dev_interface.h"
+#include "exec/memory.h"
+#include "monitor-internal.h"
 
 NameInfo *qmp_query_name(Error **errp)
 {
@@ -400,3 +405,92 @@ MemoryInfo *qmp_query_memory_size_summary(Error **errp)
 
     return mem_info;
 }
+
+static void query_lock_contention_one(const LockProfileStats *stats,
+                                      void *opaque)
+{
+    LockContentionInfoList ***prev = opaque;
+    LockContentionInfoList *elem = g_new0(LockContentionInfoList, 1);
+    LockContentionInfo *info = g_new0(LockContentionInfo, 1);
+    intList **hist = &info->histogram;
+    int i;
+
+    info->name = stats->line ? g_strdup_printf("%s:%d", stats->name,
+                                               stats->line)
+                             : g_strdup(stats->name);
+    info->count = stats->count;
+    info->wait_ns = stats->wait_ns;
+    info->max_wait_ns = stats->max_ns;
+    for (i = 0; i < LOCK_PROFILE_BUCKETS; i++) {
+        *hist = g_new0(intList, 1);
+        (*hist)->value = stats->hist[i];
+        hist = &(*hist)->next;
+    }
+
+    elem->value = info;
+    **prev = elem;
+    *prev = &elem->next;
+}
+
+LockContentionInfoList *qmp_query_lock_contention(Error **errp)
+{
+    LockContentionInfoList *head = NULL;
+    LockContentionInfoList **prev = &head;
+
+    lock_profile_foreach(query_lock_contention_one, &prev);
+    return head;
+}
+
+static BatchResult *batch_run_one(BatchCommand *cmd)
+{
+    BatchResult *res = g_new0(BatchResult, 1);
+    QDict *req = qdict_new();
+    QDict *rsp, *error;
+
+    qdict_put_str(req, "execute", cmd->execute);
+    if (cmd->has_arguments) {
+        qdict_put_obj(req, "arguments", qobject_ref(cmd->arguments));
+    }
+    rsp = qmp_dispatch(&qmp_commands, QOBJECT(req), false);
+    qobject_unref(req);
+
+    error = rsp ? qdict_get_qdict(rsp, "error") : NULL;
+    if (error) {
+        res->has_error = true;
+        res->error = g_new0(BatchError, 1);
+        res->error->q_class = g_strdup(qdict_get_str(error, "class"));
+        res->error->desc = g_strdup(qdict_get_str(error, "desc"));
+    } else {
+        res->has_q_return = true;
+        /* Commands without a success response still report success */
+        res->q_return = rsp ? qobject_ref(qdict_get(rsp, "return"))
+                            : QOBJECT(qdict_new());
+    }
+    qobject_unref(rsp);
+    return res;
+}
+
+BatchResultList *qmp_batch(BatchCommandList *commands,
+                           bool has_stop_on_error, bool stop_on_error,
+                           Error **errp)
+{
+    BatchResultList *head = NULL;
+    BatchResultList **prev = &head;
+    BatchCommandList *c;
+
+    /* Rebuild the address spaces once for the whole batch */
+    memory_region_transaction_begin();
+    for (c = commands; c; c = c->next) {
+        BatchResultList *elem = g_new0(BatchResultList, 1);
+
+        elem->value = batch_run_one(c->value);
+        *prev = elem;
+        prev = &elem->next;
+        if (stop_on_error && elem->value->has_error) {
+            break;
+        }
+    }
+    memory_region_transaction_commit();
+
+    return head;
+}
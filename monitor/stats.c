@@ -0,0 +1,171 @@
+/*
+ * Runtime statistics reported by query-stats
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/queue.h"
+#include "qapi/qapi-commands-stats.h"
+#include "monitor/stats.h"
+
+typedef struct StatsGroup {
+    StatsProvider provider;
+    StatsTarget target;
+    const StatsDescriptor *desc;
+    unsigned int num;
+    StatsRetrieveFunc *retrieve;
+    QTAILQ_ENTRY(StatsGroup) next;
+} StatsGroup;
+
+struct StatsCollector {
+    StatsGroup *group;
+    StatsFilter *filter;
+    StatsResultList **tail;
+};
+
+static QTAILQ_HEAD(, StatsGroup) stats_groups =
+    QTAILQ_HEAD_INITIALIZER(stats_groups);
+
+void stats_register(StatsProvider provider, StatsTarget target,
+                    const StatsDescriptor *desc, unsigned int num,
+                    StatsRetrieveFunc *retrieve)
+{
+    StatsGroup *group = g_new0(StatsGroup, 1);
+
+    group->provider = provider;
+    group->target = target;
+    group->desc = desc;
+    group->num = num;
+    group->retrieve = retrieve;
+    QTAILQ_INSERT_TAIL(&stats_groups, group, next);
+}
+
+bool stats_wanted(StatsCollector *c, const char *qom_path)
+{
+    strList *path;
+
+    if (!c->filter->has_qom_paths) {
+        return true;
+    }
+    if (!qom_path) {
+        return false;
+    }
+    for (path = c->filter->qom_paths; path; path = path->next) {
+        if (g_str_equal(path->value, qom_path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void stats_collect(StatsCollector *c, const char *qom_path,
+                   const uint64_t *values)
+{
+    StatsGroup *group = c->group;
+    StatsResultList *entry;
+    StatsResult *result;
+    StatsList **tail;
+    unsigned int i;
+
+    if (!stats_wanted(c, qom_path)) {
+        return;
+    }
+
+    result = g_new0(StatsResult, 1);
+    result->provider = group->provider;
+    result->target = group->target;
+    result->has_qom_path = !!qom_path;
+    result->qom_path = g_strdup(qom_path);
+
+    tail = &result->stats;
+    for (i = 0; i < group->num; i++) {
+        StatsList *stat = g_new0(StatsList, 1);
+
+        stat->value = g_new0(Stats, 1);
+        stat->value->name = g_strdup(group->desc[i].name);
+        stat->value->value = values[i];
+        *tail = stat;
+        tail = &stat->next;
+    }
+
+    entry = g_new0(StatsResultList, 1);
+    entry->value = result;
+    *c->tail = entry;
+    c->tail = &entry->next;
+}
+
+static bool stats_provider_wanted(StatsProviderList *list,
+                                  StatsProvider provider)
+{
+    for (; list; list = list->next) {
+        if (list->value == provider) {
+            return true;
+        }
+    }
+    return false;
+}
+
+StatsResultList *qmp_query_stats(StatsFilter *filter, Error **errp)
+{
+    StatsResultList *head = NULL;
+    StatsCollector c = { .filter = filter, .tail = &head };
+    StatsGroup *group;
+
+    QTAILQ_FOREACH(group, &stats_groups, next) {
+        if (filter->has_target && filter->target != group->target) {
+            continue;
+        }
+        if (filter->has_providers &&
+            !stats_provider_wanted(filter->providers, group->provider)) {
+            continue;
+        }
+        c.group = group;
+        group->retrieve(&c);
+    }
+    return head;
+}
+
+StatsSchemaList *qmp_query_stats_schemas(bool has_provider,
+                                         StatsProvider provider,
+                                         Error **errp)
+{
+    StatsSchemaList *head = NULL, **tail = &head;
+    StatsGroup *group;
+
+    QTAILQ_FOREACH(group, &stats_groups, next) {
+        StatsSchemaValueList **vtail;
+        StatsSchemaList *entry;
+        StatsSchema *schema;
+        unsigned int i;
+
+        if (has_provider && provider != group->provider) {
+            continue;
+        }
+
+        schema = g_new0(StatsSchema, 1);
+        schema->provider = group->provider;
+        schema->target = group->target;
+        vtail = &schema->stats;
+        for (i = 0; i < group->num; i++) {
+            StatsSchemaValueList *v = g_new0(StatsSchemaValueList, 1);
+
+            v->value = g_new0(StatsSchemaValue, 1);
+            v->value->name = g_strdup(group->desc[i].name);
+            v->value->type = group->desc[i].type;
+            v->value->has_unit = group->desc[i].has_unit;
+            v->value->unit = group->desc[i].unit;
+            *vtail = v;
+            vtail = &v->next;
+        }
+
+        entry = g_new0(StatsSchemaList, 1);
+        entry->value = schema;
+        *tail = entry;
+        tail = &entry->next;
+    }
+    return head;
+}
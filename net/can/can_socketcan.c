@@ -49,7 +49,7 @@
 #define CAN_HOST_SOCKETCAN(obj) \
      OBJECT_CHECK(CanHostSocketCAN, (obj), TYPE_CAN_HOST_SOCKETCAN)
 
-#define CAN_READ_BUF_LEN  5
+#define CAN_READ_BUF_LEN  32
 typedef struct CanHostSocketCAN {
     CanHostState       parent;
     char               *ifname;
@@ -95,18 +95,33 @@ static void can_host_socketcan_read(void *opaque)
 {
     CanHostSocketCAN *c = opaque;
     CanHostState *ch = CAN_HOST(c);
+    struct mmsghdr msgs[CAN_READ_BUF_LEN];
+    struct iovec iov[CAN_READ_BUF_LEN];
+    int i;
+
+    /* Drain up to CAN_READ_BUF_LEN frames and put them on the bus at once */
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < CAN_READ_BUF_LEN; i++) {
+        iov[i].iov_base = &c->buf[i];
+        iov[i].iov_len = sizeof(qemu_can_frame);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
 
-    /* CAN_READ_BUF_LEN for multiple messages syscall is possible for future */
-    c->bufcnt = read(c->fd, c->buf, sizeof(qemu_can_frame));
+    c->bufcnt = recvmmsg(c->fd, msgs, CAN_READ_BUF_LEN, MSG_DONTWAIT, NULL);
     if (c->bufcnt < 0) {
-        warn_report("CAN bus host read failed (%s)", strerror(errno));
+        if (errno != EAGAIN && errno != EINTR) {
+            warn_report("CAN bus host read failed (%s)", strerror(errno));
+        }
         return;
     }
 
-    can_bus_client_send(&ch->bus_client, c->buf, 1);
+    can_bus_client_send(&ch->bus_client, c->buf, c->bufcnt);
 
     if (DEBUG_CAN) {
-        can_host_socketcan_display_msg(c->buf);
+        for (i = 0; i < c->bufcnt; i++) {
+            can_host_socketcan_display_msg(&c->buf[i]);
+        }
     }
 }
 
@@ -120,29 +135,43 @@ static ssize_t can_host_socketcan_receive(CanBusClientState *client,
 {
     CanHostState *ch = container_of(client, CanHostState, bus_client);
     CanHostSocketCAN *c = CAN_HOST_SOCKETCAN(ch);
-
-    size_t len = sizeof(qemu_can_frame);
-    int res;
+    struct mmsghdr msgs[CAN_READ_BUF_LEN];
+    struct iovec iov[CAN_READ_BUF_LEN];
+    size_t sent = 0;
+    int i, n, res;
 
     if (c->fd < 0) {
         return -1;
     }
 
-    res = write(c->fd, frames, len);
-
-    if (!res) {
-        warn_report("[cansocketcan]: write message to host returns zero");
-        return -1;
-    }
+    /* One sendmmsg per CAN_READ_BUF_LEN frames of the batch */
+    while (sent < frames_cnt) {
+        n = MIN(frames_cnt - sent, CAN_READ_BUF_LEN);
+        memset(msgs, 0, n * sizeof(msgs[0]));
+        for (i = 0; i < n; i++) {
+            iov[i].iov_base = (void *)&frames[sent + i];
+            iov[i].iov_len = sizeof(qemu_can_frame);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
 
-    if (res != len) {
+        res = sendmmsg(c->fd, msgs, n, 0);
         if (res < 0) {
             warn_report("[cansocketcan]: write to host failed (%s)",
                         strerror(errno));
-        } else {
-            warn_report("[cansocketcan]: write to host truncated");
+            return -1;
         }
-        return -1;
+        for (i = 0; i < res; i++) {
+            if (msgs[i].msg_len != sizeof(qemu_can_frame)) {
+                warn_report("[cansocketcan]: write to host truncated");
+                return -1;
+            }
+        }
+        if (!res) {
+            warn_report("[cansocketcan]: write message to host returns zero");
+            return -1;
+        }
+        sent += res;
     }
 
     return 1;
@@ -75,6 +75,15 @@ typedef struct NetL2TPV3State {
 
     struct mmsghdr *msgvec;
 
+    /*
+     * these are used for xmit while the peer sends a batch - packets
+     * that fit are copied here and go out with a single sendmmsg
+     */
+
+    struct mmsghdr *tx_msgvec;
+    int tx_head;
+    int tx_count;
+
     /*
      * peer address
      */
@@ -159,10 +168,15 @@ static void l2tpv3_write_poll(NetL2TPV3State *s, bool enable)
     }
 }
 
+static bool l2tpv3_tx_flush(NetL2TPV3State *s);
+
 static void l2tpv3_writable(void *opaque)
 {
     NetL2TPV3State *s = opaque;
     l2tpv3_write_poll(s, false);
+    if (!l2tpv3_tx_flush(s)) {
+        return;
+    }
     qemu_flush_queued_packets(&s->nc);
 }
 
@@ -213,6 +227,68 @@ static void l2tpv3_form_header(NetL2TPV3State *s)
     }
 }
 
+/*
+ * Send out the staged packets. Returns false if some are still pending
+ * because the socket buffer is full, in which case write poll is armed.
+ */
+static bool l2tpv3_tx_flush(NetL2TPV3State *s)
+{
+    int ret;
+
+    while (s->tx_head < s->tx_count) {
+        do {
+            ret = sendmmsg(s->fd, s->tx_msgvec + s->tx_head,
+                           s->tx_count - s->tx_head, 0);
+        } while ((ret == -1) && (errno == EINTR));
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == ENOBUFS) {
+                l2tpv3_write_poll(s, true);
+                return false;
+            }
+            /* same as for a single packet - the rest of the batch is lost */
+            break;
+        }
+        s->tx_head += ret;
+    }
+    s->tx_head = 0;
+    s->tx_count = 0;
+    return true;
+}
+
+static void net_l2tpv3_receive_flush(NetClientState *nc)
+{
+    NetL2TPV3State *s = DO_UPCAST(NetL2TPV3State, nc, nc);
+
+    l2tpv3_tx_flush(s);
+}
+
+/*
+ * Stage a packet for the next sendmmsg. Returns the packet size, 0 if it
+ * has to be queued until the socket drains, or -1 if it is not eligible.
+ */
+static ssize_t l2tpv3_tx_stage(NetL2TPV3State *s,
+                               const struct iovec *iov, int iovcnt)
+{
+    struct mmsghdr *msg;
+    size_t size = iov_size(iov, iovcnt);
+
+    if (!s->nc.receive_batch || size > BUFFER_SIZE) {
+        return -1;
+    }
+    if (s->tx_count == MAX_L2TPV3_MSGCNT && !l2tpv3_tx_flush(s)) {
+        return 0;
+    }
+
+    msg = s->tx_msgvec + s->tx_count++;
+    l2tpv3_form_header(s);
+    memcpy(msg->msg_hdr.msg_iov[0].iov_base, s->header_buf, s->offset);
+    msg->msg_hdr.msg_iov[1].iov_len =
+        iov_to_buf(iov, iovcnt, 0, msg->msg_hdr.msg_iov[1].iov_base, size);
+    msg->msg_hdr.msg_name = s->dgram_dst;
+    msg->msg_hdr.msg_namelen = s->dst_size;
+    return size;
+}
+
 static ssize_t net_l2tpv3_receive_dgram_iov(NetClientState *nc,
                     const struct iovec *iov,
                     int iovcnt)
@@ -222,6 +298,19 @@ static ssize_t net_l2tpv3_receive_dgram_iov(NetClientState *nc,
     struct msghdr message;
     int ret;
 
+    /* staged packets go first, keep the order */
+    if (s->tx_count &&
+        (s->tx_head || !s->nc.receive_batch) && !l2tpv3_tx_flush(s)) {
+        return 0;
+    }
+    ret = l2tpv3_tx_stage(s, iov, iovcnt);
+    if (ret >= 0) {
+        return ret;
+    }
+    if (s->tx_count && !l2tpv3_tx_flush(s)) {
+        return 0;
+    }
+
     if (iovcnt > MAX_L2TPV3_IOVCNT - 1) {
         error_report(
             "iovec too long %d > %d, change l2tpv3.h",
@@ -271,6 +360,10 @@ static ssize_t net_l2tpv3_receive_dgram(NetClientState *nc,
     struct msghdr message;
     ssize_t ret = 0;
 
+    if (s->tx_count && !l2tpv3_tx_flush(s)) {
+        return 0;
+    }
+
     l2tpv3_form_header(s);
     vec = s->vec;
     vec->iov_base = s->header_buf;
@@ -473,7 +566,8 @@ static void destroy_vector(struct mmsghdr *msgvec, int count, int iovcount)
     }
 }
 
-static struct mmsghdr *build_l2tpv3_vector(NetL2TPV3State *s, int count)
+static struct mmsghdr *build_l2tpv3_vector(NetL2TPV3State *s, int count,
+                                           uint32_t header_size)
 {
     int i;
     struct iovec *iov;
@@ -486,8 +580,8 @@ static struct mmsghdr *build_l2tpv3_vector(NetL2TPV3State *s, int count)
         msgvec->msg_hdr.msg_namelen = 0;
         iov =  g_new(struct iovec, IOVSIZE);
         msgvec->msg_hdr.msg_iov = iov;
-        iov->iov_base = g_malloc(s->header_size);
-        iov->iov_len = s->header_size;
+        iov->iov_base = g_malloc(header_size);
+        iov->iov_len = header_size;
         iov++ ;
         iov->iov_base = qemu_memalign(BUFFER_ALIGN, BUFFER_SIZE);
         iov->iov_len = BUFFER_SIZE;
@@ -510,6 +604,7 @@ static void net_l2tpv3_cleanup(NetClientState *nc)
         close(s->fd);
     }
     destroy_vector(s->msgvec, MAX_L2TPV3_MSGCNT, IOVSIZE);
+    destroy_vector(s->tx_msgvec, MAX_L2TPV3_MSGCNT, IOVSIZE);
     g_free(s->vec);
     g_free(s->header_buf);
     g_free(s->dgram_dst);
@@ -520,6 +615,7 @@ static NetClientInfo net_l2tpv3_info = {
     .size = sizeof(NetL2TPV3State),
     .receive = net_l2tpv3_receive_dgram,
     .receive_iov = net_l2tpv3_receive_dgram_iov,
+    .receive_flush = net_l2tpv3_receive_flush,
     .poll = l2tpv3_poll,
     .cleanup = net_l2tpv3_cleanup,
 };
@@ -715,7 +811,9 @@ int net_init_l2tpv3(const Netdev *netdev,
         s->header_size = s->offset + sizeof(struct iphdr);
     }
 
-    s->msgvec = build_l2tpv3_vector(s, MAX_L2TPV3_MSGCNT);
+    s->msgvec = build_l2tpv3_vector(s, MAX_L2TPV3_MSGCNT, s->header_size);
+    /* on xmit the kernel adds the IP header, only our part is sent */
+    s->tx_msgvec = build_l2tpv3_vector(s, MAX_L2TPV3_MSGCNT, s->offset);
     s->vec = g_new(struct iovec, MAX_L2TPV3_IOVCNT);
     s->header_buf = g_malloc(s->header_size);
 
@@ -735,6 +735,30 @@ static ssize_t qemu_deliver_packet_iov(NetClientState *sender,
     return ret;
 }
 
+/*
+ * Bracket a burst of packets sent by @nc.  In between, a peer that
+ * implements receive_flush may accept packets without transmitting them
+ * right away, and pass them on to the host in one go when the outermost
+ * batch ends.
+ */
+void qemu_net_batch_begin(NetClientState *nc)
+{
+    NetClientState *peer = nc->peer;
+
+    if (peer && peer->info->receive_flush) {
+        peer->receive_batch++;
+    }
+}
+
+void qemu_net_batch_end(NetClientState *nc)
+{
+    NetClientState *peer = nc->peer;
+
+    if (peer && peer->receive_batch && --peer->receive_batch == 0) {
+        peer->info->receive_flush(peer);
+    }
+}
+
 ssize_t qemu_sendv_packet_async(NetClientState *sender,
                                 const struct iovec *iov, int iovcnt,
                                 NetPacketSent *sent_cb)
@@ -952,6 +976,9 @@ static int (* const net_client_init_fun[NET_CLIENT_DRIVER__MAX])(
 #ifdef CONFIG_NETMAP
         [NET_CLIENT_DRIVER_NETMAP]    = net_init_netmap,
 #endif
+#ifdef CONFIG_AF_XDP
+        [NET_CLIENT_DRIVER_AF_XDP]    = net_init_af_xdp,
+#endif
 #ifdef CONFIG_NET_BRIDGE
         [NET_CLIENT_DRIVER_BRIDGE]    = net_init_bridge,
 #endif
@@ -1094,6 +1121,9 @@ static void show_netdevs(void)
 #ifdef CONFIG_NETMAP
         "netmap",
 #endif
+#ifdef CONFIG_AF_XDP
+        "af-xdp",
+#endif
 #ifdef CONFIG_POSIX
         "vhost-user",
 #endif
@@ -38,6 +38,15 @@
 #include "qemu/error-report.h"
 #include "qemu/sockets.h"
 #include <libslirp.h>
+
+/* slirp_new() and SlirpConfig came with libslirp 4.1 */
+#if defined(SLIRP_MAJOR_VERSION) && \
+    (SLIRP_MAJOR_VERSION > 4 || \
+     (SLIRP_MAJOR_VERSION == 4 && SLIRP_MINOR_VERSION >= 1))
+#define SLIRP_HAS_CONFIG 1
+#else
+#define SLIRP_HAS_CONFIG 0
+#endif
 #include "chardev/char-fe.h"
 #include "sysemu/sysemu.h"
 #include "qemu/cutils.h"
@@ -356,7 +365,7 @@ static int net_slirp_init(NetClientState *peer, const char *model,
                           const char *vnameserver, const char *vnameserver6,
                           const char *smb_export, const char *vsmbserver,
                           const char **dnssearch, const char *vdomainname,
-                          const char *tftp_server_name,
+                          const char *tftp_server_name, int64_t mtu,
                           Error **errp)
 {
     /* default settings according to historic slirp */
@@ -551,20 +560,68 @@ static int net_slirp_init(NetClientState *peer, const char *model,
         return -1;
     }
 
+    if (mtu && (mtu < 68 || mtu > 65521)) {
+        error_setg(errp, "'mtu' parameter must be between 68 and 65521");
+        return -1;
+    }
+#if !SLIRP_HAS_CONFIG
+    if (mtu) {
+        error_setg(errp, "'mtu' parameter needs libslirp 4.1 or newer");
+        return -1;
+    }
+#endif
+
     nc = qemu_new_net_client(&net_slirp_info, peer, model, name);
 
     snprintf(nc->info_str, sizeof(nc->info_str),
              "net=%s,restrict=%s", inet_ntoa(net),
              restricted ? "on" : "off");
+    if (mtu) {
+        size_t len = strlen(nc->info_str);
+
+        snprintf(nc->info_str + len, sizeof(nc->info_str) - len,
+                 ",mtu=%" PRId64, mtu);
+    }
 
     s = DO_UPCAST(SlirpState, nc, nc);
 
-    s->slirp = slirp_init(restricted, ipv4, net, mask, host,
-                          ipv6, ip6_prefix, vprefix6_len, ip6_host,
-                          vhostname, tftp_server_name,
-                          tftp_export, bootfile, dhcp,
-                          dns, ip6_dns, dnssearch, vdomainname,
-                          &slirp_cb, s);
+#if SLIRP_HAS_CONFIG
+    if (mtu) {
+        SlirpConfig cfg = {
+            .version = 1,
+            .restricted = restricted,
+            .in_enabled = ipv4,
+            .vnetwork = net,
+            .vnetmask = mask,
+            .vhost = host,
+            .in6_enabled = ipv6,
+            .vprefix_addr6 = ip6_prefix,
+            .vprefix_len = vprefix6_len,
+            .vhost6 = ip6_host,
+            .vhostname = vhostname,
+            .tftp_server_name = tftp_server_name,
+            .tftp_path = tftp_export,
+            .bootfile = bootfile,
+            .vdhcp_start = dhcp,
+            .vnameserver = dns,
+            .vnameserver6 = ip6_dns,
+            .vdnssearch = dnssearch,
+            .vdomainname = vdomainname,
+            .if_mtu = mtu,
+            .if_mru = mtu,
+        };
+
+        s->slirp = slirp_new(&cfg, &slirp_cb, s);
+    } else
+#endif
+    {
+        s->slirp = slirp_init(restricted, ipv4, net, mask, host,
+                              ipv6, ip6_prefix, vprefix6_len, ip6_host,
+                              vhostname, tftp_server_name,
+                              tftp_export, bootfile, dhcp,
+                              dns, ip6_dns, dnssearch, vdomainname,
+                              &slirp_cb, s);
+    }
     QTAILQ_INSERT_TAIL(&slirp_stacks, s, entry);
 
     /*
@@ -1100,7 +1157,8 @@ int net_init_slirp(const Netdev *netdev, const char *name,
                          user->bootfile, user->dhcpstart,
                          user->dns, user->ipv6_dns, user->smb,
                          user->smbserver, dnssearch, user->domainname,
-                         user->tftp_server_name, errp);
+                         user->tftp_server_name,
+                         user->has_mtu ? user->mtu : 0, errp);
 
     while (slirp_configs) {
         config = slirp_configs;
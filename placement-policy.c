@@ -0,0 +1,332 @@
+/*
+ * Host CPU placement policy for vCPU, I/O and worker threads
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Every thread class has a host CPU list and a host NUMA node.  The
+ * threads of a class run on the CPUs of the list that belong to the node;
+ * either may be left empty.  All properties can be changed at runtime
+ * with qom-set, and existing threads are moved right away.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "qemu/bitmap.h"
+#include "qemu/cutils.h"
+#include "qemu/module.h"
+#include "qemu/thread-placement.h"
+#include "qom/object_interfaces.h"
+
+#define TYPE_PLACEMENT_POLICY "placement-policy"
+#define PLACEMENT_POLICY(obj) \
+    OBJECT_CHECK(PlacementPolicy, (obj), TYPE_PLACEMENT_POLICY)
+
+typedef struct PlacementPolicyClassInfo {
+    char *cpus;
+    int64_t node;           /* -1 if unset */
+} PlacementPolicyClassInfo;
+
+typedef struct PlacementPolicy {
+    Object parent_obj;
+
+    PlacementPolicyClassInfo cls[THREAD_PLACEMENT__MAX];
+    /* Pin vCPU i to the i-th CPU of its set */
+    bool vcpu_pin;
+    bool complete;
+} PlacementPolicy;
+
+typedef struct PlacementPolicyProp {
+    const char *name;
+    ThreadPlacementClass cls;
+} PlacementPolicyProp;
+
+static const PlacementPolicyProp placement_policy_props[] = {
+    { "vcpu", THREAD_PLACEMENT_VCPU },
+    { "iothread", THREAD_PLACEMENT_IOTHREAD },
+    { "worker", THREAD_PLACEMENT_WORKER },
+};
+
+/* Only one policy may be in effect at a time */
+static PlacementPolicy *placement_policy_current;
+
+/* Parse a list such as "0-3,8,10-11" into @cpus */
+static bool placement_policy_parse_cpus(const char *str, unsigned long *cpus,
+                                        Error **errp)
+{
+    const char *p = str;
+    unsigned long first, last;
+
+    bitmap_zero(cpus, THREAD_PLACEMENT_MAX_CPUS);
+    while (*p && *p != '\n') {
+        if (qemu_strtoul(p, &p, 10, &first) < 0) {
+            goto fail;
+        }
+        last = first;
+        if (*p == '-' && qemu_strtoul(p + 1, &p, 10, &last) < 0) {
+            goto fail;
+        }
+        if (first > last || last >= THREAD_PLACEMENT_MAX_CPUS) {
+            goto fail;
+        }
+        bitmap_set(cpus, first, last - first + 1);
+        if (*p == ',') {
+            p++;
+        } else if (*p && *p != '\n') {
+            goto fail;
+        }
+    }
+    return true;
+
+fail:
+    error_setg(errp, "invalid host CPU list '%s'", str);
+    return false;
+}
+
+static bool placement_policy_node_cpus(int64_t node, unsigned long *cpus,
+                                       Error **errp)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *list = NULL;
+    GError *err = NULL;
+
+    path = g_strdup_printf("/sys/devices/system/node/node%" PRId64 "/cpulist",
+                           node);
+    if (!g_file_get_contents(path, &list, NULL, &err)) {
+        error_setg(errp, "cannot read the CPUs of host node %" PRId64 ": %s",
+                   node, err->message);
+        g_error_free(err);
+        return false;
+    }
+    return placement_policy_parse_cpus(list, cpus, errp);
+}
+
+static bool placement_policy_apply(PlacementPolicy *pp,
+                                   ThreadPlacementClass cls, Error **errp)
+{
+    PlacementPolicyClassInfo *info = &pp->cls[cls];
+    DECLARE_BITMAP(cpus, THREAD_PLACEMENT_MAX_CPUS);
+    DECLARE_BITMAP(node_cpus, THREAD_PLACEMENT_MAX_CPUS);
+
+    if (!info->cpus && info->node < 0) {
+        thread_placement_set_policy(cls, NULL, false);
+        return true;
+    }
+
+    bitmap_fill(cpus, THREAD_PLACEMENT_MAX_CPUS);
+    if (info->cpus &&
+        !placement_policy_parse_cpus(info->cpus, cpus, errp)) {
+        return false;
+    }
+    if (info->node >= 0) {
+        if (!placement_policy_node_cpus(info->node, node_cpus, errp)) {
+            return false;
+        }
+        bitmap_and(cpus, cpus, node_cpus, THREAD_PLACEMENT_MAX_CPUS);
+    }
+    if (bitmap_empty(cpus, THREAD_PLACEMENT_MAX_CPUS)) {
+        error_setg(errp, "no host CPU left for the threads");
+        return false;
+    }
+
+    thread_placement_set_policy(cls, cpus,
+                                cls == THREAD_PLACEMENT_VCPU && pp->vcpu_pin);
+    return true;
+}
+
+static void placement_policy_get_cpus(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    PlacementPolicy *pp = PLACEMENT_POLICY(obj);
+    const PlacementPolicyProp *prop = opaque;
+    char *value = g_strdup(pp->cls[prop->cls].cpus ?: "");
+
+    visit_type_str(v, name, &value, errp);
+    g_free(value);
+}
+
+static void placement_policy_set_cpus(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    PlacementPolicy *pp = PLACEMENT_POLICY(obj);
+    const PlacementPolicyProp *prop = opaque;
+    DECLARE_BITMAP(cpus, THREAD_PLACEMENT_MAX_CPUS);
+    Error *local_err = NULL;
+    char *value, *old;
+
+    visit_type_str(v, name, &value, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+    if (!placement_policy_parse_cpus(value, cpus, errp)) {
+        g_free(value);
+        return;
+    }
+    if (!*value) {
+        g_free(value);
+        value = NULL;
+    }
+
+    old = pp->cls[prop->cls].cpus;
+    pp->cls[prop->cls].cpus = value;
+    if (pp->complete && !placement_policy_apply(pp, prop->cls, errp)) {
+        pp->cls[prop->cls].cpus = old;
+        g_free(value);
+        return;
+    }
+    g_free(old);
+}
+
+static void placement_policy_get_node(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    PlacementPolicy *pp = PLACEMENT_POLICY(obj);
+    const PlacementPolicyProp *prop = opaque;
+
+    visit_type_int64(v, name, &pp->cls[prop->cls].node, errp);
+}
+
+static void placement_policy_set_node(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    PlacementPolicy *pp = PLACEMENT_POLICY(obj);
+    const PlacementPolicyProp *prop = opaque;
+    Error *local_err = NULL;
+    int64_t value, old;
+
+    visit_type_int64(v, name, &value, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+    if (value < -1) {
+        error_setg(errp, "%s must be a host node number, or -1 for any",
+                   name);
+        return;
+    }
+
+    old = pp->cls[prop->cls].node;
+    pp->cls[prop->cls].node = value;
+    if (pp->complete && !placement_policy_apply(pp, prop->cls, errp)) {
+        pp->cls[prop->cls].node = old;
+    }
+}
+
+static bool placement_policy_get_vcpu_pin(Object *obj, Error **errp)
+{
+    return PLACEMENT_POLICY(obj)->vcpu_pin;
+}
+
+static void placement_policy_set_vcpu_pin(Object *obj, bool value,
+                                          Error **errp)
+{
+    PlacementPolicy *pp = PLACEMENT_POLICY(obj);
+
+    pp->vcpu_pin = value;
+    if (pp->complete) {
+        placement_policy_apply(pp, THREAD_PLACEMENT_VCPU, errp);
+    }
+}
+
+static void placement_policy_complete(UserCreatable *uc, Error **errp)
+{
+    PlacementPolicy *pp = PLACEMENT_POLICY(uc);
+    int i;
+
+    if (placement_policy_current) {
+        error_setg(errp, "only one %s object is supported",
+                   TYPE_PLACEMENT_POLICY);
+        return;
+    }
+
+    for (i = 0; i < THREAD_PLACEMENT__MAX; i++) {
+        if (!placement_policy_apply(pp, i, errp)) {
+            while (i--) {
+                thread_placement_set_policy(i, NULL, false);
+            }
+            return;
+        }
+    }
+    pp->complete = true;
+    placement_policy_current = pp;
+}
+
+static void placement_policy_instance_init(Object *obj)
+{
+    PlacementPolicy *pp = PLACEMENT_POLICY(obj);
+    int i;
+
+    for (i = 0; i < THREAD_PLACEMENT__MAX; i++) {
+        pp->cls[i].node = -1;
+    }
+}
+
+static void placement_policy_instance_finalize(Object *obj)
+{
+    PlacementPolicy *pp = PLACEMENT_POLICY(obj);
+    int i;
+
+    for (i = 0; i < THREAD_PLACEMENT__MAX; i++) {
+        if (pp->complete) {
+            thread_placement_set_policy(i, NULL, false);
+        }
+        g_free(pp->cls[i].cpus);
+    }
+    if (placement_policy_current == pp) {
+        placement_policy_current = NULL;
+    }
+}
+
+static void placement_policy_class_init(ObjectClass *oc, void *data)
+{
+    UserCreatableClass *ucc = USER_CREATABLE_CLASS(oc);
+    int i;
+
+    ucc->complete = placement_policy_complete;
+
+    for (i = 0; i < ARRAY_SIZE(placement_policy_props); i++) {
+        const PlacementPolicyProp *prop = &placement_policy_props[i];
+        g_autofree char *cpus = g_strdup_printf("%s-cpus", prop->name);
+        g_autofree char *node = g_strdup_printf("%s-node", prop->name);
+
+        object_class_property_add(oc, cpus, "str",
+                                  placement_policy_get_cpus,
+                                  placement_policy_set_cpus,
+                                  NULL, (void *)prop);
+        object_class_property_add(oc, node, "int",
+                                  placement_policy_get_node,
+                                  placement_policy_set_node,
+                                  NULL, (void *)prop);
+    }
+    object_class_property_add_bool(oc, "vcpu-pin",
+                                   placement_policy_get_vcpu_pin,
+                                   placement_policy_set_vcpu_pin);
+}
+
+static const TypeInfo placement_policy_info = {
+    .name = TYPE_PLACEMENT_POLICY,
+    .parent = TYPE_OBJECT,
+    .class_init = placement_policy_class_init,
+    .instance_size = sizeof(PlacementPolicy),
+    .instance_init = placement_policy_instance_init,
+    .instance_finalize = placement_policy_instance_finalize,
+    .interfaces = (InterfaceInfo[]) {
+        { TYPE_USER_CREATABLE },
+        { }
+    },
+};
+
+static void placement_policy_register_types(void)
+{
+    type_register_static(&placement_policy_info);
+}
+
+type_init(placement_policy_register_types)
@@ -45,6 +45,7 @@
 #ifndef CONFIG_USER_ONLY
 #include "qemu/plugin-memory.h"
 #include "hw/boards.h"
+#include "exec/gdbstub.h"
 #endif
 #include "trace/mem.h"
 
@@ -333,6 +334,41 @@ int qemu_plugin_n_max_vcpus(void)
 #endif
 }
 
+/*
+ * vCPU state access
+ *
+ * These read the state of the vCPU the calling callback runs on, so
+ * they are only valid from vCPU callbacks.
+ */
+
+int qemu_plugin_read_register(int reg, void *buf, size_t len)
+{
+    GByteArray *val;
+    int size;
+
+    g_assert(current_cpu);
+    val = g_byte_array_new();
+    size = gdb_read_register(current_cpu, val, reg);
+    memcpy(buf, val->data, MIN(len, size));
+    g_byte_array_unref(val);
+    return size;
+}
+
+bool qemu_plugin_read_memory_vaddr(uint64_t addr, void *buf, size_t len)
+{
+    g_assert(current_cpu);
+    return cpu_memory_rw_debug(current_cpu, addr, buf, len, false) == 0;
+}
+
+void qemu_plugin_register_vcpu_sample_cb(qemu_plugin_id_t id,
+                                         uint64_t period_ns,
+                                         qemu_plugin_vcpu_simple_cb_t cb)
+{
+#ifdef CONFIG_SOFTMMU
+    plugin_register_sample_cb(id, period_ns, cb);
+#endif
+}
+
 /*
  * Plugin output
  */
@@ -248,6 +248,89 @@ void qemu_plugin_vcpu_for_each(qemu_plugin_id_t id,
     qemu_rec_mutex_unlock(&plugin.lock);
 }
 
+/*
+ * vCPU sampling. The timer fires in the main loop; the callback itself
+ * runs as queued work on each vCPU, between TBs, so the CPU state it
+ * sees is consistent. The ctx may be gone by the time either runs,
+ * hence the lookups.
+ */
+static bool plugin_ctx_alive__locked(struct qemu_plugin_ctx *ctx)
+{
+    struct qemu_plugin_ctx *c;
+
+    QTAILQ_FOREACH(c, &plugin.ctxs, entry) {
+        if (c == ctx) {
+            return !ctx->uninstalling && !ctx->resetting;
+        }
+    }
+    return false;
+}
+
+static void plugin_sample_vcpu(CPUState *cpu, run_on_cpu_data arg)
+{
+    struct qemu_plugin_ctx *ctx = arg.host_ptr;
+    qemu_plugin_vcpu_simple_cb_t cb = NULL;
+    qemu_plugin_id_t id = 0;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    if (plugin_ctx_alive__locked(ctx)) {
+        cb = ctx->sample_cb;
+        id = ctx->id;
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    if (cb) {
+        cb(id, cpu->cpu_index);
+    }
+}
+
+static void plugin_sample_timer_cb(void *opaque)
+{
+    struct qemu_plugin_ctx *ctx = opaque;
+    CPUState *cpu;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    if (plugin_ctx_alive__locked(ctx) && ctx->sample_cb) {
+        CPU_FOREACH(cpu) {
+            async_run_on_cpu(cpu, plugin_sample_vcpu, RUN_ON_CPU_HOST_PTR(ctx));
+        }
+        timer_mod(ctx->sample_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + ctx->sample_period);
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+}
+
+void plugin_register_sample_cb(qemu_plugin_id_t id, uint64_t period_ns,
+                               qemu_plugin_vcpu_simple_cb_t cb)
+{
+    struct qemu_plugin_ctx *ctx;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    ctx = plugin_id_to_ctx_locked(id);
+    if (!ctx->sample_timer) {
+        ctx->sample_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                         plugin_sample_timer_cb, ctx);
+    }
+    ctx->sample_cb = period_ns ? cb : NULL;
+    ctx->sample_period = period_ns;
+    if (ctx->sample_cb) {
+        timer_mod(ctx->sample_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + period_ns);
+    } else {
+        timer_del(ctx->sample_timer);
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+}
+
+void plugin_sample_cleanup__locked(struct qemu_plugin_ctx *ctx)
+{
+    if (ctx->sample_timer) {
+        timer_free(ctx->sample_timer);
+        ctx->sample_timer = NULL;
+    }
+    ctx->sample_cb = NULL;
+}
+
 /* Allocate and return a callback record */
 static struct qemu_plugin_dyn_cb *plugin_get_dyn_cb(GArray **arr)
 {
@@ -424,6 +507,9 @@ void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
     case QEMU_PLUGIN_INLINE_ADD_U64:
         *val += cb->inline_insn.imm;
         break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        *val = cb->inline_insn.imm;
+        break;
     default:
         g_assert_not_reached();
     }
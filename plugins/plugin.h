@@ -13,6 +13,7 @@
 #define _PLUGIN_INTERNAL_H_
 
 #include <gmodule.h>
+#include "qemu/timer.h"
 
 #define QEMU_PLUGIN_MIN_VERSION 0
 
@@ -59,6 +60,10 @@ struct qemu_plugin_ctx {
     bool installing;
     bool uninstalling;
     bool resetting;
+    /* periodic vCPU sampling, see qemu_plugin_register_vcpu_sample_cb() */
+    QEMUTimer *sample_timer;
+    int64_t sample_period;
+    qemu_plugin_vcpu_simple_cb_t sample_cb;
 };
 
 struct qemu_plugin_ctx *plugin_id_to_ctx_locked(qemu_plugin_id_t id);
@@ -96,4 +101,9 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
 
 void exec_inline_op(struct qemu_plugin_dyn_cb *cb);
 
+void plugin_register_sample_cb(qemu_plugin_id_t id, uint64_t period_ns,
+                               qemu_plugin_vcpu_simple_cb_t cb);
+
+void plugin_sample_cleanup__locked(struct qemu_plugin_ctx *ctx);
+
 #endif /* _PLUGIN_INTERNAL_H_ */
@@ -24,6 +24,7 @@
 
 #include "qemu/osdep.h"
 #include <getopt.h>
+#include <math.h>
 
 #include "qemu-common.h"
 #include "qemu-version.h"
@@ -33,14 +34,17 @@
 #include "qapi/qobject-output-visitor.h"
 #include "qapi/qmp/qjson.h"
 #include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qnum.h"
 #include "qapi/qmp/qstring.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "qemu/config-file.h"
 #include "qemu/option.h"
 #include "qemu/error-report.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/timer.h"
 #include "qemu/units.h"
 #include "qom/object_interfaces.h"
 #include "sysemu/block-backend.h"
@@ -79,6 +83,8 @@ enum {
     OPTION_DISABLE = 273,
     OPTION_MERGE = 274,
     OPTION_BITMAPS = 275,
+    OPTION_ACCESS = 276,
+    OPTION_WRITE_PERCENT = 277,
 };
 
 typedef enum OutputFormat {
@@ -4252,10 +4258,50 @@ out_no_progress:
     return 0;
 }
 
-typedef struct BenchData {
+typedef enum BenchAccess {
+    BENCH_ACCESS_SEQUENTIAL,
+    BENCH_ACCESS_RANDOM,
+    BENCH_ACCESS_ZIPF,
+} BenchAccess;
+
+static const char *const bench_access_names[] = {
+    [BENCH_ACCESS_SEQUENTIAL] = "sequential",
+    [BENCH_ACCESS_RANDOM] = "random",
+    [BENCH_ACCESS_ZIPF] = "zipf",
+};
+
+/* Skew of --access=zipf, the YCSB default */
+#define BENCH_ZIPF_THETA 0.99
+
+/*
+ * Latencies are kept in a log-linear histogram: every power of two is split
+ * into 2^BENCH_HIST_SUB_BITS buckets, which keeps percentiles within ~3%.
+ */
+#define BENCH_HIST_SUB_BITS 5
+#define BENCH_HIST_BUCKETS (64 << BENCH_HIST_SUB_BITS)
+
+typedef struct BenchStats {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t hist[BENCH_HIST_BUCKETS];
+} BenchStats;
+
+typedef struct BenchData BenchData;
+
+typedef struct BenchReq {
+    BenchData *b;
+    QEMUIOVector *qiov;
+    int64_t start_ns;
+    bool write;
+    int next_free;
+} BenchReq;
+
+struct BenchData {
     BlockBackend *blk;
     uint64_t image_size;
-    bool write;
+    int write_percent;
     int bufsize;
     int step;
     int nrreq;
@@ -4265,10 +4311,153 @@ typedef struct BenchData {
     uint8_t *buf;
     QEMUIOVector *qiov;
 
+    BenchAccess access;
+    /* Random and zipf requests are bufsize blocks from start_offset on */
+    uint64_t start_offset;
+    uint64_t nb_blocks;
+    double zipf_zetan;
+    double zipf_alpha;
+    double zipf_eta;
+
+    BenchReq *reqs;
+    int free_req;
+    BenchStats stats[2]; /* [0]: reads, [1]: writes */
+
     int in_flight;
     bool in_flush;
     uint64_t offset;
-} BenchData;
+};
+
+static int bench_hist_index(uint64_t ns)
+{
+    int e;
+
+    if (ns < (1 << BENCH_HIST_SUB_BITS)) {
+        return ns;
+    }
+    e = 63 - clz64(ns);
+    return ((e - BENCH_HIST_SUB_BITS + 1) << BENCH_HIST_SUB_BITS) +
+           ((ns >> (e - BENCH_HIST_SUB_BITS)) &
+            ((1 << BENCH_HIST_SUB_BITS) - 1));
+}
+
+/* Smallest latency that falls into bucket @idx */
+static uint64_t bench_hist_value(int idx)
+{
+    int e, m;
+
+    if (idx < (1 << BENCH_HIST_SUB_BITS)) {
+        return idx;
+    }
+    e = (idx >> BENCH_HIST_SUB_BITS) + BENCH_HIST_SUB_BITS - 1;
+    m = idx & ((1 << BENCH_HIST_SUB_BITS) - 1);
+    return (uint64_t)((1 << BENCH_HIST_SUB_BITS) + m) <<
+           (e - BENCH_HIST_SUB_BITS);
+}
+
+static void bench_stats_add(BenchStats *st, uint64_t ns)
+{
+    if (!st->count || ns < st->min_ns) {
+        st->min_ns = ns;
+    }
+    if (ns > st->max_ns) {
+        st->max_ns = ns;
+    }
+    st->count++;
+    st->total_ns += ns;
+    st->hist[bench_hist_index(ns)]++;
+}
+
+static uint64_t bench_stats_percentile(BenchStats *st, double pct)
+{
+    uint64_t target = MAX(1, (uint64_t)ceil(st->count * pct / 100));
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < BENCH_HIST_BUCKETS; i++) {
+        seen += st->hist[i];
+        if (seen >= target) {
+            return MIN(MAX(bench_hist_value(i), st->min_ns), st->max_ns);
+        }
+    }
+    return st->max_ns;
+}
+
+/* Generalized harmonic number H(n, theta), approximated for large n */
+static double bench_zeta(uint64_t n, double theta)
+{
+    const uint64_t exact = 1000000;
+    double sum = 0;
+    uint64_t i;
+
+    for (i = 1; i <= MIN(n, exact); i++) {
+        sum += pow(i, -theta);
+    }
+    if (n > exact) {
+        sum += (pow(n + 0.5, 1 - theta) - pow(exact + 0.5, 1 - theta)) /
+               (1 - theta);
+    }
+    return sum;
+}
+
+static void bench_zipf_init(BenchData *b)
+{
+    double theta = BENCH_ZIPF_THETA;
+
+    b->zipf_zetan = bench_zeta(b->nb_blocks, theta);
+    b->zipf_alpha = 1 / (1 - theta);
+    b->zipf_eta = (1 - pow(2.0 / b->nb_blocks, 1 - theta)) /
+                  (1 - bench_zeta(2, theta) / b->zipf_zetan);
+}
+
+/*
+ * Gray et al., "Quickly Generating Billion-Record Synthetic Databases".
+ * Block 0 is the most popular one.
+ */
+static uint64_t bench_zipf_next(BenchData *b)
+{
+    double u = g_random_double();
+    double uz = u * b->zipf_zetan;
+
+    if (uz < 1) {
+        return 0;
+    }
+    if (uz < 1 + pow(0.5, BENCH_ZIPF_THETA)) {
+        return 1;
+    }
+    return MIN(b->nb_blocks - 1,
+               (uint64_t)(b->nb_blocks *
+                          pow(b->zipf_eta * u - b->zipf_eta + 1,
+                              b->zipf_alpha)));
+}
+
+static uint64_t bench_next_offset(BenchData *b)
+{
+    uint64_t offset = b->offset;
+
+    switch (b->access) {
+    case BENCH_ACCESS_SEQUENTIAL:
+        b->offset += b->step;
+        b->offset %= b->image_size;
+        return offset;
+    case BENCH_ACCESS_RANDOM:
+        return b->start_offset + MIN(b->nb_blocks - 1,
+                                     (uint64_t)(g_random_double() *
+                                                b->nb_blocks)) * b->bufsize;
+    case BENCH_ACCESS_ZIPF:
+        return b->start_offset + bench_zipf_next(b) * b->bufsize;
+    default:
+        abort();
+    }
+}
+
+static bool bench_next_is_write(BenchData *b)
+{
+    if (b->write_percent == 0 || b->write_percent == 100) {
+        return b->write_percent;
+    }
+    return g_random_int_range(0, 100) < b->write_percent;
+}
 
 static void bench_undrained_flush_cb(void *opaque, int ret)
 {
@@ -4278,6 +4467,8 @@ static void bench_undrained_flush_cb(void *opaque, int ret)
     }
 }
 
+static void bench_req_cb(void *opaque, int ret);
+
 static void bench_cb(void *opaque, int ret)
 {
     BenchData *b = opaque;
@@ -4323,18 +4514,26 @@ static void bench_cb(void *opaque, int ret)
     }
 
     while (b->n > b->in_flight && b->in_flight < b->nrreq) {
-        int64_t offset = b->offset;
+        int64_t offset = bench_next_offset(b);
+        BenchReq *req;
+
         /* blk_aio_* might look for completed I/Os and kick bench_cb
          * again, so make sure this operation is counted by in_flight
          * and b->offset is ready for the next submission.
          */
+        assert(b->free_req >= 0);
+        req = &b->reqs[b->free_req];
+        b->free_req = req->next_free;
+        req->write = bench_next_is_write(b);
+        req->start_ns = get_clock();
+
         b->in_flight++;
-        b->offset += b->step;
-        b->offset %= b->image_size;
-        if (b->write) {
-            acb = blk_aio_pwritev(b->blk, offset, b->qiov, 0, bench_cb, b);
+        if (req->write) {
+            acb = blk_aio_pwritev(b->blk, offset, req->qiov, 0, bench_req_cb,
+                                  req);
         } else {
-            acb = blk_aio_preadv(b->blk, offset, b->qiov, 0, bench_cb, b);
+            acb = blk_aio_preadv(b->blk, offset, req->qiov, 0, bench_req_cb,
+                                 req);
         }
         if (!acb) {
             error_report("Failed to issue request");
@@ -4343,13 +4542,99 @@ static void bench_cb(void *opaque, int ret)
     }
 }
 
+static void bench_req_cb(void *opaque, int ret)
+{
+    BenchReq *req = opaque;
+    BenchData *b = req->b;
+
+    bench_stats_add(&b->stats[req->write], get_clock() - req->start_ns);
+    req->next_free = b->free_req;
+    b->free_req = req - b->reqs;
+
+    bench_cb(b, ret);
+}
+
+static const double bench_percentiles[] = { 50, 90, 99, 99.9 };
+
+static void bench_dump_human(BenchData *b, double seconds)
+{
+    int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(b->stats); i++) {
+        BenchStats *st = &b->stats[i];
+
+        if (!st->count) {
+            continue;
+        }
+        printf("%s: %" PRIu64 " requests, %.0f IOPS, %.2f MiB/s\n"
+               "  latency (us): min %.1f, mean %.1f",
+               i ? "write" : "read", st->count, st->count / seconds,
+               st->count * b->bufsize / seconds / MiB,
+               st->min_ns / 1000.0, st->total_ns / 1000.0 / st->count);
+        for (j = 0; j < ARRAY_SIZE(bench_percentiles); j++) {
+            printf(", p%g %.1f", bench_percentiles[j],
+                   bench_stats_percentile(st, bench_percentiles[j]) / 1000.0);
+        }
+        printf(", max %.1f\n", st->max_ns / 1000.0);
+    }
+}
+
+static void bench_dump_json(BenchData *b, double seconds)
+{
+    QDict *dict = qdict_new();
+    QString *str;
+    int i, j;
+
+    qdict_put_int(dict, "request-size", b->bufsize);
+    qdict_put_int(dict, "depth", b->nrreq);
+    qdict_put_str(dict, "access", bench_access_names[b->access]);
+    qdict_put_int(dict, "write-percent", b->write_percent);
+    qdict_put(dict, "seconds", qnum_from_double(seconds));
+
+    for (i = 0; i < ARRAY_SIZE(b->stats); i++) {
+        BenchStats *st = &b->stats[i];
+        QDict *d, *lat;
+
+        if (!st->count) {
+            continue;
+        }
+
+        lat = qdict_new();
+        qdict_put_int(lat, "min", st->min_ns);
+        qdict_put_int(lat, "mean", st->total_ns / st->count);
+        for (j = 0; j < ARRAY_SIZE(bench_percentiles); j++) {
+            char *name = g_strdup_printf("p%g", bench_percentiles[j]);
+
+            qdict_put_int(lat, name,
+                          bench_stats_percentile(st, bench_percentiles[j]));
+            g_free(name);
+        }
+        qdict_put_int(lat, "max", st->max_ns);
+
+        d = qdict_new();
+        qdict_put_int(d, "requests", st->count);
+        qdict_put(d, "iops", qnum_from_double(st->count / seconds));
+        qdict_put(d, "bytes-per-second",
+                  qnum_from_double(st->count * b->bufsize / seconds));
+        qdict_put(d, "latency-ns", lat);
+        qdict_put(dict, i ? "write" : "read", d);
+    }
+
+    str = qobject_to_json_pretty(QOBJECT(dict));
+    printf("%s\n", qstring_get_str(str));
+    qobject_unref(str);
+    qobject_unref(dict);
+}
+
 static int img_bench(int argc, char **argv)
 {
     int c, ret = 0;
     const char *fmt = NULL, *filename;
     bool quiet = false;
     bool image_opts = false;
-    bool is_write = false;
+    int write_percent = -1;
+    BenchAccess access = BENCH_ACCESS_SEQUENTIAL;
+    OutputFormat output_format = OFORMAT_HUMAN;
     int count = 75000;
     int depth = 64;
     int64_t offset = 0;
@@ -4364,6 +4649,7 @@ static int img_bench(int argc, char **argv)
     int flags = 0;
     bool writethrough = false;
     struct timeval t1, t2;
+    double seconds;
     int i;
     bool force_share = false;
     size_t buf_size;
@@ -4376,6 +4662,9 @@ static int img_bench(int argc, char **argv)
             {"pattern", required_argument, 0, OPTION_PATTERN},
             {"no-drain", no_argument, 0, OPTION_NO_DRAIN},
             {"force-share", no_argument, 0, 'U'},
+            {"access", required_argument, 0, OPTION_ACCESS},
+            {"write-percent", required_argument, 0, OPTION_WRITE_PERCENT},
+            {"output", required_argument, 0, OPTION_OUTPUT},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hc:d:f:ni:o:qs:S:t:wU", long_options,
@@ -4475,12 +4764,45 @@ static int img_bench(int argc, char **argv)
             }
             break;
         case 'w':
-            flags |= BDRV_O_RDWR;
-            is_write = true;
+            write_percent = 100;
             break;
         case 'U':
             force_share = true;
             break;
+        case OPTION_ACCESS:
+            for (i = 0; i < ARRAY_SIZE(bench_access_names); i++) {
+                if (!strcmp(optarg, bench_access_names[i])) {
+                    break;
+                }
+            }
+            if (i == ARRAY_SIZE(bench_access_names)) {
+                error_report("--access must be sequential, random or zipf");
+                return 1;
+            }
+            access = i;
+            break;
+        case OPTION_WRITE_PERCENT:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > 100) {
+                error_report("Invalid write percentage specified");
+                return 1;
+            }
+            write_percent = res;
+            break;
+        }
+        case OPTION_OUTPUT:
+            if (!strcmp(optarg, "json")) {
+                output_format = OFORMAT_JSON;
+            } else if (!strcmp(optarg, "human")) {
+                output_format = OFORMAT_HUMAN;
+            } else {
+                error_report("--output must be used with human or json "
+                             "as argument.");
+                return 1;
+            }
+            break;
         case OPTION_PATTERN:
         {
             unsigned long res;
@@ -4517,7 +4839,13 @@ static int img_bench(int argc, char **argv)
     }
     filename = argv[argc - 1];
 
-    if (!is_write && flush_interval) {
+    if (write_percent < 0) {
+        write_percent = 0;
+    } else if (write_percent > 0) {
+        flags |= BDRV_O_RDWR;
+    }
+
+    if (!write_percent && flush_interval) {
         error_report("--flush-interval is only available in write tests");
         ret = -1;
         goto out;
@@ -4549,16 +4877,49 @@ static int img_bench(int argc, char **argv)
         .nrreq          = depth,
         .n              = count,
         .offset         = offset,
-        .write          = is_write,
+        .write_percent  = write_percent,
         .flush_interval = flush_interval,
         .drain_on_flush = drain_on_flush,
+        .access         = access,
+        .start_offset   = offset,
     };
-    printf("Sending %d %s requests, %d bytes each, %d in parallel "
-           "(starting at offset %" PRId64 ", step size %d)\n",
-           data.n, data.write ? "write" : "read", data.bufsize, data.nrreq,
-           data.offset, data.step);
-    if (flush_interval) {
-        printf("Sending flush every %d requests\n", flush_interval);
+
+    if (access != BENCH_ACCESS_SEQUENTIAL) {
+        if (!data.bufsize || offset >= image_size ||
+            (image_size - offset) / data.bufsize == 0) {
+            error_report("Image too small for %s requests of %d bytes "
+                         "from offset %" PRId64, bench_access_names[access],
+                         data.bufsize, offset);
+            ret = -1;
+            goto out;
+        }
+        data.nb_blocks = (image_size - offset) / data.bufsize;
+        if (access == BENCH_ACCESS_ZIPF) {
+            bench_zipf_init(&data);
+        }
+    }
+
+    if (output_format == OFORMAT_HUMAN) {
+        if (write_percent == 0 || write_percent == 100) {
+            printf("Sending %d %s requests", data.n,
+                   write_percent ? "write" : "read");
+        } else {
+            printf("Sending %d requests (%d%% writes)", data.n,
+                   write_percent);
+        }
+        if (access == BENCH_ACCESS_SEQUENTIAL) {
+            printf(", %d bytes each, %d in parallel "
+                   "(starting at offset %" PRId64 ", step size %d)\n",
+                   data.bufsize, data.nrreq, data.offset, data.step);
+        } else {
+            printf(", %d bytes each, %d in parallel "
+                   "(%s access from offset %" PRId64 ")\n",
+                   data.bufsize, data.nrreq, bench_access_names[access],
+                   data.offset);
+        }
+        if (flush_interval) {
+            printf("Sending flush every %d requests\n", flush_interval);
+        }
     }
 
     buf_size = data.nrreq * data.bufsize;
@@ -4574,6 +4935,14 @@ static int img_bench(int argc, char **argv)
                        data.buf + i * data.bufsize, data.bufsize);
     }
 
+    data.reqs = g_new0(BenchReq, data.nrreq);
+    for (i = 0; i < data.nrreq; i++) {
+        data.reqs[i].b = &data;
+        data.reqs[i].qiov = &data.qiov[i];
+        data.reqs[i].next_free = i + 1 < data.nrreq ? i + 1 : -1;
+    }
+    data.free_req = data.nrreq ? 0 : -1;
+
     gettimeofday(&t1, NULL);
     bench_cb(&data, 0);
 
@@ -4582,15 +4951,21 @@ static int img_bench(int argc, char **argv)
     }
     gettimeofday(&t2, NULL);
 
-    printf("Run completed in %3.3f seconds.\n",
-           (t2.tv_sec - t1.tv_sec)
-           + ((double)(t2.tv_usec - t1.tv_usec) / 1000000));
+    seconds = (t2.tv_sec - t1.tv_sec)
+              + ((double)(t2.tv_usec - t1.tv_usec) / 1000000);
+    if (output_format == OFORMAT_JSON) {
+        bench_dump_json(&data, seconds);
+    } else {
+        printf("Run completed in %3.3f seconds.\n", seconds);
+        bench_dump_human(&data, seconds);
+    }
 
 out:
     if (data.buf) {
         blk_unregister_buf(blk, data.buf);
     }
     qemu_vfree(data.buf);
+    g_free(data.reqs);
     blk_unref(blk);
 
     if (ret) {
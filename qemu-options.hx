@@ -36,7 +36,8 @@ DEF("machine", HAS_ARG, QEMU_OPTION_machine, \
     "                nvdimm=on|off controls NVDIMM support (default=off)\n"
     "                enforce-config-section=on|off enforce configuration section migration (default=off)\n"
     "                memory-encryption=@var{} memory encryption object to use (default=none)\n"
-    "                hmat=on|off controls ACPI HMAT support (default=off)\n",
+    "                hmat=on|off controls ACPI HMAT support (default=off)\n"
+    "                target-page-size=size TCG page size for guests that never map smaller pages\n",
     QEMU_ARCH_ALL)
 SRST
 ``-machine [type=]name[,prop=value[,...]]``
@@ -104,6 +105,20 @@ SRST
     ``hmat=on|off``
         Enables or disables ACPI Heterogeneous Memory Attribute Table
         (HMAT) support. The default is off.
+
+    ``target-page-size=size``
+        Sets the page size of the TCG softmmu TLB and of dirty memory
+        tracking, for targets whose page size can vary (such as ARM).
+        Normally this is the smallest page any CPU of the machine can
+        map.  A larger size, for example 64K for AArch64 guests that
+        use the 64K translation granule, gives the TLB more reach.
+
+        The guest must then not map memory in smaller units: such
+        mappings still work, as the MMU lookup is repeated on every
+        access to them, but they are slow, and an access that crosses
+        one of their boundaries within a target page is not split.
+        Sizes up to 64K are supported, with TCG only, and both
+        sides of a migration must use the same size.
 ERST
 
 HXCOMM Deprecated by -machine
@@ -123,8 +138,11 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                igd-passthru=on|off (enable Xen integrated Intel graphics passthrough, default=off)\n"
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
+    "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
+    "                halt-poll-max-ns=n (KVM userspace halt polling limit, default 0)\n"
     "                tb-size=n (TCG translation block cache size)\n"
-    "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
+    "                thread=single|multi (enable multi-threaded TCG)\n"
+    "                mmio-poll-sleep=on|off (sleep vCPUs spinning on MMIO, default=off)\n", QEMU_ARCH_ALL)
 SRST
 ``-accel name[,prop=value[,...]]``
     This is used to enable an accelerator. Depending on the target
@@ -148,6 +166,25 @@ SRST
     ``kvm-shadow-mem=size``
         Defines the size of the KVM shadow MMU.
 
+    ``dirty-ring-size=n``
+        When the KVM accelerator is used, it controls the size of the per-vCPU
+        dirty page ring buffer (number of entries for each vCPU). It should
+        be a value that is power of two, and it should be 1024 or bigger (but
+        still less than the maximum value that the kernel supports).  4096
+        could be a good initial value if you have no idea which is the best.
+        Set this value to 0 to disable the feature.  By default, this feature
+        is disabled (dirty-ring-size=0), and KVM records dirty pages in a
+        bitmap instead.
+
+    ``halt-poll-max-ns=n``
+        When the KVM accelerator is used and vCPU halts are handled by
+        QEMU rather than by the kernel (e.g. kernel-irqchip=off on x86),
+        a halted vCPU spins for an adaptive window of at most n
+        nanoseconds before going to sleep. This cuts the wakeup latency
+        of guests that halt frequently for short periods, at the cost of
+        host CPU time. The window of each vCPU is reported by
+        ``query-cpus-fast``. By default (0), halts are not polled.
+
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
@@ -158,6 +195,15 @@ SRST
         where both the back-end and front-ends support it and no
         incompatible TCG features have been enabled (e.g.
         icount/replay).
+
+    ``mmio-poll-sleep=on|off``
+        When a vCPU reads the same value from the same MMIO register
+        many times in a row from the same instruction, e.g. while it
+        waits for a PLL to lock, put it to sleep until the next virtual
+        clock deadline, for at most 1 ms. An interrupt wakes it earlier.
+        With icount and ``sleep=off`` the virtual clock then warps to
+        the deadline. This frees host CPU time and shortens boots that
+        poll status bits. Ignored with record/replay (default=off).
 ERST
 
 DEF("smp", HAS_ARG, QEMU_OPTION_smp,
@@ -511,6 +557,36 @@ SRST
     translation   Trace TB translation with TB contents. (for off-line disassembly)
     mem           Trace memory accesses (Only MMIO at the moment).
     cpu           Trace CPU register state (slow, currently not binary).
+    range=S..E    Only trace exec for code in [S, E]. S+SIZE is also
+                  accepted. May be repeated.
+    unit=N        Only trace CPU/unit N. May be repeated.
+    sample-tbs=N  Trace one in every N executed TBs.
+    sample-ns=NS  Trace one TB every NS of virtual time.
+    buffer=SIZE   Per-thread trace buffer drained by a writer thread
+                  (default 4M). 0 writes records synchronously.
+    compress=ALG  Write the trace as indexed compressed blocks, ALG is
+                  none, zlib or zstd (if built with zstd support).
+ERST
+
+DEF("boot-profile", HAS_ARG, QEMU_OPTION_boot_profile,
+    "-boot-profile FILE  write boot phase timings to FILE\n", QEMU_ARCH_ALL)
+SRST
+``-boot-profile file``
+    Record how long each phase of the boot takes and write it to
+    @var{file} in the Chrome trace-event JSON format, which can be
+    loaded in chrome://tracing or https://ui.perfetto.dev.
+
+    The trace has spans for option parsing, machine creation (with
+    one span per device tree node on FDT-generic machines), every
+    device realize and reset, ROM loading and the initial system
+    reset, plus a mark when each CPU executes its first instruction.
+    Guest firmware can add its own marks through a
+    ``boot-profile-marker`` device; a 32-bit write of N to offset 0
+    records ``fw N``, and bytes written to offset 4 are collected
+    into a name that is recorded when a NUL byte is written.
+
+    Marks are flushed to @var{file} immediately, the file is
+    completed when QEMU exits.
 ERST
 
 DEF("mem-path", HAS_ARG, QEMU_OPTION_mempath,
@@ -1765,6 +1841,9 @@ DEF("display", HAS_ARG, QEMU_OPTION_display,
 #endif
 #if defined(CONFIG_OPENGL)
     "-display egl-headless[,rendernode=<file>]\n"
+#endif
+#if defined(CONFIG_POSIX)
+    "-display stream,cmd=<command>[,fps=<n>]\n"
 #endif
     "-display none\n"
     "                select display backend type\n"
@@ -1827,6 +1906,30 @@ SRST
         Start QEMU as a Spice server and launch the default Spice client
         application. The Spice server will redirect the serial consoles
         and QEMU monitors. (Since 4.0)
+
+    ``stream``
+        Write the video output of the first graphical console, as raw
+        frames, to the standard input of the shell command given by
+        ``cmd``. The command is expected to encode and transmit the
+        frames, for example with a hardware H.264 or HEVC encoder and
+        an RTP or WebRTC transport. Frames are only sent when the guest
+        updated the screen, at most ``fps`` times per second (default
+        30); when the command does not keep up, updates are merged into
+        the next frame instead of delaying the guest. The size and
+        layout of the frames are passed in the ``QEMU_STREAM_WIDTH``,
+        ``QEMU_STREAM_HEIGHT``, ``QEMU_STREAM_STRIDE`` and
+        ``QEMU_STREAM_FORMAT`` (always ``BGRx``) environment variables,
+        and the command is restarted when the resolution changes.
+        Commas in ``cmd`` must be doubled. For example, to stream H.264
+        over RTP with VA-API:
+
+        .. parsed-literal::
+
+            |qemu_system| -display stream,fps=60,cmd='gst-launch-1.0 \
+                fdsrc ! rawvideoparse format=bgrx \
+                width=$QEMU_STREAM_WIDTH height=$QEMU_STREAM_HEIGHT \
+                framerate=60/1 ! videoconvert ! vaapih264enc ! \
+                rtph264pay ! udpsink host=192.168.0.2 port=5000'
 ERST
 
 DEF("nographic", 0, QEMU_OPTION_nographic,
@@ -2226,6 +2329,12 @@ SRST
         bandwidth when playing videos. Disabling adaptive encodings
         restores the original static behavior of encodings like Tight.
 
+    ``workers=n``
+        Encode framebuffer updates with at least n threads (1 by
+        default). The threads are shared by all VNC displays of the
+        process. Each client is encoded by one thread at a time, so
+        this helps when several clients or displays are busy at once.
+
     ``share=[allow-exclusive|force-shared|ignore]``
         Set display sharing policy. 'allow-exclusive' allows clients to
         ask for exclusive access. As suggested by the rfb spec this is
@@ -2366,8 +2475,9 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "         [,dns=addr][,ipv6-dns=addr][,dnssearch=domain][,domainname=domain]\n"
     "         [,tftp=dir][,tftp-server-name=name][,bootfile=f][,hostfwd=rule][,guestfwd=rule]"
 #ifndef _WIN32
-                                             "[,smb=dir[,smbserver=addr]]\n"
+                                             "[,smb=dir[,smbserver=addr]]"
 #endif
+    "\n         [,mtu=n]\n"
     "                configure a user mode network backend with ID 'str',\n"
     "                its DHCP server and optional services\n"
 #endif
@@ -2455,6 +2565,12 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                VALE port (created on the fly) called 'name' ('nmname' is name of the \n"
     "                netmap device, defaults to '/dev/netmap')\n"
 #endif
+#ifdef CONFIG_AF_XDP
+    "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
+    "         [,queues=n][,start-queue=m]\n"
+    "                attach to the existing network interface 'name' with AF_XDP socket(s),\n"
+    "                using 'n' queues of the interface starting from queue 'm'\n"
+#endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
     "                configure a vhost-user network, backed by a chardev 'dev'\n"
@@ -2611,6 +2727,13 @@ SRST
         load boot files or configurations from a different server than
         the host address.
 
+    ``mtu=n``
+        Set the MTU of the virtual link, between 68 and 65521 (default
+        1500). With a large MTU, data read from host sockets reaches the
+        guest in fewer, larger frames, which raises TCP throughput. The
+        guest interface must use the same MTU, e.g. with the ``host_mtu``
+        property of virtio-net. Needs libslirp 4.1 or newer.
+
     ``bootfile=file``
         When using the user mode network stack, broadcast file as the
         BOOTP filename. In conjunction with ``tftp``, this can be used
@@ -2937,6 +3060,44 @@ SRST
              -netdev type=vhost-user,id=net0,chardev=chr0 \
              -device virtio-net-pci,netdev=net0
 
+``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m]``
+    Configure AF_XDP backend to connect to a network interface 'name'
+    using AF_XDP socket. A specific program attach mode for a default
+    XDP program can be forced with 'mode', defaults to best-effort,
+    where the likely most performant mode will be in use. Number of
+    queues 'n' should generally match the number of queues in the
+    interface, defaults to 1. Traffic arriving on non-configured device
+    queues will not be delivered to the network backend.
+
+    ::
+
+        # set number of queues to 4
+        ethtool -L eth0 combined 4
+        # launch QEMU instance
+        |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \
+            -netdev af-xdp,id=n1,ifname=eth0,queues=4
+
+    'start-queue' option can be specified if a particular range of
+    queues [m, m + n - 1] should be in use. For example, this may be
+    necessary in order to use certain NICs in native mode. Kernel
+    allows the driver to create a separate set of XDP queues on top of
+    regular ones, and only these queues can be used for AF_XDP sockets.
+    NICs that work this way may also require an additional traffic
+    redirection with ethtool to these special queues.
+
+    ::
+
+        # set number of queues to 1
+        ethtool -L eth0 combined 1
+        # redirect all the traffic to the second queue (id: 1)
+        # note: drivers may require non-empty key/mask pair.
+        ethtool -N eth0 flow-type ether \
+            dst 00:00:00:00:00:00 m FF:FF:FF:FF:FF:FE action 1
+        ethtool -N eth0 flow-type ether \
+            dst 00:00:00:00:00:01 m FF:FF:FF:FF:FF:FE action 1
+        |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \
+            -netdev af-xdp,id=n1,ifname=eth0,queues=1,start-queue=1
+
 ``-netdev hubport,id=id,hubid=hubid[,netdev=nd]``
     Create a hub port on the emulated hub with ID hubid.
 
@@ -3949,12 +4110,12 @@ SRST
 ERST
 
 DEF("icount", HAS_ARG, QEMU_OPTION_icount, \
-    "-icount [shift=N|auto][,align=on|off][,sleep=on|off,rr=record|replay,rrfile=<filename>,rrsnapshot=<snapshot>]\n" \
+    "-icount [shift=N|auto][,align=on|off][,sleep=on|off,rr=record|replay,rrfile=<filename>,rrsnapshot=<snapshot>,rrsnapshot-period=<seconds>]\n" \
     "                enable virtual instruction counter with 2^N clock ticks per\n" \
     "                instruction, enable aligning the host and virtual clocks\n" \
     "                or disable real time cpu sleeping\n", QEMU_ARCH_ALL)
 SRST
-``-icount [shift=N|auto][,rr=record|replay,rrfile=filename,rrsnapshot=snapshot]``
+``-icount [shift=N|auto][,rr=record|replay,rrfile=filename,rrsnapshot=snapshot,rrsnapshot-period=seconds]``
     Enable virtual instruction counter. The virtual cpu will execute one
     instruction every 2^N ns of virtual time. If ``auto`` is specified
     then the virtual cpu speed will be automatically adjusted to keep
@@ -3991,6 +4152,10 @@ SRST
     Option rrsnapshot is used to create new vm snapshot named snapshot
     at the start of execution recording. In replay mode this option is
     used to load the initial VM state.
+
+    With ``rrsnapshot-period``, recording also creates a snapshot named
+    snapshot-icount every given number of seconds. The QMP command
+    ``replay-seek`` starts from the nearest of these snapshots.
 ERST
 
 DEF("watchdog", HAS_ARG, QEMU_OPTION_watchdog, \
@@ -4299,10 +4464,11 @@ ERST
 
 DEF("trace", HAS_ARG, QEMU_OPTION_trace,
     "-trace [[enable=]<pattern>][,events=<file>][,file=<file>]\n"
+    "       [,flight-recorder=on|off]\n"
     "                specify tracing options\n",
     QEMU_ARCH_ALL)
 SRST
-``-trace [[enable=]pattern][,events=file][,file=file]``
+``-trace [[enable=]pattern][,events=file][,file=file][,flight-recorder=on|off]``
   .. include:: ../qemu-option-trace.rst.inc
 
 ERST
@@ -4391,7 +4557,7 @@ SRST
     they are specified. Note that the 'id' property must be set. These
     objects are placed in the '/objects' path.
 
-    ``-object memory-backend-file,id=id,size=size,mem-path=dir,share=on|off,discard-data=on|off,merge=on|off,dump=on|off,prealloc=on|off,host-nodes=host-nodes,policy=default|preferred|bind|interleave,align=align``
+    ``-object memory-backend-file,id=id,size=size,mem-path=dir,share=on|off,clone=on|off,discard-data=on|off,merge=on|off,dump=on|off,prealloc=on|off,host-nodes=host-nodes,policy=default|preferred|bind|interleave,align=align``
         Creates a memory file backend object, which can be used to back
         the guest RAM with huge pages.
 
@@ -4418,6 +4584,16 @@ SRST
         Documentation/vm/numa\_memory\_policy.txt on the Linux kernel
         source tree for additional details.
 
+        Setting the ``clone`` boolean option to on maps the existing
+        file ``mem-path`` copy-on-write and never writes to it. It is
+        meant to start many identical guests from the RAM of a template
+        guest: the template runs with share=on, is stopped and its
+        device state saved with the ``x-ignore-shared`` migration
+        capability. Clones are then started with ``clone=on`` and
+        ``-incoming`` with the same capability, load only the device
+        state and share all pages they do not modify. ``clone`` cannot
+        be combined with share=on.
+
         Setting the ``discard-data`` boolean option to on indicates that
         file contents can be destroyed when QEMU exits, to avoid
         unnecessarily flushing data to the backing file. Note that
@@ -4474,13 +4650,30 @@ SRST
         4.15) and the filesystem of ``mem-path`` mounted with DAX
         option.
 
-    ``-object memory-backend-ram,id=id,merge=on|off,dump=on|off,share=on|off,prealloc=on|off,size=size,host-nodes=host-nodes,policy=default|preferred|bind|interleave``
+    ``-object memory-backend-ram,id=id,merge=on|off,dump=on|off,share=on|off,prealloc=on|off,size=size,host-nodes=host-nodes,policy=default|preferred|bind|interleave,hugetlbsize=size``
         Creates a memory backend object, which can be used to back the
         guest RAM. Memory backend objects offer more control than the
         ``-m`` option that is traditionally used to define guest RAM.
         Please refer to ``memory-backend-file`` for a description of the
         options.
 
+        The ``hugetlbsize`` option backs the memory with anonymous huge
+        pages of the given size (e.g. 2M or 1G) taken from the host's
+        hugetlb pool, without the need for a hugetlbfs mount.  The pages
+        are reserved when the backend is created, which fails if the pool
+        is too small; ``size`` is rounded up to the huge page size.
+        Combined with ``host-nodes`` and ``policy=bind``, and one backend
+        per guest NUMA node, this keeps each node's memory in huge pages
+        of the matching host node, which cuts host TLB misses on the TCG
+        memory access paths in particular. (Linux only)
+
+        .. parsed-literal::
+
+            |qemu_system| \
+             -object memory-backend-ram,id=ram0,size=4G,hugetlbsize=1G,host-nodes=0,policy=bind \
+             -object memory-backend-ram,id=ram1,size=4G,hugetlbsize=1G,host-nodes=1,policy=bind \
+             -numa node,nodeid=0,memdev=ram0 -numa node,nodeid=1,memdev=ram1
+
     ``-object memory-backend-memfd,id=id,merge=on|off,dump=on|off,share=on|off,prealloc=on|off,size=size,host-nodes=host-nodes,policy=default|preferred|bind|interleave,seal=on|off,hugetlb=on|off,hugetlbsize=size``
         Creates an anonymous memory file backend object, which allows
         QEMU to share the memory with an external process (e.g. when
@@ -5036,7 +5229,7 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
-    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink``
+    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,io-uring-sqpoll=on|off``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
         emulation happens in vCPU threads or the main event loop thread.
@@ -5060,6 +5253,12 @@ SRST
         for many cases but can be adjusted based on knowledge of the
         workload and/or host device latency.
 
+        The polling time is tuned separately for each file descriptor
+        that supports polling, such as a virtqueue, from the time that
+        passes between its events. The IOThread polls for as long as
+        its busiest file descriptor requires. Virtqueues only have guest
+        notifications disabled while they are polled productively.
+
         The ``poll-max-ns`` parameter is the maximum number of
         nanoseconds to busy wait for events. Polling can be disabled by
         setting this value to 0.
@@ -5079,6 +5278,36 @@ SRST
         ::
 
             (qemu) qom-set /objects/iothread1 poll-max-ns 100000
+
+        The ``io-uring-sqpoll`` parameter gives the io_uring ring of the
+        IOThread a kernel thread that polls for submissions, so that
+        drives using ``aio=io_uring`` can submit requests without a
+        system call. The kernel thread burns host CPU while busy. Older
+        kernels only allow it for privileged processes, in which case a
+        normal ring is used. It can only be set when creating the
+        IOThread.
+
+    ``-object placement-policy,id=id,vcpu-cpus=list,vcpu-node=node,vcpu-pin=on|off,iothread-cpus=list,iothread-node=node,worker-cpus=list,worker-node=node``
+        Restricts the host CPUs that QEMU threads run on. Threads are
+        grouped in three classes: ``vcpu`` threads, ``iothread``
+        threads and ``worker`` threads, which are the block layer
+        thread pool and the migration compression and multifd threads.
+        Threads are placed when they are created, including vCPUs that
+        are hotplugged later, so no external pinning is needed.
+
+        ``*-cpus`` is a list of host CPUs such as ``0-3,8``. ``*-node``
+        is a host NUMA node, -1 meaning any. If both are given, the
+        threads run on the listed CPUs of that node. When ``vcpu-pin``
+        is on, vCPU i only runs on the i-th CPU of its set, modulo its
+        size.
+
+        Only one placement-policy object can exist. All its properties
+        can be changed at run-time using ``qom-set``, which moves the
+        existing threads:
+
+        ::
+
+            (qemu) qom-set /objects/place0 vcpu-cpus 4-7
 ERST
 
 
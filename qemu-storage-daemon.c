@@ -29,6 +29,9 @@
 
 #include "block/block.h"
 #include "block/nbd.h"
+#ifdef CONFIG_LINUX
+#include "block/export/vhost-user-blk-server.h"
+#endif
 #include "chardev/char.h"
 #include "crypto/init.h"
 #include "monitor/monitor.h"
@@ -93,9 +96,16 @@ static void help(void)
 "                         (see the qemu(1) man page for possible options)\n"
 "\n"
 "  --export [type=]nbd,device=<node-name>[,name=<export-name>]\n"
-"           [,writable=on|off][,bitmap=<name>]\n"
+"           [,writable=on|off][,bitmap=<name>][,iothread=<id>]\n"
 "                         export the specified block node over NBD\n"
 "                         (requires --nbd-server)\n"
+#ifdef CONFIG_LINUX
+"  --export [type=]vhost-user-blk,device=<node-name>,addr.type=unix,\n"
+"           addr.path=<socket-path>[,writable=on|off]\n"
+"           [,logical-block-size=<size>][,num-queues=<n>][,iothread=<id>]\n"
+"                         export the specified block node as a vhost-user-blk\n"
+"                         device over a vhost-user socket\n"
+#endif
 "\n"
 "  --monitor [chardev=]name[,mode=control][,pretty[=on|off]]\n"
 "                         configure a QMP monitor\n"
@@ -156,6 +166,11 @@ static void init_export(BlockExport *export, Error **errp)
     case BLOCK_EXPORT_TYPE_NBD:
         qmp_nbd_server_add(&export->u.nbd, errp);
         break;
+#ifdef CONFIG_LINUX
+    case BLOCK_EXPORT_TYPE_VHOST_USER_BLK:
+        vhost_user_blk_server_add(&export->u.vhost_user_blk, errp);
+        break;
+#endif
     default:
         g_assert_not_reached();
     }
@@ -35,8 +35,6 @@ typedef enum json_token_type {
     JSON_MAX = JSON_END_OF_INPUT
 } JSONTokenType;
 
-typedef struct JSONToken JSONToken;
-
 /* json-lexer.c */
 void json_lexer_init(JSONLexer *lexer, bool enable_interpolation);
 void json_lexer_feed(JSONLexer *lexer, const char *buffer, size_t size);
@@ -48,7 +46,10 @@ void json_message_process_token(JSONLexer *lexer, GString *input,
                                 JSONTokenType type, int x, int y);
 
 /* json-parser.c */
-JSONToken *json_token(JSONTokenType type, int x, int y, GString *tokstr);
-QObject *json_parser_parse(GQueue *tokens, va_list *ap, Error **errp);
+void json_parser_init(JSONParser *parser, va_list *ap);
+void json_parser_feed(JSONParser *parser, JSONTokenType type, const char *str);
+QObject *json_parser_finish(JSONParser *parser, Error **errp);
+void json_parser_reset(JSONParser *parser);
+void json_parser_destroy(JSONParser *parser);
 
 #endif
@@ -24,39 +24,29 @@
 #include "qapi/qmp/qstring.h"
 #include "json-parser-int.h"
 
-struct JSONToken {
-    JSONTokenType type;
-    int x;
-    int y;
-    char str[];
+typedef enum JSONParserState {
+    JSON_PARSE_OBJECT_KEY_OR_END,   /* after '{' */
+    JSON_PARSE_OBJECT_KEY,          /* after ',' in an object */
+    JSON_PARSE_OBJECT_COLON,
+    JSON_PARSE_OBJECT_VALUE,
+    JSON_PARSE_OBJECT_SEP,          /* after a member */
+    JSON_PARSE_ARRAY_VALUE_OR_END,  /* after '[' */
+    JSON_PARSE_ARRAY_VALUE,         /* after ',' in an array */
+    JSON_PARSE_ARRAY_SEP,           /* after an element */
+} JSONParserState;
+
+/* An object or array that is still open */
+struct JSONParserFrame {
+    JSONParserState state;
+    QObject *container;
+    QString *key;
 };
 
-typedef struct JSONParserContext
-{
-    Error *err;
-    JSONToken *current;
-    GQueue *buf;
-    va_list *ap;
-} JSONParserContext;
-
-#define BUG_ON(cond) assert(!(cond))
-
-/**
- * TODO
- *
- * 0) make errors meaningful again
- * 1) add geometry information to tokens
- * 3) should we return a parsed size?
- * 4) deal with premature EOI
- */
-
-static QObject *parse_value(JSONParserContext *ctxt);
-
 /**
  * Error handler
  */
-static void GCC_FMT_ATTR(3, 4) parse_error(JSONParserContext *ctxt,
-                                           JSONToken *token, const char *msg, ...)
+static void GCC_FMT_ATTR(2, 3) parse_error(JSONParser *ctxt,
+                                           const char *msg, ...)
 {
     va_list ap;
     char message[1024];
@@ -127,9 +117,8 @@ static int cvt4hex(const char *s)
  * - Invalid Unicode characters are rejected.
  * - Control characters \x00..\x1F are rejected by the lexer.
  */
-static QString *parse_string(JSONParserContext *ctxt, JSONToken *token)
+static QString *parse_string(JSONParser *ctxt, const char *ptr)
 {
-    const char *ptr = token->str;
     QString *str;
     char quote;
     const char *beg;
@@ -195,7 +184,7 @@ static QString *parse_string(JSONParserContext *ctxt, JSONToken *token)
                 }
 
                 if (mod_utf8_encode(utf8_buf, sizeof(utf8_buf), cp) < 0) {
-                    parse_error(ctxt, token,
+                    parse_error(ctxt,
                                 "%.*s is not a valid Unicode character",
                                 (int)(ptr - beg), beg);
                     goto out;
@@ -203,14 +192,14 @@ static QString *parse_string(JSONParserContext *ctxt, JSONToken *token)
                 qstring_append(str, utf8_buf);
                 break;
             default:
-                parse_error(ctxt, token, "invalid escape sequence in string");
+                parse_error(ctxt, "invalid escape sequence in string");
                 goto out;
             }
             break;
         case '%':
             if (ctxt->ap) {
                 if (ptr[1] != '%') {
-                    parse_error(ctxt, token, "can't interpolate into string");
+                    parse_error(ctxt, "can't interpolate into string");
                     goto out;
                 }
                 ptr++;
@@ -219,7 +208,7 @@ static QString *parse_string(JSONParserContext *ctxt, JSONToken *token)
         default:
             cp = mod_utf8_codepoint(ptr, 6, &end);
             if (cp < 0) {
-                parse_error(ctxt, token, "invalid UTF-8 sequence in string");
+                parse_error(ctxt, "invalid UTF-8 sequence in string");
                 goto out;
             }
             ptr = end;
@@ -236,259 +225,56 @@ out:
     return NULL;
 }
 
-/* Note: the token object returned by parser_context_peek_token or
- * parser_context_pop_token is deleted as soon as parser_context_pop_token
- * is called again.
- */
-static JSONToken *parser_context_pop_token(JSONParserContext *ctxt)
-{
-    g_free(ctxt->current);
-    ctxt->current = g_queue_pop_head(ctxt->buf);
-    return ctxt->current;
-}
-
-static JSONToken *parser_context_peek_token(JSONParserContext *ctxt)
-{
-    return g_queue_peek_head(ctxt->buf);
-}
-
-/**
- * Parsing rules
- */
-static int parse_pair(JSONParserContext *ctxt, QDict *dict)
-{
-    QObject *value;
-    QString *key = NULL;
-    JSONToken *peek, *token;
-
-    peek = parser_context_peek_token(ctxt);
-    if (peek == NULL) {
-        parse_error(ctxt, NULL, "premature EOI");
-        goto out;
-    }
-
-    key = qobject_to(QString, parse_value(ctxt));
-    if (!key) {
-        parse_error(ctxt, peek, "key is not a string in object");
-        goto out;
-    }
-
-    token = parser_context_pop_token(ctxt);
-    if (token == NULL) {
-        parse_error(ctxt, NULL, "premature EOI");
-        goto out;
-    }
-
-    if (token->type != JSON_COLON) {
-        parse_error(ctxt, token, "missing : in object pair");
-        goto out;
-    }
-
-    value = parse_value(ctxt);
-    if (value == NULL) {
-        parse_error(ctxt, token, "Missing value in dict");
-        goto out;
-    }
-
-    if (qdict_haskey(dict, qstring_get_str(key))) {
-        parse_error(ctxt, token, "duplicate key");
-        goto out;
-    }
-
-    qdict_put_obj(dict, qstring_get_str(key), value);
-
-    qobject_unref(key);
-
-    return 0;
-
-out:
-    qobject_unref(key);
-
-    return -1;
-}
-
-static QObject *parse_object(JSONParserContext *ctxt)
+static QObject *parse_keyword(JSONParser *ctxt, const char *str)
 {
-    QDict *dict = NULL;
-    JSONToken *token, *peek;
-
-    token = parser_context_pop_token(ctxt);
-    assert(token && token->type == JSON_LCURLY);
-
-    dict = qdict_new();
-
-    peek = parser_context_peek_token(ctxt);
-    if (peek == NULL) {
-        parse_error(ctxt, NULL, "premature EOI");
-        goto out;
-    }
-
-    if (peek->type != JSON_RCURLY) {
-        if (parse_pair(ctxt, dict) == -1) {
-            goto out;
-        }
-
-        token = parser_context_pop_token(ctxt);
-        if (token == NULL) {
-            parse_error(ctxt, NULL, "premature EOI");
-            goto out;
-        }
-
-        while (token->type != JSON_RCURLY) {
-            if (token->type != JSON_COMMA) {
-                parse_error(ctxt, token, "expected separator in dict");
-                goto out;
-            }
-
-            if (parse_pair(ctxt, dict) == -1) {
-                goto out;
-            }
-
-            token = parser_context_pop_token(ctxt);
-            if (token == NULL) {
-                parse_error(ctxt, NULL, "premature EOI");
-                goto out;
-            }
-        }
-    } else {
-        (void)parser_context_pop_token(ctxt);
-    }
-
-    return QOBJECT(dict);
-
-out:
-    qobject_unref(dict);
-    return NULL;
-}
-
-static QObject *parse_array(JSONParserContext *ctxt)
-{
-    QList *list = NULL;
-    JSONToken *token, *peek;
-
-    token = parser_context_pop_token(ctxt);
-    assert(token && token->type == JSON_LSQUARE);
-
-    list = qlist_new();
-
-    peek = parser_context_peek_token(ctxt);
-    if (peek == NULL) {
-        parse_error(ctxt, NULL, "premature EOI");
-        goto out;
-    }
-
-    if (peek->type != JSON_RSQUARE) {
-        QObject *obj;
-
-        obj = parse_value(ctxt);
-        if (obj == NULL) {
-            parse_error(ctxt, token, "expecting value");
-            goto out;
-        }
-
-        qlist_append_obj(list, obj);
-
-        token = parser_context_pop_token(ctxt);
-        if (token == NULL) {
-            parse_error(ctxt, NULL, "premature EOI");
-            goto out;
-        }
-
-        while (token->type != JSON_RSQUARE) {
-            if (token->type != JSON_COMMA) {
-                parse_error(ctxt, token, "expected separator in list");
-                goto out;
-            }
-
-            obj = parse_value(ctxt);
-            if (obj == NULL) {
-                parse_error(ctxt, token, "expecting value");
-                goto out;
-            }
-
-            qlist_append_obj(list, obj);
-
-            token = parser_context_pop_token(ctxt);
-            if (token == NULL) {
-                parse_error(ctxt, NULL, "premature EOI");
-                goto out;
-            }
-        }
-    } else {
-        (void)parser_context_pop_token(ctxt);
-    }
-
-    return QOBJECT(list);
-
-out:
-    qobject_unref(list);
-    return NULL;
-}
-
-static QObject *parse_keyword(JSONParserContext *ctxt)
-{
-    JSONToken *token;
-
-    token = parser_context_pop_token(ctxt);
-    assert(token && token->type == JSON_KEYWORD);
-
-    if (!strcmp(token->str, "true")) {
+    if (!strcmp(str, "true")) {
         return QOBJECT(qbool_from_bool(true));
-    } else if (!strcmp(token->str, "false")) {
+    } else if (!strcmp(str, "false")) {
         return QOBJECT(qbool_from_bool(false));
-    } else if (!strcmp(token->str, "null")) {
+    } else if (!strcmp(str, "null")) {
         return QOBJECT(qnull());
     }
-    parse_error(ctxt, token, "invalid keyword '%s'", token->str);
+    parse_error(ctxt, "invalid keyword '%s'", str);
     return NULL;
 }
 
-static QObject *parse_interpolation(JSONParserContext *ctxt)
+static QObject *parse_interpolation(JSONParser *ctxt, const char *str)
 {
-    JSONToken *token;
-
-    token = parser_context_pop_token(ctxt);
-    assert(token && token->type == JSON_INTERP);
-
-    if (!strcmp(token->str, "%p")) {
+    if (!strcmp(str, "%p")) {
         return va_arg(*ctxt->ap, QObject *);
-    } else if (!strcmp(token->str, "%i")) {
+    } else if (!strcmp(str, "%i")) {
         return QOBJECT(qbool_from_bool(va_arg(*ctxt->ap, int)));
-    } else if (!strcmp(token->str, "%d")) {
+    } else if (!strcmp(str, "%d")) {
         return QOBJECT(qnum_from_int(va_arg(*ctxt->ap, int)));
-    } else if (!strcmp(token->str, "%ld")) {
+    } else if (!strcmp(str, "%ld")) {
         return QOBJECT(qnum_from_int(va_arg(*ctxt->ap, long)));
-    } else if (!strcmp(token->str, "%lld")) {
+    } else if (!strcmp(str, "%lld")) {
         return QOBJECT(qnum_from_int(va_arg(*ctxt->ap, long long)));
-    } else if (!strcmp(token->str, "%" PRId64)) {
+    } else if (!strcmp(str, "%" PRId64)) {
         return QOBJECT(qnum_from_int(va_arg(*ctxt->ap, int64_t)));
-    } else if (!strcmp(token->str, "%u")) {
+    } else if (!strcmp(str, "%u")) {
         return QOBJECT(qnum_from_uint(va_arg(*ctxt->ap, unsigned int)));
-    } else if (!strcmp(token->str, "%lu")) {
+    } else if (!strcmp(str, "%lu")) {
         return QOBJECT(qnum_from_uint(va_arg(*ctxt->ap, unsigned long)));
-    } else if (!strcmp(token->str, "%llu")) {
+    } else if (!strcmp(str, "%llu")) {
         return QOBJECT(qnum_from_uint(va_arg(*ctxt->ap, unsigned long long)));
-    } else if (!strcmp(token->str, "%" PRIu64)) {
+    } else if (!strcmp(str, "%" PRIu64)) {
         return QOBJECT(qnum_from_uint(va_arg(*ctxt->ap, uint64_t)));
-    } else if (!strcmp(token->str, "%s")) {
+    } else if (!strcmp(str, "%s")) {
         return QOBJECT(qstring_from_str(va_arg(*ctxt->ap, const char *)));
-    } else if (!strcmp(token->str, "%f")) {
+    } else if (!strcmp(str, "%f")) {
         return QOBJECT(qnum_from_double(va_arg(*ctxt->ap, double)));
     }
-    parse_error(ctxt, token, "invalid interpolation '%s'", token->str);
+    parse_error(ctxt, "invalid interpolation '%s'", str);
     return NULL;
 }
 
-static QObject *parse_literal(JSONParserContext *ctxt)
+static QObject *parse_literal(JSONParser *ctxt, JSONTokenType type,
+                              const char *str)
 {
-    JSONToken *token;
-
-    token = parser_context_pop_token(ctxt);
-    assert(token);
-
-    switch (token->type) {
+    switch (type) {
     case JSON_STRING:
-        return QOBJECT(parse_string(ctxt, token));
+        return QOBJECT(parse_string(ctxt, str));
     case JSON_INTEGER: {
         /*
          * Represent JSON_INTEGER as QNUM_I64 if possible, else as
@@ -506,14 +292,14 @@ static QObject *parse_literal(JSONParserContext *ctxt)
         int64_t value;
         uint64_t uvalue;
 
-        ret = qemu_strtoi64(token->str, NULL, 10, &value);
+        ret = qemu_strtoi64(str, NULL, 10, &value);
         if (!ret) {
             return QOBJECT(qnum_from_int(value));
         }
         assert(ret == -ERANGE);
 
-        if (token->str[0] != '-') {
-            ret = qemu_strtou64(token->str, NULL, 10, &uvalue);
+        if (str[0] != '-') {
+            ret = qemu_strtou64(str, NULL, 10, &uvalue);
             if (!ret) {
                 return QOBJECT(qnum_from_uint(uvalue));
             }
@@ -525,67 +311,227 @@ static QObject *parse_literal(JSONParserContext *ctxt)
         /* FIXME dependent on locale; a pervasive issue in QEMU */
         /* FIXME our lexer matches RFC 8259 in forbidding Inf or NaN,
          * but those might be useful extensions beyond JSON */
-        return QOBJECT(qnum_from_double(strtod(token->str, NULL)));
+        return QOBJECT(qnum_from_double(strtod(str, NULL)));
+    default:
+        abort();
+    }
+}
+
+/**
+ * Parsing rules
+ *
+ * Tokens are fed one at a time, straight from the lexer's buffer, and
+ * the value is built as they arrive; the objects and arrays that are
+ * still open form a stack.  The errors are those of a recursive descent
+ * parser that sees the same tokens: the first one wins, and the rest of
+ * the message is ignored.
+ */
+static void parser_push(JSONParser *ctxt, QObject *container,
+                        JSONParserState state)
+{
+    JSONParserFrame *frame;
+
+    if (ctxt->depth == ctxt->stack_size) {
+        ctxt->stack_size = MAX(ctxt->stack_size * 2, 8);
+        ctxt->stack = g_renew(JSONParserFrame, ctxt->stack, ctxt->stack_size);
+    }
+    frame = &ctxt->stack[ctxt->depth++];
+    frame->state = state;
+    frame->container = container;
+    frame->key = NULL;
+}
+
+/* Add a complete value to the innermost open object or array */
+static void parser_add_value(JSONParser *ctxt, QObject *value)
+{
+    JSONParserFrame *frame;
+
+    if (!ctxt->depth) {
+        ctxt->result = value;
+        ctxt->complete = true;
+        return;
+    }
+
+    frame = &ctxt->stack[ctxt->depth - 1];
+    switch (frame->state) {
+    case JSON_PARSE_OBJECT_KEY_OR_END:
+    case JSON_PARSE_OBJECT_KEY:
+        frame->key = qobject_to(QString, value);
+        if (!frame->key) {
+            qobject_unref(value);
+            parse_error(ctxt, "key is not a string in object");
+            return;
+        }
+        frame->state = JSON_PARSE_OBJECT_COLON;
+        break;
+    case JSON_PARSE_OBJECT_VALUE: {
+        QDict *dict = qobject_to(QDict, frame->container);
+
+        if (!value) {
+            parse_error(ctxt, "Missing value in dict");
+            return;
+        }
+        if (qdict_haskey(dict, qstring_get_str(frame->key))) {
+            qobject_unref(value);
+            parse_error(ctxt, "duplicate key");
+            return;
+        }
+        qdict_put_obj(dict, qstring_get_str(frame->key), value);
+        qobject_unref(frame->key);
+        frame->key = NULL;
+        frame->state = JSON_PARSE_OBJECT_SEP;
+        break;
+    }
+    case JSON_PARSE_ARRAY_VALUE_OR_END:
+    case JSON_PARSE_ARRAY_VALUE:
+        if (!value) {
+            parse_error(ctxt, "expecting value");
+            return;
+        }
+        qlist_append_obj(qobject_to(QList, frame->container), value);
+        frame->state = JSON_PARSE_ARRAY_SEP;
+        break;
     default:
         abort();
     }
 }
 
-static QObject *parse_value(JSONParserContext *ctxt)
+static void parser_pop(JSONParser *ctxt)
 {
-    JSONToken *token;
+    JSONParserFrame *frame = &ctxt->stack[--ctxt->depth];
 
-    token = parser_context_peek_token(ctxt);
-    if (token == NULL) {
-        parse_error(ctxt, NULL, "premature EOI");
-        return NULL;
+    assert(!frame->key);
+    parser_add_value(ctxt, frame->container);
+}
+
+void json_parser_feed(JSONParser *ctxt, JSONTokenType type, const char *str)
+{
+    JSONParserFrame *frame;
+    QObject *value;
+
+    if (ctxt->err) {
+        return;
+    }
+    assert(!ctxt->complete);
+
+    if (ctxt->depth) {
+        frame = &ctxt->stack[ctxt->depth - 1];
+        switch (frame->state) {
+        case JSON_PARSE_OBJECT_KEY_OR_END:
+            if (type == JSON_RCURLY) {
+                parser_pop(ctxt);
+                return;
+            }
+            break;
+        case JSON_PARSE_OBJECT_COLON:
+            if (type != JSON_COLON) {
+                parse_error(ctxt, "missing : in object pair");
+                return;
+            }
+            frame->state = JSON_PARSE_OBJECT_VALUE;
+            return;
+        case JSON_PARSE_OBJECT_SEP:
+            if (type == JSON_RCURLY) {
+                parser_pop(ctxt);
+            } else if (type == JSON_COMMA) {
+                frame->state = JSON_PARSE_OBJECT_KEY;
+            } else {
+                parse_error(ctxt, "expected separator in dict");
+            }
+            return;
+        case JSON_PARSE_ARRAY_VALUE_OR_END:
+            if (type == JSON_RSQUARE) {
+                parser_pop(ctxt);
+                return;
+            }
+            break;
+        case JSON_PARSE_ARRAY_SEP:
+            if (type == JSON_RSQUARE) {
+                parser_pop(ctxt);
+            } else if (type == JSON_COMMA) {
+                frame->state = JSON_PARSE_ARRAY_VALUE;
+            } else {
+                parse_error(ctxt, "expected separator in list");
+            }
+            return;
+        default:
+            break;
+        }
     }
 
-    switch (token->type) {
+    /* Anything else must start a value */
+    switch (type) {
     case JSON_LCURLY:
-        return parse_object(ctxt);
+        parser_push(ctxt, QOBJECT(qdict_new()), JSON_PARSE_OBJECT_KEY_OR_END);
+        return;
     case JSON_LSQUARE:
-        return parse_array(ctxt);
+        parser_push(ctxt, QOBJECT(qlist_new()), JSON_PARSE_ARRAY_VALUE_OR_END);
+        return;
     case JSON_INTERP:
-        return parse_interpolation(ctxt);
+        value = parse_interpolation(ctxt, str);
+        break;
     case JSON_INTEGER:
     case JSON_FLOAT:
     case JSON_STRING:
-        return parse_literal(ctxt);
+        value = parse_literal(ctxt, type, str);
+        break;
     case JSON_KEYWORD:
-        return parse_keyword(ctxt);
+        value = parse_keyword(ctxt, str);
+        break;
     default:
-        parse_error(ctxt, token, "expecting value");
-        return NULL;
+        parse_error(ctxt, "expecting value");
+        return;
+    }
+    if (!ctxt->err) {
+        parser_add_value(ctxt, value);
     }
 }
 
-JSONToken *json_token(JSONTokenType type, int x, int y, GString *tokstr)
+void json_parser_reset(JSONParser *ctxt)
 {
-    JSONToken *token = g_malloc(sizeof(JSONToken) + tokstr->len + 1);
-
-    token->type = type;
-    memcpy(token->str, tokstr->str, tokstr->len);
-    token->str[tokstr->len] = 0;
-    token->x = x;
-    token->y = y;
-    return token;
+    while (ctxt->depth) {
+        JSONParserFrame *frame = &ctxt->stack[--ctxt->depth];
+
+        qobject_unref(frame->key);
+        qobject_unref(frame->container);
+    }
+    if (ctxt->err) {
+        error_free(ctxt->err);
+        ctxt->err = NULL;
+    }
+    qobject_unref(ctxt->result);
+    ctxt->result = NULL;
+    ctxt->complete = false;
 }
 
-QObject *json_parser_parse(GQueue *tokens, va_list *ap, Error **errp)
+QObject *json_parser_finish(JSONParser *ctxt, Error **errp)
 {
-    JSONParserContext ctxt = { .buf = tokens, .ap = ap };
-    QObject *result;
-
-    result = parse_value(&ctxt);
-    assert(ctxt.err || g_queue_is_empty(ctxt.buf));
-
-    error_propagate(errp, ctxt.err);
+    QObject *result = NULL;
 
-    while (!g_queue_is_empty(ctxt.buf)) {
-        parser_context_pop_token(&ctxt);
+    if (!ctxt->complete) {
+        parse_error(ctxt, "premature EOI");
     }
-    g_free(ctxt.current);
-
+    if (ctxt->err) {
+        error_propagate(errp, ctxt->err);
+        ctxt->err = NULL;
+    } else {
+        result = ctxt->result;
+        ctxt->result = NULL;
+    }
+    json_parser_reset(ctxt);
     return result;
 }
+
+void json_parser_init(JSONParser *ctxt, va_list *ap)
+{
+    memset(ctxt, 0, sizeof(*ctxt));
+    ctxt->ap = ap;
+}
+
+void json_parser_destroy(JSONParser *ctxt)
+{
+    json_parser_reset(ctxt);
+    g_free(ctxt->stack);
+    ctxt->stack = NULL;
+    ctxt->stack_size = 0;
+}
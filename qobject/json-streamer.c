@@ -19,22 +19,12 @@
 #define MAX_TOKEN_COUNT (2ULL << 20)
 #define MAX_NESTING (1 << 10)
 
-static void json_message_free_tokens(JSONMessageParser *parser)
-{
-    JSONToken *token;
-
-    while ((token = g_queue_pop_head(&parser->tokens))) {
-        g_free(token);
-    }
-}
-
 void json_message_process_token(JSONLexer *lexer, GString *input,
                                 JSONTokenType type, int x, int y)
 {
     JSONMessageParser *parser = container_of(lexer, JSONMessageParser, lexer);
     QObject *json = NULL;
     Error *err = NULL;
-    JSONToken *token;
 
     switch (type) {
     case JSON_LCURLY:
@@ -53,10 +43,10 @@ void json_message_process_token(JSONLexer *lexer, GString *input,
         error_setg(&err, "JSON parse error, stray '%s'", input->str);
         goto out_emit;
     case JSON_END_OF_INPUT:
-        if (g_queue_is_empty(&parser->tokens)) {
+        if (!parser->token_count) {
             return;
         }
-        json = json_parser_parse(&parser->tokens, parser->ap, &err);
+        json = json_parser_finish(&parser->parser, &err);
         goto out_emit;
     default:
         break;
@@ -70,7 +60,7 @@ void json_message_process_token(JSONLexer *lexer, GString *input,
         error_setg(&err, "JSON token size limit exceeded");
         goto out_emit;
     }
-    if (g_queue_get_length(&parser->tokens) + 1 > MAX_TOKEN_COUNT) {
+    if (parser->token_count + 1 > MAX_TOKEN_COUNT) {
         error_setg(&err, "JSON token count limit exceeded");
         goto out_emit;
     }
@@ -79,22 +69,23 @@ void json_message_process_token(JSONLexer *lexer, GString *input,
         goto out_emit;
     }
 
-    token = json_token(type, x, y, input);
+    /* The value is built as we go, tokens are not kept */
+    json_parser_feed(&parser->parser, type, input->str);
     parser->token_size += input->len;
-
-    g_queue_push_tail(&parser->tokens, token);
+    parser->token_count++;
 
     if ((parser->brace_count > 0 || parser->bracket_count > 0)
         && parser->brace_count >= 0 && parser->bracket_count >= 0) {
         return;
     }
 
-    json = json_parser_parse(&parser->tokens, parser->ap, &err);
+    json = json_parser_finish(&parser->parser, &err);
 
 out_emit:
     parser->brace_count = 0;
     parser->bracket_count = 0;
-    json_message_free_tokens(parser);
+    json_parser_reset(&parser->parser);
+    parser->token_count = 0;
     parser->token_size = 0;
     parser->emit(parser->opaque, json, err);
 }
@@ -106,12 +97,13 @@ void json_message_parser_init(JSONMessageParser *parser,
 {
     parser->emit = emit;
     parser->opaque = opaque;
-    parser->ap = ap;
     parser->brace_count = 0;
     parser->bracket_count = 0;
-    g_queue_init(&parser->tokens);
+    parser->token_count = 0;
     parser->token_size = 0;
 
+    json_parser_init(&parser->parser, ap);
+
     json_lexer_init(&parser->lexer, !!ap);
 }
 
@@ -124,11 +116,11 @@ void json_message_parser_feed(JSONMessageParser *parser,
 void json_message_parser_flush(JSONMessageParser *parser)
 {
     json_lexer_flush(&parser->lexer);
-    assert(g_queue_is_empty(&parser->tokens));
+    assert(!parser->token_count);
 }
 
 void json_message_parser_destroy(JSONMessageParser *parser)
 {
     json_lexer_destroy(&parser->lexer);
-    json_message_free_tokens(parser);
+    json_parser_destroy(&parser->parser);
 }
@@ -316,6 +316,9 @@ static void type_initialize(TypeImpl *ti)
         g_assert(parent->instance_size <= ti->instance_size);
         memcpy(ti->class, parent->class, parent->class_size);
         ti->class->interfaces = NULL;
+        ti->class->properties_all = NULL;
+        ti->class->properties_init = NULL;
+        ti->class->properties_gen = 0;
         ti->class->properties = g_hash_table_new_full(
             g_str_hash, g_str_equal, NULL, object_property_free);
 
@@ -484,17 +487,53 @@ void object_apply_compat_props(Object *obj)
     }
 }
 
-static void object_class_property_init_all(Object *obj)
+/* Bumped whenever a class property is added */
+static unsigned object_class_properties_gen = 1;
+
+static void object_class_flatten_properties(ObjectClass *klass)
 {
-    ObjectPropertyIterator iter;
-    ObjectProperty *prop;
+    GHashTableIter iter;
+    ObjectClass *k;
+    gpointer key, val;
+
+    if (klass->properties_gen == object_class_properties_gen) {
+        return;
+    }
+
+    if (!klass->properties_all) {
+        klass->properties_all = g_hash_table_new(g_str_hash, g_str_equal);
+        klass->properties_init = g_ptr_array_new();
+    } else {
+        g_hash_table_remove_all(klass->properties_all);
+        g_ptr_array_set_size(klass->properties_init, 0);
+    }
+
+    /* Parents come last, so they win on name clashes as in a lookup */
+    for (k = klass; k; k = object_class_get_parent(k)) {
+        g_hash_table_iter_init(&iter, k->properties);
+        while (g_hash_table_iter_next(&iter, &key, &val)) {
+            ObjectProperty *prop = val;
 
-    object_class_property_iter_init(&iter, object_get_class(obj));
-    while ((prop = object_property_iter_next(&iter))) {
-        if (prop->init) {
-            prop->init(obj, prop);
+            g_hash_table_replace(klass->properties_all, key, prop);
+            if (prop->init) {
+                g_ptr_array_add(klass->properties_init, prop);
+            }
         }
     }
+    klass->properties_gen = object_class_properties_gen;
+}
+
+static void object_class_property_init_all(Object *obj)
+{
+    ObjectClass *klass = object_get_class(obj);
+    guint i;
+
+    object_class_flatten_properties(klass);
+    for (i = 0; i < klass->properties_init->len; i++) {
+        ObjectProperty *prop = g_ptr_array_index(klass->properties_init, i);
+
+        prop->init(obj, prop);
+    }
 }
 
 static void object_initialize_with_type(void *data, size_t size, TypeImpl *type)
@@ -1184,6 +1223,31 @@ object_property_add(Object *obj, const char *name, const char *type,
                                    opaque, &error_abort);
 }
 
+static ObjectProperty *object_class_property_lookup(ObjectClass *klass,
+                                                    const char *name)
+{
+    ObjectProperty *prop;
+    ObjectClass *parent_klass;
+
+    if (klass->properties_gen == object_class_properties_gen) {
+        return g_hash_table_lookup(klass->properties_all, name);
+    }
+
+    /*
+     * Not flattened yet, or out of date.  Do not flatten here: classes
+     * look up properties while other classes are still adding theirs.
+     */
+    parent_klass = object_class_get_parent(klass);
+    if (parent_klass) {
+        prop = object_class_property_lookup(parent_klass, name);
+        if (prop) {
+            return prop;
+        }
+    }
+
+    return g_hash_table_lookup(klass->properties, name);
+}
+
 ObjectProperty *
 object_class_property_add(ObjectClass *klass,
                           const char *name,
@@ -1195,7 +1259,7 @@ object_class_property_add(ObjectClass *klass,
 {
     ObjectProperty *prop;
 
-    assert(!object_class_property_find(klass, name, NULL));
+    assert(!object_class_property_lookup(klass, name));
 
     prop = g_malloc0(sizeof(*prop));
 
@@ -1208,6 +1272,7 @@ object_class_property_add(ObjectClass *klass,
     prop->opaque = opaque;
 
     g_hash_table_insert(klass->properties, prop->name, prop);
+    object_class_properties_gen++;
 
     return prop;
 }
@@ -1263,17 +1328,8 @@ ObjectProperty *object_class_property_find(ObjectClass *klass, const char *name,
                                            Error **errp)
 {
     ObjectProperty *prop;
-    ObjectClass *parent_klass;
-
-    parent_klass = object_class_get_parent(klass);
-    if (parent_klass) {
-        prop = object_class_property_find(parent_klass, name, NULL);
-        if (prop) {
-            return prop;
-        }
-    }
 
-    prop = g_hash_table_lookup(klass->properties, name);
+    prop = object_class_property_lookup(klass, name);
     if (!prop) {
         error_setg(errp, "Property '.%s' not found", name);
     }
@@ -45,6 +45,8 @@ static qemu_timeval start_time;
 static bool qtest_opened;
 static void (*qtest_server_send)(void*, const char*);
 static void *qtest_server_send_opaque;
+static uint8_t *qtest_shm;
+static uint64_t qtest_shm_size;
 
 #define FMT_timeval "%ld.%06ld"
 
@@ -148,6 +150,23 @@ static void *qtest_server_send_opaque;
  * B64_DATA is an arbitrarily long base64 encoded string.
  * If the sizes do not match, the data will be truncated.
  *
+ * Shared memory window:
+ *
+ *  > shm_attach SIZE
+ *  < OK
+ *
+ *  > shm_read ADDR SIZE
+ *  < OK
+ *
+ *  > shm_write ADDR SIZE
+ *  < OK
+ *
+ * 'shm_attach' must come with a file descriptor passed over the qtest
+ * socket.  The first SIZE bytes of it are mapped and replace any earlier
+ * window.  'shm_read' copies SIZE bytes of guest memory at ADDR to the
+ * start of the window and 'shm_write' copies them the other way, so that
+ * bulk data does not have to be encoded in the stream.
+ *
  * IRQ management:
  *
  *  > irq_intercept_in QOM-PATH
@@ -273,6 +292,17 @@ static void qtest_irq_handler(void *opaque, int n, int level)
     }
 }
 
+static void qtest_shm_detach(void)
+{
+#ifndef _WIN32
+    if (qtest_shm) {
+        munmap(qtest_shm, qtest_shm_size);
+        qtest_shm = NULL;
+        qtest_shm_size = 0;
+    }
+#endif
+}
+
 static void qtest_process_command(CharBackend *chr, gchar **words)
 {
     const gchar *command;
@@ -626,6 +656,60 @@ static void qtest_process_command(CharBackend *chr, gchar **words)
 
         qtest_send_prefix(chr);
         qtest_send(chr, "OK\n");
+#ifndef _WIN32
+    } else if (strcmp(words[0], "shm_attach") == 0) {
+        uint64_t len;
+        void *p;
+        int fd;
+        int ret;
+
+        g_assert(words[1]);
+        ret = qemu_strtou64(words[1], NULL, 0, &len);
+        g_assert(ret == 0);
+
+        fd = chr ? qemu_chr_fe_get_msgfd(chr) : -1;
+        if (fd < 0) {
+            qtest_send(chr, "ERR no file descriptor\n");
+            return;
+        }
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            qtest_send(chr, "ERR cannot map file descriptor\n");
+            return;
+        }
+        qtest_shm_detach();
+        qtest_shm = p;
+        qtest_shm_size = len;
+
+        qtest_send_prefix(chr);
+        qtest_send(chr, "OK\n");
+    } else if (strcmp(words[0], "shm_read") == 0 ||
+               strcmp(words[0], "shm_write") == 0) {
+        uint64_t addr, len;
+        int ret;
+
+        g_assert(words[1] && words[2]);
+        ret = qemu_strtou64(words[1], NULL, 0, &addr);
+        g_assert(ret == 0);
+        ret = qemu_strtou64(words[2], NULL, 0, &len);
+        g_assert(ret == 0);
+
+        if (len > qtest_shm_size) {
+            qtest_send(chr, "ERR size exceeds shared memory window\n");
+            return;
+        }
+        if (words[0][4] == 'r') {
+            address_space_read(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                               qtest_shm, len);
+        } else {
+            address_space_write(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                                qtest_shm, len);
+        }
+
+        qtest_send_prefix(chr);
+        qtest_send(chr, "OK\n");
+#endif
     } else if (strcmp(words[0], "endianness") == 0) {
         qtest_send_prefix(chr);
 #if defined(TARGET_WORDS_BIGENDIAN)
@@ -751,6 +835,7 @@ static void qtest_event(void *opaque, QEMUChrEvent event)
         break;
     case CHR_EVENT_CLOSED:
         qtest_opened = false;
+        qtest_shm_detach();
         if (qtest_log_fp) {
             qemu_timeval tv;
             qtest_get_time(&tv);
@@ -0,0 +1,137 @@
+/*
+ * replay-debugging.c
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
+#include "sysemu/replay.h"
+#include "sysemu/runstate.h"
+#include "replay-internal.h"
+#include "qemu/cutils.h"
+#include "qemu/timer.h"
+#include "block/snapshot.h"
+#include "migration/snapshot.h"
+
+int64_t replay_break_icount = -1;
+static QEMUTimer *replay_break_timer;
+
+static void replay_break_stop(void *opaque)
+{
+    replay_break_icount = -1;
+    vm_stop(RUN_STATE_PAUSED);
+}
+
+void replay_break_reached(void)
+{
+    /* The vCPU thread cannot stop the VM itself */
+    timer_mod_ns(replay_break_timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME));
+}
+
+static void replay_break(uint64_t icount)
+{
+    if (!replay_break_timer) {
+        replay_break_timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                          replay_break_stop, NULL);
+    }
+    replay_break_icount = icount;
+}
+
+/*
+ * Returns the name of the latest snapshot made by rrsnapshot at or
+ * before @icount and sets @found to its icount, or returns NULL.
+ */
+static char *replay_find_snapshot(uint64_t icount, uint64_t *found)
+{
+    BlockDriverState *bs = bdrv_all_find_vmstate_bs();
+    QEMUSnapshotInfo *sn_tab;
+    AioContext *aio_context;
+    char *best = NULL;
+    char *prefix;
+    int i, nb;
+
+    if (!replay_snapshot || !bs) {
+        return NULL;
+    }
+
+    aio_context = bdrv_get_aio_context(bs);
+    aio_context_acquire(aio_context);
+    nb = bdrv_snapshot_list(bs, &sn_tab);
+    aio_context_release(aio_context);
+
+    prefix = g_strdup_printf("%s-", replay_snapshot);
+    for (i = 0; i < nb; i++) {
+        const char *rest;
+        uint64_t n;
+
+        if (!strcmp(sn_tab[i].name, replay_snapshot)) {
+            /* The initial snapshot */
+            n = 0;
+        } else if (!strstart(sn_tab[i].name, prefix, &rest) ||
+                   qemu_strtou64(rest, NULL, 10, &n) < 0) {
+            continue;
+        }
+        if (n <= icount && (!best || n > *found)) {
+            g_free(best);
+            best = g_strdup(sn_tab[i].name);
+            *found = n;
+        }
+    }
+    g_free(prefix);
+    if (nb > 0) {
+        g_free(sn_tab);
+    }
+    return best;
+}
+
+void qmp_replay_seek(int64_t icount, Error **errp)
+{
+    bool running = runstate_is_running();
+    uint64_t snapshot_icount = 0;
+    uint64_t current;
+    char *snapshot;
+
+    if (replay_mode != REPLAY_MODE_PLAY) {
+        error_setg(errp, "replay-seek needs replay mode");
+        return;
+    }
+    if (icount < 0) {
+        error_setg(errp, "icount must not be negative");
+        return;
+    }
+
+    /* Stop the vCPUs, so that none is running past @icount already */
+    vm_stop(RUN_STATE_PAUSED);
+    current = replay_get_current_icount();
+
+    snapshot = replay_find_snapshot(icount, &snapshot_icount);
+    if (icount < current || (snapshot && snapshot_icount > current)) {
+        if (!snapshot) {
+            error_setg(errp, "no snapshot before icount %" PRId64, icount);
+            goto fail;
+        }
+        if (load_snapshot(snapshot, errp) != 0) {
+            goto fail;
+        }
+        current = replay_get_current_icount();
+    }
+    g_free(snapshot);
+
+    if (icount > current) {
+        replay_break(icount);
+        vm_start();
+    }
+    return;
+
+fail:
+    g_free(snapshot);
+    if (running) {
+        vm_start();
+    }
+}
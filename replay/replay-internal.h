@@ -134,6 +134,16 @@ void replay_save_instructions(void);
     \return true, if event was found */
 bool replay_next_event_is(int event);
 
+/*! Instruction count at which replay-seek stops the replay, or -1. */
+extern int64_t replay_break_icount;
+/*! Called from the vCPU thread when replay_break_icount is reached. */
+void replay_break_reached(void);
+
+/*! Seconds of host time between snapshots in record mode, or 0. */
+extern uint64_t replay_snapshot_period;
+/*! Starts taking the periodic snapshots. */
+void replay_snapshot_period_start(void);
+
 /*! Reads next clock value from the file.
     If clock kind read from the file is different from the parameter,
     the value is not used. */
@@ -18,10 +18,23 @@
 #include "qemu/error-report.h"
 #include "migration/vmstate.h"
 #include "migration/snapshot.h"
+#include "qemu/timer.h"
+#include "sysemu/runstate.h"
+
+/* Retry delay when a periodic snapshot cannot be taken yet */
+#define REPLAY_SNAPSHOT_RETRY_MS 100
+
+static QEMUTimer *replay_snapshot_timer;
 
 static int replay_pre_save(void *opaque)
 {
     ReplayState *state = opaque;
+
+    /*
+     * Log the instructions run so far, so that the log from file_offset
+     * on only counts instructions executed after the snapshot.
+     */
+    replay_save_instructions();
     state->file_offset = ftell(replay_file);
 
     return 0;
@@ -92,6 +105,48 @@ void replay_vmstate_init(void)
     }
 }
 
+/*
+ * In record mode, snapshot the VM every replay_snapshot_period seconds
+ * as "<rrsnapshot>-<icount>", for replay-seek to start from.
+ */
+static void replay_snapshot_tick(void *opaque)
+{
+    int64_t next = REPLAY_SNAPSHOT_RETRY_MS;
+    Error *err = NULL;
+    char *name;
+
+    if (runstate_is_running()) {
+        /* Stop first, so that the name has the icount of the snapshot */
+        vm_stop(RUN_STATE_SAVE_VM);
+        if (replay_can_snapshot()) {
+            name = g_strdup_printf("%s-%" PRIu64, replay_snapshot,
+                                   replay_get_current_icount());
+            if (save_snapshot(name, &err) != 0) {
+                error_report_err(err);
+                error_report("Periodic snapshots for icount record "
+                             "are disabled");
+                g_free(name);
+                vm_start();
+                return;
+            }
+            g_free(name);
+            next = replay_snapshot_period * 1000;
+        }
+        vm_start();
+    }
+
+    timer_mod(replay_snapshot_timer,
+              qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + next);
+}
+
+void replay_snapshot_period_start(void)
+{
+    replay_snapshot_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                         replay_snapshot_tick, NULL);
+    timer_mod(replay_snapshot_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME)
+              + replay_snapshot_period * 1000);
+}
+
 bool replay_can_snapshot(void)
 {
     return replay_mode == REPLAY_MODE_NONE
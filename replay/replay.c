@@ -28,6 +28,7 @@
 
 ReplayMode replay_mode = REPLAY_MODE_NONE;
 char *replay_snapshot;
+uint64_t replay_snapshot_period;
 
 /* Name of replay file  */
 static char *replay_filename;
@@ -73,6 +74,15 @@ int replay_get_instructions(void)
     replay_mutex_lock();
     if (replay_next_event_is(EVENT_INSTRUCTION)) {
         res = replay_state.instruction_count;
+        if (replay_break_icount != -1) {
+            uint64_t current = replay_get_current_icount();
+
+            /* Do not run past the icount that replay-seek stops at */
+            assert(replay_break_icount >= current);
+            if (current + res > replay_break_icount) {
+                res = replay_break_icount - current;
+            }
+        }
     }
     replay_mutex_unlock();
     return res;
@@ -91,6 +101,9 @@ void replay_account_executed_instructions(void)
 
             replay_state.instruction_count -= count;
             replay_state.current_icount += count;
+            if (replay_break_icount == replay_state.current_icount) {
+                replay_break_reached();
+            }
             if (replay_state.instruction_count == 0) {
                 assert(replay_state.data_kind == EVENT_INSTRUCTION);
                 replay_finish_event();
@@ -328,6 +341,11 @@ void replay_configure(QemuOpts *opts)
     }
 
     replay_snapshot = g_strdup(qemu_opt_get(opts, "rrsnapshot"));
+    replay_snapshot_period = qemu_opt_get_number(opts, "rrsnapshot-period", 0);
+    if (replay_snapshot_period && !replay_snapshot) {
+        error_report("rrsnapshot-period needs rrsnapshot");
+        exit(1);
+    }
     replay_vmstate_register();
     replay_enable(fname, mode);
 
@@ -350,7 +368,9 @@ void replay_start(void)
         exit(1);
     }
 
-    /* Timer for snapshotting will be set up here. */
+    if (replay_mode == REPLAY_MODE_RECORD && replay_snapshot_period) {
+        replay_snapshot_period_start();
+    }
 
     replay_enable_events();
 }
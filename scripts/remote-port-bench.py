@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+#
+# Benchmark remote-port against the loopback peer
+#
+# Copyright (c) 2020 Xilinx Inc.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+#
+# For each transport and sync quantum, starts remote-port-peer in
+# benchmark mode, then QEMU with a machine path pointing at it.  The
+# peer issues bus accesses to a remote-port-memory-slave of QEMU, so no
+# SystemC model is needed.  The QEMU command line is given as one
+# string; the script appends -machine-path and the -global options that
+# select the transport and the quantum.
+#
+# Results are printed as JSON lines, one per transport and quantum, the
+# best of --repeat runs.  Save them and pass them back with --baseline
+# to flag configurations that got slower.
+#
+# Example, for a board whose remote-port adaptor is called "cosim" and
+# has a memory slave as device 1:
+#
+#   scripts/remote-port-bench.py --peer ./remote-port-peer \
+#       --qemu "aarch64-softmmu/qemu-system-aarch64 -M arm-generic-fdt \
+#               -hw-dtb board.dtb -display none" \
+#       --prefix cosim --dev 1 --addr 0x40000000 \
+#       --transport socket --transport shm \
+#       --quantum 10000 --quantum 1000000 > today.json
+
+import argparse
+import json
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+import time
+
+TRANSPORTS = ["socket", "shm"]
+
+
+def run_config(args, transport, quantum):
+    with tempfile.TemporaryDirectory(prefix="rport-bench-") as path:
+        sock = os.path.join(path, "qemu-rport-" + args.prefix.replace("/", "_"))
+        peer = [args.peer, "-b", "-d", str(args.dev), "-a", str(args.addr),
+                "-s", str(args.size), "-n", str(args.count)]
+        if args.write:
+            peer += ["-w"]
+        if args.sync_every:
+            peer += ["-y", str(args.sync_every)]
+        if transport == "shm":
+            peer += ["-S", sock + "-shm"]
+        peer += ["unix:" + sock]
+
+        qemu = shlex.split(args.qemu) + ["-machine-path", path]
+        if quantum:
+            qemu += ["-global", "remote-port.sync=on",
+                     "-global", "remote-port.sync-quantum=%d" % quantum]
+        if transport == "shm":
+            qemu += ["-global", "remote-port.shm=on"]
+
+        p = subprocess.Popen(peer, stdout=subprocess.PIPE,
+                             universal_newlines=True)
+        # QEMU connects as a client only if the socket is already there
+        deadline = time.monotonic() + 10
+        while not os.path.exists(sock):
+            if p.poll() is not None or time.monotonic() > deadline:
+                p.kill()
+                raise RuntimeError("remote-port-peer did not start")
+            time.sleep(0.01)
+
+        q = subprocess.Popen(qemu, stdin=subprocess.DEVNULL)
+        try:
+            out = p.communicate(timeout=args.timeout)[0]
+        finally:
+            q.kill()
+            q.wait()
+            if p.poll() is None:
+                p.kill()
+        if p.returncode:
+            raise RuntimeError("remote-port-peer failed with status %d"
+                               % p.returncode)
+
+    result = json.loads(out.strip().splitlines()[-1])
+    if result["transport"] != transport:
+        print("# %s transport was not negotiated, got %s" %
+              (transport, result["transport"]), file=sys.stderr)
+    result["quantum"] = quantum
+    return result
+
+
+def key(result):
+    return (result["transport"], result["quantum"], result["op"],
+            result["size"])
+
+
+def compare(results, baseline_file, threshold):
+    baseline = {}
+    with open(baseline_file) as f:
+        for line in f:
+            if line.strip():
+                r = json.loads(line)
+                baseline[key(r)] = r
+
+    regressions = 0
+    for r in results:
+        b = baseline.get(key(r))
+        if not b:
+            continue
+        ratio = r["transactions-per-second"] / b["transactions-per-second"]
+        status = "ok"
+        if ratio < 1 - threshold:
+            status = "REGRESSION"
+            regressions += 1
+        print("# %-6s quantum %-10d %6.2fx %s" % (r["transport"],
+                                                  r["quantum"], ratio, status),
+              file=sys.stderr)
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark remote-port")
+    parser.add_argument("--peer", default="./remote-port-peer",
+                        help="remote-port-peer binary")
+    parser.add_argument("--qemu", required=True,
+                        help="QEMU command line, without -machine-path")
+    parser.add_argument("--prefix", required=True,
+                        help="name of the remote-port adaptor in the board")
+    parser.add_argument("--dev", type=int, required=True,
+                        help="device number of the remote-port-memory-slave")
+    parser.add_argument("--addr", type=lambda x: int(x, 0), default=0,
+                        help="address accessed through the slave")
+    parser.add_argument("--size", type=int, default=4,
+                        help="bytes per access (default: 4)")
+    parser.add_argument("--count", type=int, default=100000,
+                        help="accesses per run (default: 100000)")
+    parser.add_argument("--write", action="store_true",
+                        help="write instead of reading")
+    parser.add_argument("--sync-every", type=int, default=0,
+                        help="make the peer sync after every N accesses")
+    parser.add_argument("--transport", action="append", choices=TRANSPORTS,
+                        help="transport to measure (may be repeated, "
+                             "default: all)")
+    parser.add_argument("--quantum", action="append", type=int,
+                        help="sync quantum in ns, 0 to disable syncs "
+                             "(may be repeated, default: 0)")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="runs per configuration, the best one is kept "
+                             "(default: 3)")
+    parser.add_argument("--timeout", type=int, default=300,
+                        help="seconds allowed per run (default: 300)")
+    parser.add_argument("--baseline",
+                        help="JSON lines from an earlier run to compare with")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="slowdown reported as a regression "
+                             "(default: 0.05)")
+    args = parser.parse_args()
+
+    results = []
+    for transport in args.transport or TRANSPORTS:
+        for quantum in args.quantum or [0]:
+            runs = [run_config(args, transport, quantum)
+                    for _ in range(args.repeat)]
+            best = max(runs, key=lambda r: r["transactions-per-second"])
+            print(json.dumps(best, sort_keys=True))
+            sys.stdout.flush()
+            results.append(best)
+
+    if args.baseline and compare(results, args.baseline, args.threshold):
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+#
+# Run the TCG microbenchmarks and compare them with a baseline
+#
+# Copyright (c) 2020 Xilinx Inc.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+#
+# The benchmarks are the kernels of tests/tcg/multiarch/tcg-bench.c,
+# built for the guest by "make build-tcg".  Each kernel runs in its own
+# QEMU process so that, with the insn plugin, the instruction count and
+# so the MIPS figure belong to that kernel alone.
+#
+# Results are printed as JSON lines, one per kernel and per QEMU
+# binary, the best of --repeat runs.  Save them and pass them back with
+# --baseline to flag kernels that got slower.
+#
+# Example:
+#
+#   scripts/tcg-bench.py --qemu aarch64-linux-user/qemu-aarch64 \
+#       --plugin tests/plugin/libinsn.so --scale 50 \
+#       tests/tcg/aarch64-linux-user/tcg-bench > today.json
+#   scripts/tcg-bench.py ... --baseline today.json
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+KERNELS = ["int-loop", "memcpy", "fp", "indirect", "page-stride", "mmap"]
+
+
+def run_kernel(qemu, plugin, binary, kernel, scale):
+    cmd = [qemu]
+    log = None
+    if plugin:
+        log = tempfile.NamedTemporaryFile(prefix="tcg-bench-", suffix=".log",
+                                          delete=False)
+        log.close()
+        cmd += ["-plugin", plugin + ",arg=inline", "-d", "plugin",
+                "-D", log.name]
+    cmd += [binary, "-s", str(scale), kernel]
+
+    start = time.monotonic()
+    out = subprocess.run(cmd, stdout=subprocess.PIPE, check=True,
+                         universal_newlines=True).stdout
+    host_seconds = time.monotonic() - start
+
+    result = json.loads(out.strip().splitlines()[-1])
+    result["qemu"] = os.path.basename(qemu)
+    result["scale"] = scale
+    result["host-seconds"] = round(host_seconds, 6)
+
+    if log:
+        with open(log.name) as f:
+            m = re.search(r"insns: (\d+)", f.read())
+        os.unlink(log.name)
+        if m:
+            insns = int(m.group(1))
+            result["insns"] = insns
+            # Includes startup, which is why -s should be large
+            result["mips"] = round(insns / host_seconds / 1e6, 2)
+    return result
+
+
+def key(result):
+    return (result["qemu"], result["kernel"])
+
+
+def compare(results, baseline_file, threshold):
+    baseline = {}
+    with open(baseline_file) as f:
+        for line in f:
+            if line.strip():
+                r = json.loads(line)
+                baseline[key(r)] = r
+
+    regressions = 0
+    for r in results:
+        b = baseline.get(key(r))
+        if not b:
+            continue
+        ratio = r["iterations-per-second"] / b["iterations-per-second"]
+        status = "ok"
+        if ratio < 1 - threshold:
+            status = "REGRESSION"
+            regressions += 1
+        print("# %-20s %-12s %6.2fx %s" % (r["qemu"], r["kernel"], ratio,
+                                           status), file=sys.stderr)
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run TCG microbenchmarks")
+    parser.add_argument("--qemu", action="append", required=True,
+                        help="QEMU linux-user binary (may be repeated)")
+    parser.add_argument("--plugin",
+                        help="path to tests/plugin/libinsn.so, to count "
+                             "instructions and report MIPS")
+    parser.add_argument("--scale", type=int, default=20,
+                        help="iteration multiplier (default: 20)")
+    parser.add_argument("--repeat", type=int, default=3,
+                        help="runs per kernel, the best one is kept "
+                             "(default: 3)")
+    parser.add_argument("--kernel", action="append", choices=KERNELS,
+                        help="only run this kernel (may be repeated)")
+    parser.add_argument("--baseline",
+                        help="JSON lines from an earlier run to compare with")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="slowdown reported as a regression "
+                             "(default: 0.05)")
+    parser.add_argument("binary", help="tcg-bench built for the guest")
+    args = parser.parse_args()
+
+    results = []
+    for qemu in args.qemu:
+        for kernel in args.kernel or KERNELS:
+            runs = [run_kernel(qemu, args.plugin, args.binary, kernel,
+                               args.scale) for _ in range(args.repeat)]
+            best = max(runs, key=lambda r: r["iterations-per-second"])
+            print(json.dumps(best, sort_keys=True))
+            sys.stdout.flush()
+            results.append(best)
+
+    if args.baseline and compare(results, args.baseline, args.threshold):
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,326 @@
+/*
+ * MMIO access profiler
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Each thread that dispatches MMIO (in practice the vCPU threads, plus
+ * the main loop and iothreads for device DMA) owns a shard: a fixed-size,
+ * open-addressed table keyed by region and offset.  The shard lock is
+ * only contended while a report or a reset walks the shards, so
+ * recording a sample costs an uncontended spinlock and two clock reads.
+ * Like the lock profiler, shards of exited threads are recycled rather
+ * than freed.
+ *
+ * A region gets a reference when it first enters a shard, so a report
+ * never looks at a freed region.  The references are dropped on reset.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
+#include "qemu/atomic.h"
+#include "qemu/notify.h"
+#include "qemu/thread.h"
+#include "exec/memory.h"
+#include "exec/mmio-profile.h"
+
+/* Must be a power of two */
+#define MMIO_PROFILE_ENTRIES 1024
+
+#define MMIO_PROFILE_DEFAULT_COUNT 16
+
+typedef struct MmioProfileShard MmioProfileShard;
+struct MmioProfileShard {
+    MmioProfileShard *next;
+    bool in_use;
+    Notifier exit;
+    QemuSpin lock;
+    /* Collects the samples of registers that do not fit in @entries */
+    MmioProfileStats overflow;
+    MmioProfileStats entries[MMIO_PROFILE_ENTRIES];
+};
+
+bool mmio_profile_enabled;
+
+static MmioProfileShard *mmio_profile_shards;
+static __thread MmioProfileShard *mmio_profile_self;
+static __thread bool mmio_profile_exited;
+
+static void mmio_profile_thread_exit(Notifier *n, void *unused)
+{
+    MmioProfileShard *s = container_of(n, MmioProfileShard, exit);
+
+    mmio_profile_self = NULL;
+    mmio_profile_exited = true;
+    atomic_store_release(&s->in_use, false);
+}
+
+static MmioProfileShard *mmio_profile_shard(void)
+{
+    MmioProfileShard *s = mmio_profile_self;
+
+    if (likely(s)) {
+        return s;
+    }
+    if (mmio_profile_exited) {
+        return NULL;
+    }
+
+    for (s = atomic_rcu_read(&mmio_profile_shards); s; s = s->next) {
+        if (!atomic_read(&s->in_use) && !atomic_xchg(&s->in_use, true)) {
+            break;
+        }
+    }
+    if (!s) {
+        MmioProfileShard *head;
+
+        s = g_new0(MmioProfileShard, 1);
+        s->in_use = true;
+        qemu_spin_init(&s->lock);
+        do {
+            head = atomic_read(&mmio_profile_shards);
+            s->next = head;
+        } while (atomic_cmpxchg(&mmio_profile_shards, head, s) != head);
+    }
+
+    s->exit.notify = mmio_profile_thread_exit;
+    qemu_thread_atexit_add(&s->exit);
+    mmio_profile_self = s;
+    return s;
+}
+
+static MmioProfileStats *mmio_profile_lookup(MmioProfileShard *s,
+                                             MemoryRegion *mr, hwaddr offset)
+{
+    unsigned h = ((uintptr_t)mr >> 4) ^ (offset * 0x9e3779b9u);
+    unsigned i;
+
+    for (i = 0; i < MMIO_PROFILE_ENTRIES; i++) {
+        MmioProfileStats *e = &s->entries[(h + i) & (MMIO_PROFILE_ENTRIES - 1)];
+
+        if (e->mr == mr && e->offset == offset) {
+            return e;
+        }
+        if (!e->mr) {
+            memory_region_ref(mr);
+            e->mr = mr;
+            e->offset = offset;
+            return e;
+        }
+    }
+    return &s->overflow;
+}
+
+void mmio_profile_record(MemoryRegion *mr, hwaddr offset, bool is_write,
+                         int64_t start)
+{
+    MmioProfileShard *s = mmio_profile_shard();
+    int64_t ns = get_clock() - start;
+    MmioProfileStats *e;
+
+    if (!s) {
+        return;
+    }
+    qemu_spin_lock(&s->lock);
+    e = mmio_profile_lookup(s, mr, offset);
+    e->count[is_write]++;
+    e->ns[is_write] += MAX(ns, 0);
+    qemu_spin_unlock(&s->lock);
+}
+
+typedef struct MmioProfileKey {
+    MemoryRegion *mr;
+    hwaddr offset;
+} MmioProfileKey;
+
+static guint mmio_profile_key_hash(gconstpointer p)
+{
+    const MmioProfileKey *k = p;
+
+    return g_direct_hash(k->mr) ^ (guint)(k->offset * 0x9e3779b9u);
+}
+
+static gboolean mmio_profile_key_equal(gconstpointer a, gconstpointer b)
+{
+    const MmioProfileKey *ka = a;
+    const MmioProfileKey *kb = b;
+
+    return ka->mr == kb->mr && ka->offset == kb->offset;
+}
+
+static void mmio_profile_merge(GHashTable *ht, const MmioProfileStats *e)
+{
+    MmioProfileKey key = { .mr = e->mr, .offset = e->offset };
+    MmioProfileStats *m;
+    int i;
+
+    if (!e->count[0] && !e->count[1]) {
+        return;
+    }
+    m = g_hash_table_lookup(ht, &key);
+    if (!m) {
+        m = g_new0(MmioProfileStats, 1);
+        m->mr = e->mr;
+        m->offset = e->offset;
+        /* The stats start with the key, so @m doubles as its own key */
+        g_hash_table_insert(ht, m, m);
+    }
+    for (i = 0; i < 2; i++) {
+        m->count[i] += e->count[i];
+        m->ns[i] += e->ns[i];
+    }
+}
+
+static gint mmio_profile_cmp(gconstpointer a, gconstpointer b)
+{
+    const MmioProfileStats *sa = a;
+    const MmioProfileStats *sb = b;
+    uint64_t na = sa->ns[0] + sa->ns[1];
+    uint64_t nb = sb->ns[0] + sb->ns[1];
+
+    if (na != nb) {
+        return na > nb ? -1 : 1;
+    }
+    na = sa->count[0] + sa->count[1];
+    nb = sb->count[0] + sb->count[1];
+    if (na != nb) {
+        return na > nb ? -1 : 1;
+    }
+    return 0;
+}
+
+void mmio_profile_foreach(MmioProfileIterFunc *func, void *opaque)
+{
+    GHashTable *ht = g_hash_table_new_full(mmio_profile_key_hash,
+                                           mmio_profile_key_equal,
+                                           NULL, g_free);
+    MmioProfileShard *s;
+    GList *list, *l;
+    unsigned i;
+
+    QEMU_BUILD_BUG_ON(offsetof(MmioProfileStats, mr) !=
+                      offsetof(MmioProfileKey, mr) ||
+                      offsetof(MmioProfileStats, offset) !=
+                      offsetof(MmioProfileKey, offset));
+
+    for (s = atomic_rcu_read(&mmio_profile_shards); s; s = s->next) {
+        qemu_spin_lock(&s->lock);
+        for (i = 0; i < MMIO_PROFILE_ENTRIES; i++) {
+            if (s->entries[i].mr) {
+                mmio_profile_merge(ht, &s->entries[i]);
+            }
+        }
+        mmio_profile_merge(ht, &s->overflow);
+        qemu_spin_unlock(&s->lock);
+    }
+
+    list = g_list_sort(g_hash_table_get_values(ht), mmio_profile_cmp);
+    for (l = list; l; l = l->next) {
+        func(l->data, opaque);
+    }
+    g_list_free(list);
+    g_hash_table_destroy(ht);
+}
+
+void mmio_profile_reset(void)
+{
+    GPtrArray *regions = g_ptr_array_new();
+    MmioProfileShard *s;
+    unsigned i;
+
+    for (s = atomic_rcu_read(&mmio_profile_shards); s; s = s->next) {
+        qemu_spin_lock(&s->lock);
+        for (i = 0; i < MMIO_PROFILE_ENTRIES; i++) {
+            if (s->entries[i].mr) {
+                g_ptr_array_add(regions, s->entries[i].mr);
+            }
+        }
+        memset(s->entries, 0, sizeof(s->entries));
+        memset(&s->overflow, 0, sizeof(s->overflow));
+        qemu_spin_unlock(&s->lock);
+    }
+
+    /* Dropping the last reference may finalize a device, not under a lock */
+    for (i = 0; i < regions->len; i++) {
+        memory_region_unref(g_ptr_array_index(regions, i));
+    }
+    g_ptr_array_free(regions, true);
+}
+
+void qmp_mmio_profile_set_state(bool enable, bool has_reset, bool reset,
+                                Error **errp)
+{
+    atomic_set(&mmio_profile_enabled, enable);
+    if (has_reset && reset) {
+        mmio_profile_reset();
+    }
+}
+
+typedef struct MmioProfileQuery {
+    MmioProfileInfoList **prev;
+    int64_t left;
+} MmioProfileQuery;
+
+static void query_mmio_profile_one(const MmioProfileStats *stats,
+                                   void *opaque)
+{
+    MmioProfileQuery *q = opaque;
+    MmioProfileInfoList *elem;
+    MmioProfileInfo *info;
+    Object *owner;
+
+    if (!q->left) {
+        return;
+    }
+    if (q->left > 0) {
+        q->left--;
+    }
+
+    info = g_new0(MmioProfileInfo, 1);
+    if (stats->mr) {
+        const char *name = memory_region_name(stats->mr);
+
+        owner = memory_region_owner(stats->mr);
+        /* Owners that were never added to the composition tree have no path */
+        if (owner && owner->parent) {
+            info->has_owner = true;
+            info->owner = object_get_canonical_path(owner);
+        }
+        info->region = g_strdup(name ? name : "");
+        info->offset = stats->offset;
+    } else {
+        info->region = g_strdup("(other)");
+    }
+    info->reads = stats->count[0];
+    info->writes = stats->count[1];
+    info->read_ns = stats->ns[0];
+    info->write_ns = stats->ns[1];
+
+    elem = g_new0(MmioProfileInfoList, 1);
+    elem->value = info;
+    *q->prev = elem;
+    q->prev = &elem->next;
+}
+
+MmioProfileInfoList *qmp_query_mmio_profile(bool has_count, int64_t count,
+                                            Error **errp)
+{
+    MmioProfileInfoList *head = NULL;
+    MmioProfileQuery q = {
+        .prev = &head,
+        .left = has_count ? count : MMIO_PROFILE_DEFAULT_COUNT,
+    };
+
+    if (q.left < 0) {
+        error_setg(errp, "count must not be negative");
+        return NULL;
+    }
+    if (!q.left) {
+        q.left = -1;
+    }
+    mmio_profile_foreach(query_mmio_profile_one, &q);
+    return head;
+}
@@ -114,6 +114,7 @@
 #include "qapi/qmp/qerror.h"
 #include "sysemu/iothread.h"
 #include "qemu/guest-random.h"
+#include "hw/boot-profile.h"
 
 #define MAX_VIRTIO_CONSOLES 1
 
@@ -474,6 +475,9 @@ static QemuOptsList qemu_icount_opts = {
         }, {
             .name = "rrsnapshot",
             .type = QEMU_OPT_STRING,
+        }, {
+            .name = "rrsnapshot-period",
+            .type = QEMU_OPT_NUMBER,
         },
         { /* end of list */ }
     },
@@ -2849,6 +2853,7 @@ void qemu_init(int argc, char **argv, char **envp)
     char *trace_file = NULL;
     ram_addr_t maxram_size;
     uint64_t ram_slots = 0;
+    uint64_t target_page_size;
     FILE *vmstate_dump_file = NULL;
     Error *main_loop_err = NULL;
     Error *err = NULL;
@@ -2859,6 +2864,9 @@ void qemu_init(int argc, char **argv, char **envp)
     BlockdevOptionsQueue bdo_queue = QSIMPLEQ_HEAD_INITIALIZER(bdo_queue);
     QemuPluginList plugin_list = QTAILQ_HEAD_INITIALIZER(plugin_list);
     int mem_prealloc = 0; /* force preallocation of physical target memory */
+    const char *boot_profile_path = NULL;
+    int64_t init_start = get_clock();
+    int64_t start;
 
     os_set_line_buffering();
 
@@ -3168,6 +3176,9 @@ void qemu_init(int argc, char **argv, char **envp)
             case QEMU_OPTION_etrace_flags:
                 qemu_arg_etrace_flags = optarg;
                 break;
+            case QEMU_OPTION_boot_profile:
+                boot_profile_path = optarg;
+                break;
             case QEMU_OPTION_mempath:
                 mem_path = optarg;
                 break;
@@ -3821,6 +3832,11 @@ void qemu_init(int argc, char **argv, char **envp)
      */
     loc_set_none();
 
+    if (boot_profile_path) {
+        boot_profile_open(boot_profile_path, init_start, &error_fatal);
+        boot_profile_span("qemu", "options", init_start);
+    }
+
     /*
      * Check for -cpu help and -device help before we call select_machine(),
      * which will return an error if the architecture has no default machine
@@ -3920,6 +3936,20 @@ void qemu_init(int argc, char **argv, char **envp)
                                             "/unattached"),
                               "sysbus", OBJECT(sysbus_get_default()));
 
+    /*
+     * The page size is decided before machine properties are applied,
+     * so take target-page-size straight from the options.
+     */
+    target_page_size = qemu_opt_get_size(qemu_get_machine_opts(),
+                                         "target-page-size", 0);
+    if (target_page_size &&
+        (!is_power_of_2(target_page_size) ||
+         !set_target_page_bits_floor(ctz64(target_page_size)))) {
+        error_report("target-page-size %" PRIu64 " is not supported",
+                     target_page_size);
+        exit(1);
+    }
+
     if (machine_class->minimum_page_bits) {
         if (!set_preferred_target_page_bits(machine_class->minimum_page_bits)) {
             /* This would be a board error: specifying a minimum smaller than
@@ -4185,6 +4215,10 @@ void qemu_init(int argc, char **argv, char **envp)
      * after machine_set_property().
      */
     configure_accelerators(argv[0]);
+    if (target_page_size && !tcg_enabled() && !qtest_enabled()) {
+        error_report("target-page-size is only supported with TCG");
+        exit(1);
+    }
 
     /*
      * Beware, QOM objects created before this point miss global and
@@ -4379,7 +4413,9 @@ void qemu_init(int argc, char **argv, char **envp)
     audio_init_audiodevs();
 
     /* from here on runstate is RUN_STATE_PRELAUNCH */
+    start = boot_profile_start();
     machine_run_board_init(current_machine);
+    boot_profile_span("qemu", "machine-init", start);
 
     realtime_init();
 
@@ -4400,8 +4436,10 @@ void qemu_init(int argc, char **argv, char **envp)
 
     /* init generic devices */
     rom_set_order_override(FW_CFG_ORDER_OVERRIDE_DEVICE);
+    start = boot_profile_start();
     qemu_opts_foreach(qemu_find_opts("device"),
                       device_init_func, NULL, &error_fatal);
+    boot_profile_span("qemu", "device-init", start);
 
     cpu_synchronize_all_post_init();
 
@@ -4463,10 +4501,12 @@ void qemu_init(int argc, char **argv, char **envp)
     qemu_register_reset(resettable_cold_reset_fn, sysbus_get_default());
     qemu_run_machine_init_done_notifiers();
 
+    start = boot_profile_start();
     if (rom_check_and_register_reset() != 0) {
         error_report("rom check and register reset failed");
         exit(1);
     }
+    boot_profile_span("qemu", "rom-check", start);
 
     replay_start();
 
@@ -4474,7 +4514,9 @@ void qemu_init(int argc, char **argv, char **envp)
        reading from the other reads, because timer polling functions query
        clock values from the log. */
     replay_checkpoint(CHECKPOINT_RESET);
+    start = boot_profile_start();
     qemu_system_reset(SHUTDOWN_CAUSE_NONE);
+    boot_profile_span("qemu", "system-reset", start);
     register_global_state();
     if (loadvm) {
         Error *local_err = NULL;
@@ -4513,6 +4555,7 @@ void qemu_init(int argc, char **argv, char **envp)
         qemu_etrace_gpio_init();
     }
 
+    boot_profile_span("qemu", "init", init_start);
     return;
 }
 
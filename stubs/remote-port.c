@@ -0,0 +1,7 @@
+#include "qemu/osdep.h"
+#include "qapi/qapi-commands-remote-port.h"
+
+RemotePortStatsList *qmp_query_remote_port_stats(Error **errp)
+{
+    return NULL;
+}
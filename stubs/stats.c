@@ -0,0 +1,18 @@
+#include "qemu/osdep.h"
+#include "monitor/stats.h"
+
+void stats_register(StatsProvider provider, StatsTarget target,
+                    const StatsDescriptor *desc, unsigned int num,
+                    StatsRetrieveFunc *retrieve)
+{
+}
+
+bool stats_wanted(StatsCollector *c, const char *qom_path)
+{
+    return false;
+}
+
+void stats_collect(StatsCollector *c, const char *qom_path,
+                   const uint64_t *values)
+{
+}
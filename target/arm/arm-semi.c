@@ -439,6 +439,9 @@ static uint32_t host_readfn(ARMCPU *cpu, GuestFD *gf,
 {
     uint32_t ret;
     CPUARMState *env = &cpu->env;
+#ifndef CONFIG_USER_ONLY
+    ret = set_swi_errno(env, softmmu_read_user(env, gf->hostfd, buf, len));
+#else
     char *s = lock_user(VERIFY_WRITE, buf, len, 0);
     if (!s) {
         /* return bytes not read */
@@ -448,6 +451,7 @@ static uint32_t host_readfn(ARMCPU *cpu, GuestFD *gf,
         ret = set_swi_errno(env, read(gf->hostfd, s, len));
     } while (ret == -1 && errno == EINTR);
     unlock_user(s, buf, len);
+#endif
     if (ret == (uint32_t)-1) {
         ret = 0;
     }
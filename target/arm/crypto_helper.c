@@ -44,6 +44,78 @@ static void clear_tail_16(void *vd, uint32_t desc)
     clear_tail(vd, opr_sz, max_sz);
 }
 
+/*
+ * On x86 hosts, use AES-NI when the host has it.  CONFIG_AVX2_OPT tells
+ * that the compiler can build code for an ISA extension that is not
+ * enabled on the command line, see util/bufferiszero.c.
+ */
+#ifdef CONFIG_AVX2_OPT
+#include "qemu/cpuid.h"
+
+#pragma GCC push_options
+#pragma GCC target("aes")
+#include <wmmintrin.h>
+
+/*
+ * The ARM and x86 instructions split the rounds differently:
+ * AESE is AESENCLAST with the round key added first instead of last,
+ * and MixColumns is AESENC after undoing its first half with a zero
+ * round key AESDECLAST.
+ */
+static void crypto_aese_aesni(void *vd, void *vn, void *vm,
+                              intptr_t opr_sz, bool decrypt)
+{
+    __m128i zero = _mm_setzero_si128();
+    intptr_t i;
+
+    for (i = 0; i < opr_sz; i += 16) {
+        __m128i st = _mm_xor_si128(_mm_loadu_si128(vn + i),
+                                   _mm_loadu_si128(vm + i));
+
+        if (decrypt) {
+            st = _mm_aesdeclast_si128(st, zero);
+        } else {
+            st = _mm_aesenclast_si128(st, zero);
+        }
+        _mm_storeu_si128(vd + i, st);
+    }
+}
+
+static void crypto_aesmc_aesni(void *vd, void *vm, intptr_t opr_sz,
+                               bool decrypt)
+{
+    __m128i zero = _mm_setzero_si128();
+    intptr_t i;
+
+    for (i = 0; i < opr_sz; i += 16) {
+        __m128i st = _mm_loadu_si128(vm + i);
+
+        if (decrypt) {
+            st = _mm_aesimc_si128(st);
+        } else {
+            st = _mm_aesenc_si128(_mm_aesdeclast_si128(st, zero), zero);
+        }
+        _mm_storeu_si128(vd + i, st);
+    }
+}
+#pragma GCC pop_options
+
+static bool have_aesni;
+
+static void __attribute__((constructor)) crypto_init_aesni(void)
+{
+    unsigned a, b, c, d;
+
+    if (__get_cpuid(1, &a, &b, &c, &d)) {
+        have_aesni = (c & bit_AES) != 0;
+    }
+}
+#else
+#define have_aesni false
+#define crypto_aese_aesni(vd, vn, vm, opr_sz, decrypt)   g_assert_not_reached()
+#define crypto_aesmc_aesni(vd, vm, opr_sz, decrypt)      g_assert_not_reached()
+#endif
+
 static void do_crypto_aese(uint64_t *rd, uint64_t *rn,
                            uint64_t *rm, bool decrypt)
 {
@@ -71,8 +143,12 @@ void HELPER(crypto_aese)(void *vd, void *vn, void *vm, uint32_t desc)
     intptr_t i, opr_sz = simd_oprsz(desc);
     bool decrypt = simd_data(desc);
 
-    for (i = 0; i < opr_sz; i += 16) {
-        do_crypto_aese(vd + i, vn + i, vm + i, decrypt);
+    if (have_aesni) {
+        crypto_aese_aesni(vd, vn, vm, opr_sz, decrypt);
+    } else {
+        for (i = 0; i < opr_sz; i += 16) {
+            do_crypto_aese(vd + i, vn + i, vm + i, decrypt);
+        }
     }
     clear_tail(vd, opr_sz, simd_maxsz(desc));
 }
@@ -233,8 +309,12 @@ void HELPER(crypto_aesmc)(void *vd, void *vm, uint32_t desc)
     intptr_t i, opr_sz = simd_oprsz(desc);
     bool decrypt = simd_data(desc);
 
-    for (i = 0; i < opr_sz; i += 16) {
-        do_crypto_aesmc(vd + i, vm + i, decrypt);
+    if (have_aesni) {
+        crypto_aesmc_aesni(vd, vm, opr_sz, decrypt);
+    } else {
+        for (i = 0; i < opr_sz; i += 16) {
+            do_crypto_aesmc(vd + i, vm + i, decrypt);
+        }
     }
     clear_tail(vd, opr_sz, simd_maxsz(desc));
 }
@@ -453,6 +453,8 @@ int kvm_arm_init_cpreg_list(ARMCPU *cpu)
                                         arraylen);
     cpu->cpreg_array_len = arraylen;
     cpu->cpreg_vmstate_array_len = arraylen;
+    g_free(cpu->cpreg_reginfo);
+    cpu->cpreg_reginfo = NULL;
 
     for (i = 0, arraylen = 0; i < rlp->n; i++) {
         uint64_t regidx = rlp->reg[i];
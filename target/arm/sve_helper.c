@@ -329,12 +329,28 @@ LOGICAL_PPPP(sve_nand_pppp, DO_NAND)
  * extra care wrt byte/word ordering we could use gcc generic vectors
  * and do 16 bytes at a time.
  */
+/*
+ * The predicate bits of a 16-byte segment in which every element of
+ * TYPE is active.  Segments matching it are processed without testing
+ * each bit, which lets the compiler vectorize the fixed-length loop.
+ */
+#define PRED_ALL16(TYPE)  ((uint16_t)(0xffffu / ((1u << sizeof(TYPE)) - 1)))
+
 #define DO_ZPZZ(NAME, TYPE, H, OP)                                       \
 void HELPER(NAME)(void *vd, void *vn, void *vm, void *vg, uint32_t desc) \
 {                                                                       \
     intptr_t i, opr_sz = simd_oprsz(desc);                              \
     for (i = 0; i < opr_sz; ) {                                         \
         uint16_t pg = *(uint16_t *)(vg + H1_2(i >> 3));                 \
+        if ((pg & PRED_ALL16(TYPE)) == PRED_ALL16(TYPE)) {              \
+            do {                                                        \
+                TYPE nn = *(TYPE *)(vn + H(i));                         \
+                TYPE mm = *(TYPE *)(vm + H(i));                         \
+                *(TYPE *)(vd + H(i)) = OP(nn, mm);                      \
+                i += sizeof(TYPE);                                      \
+            } while (i & 15);                                           \
+            continue;                                                   \
+        }                                                               \
         do {                                                            \
             if (pg & 1) {                                               \
                 TYPE nn = *(TYPE *)(vn + H(i));                         \
@@ -563,6 +579,14 @@ void HELPER(NAME)(void *vd, void *vn, void *vg, uint32_t desc)  \
     intptr_t i, opr_sz = simd_oprsz(desc);                      \
     for (i = 0; i < opr_sz; ) {                                 \
         uint16_t pg = *(uint16_t *)(vg + H1_2(i >> 3));         \
+        if ((pg & PRED_ALL16(TYPE)) == PRED_ALL16(TYPE)) {      \
+            do {                                                \
+                TYPE nn = *(TYPE *)(vn + H(i));                 \
+                *(TYPE *)(vd + H(i)) = OP(nn);                  \
+                i += sizeof(TYPE);                              \
+            } while (i & 15);                                   \
+            continue;                                           \
+        }                                                       \
         do {                                                    \
             if (pg & 1) {                                       \
                 TYPE nn = *(TYPE *)(vn + H(i));                 \
@@ -1057,6 +1081,14 @@ void HELPER(NAME)(void *vd, void *vn, void *vg, uint32_t desc)  \
     TYPE imm = simd_data(desc);                                 \
     for (i = 0; i < opr_sz; ) {                                 \
         uint16_t pg = *(uint16_t *)(vg + H1_2(i >> 3));         \
+        if ((pg & PRED_ALL16(TYPE)) == PRED_ALL16(TYPE)) {      \
+            do {                                                \
+                TYPE nn = *(TYPE *)(vn + H(i));                 \
+                *(TYPE *)(vd + H(i)) = OP(nn, imm);             \
+                i += sizeof(TYPE);                              \
+            } while (i & 15);                                   \
+            continue;                                           \
+        }                                                       \
         do {                                                    \
             if (pg & 1) {                                       \
                 TYPE nn = *(TYPE *)(vn + H(i));                 \
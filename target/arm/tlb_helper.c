@@ -180,14 +180,16 @@ bool arm_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
         /*
          * Map a single [sub]page. Regions smaller than our declared
          * target page size are handled specially, so for those we
-         * pass in the exact addresses.
+         * pass in the exact addresses. Sections, supersections and
+         * LPAE blocks are linear with uniform attributes, so let
+         * cputlb fill the rest of them without another walk.
          */
         if (page_size >= TARGET_PAGE_SIZE) {
             phys_addr &= TARGET_PAGE_MASK;
             address &= TARGET_PAGE_MASK;
         }
-        tlb_set_page_with_attrs(cs, address, phys_addr, attrs,
-                                prot, mmu_idx, page_size);
+        tlb_set_block_with_attrs(cs, address, phys_addr, attrs,
+                                 prot, mmu_idx, page_size);
         return true;
     } else if (probe) {
         return false;
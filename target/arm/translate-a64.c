@@ -1291,6 +1291,68 @@ static void disas_test_b_imm(DisasContext *s, uint32_t insn)
  * | 0 1 0 1 0 1 0 | o1 |         imm19       | o0 | cond |
  * +---------------+----+---------------------+----+------+
  */
+static void record_cmp(DisasContext *s, bool sf, bool rn_sp, int rn,
+                       bool is_imm, int rm, uint64_t imm)
+{
+    s->last_cmp.insn = s->base.num_insns;
+    s->last_cmp.sf = sf;
+    s->last_cmp.rn_sp = rn_sp;
+    s->last_cmp.rn = rn;
+    s->last_cmp.is_imm = is_imm;
+    s->last_cmp.rm = rm;
+    s->last_cmp.imm = imm;
+}
+
+/*
+ * If the previous insn was a CMP, branch to @label on @cond by comparing
+ * its operands, which it left unchanged, rather than by combining the
+ * flags it computed.  The flags are still live and stay as they are.
+ */
+static bool gen_test_cmp(DisasContext *s, int cond, TCGLabel *label)
+{
+    static const TCGCond cmp_cond[14] = {
+        [0] = TCG_COND_EQ,  [1] = TCG_COND_NE,
+        [2] = TCG_COND_GEU, [3] = TCG_COND_LTU,
+        /* N and V alone do not map to a comparison */
+        [4 ... 7] = TCG_COND_NEVER,
+        [8] = TCG_COND_GTU, [9] = TCG_COND_LEU,
+        [10] = TCG_COND_GE, [11] = TCG_COND_LT,
+        [12] = TCG_COND_GT, [13] = TCG_COND_LE,
+    };
+    TCGv_i64 tcg_rn, tcg_rm;
+
+    if (s->last_cmp.insn == 0 || s->last_cmp.insn != s->base.num_insns - 1
+        || cmp_cond[cond] == TCG_COND_NEVER) {
+        return false;
+    }
+
+    tcg_rn = s->last_cmp.rn_sp ? cpu_reg_sp(s, s->last_cmp.rn)
+                               : cpu_reg(s, s->last_cmp.rn);
+    if (s->last_cmp.is_imm) {
+        tcg_rm = tcg_const_i64(s->last_cmp.imm);
+    } else {
+        tcg_rm = cpu_reg(s, s->last_cmp.rm);
+    }
+
+    if (s->last_cmp.sf) {
+        tcg_gen_brcond_i64(cmp_cond[cond], tcg_rn, tcg_rm, label);
+    } else {
+        TCGv_i32 tcg_rn32 = tcg_temp_new_i32();
+        TCGv_i32 tcg_rm32 = tcg_temp_new_i32();
+
+        tcg_gen_extrl_i64_i32(tcg_rn32, tcg_rn);
+        tcg_gen_extrl_i64_i32(tcg_rm32, tcg_rm);
+        tcg_gen_brcond_i32(cmp_cond[cond], tcg_rn32, tcg_rm32, label);
+        tcg_temp_free_i32(tcg_rn32);
+        tcg_temp_free_i32(tcg_rm32);
+    }
+
+    if (s->last_cmp.is_imm) {
+        tcg_temp_free_i64(tcg_rm);
+    }
+    return true;
+}
+
 static void disas_cond_b_imm(DisasContext *s, uint32_t insn)
 {
     unsigned int cond;
@@ -1307,7 +1369,9 @@ static void disas_cond_b_imm(DisasContext *s, uint32_t insn)
     if (cond < 0x0e) {
         /* genuinely conditional branches */
         TCGLabel *label_match = gen_new_label();
-        arm_gen_test_cc(cond, label_match);
+        if (!gen_test_cmp(s, cond, label_match)) {
+            arm_gen_test_cc(cond, label_match);
+        }
         gen_goto_tb(s, 0, s->base.pc_next);
         gen_set_label(label_match);
         gen_goto_tb(s, 1, addr);
@@ -3778,6 +3842,9 @@ static void disas_add_sub_imm(DisasContext *s, uint32_t insn)
         TCGv_i64 tcg_imm = tcg_const_i64(imm);
         if (sub_op) {
             gen_sub_CC(is_64bit, tcg_result, tcg_rn, tcg_imm);
+            if (rd == 31) {
+                record_cmp(s, is_64bit, true, rn, true, 0, imm);
+            }
         } else {
             gen_add_CC(is_64bit, tcg_result, tcg_rn, tcg_imm);
         }
@@ -4453,6 +4520,9 @@ static void disas_add_sub_reg(DisasContext *s, uint32_t insn)
     } else {
         if (sub_op) {
             gen_sub_CC(sf, tcg_result, tcg_rn, tcg_rm);
+            if (rd == 31 && imm6 == 0) {
+                record_cmp(s, sf, false, rn, false, rm, 0);
+            }
         } else {
             gen_add_CC(sf, tcg_result, tcg_rn, tcg_rm);
         }
@@ -14151,6 +14221,7 @@ static void aarch64_tr_init_disas_context(DisasContextBase *dcbase,
 
     dc->isar = &arm_cpu->isar;
     dc->condjmp = 0;
+    dc->last_cmp.insn = 0;
 
     dc->aarch64 = 1;
     /* If we are coming from secure EL0 in a system with a 32-bit EL3, then
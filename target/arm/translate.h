@@ -92,6 +92,20 @@ typedef struct DisasContext {
     int c15_cpar;
     /* TCG op of the current insn_start.  */
     TCGOp *insn_start;
+    /*
+     * Operands of an A64 CMP, so that a B.cond right after it can
+     * compare them directly instead of testing the flags.  @insn is
+     * the base.num_insns of the CMP, 0 if there was none.
+     */
+    struct {
+        int insn;
+        bool sf;
+        bool rn_sp;
+        bool is_imm;
+        int rn;
+        int rm;
+        uint64_t imm;
+    } last_cmp;
 #define TMP_A64_MAX 16
     int tmp_a64_count;
     TCGv_i64 tmp_a64[TMP_A64_MAX];
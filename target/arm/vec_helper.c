@@ -1292,12 +1292,59 @@ void HELPER(gvec_pmul_b)(void *vd, void *vn, void *vm, uint32_t desc)
  * Because of the lanes are not accessed in strict columns,
  * this probably cannot be turned into a generic helper.
  */
+/* As in crypto_helper.c, use PCLMULQDQ when the x86 host has it.  */
+#ifdef CONFIG_AVX2_OPT
+#include "qemu/cpuid.h"
+
+#pragma GCC push_options
+#pragma GCC target("pclmul")
+#include <wmmintrin.h>
+
+static void gvec_pmull_q_pclmul(void *vd, void *vn, void *vm,
+                                intptr_t opr_sz, intptr_t hi)
+{
+    intptr_t i;
+
+    for (i = 0; i < opr_sz; i += 16) {
+        __m128i nn = _mm_loadu_si128(vn + i);
+        __m128i mm = _mm_loadu_si128(vm + i);
+
+        if (hi) {
+            _mm_storeu_si128(vd + i, _mm_clmulepi64_si128(nn, mm, 0x11));
+        } else {
+            _mm_storeu_si128(vd + i, _mm_clmulepi64_si128(nn, mm, 0x00));
+        }
+    }
+}
+#pragma GCC pop_options
+
+static bool have_pclmul;
+
+static void __attribute__((constructor)) vec_init_pclmul(void)
+{
+    unsigned a, b, c, d;
+
+    if (__get_cpuid(1, &a, &b, &c, &d)) {
+        have_pclmul = (c & bit_PCLMUL) != 0;
+    }
+}
+#else
+#define have_pclmul false
+#define gvec_pmull_q_pclmul(vd, vn, vm, opr_sz, hi)  g_assert_not_reached()
+#endif
+
 void HELPER(gvec_pmull_q)(void *vd, void *vn, void *vm, uint32_t desc)
 {
     intptr_t i, j, opr_sz = simd_oprsz(desc);
     intptr_t hi = simd_data(desc);
     uint64_t *d = vd, *n = vn, *m = vm;
 
+    if (have_pclmul) {
+        gvec_pmull_q_pclmul(vd, vn, vm, opr_sz, hi);
+        clear_tail(d, opr_sz, simd_maxsz(desc));
+        return;
+    }
+
     for (i = 0; i < opr_sz / 8; i += 2) {
         uint64_t nn = n[i + hi];
         uint64_t mm = m[i + hi];
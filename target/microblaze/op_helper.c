@@ -194,6 +194,15 @@ static void raise_fpu_exception(CPUMBState *env)
     helper_raise_exception(env, EXCP_HW_EXCP);
 }
 
+/*
+ * MicroBlaze has no inexact flag, update_fpu_flags ignores it. Keeping it
+ * set lets softfloat hand the common cases to the host FPU.
+ */
+static inline void clear_fpu_flags(CPUMBState *env)
+{
+    set_float_exception_flags(float_flag_inexact, &env->fp_status);
+}
+
 static void update_fpu_flags(CPUMBState *env, int flags)
 {
     int raise = 0;
@@ -226,7 +235,7 @@ uint32_t helper_fadd(CPUMBState *env, uint32_t a, uint32_t b)
     CPU_FloatU fd, fa, fb;
     int flags;
 
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     fa.l = a;
     fb.l = b;
     fd.f = float32_add(fa.f, fb.f, &env->fp_status);
@@ -241,7 +250,7 @@ uint32_t helper_frsub(CPUMBState *env, uint32_t a, uint32_t b)
     CPU_FloatU fd, fa, fb;
     int flags;
 
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     fa.l = a;
     fb.l = b;
     fd.f = float32_sub(fb.f, fa.f, &env->fp_status);
@@ -255,7 +264,7 @@ uint32_t helper_fmul(CPUMBState *env, uint32_t a, uint32_t b)
     CPU_FloatU fd, fa, fb;
     int flags;
 
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     fa.l = a;
     fb.l = b;
     fd.f = float32_mul(fa.f, fb.f, &env->fp_status);
@@ -270,7 +279,7 @@ uint32_t helper_fdiv(CPUMBState *env, uint32_t a, uint32_t b)
     CPU_FloatU fd, fa, fb;
     int flags;
 
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     fa.l = a;
     fb.l = b;
     fd.f = float32_div(fb.f, fa.f, &env->fp_status);
@@ -308,7 +317,7 @@ uint32_t helper_fcmp_lt(CPUMBState *env, uint32_t a, uint32_t b)
     int r;
     int flags;
 
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     fa.l = a;
     fb.l = b;
     r = float32_lt(fb.f, fa.f, &env->fp_status);
@@ -324,7 +333,7 @@ uint32_t helper_fcmp_eq(CPUMBState *env, uint32_t a, uint32_t b)
     int flags;
     int r;
 
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     fa.l = a;
     fb.l = b;
     r = float32_eq_quiet(fa.f, fb.f, &env->fp_status);
@@ -342,7 +351,7 @@ uint32_t helper_fcmp_le(CPUMBState *env, uint32_t a, uint32_t b)
 
     fa.l = a;
     fb.l = b;
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     r = float32_le(fb.f, fa.f, &env->fp_status);
     flags = get_float_exception_flags(&env->fp_status);
     update_fpu_flags(env, flags & float_flag_invalid);
@@ -358,7 +367,7 @@ uint32_t helper_fcmp_gt(CPUMBState *env, uint32_t a, uint32_t b)
 
     fa.l = a;
     fb.l = b;
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     r = float32_lt(fa.f, fb.f, &env->fp_status);
     flags = get_float_exception_flags(&env->fp_status);
     update_fpu_flags(env, flags & float_flag_invalid);
@@ -372,7 +381,7 @@ uint32_t helper_fcmp_ne(CPUMBState *env, uint32_t a, uint32_t b)
 
     fa.l = a;
     fb.l = b;
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     r = !float32_eq_quiet(fa.f, fb.f, &env->fp_status);
     flags = get_float_exception_flags(&env->fp_status);
     update_fpu_flags(env, flags & float_flag_invalid);
@@ -387,7 +396,7 @@ uint32_t helper_fcmp_ge(CPUMBState *env, uint32_t a, uint32_t b)
 
     fa.l = a;
     fb.l = b;
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     r = !float32_lt(fb.f, fa.f, &env->fp_status);
     flags = get_float_exception_flags(&env->fp_status);
     update_fpu_flags(env, flags & float_flag_invalid);
@@ -410,7 +419,7 @@ uint32_t helper_fint(CPUMBState *env, uint32_t a)
     uint32_t r;
     int flags;
 
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     fa.l = a;
     r = float32_to_int32_round_to_zero(fa.f, &env->fp_status);
     flags = get_float_exception_flags(&env->fp_status);
@@ -424,7 +433,7 @@ uint32_t helper_fsqrt(CPUMBState *env, uint32_t a)
     CPU_FloatU fd, fa;
     int flags;
 
-    set_float_exception_flags(0, &env->fp_status);
+    clear_fpu_flags(env);
     fa.l = a;
     fd.l = float32_sqrt(fa.f, &env->fp_status);
     flags = get_float_exception_flags(&env->fp_status);
@@ -89,6 +89,8 @@ typedef struct DisasContext {
 #define JMP_INDIRECT  3
     unsigned int jmp;
     uint32_t jmp_pc;
+    /* env_btaken/env_btarget hold the state of a direct jump.  */
+    bool jmp_synced;
 
     int abort_at_next_insn;
     struct TranslationBlock *tb;
@@ -825,14 +827,20 @@ static void dec_bit(DisasContext *dc)
     }
 }
 
+/*
+ * Store the state of a pending direct jump so that a fault in the delay
+ * slot sees it. The target stays known at translation time, so the jump
+ * can still be chained.
+ */
 static inline void sync_jmpstate(DisasContext *dc)
 {
-    if (dc->jmp == JMP_DIRECT || dc->jmp == JMP_DIRECT_CC) {
+    if ((dc->jmp == JMP_DIRECT || dc->jmp == JMP_DIRECT_CC)
+        && !dc->jmp_synced) {
         if (dc->jmp == JMP_DIRECT) {
             tcg_gen_movi_i32(env_btaken, 1);
         }
-        dc->jmp = JMP_INDIRECT;
         tcg_gen_movi_i64(env_btarget, dc->jmp_pc);
+        dc->jmp_synced = true;
     }
 }
 
@@ -1209,6 +1217,7 @@ static void dec_bcc(DisasContext *dc)
         tcg_gen_movi_i64(env_btarget, dc->pc + offset);
         dc->jmp = JMP_DIRECT_CC;
         dc->jmp_pc = dc->pc + offset;
+        dc->jmp_synced = true;
     } else {
         dc->jmp = JMP_INDIRECT;
         tcg_gen_extu_i32_i64(env_btarget, *(dec_alu_op_b(dc)));
@@ -1282,6 +1291,7 @@ static void dec_br(DisasContext *dc)
         if (dec_alu_op_b_is_small_imm(dc)) {
             dc->jmp = JMP_DIRECT;
             dc->jmp_pc = dc->pc + (int32_t)((int16_t)dc->imm);
+            dc->jmp_synced = false;
         } else {
             tcg_gen_movi_i32(env_btaken, 1);
             tcg_gen_extu_i32_i64(env_btarget, *(dec_alu_op_b(dc)));
@@ -1604,17 +1614,18 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb, int max_insns)
     uint32_t pc_start;
     struct DisasContext ctx;
     struct DisasContext *dc = &ctx;
-    uint32_t page_start, org_flags;
+    uint32_t page_start;
     uint32_t npc;
     int num_insns;
 
     pc_start = tb->pc;
     dc->cpu = cpu;
     dc->tb = tb;
-    org_flags = dc->synced_flags = dc->tb_flags = tb->flags;
+    dc->synced_flags = dc->tb_flags = tb->flags;
 
     dc->is_jmp = DISAS_NEXT;
     dc->jmp = 0;
+    dc->jmp_synced = false;
     dc->delayed_branch = !!(dc->tb_flags & D_FLAG);
     if (dc->delayed_branch) {
         dc->jmp = JMP_INDIRECT;
@@ -1716,16 +1727,22 @@ void gen_intermediate_code(CPUState *cs, TranslationBlock *tb, int max_insns)
     npc = dc->pc;
     if (dc->jmp == JMP_DIRECT || dc->jmp == JMP_DIRECT_CC) {
         if (dc->tb_flags & D_FLAG) {
-            dc->is_jmp = DISAS_UPDATE;
-            tcg_gen_movi_i64(cpu_SR[SR_PC], npc);
+            /*
+             * The TB ends between a branch and its delay slot. The next
+             * TB picks the jump up from env_btaken/env_btarget, the
+             * delay slot and imm state travel in the TB flags, so the
+             * two can still be chained.
+             */
             sync_jmpstate(dc);
         } else
             npc = dc->jmp_pc;
     }
 
-    /* Force an update if the per-tb cpu state has changed.  */
-    if (dc->is_jmp == DISAS_NEXT
-        && (dc->cpustate_changed || org_flags != dc->tb_flags)) {
+    /*
+     * Force an update if the per-tb cpu state has changed. Changes to
+     * iflags are synced below and are part of the next TB's key.
+     */
+    if (dc->is_jmp == DISAS_NEXT && dc->cpustate_changed) {
         dc->is_jmp = DISAS_UPDATE;
         tcg_gen_movi_i64(cpu_SR[SR_PC], npc);
     }
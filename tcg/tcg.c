@@ -187,6 +187,12 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    /* regions reclaimed by tcg_region_evict(), handed out before a flush */
+    size_t *free;
+    size_t n_free;
+    /* when each region was handed out; the oldest is evicted first */
+    uint64_t *alloc_seq;
+    uint64_t seq;
 };
 
 static struct tcg_region_state region;
@@ -399,22 +405,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+static size_t tc_ptr_to_region_idx(void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
 
     if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
     }
-    return region_trees + region_idx * tree_size;
+    return offset / region.stride;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+{
+    return region_trees + tc_ptr_to_region_idx(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -549,11 +556,17 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t curr_region;
+
+    if (region.current < region.n) {
+        curr_region = region.current++;
+    } else if (region.n_free) {
+        curr_region = region.free[--region.n_free];
+    } else {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    region.alloc_seq[curr_region] = ++region.seq;
+    tcg_region_assign(s, curr_region);
     return false;
 }
 
@@ -594,6 +607,7 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.n_free = 0;
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = atomic_read(&tcg_ctxs[i]);
@@ -606,47 +620,109 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
-#ifdef CONFIG_USER_ONLY
-static size_t tcg_n_regions(void)
+/*
+ * Reclaim the oldest regions that no context is translating into, so that
+ * the code buffer can be reused without a full flush.  @invalidate is called
+ * on every TB of those regions and must unlink it from everything that can
+ * still reach it; the TB structs themselves live in the regions.
+ * A quarter of the regions is evicted at a time, to amortize the safe work.
+ * Returns the number of evicted regions, 0 if there already is room, or -1
+ * if no region can be evicted, in which case the caller must flush instead.
+ * Call from a safe-work context.
+ */
+int tcg_region_evict(GTraverseFunc invalidate)
 {
-    return 1;
+    unsigned int n_ctxs = atomic_read(&n_tcg_ctxs);
+    size_t n_evict = MAX(region.n / 4, 1);
+    size_t n = 0;
+    bool *busy;
+    size_t i;
+
+    qemu_mutex_lock(&region.lock);
+    if (region.n_free || region.current < region.n) {
+        /* A request from another vCPU got here first */
+        qemu_mutex_unlock(&region.lock);
+        return 0;
+    }
+
+    busy = g_new0(bool, region.n);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = atomic_read(&tcg_ctxs[i]);
+
+        busy[tc_ptr_to_region_idx(s->code_gen_buffer)] = true;
+    }
+
+    while (n < n_evict) {
+        struct tcg_region_tree *rt;
+        size_t victim = region.n;
+        void *start, *end;
+
+        for (i = 0; i < region.n; i++) {
+            if (!busy[i] && (victim == region.n ||
+                             region.alloc_seq[i] < region.alloc_seq[victim])) {
+                victim = i;
+            }
+        }
+        if (victim == region.n) {
+            break;
+        }
+        busy[victim] = true;
+
+        rt = region_trees + victim * tree_size;
+        qemu_mutex_lock(&rt->lock);
+        g_tree_foreach(rt->tree, invalidate, NULL);
+        /* Increment the refcount first so that destroy acts as a reset */
+        g_tree_ref(rt->tree);
+        g_tree_destroy(rt->tree);
+        qemu_mutex_unlock(&rt->lock);
+
+        tcg_region_bounds(victim, &start, &end);
+        region.agg_size_full -= end - start - TCG_HIGHWATER;
+        region.free[region.n_free++] = victim;
+        n++;
+    }
+    g_free(busy);
+    qemu_mutex_unlock(&region.lock);
+    return n ? n : -1;
 }
-#else
+
 /*
  * It is likely that some vCPUs will translate more code than others, so we
- * first try to set more regions than max_cpus, with those regions being of
+ * first try to set more regions than threads, with those regions being of
  * reasonable size. If that's not possible we make do by evenly dividing
- * the code_gen_buffer among the vCPUs.
+ * the code_gen_buffer among the threads.
+ * Even a single thread gets several regions when the buffer is large
+ * enough: they are what tcg_region_evict() recycles.
  */
 static size_t tcg_n_regions(void)
 {
     size_t i;
-
-    /* Use a single region if all we have is one vCPU thread */
-#if !defined(CONFIG_USER_ONLY)
+#ifdef CONFIG_USER_ONLY
+    unsigned int threads = 1;
+#else
     MachineState *ms = MACHINE(qdev_get_machine());
-    unsigned int max_cpus = ms->smp.max_cpus;
-#endif
-    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+    unsigned int threads = ms->smp.max_cpus;
+
+    if (!qemu_tcg_mttcg_enabled()) {
+        threads = 1;
     }
+#endif
 
-    /* Try to have more regions than max_cpus, with each region being >= 2 MB */
+    /* Try to have more regions than threads, with each region being >= 2 MB */
     for (i = 8; i > 0; i--) {
         size_t regions_per_thread = i;
         size_t region_size;
 
         region_size = tcg_init_ctx.code_gen_buffer_size;
-        region_size /= max_cpus * regions_per_thread;
+        region_size /= threads * regions_per_thread;
 
         if (region_size >= 2 * 1024u * 1024) {
-            return max_cpus * regions_per_thread;
+            return threads * regions_per_thread;
         }
     }
     /* If we can't, then just allocate one region per vCPU thread */
-    return max_cpus;
+    return threads;
 }
-#endif
 
 /*
  * Initializes region partitioning.
@@ -659,18 +735,19 @@ static size_t tcg_n_regions(void)
  * code in parallel without synchronization.
  *
  * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
+ * least max_cpus regions in MTTCG. In !MTTCG there is a single thread.
  * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
  *
- * In user-mode we use a single region.  Having multiple regions in user-mode
+ * In user-mode we use a single TCG context.  A context per thread in user-mode
  * is not supported, because the number of vCPU threads (recall that each thread
  * spawned by the guest corresponds to a vCPU thread) is only bounded by the
  * OS, and usually this number is huge (tens of thousands is not uncommon).
  * Thus, given this large bound on the number of vCPU threads and the fact
  * that code_gen_buffer is allocated at compile-time, we cannot guarantee
- * that the availability of at least one region per vCPU thread.
+ * that the availability of at least one region per vCPU thread.  The single
+ * context still moves through several regions, which lets them be evicted.
  *
  * However, this user-mode limitation is unlikely to be a significant problem
  * in practice. Multi-threaded guests share most if not all of their translated
@@ -705,6 +782,8 @@ void tcg_region_init(void)
     /* init the region struct */
     qemu_mutex_init(&region.lock);
     region.n = n_regions;
+    region.free = g_new(size_t, n_regions);
+    region.alloc_seq = g_new0(uint64_t, n_regions);
     region.size = region_size - page_size;
     region.stride = region_size;
     region.start = buf;
@@ -3815,6 +3894,47 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
 #define STACK_DIR(x) (x)
 #endif
 
+/*
+ * Called before a helper call clobbers @reg.  If @reg holds a value that
+ * would have to be spilled, i.e. one that is not coherent with memory and
+ * that the helper does not need in memory, move it to a free call-saved
+ * register instead: one move replaces a store now and a load later.
+ * Globals only qualify for helpers that do not access them at all, since
+ * the others need the globals in memory anyway.
+ */
+static bool tcg_reg_preserve(TCGContext *s, TCGReg reg,
+                             TCGRegSet allocated_regs, int flags)
+{
+    TCGTemp *ts = s->reg_to_temp[reg];
+    TCGRegSet set;
+    int i;
+
+    if (ts == NULL || ts->mem_coherent || ts->fixed_reg) {
+        return false;
+    }
+    if (ts->temp_global && !(flags & TCG_CALL_NO_READ_GLOBALS)) {
+        return false;
+    }
+
+    set = tcg_target_available_regs[ts->type] & ~tcg_target_call_clobber_regs;
+    set &= ~allocated_regs;
+    for (i = 0; i < ARRAY_SIZE(tcg_target_reg_alloc_order); i++) {
+        TCGReg new_reg = tcg_target_reg_alloc_order[i];
+
+        if (s->reg_to_temp[new_reg] == NULL &&
+            tcg_regset_test_reg(set, new_reg)) {
+            if (!tcg_out_mov(s, ts->type, new_reg, reg)) {
+                return false;
+            }
+            s->reg_to_temp[reg] = NULL;
+            s->reg_to_temp[new_reg] = ts;
+            ts->reg = new_reg;
+            return true;
+        }
+    }
+    return false;
+}
+
 static void tcg_reg_alloc_call(TCGContext *s, TCGOp *op)
 {
     const int nb_oargs = TCGOP_CALLO(op);
@@ -3906,9 +4026,10 @@ static void tcg_reg_alloc_call(TCGContext *s, TCGOp *op)
         }
     }
     
-    /* clobber call registers */
+    /* clobber call registers, keeping what we can in call-saved ones */
     for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
-        if (tcg_regset_test_reg(tcg_target_call_clobber_regs, i)) {
+        if (tcg_regset_test_reg(tcg_target_call_clobber_regs, i) &&
+            !tcg_reg_preserve(s, i, allocated_regs, flags)) {
             tcg_reg_free(s, i, allocated_regs);
         }
     }
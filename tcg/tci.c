@@ -474,9 +474,208 @@ static bool tci_compare64(uint64_t u0, uint64_t u1, TCGCond condition)
 # define qemu_st_beq(X)  stq_be_p(g2h(taddr), X)
 #endif
 
+/*
+ * Each operation ends by decoding the next one and jumping to it through
+ * tci_dispatch, rather than going back to the top of the loop.  This
+ * gives every operation its own indirect branch, which the host branch
+ * predictor learns far better than the single one of the switch.  The
+ * switch is still used to enter a TB and after a break out of an
+ * operation body.
+ */
+#define TCI_CASE(name)  case INDEX_op_##name: op_##name
+
+#if defined(CONFIG_DEBUG_TCG) && !defined(NDEBUG)
+# define TCI_OP_START() (op_size = tb_ptr[1], old_code_ptr = tb_ptr)
+#else
+# define TCI_OP_START() ((void)0)
+#endif
+
+#if defined(GETPC)
+# define TCI_SET_TB_PTR() (tci_tb_ptr = (uintptr_t)tb_ptr)
+#else
+# define TCI_SET_TB_PTR() ((void)0)
+#endif
+
+/* Go to the operation at tb_ptr */
+#define TCI_DISPATCH() \
+    do { \
+        opc = tb_ptr[0]; \
+        TCI_OP_START(); \
+        TCI_SET_TB_PTR(); \
+        tb_ptr += 2; \
+        goto *tci_dispatch[opc]; \
+    } while (0)
+
+/* Go to the operation following the current one */
+#define TCI_NEXT() \
+    do { \
+        tci_assert(tb_ptr == old_code_ptr + op_size); \
+        TCI_DISPATCH(); \
+    } while (0)
+
 /* Interpret pseudo code in tb. */
 uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
 {
+    static const void *const tci_dispatch[NB_OPS] = {
+        [0 ... NB_OPS - 1] = &&op_default,
+        [INDEX_op_call] = &&op_call,
+        [INDEX_op_br] = &&op_br,
+        [INDEX_op_setcond_i32] = &&op_setcond_i32,
+#if TCG_TARGET_REG_BITS == 32
+        [INDEX_op_setcond2_i32] = &&op_setcond2_i32,
+#elif TCG_TARGET_REG_BITS == 64
+        [INDEX_op_setcond_i64] = &&op_setcond_i64,
+#endif
+        [INDEX_op_mov_i32] = &&op_mov_i32,
+        [INDEX_op_movi_i32] = &&op_movi_i32,
+        [INDEX_op_ld8u_i32] = &&op_ld8u_i32,
+        [INDEX_op_ld8s_i32] = &&op_ld8s_i32,
+        [INDEX_op_ld16u_i32] = &&op_ld16u_i32,
+        [INDEX_op_ld16s_i32] = &&op_ld16s_i32,
+        [INDEX_op_ld_i32] = &&op_ld_i32,
+        [INDEX_op_st8_i32] = &&op_st8_i32,
+        [INDEX_op_st16_i32] = &&op_st16_i32,
+        [INDEX_op_st_i32] = &&op_st_i32,
+        [INDEX_op_add_i32] = &&op_add_i32,
+        [INDEX_op_sub_i32] = &&op_sub_i32,
+        [INDEX_op_mul_i32] = &&op_mul_i32,
+#if TCG_TARGET_HAS_div_i32
+        [INDEX_op_div_i32] = &&op_div_i32,
+        [INDEX_op_divu_i32] = &&op_divu_i32,
+        [INDEX_op_rem_i32] = &&op_rem_i32,
+        [INDEX_op_remu_i32] = &&op_remu_i32,
+#elif TCG_TARGET_HAS_div2_i32
+        [INDEX_op_div2_i32] = &&op_div2_i32,
+        [INDEX_op_divu2_i32] = &&op_divu2_i32,
+#endif
+        [INDEX_op_and_i32] = &&op_and_i32,
+        [INDEX_op_or_i32] = &&op_or_i32,
+        [INDEX_op_xor_i32] = &&op_xor_i32,
+        [INDEX_op_shl_i32] = &&op_shl_i32,
+        [INDEX_op_shr_i32] = &&op_shr_i32,
+        [INDEX_op_sar_i32] = &&op_sar_i32,
+#if TCG_TARGET_HAS_rot_i32
+        [INDEX_op_rotl_i32] = &&op_rotl_i32,
+        [INDEX_op_rotr_i32] = &&op_rotr_i32,
+#endif
+#if TCG_TARGET_HAS_deposit_i32
+        [INDEX_op_deposit_i32] = &&op_deposit_i32,
+#endif
+        [INDEX_op_brcond_i32] = &&op_brcond_i32,
+#if TCG_TARGET_REG_BITS == 32
+        [INDEX_op_add2_i32] = &&op_add2_i32,
+        [INDEX_op_sub2_i32] = &&op_sub2_i32,
+        [INDEX_op_brcond2_i32] = &&op_brcond2_i32,
+        [INDEX_op_mulu2_i32] = &&op_mulu2_i32,
+#endif /* TCG_TARGET_REG_BITS == 32 */
+#if TCG_TARGET_HAS_ext8s_i32
+        [INDEX_op_ext8s_i32] = &&op_ext8s_i32,
+#endif
+#if TCG_TARGET_HAS_ext16s_i32
+        [INDEX_op_ext16s_i32] = &&op_ext16s_i32,
+#endif
+#if TCG_TARGET_HAS_ext8u_i32
+        [INDEX_op_ext8u_i32] = &&op_ext8u_i32,
+#endif
+#if TCG_TARGET_HAS_ext16u_i32
+        [INDEX_op_ext16u_i32] = &&op_ext16u_i32,
+#endif
+#if TCG_TARGET_HAS_bswap16_i32
+        [INDEX_op_bswap16_i32] = &&op_bswap16_i32,
+#endif
+#if TCG_TARGET_HAS_bswap32_i32
+        [INDEX_op_bswap32_i32] = &&op_bswap32_i32,
+#endif
+#if TCG_TARGET_HAS_not_i32
+        [INDEX_op_not_i32] = &&op_not_i32,
+#endif
+#if TCG_TARGET_HAS_neg_i32
+        [INDEX_op_neg_i32] = &&op_neg_i32,
+#endif
+#if TCG_TARGET_REG_BITS == 64
+        [INDEX_op_mov_i64] = &&op_mov_i64,
+        [INDEX_op_movi_i64] = &&op_movi_i64,
+        [INDEX_op_ld8u_i64] = &&op_ld8u_i64,
+        [INDEX_op_ld8s_i64] = &&op_ld8s_i64,
+        [INDEX_op_ld16u_i64] = &&op_ld16u_i64,
+        [INDEX_op_ld16s_i64] = &&op_ld16s_i64,
+        [INDEX_op_ld32u_i64] = &&op_ld32u_i64,
+        [INDEX_op_ld32s_i64] = &&op_ld32s_i64,
+        [INDEX_op_ld_i64] = &&op_ld_i64,
+        [INDEX_op_st8_i64] = &&op_st8_i64,
+        [INDEX_op_st16_i64] = &&op_st16_i64,
+        [INDEX_op_st32_i64] = &&op_st32_i64,
+        [INDEX_op_st_i64] = &&op_st_i64,
+        [INDEX_op_add_i64] = &&op_add_i64,
+        [INDEX_op_sub_i64] = &&op_sub_i64,
+        [INDEX_op_mul_i64] = &&op_mul_i64,
+#if TCG_TARGET_HAS_div_i64
+        [INDEX_op_div_i64] = &&op_div_i64,
+        [INDEX_op_divu_i64] = &&op_divu_i64,
+        [INDEX_op_rem_i64] = &&op_rem_i64,
+        [INDEX_op_remu_i64] = &&op_remu_i64,
+#elif TCG_TARGET_HAS_div2_i64
+        [INDEX_op_div2_i64] = &&op_div2_i64,
+        [INDEX_op_divu2_i64] = &&op_divu2_i64,
+#endif
+        [INDEX_op_and_i64] = &&op_and_i64,
+        [INDEX_op_or_i64] = &&op_or_i64,
+        [INDEX_op_xor_i64] = &&op_xor_i64,
+        [INDEX_op_shl_i64] = &&op_shl_i64,
+        [INDEX_op_shr_i64] = &&op_shr_i64,
+        [INDEX_op_sar_i64] = &&op_sar_i64,
+#if TCG_TARGET_HAS_rot_i64
+        [INDEX_op_rotl_i64] = &&op_rotl_i64,
+        [INDEX_op_rotr_i64] = &&op_rotr_i64,
+#endif
+#if TCG_TARGET_HAS_deposit_i64
+        [INDEX_op_deposit_i64] = &&op_deposit_i64,
+#endif
+        [INDEX_op_brcond_i64] = &&op_brcond_i64,
+#if TCG_TARGET_HAS_ext8u_i64
+        [INDEX_op_ext8u_i64] = &&op_ext8u_i64,
+#endif
+#if TCG_TARGET_HAS_ext8s_i64
+        [INDEX_op_ext8s_i64] = &&op_ext8s_i64,
+#endif
+#if TCG_TARGET_HAS_ext16s_i64
+        [INDEX_op_ext16s_i64] = &&op_ext16s_i64,
+#endif
+#if TCG_TARGET_HAS_ext16u_i64
+        [INDEX_op_ext16u_i64] = &&op_ext16u_i64,
+#endif
+#if TCG_TARGET_HAS_ext32s_i64
+        [INDEX_op_ext32s_i64] = &&op_ext32s_i64,
+#endif
+        [INDEX_op_ext_i32_i64] = &&op_ext_i32_i64,
+#if TCG_TARGET_HAS_ext32u_i64
+        [INDEX_op_ext32u_i64] = &&op_ext32u_i64,
+#endif
+        [INDEX_op_extu_i32_i64] = &&op_extu_i32_i64,
+#if TCG_TARGET_HAS_bswap16_i64
+        [INDEX_op_bswap16_i64] = &&op_bswap16_i64,
+#endif
+#if TCG_TARGET_HAS_bswap32_i64
+        [INDEX_op_bswap32_i64] = &&op_bswap32_i64,
+#endif
+#if TCG_TARGET_HAS_bswap64_i64
+        [INDEX_op_bswap64_i64] = &&op_bswap64_i64,
+#endif
+#if TCG_TARGET_HAS_not_i64
+        [INDEX_op_not_i64] = &&op_not_i64,
+#endif
+#if TCG_TARGET_HAS_neg_i64
+        [INDEX_op_neg_i64] = &&op_neg_i64,
+#endif
+#endif /* TCG_TARGET_REG_BITS == 64 */
+        [INDEX_op_exit_tb] = &&op_exit_tb,
+        [INDEX_op_goto_tb] = &&op_goto_tb,
+        [INDEX_op_qemu_ld_i32] = &&op_qemu_ld_i32,
+        [INDEX_op_qemu_ld_i64] = &&op_qemu_ld_i64,
+        [INDEX_op_qemu_st_i32] = &&op_qemu_st_i32,
+        [INDEX_op_qemu_st_i64] = &&op_qemu_st_i64,
+        [INDEX_op_mb] = &&op_mb,
+    };
     tcg_target_ulong regs[TCG_TARGET_NB_REGS];
     long tcg_temps[CPU_TEMP_BUF_NLONGS];
     uintptr_t sp_value = (uintptr_t)(tcg_temps + CPU_TEMP_BUF_NLONGS);
@@ -507,15 +706,13 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
 #endif
         TCGMemOpIdx oi;
 
-#if defined(GETPC)
-        tci_tb_ptr = (uintptr_t)tb_ptr;
-#endif
+        TCI_SET_TB_PTR();
 
         /* Skip opcode and size entry. */
         tb_ptr += 2;
 
         switch (opc) {
-        case INDEX_op_call:
+        TCI_CASE(call):
             t0 = tci_read_ri(regs, &tb_ptr);
 #if TCG_TARGET_REG_BITS == 32
             tmp64 = ((helper_function)t0)(tci_read_reg(regs, TCG_REG_R0),
@@ -541,196 +738,196 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
                                           tci_read_reg(regs, TCG_REG_R6));
             tci_write_reg(regs, TCG_REG_R0, tmp64);
 #endif
-            break;
-        case INDEX_op_br:
+            TCI_NEXT();
+        TCI_CASE(br):
             label = tci_read_label(&tb_ptr);
             tci_assert(tb_ptr == old_code_ptr + op_size);
             tb_ptr = (uint8_t *)label;
-            continue;
-        case INDEX_op_setcond_i32:
+            TCI_DISPATCH();
+        TCI_CASE(setcond_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             condition = *tb_ptr++;
             tci_write_reg32(regs, t0, tci_compare32(t1, t2, condition));
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_setcond2_i32:
+        TCI_CASE(setcond2_i32):
             t0 = *tb_ptr++;
             tmp64 = tci_read_r64(regs, &tb_ptr);
             v64 = tci_read_ri64(regs, &tb_ptr);
             condition = *tb_ptr++;
             tci_write_reg32(regs, t0, tci_compare64(tmp64, v64, condition));
-            break;
+            TCI_NEXT();
 #elif TCG_TARGET_REG_BITS == 64
-        case INDEX_op_setcond_i64:
+        TCI_CASE(setcond_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             condition = *tb_ptr++;
             tci_write_reg64(regs, t0, tci_compare64(t1, t2, condition));
-            break;
+            TCI_NEXT();
 #endif
-        case INDEX_op_mov_i32:
+        TCI_CASE(mov_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
-        case INDEX_op_movi_i32:
+            TCI_NEXT();
+        TCI_CASE(movi_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_i32(&tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
+            TCI_NEXT();
 
             /* Load/store operations (32 bit). */
 
-        case INDEX_op_ld8u_i32:
+        TCI_CASE(ld8u_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld8s_i32:
+            TCI_NEXT();
+        TCI_CASE(ld8s_i32):
             TODO();
-            break;
-        case INDEX_op_ld16u_i32:
+            TCI_NEXT();
+        TCI_CASE(ld16u_i32):
             TODO();
-            break;
-        case INDEX_op_ld16s_i32:
+            TCI_NEXT();
+        TCI_CASE(ld16s_i32):
             TODO();
-            break;
-        case INDEX_op_ld_i32:
+            TCI_NEXT();
+        TCI_CASE(ld_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
-            break;
-        case INDEX_op_st8_i32:
+            TCI_NEXT();
+        TCI_CASE(st8_i32):
             t0 = tci_read_r8(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             *(uint8_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st16_i32:
+            TCI_NEXT();
+        TCI_CASE(st16_i32):
             t0 = tci_read_r16(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             *(uint16_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st_i32:
+            TCI_NEXT();
+        TCI_CASE(st_i32):
             t0 = tci_read_r32(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_assert(t1 != sp_value || (int32_t)t2 < 0);
             *(uint32_t *)(t1 + t2) = t0;
-            break;
+            TCI_NEXT();
 
             /* Arithmetic operations (32 bit). */
 
-        case INDEX_op_add_i32:
+        TCI_CASE(add_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 + t2);
-            break;
-        case INDEX_op_sub_i32:
+            TCI_NEXT();
+        TCI_CASE(sub_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 - t2);
-            break;
-        case INDEX_op_mul_i32:
+            TCI_NEXT();
+        TCI_CASE(mul_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 * t2);
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_div_i32
-        case INDEX_op_div_i32:
+        TCI_CASE(div_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, (int32_t)t1 / (int32_t)t2);
-            break;
-        case INDEX_op_divu_i32:
+            TCI_NEXT();
+        TCI_CASE(divu_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 / t2);
-            break;
-        case INDEX_op_rem_i32:
+            TCI_NEXT();
+        TCI_CASE(rem_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, (int32_t)t1 % (int32_t)t2);
-            break;
-        case INDEX_op_remu_i32:
+            TCI_NEXT();
+        TCI_CASE(remu_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 % t2);
-            break;
+            TCI_NEXT();
 #elif TCG_TARGET_HAS_div2_i32
-        case INDEX_op_div2_i32:
-        case INDEX_op_divu2_i32:
+        TCI_CASE(div2_i32):
+        TCI_CASE(divu2_i32):
             TODO();
-            break;
+            TCI_NEXT();
 #endif
-        case INDEX_op_and_i32:
+        TCI_CASE(and_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 & t2);
-            break;
-        case INDEX_op_or_i32:
+            TCI_NEXT();
+        TCI_CASE(or_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 | t2);
-            break;
-        case INDEX_op_xor_i32:
+            TCI_NEXT();
+        TCI_CASE(xor_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 ^ t2);
-            break;
+            TCI_NEXT();
 
             /* Shift/rotate operations (32 bit). */
 
-        case INDEX_op_shl_i32:
+        TCI_CASE(shl_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 << (t2 & 31));
-            break;
-        case INDEX_op_shr_i32:
+            TCI_NEXT();
+        TCI_CASE(shr_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1 >> (t2 & 31));
-            break;
-        case INDEX_op_sar_i32:
+            TCI_NEXT();
+        TCI_CASE(sar_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, ((int32_t)t1 >> (t2 & 31)));
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_rot_i32
-        case INDEX_op_rotl_i32:
+        TCI_CASE(rotl_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, rol32(t1, t2 & 31));
-            break;
-        case INDEX_op_rotr_i32:
+            TCI_NEXT();
+        TCI_CASE(rotr_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_ri32(regs, &tb_ptr);
             t2 = tci_read_ri32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, ror32(t1, t2 & 31));
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_deposit_i32
-        case INDEX_op_deposit_i32:
+        TCI_CASE(deposit_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             t2 = tci_read_r32(regs, &tb_ptr);
@@ -738,9 +935,9 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             tmp8 = *tb_ptr++;
             tmp32 = (((1 << tmp8) - 1) << tmp16);
             tci_write_reg32(regs, t0, (t1 & ~tmp32) | ((t2 << tmp16) & tmp32));
-            break;
+            TCI_NEXT();
 #endif
-        case INDEX_op_brcond_i32:
+        TCI_CASE(brcond_i32):
             t0 = tci_read_r32(regs, &tb_ptr);
             t1 = tci_read_ri32(regs, &tb_ptr);
             condition = *tb_ptr++;
@@ -748,25 +945,25 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             if (tci_compare32(t0, t1, condition)) {
                 tci_assert(tb_ptr == old_code_ptr + op_size);
                 tb_ptr = (uint8_t *)label;
-                continue;
+                TCI_DISPATCH();
             }
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_REG_BITS == 32
-        case INDEX_op_add2_i32:
+        TCI_CASE(add2_i32):
             t0 = *tb_ptr++;
             t1 = *tb_ptr++;
             tmp64 = tci_read_r64(regs, &tb_ptr);
             tmp64 += tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t1, t0, tmp64);
-            break;
-        case INDEX_op_sub2_i32:
+            TCI_NEXT();
+        TCI_CASE(sub2_i32):
             t0 = *tb_ptr++;
             t1 = *tb_ptr++;
             tmp64 = tci_read_r64(regs, &tb_ptr);
             tmp64 -= tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t1, t0, tmp64);
-            break;
-        case INDEX_op_brcond2_i32:
+            TCI_NEXT();
+        TCI_CASE(brcond2_i32):
             tmp64 = tci_read_r64(regs, &tb_ptr);
             v64 = tci_read_ri64(regs, &tb_ptr);
             condition = *tb_ptr++;
@@ -774,237 +971,237 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             if (tci_compare64(tmp64, v64, condition)) {
                 tci_assert(tb_ptr == old_code_ptr + op_size);
                 tb_ptr = (uint8_t *)label;
-                continue;
+                TCI_DISPATCH();
             }
-            break;
-        case INDEX_op_mulu2_i32:
+            TCI_NEXT();
+        TCI_CASE(mulu2_i32):
             t0 = *tb_ptr++;
             t1 = *tb_ptr++;
             t2 = tci_read_r32(regs, &tb_ptr);
             tmp64 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg64(regs, t1, t0, t2 * tmp64);
-            break;
+            TCI_NEXT();
 #endif /* TCG_TARGET_REG_BITS == 32 */
 #if TCG_TARGET_HAS_ext8s_i32
-        case INDEX_op_ext8s_i32:
+        TCI_CASE(ext8s_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r8s(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16s_i32
-        case INDEX_op_ext16s_i32:
+        TCI_CASE(ext16s_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r16s(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext8u_i32
-        case INDEX_op_ext8u_i32:
+        TCI_CASE(ext8u_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r8(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16u_i32
-        case INDEX_op_ext16u_i32:
+        TCI_CASE(ext16u_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r16(regs, &tb_ptr);
             tci_write_reg32(regs, t0, t1);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap16_i32
-        case INDEX_op_bswap16_i32:
+        TCI_CASE(bswap16_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r16(regs, &tb_ptr);
             tci_write_reg32(regs, t0, bswap16(t1));
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap32_i32
-        case INDEX_op_bswap32_i32:
+        TCI_CASE(bswap32_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, bswap32(t1));
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_not_i32
-        case INDEX_op_not_i32:
+        TCI_CASE(not_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, ~t1);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_neg_i32
-        case INDEX_op_neg_i32:
+        TCI_CASE(neg_i32):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg32(regs, t0, -t1);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_REG_BITS == 64
-        case INDEX_op_mov_i64:
+        TCI_CASE(mov_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
-        case INDEX_op_movi_i64:
+            TCI_NEXT();
+        TCI_CASE(movi_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_i64(&tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            TCI_NEXT();
 
             /* Load/store operations (64 bit). */
 
-        case INDEX_op_ld8u_i64:
+        TCI_CASE(ld8u_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg8(regs, t0, *(uint8_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld8s_i64:
+            TCI_NEXT();
+        TCI_CASE(ld8s_i64):
             TODO();
-            break;
-        case INDEX_op_ld16u_i64:
+            TCI_NEXT();
+        TCI_CASE(ld16u_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg16(regs, t0, *(uint16_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld16s_i64:
+            TCI_NEXT();
+        TCI_CASE(ld16s_i64):
             TODO();
-            break;
-        case INDEX_op_ld32u_i64:
+            TCI_NEXT();
+        TCI_CASE(ld32u_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg32(regs, t0, *(uint32_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld32s_i64:
+            TCI_NEXT();
+        TCI_CASE(ld32s_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg32s(regs, t0, *(int32_t *)(t1 + t2));
-            break;
-        case INDEX_op_ld_i64:
+            TCI_NEXT();
+        TCI_CASE(ld_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_write_reg64(regs, t0, *(uint64_t *)(t1 + t2));
-            break;
-        case INDEX_op_st8_i64:
+            TCI_NEXT();
+        TCI_CASE(st8_i64):
             t0 = tci_read_r8(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             *(uint8_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st16_i64:
+            TCI_NEXT();
+        TCI_CASE(st16_i64):
             t0 = tci_read_r16(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             *(uint16_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st32_i64:
+            TCI_NEXT();
+        TCI_CASE(st32_i64):
             t0 = tci_read_r32(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             *(uint32_t *)(t1 + t2) = t0;
-            break;
-        case INDEX_op_st_i64:
+            TCI_NEXT();
+        TCI_CASE(st_i64):
             t0 = tci_read_r64(regs, &tb_ptr);
             t1 = tci_read_r(regs, &tb_ptr);
             t2 = tci_read_s32(&tb_ptr);
             tci_assert(t1 != sp_value || (int32_t)t2 < 0);
             *(uint64_t *)(t1 + t2) = t0;
-            break;
+            TCI_NEXT();
 
             /* Arithmetic operations (64 bit). */
 
-        case INDEX_op_add_i64:
+        TCI_CASE(add_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_ri64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 + t2);
-            break;
-        case INDEX_op_sub_i64:
+            TCI_NEXT();
+        TCI_CASE(sub_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_ri64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 - t2);
-            break;
-        case INDEX_op_mul_i64:
+            TCI_NEXT();
+        TCI_CASE(mul_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_ri64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 * t2);
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_div_i64
-        case INDEX_op_div_i64:
-        case INDEX_op_divu_i64:
-        case INDEX_op_rem_i64:
-        case INDEX_op_remu_i64:
+        TCI_CASE(div_i64):
+        TCI_CASE(divu_i64):
+        TCI_CASE(rem_i64):
+        TCI_CASE(remu_i64):
             TODO();
-            break;
+            TCI_NEXT();
 #elif TCG_TARGET_HAS_div2_i64
-        case INDEX_op_div2_i64:
-        case INDEX_op_divu2_i64:
+        TCI_CASE(div2_i64):
+        TCI_CASE(divu2_i64):
             TODO();
-            break;
+            TCI_NEXT();
 #endif
-        case INDEX_op_and_i64:
+        TCI_CASE(and_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_ri64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 & t2);
-            break;
-        case INDEX_op_or_i64:
+            TCI_NEXT();
+        TCI_CASE(or_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_ri64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 | t2);
-            break;
-        case INDEX_op_xor_i64:
+            TCI_NEXT();
+        TCI_CASE(xor_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_ri64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 ^ t2);
-            break;
+            TCI_NEXT();
 
             /* Shift/rotate operations (64 bit). */
 
-        case INDEX_op_shl_i64:
+        TCI_CASE(shl_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_ri64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 << (t2 & 63));
-            break;
-        case INDEX_op_shr_i64:
+            TCI_NEXT();
+        TCI_CASE(shr_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_ri64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1 >> (t2 & 63));
-            break;
-        case INDEX_op_sar_i64:
+            TCI_NEXT();
+        TCI_CASE(sar_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_ri64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, ((int64_t)t1 >> (t2 & 63)));
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_rot_i64
-        case INDEX_op_rotl_i64:
+        TCI_CASE(rotl_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_ri64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, rol64(t1, t2 & 63));
-            break;
-        case INDEX_op_rotr_i64:
+            TCI_NEXT();
+        TCI_CASE(rotr_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_ri64(regs, &tb_ptr);
             t2 = tci_read_ri64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, ror64(t1, t2 & 63));
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_deposit_i64
-        case INDEX_op_deposit_i64:
+        TCI_CASE(deposit_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
             t2 = tci_read_r64(regs, &tb_ptr);
@@ -1012,9 +1209,9 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             tmp8 = *tb_ptr++;
             tmp64 = (((1ULL << tmp8) - 1) << tmp16);
             tci_write_reg64(regs, t0, (t1 & ~tmp64) | ((t2 << tmp16) & tmp64));
-            break;
+            TCI_NEXT();
 #endif
-        case INDEX_op_brcond_i64:
+        TCI_CASE(brcond_i64):
             t0 = tci_read_r64(regs, &tb_ptr);
             t1 = tci_read_ri64(regs, &tb_ptr);
             condition = *tb_ptr++;
@@ -1022,105 +1219,105 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             if (tci_compare64(t0, t1, condition)) {
                 tci_assert(tb_ptr == old_code_ptr + op_size);
                 tb_ptr = (uint8_t *)label;
-                continue;
+                TCI_DISPATCH();
             }
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_ext8u_i64
-        case INDEX_op_ext8u_i64:
+        TCI_CASE(ext8u_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r8(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext8s_i64
-        case INDEX_op_ext8s_i64:
+        TCI_CASE(ext8s_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r8s(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16s_i64
-        case INDEX_op_ext16s_i64:
+        TCI_CASE(ext16s_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r16s(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext16u_i64
-        case INDEX_op_ext16u_i64:
+        TCI_CASE(ext16u_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r16(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_ext32s_i64
-        case INDEX_op_ext32s_i64:
+        TCI_CASE(ext32s_i64):
 #endif
-        case INDEX_op_ext_i32_i64:
+        TCI_CASE(ext_i32_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r32s(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_ext32u_i64
-        case INDEX_op_ext32u_i64:
+        TCI_CASE(ext32u_i64):
 #endif
-        case INDEX_op_extu_i32_i64:
+        TCI_CASE(extu_i32_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg64(regs, t0, t1);
-            break;
+            TCI_NEXT();
 #if TCG_TARGET_HAS_bswap16_i64
-        case INDEX_op_bswap16_i64:
+        TCI_CASE(bswap16_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r16(regs, &tb_ptr);
             tci_write_reg64(regs, t0, bswap16(t1));
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap32_i64
-        case INDEX_op_bswap32_i64:
+        TCI_CASE(bswap32_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r32(regs, &tb_ptr);
             tci_write_reg64(regs, t0, bswap32(t1));
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_bswap64_i64
-        case INDEX_op_bswap64_i64:
+        TCI_CASE(bswap64_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, bswap64(t1));
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_not_i64
-        case INDEX_op_not_i64:
+        TCI_CASE(not_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, ~t1);
-            break;
+            TCI_NEXT();
 #endif
 #if TCG_TARGET_HAS_neg_i64
-        case INDEX_op_neg_i64:
+        TCI_CASE(neg_i64):
             t0 = *tb_ptr++;
             t1 = tci_read_r64(regs, &tb_ptr);
             tci_write_reg64(regs, t0, -t1);
-            break;
+            TCI_NEXT();
 #endif
 #endif /* TCG_TARGET_REG_BITS == 64 */
 
             /* QEMU specific operations. */
 
-        case INDEX_op_exit_tb:
+        TCI_CASE(exit_tb):
             ret = *(uint64_t *)tb_ptr;
             goto exit;
-            break;
-        case INDEX_op_goto_tb:
+            TCI_NEXT();
+        TCI_CASE(goto_tb):
             /* Jump address is aligned */
             tb_ptr = QEMU_ALIGN_PTR_UP(tb_ptr, 4);
             t0 = atomic_read((int32_t *)tb_ptr);
             tb_ptr += sizeof(int32_t);
             tci_assert(tb_ptr == old_code_ptr + op_size);
             tb_ptr += (int32_t)t0;
-            continue;
-        case INDEX_op_qemu_ld_i32:
+            TCI_DISPATCH();
+        TCI_CASE(qemu_ld_i32):
             t0 = *tb_ptr++;
             taddr = tci_read_ulong(regs, &tb_ptr);
             oi = tci_read_i(&tb_ptr);
@@ -1153,8 +1350,8 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
                 tcg_abort();
             }
             tci_write_reg(regs, t0, tmp32);
-            break;
-        case INDEX_op_qemu_ld_i64:
+            TCI_NEXT();
+        TCI_CASE(qemu_ld_i64):
             t0 = *tb_ptr++;
             if (TCG_TARGET_REG_BITS == 32) {
                 t1 = *tb_ptr++;
@@ -1205,8 +1402,8 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             if (TCG_TARGET_REG_BITS == 32) {
                 tci_write_reg(regs, t1, tmp64 >> 32);
             }
-            break;
-        case INDEX_op_qemu_st_i32:
+            TCI_NEXT();
+        TCI_CASE(qemu_st_i32):
             t0 = tci_read_r(regs, &tb_ptr);
             taddr = tci_read_ulong(regs, &tb_ptr);
             oi = tci_read_i(&tb_ptr);
@@ -1229,8 +1426,8 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             default:
                 tcg_abort();
             }
-            break;
-        case INDEX_op_qemu_st_i64:
+            TCI_NEXT();
+        TCI_CASE(qemu_st_i64):
             tmp64 = tci_read_r64(regs, &tb_ptr);
             taddr = tci_read_ulong(regs, &tb_ptr);
             oi = tci_read_i(&tb_ptr);
@@ -1259,14 +1456,15 @@ uintptr_t tcg_qemu_tb_exec(CPUArchState *env, uint8_t *tb_ptr)
             default:
                 tcg_abort();
             }
-            break;
-        case INDEX_op_mb:
+            TCI_NEXT();
+        TCI_CASE(mb):
             /* Ensure ordering for all kinds */
             smp_mb();
-            break;
+            TCI_NEXT();
         default:
+        op_default:
             TODO();
-            break;
+            TCI_NEXT();
         }
         tci_assert(tb_ptr == old_code_ptr + op_size);
     }
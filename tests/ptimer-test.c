@@ -763,6 +763,60 @@ static void check_oneshot_with_load_0(gconstpointer arg)
     ptimer_free(ptimer);
 }
 
+static void ptimer_count_trigger(void *opaque)
+{
+    int *count = opaque;
+
+    (*count)++;
+}
+
+static void check_periodic_lazy(gconstpointer arg)
+{
+    const uint8_t *policy = arg;
+    int lazy_triggers = 0, ref_triggers = 0;
+    ptimer_state *lazy = ptimer_init(ptimer_count_trigger, &lazy_triggers,
+                                     *policy);
+    ptimer_state *ref = ptimer_init(ptimer_count_trigger, &ref_triggers,
+                                    *policy);
+    int i;
+
+    ptimer_transaction_begin(lazy);
+    ptimer_set_period(lazy, 2000000);
+    ptimer_set_limit(lazy, 10, 1);
+    ptimer_run(lazy, 0);
+    ptimer_set_lazy(lazy, true);
+    ptimer_transaction_commit(lazy);
+
+    ptimer_transaction_begin(ref);
+    ptimer_set_period(ref, 2000000);
+    ptimer_set_limit(ref, 10, 1);
+    ptimer_run(ref, 0);
+    ptimer_transaction_commit(ref);
+
+    /* A lazy timer counts like an eager one but never calls back */
+    for (i = 0; i < 8; i++) {
+        qemu_clock_step(2000000 * 7 * (i + 1) + 1);
+        g_assert_cmpuint(ptimer_get_count(lazy), ==, ptimer_get_count(ref));
+    }
+    g_assert_cmpint(lazy_triggers, ==, 0);
+    g_assert_cmpint(ref_triggers, >, 0);
+
+    /* Once it is eager again the expiries line up */
+    ptimer_transaction_begin(lazy);
+    ptimer_set_lazy(lazy, false);
+    ptimer_transaction_commit(lazy);
+    ref_triggers = 0;
+
+    qemu_clock_step(2000000 * 10 * 3);
+
+    g_assert_cmpuint(ptimer_get_count(lazy), ==, ptimer_get_count(ref));
+    g_assert_cmpint(lazy_triggers, ==, ref_triggers);
+    g_assert_cmpint(lazy_triggers, >, 0);
+
+    ptimer_free(lazy);
+    ptimer_free(ref);
+}
+
 static void add_ptimer_tests(uint8_t policy)
 {
     char policy_name[256] = "";
@@ -857,6 +911,12 @@ static void add_ptimer_tests(uint8_t policy)
                               policy_name),
         g_memdup(&policy, 1), check_oneshot_with_load_0, g_free);
     g_free(tmp);
+
+    g_test_add_data_func_full(
+        tmp = g_strdup_printf("/ptimer/periodic_lazy policy=%s",
+                              policy_name),
+        g_memdup(&policy, 1), check_periodic_lazy, g_free);
+    g_free(tmp);
 }
 
 static void add_all_ptimer_policies_comb_tests(void)
@@ -24,6 +24,8 @@
 #include "qemu-common.h"
 #include "qemu/ctype.h"
 #include "qemu/cutils.h"
+#include "qemu/memfd.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 #include "qapi/qmp/json-parser.h"
 #include "qapi/qmp/qdict.h"
@@ -35,6 +37,16 @@
 #define SOCKET_TIMEOUT 50
 #define SOCKET_MAX_FDS 16
 
+/*
+ * Replies to writes are collected lazily, up to this many at a time.
+ * The server blocks once the socket is full of unread replies.
+ */
+#define QTEST_MAX_PENDING 64
+
+/* Transfers of QTEST_SHM_MIN_XFER or more go through shared memory */
+#define QTEST_SHM_SIZE (1 * MiB)
+#define QTEST_SHM_MIN_XFER 256
+
 
 typedef void (*QTestSendFn)(QTestState *s, const char *buf);
 typedef void (*ExternalSendFn)(void *s, const char *buf);
@@ -63,6 +75,9 @@ struct QTestState
     bool irq_level[MAX_IRQ];
     GString *rx;
     QTestTransportOps ops;
+    int pending;            /* replies to writes not read yet */
+    uint8_t *shm;
+    int shm_fd;
 };
 
 static GHookList abrt_hooks;
@@ -72,6 +87,9 @@ static int qtest_query_target_endianness(QTestState *s);
 
 static void qtest_client_socket_send(QTestState*, const char *buf);
 static void socket_send(int fd, const char *buf, size_t size);
+static void socket_send_fds(int socket_fd, int *fds, size_t fds_num,
+                            const char *buf, size_t buf_size);
+static void qtest_shm_attach(QTestState *s);
 
 static GString *qtest_client_socket_recv_line(QTestState *);
 
@@ -301,6 +319,8 @@ QTestState *qtest_init_without_qmp_handshake(const char *extra_args)
     g_assert(s->fd >= 0 && s->qmp_fd >= 0);
 
     s->rx = g_string_new("");
+    s->pending = 0;
+    s->shm = NULL;
     for (i = 0; i < MAX_IRQ; i++) {
         s->irq_level[i] = false;
     }
@@ -312,6 +332,7 @@ QTestState *qtest_init_without_qmp_handshake(const char *extra_args)
     /* ask endianness of the target */
 
     s->big_endian = qtest_query_target_endianness(s);
+    qtest_shm_attach(s);
 
     return s;
 }
@@ -385,6 +406,9 @@ void qtest_quit(QTestState *s)
     kill_qemu(s);
     close(s->fd);
     close(s->qmp_fd);
+    if (s->shm) {
+        qemu_memfd_free(s->shm, QTEST_SHM_SIZE, s->shm_fd);
+    }
     g_string_free(s->rx, true);
     g_free(s);
 }
@@ -489,7 +513,7 @@ static GString *qtest_client_socket_recv_line(QTestState *s)
     return line;
 }
 
-static gchar **qtest_rsp(QTestState *s, int expected_args)
+static gchar **qtest_rsp_line(QTestState *s, int expected_args)
 {
     GString *line;
     gchar **words;
@@ -536,6 +560,50 @@ redo:
     return words;
 }
 
+/* Collects the replies of earlier writes, which must all be OK.  */
+static void qtest_flush(QTestState *s)
+{
+    while (s->pending) {
+        s->pending--;
+        qtest_rsp_line(s, 0);
+    }
+}
+
+static gchar **qtest_rsp(QTestState *s, int expected_args)
+{
+    qtest_flush(s);
+    return qtest_rsp_line(s, expected_args);
+}
+
+/*
+ * For commands whose reply carries no data: the reply is read with the
+ * next one, so a sequence of writes costs a single round trip.
+ */
+static void qtest_rsp_later(QTestState *s)
+{
+    if (++s->pending >= QTEST_MAX_PENDING) {
+        qtest_flush(s);
+    }
+}
+
+static void qtest_shm_attach(QTestState *s)
+{
+    Error *err = NULL;
+    char *cmd;
+
+    s->shm = qemu_memfd_alloc("qtest-shm", QTEST_SHM_SIZE, 0, &s->shm_fd,
+                              &err);
+    if (!s->shm) {
+        /* Bulk transfers stay in the stream */
+        error_free(err);
+        return;
+    }
+    cmd = g_strdup_printf("shm_attach 0x%" PRIx64 "\n", QTEST_SHM_SIZE);
+    socket_send_fds(s->fd, &s->shm_fd, 1, cmd, strlen(cmd));
+    g_free(cmd);
+    qtest_rsp(s, 0);
+}
+
 static int qtest_query_target_endianness(QTestState *s)
 {
     gchar **args;
@@ -657,11 +725,14 @@ void qmp_fd_vsend(int fd, const char *fmt, va_list ap)
 void qtest_qmp_vsend_fds(QTestState *s, int *fds, size_t fds_num,
                          const char *fmt, va_list ap)
 {
+    /* QMP must see the effect of the qtest commands sent before */
+    qtest_flush(s);
     qmp_fd_vsend_fds(s->qmp_fd, fds, fds_num, fmt, ap);
 }
 
 void qtest_qmp_vsend(QTestState *s, const char *fmt, va_list ap)
 {
+    qtest_flush(s);
     qmp_fd_vsend_fds(s->qmp_fd, NULL, 0, fmt, ap);
 }
 
@@ -766,6 +837,7 @@ void qtest_qmp_send_raw(QTestState *s, const char *fmt, ...)
 {
     va_list ap;
 
+    qtest_flush(s);
     va_start(ap, fmt);
     qmp_fd_vsend_raw(s->qmp_fd, fmt, ap);
     va_end(ap);
@@ -902,7 +974,7 @@ void qtest_set_irq_in(QTestState *s, const char *qom_path, const char *name,
 static void qtest_out(QTestState *s, const char *cmd, uint16_t addr, uint32_t value)
 {
     qtest_sendf(s, "%s 0x%x 0x%x\n", cmd, addr, value);
-    qtest_rsp(s, 0);
+    qtest_rsp_later(s);
 }
 
 void qtest_outb(QTestState *s, uint16_t addr, uint8_t value)
@@ -954,7 +1026,7 @@ static void qtest_write(QTestState *s, const char *cmd, uint64_t addr,
                         uint64_t value)
 {
     qtest_sendf(s, "%s 0x%" PRIx64 " 0x%" PRIx64 "\n", cmd, addr, value);
-    qtest_rsp(s, 0);
+    qtest_rsp_later(s);
 }
 
 void qtest_writeb(QTestState *s, uint64_t addr, uint8_t value)
@@ -1025,13 +1097,55 @@ static int hex2nib(char ch)
     }
 }
 
+static bool qtest_shm_read(QTestState *s, uint64_t addr, void *data,
+                           size_t size)
+{
+    uint8_t *ptr = data;
+    size_t len;
+
+    if (!s->shm || size < QTEST_SHM_MIN_XFER) {
+        return false;
+    }
+    while (size) {
+        len = MIN(size, QTEST_SHM_SIZE);
+        qtest_sendf(s, "shm_read 0x%" PRIx64 " 0x%zx\n", addr, len);
+        qtest_rsp(s, 0);
+        memcpy(ptr, s->shm, len);
+        addr += len;
+        ptr += len;
+        size -= len;
+    }
+    return true;
+}
+
+static bool qtest_shm_write(QTestState *s, uint64_t addr, const void *data,
+                            size_t size)
+{
+    const uint8_t *ptr = data;
+    size_t len;
+
+    if (!s->shm || size < QTEST_SHM_MIN_XFER) {
+        return false;
+    }
+    while (size) {
+        len = MIN(size, QTEST_SHM_SIZE);
+        memcpy(s->shm, ptr, len);
+        qtest_sendf(s, "shm_write 0x%" PRIx64 " 0x%zx\n", addr, len);
+        qtest_rsp(s, 0);
+        addr += len;
+        ptr += len;
+        size -= len;
+    }
+    return true;
+}
+
 void qtest_memread(QTestState *s, uint64_t addr, void *data, size_t size)
 {
     uint8_t *ptr = data;
     gchar **args;
     size_t i;
 
-    if (!size) {
+    if (!size || qtest_shm_read(s, addr, data, size)) {
         return;
     }
 
@@ -1084,11 +1198,14 @@ void qtest_bufwrite(QTestState *s, uint64_t addr, const void *data, size_t size)
 {
     gchar *bdata;
 
+    if (qtest_shm_write(s, addr, data, size)) {
+        return;
+    }
     bdata = g_base64_encode(data, size);
     qtest_sendf(s, "b64write 0x%" PRIx64 " 0x%zx ", addr, size);
     s->ops.send(s, bdata);
     s->ops.send(s, "\n");
-    qtest_rsp(s, 0);
+    qtest_rsp_later(s);
     g_free(bdata);
 }
 
@@ -1097,6 +1214,9 @@ void qtest_bufread(QTestState *s, uint64_t addr, void *data, size_t size)
     gchar **args;
     size_t len;
 
+    if (qtest_shm_read(s, addr, data, size)) {
+        return;
+    }
     qtest_sendf(s, "b64read 0x%" PRIx64 " 0x%zx\n", addr, size);
     args = qtest_rsp(s, 2);
 
@@ -1117,7 +1237,7 @@ void qtest_memwrite(QTestState *s, uint64_t addr, const void *data, size_t size)
     size_t i;
     char *enc;
 
-    if (!size) {
+    if (!size || qtest_shm_write(s, addr, data, size)) {
         return;
     }
 
@@ -1128,14 +1248,14 @@ void qtest_memwrite(QTestState *s, uint64_t addr, const void *data, size_t size)
     }
 
     qtest_sendf(s, "write 0x%" PRIx64 " 0x%zx 0x%s\n", addr, size, enc);
-    qtest_rsp(s, 0);
+    qtest_rsp_later(s);
     g_free(enc);
 }
 
 void qtest_memset(QTestState *s, uint64_t addr, uint8_t pattern, size_t size)
 {
     qtest_sendf(s, "memset 0x%" PRIx64 " 0x%zx 0x%02x\n", addr, size, pattern);
-    qtest_rsp(s, 0);
+    qtest_rsp_later(s);
 }
 
 void qtest_qmp_assert_success(QTestState *qts, const char *fmt, ...)
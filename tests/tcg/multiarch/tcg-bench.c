@@ -0,0 +1,252 @@
+/*
+ * TCG microbenchmarks
+ *
+ * Each kernel stresses one part of the translator or of the guest memory
+ * emulation and reports its speed as one JSON object per line, so the
+ * results can be collected by scripts/tcg-bench.py and compared between
+ * releases.  The default scale is small enough to run as part of
+ * check-tcg; use -s to make the runs long enough to be measured.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+typedef struct Kernel {
+    const char *name;
+    /* Iterations at scale 1 */
+    uint64_t iterations;
+    uint64_t (*run)(uint64_t iterations);
+} Kernel;
+
+static volatile uint64_t sink;
+
+/* A dependent chain of integer operations in one long basic block */
+static uint64_t bench_int_loop(uint64_t n)
+{
+    uint64_t x = 1, y = 3;
+    uint64_t i;
+
+    for (i = 0; i < n; i++) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        y ^= (x >> 17) + (y << 3);
+        y = (y >> 7) | (y << 57);
+    }
+    return x ^ y;
+}
+
+#define COPY_SIZE (64 * 1024)
+
+/* Block copies, whatever the guest libc uses for memcpy */
+static uint64_t bench_memcpy(uint64_t n)
+{
+    static uint8_t src[COPY_SIZE], dst[COPY_SIZE];
+    uint64_t i;
+
+    memset(src, 0x5a, sizeof(src));
+    for (i = 0; i < n; i++) {
+        src[i % COPY_SIZE] = i;
+        memcpy(dst, src, sizeof(dst));
+    }
+    return dst[n % COPY_SIZE];
+}
+
+#define FP_SIZE 1024
+
+/* Multiply-add over arrays; built with -O2 so it is vectorised if the
+ * guest has SIMD (e.g. NEON on AArch64) */
+static uint64_t bench_fp(uint64_t n)
+{
+    static double a[FP_SIZE], b[FP_SIZE], c[FP_SIZE];
+    uint64_t i;
+    int j;
+
+    for (j = 0; j < FP_SIZE; j++) {
+        a[j] = j * 0.5;
+        b[j] = 1.0 / (j + 1);
+        c[j] = 0;
+    }
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < FP_SIZE; j++) {
+            c[j] = c[j] * 0.999 + a[j] * b[j];
+        }
+    }
+    return (uint64_t)c[FP_SIZE - 1];
+}
+
+static uint64_t op_add(uint64_t x) { return x + 7; }
+static uint64_t op_xor(uint64_t x) { return x ^ 0x55aa; }
+static uint64_t op_mul(uint64_t x) { return x * 3; }
+static uint64_t op_shr(uint64_t x) { return (x >> 3) | 1; }
+static uint64_t op_rol(uint64_t x) { return (x << 5) | (x >> 59); }
+static uint64_t op_not(uint64_t x) { return ~x; }
+static uint64_t op_sub(uint64_t x) { return x - 13; }
+static uint64_t op_inc(uint64_t x) { return x + 1; }
+
+/* Calls through a table with unpredictable targets, so every branch
+ * goes back through the TB lookup instead of a chained jump */
+static uint64_t bench_indirect(uint64_t n)
+{
+    static uint64_t (*const ops[8])(uint64_t) = {
+        op_add, op_xor, op_mul, op_shr, op_rol, op_not, op_sub, op_inc,
+    };
+    uint64_t (*volatile const *table)(uint64_t) = ops;
+    uint64_t x = 1, r = 12345;
+    uint64_t i;
+
+    for (i = 0; i < n; i++) {
+        r = r * 1103515245 + 12345;
+        x = table[(r >> 16) & 7](x);
+    }
+    return x;
+}
+
+#define STRIDE_PAGES 4096
+
+/* One access per page over 16 MiB, in an order that defeats locality,
+ * which is what stresses the softmmu TLB and the host TLB */
+static uint64_t bench_page_stride(uint64_t n)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    size_t size = (size_t)page * STRIDE_PAGES;
+    volatile uint8_t *buf;
+    uint64_t i, sum = 0;
+    unsigned p = 0;
+
+    buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < n; i++) {
+        /* 1021 is prime, so this visits every page */
+        p = (p + 1021) % STRIDE_PAGES;
+        buf[(size_t)p * page] += i;
+        sum += buf[(size_t)p * page + 64];
+    }
+    munmap((void *)buf, size);
+    return sum;
+}
+
+/* Map, touch and unmap small regions, as allocators and JITs do */
+static uint64_t bench_mmap(uint64_t n)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    uint64_t i, sum = 0;
+
+    for (i = 0; i < n; i++) {
+        size_t size = page * (1 + i % 16);
+        uint8_t *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (p == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        p[0] = i;
+        p[size - 1] = i;
+        if (mprotect(p, page, PROT_READ)) {
+            perror("mprotect");
+            exit(EXIT_FAILURE);
+        }
+        sum += p[0];
+        munmap(p, size);
+    }
+    return sum;
+}
+
+static const Kernel kernels[] = {
+    { "int-loop", 2000000, bench_int_loop },
+    { "memcpy", 2000, bench_memcpy },
+    { "fp", 500, bench_fp },
+    { "indirect", 1000000, bench_indirect },
+    { "page-stride", 200000, bench_page_stride },
+    { "mmap", 2000, bench_mmap },
+};
+
+#define NR_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_kernel(const Kernel *k, uint64_t scale)
+{
+    uint64_t n = k->iterations * scale;
+    double start, secs;
+
+    start = now();
+    sink = k->run(n);
+    secs = now() - start;
+
+    printf("{ \"kernel\": \"%s\", \"iterations\": %llu, \"seconds\": %.6f, "
+           "\"iterations-per-second\": %.1f }\n",
+           k->name, (unsigned long long)n, secs, secs > 0 ? n / secs : 0.0);
+    fflush(stdout);
+}
+
+static void usage(const char *prog)
+{
+    unsigned i;
+
+    fprintf(stderr, "usage: %s [-s scale] [kernel...]\nkernels:", prog);
+    for (i = 0; i < NR_KERNELS; i++) {
+        fprintf(stderr, " %s", kernels[i].name);
+    }
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t scale = 1;
+    unsigned i;
+    int opt, a;
+
+    while ((opt = getopt(argc, argv, "s:h")) != -1) {
+        switch (opt) {
+        case 's':
+            scale = strtoull(optarg, NULL, 0);
+            if (!scale) {
+                usage(argv[0]);
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (optind == argc) {
+        for (i = 0; i < NR_KERNELS; i++) {
+            run_kernel(&kernels[i], scale);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    for (a = optind; a < argc; a++) {
+        for (i = 0; i < NR_KERNELS; i++) {
+            if (!strcmp(argv[a], kernels[i].name)) {
+                run_kernel(&kernels[i], scale);
+                break;
+            }
+        }
+        if (i == NR_KERNELS) {
+            usage(argv[0]);
+        }
+    }
+    return EXIT_SUCCESS;
+}
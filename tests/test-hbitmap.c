@@ -1042,6 +1042,34 @@ static void test_hbitmap_next_dirty_area_after_truncate(TestHBitmapData *data,
     test_hbitmap_next_dirty_area_check(data, 0, INT64_MAX);
 }
 
+static void test_hbitmap_merge(TestHBitmapData *data, const void *unused)
+{
+    HBitmap *b;
+    uint64_t i;
+
+    hbitmap_test_init(data, L3 * 2, 0);
+    b = hbitmap_alloc(L3 * 2, 0);
+
+    hbitmap_test_set(data, 0, 3);
+    hbitmap_test_set(data, L2 + 5, L1);
+    hbitmap_set(b, 1, 4);
+    hbitmap_set(b, L2 + L1, L1 * 3);
+    hbitmap_set(b, L3 + 7, 1);
+    hbitmap_set(b, L3 * 2 - 1, 1);
+
+    g_assert(hbitmap_merge(data->hb, b, data->hb));
+    for (i = 0; i < L3 * 2; i++) {
+        if (hbitmap_get(b, i)) {
+            data->bits[i >> LOG_BITS_PER_LONG] |=
+                1UL << (i & (BITS_PER_LONG - 1));
+        }
+    }
+    hbitmap_test_check(data, 0);
+    hbitmap_test_check(data, L3);
+
+    hbitmap_free(b);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -1112,6 +1140,7 @@ int main(int argc, char **argv)
                      test_hbitmap_next_dirty_area_4);
     hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_area_after_truncate",
                      test_hbitmap_next_dirty_area_after_truncate);
+    hbitmap_test_add("/hbitmap/merge", test_hbitmap_merge);
 
     g_test_run();
 
@@ -286,12 +286,14 @@ static void test_simple_primitive(void)
 
 typedef struct TestSimpleArray {
     uint16_t u16_1[3];
+    uint32_t u32_1[2];
 } TestSimpleArray;
 
 /* Object instantiation, we are going to use it in more than one test */
 
 TestSimpleArray obj_simple_arr = {
     .u16_1 = { 0x42, 0x43, 0x44 },
+    .u32_1 = { 0x11223344, 0x55667788 },
 };
 
 /* Description of the values.  If you add a primitive type
@@ -303,6 +305,7 @@ static const VMStateDescription vmstate_simple_arr = {
     .minimum_version_id = 1,
     .fields = (VMStateField[]) {
         VMSTATE_UINT16_ARRAY(u16_1, TestSimpleArray, 3),
+        VMSTATE_UINT32_ARRAY(u32_1, TestSimpleArray, 2),
         VMSTATE_END_OF_LIST()
     }
 };
@@ -311,6 +314,8 @@ uint8_t wire_simple_arr[] = {
     /* u16_1 */ 0x00, 0x42,
     /* u16_1 */ 0x00, 0x43,
     /* u16_1 */ 0x00, 0x44,
+    /* u32_1 */ 0x11, 0x22, 0x33, 0x44,
+    /* u32_1 */ 0x55, 0x66, 0x77, 0x88,
     QEMU_VM_EOF, /* just to ensure we won't get EOF reported prematurely */
 };
 
@@ -1222,6 +1222,38 @@ struct fuse_lowlevel_ops {
      */
     void (*lseek)(fuse_req_t req, fuse_ino_t ino, off_t off, int whence,
                   struct fuse_file_info *fi);
+
+    /**
+     * Map a range of a file into the DAX cache window
+     *
+     * Valid replies:
+     *   fuse_reply_err
+     *
+     * @param req request handle
+     * @param ino the inode number
+     * @param foffset offset of the range in the file
+     * @param len length of the range
+     * @param moffset offset in the cache window
+     * @param flags FUSE_SETUPMAPPING_FLAG_* access of the mapping
+     * @param fi file information, fh may not be an open file
+     */
+    void (*setupmapping)(fuse_req_t req, fuse_ino_t ino, uint64_t foffset,
+                         uint64_t len, uint64_t moffset, uint64_t flags,
+                         struct fuse_file_info *fi);
+
+    /**
+     * Remove ranges from the DAX cache window
+     *
+     * Valid replies:
+     *   fuse_reply_err
+     *
+     * @param req request handle
+     * @param ino the inode number
+     * @param num number of ranges in @argp
+     * @param argp the ranges to unmap
+     */
+    void (*removemapping)(fuse_req_t req, fuse_ino_t ino, unsigned num,
+                          struct fuse_removemapping_one *argp);
 };
 
 /**
@@ -261,6 +261,33 @@ err:
     return ret;
 }
 
+static int fuse_virtio_cache_request(fuse_req_t req, VhostUserSlaveRequest op,
+                                     VhostUserFSSlaveMsg *msg, int fd)
+{
+    struct fv_VuDev *vud = req->se->virtio_dev;
+    bool ok;
+
+    if (!vud) {
+        return -EINVAL;
+    }
+
+    pthread_rwlock_rdlock(&vud->vu_dispatch_rwlock);
+    ok = vu_fs_cache_request(&vud->dev, op, fd, msg);
+    pthread_rwlock_unlock(&vud->vu_dispatch_rwlock);
+
+    return ok ? 0 : -EIO;
+}
+
+int fuse_virtio_map(fuse_req_t req, VhostUserFSSlaveMsg *msg, int fd)
+{
+    return fuse_virtio_cache_request(req, VHOST_USER_SLAVE_FS_MAP, msg, fd);
+}
+
+int fuse_virtio_unmap(fuse_req_t req, VhostUserFSSlaveMsg *msg)
+{
+    return fuse_virtio_cache_request(req, VHOST_USER_SLAVE_FS_UNMAP, msg, -1);
+}
+
 /*
  * Callback from fuse_send_data_iov_* when it's virtio and the buffer
  * is a single FD with FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK
@@ -15,6 +15,7 @@
 #define FUSE_VIRTIO_H
 
 #include "fuse_i.h"
+#include "contrib/libvhost-user/libvhost-user.h"
 
 struct fuse_session;
 
@@ -30,4 +31,11 @@ int virtio_send_data_iov(struct fuse_session *se, struct fuse_chan *ch,
                          struct iovec *iov, int count,
                          struct fuse_bufvec *buf, size_t len);
 
+/*
+ * Ask QEMU to map ranges of @fd into, or to unmap ranges of, the DAX cache
+ * window.  Return 0 on success or a negative errno value.
+ */
+int fuse_virtio_map(fuse_req_t req, VhostUserFSSlaveMsg *msg, int fd);
+int fuse_virtio_unmap(fuse_req_t req, VhostUserFSSlaveMsg *msg);
+
 #endif
@@ -2296,6 +2296,78 @@ static void lo_lseek(fuse_req_t req, fuse_ino_t ino, off_t off, int whence,
     }
 }
 
+static void lo_setupmapping(fuse_req_t req, fuse_ino_t ino, uint64_t foffset,
+                            uint64_t len, uint64_t moffset, uint64_t flags,
+                            struct fuse_file_info *fi)
+{
+    struct lo_data *lo = lo_data(req);
+    bool writable = flags & FUSE_SETUPMAPPING_FLAG_WRITE;
+    VhostUserFSSlaveMsg msg = { 0 };
+    struct lo_inode *inode;
+    char procname[64];
+    int fd;
+    int res;
+
+    fuse_log(FUSE_LOG_DEBUG,
+             "lo_setupmapping(ino=%" PRIu64 ", foffset=%" PRIu64
+             ", len=%" PRIu64 ", moffset=%" PRIu64 ", flags=0x%" PRIx64 ")\n",
+             ino, foffset, len, moffset, flags);
+
+    /* The guest doesn't necessarily pass an open handle, use the inode */
+    inode = lo_inode(req, ino);
+    if (!inode) {
+        fuse_reply_err(req, EBADF);
+        return;
+    }
+
+    sprintf(procname, "%i", inode->fd);
+    fd = openat(lo->proc_self_fd, procname, writable ? O_RDWR : O_RDONLY);
+    lo_inode_put(lo, &inode);
+    if (fd < 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+
+    msg.fd_offset[0] = foffset;
+    msg.c_offset[0] = moffset;
+    msg.len[0] = len;
+    msg.flags[0] = VHOST_USER_FS_FLAG_MAP_R;
+    if (writable) {
+        msg.flags[0] |= VHOST_USER_FS_FLAG_MAP_W;
+    }
+
+    res = fuse_virtio_map(req, &msg, fd);
+    close(fd);
+    fuse_reply_err(req, -res);
+}
+
+static void lo_removemapping(fuse_req_t req, fuse_ino_t ino, unsigned num,
+                             struct fuse_removemapping_one *argp)
+{
+    VhostUserFSSlaveMsg msg = { 0 };
+    unsigned int i, entry = 0;
+    int res = 0;
+
+    (void)ino;
+    for (i = 0; i < num; i++) {
+        msg.c_offset[entry] = argp[i].moffset;
+        msg.len[entry] = argp[i].len;
+
+        /* Send full batches, and whatever is left at the end */
+        if (++entry == VHOST_USER_FS_SLAVE_ENTRIES || i == num - 1) {
+            int ret = fuse_virtio_unmap(req, &msg);
+
+            if (ret < 0) {
+                res = ret;
+            }
+            memset(&msg, 0, sizeof(msg));
+            entry = 0;
+        }
+    }
+
+    fuse_reply_err(req, -res);
+}
+
 static void lo_destroy(void *userdata)
 {
     struct lo_data *lo = (struct lo_data *)userdata;
@@ -2356,6 +2428,8 @@ static struct fuse_lowlevel_ops lo_oper = {
     .copy_file_range = lo_copy_file_range,
 #endif
     .lseek = lo_lseek,
+    .setupmapping = lo_setupmapping,
+    .removemapping = lo_removemapping,
     .destroy = lo_destroy,
 };
 
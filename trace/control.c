@@ -55,6 +55,9 @@ QemuOptsList qemu_trace_opts = {
         },{
             .name = "file",
             .type = QEMU_OPT_STRING,
+        },{
+            .name = "flight-recorder",
+            .type = QEMU_OPT_BOOL,
         },
         { /* end of list */ }
     },
@@ -297,6 +300,16 @@ char *trace_opt_parse(const char *optarg)
         trace_enable_events(qemu_opt_get(opts, "enable"));
     }
     trace_init_events(qemu_opt_get(opts, "events"));
+    if (qemu_opt_get(opts, "flight-recorder")) {
+#ifdef CONFIG_TRACE_SIMPLE
+        st_set_flight_recorder(qemu_opt_get_bool(opts, "flight-recorder",
+                                                 false));
+#else
+        fprintf(stderr, "error: --trace flight-recorder=...: "
+                "option not supported by the selected tracing backends\n");
+        exit(1);
+#endif
+    }
     trace_file = g_strdup(qemu_opt_get(opts, "file"));
     qemu_opts_del(opts);
 
@@ -30,8 +30,40 @@
 /** Records were dropped event ID */
 #define DROPPED_EVENT_ID (~(uint64_t)0 - 1)
 
-/** Trace record is valid */
-#define TRACE_RECORD_VALID ((uint64_t)1 << 63)
+/*
+ * Every thread that traces gets its own ring of records, so that tracing
+ * on hot paths does not bounce a shared cache line between threads.  The
+ * owning thread is the only producer and only publishes head at record
+ * boundaries.  Positions are free running.
+ *
+ * Normally the writeout thread is the only consumer and owns tail.  In
+ * flight recorder mode nothing is written out until a dump is requested;
+ * the producer then overwrites its oldest records and advances tail
+ * itself, and a dump revalidates each record it copies against tail.
+ */
+enum {
+    TRACE_BUF_LEN = 4096 * 64,
+    TRACE_BUF_FLUSH_THRESHOLD = TRACE_BUF_LEN / 4,
+    TRACE_RECORD_MAX = 4096 * 4,
+    TRACE_WRITEOUT_PERIOD_US = 100 * 1000,
+};
+
+struct TraceRing {
+    struct TraceRing *next;
+    unsigned int head;
+    unsigned int tail;
+    unsigned int dropped;
+    bool kicked;
+    bool orphan;
+    /* Producer private */
+    bool busy;
+    /* Consumer private */
+    unsigned int rpos;
+    unsigned int rend;
+    uint64_t rts;
+    bool rvalid;
+    uint8_t data[TRACE_BUF_LEN];
+};
 
 /*
  * Trace records are written out by a dedicated thread.  The thread waits for
@@ -43,16 +75,16 @@ static GCond trace_empty_cond;
 
 static bool trace_available;
 static bool trace_writeout_enabled;
+static bool trace_flight_recorder;
+static bool trace_file_enabled;
+static int trace_dumping;
 
-enum {
-    TRACE_BUF_LEN = 4096 * 64,
-    TRACE_BUF_FLUSH_THRESHOLD = TRACE_BUF_LEN / 4,
-};
-
-uint8_t trace_buf[TRACE_BUF_LEN];
-static volatile gint trace_idx;
-static unsigned int writeout_idx;
-static volatile gint dropped_events;
+static TraceRing *trace_rings;
+static __thread TraceRing *trace_thread_ring;
+#ifndef _WIN32
+static pthread_key_t trace_ring_key;
+static bool trace_ring_key_valid;
+#endif
 static uint32_t trace_pid;
 static FILE *trace_fp;
 static char *trace_file_name;
@@ -75,54 +107,123 @@ typedef struct {
     uint64_t header_version;  /* HEADER_VERSION  */
 } TraceLogHeader;
 
+typedef void TraceOutFunc(const void *buf, size_t len, void *opaque);
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size);
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size);
+static void read_from_ring(TraceRing *r, unsigned int pos, void *dataptr,
+                           size_t size)
+{
+    unsigned int idx = pos % TRACE_BUF_LEN;
+    size_t first = MIN(size, TRACE_BUF_LEN - idx);
 
-static void clear_buffer_range(unsigned int idx, size_t len)
+    memcpy(dataptr, r->data + idx, first);
+    memcpy((uint8_t *)dataptr + first, r->data, size - first);
+}
+
+static unsigned int write_to_ring(TraceRing *r, unsigned int pos,
+                                  const void *dataptr, size_t size)
 {
-    uint32_t num = 0;
-    while (num < len) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
+    unsigned int idx = pos % TRACE_BUF_LEN;
+    size_t first = MIN(size, TRACE_BUF_LEN - idx);
+
+    memcpy(r->data + idx, dataptr, first);
+    memcpy(r->data, (const uint8_t *)dataptr + first, size - first);
+    return pos + size; /* most callers wants to know where to write next */
+}
+
+/* Whether the consumer position @pos may have been overwritten already */
+static bool trace_ring_stale(TraceRing *r, unsigned int pos)
+{
+    smp_rmb(); /* read the record before checking it is still there */
+    return (int)(atomic_read(&r->tail) - pos) > 0;
+}
+
+/*
+ * Look up the timestamp of the next record of @r the consumer has not
+ * written out yet.  Returns false if there is none.
+ */
+static bool trace_ring_peek(TraceRing *r)
+{
+    TraceRecord hdr;
+
+    while (r->rpos != r->rend) {
+        read_from_ring(r, r->rpos, &hdr, sizeof(hdr));
+        if (trace_ring_stale(r, r->rpos)) {
+            r->rpos = atomic_read(&r->tail);
+            continue;
         }
-        trace_buf[idx++] = 0;
-        num++;
+        r->rts = hdr.timestamp_ns;
+        return r->rvalid = true;
     }
+    return r->rvalid = false;
 }
-/**
- * Read a trace record from the trace buffer
- *
- * @idx         Trace buffer index
- * @record      Trace record to fill
- *
- * Returns false if the record is not valid.
+
+/*
+ * Write out the records published in all rings so far, merged in
+ * timestamp order.  Only one consumer may run at a time.
  */
-static bool get_trace_record(unsigned int idx, TraceRecord **recordptr)
+static void trace_rings_out(TraceOutFunc *out, void *opaque, bool advance)
 {
-    uint64_t event_flag = 0;
-    TraceRecord record;
-    /* read the event flag to see if its a valid record */
-    read_from_buffer(idx, &record, sizeof(event_flag));
+    static uint64_t scratch[TRACE_RECORD_MAX / sizeof(uint64_t)];
+    uint64_t type = TRACE_RECORD_TYPE_EVENT;
+    TraceRing *r;
 
-    if (!(record.event & TRACE_RECORD_VALID)) {
-        return false;
+    for (r = atomic_rcu_read(&trace_rings); r; r = r->next) {
+        r->rpos = atomic_read(&r->tail);
+        r->rend = atomic_load_acquire(&r->head);
+        trace_ring_peek(r);
     }
 
-    smp_rmb(); /* read memory barrier before accessing record */
-    /* read the record header to know record length */
-    read_from_buffer(idx, &record, sizeof(TraceRecord));
-    *recordptr = malloc(record.length); /* don't use g_malloc, can deadlock when traced */
-    /* make a copy of record to avoid being overwritten */
-    read_from_buffer(idx, *recordptr, record.length);
-    smp_rmb(); /* memory barrier before clearing valid flag */
-    (*recordptr)->event &= ~TRACE_RECORD_VALID;
-    /* clear the trace buffer range for consumed record otherwise any byte
-     * with its MSB set may be considered as a valid event id when the writer
-     * thread crosses this range of buffer again.
-     */
-    clear_buffer_range(idx, record.length);
-    return true;
+    for (;;) {
+        TraceRing *next = NULL;
+        TraceRecord *rec = (TraceRecord *)scratch;
+        uint32_t len;
+        bool valid;
+
+        for (r = atomic_rcu_read(&trace_rings); r; r = r->next) {
+            if (r->rvalid && (!next || r->rts < next->rts)) {
+                next = r;
+            }
+        }
+        if (!next) {
+            break;
+        }
+
+        read_from_ring(next, next->rpos, rec, sizeof(*rec));
+        len = rec->length;
+        valid = len >= sizeof(*rec) && len <= sizeof(scratch);
+        if (valid) {
+            read_from_ring(next, next->rpos, rec, len);
+        }
+        if (!valid || trace_ring_stale(next, next->rpos)) {
+            /* Overwritten under us; resynchronise with the producer */
+            next->rpos = atomic_read(&next->tail);
+        } else {
+            out(&type, sizeof(type), opaque);
+            out(rec, len, opaque);
+            next->rpos += len;
+        }
+        trace_ring_peek(next);
+    }
+
+    if (advance) {
+        for (r = atomic_rcu_read(&trace_rings); r; r = r->next) {
+            atomic_set(&r->kicked, false);
+            atomic_store_release(&r->tail, r->rend);
+        }
+    }
+}
+
+static unsigned int trace_rings_take_dropped(void)
+{
+    unsigned int dropped = 0;
+    TraceRing *r;
+
+    for (r = atomic_rcu_read(&trace_rings); r; r = r->next) {
+        if (atomic_read(&r->dropped)) {
+            dropped += atomic_xchg(&r->dropped, 0);
+        }
+    }
+    return dropped;
 }
 
 /**
@@ -147,140 +248,192 @@ static void wait_for_trace_records_available(void)
 {
     g_mutex_lock(&trace_lock);
     while (!(trace_available && trace_writeout_enabled)) {
+        gint64 end_time = g_get_monotonic_time() + TRACE_WRITEOUT_PERIOD_US;
+
         g_cond_signal(&trace_empty_cond);
-        g_cond_wait(&trace_available_cond, &trace_lock);
+        if (!trace_writeout_enabled) {
+            g_cond_wait(&trace_available_cond, &trace_lock);
+        } else if (!g_cond_wait_until(&trace_available_cond, &trace_lock,
+                                      end_time)) {
+            /* Also pick up threads that trace too little to kick us */
+            break;
+        }
     }
     trace_available = false;
     g_mutex_unlock(&trace_lock);
 }
 
-static gpointer writeout_thread(gpointer opaque)
+static void trace_fp_out(const void *buf, size_t len, void *opaque)
+{
+    size_t unused __attribute__ ((unused));
+
+    unused = fwrite(buf, len, 1, opaque);
+}
+
+static void write_dropped_record(TraceOutFunc *out, void *opaque,
+                                 unsigned int dropped_count)
 {
-    TraceRecord *recordptr;
     union {
         TraceRecord rec;
         uint8_t bytes[sizeof(TraceRecord) + sizeof(uint64_t)];
     } dropped;
-    unsigned int idx = 0;
-    int dropped_count;
-    size_t unused __attribute__ ((unused));
     uint64_t type = TRACE_RECORD_TYPE_EVENT;
 
+    dropped.rec.event = DROPPED_EVENT_ID;
+    dropped.rec.timestamp_ns = get_clock();
+    dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
+    dropped.rec.pid = trace_pid;
+    dropped.rec.arguments[0] = dropped_count;
+    out(&type, sizeof(type), opaque);
+    out(&dropped.rec, dropped.rec.length, opaque);
+}
+
+static gpointer writeout_thread(gpointer opaque)
+{
+    unsigned int dropped_count;
+
     for (;;) {
         wait_for_trace_records_available();
 
-        if (g_atomic_int_get(&dropped_events)) {
-            dropped.rec.event = DROPPED_EVENT_ID;
-            dropped.rec.timestamp_ns = get_clock();
-            dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
-            dropped.rec.pid = trace_pid;
-            do {
-                dropped_count = g_atomic_int_get(&dropped_events);
-            } while (!g_atomic_int_compare_and_exchange(&dropped_events,
-                                                        dropped_count, 0));
-            dropped.rec.arguments[0] = dropped_count;
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+        dropped_count = trace_rings_take_dropped();
+        if (dropped_count) {
+            write_dropped_record(trace_fp_out, trace_fp, dropped_count);
         }
 
-        while (get_trace_record(idx, &recordptr)) {
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(recordptr, recordptr->length, 1, trace_fp);
-            writeout_idx += recordptr->length;
-            free(recordptr); /* don't use g_free, can deadlock when traced */
-            idx = writeout_idx % TRACE_BUF_LEN;
-        }
+        trace_rings_out(trace_fp_out, trace_fp, true);
 
         fflush(trace_fp);
     }
     return NULL;
 }
 
-void trace_record_write_u64(TraceBufferRecord *rec, uint64_t val)
+#ifndef _WIN32
+static void trace_ring_release(void *opaque)
 {
-    rec->rec_off = write_to_buffer(rec->rec_off, &val, sizeof(uint64_t));
+    TraceRing *r = opaque;
+
+    /* Whatever is left is still written out; the next thread reuses it */
+    atomic_store_release(&r->orphan, true);
 }
+#endif
 
-void trace_record_write_str(TraceBufferRecord *rec, const char *s, uint32_t slen)
+static TraceRing *trace_get_ring(void)
 {
-    /* Write string length first */
-    rec->rec_off = write_to_buffer(rec->rec_off, &slen, sizeof(slen));
-    /* Write actual string now */
-    rec->rec_off = write_to_buffer(rec->rec_off, (void*)s, slen);
+    TraceRing *r = trace_thread_ring;
+
+    if (likely(r)) {
+        return r;
+    }
+
+    for (r = atomic_rcu_read(&trace_rings); r; r = r->next) {
+        if (atomic_read(&r->orphan) && atomic_xchg(&r->orphan, false)) {
+            break;
+        }
+    }
+
+    if (!r) {
+        /* don't use g_malloc, can deadlock when traced */
+        r = calloc(1, sizeof(*r));
+        if (!r) {
+            return NULL;
+        }
+        do {
+            r->next = atomic_read(&trace_rings);
+        } while (atomic_cmpxchg(&trace_rings, r->next, r) != r->next);
+    }
+
+#ifndef _WIN32
+    if (trace_ring_key_valid) {
+        pthread_setspecific(trace_ring_key, r);
+    }
+#endif
+    trace_thread_ring = r;
+    return r;
 }
 
-int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
+/* Make room for @len bytes at the head of @r */
+static bool trace_ring_reserve(TraceRing *r, uint32_t len)
 {
-    unsigned int idx, rec_off, old_idx, new_idx;
-    uint32_t rec_len = sizeof(TraceRecord) + datasize;
-    uint64_t event_u64 = event;
-    uint64_t timestamp_ns = get_clock();
-
-    do {
-        old_idx = g_atomic_int_get(&trace_idx);
-        smp_rmb();
-        new_idx = old_idx + rec_len;
-
-        if (new_idx - writeout_idx > TRACE_BUF_LEN) {
-            /* Trace Buffer Full, Event dropped ! */
-            g_atomic_int_inc(&dropped_events);
-            return -ENOSPC;
-        }
-    } while (!g_atomic_int_compare_and_exchange(&trace_idx, old_idx, new_idx));
+    unsigned int tail = atomic_load_acquire(&r->tail);
 
-    idx = old_idx % TRACE_BUF_LEN;
+    if (TRACE_BUF_LEN - (r->head - tail) >= len) {
+        return true;
+    }
+    if (!atomic_read(&trace_flight_recorder)) {
+        return false;
+    }
 
-    rec_off = idx;
-    rec_off = write_to_buffer(rec_off, &event_u64, sizeof(event_u64));
-    rec_off = write_to_buffer(rec_off, &timestamp_ns, sizeof(timestamp_ns));
-    rec_off = write_to_buffer(rec_off, &rec_len, sizeof(rec_len));
-    rec_off = write_to_buffer(rec_off, &trace_pid, sizeof(trace_pid));
+    /* Flight recorder: drop the oldest records */
+    while (TRACE_BUF_LEN - (r->head - tail) < len) {
+        TraceRecord hdr;
 
-    rec->tbuf_idx = idx;
-    rec->rec_off  = (idx + sizeof(TraceRecord)) % TRACE_BUF_LEN;
-    return 0;
+        read_from_ring(r, tail, &hdr, sizeof(hdr));
+        tail += hdr.length;
+    }
+    atomic_set(&r->tail, tail);
+    smp_wmb(); /* tail must move before the old records are overwritten */
+    return true;
 }
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
+void trace_record_write_u64(TraceBufferRecord *rec, uint64_t val)
 {
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        data_ptr[x++] = trace_buf[idx++];
-    }
+    rec->rec_off = write_to_ring(rec->ring, rec->rec_off, &val,
+                                 sizeof(uint64_t));
 }
 
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size)
+void trace_record_write_str(TraceBufferRecord *rec, const char *s, uint32_t slen)
 {
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = data_ptr[x++];
+    /* Write string length first */
+    rec->rec_off = write_to_ring(rec->ring, rec->rec_off, &slen, sizeof(slen));
+    /* Write actual string now */
+    rec->rec_off = write_to_ring(rec->ring, rec->rec_off, s, slen);
+}
+
+int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
+{
+    TraceRing *r = trace_get_ring();
+    TraceRecord hdr;
+
+    if (!r || r->busy) {
+        /* Out of memory, or an event traced from a signal handler */
+        return -ENOSPC;
+    }
+
+    hdr.event = event;
+    hdr.timestamp_ns = get_clock();
+    hdr.length = sizeof(TraceRecord) + datasize;
+    hdr.pid = trace_pid;
+
+    if (datasize > TRACE_RECORD_MAX - sizeof(TraceRecord) ||
+        !trace_ring_reserve(r, hdr.length)) {
+        /* Trace Buffer Full, Event dropped ! */
+        atomic_inc(&r->dropped);
+        return -ENOSPC;
     }
-    return idx; /* most callers wants to know where to write next */
+
+    r->busy = true;
+    rec->ring = r;
+    rec->tbuf_idx = r->head;
+    rec->rec_off = write_to_ring(r, r->head, &hdr, sizeof(hdr));
+    return 0;
 }
 
 void trace_record_finish(TraceBufferRecord *rec)
 {
-    TraceRecord record;
-    read_from_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-    smp_wmb(); /* write barrier before marking as valid */
-    record.event |= TRACE_RECORD_VALID;
-    write_to_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-
-    if (((unsigned int)g_atomic_int_get(&trace_idx) - writeout_idx)
-        > TRACE_BUF_FLUSH_THRESHOLD) {
+    TraceRing *r = rec->ring;
+
+    /* Publish the record to the consumer */
+    atomic_store_release(&r->head, rec->rec_off);
+    r->busy = false;
+
+    if (!atomic_read(&trace_flight_recorder) &&
+        r->head - atomic_read(&r->tail) > TRACE_BUF_FLUSH_THRESHOLD &&
+        !atomic_read(&r->kicked) && !atomic_xchg(&r->kicked, true)) {
         flush_trace_file(false);
     }
 }
 
-static int st_write_event_mapping(void)
+static void st_write_event_mapping(TraceOutFunc *out, void *opaque)
 {
     uint64_t type = TRACE_RECORD_TYPE_MAPPING;
     TraceEventIter iter;
@@ -291,19 +444,102 @@ static int st_write_event_mapping(void)
         uint64_t id = trace_event_get_id(ev);
         const char *name = trace_event_get_name(ev);
         uint32_t len = strlen(name);
-        if (fwrite(&type, sizeof(type), 1, trace_fp) != 1 ||
-            fwrite(&id, sizeof(id), 1, trace_fp) != 1 ||
-            fwrite(&len, sizeof(len), 1, trace_fp) != 1 ||
-            fwrite(name, len, 1, trace_fp) != 1) {
-            return -1;
+
+        out(&type, sizeof(type), opaque);
+        out(&id, sizeof(id), opaque);
+        out(&len, sizeof(len), opaque);
+        out(name, len, opaque);
+    }
+}
+
+static const TraceLogHeader trace_log_header = {
+    .header_event_id = HEADER_EVENT_ID,
+    .header_magic = HEADER_MAGIC,
+    /* Older log readers will check for version at next location */
+    .header_version = HEADER_VERSION,
+};
+
+/*
+ * Flight recorder dumps only use open/write/close so that they can run
+ * from a fatal signal handler.
+ */
+typedef struct {
+    int fd;
+    size_t len;
+    uint8_t buf[4096 * 16];
+} TraceDumpBuf;
+
+static void trace_dump_flush(TraceDumpBuf *d)
+{
+    size_t off = 0;
+
+    while (off < d->len) {
+        ssize_t ret = write(d->fd, d->buf + off, d->len - off);
+
+        if (ret <= 0) {
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
         }
+        off += ret;
     }
+    d->len = 0;
+}
 
-    return 0;
+static void trace_dump_out(const void *buf, size_t len, void *opaque)
+{
+    TraceDumpBuf *d = opaque;
+
+    while (len) {
+        size_t chunk = MIN(len, sizeof(d->buf) - d->len);
+
+        memcpy(d->buf + d->len, buf, chunk);
+        d->len += chunk;
+        buf = (const uint8_t *)buf + chunk;
+        len -= chunk;
+        if (d->len == sizeof(d->buf)) {
+            trace_dump_flush(d);
+        }
+    }
+}
+
+/* Write the flight recorder rings to the trace file */
+static void st_dump_flight_recorder(void)
+{
+    static TraceDumpBuf dump;
+    unsigned int dropped_count;
+
+    if (!trace_file_enabled || !trace_file_name ||
+        atomic_xchg(&trace_dumping, 1)) {
+        return;
+    }
+
+    dump.fd = open(trace_file_name, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY,
+                   0644);
+    if (dump.fd >= 0) {
+        dump.len = 0;
+        trace_dump_out(&trace_log_header, sizeof(trace_log_header), &dump);
+        st_write_event_mapping(trace_dump_out, &dump);
+        dropped_count = trace_rings_take_dropped();
+        if (dropped_count) {
+            write_dropped_record(trace_dump_out, &dump, dropped_count);
+        }
+        trace_rings_out(trace_dump_out, &dump, false);
+        trace_dump_flush(&dump);
+        close(dump.fd);
+    }
+    atomic_set(&trace_dumping, 0);
 }
 
 void st_set_trace_file_enabled(bool enable)
 {
+    if (trace_flight_recorder) {
+        /* The file is only written when the rings are dumped */
+        trace_file_enabled = enable;
+        return;
+    }
+
     if (enable == !!trace_fp) {
         return; /* no change */
     }
@@ -314,31 +550,27 @@ void st_set_trace_file_enabled(bool enable)
     flush_trace_file(true);
 
     if (enable) {
-        static const TraceLogHeader header = {
-            .header_event_id = HEADER_EVENT_ID,
-            .header_magic = HEADER_MAGIC,
-            /* Older log readers will check for version at next location */
-            .header_version = HEADER_VERSION,
-        };
-
         trace_fp = fopen(trace_file_name, "wb");
         if (!trace_fp) {
             return;
         }
 
-        if (fwrite(&header, sizeof header, 1, trace_fp) != 1 ||
-            st_write_event_mapping() < 0) {
+        trace_fp_out(&trace_log_header, sizeof trace_log_header, trace_fp);
+        st_write_event_mapping(trace_fp_out, trace_fp);
+        if (ferror(trace_fp)) {
             fclose(trace_fp);
             trace_fp = NULL;
             return;
         }
 
         /* Resume trace writeout */
+        trace_file_enabled = true;
         trace_writeout_enabled = true;
         flush_trace_file(false);
     } else {
         fclose(trace_fp);
         trace_fp = NULL;
+        trace_file_enabled = false;
     }
 }
 
@@ -364,17 +596,57 @@ void st_set_trace_file(const char *file)
     st_set_trace_file_enabled(true);
 }
 
+void st_set_flight_recorder(bool enable)
+{
+    trace_flight_recorder = enable;
+}
+
 void st_print_trace_file_status(void)
 {
-    qemu_printf("Trace file \"%s\" %s.\n",
-                trace_file_name, trace_fp ? "on" : "off");
+    qemu_printf("Trace file \"%s\" %s%s.\n",
+                trace_file_name, trace_file_enabled ? "on" : "off",
+                trace_flight_recorder ? " (flight recorder, dumped on flush)"
+                                      : "");
 }
 
 void st_flush_trace_buffer(void)
 {
+    if (trace_flight_recorder) {
+        st_dump_flight_recorder();
+        return;
+    }
     flush_trace_file(true);
 }
 
+#ifndef _WIN32
+static void st_crash_handler(int sig)
+{
+    st_dump_flight_recorder();
+    /* SA_RESETHAND restored the default action */
+    raise(sig);
+}
+
+/* Dump the flight recorder on fatal signals nobody else handles */
+static void st_install_crash_handler(void)
+{
+    static const int sigs[] = { SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV };
+    struct sigaction act, old;
+    int i;
+
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = st_crash_handler;
+    act.sa_flags = SA_RESETHAND;
+    sigemptyset(&act.sa_mask);
+
+    for (i = 0; i < ARRAY_SIZE(sigs); i++) {
+        if (sigaction(sigs[i], NULL, &old) == 0 && old.sa_handler == SIG_DFL &&
+            !(old.sa_flags & SA_SIGINFO)) {
+            sigaction(sigs[i], &act, NULL);
+        }
+    }
+}
+#endif
+
 /* Helper function to create a thread with signals blocked.  Use glib's
  * portable threads since QEMU abstractions cannot be used due to reentrancy in
  * the tracer.  Also note the signal masking on POSIX hosts so that the thread
@@ -405,6 +677,21 @@ bool st_init(void)
 
     trace_pid = getpid();
 
+#ifndef _WIN32
+    if (pthread_key_create(&trace_ring_key, trace_ring_release)) {
+        warn_report("unable to initialize simple trace backend");
+        return false;
+    }
+    trace_ring_key_valid = true;
+#endif
+
+    if (trace_flight_recorder) {
+#ifndef _WIN32
+        st_install_crash_handler();
+#endif
+        return true;
+    }
+
     thread = trace_thread_create(writeout_thread);
     if (!thread) {
         warn_report("unable to initialize simple trace backend");
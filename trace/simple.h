@@ -17,7 +17,17 @@ void st_set_trace_file(const char *file);
 bool st_init(void);
 void st_flush_trace_buffer(void);
 
+/**
+ * Keep records in per-thread rings only, overwriting the oldest ones, and
+ * write them to the trace file on st_flush_trace_buffer() or a crash.
+ * Must be called before st_init().
+ */
+void st_set_flight_recorder(bool enable);
+
+typedef struct TraceRing TraceRing;
+
 typedef struct {
+    TraceRing *ring;
     unsigned int tbuf_idx;
     unsigned int rec_off;
 } TraceBufferRecord;
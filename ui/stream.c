@@ -0,0 +1,255 @@
+/*
+ * Stream the console to an external encoder
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The first graphical console is written, as raw BGRx frames at a fixed
+ * rate, to the standard input of a shell command.  That command does the
+ * actual encoding and transport, e.g. a GStreamer or ffmpeg pipeline using
+ * VA-API or NVENC for H.264/HEVC and RTP or WebRTC for delivery, so QEMU
+ * does not depend on any of those libraries.
+ *
+ * Frames are only sent when the guest changed the surface.  When the
+ * encoder falls behind, the frame being written is completed and newer
+ * updates are coalesced into the next one, so the guest never waits for
+ * the encoder.  On a resolution change the command is restarted with the
+ * new size in its environment.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "qemu/sockets.h"
+#include "ui/console.h"
+#include "trace.h"
+
+#define STREAM_FPS_DEFAULT  30
+
+#ifdef HOST_WORDS_BIGENDIAN
+#define STREAM_PIXMAN_FORMAT PIXMAN_b8g8r8x8
+#else
+#define STREAM_PIXMAN_FORMAT PIXMAN_x8r8g8b8
+#endif
+
+typedef struct StreamDisplay {
+    DisplayChangeListener dcl;
+    DisplaySurface *ds;
+    bool dirty;
+
+    char *cmd;
+    GPid pid;
+    int fd;
+    bool failed;
+
+    /* The frame being written to the encoder */
+    pixman_image_t *frame;
+    int width;
+    int height;
+    size_t frame_size;
+    size_t frame_off;
+} StreamDisplay;
+
+static void stream_stop(StreamDisplay *s)
+{
+    if (s->fd >= 0) {
+        qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+        /* EOF tells the encoder to flush and exit */
+        close(s->fd);
+        s->fd = -1;
+    }
+    s->frame_off = s->frame_size;
+}
+
+static void stream_child_exited(GPid pid, gint status, gpointer opaque)
+{
+    StreamDisplay *s = opaque;
+
+    g_spawn_close_pid(pid);
+    if (pid != s->pid) {
+        return;
+    }
+    s->pid = 0;
+    if (s->fd >= 0) {
+        error_report("stream: encoder exited with status %d, "
+                     "stopping the stream", status);
+        stream_stop(s);
+        s->failed = true;
+    }
+}
+
+static bool stream_start(StreamDisplay *s)
+{
+    g_autofree char *width = g_strdup_printf("%d", s->width);
+    g_autofree char *height = g_strdup_printf("%d", s->height);
+    g_autofree char *stride = g_strdup_printf("%d", s->width * 4);
+    char *argv[] = { (char *)"/bin/sh", (char *)"-c", s->cmd, NULL };
+    char **envp = g_get_environ();
+    GError *err = NULL;
+    bool ok;
+
+    envp = g_environ_setenv(envp, "QEMU_STREAM_WIDTH", width, true);
+    envp = g_environ_setenv(envp, "QEMU_STREAM_HEIGHT", height, true);
+    envp = g_environ_setenv(envp, "QEMU_STREAM_STRIDE", stride, true);
+    envp = g_environ_setenv(envp, "QEMU_STREAM_FORMAT", "BGRx", true);
+
+    ok = g_spawn_async_with_pipes(NULL, argv, envp,
+                                  G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL,
+                                  &s->pid, &s->fd, NULL, NULL, &err);
+    g_strfreev(envp);
+    if (!ok) {
+        error_report("stream: cannot start the encoder: %s", err->message);
+        g_error_free(err);
+        s->failed = true;
+        return false;
+    }
+
+    trace_stream_start(s->pid, s->width, s->height);
+    qemu_set_nonblock(s->fd);
+    g_child_watch_add(s->pid, stream_child_exited, s);
+    return true;
+}
+
+static void stream_write(void *opaque)
+{
+    StreamDisplay *s = opaque;
+    uint8_t *data = (uint8_t *)pixman_image_get_data(s->frame);
+    ssize_t ret;
+
+    while (s->frame_off < s->frame_size) {
+        ret = write(s->fd, data + s->frame_off, s->frame_size - s->frame_off);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                /* Finish the frame when the encoder catches up */
+                qemu_set_fd_handler(s->fd, NULL, stream_write, s);
+                return;
+            }
+            error_report("stream: cannot write to the encoder: %s",
+                         strerror(errno));
+            stream_stop(s);
+            s->failed = true;
+            return;
+        }
+        s->frame_off += ret;
+    }
+    qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+}
+
+static void stream_send_frame(StreamDisplay *s)
+{
+    int width = surface_width(s->ds);
+    int height = surface_height(s->ds);
+
+    if (!s->frame || width != s->width || height != s->height) {
+        stream_stop(s);
+        qemu_pixman_image_unref(s->frame);
+        s->width = width;
+        s->height = height;
+        s->frame = pixman_image_create_bits(STREAM_PIXMAN_FORMAT,
+                                            width, height, NULL, width * 4);
+        s->frame_size = (size_t)width * height * 4;
+        s->frame_off = s->frame_size;
+        if (!stream_start(s)) {
+            return;
+        }
+    }
+
+    pixman_image_composite(PIXMAN_OP_SRC, s->ds->image, NULL, s->frame,
+                           0, 0, 0, 0, 0, 0, width, height);
+    s->dirty = false;
+    s->frame_off = 0;
+    stream_write(s);
+}
+
+static void stream_refresh(DisplayChangeListener *dcl)
+{
+    StreamDisplay *s = container_of(dcl, StreamDisplay, dcl);
+
+    graphic_hw_update(dcl->con);
+    if (!s->ds || !s->dirty || s->failed) {
+        return;
+    }
+    if (s->frame && s->frame_off < s->frame_size) {
+        /* Still sending the previous frame; this one is coalesced */
+        trace_stream_frame_delayed();
+        return;
+    }
+    stream_send_frame(s);
+}
+
+static void stream_gfx_update(DisplayChangeListener *dcl,
+                              int x, int y, int w, int h)
+{
+    StreamDisplay *s = container_of(dcl, StreamDisplay, dcl);
+
+    s->dirty = true;
+}
+
+static void stream_gfx_switch(DisplayChangeListener *dcl,
+                              struct DisplaySurface *new_surface)
+{
+    StreamDisplay *s = container_of(dcl, StreamDisplay, dcl);
+
+    s->ds = new_surface;
+    s->dirty = true;
+}
+
+static bool stream_check_format(DisplayChangeListener *dcl,
+                                pixman_format_code_t format)
+{
+    /* Any format works, it is converted to BGRx when sending */
+    return true;
+}
+
+static const DisplayChangeListenerOps stream_ops = {
+    .dpy_name             = "stream",
+    .dpy_refresh          = stream_refresh,
+    .dpy_gfx_update       = stream_gfx_update,
+    .dpy_gfx_switch       = stream_gfx_switch,
+    .dpy_gfx_check_format = stream_check_format,
+};
+
+static void stream_init(DisplayState *ds, DisplayOptions *opts)
+{
+    DisplayStream *o = &opts->u.stream;
+    QemuConsole *con;
+    StreamDisplay *s;
+    uint32_t fps = o->has_fps ? o->fps : STREAM_FPS_DEFAULT;
+
+    if (!fps || fps > 1000) {
+        error_report("stream: fps must be between 1 and 1000");
+        exit(1);
+    }
+
+    con = qemu_console_lookup_by_index(0);
+    if (!con || !qemu_console_is_graphic(con)) {
+        error_report("stream: no graphical console to stream");
+        exit(1);
+    }
+
+    s = g_new0(StreamDisplay, 1);
+    s->cmd = g_strdup(o->cmd);
+    s->fd = -1;
+    s->dcl.con = con;
+    s->dcl.ops = &stream_ops;
+    register_displaychangelistener(&s->dcl);
+    update_displaychangelistener(&s->dcl, 1000 / fps);
+}
+
+static QemuDisplay qemu_display_stream = {
+    .type       = DISPLAY_TYPE_STREAM,
+    .init       = stream_init,
+};
+
+static void register_stream(void)
+{
+    qemu_display_register(&qemu_display_stream);
+}
+
+type_init(register_stream);
@@ -45,27 +45,28 @@
  *                          if two threads try to write on it at the same time
  *
  * While the VNC worker thread is working, the VncDisplay global lock is held
- * to avoid screen corruption (this does not block vnc_refresh() because it
- * uses trylock()) but the output lock is not held because the thread works on
- * its own output buffer.
+ * in shared mode to avoid screen corruption (this does not block
+ * vnc_refresh() because it uses trylock()) but the output lock is not held
+ * because the thread works on its own output buffer.
  * When the encoding job is done, the worker thread will hold the output lock
  * and copy its output buffer in vs->output.
+ *
+ * Several worker threads may serve the queue.  The encoders keep state
+ * per client (e.g. the zlib streams), so the jobs of one client are run
+ * one at a time and in order; jobs of different clients run in parallel.
  */
 
 struct VncJobQueue {
     QemuCond cond;
     QemuMutex mutex;
-    QemuThread thread;
+    unsigned int nr_workers;
     bool exit;
     QTAILQ_HEAD(, VncJob) jobs;
 };
 
 typedef struct VncJobQueue VncJobQueue;
 
-/*
- * We use a single global queue, but most of the functions are
- * already reentrant, so we can easily add more than one encoding thread
- */
+/* We use a single global queue, shared by all displays and workers */
 static VncJobQueue *queue;
 
 static void vnc_lock_queue(VncJobQueue *queue)
@@ -201,6 +202,19 @@ static void vnc_async_encoding_end(VncState *orig, VncState *local)
     orig->lossy_rect = local->lossy_rect;
 }
 
+/* Return the oldest job of a client that is not being encoded already */
+static VncJob *vnc_next_job_locked(VncJobQueue *queue)
+{
+    VncJob *job;
+
+    QTAILQ_FOREACH(job, &queue->jobs, next) {
+        if (!job->vs->job_running) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
 static int vnc_worker_thread_loop(VncJobQueue *queue)
 {
     VncJob *job;
@@ -210,17 +224,16 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     int saved_offset;
 
     vnc_lock_queue(queue);
-    while (QTAILQ_EMPTY(&queue->jobs) && !queue->exit) {
+    while (!(job = vnc_next_job_locked(queue)) && !queue->exit) {
         qemu_cond_wait(&queue->cond, &queue->mutex);
     }
-    /* Here job can only be NULL if queue->exit is true */
-    job = QTAILQ_FIRST(&queue->jobs);
-    vnc_unlock_queue(queue);
-    assert(job->vs->magic == VNC_MAGIC);
-
     if (queue->exit) {
+        vnc_unlock_queue(queue);
         return -1;
     }
+    job->vs->job_running = true;
+    vnc_unlock_queue(queue);
+    assert(job->vs->magic == VNC_MAGIC);
 
     vnc_lock_output(job->vs);
     if (job->vs->ioc == NULL || job->vs->abort == true) {
@@ -248,12 +261,12 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     saved_offset = vs.output.offset;
     vnc_write_u16(&vs, 0);
 
-    vnc_lock_display(job->vs->vd);
+    vnc_lock_display_shared(job->vs->vd);
     QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
         int n;
 
         if (job->vs->ioc == NULL) {
-            vnc_unlock_display(job->vs->vd);
+            vnc_unlock_display_shared(job->vs->vd);
             /* Copy persistent encoding data */
             vnc_async_encoding_end(job->vs, &vs);
             goto disconnected;
@@ -267,7 +280,7 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
         }
         g_free(entry);
     }
-    vnc_unlock_display(job->vs->vd);
+    vnc_unlock_display_shared(job->vs->vd);
 
     /* Put n_rectangles at the beginning of the message */
     vs.output.buffer[saved_offset] = (n_rectangles >> 8) & 0xFF;
@@ -290,6 +303,7 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
 disconnected:
     vnc_lock_queue(queue);
     QTAILQ_REMOVE(&queue->jobs, job, next);
+    job->vs->job_running = false;
     vnc_unlock_queue(queue);
     qemu_cond_broadcast(&queue->cond);
     g_free(job);
@@ -318,28 +332,32 @@ static void vnc_queue_clear(VncJobQueue *q)
 static void *vnc_worker_thread(void *arg)
 {
     VncJobQueue *queue = arg;
-
-    qemu_thread_get_self(&queue->thread);
+    bool last;
 
     while (!vnc_worker_thread_loop(queue)) ;
-    vnc_queue_clear(queue);
-    return NULL;
-}
 
-static bool vnc_worker_thread_running(void)
-{
-    return queue; /* Check global queue */
+    vnc_lock_queue(queue);
+    last = --queue->nr_workers == 0;
+    vnc_unlock_queue(queue);
+    if (last) {
+        vnc_queue_clear(queue);
+    }
+    return NULL;
 }
 
-void vnc_start_worker_thread(void)
+void vnc_start_worker_threads(unsigned int n)
 {
-    VncJobQueue *q;
+    QemuThread thread;
 
-    if (vnc_worker_thread_running())
-        return ;
+    if (!queue) {
+        queue = vnc_queue_init(); /* Set global queue */
+    }
 
-    q = vnc_queue_init();
-    qemu_thread_create(&q->thread, "vnc_worker", vnc_worker_thread, q,
-                       QEMU_THREAD_DETACHED);
-    queue = q; /* Set global queue */
+    vnc_lock_queue(queue);
+    while (queue->nr_workers < n) {
+        queue->nr_workers++;
+        qemu_thread_create(&thread, "vnc_worker", vnc_worker_thread, queue,
+                           QEMU_THREAD_DETACHED);
+    }
+    vnc_unlock_queue(queue);
 }
@@ -3188,7 +3188,7 @@ void vnc_display_init(const char *id, Error **errp)
     vd->connections_limit = 32;
 
     qemu_mutex_init(&vd->mutex);
-    vnc_start_worker_thread();
+    vnc_start_worker_threads(1);
 
     vd->dcl.ops = &dcl_ops;
     register_displaychangelistener(&vd->dcl);
@@ -3361,6 +3361,9 @@ static QemuOptsList qemu_vnc_opts = {
         },{
             .name = "non-adaptive",
             .type = QEMU_OPT_BOOL,
+        },{
+            .name = "workers",
+            .type = QEMU_OPT_NUMBER,
         },{
             .name = "audiodev",
             .type = QEMU_OPT_STRING,
@@ -3794,6 +3797,7 @@ void vnc_display_open(const char *id, Error **errp)
     QemuConsole *con;
     bool password = false;
     bool reverse = false;
+    uint64_t workers;
     const char *credid;
     bool sasl = false;
     int acl = 0;
@@ -3916,6 +3920,14 @@ void vnc_display_open(const char *id, Error **errp)
     }
     vd->connections_limit = qemu_opt_get_number(opts, "connections", 32);
 
+    workers = qemu_opt_get_number(opts, "workers", 1);
+    if (workers < 1 || workers > VNC_MAX_WORKERS) {
+        error_setg(errp, "vnc: workers must be between 1 and %d",
+                   VNC_MAX_WORKERS);
+        goto fail;
+    }
+    vnc_start_worker_threads(workers);
+
 #ifdef CONFIG_VNC_JPEG
     vd->lossy = qemu_opt_get_bool(opts, "lossy", false);
 #endif
@@ -157,6 +157,7 @@ struct VncDisplay
     int ledstate;
     QKbdState *kbd;
     QemuMutex mutex;
+    unsigned int encoders;      /* shared holders of @mutex, see vnc-jobs.h */
 
     QEMUCursor *cursor;
     int cursor_msize;
@@ -334,6 +335,7 @@ struct VncState
     QemuMutex output_mutex;
     QEMUBH *bh;
     Buffer jobs_buffer;
+    bool job_running;           /* protected by the job queue lock */
 
     /* Encoding specific, if you add something here, don't forget to
      *  update vnc_async_encoding_start()
@@ -61,7 +61,8 @@ static bool aio_remove_fd_handler(AioContext *ctx, AioHandler *node)
      * removal in that case, because glib cleans up its state during
      * destruction anyway.
      */
-    if (!g_source_is_destroyed(&ctx->source)) {
+    if (!g_source_is_destroyed(&ctx->source) &&
+        !ctx->fdmon_ops->gsource_prepare) {
         g_source_remove_poll(&ctx->source, &node->pfd);
     }
 
@@ -86,13 +87,14 @@ static bool aio_remove_fd_handler(AioContext *ctx, AioHandler *node)
     return true;
 }
 
-void aio_set_fd_handler(AioContext *ctx,
-                        int fd,
-                        bool is_external,
-                        IOHandler *io_read,
-                        IOHandler *io_write,
-                        AioPollFn *io_poll,
-                        void *opaque)
+static void aio_set_fd_handler_common(AioContext *ctx,
+                                      int fd,
+                                      bool is_external,
+                                      bool is_event_notifier,
+                                      IOHandler *io_read,
+                                      IOHandler *io_write,
+                                      AioPollFn *io_poll,
+                                      void *opaque)
 {
     AioHandler *node;
     AioHandler *new_node = NULL;
@@ -128,13 +130,16 @@ void aio_set_fd_handler(AioContext *ctx,
         new_node->io_poll = io_poll;
         new_node->opaque = opaque;
         new_node->is_external = is_external;
+        new_node->is_event_notifier = is_event_notifier;
 
         if (is_new) {
             new_node->pfd.fd = fd;
         } else {
             new_node->pfd = node->pfd;
         }
-        g_source_add_poll(&ctx->source, &new_node->pfd);
+        if (!ctx->fdmon_ops->gsource_prepare) {
+            g_source_add_poll(&ctx->source, &new_node->pfd);
+        }
 
         new_node->pfd.events = (io_read ? G_IO_IN | G_IO_HUP | G_IO_ERR : 0);
         new_node->pfd.events |= (io_write ? G_IO_OUT | G_IO_ERR : 0);
@@ -163,6 +168,18 @@ void aio_set_fd_handler(AioContext *ctx,
     }
 }
 
+void aio_set_fd_handler(AioContext *ctx,
+                        int fd,
+                        bool is_external,
+                        IOHandler *io_read,
+                        IOHandler *io_write,
+                        AioPollFn *io_poll,
+                        void *opaque)
+{
+    aio_set_fd_handler_common(ctx, fd, is_external, false,
+                              io_read, io_write, io_poll, opaque);
+}
+
 void aio_set_fd_poll(AioContext *ctx, int fd,
                      IOHandler *io_poll_begin,
                      IOHandler *io_poll_end)
@@ -183,8 +200,9 @@ void aio_set_event_notifier(AioContext *ctx,
                             EventNotifierHandler *io_read,
                             AioPollFn *io_poll)
 {
-    aio_set_fd_handler(ctx, event_notifier_get_fd(notifier), is_external,
-                       (IOHandler *)io_read, NULL, io_poll, notifier);
+    aio_set_fd_handler_common(ctx, event_notifier_get_fd(notifier),
+                              is_external, true, (IOHandler *)io_read, NULL,
+                              io_poll, notifier);
 }
 
 void aio_set_event_notifier_poll(AioContext *ctx,
@@ -216,9 +234,21 @@ static bool poll_set_started(AioContext *ctx, bool started)
             continue;
         }
 
+        /*
+         * Only handlers that are worth polling get their notifications
+         * suppressed, the others keep waking us up through their fd.
+         */
         if (started) {
+            if (!node->poll_ns) {
+                continue;
+            }
+            node->poll_started = true;
             fn = node->io_poll_begin;
         } else {
+            if (!node->poll_started) {
+                continue;
+            }
+            node->poll_started = false;
             fn = node->io_poll_end;
         }
 
@@ -242,6 +272,9 @@ bool aio_prepare(AioContext *ctx)
     /* Poll mode cannot be used with glib's event loop, disable it. */
     poll_set_started(ctx, false);
 
+    if (ctx->fdmon_ops->gsource_prepare) {
+        ctx->fdmon_ops->gsource_prepare(ctx);
+    }
     return false;
 }
 
@@ -250,6 +283,10 @@ bool aio_pending(AioContext *ctx)
     AioHandler *node;
     bool result = false;
 
+    if (ctx->fdmon_ops->gsource_check) {
+        return ctx->fdmon_ops->gsource_check(ctx);
+    }
+
     /*
      * We have to walk very carefully in case aio_set_fd_handler is
      * called while we're walking.
@@ -315,7 +352,8 @@ static bool aio_dispatch_handler(AioContext *ctx, AioHandler *node)
         !QLIST_IS_INSERTED(node, node_poll) &&
         node->io_poll) {
         trace_poll_add(ctx, node, node->pfd.fd, revents);
-        if (ctx->poll_started && node->io_poll_begin) {
+        if (ctx->poll_started && node->poll_ns && node->io_poll_begin) {
+            node->poll_started = true;
             node->io_poll_begin(node->opaque);
         }
         QLIST_INSERT_HEAD(&ctx->poll_aio_handlers, node, node_poll);
@@ -329,6 +367,7 @@ static bool aio_dispatch_handler(AioContext *ctx, AioHandler *node)
 
         /* aio_notify() does not count as progress */
         if (node->opaque != &ctx->notifier) {
+            node->poll_ready = true;
             progress = true;
         }
     }
@@ -337,6 +376,7 @@ static bool aio_dispatch_handler(AioContext *ctx, AioHandler *node)
         aio_node_check(ctx, node->is_external) &&
         node->io_write) {
         node->io_write(node->opaque);
+        node->poll_ready = true;
         progress = true;
     }
 
@@ -378,7 +418,14 @@ void aio_dispatch(AioContext *ctx)
 {
     qemu_lockcnt_inc(&ctx->list_lock);
     aio_bh_poll(ctx);
-    aio_dispatch_handlers(ctx);
+    if (ctx->fdmon_ops->gsource_dispatch) {
+        AioHandlerList ready_list = QLIST_HEAD_INITIALIZER(ready_list);
+
+        ctx->fdmon_ops->gsource_dispatch(ctx, &ready_list);
+        aio_dispatch_ready_handlers(ctx, &ready_list);
+    } else {
+        aio_dispatch_handlers(ctx);
+    }
     aio_free_deleted_handlers(ctx);
     qemu_lockcnt_dec(&ctx->list_lock);
 
@@ -404,6 +451,7 @@ static bool run_poll_handlers_once(AioContext *ctx,
              */
             *timeout = 0;
             if (node->opaque != &ctx->notifier) {
+                node->poll_ready = true;
                 progress = true;
             }
         }
@@ -441,8 +489,10 @@ static bool remove_idle_poll_handlers(AioContext *ctx, int64_t now)
         } else if (now >= node->poll_idle_timeout) {
             trace_poll_remove(ctx, node, node->pfd.fd);
             node->poll_idle_timeout = 0LL;
+            node->poll_ns = 0;
             QLIST_SAFE_REMOVE(node, node_poll);
-            if (ctx->poll_started && node->io_poll_end) {
+            if (node->poll_started && node->io_poll_end) {
+                node->poll_started = false;
                 node->io_poll_end(node->opaque);
 
                 /*
@@ -515,6 +565,59 @@ static bool run_poll_handlers(AioContext *ctx, int64_t max_ns, int64_t *timeout)
     return progress;
 }
 
+/* adjust_polling_time:
+ * @ctx: the AioContext
+ * @node: a handler on ctx->poll_aio_handlers
+ * @block_ns: how long this aio_poll() waited for events
+ *
+ * Tune the polling time of @node.  The time it took until @node had an event
+ * approximates the inter-arrival time of its events, so only grow the
+ * polling time if @node made progress, but shrink it whether or not it did.
+ */
+static void adjust_polling_time(AioContext *ctx, AioHandler *node,
+                                int64_t block_ns)
+{
+    bool ready = node->poll_ready;
+
+    node->poll_ready = false;
+    node->poll_ns = MIN(node->poll_ns, ctx->poll_max_ns);
+
+    if (block_ns <= node->poll_ns) {
+        /* This is the sweet spot, no adjustment needed */
+    } else if (block_ns > ctx->poll_max_ns) {
+        /* We'd have to poll for too long, poll less */
+        int64_t old = node->poll_ns;
+
+        if (ctx->poll_shrink) {
+            node->poll_ns /= ctx->poll_shrink;
+        } else {
+            node->poll_ns = 0;
+        }
+
+        trace_poll_shrink(ctx, node, old, node->poll_ns);
+    } else if (ready && node->poll_ns < ctx->poll_max_ns) {
+        /* There is room to grow, poll longer */
+        int64_t old = node->poll_ns;
+        int64_t grow = ctx->poll_grow;
+
+        if (grow == 0) {
+            grow = 2;
+        }
+
+        if (node->poll_ns) {
+            node->poll_ns *= grow;
+        } else {
+            node->poll_ns = 4000; /* start polling at 4 microseconds */
+        }
+
+        if (node->poll_ns > ctx->poll_max_ns) {
+            node->poll_ns = ctx->poll_max_ns;
+        }
+
+        trace_poll_grow(ctx, node, old, node->poll_ns);
+    }
+}
+
 /* try_poll_mode:
  * @ctx: the AioContext
  * @timeout: timeout for blocking wait, computed by the caller and updated if
@@ -558,6 +661,7 @@ bool aio_poll(AioContext *ctx, bool blocking)
     bool progress;
     int64_t timeout;
     int64_t start = 0;
+    int64_t block_ns = 0;
 
     /*
      * There cannot be two concurrent aio_poll calls for the same AioContext (or
@@ -606,45 +710,8 @@ bool aio_poll(AioContext *ctx, bool blocking)
         aio_notify_accept(ctx);
     }
 
-    /* Adjust polling time */
     if (ctx->poll_max_ns) {
-        int64_t block_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
-
-        if (block_ns <= ctx->poll_ns) {
-            /* This is the sweet spot, no adjustment needed */
-        } else if (block_ns > ctx->poll_max_ns) {
-            /* We'd have to poll for too long, poll less */
-            int64_t old = ctx->poll_ns;
-
-            if (ctx->poll_shrink) {
-                ctx->poll_ns /= ctx->poll_shrink;
-            } else {
-                ctx->poll_ns = 0;
-            }
-
-            trace_poll_shrink(ctx, old, ctx->poll_ns);
-        } else if (ctx->poll_ns < ctx->poll_max_ns &&
-                   block_ns < ctx->poll_max_ns) {
-            /* There is room to grow, poll longer */
-            int64_t old = ctx->poll_ns;
-            int64_t grow = ctx->poll_grow;
-
-            if (grow == 0) {
-                grow = 2;
-            }
-
-            if (ctx->poll_ns) {
-                ctx->poll_ns *= grow;
-            } else {
-                ctx->poll_ns = 4000; /* start polling at 4 microseconds */
-            }
-
-            if (ctx->poll_ns > ctx->poll_max_ns) {
-                ctx->poll_ns = ctx->poll_max_ns;
-            }
-
-            trace_poll_grow(ctx, old, ctx->poll_ns);
-        }
+        block_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
     }
 
     progress |= aio_bh_poll(ctx);
@@ -653,6 +720,22 @@ bool aio_poll(AioContext *ctx, bool blocking)
         progress |= aio_dispatch_ready_handlers(ctx, &ready_list);
     }
 
+    /*
+     * Adjust polling time.  This is done per handler, so that a busy
+     * virtqueue does not make us poll idle ones, and ctx->poll_ns is how
+     * long the busiest handler wants to be polled.
+     */
+    if (ctx->poll_max_ns) {
+        AioHandler *node;
+        int64_t poll_ns = 0;
+
+        QLIST_FOREACH(node, &ctx->poll_aio_handlers, node_poll) {
+            adjust_polling_time(ctx, node, block_ns);
+            poll_ns = MAX(poll_ns, node->poll_ns);
+        }
+        ctx->poll_ns = poll_ns;
+    }
+
     aio_free_deleted_handlers(ctx);
 
     qemu_lockcnt_dec(&ctx->list_lock);
@@ -685,13 +768,10 @@ void aio_context_destroy(AioContext *ctx)
 void aio_context_use_g_source(AioContext *ctx)
 {
     /*
-     * Disable io_uring when the glib main loop is used because it doesn't
-     * support mixed glib/aio_poll() usage. It relies on aio_poll() being
-     * called regularly so that changes to the monitored file descriptors are
-     * submitted, otherwise a list of pending fd handlers builds up.
+     * Nothing to do: fdmon-io_uring hooks into the GSource callbacks to
+     * submit changes to the monitored file descriptors, so it supports
+     * mixed glib/aio_poll() usage.
      */
-    fdmon_io_uring_destroy(ctx);
-    aio_free_deleted_handlers(ctx);
 }
 
 void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
@@ -36,7 +36,11 @@ struct AioHandler {
     unsigned flags; /* see fdmon-io_uring.c */
 #endif
     int64_t poll_idle_timeout; /* when to stop userspace polling */
+    int64_t poll_ns;           /* polling time tuned from this fd's events */
+    bool poll_ready;           /* made progress in this aio_poll() */
+    bool poll_started;         /* ->io_poll_begin() was called */
     bool is_external;
+    bool is_event_notifier;    /* ->io_read() drains the EventNotifier */
 };
 
 /* Add a handler to a ready list */
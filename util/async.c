@@ -401,7 +401,7 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
+    ctx->linux_io_uring = luring_init(ctx->linux_io_uring_sqpoll, errp);
     if (!ctx->linux_io_uring) {
         return NULL;
     }
@@ -417,6 +417,18 @@ LuringState *aio_get_linux_io_uring(AioContext *ctx)
 }
 #endif
 
+void aio_context_set_io_uring_sqpoll(AioContext *ctx, bool sqpoll,
+                                     Error **errp)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    ctx->linux_io_uring_sqpoll = sqpoll;
+#else
+    if (sqpoll) {
+        error_setg(errp, "io_uring is not supported by this QEMU build");
+    }
+#endif
+}
+
 void aio_notify(AioContext *ctx)
 {
     /* Write e.g. bh->scheduled before reading ctx->notify_me.  Pairs
@@ -520,6 +532,7 @@ AioContext *aio_context_new(Error **errp)
 
     ctx->thread_pool = NULL;
     qemu_rec_mutex_init(&ctx->lock);
+    qemu_rec_mutex_set_profile_class(&ctx->lock, "AioContext");
     timerlistgroup_init(&ctx->tlg, aio_timerlist_notify, ctx);
 
     ctx->poll_ns = 0;
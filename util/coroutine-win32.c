@@ -87,6 +87,11 @@ void qemu_coroutine_delete(Coroutine *co_)
     g_free(co);
 }
 
+void qemu_coroutine_trim(Coroutine *co_)
+{
+    /* Fiber stacks are owned by Windows, nothing to trim */
+}
+
 Coroutine *qemu_coroutine_self(void)
 {
     if (!current) {
@@ -38,9 +38,20 @@
  * the "cq ring".  Ring entries are called "sqe" and "cqe", respectively.
  *
  * The code is structured so that sq/cq rings are only modified within
- * fdmon_io_uring_wait().  Changes to AioHandlers are made by enqueuing them on
- * ctx->submit_list so that fdmon_io_uring_wait() can submit IORING_OP_POLL_ADD
- * and/or IORING_OP_POLL_REMOVE sqes for them.
+ * fdmon_io_uring_wait() and the GSource callbacks, which all run in the
+ * AioContext's home thread.  Changes to AioHandlers are made by enqueuing them
+ * on ctx->submit_list so that these can submit IORING_OP_POLL_ADD and/or
+ * IORING_OP_POLL_REMOVE sqes for them.
+ *
+ * EventNotifier handlers drain their eventfd every time they run, so they are
+ * monitored with multishot IORING_OP_POLL_ADD when the kernel supports it and
+ * do not need to be re-armed after each event.  Multishot polls only report
+ * new events, so they are not used for external handlers, whose events are
+ * ignored while external clients are disabled.
+ *
+ * When the AioContext is used as a GSource, glib polls the io_uring fd itself
+ * instead of every handler's GPollFD, so the glib main loop also benefits from
+ * a single file descriptor to poll regardless of the number of handlers.
  */
 
 #include "qemu/osdep.h"
@@ -57,6 +68,9 @@ enum {
     FDMON_IO_URING_REMOVE   = (1 << 2),
 };
 
+/* Set when the kernel rejects multishot IORING_OP_POLL_ADD */
+static bool fdmon_io_uring_no_multishot;
+
 static inline int poll_events_from_pfd(int pfd_events)
 {
     return (pfd_events & G_IO_IN ? POLLIN : 0) |
@@ -166,12 +180,27 @@ static void fdmon_io_uring_update(AioContext *ctx,
     }
 }
 
+static bool use_multishot(AioHandler *node)
+{
+#ifdef IORING_POLL_ADD_MULTI
+    return node->is_event_notifier && !node->is_external &&
+           !atomic_read(&fdmon_io_uring_no_multishot);
+#else
+    return false;
+#endif
+}
+
 static void add_poll_add_sqe(AioContext *ctx, AioHandler *node)
 {
     struct io_uring_sqe *sqe = get_sqe(ctx);
     int events = poll_events_from_pfd(node->pfd.events);
 
     io_uring_prep_poll_add(sqe, node->pfd.fd, events);
+#ifdef IORING_POLL_ADD_MULTI
+    if (use_multishot(node)) {
+        sqe->len |= IORING_POLL_ADD_MULTI;
+    }
+#endif
     io_uring_sqe_set_data(sqe, node);
 }
 
@@ -205,6 +234,23 @@ static void fill_sq_ring(AioContext *ctx)
     QSLIST_MOVE_ATOMIC(&submit_list, &ctx->submit_list);
 
     while ((node = dequeue(&submit_list, &flags))) {
+        /*
+         * An external handler that fired while external clients were
+         * disabled is parked here until they are enabled again.  Nothing is
+         * being monitored for it, so it can be deleted right away.
+         */
+        if ((flags & FDMON_IO_URING_ADD) &&
+            !aio_node_check(ctx, node->is_external)) {
+            flags = atomic_fetch_and(&node->flags, ~FDMON_IO_URING_REMOVE);
+            if (flags & FDMON_IO_URING_REMOVE) {
+                QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node,
+                                      node_deleted);
+            } else {
+                enqueue(&ctx->submit_list, node, FDMON_IO_URING_ADD);
+            }
+            continue;
+        }
+
         /* Order matters, just in case both flags were set */
         if (flags & FDMON_IO_URING_ADD) {
             add_poll_add_sqe(ctx, node);
@@ -228,6 +274,18 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
+#ifdef IORING_CQE_F_MORE
+    /* A multishot IORING_OP_POLL_ADD stays armed, no need to re-arm it */
+    if (cqe->flags & IORING_CQE_F_MORE) {
+        if (atomic_read(&node->flags) & FDMON_IO_URING_REMOVE) {
+            return false; /* wait for the final cqe to delete the handler */
+        }
+        aio_add_ready_handler(ready_list, node,
+                              pfd_events_from_poll(cqe->res));
+        return true;
+    }
+#endif
+
     /*
      * Deletion can only happen when IORING_OP_POLL_ADD completes.  If we race
      * with enqueue() here then we can safely clear the FDMON_IO_URING_REMOVE
@@ -239,10 +297,29 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
-    aio_add_ready_handler(ready_list, node, pfd_events_from_poll(cqe->res));
+    if (cqe->res == -EINVAL && use_multishot(node)) {
+        /* Older kernels reject multishot poll, fall back to one-shot */
+        atomic_set(&fdmon_io_uring_no_multishot, true);
+        add_poll_add_sqe(ctx, node);
+        return false;
+    }
+
+    /* Don't lose the event of a handler that would not be dispatched now */
+    if (!aio_node_check(ctx, node->is_external)) {
+        enqueue(&ctx->submit_list, node, FDMON_IO_URING_ADD);
+        return false;
+    }
 
-    /* IORING_OP_POLL_ADD is one-shot so we must re-arm it */
+    /*
+     * IORING_OP_POLL_ADD is one-shot, or the multishot poll was terminated
+     * (e.g. on cq ring overflow), so we must re-arm it
+     */
     add_poll_add_sqe(ctx, node);
+
+    if (cqe->res < 0) {
+        return false;
+    }
+    aio_add_ready_handler(ready_list, node, pfd_events_from_poll(cqe->res));
     return true;
 }
 
@@ -315,10 +392,41 @@ static bool fdmon_io_uring_need_wait(AioContext *ctx)
     return atomic_read(&ctx->external_disable_cnt);
 }
 
+/* Submit changes so that glib's poll of the io_uring fd covers them */
+static void fdmon_io_uring_gsource_prepare(AioContext *ctx)
+{
+    int ret;
+
+    fill_sq_ring(ctx);
+    if (!io_uring_sq_ready(&ctx->fdmon_io_uring)) {
+        return;
+    }
+
+    do {
+        ret = io_uring_submit(&ctx->fdmon_io_uring);
+    } while (ret == -EINTR);
+
+    assert(ret >= 0);
+}
+
+static bool fdmon_io_uring_gsource_check(AioContext *ctx)
+{
+    return io_uring_cq_ready(&ctx->fdmon_io_uring);
+}
+
+static void fdmon_io_uring_gsource_dispatch(AioContext *ctx,
+                                            AioHandlerList *ready_list)
+{
+    process_cq_ring(ctx, ready_list);
+}
+
 static const FDMonOps fdmon_io_uring_ops = {
     .update = fdmon_io_uring_update,
     .wait = fdmon_io_uring_wait,
     .need_wait = fdmon_io_uring_need_wait,
+    .gsource_prepare = fdmon_io_uring_gsource_prepare,
+    .gsource_check = fdmon_io_uring_gsource_check,
+    .gsource_dispatch = fdmon_io_uring_gsource_dispatch,
 };
 
 bool fdmon_io_uring_setup(AioContext *ctx)
@@ -332,6 +440,8 @@ bool fdmon_io_uring_setup(AioContext *ctx)
 
     QSLIST_INIT(&ctx->submit_list);
     ctx->fdmon_ops = &fdmon_io_uring_ops;
+    ctx->fdmon_io_uring_tag = g_source_add_unix_fd(&ctx->source,
+            ctx->fdmon_io_uring.ring_fd, G_IO_IN);
     return true;
 }
 
@@ -340,6 +450,10 @@ void fdmon_io_uring_destroy(AioContext *ctx)
     if (ctx->fdmon_ops == &fdmon_io_uring_ops) {
         AioHandler *node;
 
+        if (!g_source_is_destroyed(&ctx->source)) {
+            g_source_remove_unix_fd(&ctx->source, ctx->fdmon_io_uring_tag);
+        }
+        ctx->fdmon_io_uring_tag = NULL;
         io_uring_queue_exit(&ctx->fdmon_io_uring);
 
         /* Move handlers due to be removed onto the deleted list */
@@ -32,6 +32,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <string.h>
+#include <errno.h>
 
 /* N way (num) in place bit striper. Lay out row wise bits column wise
  * (from element 0 to N-1). num is the length of x, and dir reverses the
@@ -73,6 +74,85 @@ static inline void stripe8(uint8_t *x, int num, bool dir, bool be)
     memcpy(x, r, sizeof(uint8_t) * num);
 }
 
+/* Number of bytes moved per file and per system call */
+#define CHUNK_SIZE (64 * 1024)
+
+/*
+ * Lookup table for the common two way (dual parallel) case, built with
+ * stripe8() itself so that it cannot disagree with it.
+ */
+static uint16_t stripe2_lut[1 << 16];
+
+static void stripe2_lut_init(bool dir, bool be)
+{
+    uint32_t v;
+
+    for (v = 0; v < 1 << 16; v++) {
+        uint8_t x[2] = { v, v >> 8 };
+
+        stripe8(x, 2, dir, be);
+        stripe2_lut[v] = x[0] | x[1] << 8;
+    }
+}
+
+/* Stripe @groups consecutive groups of @num bytes of @x in place */
+static void stripe_buf(uint8_t *x, size_t groups, int num, bool dir, bool be)
+{
+    size_t g;
+
+    if (num == 2) {
+        for (g = 0; g < groups; g++, x += 2) {
+            uint16_t v = stripe2_lut[x[0] | x[1] << 8];
+
+            x[0] = v;
+            x[1] = v >> 8;
+        }
+        return;
+    }
+    for (g = 0; g < groups; g++, x += num) {
+        stripe8(x, num, dir, be);
+    }
+}
+
+/* Read up to @len bytes, only returning less at end of file */
+static ssize_t read_full(int fd, uint8_t *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t ret = read(fd, buf + done, len - done);
+
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (ret == 0) {
+            break;
+        }
+        done += ret;
+    }
+    return done;
+}
+
+static int write_full(int fd, const uint8_t *buf, size_t len)
+{
+    while (len) {
+        ssize_t ret = write(fd, buf, len);
+
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
 #ifdef UNSTRIPE
@@ -115,65 +195,109 @@ int main(int argc, char *argv[])
     argc--;
 
     int multiple[argc];
+    const char *names[argc];
 
     for (i = 0; i < argc; ++i) {
+        /* Byte i of each group lives in file multiple[i] */
+        names[i] = argv[
+#if defined(FLASH_STRIPE_BW) && defined(FLASH_STRIPE_BE)
+                        argc - 1 -
+#endif
+                        i];
         if (unstripe) {
-            multiple[i] = open(argv[i], 0);
+            multiple[i] = open(names[i], 0);
         } else {
-            multiple[i] = creat(argv[i], 0644);
+            multiple[i] = creat(names[i], 0644);
         }
         if (multiple[i] == -1) {
-            perror(argv[i]);
+            perror(names[i]);
             return 1;
         }
     }
 
-    while (true) {
-        uint8_t buf[argc];
-        for (i = 0; i < argc; ++i) {
-            switch (read(!unstripe ? single : multiple[
-#if defined(FLASH_STRIPE_BW) && defined(FLASH_STRIPE_BE)
-                                                       argc - 1 -
+#ifndef FLASH_STRIPE_BW
+    if (argc == 2) {
+        stripe2_lut_init(unstripe, be);
+    }
 #endif
-                                                       i], &buf[i], 1)) {
-            case 0:
+
+    uint8_t *buf = malloc((size_t)CHUNK_SIZE * argc);
+    uint8_t *part = malloc(CHUNK_SIZE);
+
+    if (!buf || !part) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+
+    while (true) {
+        size_t groups, g;
+        ssize_t n;
+
+        if (!unstripe) {
+            n = read_full(single, buf, (size_t)CHUNK_SIZE * argc);
+            if (n == -1) {
+                perror(single_f);
+                return 1;
+            }
+            groups = (n + argc - 1) / argc;
+            if (n % argc) {
+                fprintf(stderr, "WARNING:input file %s is not multiple of "
+                        "%d bytes, padding with garbage byte\n", single_f,
+                        argc);
+                memset(buf + n, 0xff, groups * argc - n);
+            }
+        } else {
+            groups = 0;
+            for (i = 0; i < argc; ++i) {
+                n = read_full(multiple[i], part, i ? groups : CHUNK_SIZE);
+                if (n == -1) {
+                    perror(names[i]);
+                    return 1;
+                }
                 if (i == 0) {
-                    goto done;
-                } else if (!unstripe) {
-                    fprintf(stderr, "WARNING:input file %s is not multiple of "
-                            "%d bytes, padding with garbage byte\n", single_f,
-                            argc);
+                    groups = n;
+                } else {
+                    memset(part + n, 0xff, groups - n);
+                }
+                for (g = 0; g < groups; g++) {
+                    buf[g * argc + i] = part[g];
                 }
-                break;
-            case -1:
-                perror(unstripe ? argv[i] : single_f);
-                return 1;
             }
         }
+        if (!groups) {
+            break;
+        }
 
 #ifndef FLASH_STRIPE_BW
-        stripe8(buf, argc, unstripe, be);
+        stripe_buf(buf, groups, argc, unstripe, be);
 #endif
 
-        for (i = 0; i < argc; ++i) {
-            switch (write(unstripe ? single : multiple[
-#if defined(FLASH_STRIPE_BW) && defined(FLASH_STRIPE_BE)
-                                                       argc - 1 -
-#endif
-                                                       i], &buf[i], 1)) {
-            case -1:
-                perror(unstripe ? single_f : argv[i]);
+        if (unstripe) {
+            if (write_full(single, buf, groups * argc) == -1) {
+                perror(single_f);
                 return 1;
-            case 0:
-                i--; /* try again */
             }
+        } else {
+            for (i = 0; i < argc; ++i) {
+                for (g = 0; g < groups; g++) {
+                    part[g] = buf[g * argc + i];
+                }
+                if (write_full(multiple[i], part, groups) == -1) {
+                    perror(names[i]);
+                    return 1;
+                }
+            }
+        }
+        if (groups < CHUNK_SIZE) {
+            break;
         }
     }
 
-done:
+    free(part);
+    free(buf);
     close(single);
     for (i = 0; i < argc; ++i) {
-        close(multiple[argc]);
+        close(multiple[i]);
     }
     return 0;
 }
@@ -125,6 +125,12 @@ int gcm_init( gcm_context *ctx, const unsigned char *key, unsigned int keysize )
     return( 0 );
 }
 
+void gcm_set_ecb(gcm_context *ctx, gcm_ecb_fn ecb, void *opaque)
+{
+    ctx->ecb = ecb;
+    ctx->ecb_opaque = opaque;
+}
+
 static const uint64_t last4[16] =
 {
     0x0000, 0x1c20, 0x3840, 0x2460,
@@ -216,6 +222,68 @@ void gcm_push_aad(gcm_context *ctx,
     }
 }
 
+/*
+ * Payload fast path for whole blocks, with the counter and GHASH
+ * positions both block aligned. The key stream for up to
+ * GCM_BULK_BLOCKS blocks is generated in one go so that an external
+ * cipher (see gcm_set_ecb) can pipeline it.
+ */
+#define GCM_BULK_BLOCKS 64
+
+static size_t gcm_push_blocks(gcm_context *ctx,
+                              int mode,
+                              unsigned char *output,
+                              const unsigned char *input,
+                              size_t length)
+{
+    unsigned char ks[GCM_BULK_BLOCKS * 16];
+    size_t nblocks = MIN(length / 16, GCM_BULK_BLOCKS);
+    uint32_t ctr;
+    size_t i;
+
+    GET_UINT32_BE(ctr, ctx->iv, 12);
+    for (i = 0; i < nblocks; i++) {
+        ctr++;
+        memcpy(ks + i * 16, ctx->iv, 12);
+        PUT_UINT32_BE(ctr, ks + i * 16, 12);
+    }
+    PUT_UINT32_BE(ctr, ctx->iv, 12);
+
+    if (ctx->ecb) {
+        ctx->ecb(ctx->ecb_opaque, ks, nblocks * 16);
+    } else {
+        for (i = 0; i < nblocks; i++) {
+            aes_crypt_ecb(&ctx->aes_ctx, AES_ENCRYPT, ks + i * 16,
+                          ks + i * 16);
+        }
+    }
+
+    for (i = 0; i < nblocks; i++) {
+        uint64_t in[2], k[2], out[2], mul[2];
+
+        /* Input and output may overlap, read before writing.  */
+        memcpy(in, input + i * 16, 16);
+        memcpy(k, ks + i * 16, 16);
+        out[0] = in[0] ^ k[0];
+        out[1] = in[1] ^ k[1];
+        memcpy(output + i * 16, out, 16);
+
+        memcpy(mul, ctx->mul, 16);
+        if (mode == GCM_ENCRYPT) {
+            mul[0] ^= out[0];
+            mul[1] ^= out[1];
+        } else {
+            mul[0] ^= in[0];
+            mul[1] ^= in[1];
+        }
+        memcpy(ctx->mul, mul, 16);
+        gcm_mult(ctx, ctx->mul, ctx->mul);
+    }
+
+    ctx->data_len += nblocks * 16;
+    return nblocks * 16;
+}
+
 void gcm_push_data(gcm_context *ctx,
                    int mode,
                    unsigned char *output,
@@ -236,6 +304,14 @@ void gcm_push_data(gcm_context *ctx,
     p = input;
     while( length > 0 )
     {
+        if (length >= 16 && ctx->ectr_len == 0 && ctx->mul_idx == 0) {
+            use_len = gcm_push_blocks(ctx, mode, out_p, p, length);
+            length -= use_len;
+            p += use_len;
+            out_p += use_len;
+            continue;
+        }
+
         use_len = ( length < 16 ) ? length : 16;
         if (ctx->ectr_len && use_len > ctx->ectr_len) {
             use_len = ctx->ectr_len;
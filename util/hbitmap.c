@@ -13,6 +13,7 @@
 #include <glib.h>
 #include "qemu/hbitmap.h"
 #include "qemu/host-utils.h"
+#include "qemu/cutils.h"
 #include "trace.h"
 #include "crypto/hash.h"
 
@@ -737,11 +738,22 @@ void hbitmap_deserialize_finish(HBitmap *bitmap)
         size = MAX((size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
         memset(bitmap->levels[lev], 0, size * sizeof(unsigned long));
 
-        for (i = 0; i < prev_size; ++i) {
-            if (bitmap->levels[lev + 1][i]) {
-                bitmap->levels[lev][i >> BITS_PER_LEVEL] |=
-                    1UL << (i & (BITS_PER_LONG - 1));
+        /* Persistent bitmaps are mostly empty; skip zero blocks in bulk.  */
+        for (i = 0; i < prev_size; i += BITS_PER_LONG) {
+            unsigned long *words = &bitmap->levels[lev + 1][i];
+            int n = MIN(prev_size - i, BITS_PER_LONG);
+            unsigned long el = 0;
+            int j;
+
+            if (buffer_is_zero(words, n * sizeof(unsigned long))) {
+                continue;
+            }
+            for (j = 0; j < n; j++) {
+                if (words[j]) {
+                    el |= 1UL << j;
+                }
             }
+            bitmap->levels[lev][i >> BITS_PER_LEVEL] = el;
         }
     }
 
@@ -865,6 +877,34 @@ static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
     }
 }
 
+/**
+ * hbitmap_merge_words: performs dst = dst | src
+ * requires identical granularities.  Only the nonzero words of src are
+ * visited, so the cost depends on how populated src is, not on its size.
+ */
+static void hbitmap_merge_words(HBitmap *dst, const HBitmap *src)
+{
+    unsigned long *last_lev = dst->levels[HBITMAP_LEVELS - 1];
+    HBitmapIter hbi;
+    unsigned long cur, old;
+    size_t pos;
+
+    hbitmap_iter_init(&hbi, src, 0);
+    for (;;) {
+        pos = hbitmap_iter_next_word(&hbi, &cur);
+        if (!cur) {
+            break;
+        }
+
+        old = last_lev[pos];
+        last_lev[pos] |= cur;
+        dst->count += ctpopl(last_lev[pos]) - ctpopl(old);
+        if (!old) {
+            hb_set_between(dst, HBITMAP_LEVELS - 2, pos, pos);
+        }
+    }
+}
+
 /**
  * Given HBitmaps A and B, let R := A (BITOR) B.
  * Bitmaps A and B will not be modified,
@@ -906,11 +946,16 @@ bool hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
         return true;
     }
 
+    assert(a->size == b->size);
+    if (result == a || result == b) {
+        hbitmap_merge_words(result, result == a ? b : a);
+        return true;
+    }
+
     /* This merge is O(size), as BITS_PER_LONG and HBITMAP_LEVELS are constant.
      * It may be possible to improve running times for sparsely populated maps
      * by using hbitmap_iter_next, but this is suboptimal for dense maps.
      */
-    assert(a->size == b->size);
     for (i = HBITMAP_LEVELS - 1; i >= 0; i--) {
         for (j = 0; j < a->sizes[i]; j++) {
             result->levels[i][j] = a->levels[i][j] | b->levels[i][j];
@@ -0,0 +1,227 @@
+/*
+ * Lock contention profiler
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Each thread owns a fixed-size, open-addressed table of per-class
+ * statistics.  Only the owner writes to it, so recording a sample is a
+ * handful of plain stores; readers walk every table without locking and
+ * merge what they find.  Tables are never freed: when a thread exits its
+ * table is marked free and handed to the next thread that needs one, so
+ * samples of exited threads are still reported and the number of tables
+ * is bounded by the peak number of concurrently contending threads.
+ *
+ * Nothing here may take a QemuMutex, since the profiler runs from within
+ * qemu_mutex_lock() itself.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/host-utils.h"
+#include "qemu/lock-profile.h"
+#include "qemu/notify.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+
+/* Must be a power of two */
+#define LOCK_PROFILE_ENTRIES 128
+
+typedef struct LockProfileThread LockProfileThread;
+struct LockProfileThread {
+    LockProfileThread *next;
+    bool in_use;
+    Notifier exit;
+    /* Collects the samples of classes that do not fit in @entries */
+    LockProfileStats overflow;
+    LockProfileStats entries[LOCK_PROFILE_ENTRIES];
+};
+
+static LockProfileThread *lock_profile_threads;
+static __thread LockProfileThread *lock_profile_self;
+static __thread bool lock_profile_exited;
+
+#ifdef CONFIG_ATOMIC64
+#define lock_profile_get(p)     atomic_read__nocheck(p)
+#define lock_profile_set(p, v)  atomic_set__nocheck(p, v)
+#else
+/* Torn reads on these hosts can only skew a report */
+#define lock_profile_get(p)     (*(p))
+#define lock_profile_set(p, v)  (*(p) = (v))
+#endif
+
+static void lock_profile_thread_exit(Notifier *n, void *unused)
+{
+    LockProfileThread *t = container_of(n, LockProfileThread, exit);
+
+    lock_profile_self = NULL;
+    lock_profile_exited = true;
+    atomic_store_release(&t->in_use, false);
+}
+
+static LockProfileThread *lock_profile_thread(void)
+{
+    LockProfileThread *t = lock_profile_self;
+
+    if (likely(t)) {
+        return t;
+    }
+    if (lock_profile_exited) {
+        return NULL;
+    }
+
+    for (t = atomic_rcu_read(&lock_profile_threads); t; t = t->next) {
+        if (!atomic_read(&t->in_use) && !atomic_xchg(&t->in_use, true)) {
+            break;
+        }
+    }
+    if (!t) {
+        LockProfileThread *head;
+
+        t = g_new0(LockProfileThread, 1);
+        t->in_use = true;
+        t->overflow.name = "(other)";
+        do {
+            head = atomic_read(&lock_profile_threads);
+            t->next = head;
+        } while (atomic_cmpxchg(&lock_profile_threads, head, t) != head);
+    }
+
+    t->exit.notify = lock_profile_thread_exit;
+    qemu_thread_atexit_add(&t->exit);
+    lock_profile_self = t;
+    return t;
+}
+
+static LockProfileStats *lock_profile_lookup(LockProfileThread *t,
+                                             const char *name, int line)
+{
+    unsigned h = ((uintptr_t)name >> 3) ^ (line * 0x9e3779b9u);
+    unsigned i;
+
+    for (i = 0; i < LOCK_PROFILE_ENTRIES; i++) {
+        LockProfileStats *s = &t->entries[(h + i) & (LOCK_PROFILE_ENTRIES - 1)];
+
+        if (s->name == name && s->line == line) {
+            return s;
+        }
+        if (!s->name) {
+            s->line = line;
+            /* Publish the key after the line, readers check the name */
+            atomic_store_release(&s->name, name);
+            return s;
+        }
+    }
+    return &t->overflow;
+}
+
+static unsigned lock_profile_bucket(uint64_t ns)
+{
+    unsigned b;
+
+    if (ns < 1024) {
+        return 0;
+    }
+    b = 63 - clz64(ns) - 9;
+    return MIN(b, LOCK_PROFILE_BUCKETS - 1);
+}
+
+int64_t lock_profile_begin(void)
+{
+    return get_clock();
+}
+
+void lock_profile_end(const char *class, const char *file, int line,
+                      int64_t start)
+{
+    LockProfileThread *t = lock_profile_thread();
+    LockProfileStats *s;
+    int64_t ns = get_clock() - start;
+    unsigned b;
+
+    if (!t) {
+        return;
+    }
+    ns = MAX(ns, 0);
+    s = class ? lock_profile_lookup(t, class, 0)
+              : lock_profile_lookup(t, file, line);
+    b = lock_profile_bucket(ns);
+
+    lock_profile_set(&s->count, s->count + 1);
+    lock_profile_set(&s->wait_ns, s->wait_ns + ns);
+    lock_profile_set(&s->hist[b], s->hist[b] + 1);
+    if (ns > s->max_ns) {
+        lock_profile_set(&s->max_ns, ns);
+    }
+}
+
+static void lock_profile_merge(GHashTable *ht, LockProfileStats *s)
+{
+    const char *name = atomic_load_acquire(&s->name);
+    LockProfileStats *m;
+    uint64_t count, max_ns;
+    g_autofree char *key = NULL;
+    unsigned i;
+
+    if (!name) {
+        return;
+    }
+    count = lock_profile_get(&s->count);
+    if (!count) {
+        return;
+    }
+
+    /* Equal string literals in different objects may not be shared */
+    key = g_strdup_printf("%s:%d", name, s->line);
+    m = g_hash_table_lookup(ht, key);
+    if (!m) {
+        m = g_new0(LockProfileStats, 1);
+        m->name = name;
+        m->line = s->line;
+        g_hash_table_insert(ht, g_steal_pointer(&key), m);
+    }
+
+    m->count += count;
+    m->wait_ns += lock_profile_get(&s->wait_ns);
+    max_ns = lock_profile_get(&s->max_ns);
+    m->max_ns = MAX(m->max_ns, max_ns);
+    for (i = 0; i < LOCK_PROFILE_BUCKETS; i++) {
+        m->hist[i] += lock_profile_get(&s->hist[i]);
+    }
+}
+
+static gint lock_profile_cmp(gconstpointer a, gconstpointer b)
+{
+    const LockProfileStats *sa = a;
+    const LockProfileStats *sb = b;
+
+    if (sa->wait_ns != sb->wait_ns) {
+        return sa->wait_ns > sb->wait_ns ? -1 : 1;
+    }
+    return 0;
+}
+
+void lock_profile_foreach(LockProfileIterFunc *func, void *opaque)
+{
+    GHashTable *ht = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                           g_free, g_free);
+    LockProfileThread *t;
+    GList *list, *l;
+    unsigned i;
+
+    for (t = atomic_rcu_read(&lock_profile_threads); t; t = t->next) {
+        for (i = 0; i < LOCK_PROFILE_ENTRIES; i++) {
+            lock_profile_merge(ht, &t->entries[i]);
+        }
+        lock_profile_merge(ht, &t->overflow);
+    }
+
+    list = g_list_sort(g_hash_table_get_values(ht), lock_profile_cmp);
+    for (l = list; l; l = l->next) {
+        func(l->data, opaque);
+    }
+    g_list_free(list);
+    g_hash_table_destroy(ht);
+}
@@ -196,6 +196,59 @@ void *qemu_ram_mmap(int fd,
     return ptr;
 }
 
+void *qemu_ram_mmap_hugetlb(size_t size, size_t pagesize, bool shared)
+{
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    size_t offset, total;
+    void *guardptr;
+    void *ptr;
+    int flags;
+
+    if (!is_power_of_2(pagesize) || pagesize <= qemu_real_host_page_size ||
+        (size & (pagesize - 1))) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    /*
+     * As in qemu_ram_mmap(), reserve enough address space to align the
+     * mapping and to leave a normal guard page after it.
+     */
+    total = size + pagesize;
+    guardptr = mmap(0, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (guardptr == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+
+    flags = MAP_FIXED | MAP_ANONYMOUS | MAP_HUGETLB;
+    flags |= ctz64(pagesize) << MAP_HUGE_SHIFT;
+    flags |= shared ? MAP_SHARED : MAP_PRIVATE;
+    offset = QEMU_ALIGN_UP((uintptr_t)guardptr, pagesize) - (uintptr_t)guardptr;
+
+    ptr = mmap(guardptr + offset, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (ptr == MAP_FAILED) {
+        int saved_errno = errno;
+
+        munmap(guardptr, total);
+        errno = saved_errno;
+        return MAP_FAILED;
+    }
+
+    if (offset > 0) {
+        munmap(guardptr, offset);
+    }
+    total -= offset;
+    if (total > size + qemu_real_host_page_size) {
+        munmap(ptr + size + qemu_real_host_page_size,
+               total - size - qemu_real_host_page_size);
+    }
+    return ptr;
+#else
+    errno = ENOSYS;
+    return MAP_FAILED;
+#endif
+}
+
 void qemu_ram_munmap(int fd, void *ptr, size_t size)
 {
     size_t pagesize;
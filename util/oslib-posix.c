@@ -67,6 +67,7 @@ struct MemsetThread {
     char *addr;
     size_t numpages;
     size_t hpagesize;
+    bool populate;
     QemuThread pgthread;
     sigjmp_buf env;
 };
@@ -423,7 +424,17 @@ static void *do_touch_pages(void *arg)
     sigaddset(&set, SIGBUS);
     pthread_sigmask(SIG_UNBLOCK, &set, &oldset);
 
-    if (sigsetjmp(memset_args->env, 1)) {
+    if (memset_args->populate) {
+        /*
+         * Let the kernel fault the whole range in write mode, without
+         * a round trip per page and without writing to the pages.
+         */
+        if (qemu_madvise(memset_args->addr,
+                         memset_args->numpages * memset_args->hpagesize,
+                         QEMU_MADV_POPULATE_WRITE)) {
+            memset_thread_failed = true;
+        }
+    } else if (sigsetjmp(memset_args->env, 1)) {
         memset_thread_failed = true;
     } else {
         char *addr = memset_args->addr;
@@ -463,9 +474,20 @@ static inline int get_memset_num_threads(int smp_cpus)
     return ret;
 }
 
+/*
+ * MADV_POPULATE_WRITE fails with EINVAL if the kernel does not know it, any
+ * other error is a failure to populate that touching the pages would hit too.
+ */
+static bool madv_populate_write_possible(char *area, size_t hpagesize)
+{
+    return !qemu_madvise(area, hpagesize, QEMU_MADV_POPULATE_WRITE) ||
+           errno != EINVAL;
+}
+
 static bool touch_all_pages(char *area, size_t hpagesize, size_t numpages,
                             int smp_cpus)
 {
+    bool populate = madv_populate_write_possible(area, hpagesize);
     static gsize initialized = 0;
     size_t numpages_per_thread, leftover;
     char *addr = area;
@@ -487,6 +509,7 @@ static bool touch_all_pages(char *area, size_t hpagesize, size_t numpages,
         memset_thread[i].addr = addr;
         memset_thread[i].numpages = numpages_per_thread + (i < leftover);
         memset_thread[i].hpagesize = hpagesize;
+        memset_thread[i].populate = populate;
         qemu_thread_create(&memset_thread[i].pgthread, "touch_pages",
                            do_touch_pages, &memset_thread[i],
                            QEMU_THREAD_JOINABLE);
@@ -722,6 +745,26 @@ void qemu_free_stack(void *stack, size_t sz)
     munmap(stack, sz);
 }
 
+void qemu_trim_stack(void *stack, size_t sz, size_t keep)
+{
+#if !defined(HOST_IA64) && !defined(HOST_HPPA)
+    size_t pagesz = qemu_real_host_page_size;
+    size_t len;
+
+    /* The guard page is at the bottom, the stack grows down towards it */
+    keep = ROUND_UP(keep, pagesz);
+    if (sz <= keep + pagesz) {
+        return;
+    }
+    len = sz - keep - pagesz;
+
+    /* MADV_FREE is lazy; fall back on kernels that do not know it */
+    if (qemu_madvise(stack + pagesz, len, QEMU_MADV_FREE)) {
+        qemu_madvise(stack + pagesz, len, QEMU_MADV_DONTNEED);
+    }
+#endif
+}
+
 void sigaction_invoke(struct sigaction *action,
                       struct qemu_signalfd_siginfo *info)
 {
@@ -29,6 +29,7 @@
 #include "qemu/osdep.h"
 #include "qemu/coroutine.h"
 #include "qemu/coroutine_int.h"
+#include "qemu/lock-profile.h"
 #include "qemu/processor.h"
 #include "qemu/queue.h"
 #include "block/aio.h"
@@ -188,6 +189,11 @@ void qemu_co_mutex_init(CoMutex *mutex)
     memset(mutex, 0, sizeof(*mutex));
 }
 
+void qemu_co_mutex_set_profile_class(CoMutex *mutex, const char *name)
+{
+    mutex->profile_class = name;
+}
+
 static void coroutine_fn qemu_co_mutex_wake(CoMutex *mutex, Coroutine *co)
 {
     /* Read co before co->ctx; pairs with smp_wmb() in
@@ -204,6 +210,7 @@ static void coroutine_fn qemu_co_mutex_lock_slowpath(AioContext *ctx,
     Coroutine *self = qemu_coroutine_self();
     CoWaitRecord w;
     unsigned old_handoff;
+    int64_t start = lock_profile_begin();
 
     trace_qemu_co_mutex_lock_entry(mutex, self);
     w.co = self;
@@ -225,7 +232,7 @@ static void coroutine_fn qemu_co_mutex_lock_slowpath(AioContext *ctx,
             /* We got the lock ourselves!  */
             assert(to_wake == &w);
             mutex->ctx = ctx;
-            return;
+            goto out;
         }
 
         qemu_co_mutex_wake(mutex, co);
@@ -233,6 +240,9 @@ static void coroutine_fn qemu_co_mutex_lock_slowpath(AioContext *ctx,
 
     qemu_coroutine_yield();
     trace_qemu_co_mutex_lock_return(mutex, self);
+out:
+    lock_profile_end(mutex->profile_class ?: "CoMutex", __FILE__, __LINE__,
+                     start);
 }
 
 void coroutine_fn qemu_co_mutex_lock(CoMutex *mutex)
@@ -264,25 +264,43 @@ done:
     return 0;
 }
 
+/*
+ * Same digest as the Arasan NFC model: every codeword is folded into its own
+ * ecc_bytes_per_subpage sized slice of @oob.
+ */
 static void ecc_digest(uint8_t *data , uint8_t * oob,
                        uint32_t bytes_read, uint32_t page_size)
 {
-    int ecc_bytes_per_subpage =  ecc_size /
+    uint32_t ecc_bytes_per_subpage =  ecc_size /
                                     (page_size / ECC_CODEWORD_SIZE);
     uint32_t head = 0;
+
+    if (!ecc_bytes_per_subpage) {
+        return;
+    }
+
     while (head < bytes_read) {
-        oob[ecc_pos++] ^= ~data[head];
-        if (!(ecc_pos % ecc_bytes_per_subpage)) {
-            ecc_pos -= ecc_bytes_per_subpage;
+        uint32_t col = ecc_pos % ecc_bytes_per_subpage;
+        uint8_t *slice = &oob[ecc_pos - col];
+        uint32_t n = bytes_read - head;
+        uint32_t i;
+
+        if (n > ECC_CODEWORD_SIZE - ecc_subpage_offset) {
+            n = ECC_CODEWORD_SIZE - ecc_subpage_offset;
+        }
+        for (i = 0; i < n; i++) {
+            slice[col] ^= ~data[head + i];
+            if (++col == ecc_bytes_per_subpage) {
+                col = 0;
+            }
         }
+        head += n;
 
-        ecc_subpage_offset++;
+        ecc_subpage_offset += n;
         if (ecc_subpage_offset == ECC_CODEWORD_SIZE) {
             ecc_subpage_offset = 0;
-            do {
-                ecc_pos++;
-            } while (ecc_pos % ecc_bytes_per_subpage);
+            col = ecc_bytes_per_subpage;
         }
-        head++;
+        ecc_pos = slice - oob + col;
     }
 }
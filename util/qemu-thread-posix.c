@@ -13,6 +13,8 @@
 #include "qemu/osdep.h"
 #include "qemu/thread.h"
 #include "qemu/atomic.h"
+#include "qemu/bitops.h"
+#include "qemu/lock-profile.h"
 #include "qemu/notify.h"
 #include "qemu-thread-common.h"
 
@@ -69,13 +71,28 @@ void qemu_mutex_destroy(QemuMutex *mutex)
         error_exit(err, __func__);
 }
 
+void qemu_mutex_set_profile_class(QemuMutex *mutex, const char *name)
+{
+    mutex->profile_class = name;
+}
+
 void qemu_mutex_lock_impl(QemuMutex *mutex, const char *file, const int line)
 {
     int err;
 
     assert(mutex->initialized);
     qemu_mutex_pre_lock(mutex, file, line);
-    err = pthread_mutex_lock(&mutex->lock);
+    /*
+     * An uncontended trylock costs the same as the fast path of
+     * pthread_mutex_lock, so only contended acquisitions are timed.
+     */
+    err = pthread_mutex_trylock(&mutex->lock);
+    if (err == EBUSY) {
+        int64_t start = lock_profile_begin();
+
+        err = pthread_mutex_lock(&mutex->lock);
+        lock_profile_end(mutex->profile_class, file, line, start);
+    }
     if (err)
         error_exit(err, __func__);
     qemu_mutex_post_lock(mutex, file, line);
@@ -120,6 +137,7 @@ void qemu_rec_mutex_init(QemuRecMutex *mutex)
     if (err) {
         error_exit(err, __func__);
     }
+    mutex->profile_class = NULL;
     mutex->initialized = true;
 }
 
@@ -579,6 +597,32 @@ void qemu_thread_exit(void *retval)
     pthread_exit(retval);
 }
 
+int qemu_thread_set_affinity(QemuThread *thread,
+                             const unsigned long *host_cpus,
+                             unsigned long nbits)
+{
+#ifdef CONFIG_LINUX
+    cpu_set_t set;
+    unsigned long cpu;
+
+    CPU_ZERO(&set);
+    nbits = MIN(nbits, CPU_SETSIZE);
+    if (!host_cpus) {
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &set);
+        }
+    } else {
+        for (cpu = find_first_bit(host_cpus, nbits); cpu < nbits;
+             cpu = find_next_bit(host_cpus, nbits, cpu + 1)) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return -pthread_setaffinity_np(thread->thread, sizeof(set), &set);
+#else
+    return -ENOSYS;
+#endif
+}
+
 void *qemu_thread_join(QemuThread *thread)
 {
     int err;
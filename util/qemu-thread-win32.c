@@ -14,6 +14,7 @@
 #include "qemu/osdep.h"
 #include "qemu-common.h"
 #include "qemu/thread.h"
+#include "qemu/lock-profile.h"
 #include "qemu/notify.h"
 #include "qemu-thread-common.h"
 #include <process.h>
@@ -52,11 +53,21 @@ void qemu_mutex_destroy(QemuMutex *mutex)
     InitializeSRWLock(&mutex->lock);
 }
 
+void qemu_mutex_set_profile_class(QemuMutex *mutex, const char *name)
+{
+    mutex->profile_class = name;
+}
+
 void qemu_mutex_lock_impl(QemuMutex *mutex, const char *file, const int line)
 {
     assert(mutex->initialized);
     qemu_mutex_pre_lock(mutex, file, line);
-    AcquireSRWLockExclusive(&mutex->lock);
+    if (!TryAcquireSRWLockExclusive(&mutex->lock)) {
+        int64_t start = lock_profile_begin();
+
+        AcquireSRWLockExclusive(&mutex->lock);
+        lock_profile_end(mutex->profile_class, file, line, start);
+    }
     qemu_mutex_post_lock(mutex, file, line);
 }
 
@@ -83,9 +94,15 @@ void qemu_mutex_unlock_impl(QemuMutex *mutex, const char *file, const int line)
 void qemu_rec_mutex_init(QemuRecMutex *mutex)
 {
     InitializeCriticalSection(&mutex->lock);
+    mutex->profile_class = NULL;
     mutex->initialized = true;
 }
 
+void qemu_rec_mutex_set_profile_class(QemuRecMutex *mutex, const char *name)
+{
+    mutex->profile_class = name;
+}
+
 void qemu_rec_mutex_destroy(QemuRecMutex *mutex)
 {
     assert(mutex->initialized);
@@ -96,7 +113,12 @@ void qemu_rec_mutex_destroy(QemuRecMutex *mutex)
 void qemu_rec_mutex_lock_impl(QemuRecMutex *mutex, const char *file, int line)
 {
     assert(mutex->initialized);
-    EnterCriticalSection(&mutex->lock);
+    if (!TryEnterCriticalSection(&mutex->lock)) {
+        int64_t start = lock_profile_begin();
+
+        EnterCriticalSection(&mutex->lock);
+        lock_profile_end(mutex->profile_class, file, line, start);
+    }
 }
 
 int qemu_rec_mutex_trylock_impl(QemuRecMutex *mutex, const char *file, int line)
@@ -459,3 +481,10 @@ bool qemu_thread_is_self(QemuThread *thread)
 {
     return GetCurrentThreadId() == thread->tid;
 }
+
+int qemu_thread_set_affinity(QemuThread *thread,
+                             const unsigned long *host_cpus,
+                             unsigned long nbits)
+{
+    return -ENOSYS;
+}
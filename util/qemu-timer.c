@@ -60,12 +60,22 @@ static QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
  * used by different AioContexts / threads. Each clock also has
  * a list of the QEMUTimerLists associated with it, in order that
  * reenabling the clock can call all the notifiers.
+ *
+ * The active timers are kept in pairing heaps ordered by expire time, so
+ * that arming a timer is O(1) and removing one is O(log n) amortized even
+ * with hundreds of them.  External timers have their own heap because
+ * qemu_clock_deadline_ns_all() can be asked to skip them.
  */
 
+#define TIMER_HEAP_INTERNAL 0
+#define TIMER_HEAP_EXTERNAL 1
+#define TIMER_HEAP_MAX      2
+
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
-    QEMUTimer *active_timers;
+    QEMUTimer *active_timers[TIMER_HEAP_MAX];
+    uint64_t active_timers_seq;
     QLIST_ENTRY(QEMUTimerList) list;
     QEMUTimerListNotifyCB *notify_cb;
     void *notify_opaque;
@@ -92,6 +102,125 @@ static bool timer_expired_ns(QEMUTimer *timer_head, int64_t current_time)
     return timer_head && (timer_head->expire_time <= current_time);
 }
 
+/* Timers with the same expire time fire in the order they were armed */
+static bool timer_before(QEMUTimer *a, QEMUTimer *b)
+{
+    return a->expire_time < b->expire_time ||
+           (a->expire_time == b->expire_time && a->seq < b->seq);
+}
+
+static QEMUTimer **timer_heap(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    int heap = ts->attributes & QEMU_TIMER_ATTR_EXTERNAL ?
+               TIMER_HEAP_EXTERNAL : TIMER_HEAP_INTERNAL;
+
+    return &timer_list->active_timers[heap];
+}
+
+/* Link two heap roots, the later one becoming a child of the earlier one */
+static QEMUTimer *timer_heap_meld(QEMUTimer *a, QEMUTimer *b)
+{
+    if (timer_before(b, a)) {
+        QEMUTimer *t = a;
+        a = b;
+        b = t;
+    }
+
+    b->prev = a;
+    b->next = a->child;
+    if (a->child) {
+        a->child->prev = b;
+    }
+    a->child = b;
+    a->next = NULL;
+    a->prev = NULL;
+    return a;
+}
+
+/* Standard two-pass pairing of the children of a removed node */
+static QEMUTimer *timer_heap_merge_pairs(QEMUTimer *first)
+{
+    QEMUTimer *pairs = NULL;
+    QEMUTimer *root = NULL;
+
+    while (first) {
+        QEMUTimer *a = first;
+        QEMUTimer *b = a->next;
+
+        if (b) {
+            first = b->next;
+            a = timer_heap_meld(a, b);
+        } else {
+            first = NULL;
+        }
+        a->next = pairs;
+        pairs = a;
+    }
+
+    while (pairs) {
+        QEMUTimer *a = pairs;
+
+        pairs = a->next;
+        a->next = NULL;
+        root = root ? timer_heap_meld(root, a) : a;
+    }
+
+    if (root) {
+        root->prev = NULL;
+    }
+    return root;
+}
+
+static void timer_heap_insert(QEMUTimer **root, QEMUTimer *ts)
+{
+    ts->child = NULL;
+    ts->next = NULL;
+    ts->prev = NULL;
+    atomic_set(root, *root ? timer_heap_meld(*root, ts) : ts);
+}
+
+static void timer_heap_remove(QEMUTimer **root, QEMUTimer *ts)
+{
+    QEMUTimer *sub = timer_heap_merge_pairs(ts->child);
+
+    if (ts == *root) {
+        atomic_set(root, sub);
+    } else {
+        if (ts->prev->child == ts) {
+            ts->prev->child = ts->next;
+        } else {
+            ts->prev->next = ts->next;
+        }
+        if (ts->next) {
+            ts->next->prev = ts->prev;
+        }
+        if (sub) {
+            atomic_set(root, timer_heap_meld(*root, sub));
+        }
+    }
+    ts->child = NULL;
+    ts->next = NULL;
+    ts->prev = NULL;
+}
+
+static inline bool timerlist_active(QEMUTimerList *timer_list)
+{
+    return atomic_read(&timer_list->active_timers[TIMER_HEAP_INTERNAL]) ||
+           atomic_read(&timer_list->active_timers[TIMER_HEAP_EXTERNAL]);
+}
+
+/* The next timer to expire; called with active_timers_lock held */
+static QEMUTimer *timerlist_first(QEMUTimerList *timer_list)
+{
+    QEMUTimer *a = timer_list->active_timers[TIMER_HEAP_INTERNAL];
+    QEMUTimer *b = timer_list->active_timers[TIMER_HEAP_EXTERNAL];
+
+    if (!a || !b) {
+        return a ? a : b;
+    }
+    return timer_before(b, a) ? b : a;
+}
+
 QEMUTimerList *timerlist_new(QEMUClockType type,
                              QEMUTimerListNotifyCB *cb,
                              void *opaque)
@@ -170,7 +299,7 @@ void qemu_clock_enable(QEMUClockType type, bool enabled)
 
 bool timerlist_has_timers(QEMUTimerList *timer_list)
 {
-    return !!atomic_read(&timer_list->active_timers);
+    return timerlist_active(timer_list);
 }
 
 bool qemu_clock_has_timers(QEMUClockType type)
@@ -181,17 +310,19 @@ bool qemu_clock_has_timers(QEMUClockType type)
 
 bool timerlist_expired(QEMUTimerList *timer_list)
 {
+    QEMUTimer *ts;
     int64_t expire_time;
 
-    if (!atomic_read(&timer_list->active_timers)) {
+    if (!timerlist_active(timer_list)) {
         return false;
     }
 
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        ts = timerlist_first(timer_list);
+        if (!ts) {
             return false;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = ts->expire_time;
     }
 
     return expire_time <= qemu_clock_get_ns(timer_list->clock->type);
@@ -210,10 +341,11 @@ bool qemu_clock_expired(QEMUClockType type)
 
 int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
 {
+    QEMUTimer *ts;
     int64_t delta;
     int64_t expire_time;
 
-    if (!atomic_read(&timer_list->active_timers)) {
+    if (!timerlist_active(timer_list)) {
         return -1;
     }
 
@@ -226,10 +358,11 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
      * the caller should notice the change and there is no race condition.
      */
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        ts = timerlist_first(timer_list);
+        if (!ts) {
             return -1;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = ts->expire_time;
     }
 
     delta = expire_time - qemu_clock_get_ns(timer_list->clock->type);
@@ -261,10 +394,14 @@ int64_t qemu_clock_deadline_ns_all(QEMUClockType type, int attr_mask)
 
     QLIST_FOREACH(timer_list, &clock->timerlists, list) {
         qemu_mutex_lock(&timer_list->active_timers_lock);
-        ts = timer_list->active_timers;
-        /* Skip all external timers */
-        while (ts && (ts->attributes & ~attr_mask)) {
-            ts = ts->next;
+        ts = timer_list->active_timers[TIMER_HEAP_INTERNAL];
+        /* Skip all external timers unless asked for */
+        if (attr_mask & QEMU_TIMER_ATTR_EXTERNAL) {
+            QEMUTimer *ext = timer_list->active_timers[TIMER_HEAP_EXTERNAL];
+
+            if (!ts || (ext && timer_before(ext, ts))) {
+                ts = ext;
+            }
         }
         if (!ts) {
             qemu_mutex_unlock(&timer_list->active_timers_lock);
@@ -376,41 +513,20 @@ void timer_deinit(QEMUTimer *ts)
 
 static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
 {
-    QEMUTimer **pt, *t;
-
-    ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            atomic_set(pt, t->next);
-            break;
-        }
-        pt = &t->next;
+    if (ts->expire_time != -1) {
+        timer_heap_remove(timer_heap(timer_list, ts), ts);
     }
+    ts->expire_time = -1;
 }
 
 static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
                                 QEMUTimer *ts, int64_t expire_time)
 {
-    QEMUTimer **pt, *t;
-
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
-    for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
-            break;
-        }
-        pt = &t->next;
-    }
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    atomic_set(pt, ts);
+    ts->seq = timer_list->active_timers_seq++;
+    timer_heap_insert(timer_heap(timer_list, ts), ts);
 
-    return pt == &timer_list->active_timers;
+    return timerlist_first(timer_list) == ts;
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -503,7 +619,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
     void *opaque;
     bool need_replay_checkpoint = false;
 
-    if (!atomic_read(&timer_list->active_timers)) {
+    if (!timerlist_active(timer_list)) {
         return false;
     }
 
@@ -552,7 +668,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
      */
     current_time = qemu_clock_get_ns(timer_list->clock->type);
     qemu_mutex_lock(&timer_list->active_timers_lock);
-    while ((ts = timer_list->active_timers)) {
+    while ((ts = timerlist_first(timer_list))) {
         if (!timer_expired_ns(ts, current_time)) {
             /* No expired timers left.  The checkpoint can be skipped
              * if no timers fired or they were all external.
@@ -575,9 +691,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
-        ts->expire_time = -1;
+        timer_del_locked(timer_list, ts);
         cb = ts->cb;
         opaque = ts->opaque;
 
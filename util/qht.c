@@ -22,8 +22,8 @@
  * - Writes (i.e. insertions/removals) can be concurrent with writes to
  *   different buckets; writes to the same bucket are serialized through a lock.
  * - Optional auto-resizing: the hash table resizes up if the load surpasses
- *   a certain threshold. Resizing is done concurrently with readers; writes
- *   are serialized with the resize operation.
+ *   a certain threshold. Resizing is done concurrently with readers and,
+ *   for automatic resizes, incrementally with writers.
  *
  * The key structure is the bucket, which is cacheline-sized. Buckets
  * contain a few hash values and pointers; the u32 hash values are stored in
@@ -43,10 +43,22 @@
  * just-removed entry. This makes lookups slightly faster, since the moment an
  * invalid entry is found, the (failed) lookup is over.
  *
- * Resizing is done by taking all bucket spinlocks (so that no other writers can
- * race with us) and then copying all entries into a new hash map. Then, the
- * ht->map pointer is set, and the old map is freed once no RCU readers can see
- * it anymore.
+ * Explicit resizes (qht_resize, qht_reset_size) are done by taking all bucket
+ * spinlocks (so that no other writers can race with us) and then copying all
+ * entries into a new hash map. Then, the ht->map pointer is set, and the old
+ * map is freed once no RCU readers can see it anymore.
+ *
+ * Automatic resizes must not stall every writer for the time it takes to copy
+ * the whole table, so they double the map incrementally instead. The new map
+ * is published right away with a pointer to the old one. Each head bucket of
+ * the old map is then migrated on its own, under its lock, either on demand by
+ * a writer to one of the two new buckets its entries map to, or by writers
+ * walking the old map a few buckets at a time. Lookups of a not yet migrated
+ * bucket go to the old map; the migration is done inside the old bucket's
+ * seqlock write section, so lookups racing with it retry. Operations that need
+ * the whole table (iterators, resets and explicit resizes) finish the
+ * migration first. Once the last bucket is migrated the old map is freed after
+ * an RCU grace period.
  *
  * Writers check for concurrent resizes by comparing ht->map before and after
  * acquiring their bucket lock. If they don't match, a resize has occured
@@ -68,6 +80,7 @@
 #include "qemu/osdep.h"
 #include "qemu/qht.h"
 #include "qemu/atomic.h"
+#include "qemu/bitmap.h"
 #include "qemu/rcu.h"
 
 //#define QHT_DEBUG
@@ -159,6 +172,11 @@ QEMU_BUILD_BUG_ON(sizeof(struct qht_bucket) > QHT_BUCKET_ALIGN);
  * @n_added_buckets: number of added (i.e. "non-head") buckets
  * @n_added_buckets_threshold: threshold to trigger an upward resize once the
  *                             number of added buckets surpasses it.
+ * @old: map with half as many buckets that is being migrated into this one,
+ *       or NULL once the migration is over (or if there is none).
+ * @migrated: bitmap of the head buckets of @old that have been migrated.
+ * @n_migrated: number of bits set in @migrated.
+ * @migrate_next: next head bucket of @old for writers to migrate.
  *
  * Buckets are tracked in what we call a "map", i.e. this structure.
  */
@@ -168,14 +186,25 @@ struct qht_map {
     size_t n_buckets;
     size_t n_added_buckets;
     size_t n_added_buckets_threshold;
+    struct qht_map *old;
+    unsigned long *migrated;
+    size_t n_migrated;
+    size_t migrate_next;
 };
 
 /* trigger a resize when n_added_buckets > n_buckets / div */
 #define QHT_NR_ADDED_BUCKETS_THRESHOLD_DIV 8
 
+/* number of old head buckets each writer migrates during a resize */
+#define QHT_MIGRATE_BATCH 4
+
 static void qht_do_resize_reset(struct qht *ht, struct qht_map *new,
                                 bool reset);
 static void qht_grow_maybe(struct qht *ht);
+static void *qht_insert__locked(const struct qht *ht, struct qht_map *map,
+                                struct qht_bucket *head, void *p, uint32_t hash,
+                                bool *needs_resize);
+static void qht_map_destroy(struct qht_map *map);
 
 #ifdef QHT_DEBUG
 
@@ -274,8 +303,111 @@ static inline bool qht_map_is_stale__locked(const struct qht *ht,
     return map != ht->map;
 }
 
+static inline bool qht_map_is_migrated(const struct qht_map *map, size_t idx)
+{
+    return atomic_read(&map->migrated[BIT_WORD(idx)]) & BIT_MASK(idx);
+}
+
 /*
- * Grab all bucket locks, and set @pmap after making sure the map isn't stale.
+ * Move the entries of head bucket @idx of @old, i.e. @map->old, into @map.
+ * Entries are copied, not removed: the old bucket is simply ignored once it
+ * is marked as migrated.
+ *
+ * Note: callers cannot have any bucket lock held.
+ */
+static void qht_map_migrate_bucket(const struct qht *ht, struct qht_map *map,
+                                   struct qht_map *old, size_t idx)
+{
+    struct qht_bucket *head = &old->buckets[idx];
+    struct qht_bucket *lo = &map->buckets[idx];
+    struct qht_bucket *hi = &map->buckets[idx + old->n_buckets];
+    struct qht_bucket *b;
+    int i;
+
+    if (qht_map_is_migrated(map, idx)) {
+        return;
+    }
+    qemu_spin_lock(&head->lock);
+    if (qht_map_is_migrated(map, idx)) {
+        qemu_spin_unlock(&head->lock);
+        return;
+    }
+    qemu_spin_lock(&lo->lock);
+    qemu_spin_lock(&hi->lock);
+
+    seqlock_write_begin(&head->sequence);
+    b = head;
+    do {
+        for (i = 0; i < QHT_BUCKET_ENTRIES; i++) {
+            if (b->pointers[i] == NULL) {
+                goto done;
+            }
+            qht_insert__locked(ht, map,
+                               qht_map_to_bucket(map, b->hashes[i]),
+                               b->pointers[i], b->hashes[i], NULL);
+        }
+        b = b->next;
+    } while (b);
+ done:
+    /* pairs with smp_rmb() in qht_lookup__migrating() */
+    set_bit_atomic(idx, map->migrated);
+    seqlock_write_end(&head->sequence);
+
+    qht_bucket_debug__locked(lo);
+    qht_bucket_debug__locked(hi);
+    qemu_spin_unlock(&hi->lock);
+    qemu_spin_unlock(&lo->lock);
+    qemu_spin_unlock(&head->lock);
+
+    if (atomic_fetch_inc(&map->n_migrated) + 1 == old->n_buckets) {
+        atomic_rcu_set(&map->old, NULL);
+        call_rcu(old, qht_map_destroy, rcu);
+    }
+}
+
+/*
+ * Migrate the old bucket that @hash maps to, so that the bucket of @hash in
+ * @map can be written to, plus a few more to make progress.
+ */
+static void qht_map_migrate_some(const struct qht *ht, struct qht_map *map,
+                                 struct qht_map *old, uint32_t hash)
+{
+    size_t n_old = map->n_buckets / 2;
+    int i;
+
+    qht_map_migrate_bucket(ht, map, old, hash & (n_old - 1));
+    for (i = 0; i < QHT_MIGRATE_BATCH; i++) {
+        size_t idx = atomic_fetch_inc(&map->migrate_next);
+
+        if (idx >= n_old) {
+            break;
+        }
+        qht_map_migrate_bucket(ht, map, old, idx);
+    }
+}
+
+/*
+ * Finish an incremental resize of @map, if any.  On return every bucket of
+ * @map->old has been migrated, although @map->old might not be NULL yet.
+ *
+ * Note: callers cannot have any bucket lock held.
+ */
+static void qht_map_migrate_all(const struct qht *ht, struct qht_map *map)
+{
+    struct qht_map *old = atomic_rcu_read(&map->old);
+    size_t i;
+
+    if (likely(old == NULL)) {
+        return;
+    }
+    for (i = 0; i < map->n_buckets / 2; i++) {
+        qht_map_migrate_bucket(ht, map, old, i);
+    }
+}
+
+/*
+ * Grab all bucket locks, and set @pmap after making sure the map isn't stale
+ * and holds all entries.
  *
  * Pairs with qht_map_unlock_buckets(), hence the pass-by-reference.
  *
@@ -287,16 +419,22 @@ void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
     struct qht_map *map;
 
     map = atomic_rcu_read(&ht->map);
-    qht_map_lock_buckets(map);
-    if (likely(!qht_map_is_stale__locked(ht, map))) {
-        *pmap = map;
-        return;
+    if (likely(atomic_rcu_read(&map->old) == NULL)) {
+        qht_map_lock_buckets(map);
+        if (likely(!qht_map_is_stale__locked(ht, map))) {
+            *pmap = map;
+            return;
+        }
+        qht_map_unlock_buckets(map);
     }
-    qht_map_unlock_buckets(map);
 
-    /* we raced with a resize; acquire ht->lock to see the updated ht->map */
+    /*
+     * We raced with a resize or one is in progress; acquire ht->lock to see
+     * the updated ht->map and to keep another resize from starting.
+     */
     qht_lock(ht);
     map = ht->map;
+    qht_map_migrate_all(ht, map);
     qht_map_lock_buckets(map);
     qht_unlock(ht);
     *pmap = map;
@@ -317,8 +455,13 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
 {
     struct qht_bucket *b;
     struct qht_map *map;
+    struct qht_map *old;
 
     map = atomic_rcu_read(&ht->map);
+    old = atomic_rcu_read(&map->old);
+    if (unlikely(old)) {
+        qht_map_migrate_some(ht, map, old, hash);
+    }
     b = qht_map_to_bucket(map, hash);
 
     qemu_spin_lock(&b->lock);
@@ -331,6 +474,10 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
     /* we raced with a resize; acquire ht->lock to see the updated ht->map */
     qht_lock(ht);
     map = ht->map;
+    old = atomic_rcu_read(&map->old);
+    if (unlikely(old)) {
+        qht_map_migrate_some(ht, map, old, hash);
+    }
     b = qht_map_to_bucket(map, hash);
     qemu_spin_lock(&b->lock);
     qht_unlock(ht);
@@ -364,6 +511,7 @@ static void qht_map_destroy(struct qht_map *map)
         qht_chain_destroy(&map->buckets[i]);
     }
     qemu_vfree(map->buckets);
+    g_free(map->migrated);
     g_free(map);
 }
 
@@ -378,6 +526,10 @@ static struct qht_map *qht_map_create(size_t n_buckets)
     map->n_added_buckets = 0;
     map->n_added_buckets_threshold = n_buckets /
         QHT_NR_ADDED_BUCKETS_THRESHOLD_DIV;
+    map->old = NULL;
+    map->migrated = NULL;
+    map->n_migrated = 0;
+    map->migrate_next = 0;
 
     /* let tiny hash tables to at least add one non-head bucket */
     if (unlikely(map->n_added_buckets_threshold == 0)) {
@@ -409,6 +561,9 @@ void qht_init(struct qht *ht, qht_cmp_func_t cmp, size_t n_elems,
 /* call only when there are no readers/writers left */
 void qht_destroy(struct qht *ht)
 {
+    if (ht->map->old) {
+        qht_map_destroy(ht->map->old);
+    }
     qht_map_destroy(ht->map);
     memset(ht, 0, sizeof(*ht));
 }
@@ -523,15 +678,47 @@ void *qht_lookup__slowpath(const struct qht_bucket *b, qht_lookup_func_t func,
     return ret;
 }
 
+/*
+ * Look up @hash while @map is being migrated from @old: the entry is in @old
+ * until its head bucket there is marked as migrated.
+ */
+static __attribute__((noinline))
+void *qht_lookup__migrating(const struct qht_map *map,
+                            const struct qht_map *old, qht_lookup_func_t func,
+                            const void *userp, uint32_t hash)
+{
+    size_t idx = hash & (old->n_buckets - 1);
+    const struct qht_bucket *head = &old->buckets[idx];
+    unsigned int version;
+    void *ret;
+
+    do {
+        version = seqlock_read_begin(&head->sequence);
+        if (qht_map_is_migrated(map, idx)) {
+            /* pairs with set_bit_atomic() in qht_map_migrate_bucket() */
+            smp_rmb();
+            return qht_lookup__slowpath(qht_map_to_bucket(map, hash), func,
+                                        userp, hash);
+        }
+        ret = qht_do_lookup(head, func, userp, hash);
+    } while (seqlock_read_retry(&head->sequence, version));
+    return ret;
+}
+
 void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
                         qht_lookup_func_t func)
 {
     const struct qht_bucket *b;
     const struct qht_map *map;
+    const struct qht_map *old;
     unsigned int version;
     void *ret;
 
     map = atomic_rcu_read(&ht->map);
+    old = atomic_rcu_read(&map->old);
+    if (unlikely(old)) {
+        return qht_lookup__migrating(map, old, func, userp, hash);
+    }
     b = qht_map_to_bucket(map, hash);
 
     version = seqlock_read_begin(&b->sequence);
@@ -613,11 +800,20 @@ static __attribute__((noinline)) void qht_grow_maybe(struct qht *ht)
         return;
     }
     map = ht->map;
-    /* another thread might have just performed the resize we were after */
-    if (qht_map_needs_resize(map)) {
+    /*
+     * Another thread might have just performed the resize we were after.
+     * Do not start a new one while the previous one is still migrating.
+     */
+    if (!atomic_read(&map->old) && qht_map_needs_resize(map)) {
         struct qht_map *new = qht_map_create(map->n_buckets * 2);
 
-        qht_do_resize(ht, new);
+        /*
+         * Publish the bigger map right away; its buckets are filled by
+         * writers as they go, see qht_map_migrate_bucket().
+         */
+        new->migrated = bitmap_new(map->n_buckets);
+        new->old = map;
+        atomic_rcu_set(&ht->map, new);
     }
     qht_unlock(ht);
 }
@@ -802,8 +998,7 @@ do_qht_iter(struct qht *ht, const struct qht_iter *iter, void *userp)
 {
     struct qht_map *map;
 
-    map = atomic_rcu_read(&ht->map);
-    qht_map_lock_buckets(map);
+    qht_map_lock_buckets__no_stale(ht, &map);
     qht_map_iter__all_locked(map, iter, userp);
     qht_map_unlock_buckets(map);
 }
@@ -858,6 +1053,7 @@ static void qht_do_resize_reset(struct qht *ht, struct qht_map *new, bool reset)
     struct qht_map_copy_data data;
 
     old = ht->map;
+    qht_map_migrate_all(ht, old);
     qht_map_lock_buckets(old);
 
     if (reset) {
@@ -902,6 +1098,7 @@ bool qht_resize(struct qht *ht, size_t n_elems)
 void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
 {
     const struct qht_map *map;
+    const struct qht_map *old;
     int i;
 
     map = atomic_rcu_read(&ht->map);
@@ -916,6 +1113,7 @@ void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
         return;
     }
     stats->head_buckets = map->n_buckets;
+    old = atomic_rcu_read(&map->old);
 
     for (i = 0; i < map->n_buckets; i++) {
         const struct qht_bucket *head = &map->buckets[i];
@@ -925,6 +1123,43 @@ void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
         size_t entries;
         int j;
 
+        if (old) {
+            size_t idx = i & (old->n_buckets - 1);
+
+            /*
+             * Count the entries that this bucket will hold once its old
+             * bucket is migrated, as if they were packed in a chain.
+             */
+            head = &old->buckets[idx];
+            do {
+                version = seqlock_read_begin(&head->sequence);
+                if (qht_map_is_migrated(map, idx)) {
+                    smp_rmb();
+                    head = &map->buckets[i];
+                    break;
+                }
+                entries = 0;
+                b = head;
+                do {
+                    for (j = 0; j < QHT_BUCKET_ENTRIES; j++) {
+                        if (atomic_read(&b->pointers[j]) == NULL) {
+                            break;
+                        }
+                        if (qht_map_to_bucket(map, atomic_read(&b->hashes[j]))
+                            == &map->buckets[i]) {
+                            entries++;
+                        }
+                    }
+                    b = atomic_rcu_read(&b->next);
+                } while (b);
+            } while (seqlock_read_retry(&head->sequence, version));
+
+            if (head == &old->buckets[idx]) {
+                buckets = DIV_ROUND_UP(entries, QHT_BUCKET_ENTRIES);
+                goto account;
+            }
+        }
+
         do {
             version = seqlock_read_begin(&head->sequence);
             buckets = 0;
@@ -942,6 +1177,7 @@ void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
             } while (b);
         } while (seqlock_read_retry(&head->sequence, version));
 
+    account:
         if (entries) {
             qdist_inc(&stats->chain, buckets);
             qdist_inc(&stats->occupancy,
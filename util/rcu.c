@@ -49,6 +49,16 @@ QemuEvent rcu_gp_event;
 static QemuMutex rcu_registry_lock;
 static QemuMutex rcu_sync_lock;
 
+/*
+ * Number of grace periods started and completed.  Written under
+ * rcu_sync_lock; rcu_gp_started is also read outside it.
+ */
+static unsigned long rcu_gp_started;
+static unsigned long rcu_gp_done;
+
+/* Number of synchronize_rcu_expedited() callers */
+static int rcu_gp_expedite;
+
 /*
  * Check whether a quiescent state was crossed between the beginning of
  * update_counter_and_wait and now.
@@ -107,6 +117,8 @@ static void wait_for_readers(void)
                  * get some extra futex wakeups.
                  */
                 atomic_set(&index->waiting, false);
+            } else if (atomic_read(&rcu_gp_expedite)) {
+                notifier_list_notify(&index->force_rcu, NULL);
             }
         }
 
@@ -140,10 +152,9 @@ static void wait_for_readers(void)
     QLIST_SWAP(&registry, &qsreaders, node);
 }
 
-void synchronize_rcu(void)
+/* Called with rcu_sync_lock held.  */
+static void rcu_run_grace_period(void)
 {
-    QEMU_LOCK_GUARD(&rcu_sync_lock);
-
     /* Write RCU-protected pointers before reading p_rcu_reader->ctr.
      * Pairs with smp_mb_placeholder() in rcu_read_lock().
      */
@@ -172,9 +183,47 @@ void synchronize_rcu(void)
     }
 }
 
+void synchronize_rcu(void)
+{
+    unsigned long target;
+
+    /*
+     * Concurrent callers are combined: any grace period that starts after
+     * this point also covers our caller, so wait for one instead of
+     * running one more.  Pairs with the smp_mb_global() at the start of
+     * rcu_run_grace_period(): either that grace period sees our updates
+     * or we see it start.
+     */
+    smp_mb();
+    target = atomic_read(&rcu_gp_started) + 1;
+
+    QEMU_LOCK_GUARD(&rcu_sync_lock);
+    if ((long)(rcu_gp_done - target) >= 0) {
+        return;
+    }
+    atomic_set(&rcu_gp_started, rcu_gp_started + 1);
+    rcu_run_grace_period();
+    rcu_gp_done = rcu_gp_started;
+}
+
+void synchronize_rcu_expedited(void)
+{
+    atomic_inc(&rcu_gp_expedite);
+    /* Make a grace period that is already waiting rescan the readers */
+    qemu_event_set(&rcu_gp_event);
+    synchronize_rcu();
+    atomic_dec(&rcu_gp_expedite);
+}
+
 
 #define RCU_CALL_MIN_SIZE        30
 
+/*
+ * Past this many pending callbacks, e.g. FlatViews during a burst of
+ * memory remapping, do not let slow readers hold them any longer.
+ */
+#define RCU_CALL_EXPEDITE_SIZE   1000
+
 /* Multi-producer, single-consumer queue based on urcu/static/wfqueue.h
  * from liburcu.  Note that head is only used by the consumer.
  */
@@ -262,7 +311,11 @@ static void *call_rcu_thread(void *opaque)
         }
 
         atomic_sub(&rcu_call_count, n);
-        synchronize_rcu();
+        if (n >= RCU_CALL_EXPEDITE_SIZE) {
+            synchronize_rcu_expedited();
+        } else {
+            synchronize_rcu();
+        }
         qemu_mutex_lock_iothread();
         while (n > 0) {
             node = try_dequeue();
@@ -308,6 +361,20 @@ void rcu_unregister_thread(void)
     qemu_mutex_unlock(&rcu_registry_lock);
 }
 
+void rcu_add_force_rcu_notifier(Notifier *n)
+{
+    qemu_mutex_lock(&rcu_registry_lock);
+    notifier_list_add(&rcu_reader.force_rcu, n);
+    qemu_mutex_unlock(&rcu_registry_lock);
+}
+
+void rcu_remove_force_rcu_notifier(Notifier *n)
+{
+    qemu_mutex_lock(&rcu_registry_lock);
+    notifier_remove(n);
+    qemu_mutex_unlock(&rcu_registry_lock);
+}
+
 static void rcu_init_complete(void)
 {
     QemuThread thread;
@@ -0,0 +1,131 @@
+/*
+ * Host CPU placement of QEMU threads
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/queue.h"
+#include "qemu/thread-placement.h"
+#include "trace.h"
+
+struct ThreadPlacement {
+    QemuThread thread;
+    ThreadPlacementClass cls;
+    int index;
+    QLIST_ENTRY(ThreadPlacement) next;
+};
+
+typedef struct ThreadPlacementPolicy {
+    unsigned long *cpus;    /* NULL if unrestricted */
+    bool pin;
+} ThreadPlacementPolicy;
+
+static const char *const thread_placement_class_names[] = {
+    [THREAD_PLACEMENT_VCPU] = "vcpu",
+    [THREAD_PLACEMENT_IOTHREAD] = "iothread",
+    [THREAD_PLACEMENT_WORKER] = "worker",
+};
+
+/* Protects both the registered threads and the policies */
+static QemuMutex thread_placement_lock;
+static QLIST_HEAD(, ThreadPlacement) thread_placement_list =
+    QLIST_HEAD_INITIALIZER(thread_placement_list);
+static ThreadPlacementPolicy thread_placement_policy[THREAD_PLACEMENT__MAX];
+
+static void __attribute__((constructor)) thread_placement_init(void)
+{
+    qemu_mutex_init(&thread_placement_lock);
+}
+
+static void thread_placement_apply(ThreadPlacement *tp)
+{
+    ThreadPlacementPolicy *p = &thread_placement_policy[tp->cls];
+    const unsigned long *cpus = p->cpus;
+    DECLARE_BITMAP(one, THREAD_PLACEMENT_MAX_CPUS);
+    unsigned long cpu, n;
+    int ret;
+
+    if (cpus && p->pin) {
+        n = tp->index % bitmap_count_one(cpus, THREAD_PLACEMENT_MAX_CPUS);
+        cpu = find_first_bit(cpus, THREAD_PLACEMENT_MAX_CPUS);
+        while (n--) {
+            cpu = find_next_bit(cpus, THREAD_PLACEMENT_MAX_CPUS, cpu + 1);
+        }
+        bitmap_zero(one, THREAD_PLACEMENT_MAX_CPUS);
+        set_bit(cpu, one);
+        cpus = one;
+    }
+
+    ret = qemu_thread_set_affinity(&tp->thread, cpus,
+                                   THREAD_PLACEMENT_MAX_CPUS);
+    trace_thread_placement_apply(thread_placement_class_names[tp->cls],
+                                 tp->index, ret);
+}
+
+ThreadPlacement *thread_placement_add(QemuThread *thread,
+                                      ThreadPlacementClass cls, int index)
+{
+    ThreadPlacement *tp = g_new0(ThreadPlacement, 1);
+
+    tp->thread = *thread;
+    tp->cls = cls;
+    tp->index = index;
+
+    qemu_mutex_lock(&thread_placement_lock);
+    QLIST_INSERT_HEAD(&thread_placement_list, tp, next);
+    if (thread_placement_policy[cls].cpus) {
+        thread_placement_apply(tp);
+    }
+    qemu_mutex_unlock(&thread_placement_lock);
+    return tp;
+}
+
+void thread_placement_del(ThreadPlacement *tp)
+{
+    if (!tp) {
+        return;
+    }
+
+    qemu_mutex_lock(&thread_placement_lock);
+    QLIST_REMOVE(tp, next);
+    qemu_mutex_unlock(&thread_placement_lock);
+    g_free(tp);
+}
+
+void thread_placement_set_policy(ThreadPlacementClass cls,
+                                 const unsigned long *cpus, bool pin)
+{
+    ThreadPlacementPolicy *p = &thread_placement_policy[cls];
+    ThreadPlacement *tp;
+
+    /* An empty set would leave the threads nowhere to run */
+    if (cpus && bitmap_empty(cpus, THREAD_PLACEMENT_MAX_CPUS)) {
+        cpus = NULL;
+    }
+
+    qemu_mutex_lock(&thread_placement_lock);
+    if (!cpus && !p->cpus) {
+        qemu_mutex_unlock(&thread_placement_lock);
+        return;
+    }
+
+    g_free(p->cpus);
+    p->cpus = NULL;
+    if (cpus) {
+        p->cpus = bitmap_new(THREAD_PLACEMENT_MAX_CPUS);
+        bitmap_copy(p->cpus, cpus, THREAD_PLACEMENT_MAX_CPUS);
+    }
+    p->pin = pin;
+
+    QLIST_FOREACH(tp, &thread_placement_list, next) {
+        if (tp->cls == cls) {
+            thread_placement_apply(tp);
+        }
+    }
+    qemu_mutex_unlock(&thread_placement_lock);
+}
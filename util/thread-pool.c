@@ -17,6 +17,7 @@
 #include "qemu/osdep.h"
 #include "qemu/queue.h"
 #include "qemu/thread.h"
+#include "qemu/thread-placement.h"
 #include "qemu/coroutine.h"
 #include "trace.h"
 #include "block/thread-pool.h"
@@ -50,6 +51,11 @@ struct ThreadPoolElement {
 
     /* Access to this list is protected by the global mutex.  */
     QLIST_ENTRY(ThreadPoolElement) all;
+
+    /* Pushed onto done_list once state is THREAD_DONE.  */
+    QSLIST_ENTRY(ThreadPoolElement) next_done;
+    /* Only accessed from the pool's AioContext.  */
+    QSIMPLEQ_ENTRY(ThreadPoolElement) next_completed;
 };
 
 struct ThreadPool {
@@ -63,6 +69,14 @@ struct ThreadPool {
 
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElement) head;
+    /* Finished requests in completion order, taken from done_list.  */
+    QSIMPLEQ_HEAD(, ThreadPoolElement) completed;
+
+    /*
+     * Finished requests, newest first.  Workers push onto it without
+     * taking lock and the completion BH takes the whole list at once.
+     */
+    QSLIST_HEAD(, ThreadPoolElement) done_list;
 
     /* The following variables are protected by lock.  */
     QTAILQ_HEAD(, ThreadPoolElement) request_list;
@@ -76,6 +90,11 @@ struct ThreadPool {
 static void *worker_thread(void *opaque)
 {
     ThreadPool *pool = opaque;
+    ThreadPlacement *placement;
+    QemuThread self;
+
+    qemu_thread_get_self(&self);
+    placement = thread_placement_add(&self, THREAD_PLACEMENT_WORKER, 0);
 
     qemu_mutex_lock(&pool->lock);
     pool->pending_threads--;
@@ -108,14 +127,16 @@ static void *worker_thread(void *opaque)
         smp_wmb();
         req->state = THREAD_DONE;
 
-        qemu_mutex_lock(&pool->lock);
-
+        QSLIST_INSERT_HEAD_ATOMIC(&pool->done_list, req, next_done);
         qemu_bh_schedule(pool->completion_bh);
+
+        qemu_mutex_lock(&pool->lock);
     }
 
     pool->cur_threads--;
     qemu_cond_signal(&pool->worker_stopped);
     qemu_mutex_unlock(&pool->lock);
+    thread_placement_del(placement);
     return NULL;
 }
 
@@ -159,17 +180,40 @@ static void spawn_thread(ThreadPool *pool)
     }
 }
 
+/*
+ * Return the oldest finished request, refilling the completed queue from
+ * done_list when it runs empty.  Finding a request is O(1) no matter how
+ * many others are still in flight.
+ */
+static ThreadPoolElement *thread_pool_next_done(ThreadPool *pool)
+{
+    ThreadPoolElement *elem;
+
+    if (QSIMPLEQ_EMPTY(&pool->completed)) {
+        QSLIST_HEAD(, ThreadPoolElement) done;
+
+        QSLIST_MOVE_ATOMIC(&done, &pool->done_list);
+        while ((elem = QSLIST_FIRST(&done))) {
+            QSLIST_REMOVE_HEAD(&done, next_done);
+            QSIMPLEQ_INSERT_HEAD(&pool->completed, elem, next_completed);
+        }
+    }
+
+    elem = QSIMPLEQ_FIRST(&pool->completed);
+    if (elem) {
+        QSIMPLEQ_REMOVE_HEAD(&pool->completed, next_completed);
+    }
+    return elem;
+}
+
 static void thread_pool_completion_bh(void *opaque)
 {
     ThreadPool *pool = opaque;
-    ThreadPoolElement *elem, *next;
+    ThreadPoolElement *elem;
 
     aio_context_acquire(pool->ctx);
-restart:
-    QLIST_FOREACH_SAFE(elem, &pool->head, all, next) {
-        if (elem->state != THREAD_DONE) {
-            continue;
-        }
+    while ((elem = thread_pool_next_done(pool))) {
+        assert(elem->state == THREAD_DONE);
 
         trace_thread_pool_complete(pool, elem, elem->common.opaque,
                                    elem->ret);
@@ -189,16 +233,12 @@ restart:
             aio_context_acquire(pool->ctx);
 
             /* We can safely cancel the completion_bh here regardless of someone
-             * else having scheduled it meanwhile because we reenter the
-             * completion function anyway (goto restart).
+             * else having scheduled it meanwhile because we look at
+             * done_list again anyway.
              */
             qemu_bh_cancel(pool->completion_bh);
-
-            qemu_aio_unref(elem);
-            goto restart;
-        } else {
-            qemu_aio_unref(elem);
         }
+        qemu_aio_unref(elem);
     }
     aio_context_release(pool->ctx);
 }
@@ -219,10 +259,11 @@ static void thread_pool_cancel(BlockAIOCB *acb)
          */
         qemu_sem_timedwait(&pool->sem, 0) == 0) {
         QTAILQ_REMOVE(&pool->request_list, elem, reqs);
-        qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
         elem->ret = -ECANCELED;
+        QSLIST_INSERT_HEAD_ATOMIC(&pool->done_list, elem, next_done);
+        qemu_bh_schedule(pool->completion_bh);
     }
 
 }
@@ -310,6 +351,8 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
+    QSIMPLEQ_INIT(&pool->completed);
+    QSLIST_INIT(&pool->done_list);
     QTAILQ_INIT(&pool->request_list);
 }
 